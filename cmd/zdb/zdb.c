@@ -2636,21 +2636,24 @@ zdb_count_block(zdb_cb_t *zcb, zilog_t *zilog, const blkptr_t *bp,
 	if (BP_GET_DEDUP(bp)) {
 		ddt_t *ddt;
 		ddt_entry_t *dde;
+		ddt_phys_t *ddp;
 
 		ddt = ddt_select(zcb->zcb_spa, bp);
-		ddt_enter(ddt);
+		ddt_enter(ddt, &bp->blk_cksum);
 		dde = ddt_lookup(ddt, bp, B_FALSE);
 
 		if (dde == NULL) {
 			refcnt = 0;
+		} else if ((ddp = ddt_phys_select(dde, bp)) == NULL) {
+			/* pruned from the DDT, so an ordinary block now */
+			refcnt = 0;
 		} else {
-			ddt_phys_t *ddp = ddt_phys_select(dde, bp);
 			ddt_phys_decref(ddp);
 			refcnt = ddp->ddp_refcnt;
 			if (ddt_phys_total_refcnt(dde) == 0)
 				ddt_remove(ddt, dde);
 		}
-		ddt_exit(ddt);
+		ddt_exit(ddt, &bp->blk_cksum);
 	}
 
 	VERIFY3U(zio_wait(zio_claim(NULL, zcb->zcb_spa,
@@ -2796,45 +2799,62 @@ static metaslab_ops_t zdb_metaslab_ops = {
 	NULL	/* alloc */
 };
 
+static void
+zdb_ddt_leak_entry(zdb_cb_t *zcb, ddt_t *ddt, const ddt_entry_t *dde)
+{
+	const ddt_phys_t *ddp = dde->dde_phys;
+	blkptr_t blk;
+	int p;
+
+	ASSERT(ddt_phys_total_refcnt(dde) > 1);
+
+	for (p = 0; p < DDT_PHYS_TYPES; p++, ddp++) {
+		if (ddp->ddp_phys_birth == 0)
+			continue;
+		ddt_bp_create(ddt->ddt_checksum, &dde->dde_key, ddp, &blk);
+		if (p == DDT_PHYS_DITTO) {
+			zdb_count_block(zcb, NULL, &blk, ZDB_OT_DITTO);
+		} else {
+			zcb->zcb_dedup_asize +=
+			    BP_GET_ASIZE(&blk) * (ddp->ddp_refcnt - 1);
+			zcb->zcb_dedup_blocks++;
+		}
+	}
+	if (!dump_opt['L']) {
+		ddt_enter(ddt, &blk.blk_cksum);
+		VERIFY(ddt_lookup(ddt, &blk, B_TRUE) != NULL);
+		ddt_exit(ddt, &blk.blk_cksum);
+	}
+}
+
+static void
+zdb_ddt_leak_log_entry(void *arg, ddt_t *ddt, const ddt_entry_t *dde)
+{
+	if (dde->dde_class != DDT_CLASS_UNIQUE)
+		zdb_ddt_leak_entry(arg, ddt, dde);
+}
+
 static void
 zdb_ddt_leak_init(spa_t *spa, zdb_cb_t *zcb)
 {
 	ddt_bookmark_t ddb = { 0 };
 	ddt_entry_t dde;
+	enum zio_checksum c;
 	int error;
-	int p;
 
 	while ((error = ddt_walk(spa, &ddb, &dde)) == 0) {
-		blkptr_t blk;
-		ddt_phys_t *ddp = dde.dde_phys;
-
 		if (ddb.ddb_class == DDT_CLASS_UNIQUE)
-			return;
-
-		ASSERT(ddt_phys_total_refcnt(&dde) > 1);
-
-		for (p = 0; p < DDT_PHYS_TYPES; p++, ddp++) {
-			if (ddp->ddp_phys_birth == 0)
-				continue;
-			ddt_bp_create(ddb.ddb_checksum,
-			    &dde.dde_key, ddp, &blk);
-			if (p == DDT_PHYS_DITTO) {
-				zdb_count_block(zcb, NULL, &blk, ZDB_OT_DITTO);
-			} else {
-				zcb->zcb_dedup_asize +=
-				    BP_GET_ASIZE(&blk) * (ddp->ddp_refcnt - 1);
-				zcb->zcb_dedup_blocks++;
-			}
-		}
-		if (!dump_opt['L']) {
-			ddt_t *ddt = spa->spa_ddt[ddb.ddb_checksum];
-			ddt_enter(ddt);
-			VERIFY(ddt_lookup(ddt, &blk, B_TRUE) != NULL);
-			ddt_exit(ddt);
-		}
+			break;
+		zdb_ddt_leak_entry(zcb, spa->spa_ddt[ddb.ddb_checksum], &dde);
 	}
 
-	ASSERT(error == ENOENT);
+	ASSERT(error == 0 || error == ENOENT);
+
+	/*
+	 * ddt_walk() skips the entries that are in the dedup logs.
+	 */
+	for (c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++)
+		ddt_log_walk(spa->spa_ddt[c], zdb_ddt_leak_log_entry, zcb);
 }
 
 static void
@@ -2890,6 +2910,17 @@ zdb_leak_init(spa_t *spa, zdb_cb_t *zcb)
 					VERIFY0(space_map_load(msp->ms_sm,
 					    msp->ms_tree, SM_ALLOC));
 
+					/*
+					 * Add the changes that are only in
+					 * the log space maps.
+					 */
+					range_tree_walk(
+					    msp->ms_unflushed_allocs,
+					    range_tree_add, msp->ms_tree);
+					range_tree_walk(
+					    msp->ms_unflushed_frees,
+					    range_tree_remove, msp->ms_tree);
+
 					if (!msp->ms_loaded) {
 						msp->ms_loaded = B_TRUE;
 					}
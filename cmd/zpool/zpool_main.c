@@ -92,6 +92,8 @@ static int zpool_do_replace(int, char **);
 static int zpool_do_split(int, char **);
 
 static int zpool_do_scrub(int, char **);
+static int zpool_do_trim(int, char **);
+static int zpool_do_ddtprune(int, char **);
 
 static int zpool_do_import(int, char **);
 static int zpool_do_export(int, char **);
@@ -141,6 +143,8 @@ typedef enum {
 	HELP_REPLACE,
 	HELP_REMOVE,
 	HELP_SCRUB,
+	HELP_TRIM,
+	HELP_DDTPRUNE,
 	HELP_STATUS,
 	HELP_UPGRADE,
 	HELP_EVENTS,
@@ -265,6 +269,8 @@ static zpool_command_t command_table[] = {
 	{ "split",	zpool_do_split,		HELP_SPLIT		},
 	{ NULL },
 	{ "scrub",	zpool_do_scrub,		HELP_SCRUB		},
+	{ "trim",	zpool_do_trim,		HELP_TRIM		},
+	{ "ddtprune",	zpool_do_ddtprune,	HELP_DDTPRUNE		},
 	{ NULL },
 	{ "import",	zpool_do_import,	HELP_IMPORT		},
 	{ "export",	zpool_do_export,	HELP_EXPORT		},
@@ -342,6 +348,10 @@ get_usage(zpool_help_t idx) {
 		return (gettext("\treopen <pool>\n"));
 	case HELP_SCRUB:
 		return (gettext("\tscrub [-s | -p] <pool> ...\n"));
+	case HELP_TRIM:
+		return (gettext("\ttrim [-s | -r <rate>] <pool> ...\n"));
+	case HELP_DDTPRUNE:
+		return (gettext("\tddtprune -p <percent> <pool>\n"));
 	case HELP_STATUS:
 		return (gettext("\tstatus [-gLPvxD] [-T d|u] [pool] ... "
 		    "[interval [count]]\n"));
@@ -454,9 +464,26 @@ usage(boolean_t requested)
 	exit(requested ? 0 : 2);
 }
 
+/*
+ * The classes of top-level vdevs that are listed in their own section after
+ * the normal class, in display order.
+ */
+static const struct {
+	const char	*vc_class;
+	const char	*vc_title;
+} vdev_classes[] = {
+	{ VDEV_ALLOC_BIAS_DEDUP,	"dedup" },
+	{ VDEV_ALLOC_BIAS_SPECIAL,	"special" },
+	{ VDEV_TYPE_LOG,		"logs" },
+};
+
+/*
+ * Print the top-level vdevs of the given class (see vdev_in_class()), and
+ * everything below them.
+ */
 void
 print_vdev_tree(zpool_handle_t *zhp, const char *name, nvlist_t *nv, int indent,
-    boolean_t print_logs, int name_flags)
+    const char *class, int name_flags)
 {
 	nvlist_t **child;
 	uint_t c, children;
@@ -470,16 +497,12 @@ print_vdev_tree(zpool_handle_t *zhp, const char *name, nvlist_t *nv, int indent,
 		return;
 
 	for (c = 0; c < children; c++) {
-		uint64_t is_log = B_FALSE;
-
-		(void) nvlist_lookup_uint64(child[c], ZPOOL_CONFIG_IS_LOG,
-		    &is_log);
-		if ((is_log && !print_logs) || (!is_log && print_logs))
+		if (!vdev_in_class(child[c], class))
 			continue;
 
 		vname = zpool_vdev_name(g_zfs, zhp, child[c], name_flags);
 		print_vdev_tree(zhp, vname, child[c], indent + 2,
-		    B_FALSE, name_flags);
+		    NULL, name_flags);
 		free(vname);
 	}
 }
@@ -704,19 +727,24 @@ zpool_do_add(int argc, char **argv)
 		    "configuration:\n"), zpool_get_name(zhp));
 
 		/* print original main pool and new tree */
-		print_vdev_tree(zhp, poolname, poolnvroot, 0, B_FALSE,
+		print_vdev_tree(zhp, poolname, poolnvroot, 0, NULL,
 		    name_flags);
-		print_vdev_tree(zhp, NULL, nvroot, 0, B_FALSE, name_flags);
-
-		/* Do the same for the logs */
-		if (num_logs(poolnvroot) > 0) {
-			print_vdev_tree(zhp, "logs", poolnvroot, 0, B_TRUE,
-			    name_flags);
-			print_vdev_tree(zhp, NULL, nvroot, 0, B_TRUE,
-			    name_flags);
-		} else if (num_logs(nvroot) > 0) {
-			print_vdev_tree(zhp, "logs", nvroot, 0, B_TRUE,
-			    name_flags);
+		print_vdev_tree(zhp, NULL, nvroot, 0, NULL, name_flags);
+
+		/* Do the same for the dedup, special and log classes */
+		for (c = 0; c < ARRAY_SIZE(vdev_classes); c++) {
+			const char *class = vdev_classes[c].vc_class;
+			const char *title = vdev_classes[c].vc_title;
+
+			if (num_class(poolnvroot, class) > 0) {
+				print_vdev_tree(zhp, title, poolnvroot, 0,
+				    class, name_flags);
+				print_vdev_tree(zhp, NULL, nvroot, 0, class,
+				    name_flags);
+			} else if (num_class(nvroot, class) > 0) {
+				print_vdev_tree(zhp, title, nvroot, 0, class,
+				    name_flags);
+			}
 		}
 
 		/* Do the same for the caches */
@@ -1211,9 +1239,13 @@ zpool_do_create(int argc, char **argv)
 		(void) printf(gettext("would create '%s' with the "
 		    "following layout:\n\n"), poolname);
 
-		print_vdev_tree(NULL, poolname, nvroot, 0, B_FALSE, 0);
-		if (num_logs(nvroot) > 0)
-			print_vdev_tree(NULL, "logs", nvroot, 0, B_TRUE, 0);
+		print_vdev_tree(NULL, poolname, nvroot, 0, NULL, 0);
+		for (c = 0; c < ARRAY_SIZE(vdev_classes); c++) {
+			if (num_class(nvroot, vdev_classes[c].vc_class) > 0) {
+				print_vdev_tree(NULL, vdev_classes[c].vc_title,
+				    nvroot, 0, vdev_classes[c].vc_class, 0);
+			}
+		}
 
 		ret = 0;
 	} else {
@@ -1659,14 +1691,12 @@ print_status_config(zpool_handle_t *zhp, const char *name, nvlist_t *nv,
 	(void) printf("\n");
 
 	for (c = 0; c < children; c++) {
-		uint64_t islog = B_FALSE, ishole = B_FALSE;
+		uint64_t ishole = B_FALSE;
 
-		/* Don't print logs or holes here */
-		(void) nvlist_lookup_uint64(child[c], ZPOOL_CONFIG_IS_LOG,
-		    &islog);
+		/* Don't print logs, other classes or holes here */
 		(void) nvlist_lookup_uint64(child[c], ZPOOL_CONFIG_IS_HOLE,
 		    &ishole);
-		if (islog || ishole)
+		if (!vdev_in_class(child[c], NULL) || ishole)
 			continue;
 		vname = zpool_vdev_name(g_zfs, zhp, child[c],
 		    name_flags | VDEV_NAME_TYPE_ID);
@@ -1741,11 +1771,7 @@ print_import_config(const char *name, nvlist_t *nv, int namewidth, int depth,
 		return;
 
 	for (c = 0; c < children; c++) {
-		uint64_t is_log = B_FALSE;
-
-		(void) nvlist_lookup_uint64(child[c], ZPOOL_CONFIG_IS_LOG,
-		    &is_log);
-		if (is_log)
+		if (!vdev_in_class(child[c], NULL))
 			continue;
 
 		vname = zpool_vdev_name(g_zfs, NULL, child[c],
@@ -1779,16 +1805,17 @@ print_import_config(const char *name, nvlist_t *nv, int namewidth, int depth,
 }
 
 /*
- * Print log vdevs.
- * Logs are recorded as top level vdevs in the main pool child array
- * but with "is_log" set to 1. We use either print_status_config() or
- * print_import_config() to print the top level logs then any log
- * children (eg mirrored slogs) are printed recursively - which
- * works because only the top level vdev is marked "is_log"
+ * Print log, special or dedup vdevs.
+ * These are recorded as top level vdevs in the main pool child array,
+ * with "is_log" set to 1 for logs and an allocation bias for the other
+ * classes. We use either print_status_config() or print_import_config()
+ * to print the top level vdevs of the class then any children (eg
+ * mirrored slogs) are printed recursively - which works because only
+ * the top level vdev carries the class.
  */
 static void
-print_logs(zpool_handle_t *zhp, nvlist_t *nv, int namewidth, boolean_t verbose,
-    int name_flags)
+print_class_vdevs(zpool_handle_t *zhp, nvlist_t *nv, int namewidth,
+    boolean_t verbose, const char *class, const char *title, int name_flags)
 {
 	uint_t c, children;
 	nvlist_t **child;
@@ -1797,15 +1824,12 @@ print_logs(zpool_handle_t *zhp, nvlist_t *nv, int namewidth, boolean_t verbose,
 	    &children) != 0)
 		return;
 
-	(void) printf(gettext("\tlogs\n"));
+	(void) printf("\t%s\n", title);
 
 	for (c = 0; c < children; c++) {
-		uint64_t is_log = B_FALSE;
 		char *name;
 
-		(void) nvlist_lookup_uint64(child[c], ZPOOL_CONFIG_IS_LOG,
-		    &is_log);
-		if (!is_log)
+		if (!vdev_in_class(child[c], class))
 			continue;
 		name = zpool_vdev_name(g_zfs, zhp, child[c],
 		    name_flags | VDEV_NAME_TYPE_ID);
@@ -1835,7 +1859,7 @@ show_import(nvlist_t *config)
 	zpool_status_t reason;
 	zpool_errata_t errata;
 	const char *health;
-	uint_t vsc;
+	uint_t vsc, c;
 	int namewidth;
 	char *comment;
 
@@ -2069,8 +2093,13 @@ show_import(nvlist_t *config)
 		namewidth = 10;
 
 	print_import_config(name, nvroot, namewidth, 0, 0);
-	if (num_logs(nvroot) > 0)
-		print_logs(NULL, nvroot, namewidth, B_FALSE, 0);
+	for (c = 0; c < ARRAY_SIZE(vdev_classes); c++) {
+		if (num_class(nvroot, vdev_classes[c].vc_class) > 0) {
+			print_class_vdevs(NULL, nvroot, namewidth, B_FALSE,
+			    vdev_classes[c].vc_class, vdev_classes[c].vc_title,
+			    0);
+		}
+	}
 
 	if (reason == ZPOOL_STATUS_BAD_GUID_SUM) {
 		(void) printf(gettext("\n\tAdditional devices are known to "
@@ -3381,7 +3410,7 @@ print_vdev_stats(zpool_handle_t *zhp, const char *name, nvlist_t *oldnv,
     nvlist_t *newnv, iostat_cbdata_t *cb, int depth)
 {
 	nvlist_t **oldchild, **newchild;
-	uint_t c, children;
+	uint_t c, n, children;
 	vdev_stat_t *oldvs, *newvs, *calcvs;
 	vdev_stat_t zerovs = { 0 };
 	char *vname;
@@ -3487,15 +3516,12 @@ children:
 		return (ret);
 
 	for (c = 0; c < children; c++) {
-		uint64_t ishole = B_FALSE, islog = B_FALSE;
+		uint64_t ishole = B_FALSE;
 
 		(void) nvlist_lookup_uint64(newchild[c], ZPOOL_CONFIG_IS_HOLE,
 		    &ishole);
 
-		(void) nvlist_lookup_uint64(newchild[c], ZPOOL_CONFIG_IS_LOG,
-		    &islog);
-
-		if (ishole || islog)
+		if (ishole || !vdev_in_class(newchild[c], NULL))
 			continue;
 
 		vname = zpool_vdev_name(g_zfs, zhp, newchild[c],
@@ -3506,30 +3532,29 @@ children:
 	}
 
 	/*
-	 * Log device section
+	 * Dedup, special and log device sections
 	 */
+	for (n = 0; n < ARRAY_SIZE(vdev_classes); n++) {
+		const char *class = vdev_classes[n].vc_class;
+
+		if (num_class(newnv, class) == 0)
+			continue;
 
-	if (num_logs(newnv) > 0) {
 		if ((!(cb->cb_flags & IOS_ANYHISTO_M)) && !cb->cb_scripted &&
 		    !cb->cb_vdev_names) {
-			print_iostat_dashes(cb, 0, "logs");
+			print_iostat_dashes(cb, 0, vdev_classes[n].vc_title);
 		}
 
 		for (c = 0; c < children; c++) {
-			uint64_t islog = B_FALSE;
-			(void) nvlist_lookup_uint64(newchild[c],
-			    ZPOOL_CONFIG_IS_LOG, &islog);
-
-			if (islog) {
-				vname = zpool_vdev_name(g_zfs, zhp, newchild[c],
-				    cb->cb_name_flags);
-				ret += print_vdev_stats(zhp, vname, oldnv ?
-				    oldchild[c] : NULL, newchild[c],
-				    cb, depth + 2);
-				free(vname);
-			}
-		}
+			if (!vdev_in_class(newchild[c], class))
+				continue;
 
+			vname = zpool_vdev_name(g_zfs, zhp, newchild[c],
+			    cb->cb_name_flags);
+			ret += print_vdev_stats(zhp, vname, oldnv ?
+			    oldchild[c] : NULL, newchild[c], cb, depth + 2);
+			free(vname);
+		}
 	}
 
 	/*
@@ -4503,11 +4528,9 @@ print_list_stats(zpool_handle_t *zhp, const char *name, nvlist_t *nv,
 {
 	nvlist_t **child;
 	vdev_stat_t *vs;
-	uint_t c, children;
+	uint_t c, n, children;
 	char *vname;
 	boolean_t scripted = cb->cb_scripted;
-	uint64_t islog = B_FALSE;
-	boolean_t haslog = B_FALSE;
 	char *dashes = "%-*s      -      -      -         -      -      -\n";
 
 	verify(nvlist_lookup_uint64_array(nv, ZPOOL_CONFIG_VDEV_STATS,
@@ -4559,11 +4582,8 @@ print_list_stats(zpool_handle_t *zhp, const char *name, nvlist_t *nv,
 		    ZPOOL_CONFIG_IS_HOLE, &ishole) == 0 && ishole)
 			continue;
 
-		if (nvlist_lookup_uint64(child[c],
-		    ZPOOL_CONFIG_IS_LOG, &islog) == 0 && islog) {
-			haslog = B_TRUE;
+		if (!vdev_in_class(child[c], NULL))
 			continue;
-		}
 
 		vname = zpool_vdev_name(g_zfs, zhp, child[c],
 		    cb->cb_name_flags);
@@ -4571,12 +4591,17 @@ print_list_stats(zpool_handle_t *zhp, const char *name, nvlist_t *nv,
 		free(vname);
 	}
 
-	if (haslog == B_TRUE) {
+	for (n = 0; n < ARRAY_SIZE(vdev_classes); n++) {
+		const char *class = vdev_classes[n].vc_class;
+
+		if (num_class(nv, class) == 0)
+			continue;
+
 		/* LINTED E_SEC_PRINTF_VAR_FMT */
-		(void) printf(dashes, cb->cb_namewidth, "log");
+		(void) printf(dashes, cb->cb_namewidth,
+		    vdev_classes[n].vc_title);
 		for (c = 0; c < children; c++) {
-			if (nvlist_lookup_uint64(child[c], ZPOOL_CONFIG_IS_LOG,
-			    &islog) != 0 || !islog)
+			if (!vdev_in_class(child[c], class))
 				continue;
 			vname = zpool_vdev_name(g_zfs, zhp, child[c],
 			    cb->cb_name_flags);
@@ -5081,7 +5106,7 @@ zpool_do_split(int argc, char **argv)
 		if (flags.dryrun) {
 			(void) printf(gettext("would create '%s' with the "
 			    "following layout:\n\n"), newpool);
-			print_vdev_tree(NULL, newpool, config, 0, B_FALSE,
+			print_vdev_tree(NULL, newpool, config, 0, NULL,
 			    flags.name_flags);
 		}
 	}
@@ -5513,6 +5538,157 @@ zpool_do_scrub(int argc, char **argv)
 	return (for_each_pool(argc, argv, B_TRUE, NULL, scrub_callback, &cb));
 }
 
+typedef struct trim_cbdata {
+	pool_trim_func_t cb_func;
+	uint64_t	cb_rate;
+} trim_cbdata_t;
+
+int
+trim_callback(zpool_handle_t *zhp, void *data)
+{
+	trim_cbdata_t *cb = data;
+
+	/*
+	 * Ignore faulted pools.
+	 */
+	if (zpool_get_state(zhp) == POOL_STATE_UNAVAIL) {
+		(void) fprintf(stderr, gettext("cannot trim '%s': pool is "
+		    "currently unavailable\n"), zpool_get_name(zhp));
+		return (1);
+	}
+
+	return (zpool_trim(zhp, cb->cb_func, cb->cb_rate) != 0);
+}
+
+/*
+ * zpool trim [-s | -r <rate>] <pool> ...
+ *
+ *	-s		Stop.  Stops any in-progress trim.
+ *	-r <rate>	Limit the trim to <rate> bytes per second.
+ */
+int
+zpool_do_trim(int argc, char **argv)
+{
+	int c;
+	trim_cbdata_t cb;
+
+	cb.cb_func = POOL_TRIM_START;
+	cb.cb_rate = 0;
+
+	/* check options */
+	while ((c = getopt(argc, argv, "sr:")) != -1) {
+		switch (c) {
+		case 's':
+			cb.cb_func = POOL_TRIM_CANCEL;
+			break;
+		case 'r':
+			if (zfs_nicestrtonum(g_zfs, optarg, &cb.cb_rate) != 0 ||
+			    cb.cb_rate == 0) {
+				(void) fprintf(stderr,
+				    gettext("invalid rate '%s'\n"), optarg);
+				usage(B_FALSE);
+			}
+			break;
+		case ':':
+			(void) fprintf(stderr, gettext("missing argument for "
+			    "'%c' option\n"), optopt);
+			usage(B_FALSE);
+			break;
+		case '?':
+			(void) fprintf(stderr, gettext("invalid option '%c'\n"),
+			    optopt);
+			usage(B_FALSE);
+		}
+	}
+
+	if (cb.cb_func == POOL_TRIM_CANCEL && cb.cb_rate != 0) {
+		(void) fprintf(stderr, gettext("invalid option combination: "
+		    "-s and -r are mutually exclusive\n"));
+		usage(B_FALSE);
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1) {
+		(void) fprintf(stderr, gettext("missing pool name argument\n"));
+		usage(B_FALSE);
+	}
+
+	return (for_each_pool(argc, argv, B_TRUE, NULL, trim_callback, &cb));
+}
+
+/*
+ * zpool ddtprune -p <percent> <pool>
+ *
+ *	-p <percent>	Prune the oldest <percent> percent of the unique
+ *			entries of the dedup table.
+ */
+int
+zpool_do_ddtprune(int argc, char **argv)
+{
+	zpool_handle_t *zhp;
+	uint64_t percent = 0, pruned = 0;
+	char *end;
+	int c, ret;
+
+	/* check options */
+	while ((c = getopt(argc, argv, "p:")) != -1) {
+		switch (c) {
+		case 'p':
+			errno = 0;
+			percent = strtoull(optarg, &end, 10);
+			if (errno != 0 || *end != '\0' || percent == 0 ||
+			    percent > 100) {
+				(void) fprintf(stderr,
+				    gettext("invalid percentage '%s'\n"),
+				    optarg);
+				usage(B_FALSE);
+			}
+			break;
+		case ':':
+			(void) fprintf(stderr, gettext("missing argument for "
+			    "'%c' option\n"), optopt);
+			usage(B_FALSE);
+			break;
+		case '?':
+			(void) fprintf(stderr, gettext("invalid option '%c'\n"),
+			    optopt);
+			usage(B_FALSE);
+		}
+	}
+
+	if (percent == 0) {
+		(void) fprintf(stderr, gettext("missing -p option\n"));
+		usage(B_FALSE);
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1) {
+		(void) fprintf(stderr, gettext("missing pool name argument\n"));
+		usage(B_FALSE);
+	}
+	if (argc > 1) {
+		(void) fprintf(stderr, gettext("too many arguments\n"));
+		usage(B_FALSE);
+	}
+
+	if ((zhp = zpool_open(g_zfs, argv[0])) == NULL)
+		return (1);
+
+	ret = (zpool_ddt_prune(zhp, percent, &pruned) != 0);
+	if (ret == 0) {
+		(void) printf(gettext("pruned %llu dedup table entries\n"),
+		    (u_longlong_t)pruned);
+	}
+
+	zpool_close(zhp);
+
+	return (ret);
+}
+
 typedef struct status_cbdata {
 	int		cb_count;
 	int		cb_name_flags;
@@ -5532,10 +5708,11 @@ print_scan_status(pool_scan_stat_t *ps)
 {
 	time_t start, end, pause;
 	uint64_t elapsed, mins_left, hours_left;
-	uint64_t pass_exam, examined, total;
-	uint_t rate;
+	uint64_t pass_exam, pass_issued, examined, issued, total;
+	uint_t rate, issue_rate;
 	double fraction_done;
-	char processed_buf[7], examined_buf[7], total_buf[7], rate_buf[7];
+	char processed_buf[7], examined_buf[7], issued_buf[7], total_buf[7];
+	char rate_buf[7], issue_rate_buf[7];
 
 	(void) printf(gettext("  scan: "));
 
@@ -5607,21 +5784,33 @@ print_scan_status(pool_scan_stat_t *ps)
 		    ctime(&start));
 	}
 
-	examined = ps->pss_examined ? ps->pss_examined : 1;
+	/*
+	 * A scan first examines blocks and then issues the reads for those
+	 * that need them, sorted by their location on disk, so progress is
+	 * measured by the bytes issued.
+	 */
+	examined = ps->pss_examined;
+	issued = ps->pss_issued ? ps->pss_issued : 1;
 	total = ps->pss_to_examine;
-	fraction_done = (double)examined / total;
+	if (issued > total)
+		issued = total;
+	fraction_done = (double)issued / (total ? total : 1);
 
 	/* elapsed time for this pass */
 	elapsed = time(NULL) - ps->pss_pass_start;
 	elapsed -= ps->pss_pass_scrub_spent_paused;
 	elapsed = elapsed ? elapsed : 1;
 	pass_exam = ps->pss_pass_exam ? ps->pss_pass_exam : 1;
+	pass_issued = ps->pss_pass_issued ? ps->pss_pass_issued : 1;
 	rate = pass_exam / elapsed;
 	rate = rate ? rate : 1;
-	mins_left = ((total - examined) / rate) / 60;
+	issue_rate = pass_issued / elapsed;
+	issue_rate = issue_rate ? issue_rate : 1;
+	mins_left = ((total - issued) / issue_rate) / 60;
 	hours_left = mins_left / 60;
 
 	zfs_nicenum(examined, examined_buf, sizeof (examined_buf));
+	zfs_nicenum(issued, issued_buf, sizeof (issued_buf));
 	zfs_nicenum(total, total_buf, sizeof (total_buf));
 
 	/*
@@ -5630,8 +5819,26 @@ print_scan_status(pool_scan_stat_t *ps)
 	 */
 	if (pause == 0) {
 		zfs_nicenum(rate, rate_buf, sizeof (rate_buf));
-		(void) printf(gettext("\t%s scanned out of %s at %s/s"),
-		    examined_buf, total_buf, rate_buf);
+		zfs_nicenum(issue_rate, issue_rate_buf,
+		    sizeof (issue_rate_buf));
+		(void) printf(gettext("\t%s scanned at %s/s, "
+		    "%s issued at %s/s, %s total\n"),
+		    examined_buf, rate_buf, issued_buf, issue_rate_buf,
+		    total_buf);
+	} else {
+		(void) printf(gettext("\t%s scanned, %s issued, %s total\n"),
+		    examined_buf, issued_buf, total_buf);
+	}
+
+	if (ps->pss_func == POOL_SCAN_RESILVER) {
+		(void) printf(gettext("    %s resilvered, %.2f%% done"),
+		    processed_buf, 100 * fraction_done);
+	} else if (ps->pss_func == POOL_SCAN_SCRUB) {
+		(void) printf(gettext("    %s repaired, %.2f%% done"),
+		    processed_buf, 100 * fraction_done);
+	}
+
+	if (pause == 0) {
 		if (hours_left < (30 * 24)) {
 			(void) printf(gettext(", %lluh%um to go\n"),
 			    (u_longlong_t)hours_left, (uint_t)(mins_left % 60));
@@ -5640,17 +5847,50 @@ print_scan_status(pool_scan_stat_t *ps)
 			    ", (scan is slow, no estimated time)\n"));
 		}
 	} else {
-		(void) printf(gettext("\t%s scanned out of %s\n"),
-		    examined_buf, total_buf);
+		(void) printf("\n");
 	}
+}
 
-	if (ps->pss_func == POOL_SCAN_RESILVER) {
-		(void) printf(gettext("    %s resilvered, %.2f%% done\n"),
-		    processed_buf, 100 * fraction_done);
-	} else if (ps->pss_func == POOL_SCAN_SCRUB) {
-		(void) printf(gettext("    %s repaired, %.2f%% done\n"),
-		    processed_buf, 100 * fraction_done);
+/*
+ * Print out the progress of the current or last manual trim.
+ */
+static void
+print_trim_status(pool_trim_stat_t *pts)
+{
+	time_t start, end;
+	char trimmed_buf[7], examined_buf[7], total_buf[7];
+	double fraction_done;
+
+	if (pts == NULL || pts->pts_state == POOL_TRIM_NONE ||
+	    pts->pts_state >= POOL_TRIM_NUM_STATES)
+		return;
+
+	start = pts->pts_start_time;
+	end = pts->pts_end_time;
+	zfs_nicenum(pts->pts_trimmed, trimmed_buf, sizeof (trimmed_buf));
+
+	(void) printf(gettext("  trim: "));
+
+	if (pts->pts_state == POOL_TRIM_FINISHED) {
+		(void) printf(gettext("%s trimmed on %s"), trimmed_buf,
+		    ctime(&end));
+		return;
+	} else if (pts->pts_state == POOL_TRIM_CANCELED) {
+		(void) printf(gettext("%s trimmed, canceled on %s"),
+		    trimmed_buf, ctime(&end));
+		return;
 	}
+
+	(void) printf(gettext("trim in progress since %s"), ctime(&start));
+
+	zfs_nicenum(pts->pts_examined, examined_buf, sizeof (examined_buf));
+	zfs_nicenum(pts->pts_to_examine, total_buf, sizeof (total_buf));
+	fraction_done = (double)pts->pts_examined /
+	    (pts->pts_to_examine ? pts->pts_to_examine : 1);
+
+	(void) printf(gettext("\t%s scanned of %s, %s trimmed, "
+	    "%.2f%% done\n"), examined_buf, total_buf, trimmed_buf,
+	    100 * fraction_done);
 }
 
 static void
@@ -5728,12 +5968,46 @@ print_l2cache(zpool_handle_t *zhp, nvlist_t **l2cache, uint_t nl2cache,
 	}
 }
 
+/*
+ * Print the DDT's limit and the results of pruning it, e.g.:
+ *
+ *  DDT limit 1000000 entries, 93% used, 712093 unique
+ *  pruned 104857 entries since import, last on Tue Oct 13 10:12:44 2026
+ */
+static void
+print_ddt_prune_stats(ddt_prune_stat_t *dps)
+{
+	time_t when = dps->dps_prune_time;
+
+	if (dps->dps_max_entries != 0) {
+		(void) printf(gettext(" DDT limit %llu entries, %llu%% used, "
+		    "%llu unique\n"), (u_longlong_t)dps->dps_max_entries,
+		    (u_longlong_t)(dps->dps_entries * 100 /
+		    dps->dps_max_entries), (u_longlong_t)dps->dps_unique);
+	}
+	if (dps->dps_bypassed != 0) {
+		(void) printf(gettext(" %llu blocks written without dedup "
+		    "because the DDT was full\n"),
+		    (u_longlong_t)dps->dps_bypassed);
+	}
+	if (dps->dps_prune_time != 0) {
+		(void) printf(gettext(" pruned %llu entries since import, "
+		    "last on %s"), (u_longlong_t)dps->dps_pruned,
+		    ctime(&when));
+	}
+	if (dps->dps_logged != 0) {
+		(void) printf(gettext(" %llu entries in the dedup log\n"),
+		    (u_longlong_t)dps->dps_logged);
+	}
+}
+
 static void
 print_dedup_stats(nvlist_t *config)
 {
 	ddt_histogram_t *ddh;
 	ddt_stat_t *dds;
 	ddt_object_t *ddo;
+	ddt_prune_stat_t *dps;
 	uint_t c;
 
 	/*
@@ -5757,6 +6031,10 @@ print_dedup_stats(nvlist_t *config)
 	    (u_longlong_t)ddo->ddo_dspace,
 	    (u_longlong_t)ddo->ddo_mspace);
 
+	if (nvlist_lookup_uint64_array(config, ZPOOL_CONFIG_DDT_PRUNE_STATS,
+	    (uint64_t **)&dps, &c) == 0)
+		print_ddt_prune_stats(dps);
+
 	verify(nvlist_lookup_uint64_array(config, ZPOOL_CONFIG_DDT_STATS,
 	    (uint64_t **)&dds, &c) == 0);
 	verify(nvlist_lookup_uint64_array(config, ZPOOL_CONFIG_DDT_HISTOGRAM,
@@ -6060,11 +6338,16 @@ status_callback(zpool_handle_t *zhp, void *data)
 		nvlist_t **spares, **l2cache;
 		uint_t nspares, nl2cache;
 		pool_scan_stat_t *ps = NULL;
+		pool_trim_stat_t *pts = NULL;
 
 		(void) nvlist_lookup_uint64_array(nvroot,
 		    ZPOOL_CONFIG_SCAN_STATS, (uint64_t **)&ps, &c);
 		print_scan_status(ps);
 
+		(void) nvlist_lookup_uint64_array(nvroot,
+		    ZPOOL_CONFIG_TRIM_STATS, (uint64_t **)&pts, &c);
+		print_trim_status(pts);
+
 		namewidth = max_width(zhp, nvroot, 0, 0, cbp->cb_name_flags);
 		if (namewidth < 10)
 			namewidth = 10;
@@ -6075,9 +6358,14 @@ status_callback(zpool_handle_t *zhp, void *data)
 		print_status_config(zhp, zpool_get_name(zhp), nvroot,
 		    namewidth, 0, B_FALSE, cbp->cb_name_flags);
 
-		if (num_logs(nvroot) > 0)
-			print_logs(zhp, nvroot, namewidth, B_TRUE,
-			    cbp->cb_name_flags);
+		for (c = 0; c < ARRAY_SIZE(vdev_classes); c++) {
+			if (num_class(nvroot, vdev_classes[c].vc_class) > 0) {
+				print_class_vdevs(zhp, nvroot, namewidth,
+				    B_TRUE, vdev_classes[c].vc_class,
+				    vdev_classes[c].vc_title,
+				    cbp->cb_name_flags);
+			}
+		}
 		if (nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_L2CACHE,
 		    &l2cache, &nl2cache) == 0)
 			print_l2cache(zhp, l2cache, nl2cache, namewidth,
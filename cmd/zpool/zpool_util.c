@@ -86,6 +86,51 @@ num_logs(nvlist_t *nv)
 	return (nlogs);
 }
 
+/*
+ * Check whether a top-level vdev belongs to the given class: VDEV_TYPE_LOG
+ * for separate logs, an allocation bias for special and dedup vdevs, or
+ * NULL for the normal class.
+ */
+boolean_t
+vdev_in_class(nvlist_t *nv, const char *class)
+{
+	uint64_t is_log = B_FALSE;
+	char *bias = NULL;
+
+	(void) nvlist_lookup_uint64(nv, ZPOOL_CONFIG_IS_LOG, &is_log);
+	if (is_log)
+		bias = VDEV_TYPE_LOG;
+	else
+		(void) nvlist_lookup_string(nv, ZPOOL_CONFIG_ALLOCATION_BIAS,
+		    &bias);
+
+	if (bias == NULL || class == NULL)
+		return (bias == class);
+	return (strcmp(bias, class) == 0);
+}
+
+/*
+ * Return the number of top-level vdevs of the given class in the supplied
+ * nvlist, where a NULL class selects the normal class.
+ */
+uint_t
+num_class(nvlist_t *nv, const char *class)
+{
+	uint_t nclass = 0;
+	uint_t c, children;
+	nvlist_t **child;
+
+	if (nvlist_lookup_nvlist_array(nv, ZPOOL_CONFIG_CHILDREN,
+	    &child, &children) != 0)
+		return (0);
+
+	for (c = 0; c < children; c++) {
+		if (vdev_in_class(child[c], class))
+			nclass++;
+	}
+	return (nclass);
+}
+
 /* Find the max element in an array of uint64_t values */
 uint64_t
 array64_max(uint64_t array[], unsigned int len) {
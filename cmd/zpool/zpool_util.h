@@ -39,6 +39,8 @@ extern "C" {
 void *safe_malloc(size_t);
 void zpool_no_memory(void);
 uint_t num_logs(nvlist_t *nv);
+boolean_t vdev_in_class(nvlist_t *nv, const char *class);
+uint_t num_class(nvlist_t *nv, const char *class);
 uint64_t array64_max(uint64_t array[], unsigned int len);
 int zfs_isnumber(char *str);
 
@@ -1477,6 +1477,18 @@ is_grouping(const char *type, int *mindev, int *maxdev)
 		return (VDEV_TYPE_LOG);
 	}
 
+	if (strcmp(type, VDEV_ALLOC_BIAS_SPECIAL) == 0) {
+		if (mindev != NULL)
+			*mindev = 1;
+		return (VDEV_ALLOC_BIAS_SPECIAL);
+	}
+
+	if (strcmp(type, VDEV_ALLOC_BIAS_DEDUP) == 0) {
+		if (mindev != NULL)
+			*mindev = 1;
+		return (VDEV_ALLOC_BIAS_DEDUP);
+	}
+
 	if (strcmp(type, "cache") == 0) {
 		if (mindev != NULL)
 			*mindev = 1;
@@ -1497,9 +1509,11 @@ construct_spec(nvlist_t *props, int argc, char **argv)
 {
 	nvlist_t *nvroot, *nv, **top, **spares, **l2cache;
 	int t, toplevels, mindev, maxdev, nspares, nlogs, nl2cache;
+	int nspecial, ndedup;
 	const char *type;
+	const char *alloc_bias;
 	uint64_t is_log;
-	boolean_t seen_logs;
+	boolean_t seen_logs, seen_special, seen_dedup;
 
 	top = NULL;
 	toplevels = 0;
@@ -1508,8 +1522,13 @@ construct_spec(nvlist_t *props, int argc, char **argv)
 	nspares = 0;
 	nlogs = 0;
 	nl2cache = 0;
+	nspecial = 0;
+	ndedup = 0;
 	is_log = B_FALSE;
+	alloc_bias = NULL;
 	seen_logs = B_FALSE;
+	seen_special = B_FALSE;
+	seen_dedup = B_FALSE;
 
 	while (argc > 0) {
 		nv = NULL;
@@ -1531,6 +1550,7 @@ construct_spec(nvlist_t *props, int argc, char **argv)
 					return (NULL);
 				}
 				is_log = B_FALSE;
+				alloc_bias = NULL;
 			}
 
 			if (strcmp(type, VDEV_TYPE_LOG) == 0) {
@@ -1543,6 +1563,7 @@ construct_spec(nvlist_t *props, int argc, char **argv)
 				}
 				seen_logs = B_TRUE;
 				is_log = B_TRUE;
+				alloc_bias = NULL;
 				argc--;
 				argv++;
 				/*
@@ -1552,6 +1573,31 @@ construct_spec(nvlist_t *props, int argc, char **argv)
 				continue;
 			}
 
+			if (strcmp(type, VDEV_ALLOC_BIAS_SPECIAL) == 0 ||
+			    strcmp(type, VDEV_ALLOC_BIAS_DEDUP) == 0) {
+				boolean_t *seen =
+				    strcmp(type, VDEV_ALLOC_BIAS_SPECIAL) == 0 ?
+				    &seen_special : &seen_dedup;
+
+				if (*seen) {
+					(void) fprintf(stderr,
+					    gettext("invalid vdev "
+					    "specification: '%s' can be "
+					    "specified only once\n"), type);
+					return (NULL);
+				}
+				*seen = B_TRUE;
+				is_log = B_FALSE;
+				alloc_bias = type;
+				argc--;
+				argv++;
+				/*
+				 * Like a log, an allocation class only tags
+				 * the top-level vdevs that follow it.
+				 */
+				continue;
+			}
+
 			if (strcmp(type, VDEV_TYPE_L2CACHE) == 0) {
 				if (l2cache != NULL) {
 					(void) fprintf(stderr,
@@ -1561,17 +1607,25 @@ construct_spec(nvlist_t *props, int argc, char **argv)
 					return (NULL);
 				}
 				is_log = B_FALSE;
+				alloc_bias = NULL;
 			}
 
-			if (is_log) {
+			if (is_log || alloc_bias != NULL) {
 				if (strcmp(type, VDEV_TYPE_MIRROR) != 0) {
 					(void) fprintf(stderr,
 					    gettext("invalid vdev "
-					    "specification: unsupported 'log' "
-					    "device: %s\n"), type);
+					    "specification: unsupported '%s' "
+					    "device: %s\n"), is_log ?
+					    VDEV_TYPE_LOG : alloc_bias, type);
 					return (NULL);
 				}
-				nlogs++;
+				if (is_log)
+					nlogs++;
+				else if (strcmp(alloc_bias,
+				    VDEV_ALLOC_BIAS_SPECIAL) == 0)
+					nspecial++;
+				else
+					ndedup++;
 			}
 
 			for (c = 1; c < argc; c++) {
@@ -1620,6 +1674,11 @@ construct_spec(nvlist_t *props, int argc, char **argv)
 				    type) == 0);
 				verify(nvlist_add_uint64(nv,
 				    ZPOOL_CONFIG_IS_LOG, is_log) == 0);
+				if (alloc_bias != NULL) {
+					verify(nvlist_add_string(nv,
+					    ZPOOL_CONFIG_ALLOCATION_BIAS,
+					    alloc_bias) == 0);
+				}
 				if (strcmp(type, VDEV_TYPE_RAIDZ) == 0) {
 					verify(nvlist_add_uint64(nv,
 					    ZPOOL_CONFIG_NPARITY,
@@ -1643,6 +1702,16 @@ construct_spec(nvlist_t *props, int argc, char **argv)
 				return (NULL);
 			if (is_log)
 				nlogs++;
+			if (alloc_bias != NULL) {
+				verify(nvlist_add_string(nv,
+				    ZPOOL_CONFIG_ALLOCATION_BIAS,
+				    alloc_bias) == 0);
+				if (strcmp(alloc_bias,
+				    VDEV_ALLOC_BIAS_SPECIAL) == 0)
+					nspecial++;
+				else
+					ndedup++;
+			}
 			argc--;
 			argv++;
 		}
@@ -1667,6 +1736,18 @@ construct_spec(nvlist_t *props, int argc, char **argv)
 		return (NULL);
 	}
 
+	if (seen_special && nspecial == 0) {
+		(void) fprintf(stderr, gettext("invalid vdev specification: "
+		    "special requires at least 1 device\n"));
+		return (NULL);
+	}
+
+	if (seen_dedup && ndedup == 0) {
+		(void) fprintf(stderr, gettext("invalid vdev specification: "
+		    "dedup requires at least 1 device\n"));
+		return (NULL);
+	}
+
 	/*
 	 * Finally, create nvroot and add all top-level vdevs to it.
 	 */
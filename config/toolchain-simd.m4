@@ -0,0 +1,59 @@
+dnl #
+dnl # Checks if the compiler can generate code for the x86 SIMD instruction
+dnl # set extensions used by the vectorized checksum and parity routines.
+dnl # Each routine is compiled with a per-function target attribute, so the
+dnl # compiler and its intrinsics headers must support the extension even
+dnl # when the global flags (e.g. -mkernel) do not enable it.
+dnl #
+AC_DEFUN([ZFS_AC_CONFIG_ALWAYS_TOOLCHAIN_SIMD], [
+	case "$host_cpu" in
+		x86_64 | amd64)
+		ZFS_AC_CONFIG_TOOLCHAIN_CAN_BUILD_SIMD([SSE2], [sse2],
+		    [__m128i a = _mm_set1_epi8(1); a = _mm_add_epi8(a, a);])
+		ZFS_AC_CONFIG_TOOLCHAIN_CAN_BUILD_SIMD([SSSE3], [ssse3],
+		    [__m128i a = _mm_set1_epi8(1); a = _mm_shuffle_epi8(a, a);])
+		ZFS_AC_CONFIG_TOOLCHAIN_CAN_BUILD_SIMD([SSE4_1], [sse4.1],
+		    [__m128i a = _mm_set1_epi32(1); a = _mm_mullo_epi32(a, a);])
+		ZFS_AC_CONFIG_TOOLCHAIN_CAN_BUILD_SIMD([AVX2], [avx2],
+		    [__m256i a = _mm256_set1_epi8(1);
+		    a = _mm256_shuffle_epi8(a, a);])
+		ZFS_AC_CONFIG_TOOLCHAIN_CAN_BUILD_SIMD([AVX512F], [avx512f],
+		    [__m512i a = _mm512_set1_epi32(1);
+		    a = _mm512_add_epi64(a, a);])
+		ZFS_AC_CONFIG_TOOLCHAIN_CAN_BUILD_SIMD([AVX512BW],
+		    [avx512f,avx512bw],
+		    [__m512i a = _mm512_set1_epi8(1);
+		    a = _mm512_shuffle_epi8(a, a);])
+		;;
+	esac
+])
+
+dnl #
+dnl # ZFS_AC_CONFIG_TOOLCHAIN_CAN_BUILD_SIMD(NAME, TARGET, BODY)
+dnl #
+AC_DEFUN([ZFS_AC_CONFIG_TOOLCHAIN_CAN_BUILD_SIMD], [
+	AC_MSG_CHECKING([whether compiler supports $1])
+
+	AC_COMPILE_IFELSE([AC_LANG_SOURCE([
+		#include <immintrin.h>
+
+		__attribute__((target("$2")))
+		static int
+		simd_test(void)
+		{
+			$3
+			return (0);
+		}
+
+		int
+		main(void)
+		{
+			return (simd_test());
+		}
+	])], [
+		AC_DEFINE([HAVE_$1], 1, [Define if compiler supports $1])
+		AC_MSG_RESULT([yes])
+	], [
+		AC_MSG_RESULT([no])
+	])
+])
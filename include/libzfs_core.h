@@ -60,6 +60,14 @@ int lzc_load_key(const char *, boolean_t, uint8_t *, uint_t);
 int lzc_unload_key(const char *);
 int lzc_change_key(const char *, uint64_t, nvlist_t *, uint8_t *, uint_t);
 
+enum lzc_prefetch_flags {
+	LZC_PREFETCH_FLAG_SYNC = 1 << 0,
+	LZC_PREFETCH_FLAG_DROPBEHIND = 1 << 1,
+};
+
+int lzc_prefetch(const char *, uint64_t, uint64_t, uint64_t, uint64_t,
+    enum lzc_prefetch_flags, uint64_t *);
+
 int lzc_snaprange_space(const char *, const char *, uint64_t *);
 
 int lzc_hold(nvlist_t *, int, nvlist_t **);
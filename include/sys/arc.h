@@ -87,6 +87,15 @@ typedef enum arc_flags
 	ARC_FLAG_CACHED                 = 1 << 3,       /* I/O was in cache */
 	ARC_FLAG_L2CACHE                = 1 << 4,       /* cache in L2ARC */
 	ARC_FLAG_PREDICTIVE_PREFETCH    = 1 << 5,       /* I/O from zfetch */
+	/* Returned when the read found a zfetch I/O still in progress. */
+	ARC_FLAG_PREFETCH_INFLIGHT	= 1 << 21,
+	/*
+	 * Prefetch for a long sequential stream; the buffer is admitted at
+	 * the cold end of the MRU state until it is referenced again.
+	 */
+	ARC_FLAG_STREAMING		= 1 << 22,
+	/* b_rabd is only kept until the block is written to the L2ARC */
+	ARC_FLAG_L2_RABD		= 1 << 23,
 
 	/*
 	 * Private ARC flags.  These flags are private ARC only flags that
@@ -246,6 +255,9 @@ void arc_tempreserve_clear(uint64_t reserve);
 int arc_tempreserve_space(uint64_t reserve, uint64_t txg);
 
 uint64_t arc_max_bytes(void);
+uint64_t arc_dataset_size(spa_t *spa, uint64_t dsobj);
+void arc_dataset_set_reserve(spa_t *spa, uint64_t dsobj, uint64_t old,
+    uint64_t bytes);
 void arc_init(void);
 void arc_fini(void);
 
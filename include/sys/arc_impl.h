@@ -87,6 +87,28 @@ typedef struct arc_state {
 	arc_state_type_t arcs_state;
 } arc_state_t;
 
+/*
+ * ARC usage of one dataset (objset) of a pool.  Every header that was
+ * read or written on behalf of the dataset holds the entry, and moves
+ * its sizes between the entry's states in arc_change_state().  Entries
+ * live in arc_acct_tree and are freed when their last header is.
+ */
+typedef struct arc_acct {
+	uint64_t	aa_spa;		/* load guid of the pool */
+	uint64_t	aa_objset;	/* dataset object number */
+	uint64_t	aa_holds;	/* headers holding this entry */
+	char		aa_spa_name[ZFS_MAX_DATASET_NAME_LEN];
+	/* logical (uncompressed) and physical bytes, by state and type */
+	uint64_t	aa_lsize[ARC_STATE_NUMTYPES][ARC_BUFC_NUMTYPES];
+	uint64_t	aa_psize[ARC_STATE_NUMTYPES][ARC_BUFC_NUMTYPES];
+	uint64_t	aa_reserve;	/* "arcreserve" of the dataset */
+	uint64_t	aa_reserve_holds; /* open objsets with a reserve */
+	uint64_t	aa_hits;
+	uint64_t	aa_misses;
+	uint64_t	aa_ghost_hits;
+	avl_node_t	aa_node;
+} arc_acct_t;
+
 typedef struct arc_callback arc_callback_t;
 
 struct arc_callback {
@@ -211,6 +233,94 @@ typedef struct arc_buf_hdr_crypt {
 	uint8_t			b_mac[ZIO_DATA_MAC_LEN];
 } arc_buf_hdr_crypt_t;
 
+/*
+ * Persistent L2ARC
+ *
+ * The buffers an L2ARC device holds are described on the device itself, so
+ * that its contents can be put back into the ARC when the pool is imported
+ * again. l2arc_write_buffers() collects an entry for every buffer it writes
+ * into a log block, and writes the log block out in line with the data once
+ * it is full. Every log block points back to the one written before it, and
+ * the device header, right after the front vdev labels, points to the most
+ * recent one:
+ *
+ *	+------+-------------+-----+-------------+-----+-------------+----
+ *	| dev  | buffers ... | log | buffers ... | log | buffers ... |
+ *	| hdr  |             | blk |             | blk |             |
+ *	+------+-------------+-----+-------------+-----+-------------+----
+ *	    |                  ^  <------ lb_prev_lbp --+     ^
+ *	    +--------------------- dh_last_lbp ---------------+
+ *
+ * When the device is added, l2arc_rebuild() walks the chain from the newest
+ * log block back and creates an L2-only header for every entry. The chain
+ * ends where a log block has been overwritten (its checksum, kept in the
+ * pointer to it, no longer matches) or once a whole device worth of data
+ * has been walked. A restored header that is stale only costs a failed
+ * L2ARC read, which falls back to the pool like any other L2ARC error.
+ *
+ * This layout isn't the one of other OpenZFS platforms' persistent L2ARC,
+ * so the magic numbers differ from theirs: a cache device written by one
+ * is simply not rebuilt by the other, rather than misread.
+ */
+#define	L2ARC_DEV_HDR_MAGIC	0x4f53584c32444556ULL	/* "OSXL2DEV" */
+#define	L2ARC_LOG_BLK_MAGIC	0x4f53584c324c4f47ULL	/* "OSXL2LOG" */
+#define	L2ARC_PERSISTENT_VERSION	1
+
+/* a pointer to a log block, along with the checksum of its contents */
+typedef struct l2arc_log_blkptr {
+	uint64_t	lbp_daddr;		/* device address */
+	uint64_t	lbp_asize;		/* allocated size */
+	uint64_t	lbp_payload_asize;	/* size of its buffers */
+	uint64_t	lbp_pad;
+	zio_cksum_t	lbp_cksum;		/* fletcher4 of the block */
+} l2arc_log_blkptr_t;
+
+typedef struct l2arc_dev_hdr_phys {
+	uint64_t	dh_magic;		/* L2ARC_DEV_HDR_MAGIC */
+	uint64_t	dh_version;		/* L2ARC_PERSISTENT_VERSION */
+	uint64_t	dh_spa_guid;
+	uint64_t	dh_vdev_guid;
+	uint64_t	dh_start;		/* first data address */
+	uint64_t	dh_end;			/* end of the data area */
+	uint64_t	dh_lb_count;		/* log blocks ever written */
+	uint64_t	dh_pad[9];
+	l2arc_log_blkptr_t dh_last_lbp;		/* newest log block */
+	zio_cksum_t	dh_cksum;		/* fletcher4, as if zero */
+} l2arc_dev_hdr_phys_t;
+
+/* a buffer on the device; the same fields as an L2-only arc_buf_hdr_t */
+typedef struct l2arc_log_ent_phys {
+	dva_t		le_dva;
+	uint64_t	le_birth;
+	uint64_t	le_prop;		/* see L2BLK_* below */
+	uint64_t	le_daddr;		/* device address */
+	uint64_t	le_pad[3];
+} l2arc_log_ent_phys_t;
+
+#define	L2ARC_LOG_BLK_SIZE	(64 * 1024)
+#define	L2ARC_LOG_BLK_ENTRIES	1022
+
+typedef struct l2arc_log_blk_phys {
+	uint64_t		lb_magic;	/* L2ARC_LOG_BLK_MAGIC */
+	l2arc_log_blkptr_t	lb_prev_lbp;	/* log block written before */
+	uint64_t		lb_nentries;
+	uint64_t		lb_pad[6];
+	l2arc_log_ent_phys_t	lb_entries[L2ARC_LOG_BLK_ENTRIES];
+} l2arc_log_blk_phys_t;
+
+#define	L2BLK_GET_LSIZE(field)	\
+	BF64_GET_SB((field), 0, SPA_LSIZEBITS, SPA_MINBLOCKSHIFT, 1)
+#define	L2BLK_SET_LSIZE(field, x)	\
+	BF64_SET_SB((field), 0, SPA_LSIZEBITS, SPA_MINBLOCKSHIFT, 1, x)
+#define	L2BLK_GET_PSIZE(field)	\
+	BF64_GET_SB((field), 16, SPA_PSIZEBITS, SPA_MINBLOCKSHIFT, 1)
+#define	L2BLK_SET_PSIZE(field, x)	\
+	BF64_SET_SB((field), 16, SPA_PSIZEBITS, SPA_MINBLOCKSHIFT, 1, x)
+#define	L2BLK_GET_COMPRESS(field)	BF64_GET((field), 32, SPA_COMPRESSBITS)
+#define	L2BLK_SET_COMPRESS(field, x)	BF64_SET((field), 32, SPA_COMPRESSBITS, x)
+#define	L2BLK_GET_TYPE(field)		BF64_GET((field), 48, 8)
+#define	L2BLK_SET_TYPE(field, x)	BF64_SET((field), 48, 8, x)
+
 typedef struct l2arc_dev {
 	vdev_t			*l2ad_vdev;	/* vdev */
 	spa_t			*l2ad_spa;	/* spa */
@@ -223,6 +333,25 @@ typedef struct l2arc_dev {
 	list_t			l2ad_buflist;	/* buffer list */
 	list_node_t		l2ad_node;	/* device list node */
 	refcount_t		l2ad_alloc;	/* allocated bytes */
+	/* persistent L2ARC, see above */
+	l2arc_dev_hdr_phys_t	*l2ad_dev_hdr;	/* device header */
+	uint64_t		l2ad_dev_hdr_asize;
+	l2arc_log_blk_phys_t	*l2ad_log_blk;	/* log block being filled */
+	uint64_t		l2ad_log_blk_payload_asize;
+	boolean_t		l2ad_rebuild;	/* rebuild in progress */
+	boolean_t		l2ad_rebuild_cancel;
+	kcondvar_t		l2ad_rebuild_cv; /* rebuild done, l2ad_mtx */
+	/* feed state, only used by the device's feed task */
+	clock_t			l2ad_feed_next;	/* when to feed next */
+	uint64_t		l2ad_write_target; /* bytes to write per feed */
+	hrtime_t		l2ad_write_lat;	/* duration of last write */
+	/* statistics, see the "l2arc_devices" kstat */
+	uint64_t		l2ad_feeds;
+	uint64_t		l2ad_write_bytes;
+	uint64_t		l2ad_write_time; /* nanoseconds */
+	uint64_t		l2ad_hits;
+	uint64_t		l2ad_hit_bytes;
+	uint64_t		l2ad_misses;	/* cached here, read elsewhere */
 } l2arc_dev_t;
 
 typedef struct l2arc_buf_hdr {
@@ -277,6 +406,9 @@ struct arc_buf_hdr {
 	uint16_t		b_lsize;	/* immutable */
 	uint64_t		b_spa;		/* immutable */
 
+	/* dataset accounting entry, or NULL if the dataset isn't known */
+	arc_acct_t		*b_acct;
+
 	/* L2ARC fields. Undefined when not in L2ARC. */
 	l2arc_buf_hdr_t		b_l2hdr;
 	/* L1ARC fields. Undefined when in l2arc_only state */
@@ -37,6 +37,7 @@
 #include <sys/refcount.h>
 #include <sys/zrlock.h>
 #include <sys/multilist.h>
+#include <sys/dmu_zfetch.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -265,11 +266,26 @@ typedef struct dmu_buf_impl {
 
 /* Note: the dbuf hash table is exposed only for the mdb module */
 #define	DBUF_MUTEXES 8192
-#define	DBUF_HASH_MUTEX(h, idx) (&(h)->hash_mutexes[(idx) & (DBUF_MUTEXES-1)])
+#define	DBUF_HASH_MUTEX(h, idx) \
+	(&(h)->hash_mutexes[(idx) & (DBUF_MUTEXES-1)].dhl_lock)
+
+/*
+ * The hash mutexes are padded out to a cache line each, so that lookups
+ * on neighbouring stripes don't contend for the same line.
+ */
+#define	DBUF_HASH_LOCK_PAD	64
+typedef struct dbuf_hash_lock {
+	kmutex_t dhl_lock;
+#ifdef _KERNEL
+	unsigned char dhl_pad[DBUF_HASH_LOCK_PAD -
+	    (sizeof (kmutex_t) % DBUF_HASH_LOCK_PAD)];
+#endif
+} dbuf_hash_lock_t;
+
 typedef struct dbuf_hash_table {
 	uint64_t hash_table_mask;
 	dmu_buf_impl_t **hash_table;
-	kmutex_t hash_mutexes[DBUF_MUTEXES];
+	dbuf_hash_lock_t hash_mutexes[DBUF_MUTEXES];
 } dbuf_hash_table_t;
 
 
@@ -289,6 +305,8 @@ int dbuf_hold_impl(struct dnode *dn, uint8_t level, uint64_t blkid,
 
 void dbuf_prefetch(struct dnode *dn, int64_t level, uint64_t blkid,
     zio_priority_t prio, arc_flags_t aflags);
+void dbuf_prefetch_impl(struct dnode *dn, int64_t level, uint64_t blkid,
+    zio_priority_t prio, arc_flags_t aflags, zio_t *parent);
 
 void dbuf_add_ref(dmu_buf_impl_t *db, void *tag);
 boolean_t dbuf_try_add_ref(dmu_buf_t *db, objset_t *os, uint64_t obj,
@@ -302,6 +320,8 @@ dmu_buf_impl_t *dbuf_find(struct objset *os, uint64_t object, uint8_t level,
     uint64_t blkid);
 
 int dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags);
+int dbuf_read_access(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags,
+    zfetch_access_t *accessp);
 void dmu_buf_will_not_fill(dmu_buf_t *db, dmu_tx_t *tx);
 void dmu_buf_will_fill(dmu_buf_t *db, dmu_tx_t *tx);
 void dmu_buf_fill_done(dmu_buf_t *db, dmu_tx_t *tx);
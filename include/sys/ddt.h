@@ -130,10 +130,91 @@ struct ddt_entry {
 /*
  * In-core ddt
  */
+/*
+ * The in-core entries of a DDT are spread over DDT_SHARDS shards by their
+ * checksum, each with its own lock and tree, so that dedup writes of
+ * different blocks don't all serialize on one lock.  A shard's lock
+ * protects its tree and every field of the entries in it.
+ */
+#define	DDT_SHARDS	16
+
+typedef struct ddt_shard {
+	kmutex_t	dsh_lock;
+	avl_tree_t	dsh_tree;
+} ddt_shard_t;
+
+/*
+ * The dedup log.  With the dedup_log feature, the entries that change in
+ * a txg are appended to a log object instead of being updated in the DDT
+ * ZAP objects, and are flushed to the ZAPs later, a batch at a time and in
+ * key order.  Each DDT has two logs: the active log, which new changes are
+ * appended to, and the flushing log, which is being flushed.  Once the
+ * flushing log is empty, and the active log is old or large enough, they
+ * swap.  Each log is also indexed in memory by key, so that lookups see
+ * the latest state of an entry.
+ *
+ * A log record is the state of an entry as of the txg that logged it.  A
+ * record whose class is DDT_CLASSES is a tombstone for a removed entry.
+ */
+typedef struct ddt_log_record {
+	ddt_key_t	dlr_key;
+	uint64_t	dlr_info;	/* type and class */
+	ddt_phys_t	dlr_phys[DDT_PHYS_TYPES];
+} ddt_log_record_t;
+
+#define	DLR_GET_TYPE(dlr)	BF64_GET((dlr)->dlr_info, 0, 8)
+#define	DLR_SET_TYPE(dlr, x)	BF64_SET((dlr)->dlr_info, 0, 8, x)
+#define	DLR_GET_CLASS(dlr)	BF64_GET((dlr)->dlr_info, 8, 8)
+#define	DLR_SET_CLASS(dlr, x)	BF64_SET((dlr)->dlr_info, 8, 8, x)
+
+/*
+ * The bonus buffer of a dedup log object.
+ */
+typedef struct ddt_log_phys {
+	uint64_t	dlp_length;	/* bytes of records in the object */
+	uint64_t	dlp_first_txg;	/* txg of the first record */
+	uint64_t	dlp_flags;	/* DDL_FLAG_* */
+	uint64_t	dlp_pad[5];	/* reserved */
+} ddt_log_phys_t;
+
+#define	DDL_FLAG_FLUSHING	(1ULL << 0)
+
+/*
+ * In-core index entry of a dedup log: the latest logged state of a key.
+ */
+typedef struct ddt_log_entry {
+	ddt_key_t	dle_key;
+	ddt_phys_t	dle_phys[DDT_PHYS_TYPES];
+	uint8_t		dle_type;
+	uint8_t		dle_class;	/* DDT_CLASSES for a tombstone */
+	avl_node_t	dle_node;
+} ddt_log_entry_t;
+
+typedef struct ddt_log {
+	uint64_t	ddl_object;	/* MOS object of the log */
+	uint64_t	ddl_length;	/* bytes of records in the object */
+	uint64_t	ddl_first_txg;	/* txg of the first record */
+	avl_tree_t	ddl_tree;	/* index of ddt_log_entry_t by key */
+} ddt_log_t;
+
+/*
+ * State of the records being appended to the active log in a txg.
+ */
+typedef struct ddt_log_update {
+	ddt_log_record_t *dlu_buf;
+	uint64_t	dlu_count;	/* records in dlu_buf */
+	uint64_t	dlu_max;	/* records that fit in dlu_buf */
+	uint64_t	dlu_appended;	/* records appended in this txg */
+} ddt_log_update_t;
+
+typedef void ddt_log_walk_func_t(void *arg, ddt_t *ddt,
+    const ddt_entry_t *dde);
+
 struct ddt {
-	kmutex_t	ddt_lock;
-	avl_tree_t	ddt_tree;
+	ddt_shard_t	ddt_shard[DDT_SHARDS];
+	kmutex_t	ddt_repair_lock;	/* protects ddt_repair_tree */
 	avl_tree_t	ddt_repair_tree;
+	kmutex_t	ddt_stat_lock;		/* protects ddt_histogram */
 	enum zio_checksum ddt_checksum;
 	spa_t		*ddt_spa;
 	objset_t	*ddt_os;
@@ -142,6 +223,11 @@ struct ddt {
 	ddt_histogram_t	ddt_histogram[DDT_TYPES][DDT_CLASSES];
 	ddt_histogram_t	ddt_histogram_cache[DDT_TYPES][DDT_CLASSES];
 	ddt_object_t	ddt_object_stats[DDT_TYPES][DDT_CLASSES];
+	kmutex_t	ddt_log_lock;		/* protects the log trees */
+	ddt_log_t	ddt_log[2];
+	ddt_log_t	*ddt_log_active;
+	ddt_log_t	*ddt_log_flushing;
+	uint64_t	ddt_log_flush_rate;	/* entries to flush per txg */
 	avl_node_t	ddt_node;
 };
 
@@ -179,6 +265,10 @@ typedef struct ddt_ops {
 
 extern void ddt_object_name(ddt_t *ddt, enum ddt_type type,
     enum ddt_class _class, char *name);
+extern int ddt_object_lookup(ddt_t *ddt, enum ddt_type type,
+    enum ddt_class _class, ddt_entry_t *dde);
+extern int ddt_object_remove(ddt_t *ddt, enum ddt_type type,
+    enum ddt_class _class, ddt_entry_t *dde, dmu_tx_t *tx);
 extern int ddt_object_walk(ddt_t *ddt, enum ddt_type type,
     enum ddt_class _class, uint64_t *walk, ddt_entry_t *dde);
 extern uint64_t ddt_object_count(ddt_t *ddt, enum ddt_type type,
@@ -224,8 +314,9 @@ extern size_t ddt_compress(void *src, uchar_t *dst, size_t s_len, size_t d_len);
 extern void ddt_decompress(uchar_t *src, void *dst, size_t s_len, size_t d_len);
 
 extern ddt_t *ddt_select(spa_t *spa, const blkptr_t *bp);
-extern void ddt_enter(ddt_t *ddt);
-extern void ddt_exit(ddt_t *ddt);
+extern void ddt_enter(ddt_t *ddt, const zio_cksum_t *cksum);
+extern void ddt_exit(ddt_t *ddt, const zio_cksum_t *cksum);
+extern boolean_t ddt_changes_pending(ddt_t *ddt);
 extern void ddt_init(void);
 extern void ddt_fini(void);
 extern ddt_entry_t *ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add);
@@ -248,6 +339,29 @@ extern int ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde);
 extern int ddt_object_update(ddt_t *ddt, enum ddt_type type,
     enum ddt_class _class, ddt_entry_t *dde, dmu_tx_t *tx);
 
+extern void ddt_log_init(void);
+extern void ddt_log_fini(void);
+extern void ddt_log_alloc(ddt_t *ddt);
+extern void ddt_log_free(ddt_t *ddt);
+extern int ddt_log_load(ddt_t *ddt);
+extern boolean_t ddt_log_empty(ddt_t *ddt);
+extern boolean_t ddt_log_exists(ddt_t *ddt);
+extern boolean_t ddt_log_contains(ddt_t *ddt, const ddt_key_t *ddk);
+extern boolean_t ddt_log_find(ddt_t *ddt, ddt_entry_t *dde);
+extern void ddt_log_walk(ddt_t *ddt, ddt_log_walk_func_t *func, void *arg);
+extern void ddt_log_begin(ddt_t *ddt, ddt_log_update_t *dlu, dmu_tx_t *tx);
+extern void ddt_log_entry(ddt_t *ddt, ddt_log_update_t *dlu,
+    ddt_entry_t *dde, dmu_tx_t *tx);
+extern void ddt_log_commit(ddt_t *ddt, ddt_log_update_t *dlu, dmu_tx_t *tx);
+extern void ddt_log_flush(ddt_t *ddt, boolean_t all, dmu_tx_t *tx);
+extern void ddt_log_destroy(ddt_t *ddt, dmu_tx_t *tx);
+extern uint64_t ddt_log_count(ddt_t *ddt);
+
+extern int ddt_prune(spa_t *spa, uint64_t percent, uint64_t *pruned);
+extern void ddt_prune_auto(spa_t *spa);
+extern void ddt_prune_check(spa_t *spa);
+extern void ddt_get_prune_stats(spa_t *spa, ddt_prune_stat_t *dps);
+
 extern const ddt_ops_t ddt_zap_ops;
 
 #ifdef	__cplusplus
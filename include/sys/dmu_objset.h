@@ -108,6 +108,8 @@ struct objset {
 	zfs_sync_type_t os_sync;
 	zfs_redundant_metadata_type_t os_redundant_metadata;
 	int os_recordsize;
+	uint64_t os_zpl_special_smallblock;
+	uint64_t os_arc_reserve;
 
 	/*
 	 * Pointer is constant; the blkptr it points to is protected by
@@ -40,6 +40,31 @@ extern uint64_t	zfetch_array_rd_sz;
 
 struct dnode;				/* so we can reference dnode */
 
+/*
+ * Where the blocks of an access were found, as far as the caller knows.
+ * This lets a stream tell whether its prefetches are arriving in time.
+ */
+typedef enum zfetch_access {
+	ZFETCH_ACCESS_UNKNOWN,		/* not known */
+	ZFETCH_ACCESS_CACHED,		/* already in the ARC */
+	ZFETCH_ACCESS_INFLIGHT,		/* prefetch still being read */
+	ZFETCH_ACCESS_MISS		/* had to be read from disk */
+} zfetch_access_t;
+
+typedef enum zstream_pattern {
+	ZSTREAM_NEW,			/* one access seen so far */
+	ZSTREAM_FORWARD,		/* sequential, ascending */
+	ZSTREAM_BACKWARD,		/* sequential, descending */
+	ZSTREAM_STRIDE			/* constant stride between accesses */
+} zstream_pattern_t;
+
+/*
+ * zs_blkid is the block where we expect the next access of the stream:
+ * its first block for new, forward and strided streams, and the block
+ * just past its end for backward streams.  zs_pf_blkid and zs_ipf_blkid
+ * are where prefetching of data and of indirects will resume, moving in
+ * the direction of the stream.
+ */
 typedef struct zstream {
 	uint64_t        zs_blkid;       /* expect next access at this blkid */
 	uint64_t        zs_pf_blkid;    /* next block to prefetch */
@@ -50,6 +75,14 @@ typedef struct zstream {
 	 */
 	uint64_t	zs_ipf_blkid;
 
+	uint64_t	zs_last_blkid;	/* first block of last access */
+	uint64_t	zs_len;		/* blocks per access, if strided */
+	int64_t		zs_stride;	/* blocks between accesses */
+	zstream_pattern_t zs_pattern;	/* access pattern of the stream */
+	boolean_t	zs_confirmed;	/* stride has been seen twice */
+	uint32_t	zs_distance;	/* bytes to prefetch ahead */
+	uint64_t	zs_bytes;	/* bytes read through the stream */
+
 	kmutex_t        zs_lock;        /* protects stream */
 	hrtime_t        zs_atime;       /* time last prefetch issued */
 	list_node_t     zs_node;        /* link for zf_stream */
@@ -66,7 +99,8 @@ void		zfetch_fini(void);
 
 void		dmu_zfetch_init(zfetch_t *, struct dnode *);
 void		dmu_zfetch_fini(zfetch_t *);
-void		dmu_zfetch(zfetch_t *, uint64_t, uint64_t, boolean_t);
+void		dmu_zfetch(zfetch_t *, uint64_t, uint64_t, boolean_t,
+    zfetch_access_t);
 
 
 #ifdef	__cplusplus
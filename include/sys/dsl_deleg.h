@@ -59,6 +59,7 @@ extern "C" {
 #define	ZFS_DELEG_PERM_BOOKMARK		"bookmark"
 #define	ZFS_DELEG_PERM_LOAD_KEY		"load-key"
 #define	ZFS_DELEG_PERM_CHANGE_KEY	"change-key"
+#define	ZFS_DELEG_PERM_PREFETCH		"prefetch"
 
 /*
  * Note: the names of properties that are marked delegatable are also
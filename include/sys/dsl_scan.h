@@ -98,7 +98,30 @@ typedef enum dsl_scan_flags {
  *			the completion txg to the next txg. This is necessary
  *			to ensure that any blocks that were freed during
  *			the scan but have not yet been processed (i.e deferred
- *			frees) are accounted for.
+ *			frees) are accounted for. A sorted scan completes in
+ *			the first txg after that once its queues are empty.
+ *
+ * Scrubs and resilvers are normally sorted (scn_is_sorted). The traversal
+ * only examines blocks and gathers those that need to be read into per
+ * top-level vdev queues sorted by offset; the queues are issued as large
+ * sequential sweeps. The blocks in the queues have been examined but not
+ * read, so the on-disk state may only be updated when the queues are
+ * empty: scn_phys is the in-core state and scn_phys_cached is a copy of
+ * what was last written to disk (a checkpoint). The datasets that remain
+ * to be visited are kept in scn_queue for the same reason.
+ *
+ * scn_clearing -	the queues have used up their memory, so the
+ *			traversal stops until they have been issued down to
+ *			half of the limit.
+ *
+ * scn_checkpointing -	the traversal stops until the queues are empty,
+ *			so that a checkpoint can be written.
+ *
+ * The metadata that the traversal is about to read is prefetched by a pool
+ * of threads that walk ahead of it. Every indirect and dnode block that is
+ * prefetched adds the metadata blocks it points to to scn_prefetch_queue,
+ * which is sorted in traversal order, so the walk stays ahead of the
+ * traversal until it reaches the memory limit.
  *
  * This structure also maintains information about deferred frees which are
  * a special kind of traversal. Deferred free can exist in either a bptree or
@@ -121,9 +144,35 @@ typedef struct dsl_scan {
 	boolean_t scn_async_stalled;
 	uint64_t scn_visited_this_txg;
 
-	dsl_scan_phys_t scn_phys;
+	/* for sorted scans */
+	boolean_t scn_is_sorted;
+	boolean_t scn_clearing;
+	boolean_t scn_checkpointing;
+	hrtime_t scn_last_checkpoint;
+	uint64_t scn_issued_before_pass; /* bytes issued by earlier passes */
+	avl_tree_t scn_queue;		/* datasets left to visit */
+	kmutex_t scn_io_queues_lock;	/* protects the I/O queues */
+	struct dsl_scan_io_queue **scn_io_queues; /* by top-level vdev id */
+	uint64_t scn_io_queues_cnt;
+	uint64_t scn_bytes_pending;	/* allocated size of queued blocks */
+	uint64_t scn_queues_mem;	/* memory used by the queues */
+
+	/* for prefetching metadata ahead of the traversal */
+	taskq_t *scn_prefetch_taskq;
+	kmutex_t scn_prefetch_lock;
+	kcondvar_t scn_prefetch_cv;
+	avl_tree_t scn_prefetch_queue;	/* blocks to prefetch, by bookmark */
+	uint64_t scn_prefetch_objset;	/* objset the traversal is in */
+	uint64_t scn_prefetch_inflight;	/* prefetch reads outstanding */
+	uint64_t scn_prefetch_mem;	/* queued and in-flight bytes */
+	boolean_t scn_prefetch_stop;
+
+	dsl_scan_phys_t scn_phys;	/* in-core state */
+	dsl_scan_phys_t scn_phys_cached; /* state of the last checkpoint */
 } dsl_scan_t;
 
+void dsl_scan_stat_init(void);
+void dsl_scan_stat_fini(void);
 int dsl_scan_init(struct dsl_pool *dp, uint64_t txg);
 void dsl_scan_fini(struct dsl_pool *dp);
 void dsl_scan_sync(struct dsl_pool *, dmu_tx_t *);
@@ -142,6 +191,7 @@ void dsl_scan_ds_clone_swapped(struct dsl_dataset *ds1, struct dsl_dataset *ds2,
     struct dmu_tx *tx);
 boolean_t dsl_scan_active(dsl_scan_t *scn);
 boolean_t dsl_scan_is_paused_scrub(const dsl_scan_t *scn);
+void dsl_scan_freed(spa_t *spa, const blkptr_t *bp);
 
 #ifdef	__cplusplus
 }
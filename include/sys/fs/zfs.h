@@ -186,6 +186,9 @@ typedef enum {
 	ZFS_PROP_ENCRYPTION_ROOT,
 	ZFS_PROP_KEY_GUID,
 	ZFS_PROP_KEYSTATUS,
+	ZFS_PROP_SPECIAL_SMALL_BLOCKS,
+	ZFS_PROP_ARCSIZE,
+	ZFS_PROP_ARCRESERVE,
 	ZFS_NUM_PROPS
 } zfs_prop_t;
 
@@ -233,6 +236,8 @@ typedef enum {
 	ZPOOL_PROP_LEAKED,
 	ZPOOL_PROP_MAXBLOCKSIZE,
 	ZPOOL_PROP_TNAME,
+	ZPOOL_PROP_AUTOTRIM,
+	ZPOOL_PROP_DEDUPMAXENTRIES,
 	ZPOOL_NUM_PROPS
 } zpool_prop_t;
 
@@ -585,6 +590,7 @@ typedef struct zpool_rewind_policy {
 #define	ZPOOL_CONFIG_ASIZE		"asize"
 #define	ZPOOL_CONFIG_DTL		"DTL"
 #define	ZPOOL_CONFIG_SCAN_STATS		"scan_stats"	/* not stored on disk */
+#define	ZPOOL_CONFIG_TRIM_STATS		"trim_stats"	/* not stored on disk */
 #define	ZPOOL_CONFIG_VDEV_STATS		"vdev_stats"	/* not stored on disk */
 
 /* container nvlist of extended stats */
@@ -646,6 +652,7 @@ typedef struct zpool_rewind_policy {
 #define	ZPOOL_CONFIG_DDT_HISTOGRAM	"ddt_histogram"
 #define	ZPOOL_CONFIG_DDT_OBJ_STATS	"ddt_object_stats"
 #define	ZPOOL_CONFIG_DDT_STATS		"ddt_stats"
+#define	ZPOOL_CONFIG_DDT_PRUNE_STATS	"ddt_prune_stats"
 #define	ZPOOL_CONFIG_SPLIT		"splitcfg"
 #define	ZPOOL_CONFIG_ORIG_GUID		"orig_guid"
 #define	ZPOOL_CONFIG_SPLIT_GUID		"split_guid"
@@ -668,6 +675,11 @@ typedef struct zpool_rewind_policy {
 #define	ZPOOL_CONFIG_VDEV_LEAF_ZAP	"com.delphix:vdev_zap_leaf"
 #define	ZPOOL_CONFIG_HAS_PER_VDEV_ZAPS	"com.delphix:has_per_vdev_zaps"
 #define	ZPOOL_CONFIG_ERRATA		"errata"	/* not stored on disk */
+#define	ZPOOL_CONFIG_ALLOCATION_BIAS	"alloc_bias"	/* not on leaf vdevs */
+
+/* Entries in the top-level vdev ZAP */
+#define	VDEV_TOP_ZAP_MS_UNFLUSHED_PHYS_TXGS \
+	"org.openzfsonosx:ms_unflushed_phys_txgs"
 
 /*
  * The persistent vdev state is stored as separate values rather than a single
@@ -705,6 +717,13 @@ typedef struct zpool_rewind_policy {
 #define	VDEV_TYPE_LOG			"log"
 #define	VDEV_TYPE_L2CACHE		"l2cache"
 
+/*
+ * Allocation classes of top-level vdevs, stored as ZPOOL_CONFIG_ALLOCATION_BIAS
+ */
+#define	VDEV_ALLOC_BIAS_LOG		"log"
+#define	VDEV_ALLOC_BIAS_SPECIAL		"special"
+#define	VDEV_ALLOC_BIAS_DEDUP		"dedup"
+
 /*
  * This is needed in userland to report the minimum necessary device size.
  *
@@ -801,6 +820,24 @@ typedef enum pool_scrub_cmd {
 	POOL_SCRUB_FLAGS_END
 } pool_scrub_cmd_t;
 
+/*
+ * Manual TRIM functions.
+ */
+typedef enum pool_trim_func {
+	POOL_TRIM_START,
+	POOL_TRIM_CANCEL,
+	POOL_TRIM_FUNCS
+} pool_trim_func_t;
+
+/*
+ * Priorities of an application prefetch hint (ZFS_IOC_PREFETCH).
+ */
+typedef enum zfs_prefetch_prio {
+	ZFS_PREFETCH_PRIO_ASYNC,
+	ZFS_PREFETCH_PRIO_SYNC,
+	ZFS_PREFETCH_PRIO_FUNCS
+} zfs_prefetch_prio_t;
+
 
 /*
  * ZIO types.  Needed to interpret vdev statistics below.
@@ -812,6 +849,7 @@ typedef enum zio_type {
 	ZIO_TYPE_FREE,
 	ZIO_TYPE_CLAIM,
 	ZIO_TYPE_IOCTL,
+	ZIO_TYPE_TRIM,
 	ZIO_TYPES
 } zio_type_t;
 
@@ -837,6 +875,8 @@ typedef struct pool_scan_stat {
 	uint64_t	pss_pass_scrub_pause; /* pause time of a scurb pass */
 	/* cumulative time scrub spent paused, needed for rate calculation */
 	uint64_t	pss_pass_scrub_spent_paused;
+	uint64_t	pss_pass_issued; /* issued bytes per scan pass */
+	uint64_t	pss_issued;	/* total bytes issued or not needing I/O */
 } pool_scan_stat_t;
 
 typedef enum dsl_scan_state {
@@ -847,6 +887,28 @@ typedef enum dsl_scan_state {
 	DSS_NUM_STATES
 } dsl_scan_state_t;
 
+/*
+ * Manual TRIM statistics.  None of these are stored on disk; a manual
+ * TRIM that is interrupted by an export has to be restarted.
+ */
+typedef struct pool_trim_stat {
+	uint64_t	pts_state;	/* pool_trim_state_t */
+	uint64_t	pts_start_time;	/* trim start time */
+	uint64_t	pts_end_time;	/* trim end time */
+	uint64_t	pts_rate;	/* rate limit in bytes/s, 0 = none */
+	uint64_t	pts_to_examine;	/* total bytes of metaslabs to walk */
+	uint64_t	pts_examined;	/* total bytes of metaslabs walked */
+	uint64_t	pts_trimmed;	/* total bytes trimmed */
+} pool_trim_stat_t;
+
+typedef enum pool_trim_state {
+	POOL_TRIM_NONE,
+	POOL_TRIM_ACTIVE,
+	POOL_TRIM_FINISHED,
+	POOL_TRIM_CANCELED,
+	POOL_TRIM_NUM_STATES
+} pool_trim_state_t;
+
 /*
  * Errata described by http://zfsonlinux.org/msg/ZFS-8000-ER.  The ordering
  * of this enum must be maintained to ensure the errata identifiers map to
@@ -947,6 +1009,19 @@ typedef struct ddt_object {
 	uint64_t	ddo_mspace;	/* size of ddt in-core		*/
 } ddt_object_t;
 
+/*
+ * DDT limit and pruning statistics, for "zpool status -D".
+ */
+typedef struct ddt_prune_stat {
+	uint64_t	dps_max_entries;	/* dedupmaxentries, 0 = none */
+	uint64_t	dps_entries;		/* entries in the DDT */
+	uint64_t	dps_unique;		/* unique entries in the DDT */
+	uint64_t	dps_logged;		/* entries in the dedup log */
+	uint64_t	dps_pruned;		/* entries pruned, this import */
+	uint64_t	dps_prune_time;		/* end time of the last prune */
+	uint64_t	dps_bypassed;		/* not deduped while full */
+} ddt_prune_stat_t;
+
 typedef struct ddt_stat {
 	uint64_t	dds_blocks;	/* blocks			*/
 	uint64_t	dds_lsize;	/* logical size			*/
@@ -46,6 +46,9 @@ typedef struct osx_kstat {
 	kstat_named_t arc_zfs_arc_shrink_shift;
 	kstat_named_t arc_zfs_arc_p_min_shift;
 	kstat_named_t arc_zfs_arc_average_blocksize;
+	kstat_named_t arc_zfs_arc_hash_max_load;
+	kstat_named_t arc_zfs_arc_evict_threads;
+	kstat_named_t arc_zfs_arc_evict_lead_shift;
 
 	kstat_named_t l2arc_write_max;
 	kstat_named_t l2arc_write_boost;
@@ -54,6 +57,8 @@ typedef struct osx_kstat {
 	kstat_named_t l2arc_max_block_size;
 	kstat_named_t l2arc_feed_secs;
 	kstat_named_t l2arc_feed_min_ms;
+	kstat_named_t l2arc_write_max_scale;
+	kstat_named_t l2arc_rabd_max;
 
 	kstat_named_t zfs_vdev_max_active;
 	kstat_named_t zfs_vdev_sync_read_min_active;
@@ -66,6 +71,8 @@ typedef struct osx_kstat {
 	kstat_named_t zfs_vdev_async_write_max_active;
 	kstat_named_t zfs_vdev_scrub_min_active;
 	kstat_named_t zfs_vdev_scrub_max_active;
+	kstat_named_t zfs_vdev_trim_min_active;
+	kstat_named_t zfs_vdev_trim_max_active;
 	kstat_named_t zfs_vdev_async_write_active_min_dirty_percent;
 	kstat_named_t zfs_vdev_async_write_active_max_dirty_percent;
 	kstat_named_t zfs_vdev_aggregation_limit;
@@ -85,6 +92,10 @@ typedef struct osx_kstat {
 	kstat_named_t zfetch_max_streams;
 	kstat_named_t zfetch_min_sec_reap;
 	kstat_named_t zfetch_array_rd_sz;
+	kstat_named_t zfetch_min_distance;
+	kstat_named_t zfetch_max_distance;
+	kstat_named_t zfetch_max_stride;
+	kstat_named_t zfetch_stream_cold_bytes;
 	kstat_named_t zfs_default_bs;
 	kstat_named_t zfs_default_ibs;
 	kstat_named_t metaslab_aliquot;
@@ -99,25 +110,38 @@ typedef struct osx_kstat {
 	kstat_named_t zfs_scrub_limit;
 	kstat_named_t zfs_no_scrub_io;
 	kstat_named_t zfs_no_scrub_prefetch;
+	kstat_named_t zfs_scan_prefetch_threads;
+	kstat_named_t zfs_scan_prefetch_maxinflight;
+	kstat_named_t zfs_scan_prefetch_mem_lim;
 	kstat_named_t fzap_default_block_shift;
 	kstat_named_t zfs_immediate_write_sz;
 	kstat_named_t zfs_read_chunk_size;
 	kstat_named_t zfs_nocacheflush;
+	kstat_named_t zfs_commit_timeout_pct;
 	kstat_named_t zil_replay_disable;
 	kstat_named_t metaslab_gang_bang;
 	kstat_named_t metaslab_df_alloc_threshold;
 	kstat_named_t metaslab_df_free_pct;
+	kstat_named_t zfs_trim_extent_bytes_max;
+	kstat_named_t zfs_trim_extent_bytes_min;
+	kstat_named_t zfs_trim_txg_batch;
 	kstat_named_t zio_injection_enabled;
 	kstat_named_t zvol_immediate_write_sz;
 
 	kstat_named_t l2arc_noprefetch;
 	kstat_named_t l2arc_feed_again;
 	kstat_named_t l2arc_norw;
+	kstat_named_t l2arc_rebuild_enabled;
+	kstat_named_t l2arc_feed_policy;
+	kstat_named_t l2arc_feed_threads;
 
 	kstat_named_t zfs_top_maxinflight;
 	kstat_named_t zfs_resilver_delay;
 	kstat_named_t zfs_scrub_delay;
 	kstat_named_t zfs_scan_idle;
+	kstat_named_t zfs_scan_legacy;
+	kstat_named_t zfs_scan_mem_lim_fact;
+	kstat_named_t zfs_scan_checkpoint_intval;
 
 	kstat_named_t zfs_recover;
 
@@ -133,6 +157,9 @@ typedef struct osx_kstat {
 	kstat_named_t zfs_vdev_mirror_rotating_seek_offset;
 	kstat_named_t zfs_vdev_mirror_non_rotating_inc;
 	kstat_named_t zfs_vdev_mirror_non_rotating_seek_inc;
+	kstat_named_t zfs_vdev_mirror_latency_aware;
+	kstat_named_t zfs_vdev_mirror_latency_tolerance;
+	kstat_named_t zfs_vdev_mirror_latency_stale_ms;
 
 	kstat_named_t zvol_inhibit_dev;
 	kstat_named_t zfs_send_set_freerecords_bit;
@@ -141,11 +168,30 @@ typedef struct osx_kstat {
 	kstat_named_t zfs_send_holes_without_birth_time;
 
 	kstat_named_t dbuf_cache_max_bytes;
+	kstat_named_t dbuf_evict_threads;
 
 	kstat_named_t zfs_vdev_queue_depth_pct;
 	kstat_named_t zio_dva_throttle_enabled;
 
 	kstat_named_t zfs_vdev_file_size_mismatch_cnt;
+
+	kstat_named_t zfs_ddt_data_is_special;
+	kstat_named_t zfs_user_indirect_is_special;
+	kstat_named_t zfs_special_class_metadata_reserve_pct;
+
+	kstat_named_t zfs_min_metaslabs_to_flush;
+	kstat_named_t zfs_unflushed_max_mem_amt;
+	kstat_named_t zfs_unflushed_log_txg_max;
+
+	kstat_named_t zfs_dedup_log_enabled;
+	kstat_named_t zfs_dedup_log_txg_max;
+	kstat_named_t zfs_dedup_log_flush_entries_min;
+	kstat_named_t zfs_dedup_log_mem_max;
+	kstat_named_t zfs_dedup_prune_batch;
+	kstat_named_t zfs_dedup_prune_target_pct;
+
+	kstat_named_t zfs_vdev_raidz_impl;
+	kstat_named_t zfs_fletcher_4_impl;
 } osx_kstat_t;
 
 
@@ -165,6 +211,9 @@ extern int zfs_arc_grow_retry;
 extern int zfs_arc_shrink_shift;
 extern int zfs_arc_p_min_shift;
 extern int zfs_arc_average_blocksize;
+extern int zfs_arc_hash_max_load;
+extern int zfs_arc_evict_threads;
+extern int zfs_arc_evict_lead_shift;
 
 extern uint64_t l2arc_write_max;
 extern uint64_t l2arc_write_boost;
@@ -173,6 +222,8 @@ extern uint64_t l2arc_headroom_boost;
 extern uint64_t l2arc_max_block_size;
 extern uint64_t l2arc_feed_secs;
 extern uint64_t l2arc_feed_min_ms;
+extern uint64_t l2arc_write_max_scale;
+extern uint64_t l2arc_rabd_max;
 
 extern uint32_t zfs_vdev_max_active;
 extern uint32_t zfs_vdev_sync_read_min_active;
@@ -185,6 +236,8 @@ extern uint32_t zfs_vdev_async_write_min_active;
 extern uint32_t zfs_vdev_async_write_max_active;
 extern uint32_t zfs_vdev_scrub_min_active;
 extern uint32_t zfs_vdev_scrub_max_active;
+extern uint32_t zfs_vdev_trim_min_active;
+extern uint32_t zfs_vdev_trim_max_active;
 extern int zfs_vdev_async_write_active_min_dirty_percent;
 extern int zfs_vdev_async_write_active_max_dirty_percent;
 extern int zfs_vdev_aggregation_limit;
@@ -197,6 +250,10 @@ extern hrtime_t zfs_delay_max_ns;
 extern int spa_asize_inflation;
 extern unsigned int	zfetch_max_streams;
 extern unsigned int	zfetch_min_sec_reap;
+extern unsigned int	zfetch_min_distance;
+extern unsigned int	zfetch_max_distance;
+extern unsigned int	zfetch_max_stride;
+extern uint64_t	zfetch_stream_cold_bytes;
 extern int zfs_default_bs;
 extern int zfs_default_ibs;
 extern uint64_t metaslab_aliquot;
@@ -204,21 +261,33 @@ extern int zfs_vdev_cache_max;
 extern int spa_max_replication_override;
 extern int zfs_no_scrub_io;
 extern int zfs_no_scrub_prefetch;
+extern int zfs_scan_prefetch_threads;
+extern int zfs_scan_prefetch_maxinflight;
+extern uint64_t zfs_scan_prefetch_mem_lim;
 extern ssize_t zfs_immediate_write_sz;
 extern offset_t zfs_read_chunk_size;
 extern uint64_t metaslab_gang_bang;
 extern uint64_t metaslab_df_alloc_threshold;
 extern int metaslab_df_free_pct;
+extern uint64_t zfs_trim_extent_bytes_max;
+extern uint64_t zfs_trim_extent_bytes_min;
+extern int zfs_trim_txg_batch;
 extern ssize_t zvol_immediate_write_sz;
 
 extern boolean_t l2arc_noprefetch;
 extern boolean_t l2arc_feed_again;
 extern boolean_t l2arc_norw;
+extern boolean_t l2arc_rebuild_enabled;
+extern int l2arc_feed_policy;
+extern int l2arc_feed_threads;
 
 extern int zfs_top_maxinflight;
 extern int zfs_resilver_delay;
 extern int zfs_scrub_delay;
 extern int zfs_scan_idle;
+extern int zfs_scan_legacy;
+extern int zfs_scan_mem_lim_fact;
+extern int zfs_scan_checkpoint_intval;
 
 extern uint64_t zfs_free_max_blocks;
 extern int64_t zfs_free_bpobj_enabled;
@@ -232,6 +301,9 @@ extern uint64_t zfs_vdev_mirror_rotating_seek_inc;
 extern uint64_t zfs_vdev_mirror_rotating_seek_offset;
 extern uint64_t zfs_vdev_mirror_non_rotating_inc;
 extern uint64_t zfs_vdev_mirror_non_rotating_seek_inc;
+extern uint64_t zfs_vdev_mirror_latency_aware;
+extern uint64_t zfs_vdev_mirror_latency_tolerance;
+extern uint64_t zfs_vdev_mirror_latency_stale_ms;
 extern uint64_t zvol_inhibit_dev;
 extern uint64_t zfs_send_set_freerecords_bit;
 
@@ -240,12 +312,28 @@ extern uint64_t send_holes_without_birth_time;
 extern uint64_t zfs_send_holes_without_birth_time;
 
 extern uint64_t dbuf_cache_max_bytes;
+extern int dbuf_evict_threads;
 
 extern uint64_t zfs_vdev_queue_depth_pct;
 extern boolean_t zio_dva_throttle_enabled;
 
 extern uint64_t zfs_vdev_file_size_mismatch_cnt;
 
+extern int zfs_ddt_data_is_special;
+extern int zfs_user_indirect_is_special;
+extern int zfs_special_class_metadata_reserve_pct;
+
+extern int zfs_min_metaslabs_to_flush;
+extern uint64_t zfs_unflushed_max_mem_amt;
+extern uint64_t zfs_unflushed_log_txg_max;
+
+extern int zfs_dedup_log_enabled;
+extern uint64_t zfs_dedup_log_txg_max;
+extern uint64_t zfs_dedup_log_flush_entries_min;
+extern uint64_t zfs_dedup_log_mem_max;
+extern int zfs_dedup_prune_batch;
+extern int zfs_dedup_prune_target_pct;
+
 int        kstat_osx_init(void);
 void       kstat_osx_fini(void);
 
@@ -99,6 +99,12 @@ struct io_bootinfo {
 	uint64_t		dev_size;	/* IOMedia device size */
 };
 
+/* Struct passed to DKIOCFREE */
+typedef struct dkioc_free {
+	uint64_t		df_start;	/* Byte offset to discard */
+	uint64_t		df_length;	/* Bytes to discard */
+} dkioc_free_t;	/* (16b) */
+
 /*
  * XXX This struct is defined in spl but was unused until now.
  * There is a reference in zvol.c zvol_ioctl, commented out.
@@ -121,6 +127,9 @@ struct dk_callback {
 #define	DKIOCSETWCE		(DKIOC | 37)
 #define	DKIOCGMEDIAINFO		(DKIOC | 42)
 #define	DKIOCGMEDIAINFOEXT	(DKIOC | 48)
+#ifndef DKIOCFREE
+#define	DKIOCFREE		(DKIOC | 50)
+#endif
 
 /* XXX Created this additional ioctl */
 #define	DKIOCGETBOOTINFO	(DKIOC | 99)
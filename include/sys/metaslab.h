@@ -54,8 +54,12 @@ void metaslab_unload(metaslab_t *);
 
 void metaslab_sync(metaslab_t *, uint64_t);
 void metaslab_sync_done(metaslab_t *, uint64_t);
+void metaslab_unflushed_txg_update(metaslab_t *, uint64_t);
+void metaslab_unflushed_add(metaslab_t *, uint64_t, uint64_t, maptype_t);
+void metaslab_unflushed_load_done(metaslab_t *);
 void metaslab_sync_reassess(metaslab_group_t *);
 uint64_t metaslab_block_maxsize(metaslab_t *);
+uint64_t metaslab_trim_manual(metaslab_t *, uint64_t *, uint64_t);
 
 #define	METASLAB_HINTBP_FAVOR		0x0
 #define	METASLAB_HINTBP_AVOID		0x1
@@ -64,6 +68,7 @@ uint64_t metaslab_block_maxsize(metaslab_t *);
 #define	METASLAB_ASYNC_ALLOC		0x8
 #define	METASLAB_DONT_THROTTLE		0x10
 #define	METASLAB_FASTWRITE	0x20
+#define	METASLAB_MUST_RESERVE		0x40
 
 int metaslab_alloc(spa_t *, metaslab_class_t *, uint64_t,
     blkptr_t *, int, uint64_t, blkptr_t *, int, zio_alloc_list_t *, zio_t *);
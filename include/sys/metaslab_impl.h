@@ -308,6 +308,19 @@ struct metaslab_group {
  * metaslab needs to condense then we must set the ms_condensing flag to
  * ensure that allocations are not performed on the metaslab that is
  * being written.
+ *
+ * When the metaslab_log feature is enabled, the allocs and frees of most
+ * txgs are not appended to the metaslab's own space map.  Instead, they
+ * are written to the pool-wide log space map of the syncing txg (see
+ * spa_log_spacemap.c), and accumulated in-core in ms_unflushed_allocs
+ * and ms_unflushed_frees.  Every so often the metaslab is "flushed":
+ * the unflushed trees are appended to its space map, and the log space
+ * maps that are no longer needed by any metaslab are destroyed.  The
+ * space map plus the unflushed trees always describe the metaslab's
+ * state as of the last completed txg, so loading a metaslab combines
+ * the two.  The unflushed trees are only changed in metaslab_sync_done(),
+ * together with the space map's synced length, which keeps that view
+ * consistent for a concurrent metaslab_load().
  */
 struct metaslab {
 	kmutex_t	ms_lock;
@@ -329,6 +342,37 @@ struct metaslab {
 	range_tree_t	*ms_freeingtree; /* to free this syncing txg */
 	range_tree_t	*ms_freedtree; /* already freed this syncing txg */
 	range_tree_t	*ms_defertree[TXG_DEFER_SIZE];
+	range_tree_t	*ms_loggedtree; /* allocs logged this syncing txg */
+
+	/*
+	 * Allocs and frees that are in the log space maps but not yet in
+	 * ms_sm, and the txg of the oldest log that they came from (0 if
+	 * there are none).  ms_flush_txg is the txg in which the metaslab
+	 * was last selected to be flushed, ms_flushed_txg the txg in which
+	 * it last wrote the unflushed trees to ms_sm, and ms_logged_txg the
+	 * txg in which it last wrote to the log.
+	 */
+	range_tree_t	*ms_unflushed_allocs;
+	range_tree_t	*ms_unflushed_frees;
+	uint64_t	ms_unflushed_txg;
+	uint64_t	ms_flush_txg;
+	uint64_t	ms_flushed_txg;
+	uint64_t	ms_logged_txg;
+
+	/*
+	 * Free space that is waiting to be, or is being, TRIMmed.
+	 * ms_trimtree collects the ranges that autotrim has seen freed
+	 * and that are still free; they stay in ms_tree and are cleared
+	 * from ms_trimtree when they are allocated again.  ms_trimming
+	 * holds the ranges of the TRIM zio in flight, ms_trim_zio, which
+	 * are kept out of ms_tree until it completes.  ms_trim_txg is the
+	 * txg in which the last autotrim batch was issued.
+	 */
+	range_tree_t	*ms_trimtree;
+	range_tree_t	*ms_trimming;
+	zio_t		*ms_trim_zio;
+	kcondvar_t	ms_trim_cv;
+	uint64_t	ms_trim_txg;
 
 	boolean_t	ms_condensing;	/* condensing? */
 	boolean_t	ms_condense_wanted;
@@ -367,6 +411,7 @@ struct metaslab {
 	metaslab_group_t *ms_group;	/* metaslab group		*/
 	avl_node_t	ms_group_node;	/* node in metaslab group tree	*/
 	txg_node_t	ms_txg_node;	/* per-txg dirty metaslab links	*/
+	avl_node_t	ms_spa_txg_node; /* node in spa_metaslabs_by_flushed */
 };
 
 #ifdef	__cplusplus
@@ -76,6 +76,7 @@ void multilist_destroy(multilist_t *);
 multilist_t *multilist_create(size_t, size_t, multilist_sublist_index_func_t *);
 
 void multilist_insert(multilist_t *, void *);
+void multilist_insert_tail(multilist_t *, void *);
 void multilist_remove(multilist_t *, void *);
 int  multilist_is_empty(multilist_t *);
 
@@ -0,0 +1,253 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * USER API:
+ *
+ * Kernel fpu methods:
+ *	kfpu_begin()
+ *	kfpu_end()
+ *
+ * SIMD support:
+ *
+ * Following functions should be called to determine whether CPU feature
+ * is supported. All functions are usable in kernel and user space.
+ * If a SIMD algorithm is using more than one instruction set
+ * all relevant feature test functions should be called.
+ *
+ * Supported features:
+ *	zfs_sse2_available()
+ *	zfs_ssse3_available()
+ *	zfs_sse4_1_available()
+ *	zfs_avx_available()
+ *	zfs_avx2_available()
+ *	zfs_avx512f_available()
+ *	zfs_avx512bw_available()
+ */
+
+#ifndef _SYS_SIMD_X86_H
+#define	_SYS_SIMD_X86_H
+
+#include <sys/isa_defs.h>
+#include <sys/types.h>
+
+/* only for __x86_64 */
+#if defined(__x86_64)
+
+/*
+ * XNU preserves the vector register file of kernel threads across context
+ * switches, so unlike other platforms no explicit save/restore is needed
+ * around SIMD sections. The hooks are kept so that callers are written
+ * against the same interface everywhere.
+ */
+#define	kfpu_begin()	do {} while (0)
+#define	kfpu_end()	do {} while (0)
+
+/*
+ * CPUID feature bits
+ */
+#define	CPUID_1_EDX_SSE2	(1U << 26)
+#define	CPUID_1_ECX_SSSE3	(1U << 9)
+#define	CPUID_1_ECX_SSE4_1	(1U << 19)
+#define	CPUID_1_ECX_OSXSAVE	(1U << 27)
+#define	CPUID_1_ECX_AVX		(1U << 28)
+#define	CPUID_7_EBX_AVX2	(1U << 5)
+#define	CPUID_7_EBX_AVX512F	(1U << 16)
+#define	CPUID_7_EBX_AVX512BW	(1U << 30)
+
+/*
+ * XCR0 state components which must be enabled by the OS before the
+ * corresponding register files can be used.
+ */
+#define	XCR0_SSE		(1ULL << 1)
+#define	XCR0_AVX		(1ULL << 2)
+#define	XCR0_AVX512		((1ULL << 5) | (1ULL << 6) | (1ULL << 7))
+
+typedef struct cpuid_regs {
+	uint32_t cr_eax;
+	uint32_t cr_ebx;
+	uint32_t cr_ecx;
+	uint32_t cr_edx;
+} cpuid_regs_t;
+
+static inline void
+__simd_cpuid(uint32_t leaf, uint32_t subleaf, cpuid_regs_t *r)
+{
+	__asm__ __volatile__("cpuid"
+	    : "=a" (r->cr_eax), "=b" (r->cr_ebx),
+	    "=c" (r->cr_ecx), "=d" (r->cr_edx)
+	    : "a" (leaf), "c" (subleaf));
+}
+
+static inline uint64_t
+__simd_xgetbv(uint32_t index)
+{
+	uint32_t eax, edx;
+
+	/* xgetbv, encoded for assemblers that predate the mnemonic */
+	__asm__ __volatile__(".byte 0x0f, 0x01, 0xd0"
+	    : "=a" (eax), "=d" (edx) : "c" (index));
+
+	return ((((uint64_t)edx) << 32) | (uint64_t)eax);
+}
+
+static inline uint32_t
+__simd_cpuid_max_leaf(void)
+{
+	cpuid_regs_t r;
+
+	__simd_cpuid(0, 0, &r);
+	return (r.cr_eax);
+}
+
+/*
+ * Check that the OS has enabled saving of the requested XCR0 state
+ * components, which is a prerequisite for using AVX and AVX-512.
+ */
+static inline boolean_t
+__simd_os_state_enabled(uint64_t state)
+{
+	cpuid_regs_t r;
+
+	__simd_cpuid(1, 0, &r);
+	if ((r.cr_ecx & CPUID_1_ECX_OSXSAVE) == 0)
+		return (B_FALSE);
+
+	return ((__simd_xgetbv(0) & state) == state);
+}
+
+static inline boolean_t
+__simd_leaf1_ecx(uint32_t bits)
+{
+	cpuid_regs_t r;
+
+	__simd_cpuid(1, 0, &r);
+	return ((r.cr_ecx & bits) == bits);
+}
+
+static inline boolean_t
+__simd_leaf7_ebx(uint32_t bits)
+{
+	cpuid_regs_t r;
+
+	if (__simd_cpuid_max_leaf() < 7)
+		return (B_FALSE);
+
+	__simd_cpuid(7, 0, &r);
+	return ((r.cr_ebx & bits) == bits);
+}
+
+/*
+ * Check if SSE2 instruction set is available
+ */
+static inline boolean_t
+zfs_sse2_available(void)
+{
+	cpuid_regs_t r;
+
+	__simd_cpuid(1, 0, &r);
+	return ((r.cr_edx & CPUID_1_EDX_SSE2) != 0);
+}
+
+/*
+ * Check if SSSE3 instruction set is available
+ */
+static inline boolean_t
+zfs_ssse3_available(void)
+{
+	return (zfs_sse2_available() && __simd_leaf1_ecx(CPUID_1_ECX_SSSE3));
+}
+
+/*
+ * Check if SSE4.1 instruction set is available
+ */
+static inline boolean_t
+zfs_sse4_1_available(void)
+{
+	return (zfs_ssse3_available() &&
+	    __simd_leaf1_ecx(CPUID_1_ECX_SSE4_1));
+}
+
+/*
+ * Check if AVX instruction set is available
+ */
+static inline boolean_t
+zfs_avx_available(void)
+{
+	return (__simd_leaf1_ecx(CPUID_1_ECX_AVX) &&
+	    __simd_os_state_enabled(XCR0_SSE | XCR0_AVX));
+}
+
+/*
+ * Check if AVX2 instruction set is available
+ */
+static inline boolean_t
+zfs_avx2_available(void)
+{
+	return (zfs_avx_available() && __simd_leaf7_ebx(CPUID_7_EBX_AVX2));
+}
+
+/*
+ * Check if AVX512F instruction set is available
+ *
+ * XNU only grows a thread's save area to hold the AVX-512 state after a
+ * first-use trap taken from user space, so a kernel thread can never
+ * safely touch the ZMM registers. Report the feature as absent in the
+ * kernel even when the CPU and XCR0 advertise it.
+ */
+static inline boolean_t
+zfs_avx512f_available(void)
+{
+#if defined(_KERNEL) && defined(__APPLE__)
+	return (B_FALSE);
+#else
+	return (zfs_avx2_available() &&
+	    __simd_leaf7_ebx(CPUID_7_EBX_AVX512F) &&
+	    __simd_os_state_enabled(XCR0_SSE | XCR0_AVX | XCR0_AVX512));
+#endif
+}
+
+/*
+ * Check if AVX512BW instruction set is available
+ */
+static inline boolean_t
+zfs_avx512bw_available(void)
+{
+	return (zfs_avx512f_available() &&
+	    __simd_leaf7_ebx(CPUID_7_EBX_AVX512BW));
+}
+
+#else	/* !__x86_64 */
+
+#define	kfpu_begin()	do {} while (0)
+#define	kfpu_end()	do {} while (0)
+
+#define	zfs_sse2_available()		(B_FALSE)
+#define	zfs_ssse3_available()		(B_FALSE)
+#define	zfs_sse4_1_available()		(B_FALSE)
+#define	zfs_avx_available()		(B_FALSE)
+#define	zfs_avx2_available()		(B_FALSE)
+#define	zfs_avx512f_available()		(B_FALSE)
+#define	zfs_avx512bw_available()	(B_FALSE)
+
+#endif	/* __x86_64 */
+
+#endif	/* _SYS_SIMD_X86_H */
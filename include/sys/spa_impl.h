@@ -43,6 +43,7 @@
 #include <sys/bplist.h>
 #include <sys/bpobj.h>
 #include <sys/dsl_crypt.h>
+#include <sys/spa_log_spacemap.h>
 #include <sys/zfeature.h>
 #include <zfeature_common.h>
 
@@ -153,6 +154,8 @@ struct spa {
 	boolean_t	spa_is_initializing;	/* true while opening pool */
 	metaslab_class_t *spa_normal_class;	/* normal data class */
 	metaslab_class_t *spa_log_class;	/* intent log data class */
+	metaslab_class_t *spa_special_class;	/* special allocation class */
+	metaslab_class_t *spa_dedup_class;	/* dedup allocation class */
 	uint64_t	spa_first_txg;		/* first txg after spa_open() */
 	uint64_t	spa_final_txg;		/* txg of export/destroy */
 	uint64_t	spa_freeze_txg;		/* freeze pool at this txg */
@@ -182,6 +185,13 @@ struct spa {
 	uint64_t	spa_syncing_txg;	/* txg currently syncing */
 	bpobj_t		spa_deferred_bpobj;	/* deferred-free bplist */
 	bplist_t	spa_free_bplist[TXG_SIZE]; /* bplist of stuff to free */
+	uint64_t	spa_log_sm_zap;		/* log space maps by txg */
+	uint64_t	spa_log_sm_txg;		/* txg logging to log sm */
+	avl_tree_t	spa_log_sms;		/* in-core log space maps */
+	spa_log_sm_t	*spa_syncing_log_sm;	/* log sm of syncing txg */
+	kmutex_t	spa_flushed_ms_lock;	/* for metaslabs_by_flushed */
+	avl_tree_t	spa_metaslabs_by_flushed; /* by ms_unflushed_txg */
+	uint64_t	spa_unflushed_segs;	/* segs in unflushed trees */
 	zio_cksum_salt_t spa_cksum_salt;        /* secret salt for cksum */
 	/* checksum context templates */
 	kmutex_t        spa_cksum_tmpls_lock;
@@ -202,6 +212,7 @@ struct spa {
 	uint64_t	spa_scan_pass_scrub_pause; /* scrub pause time */
 	uint64_t	spa_scan_pass_scrub_spent_paused; /* total paused */
 	uint64_t	spa_scan_pass_exam;	/* examined bytes per pass */
+	uint64_t	spa_scan_pass_issued;	/* issued bytes per pass */
 	kmutex_t	spa_async_lock;		/* protect async state */
 	kthread_t	*spa_async_thread;	/* thread doing async task */
 	int		spa_async_suspended;	/* async tasks suspended */
@@ -246,9 +257,22 @@ struct spa {
 	int		spa_mode;		/* FREAD | FWRITE */
 	spa_log_state_t spa_log_state;		/* log state */
 	uint64_t	spa_autoexpand;		/* lun expansion on/off */
+	uint64_t	spa_autotrim;		/* trim freed space on/off */
+	kmutex_t	spa_trim_lock;		/* protects manual trim state */
+	kcondvar_t	spa_trim_cv;		/* trim thread sleep and exit */
+	kthread_t	*spa_trim_thread;	/* manual trim thread */
+	boolean_t	spa_trim_stop;		/* trim thread should exit */
+	pool_trim_stat_t spa_trim_stats;	/* manual trim progress */
 	ddt_t		*spa_ddt[ZIO_CHECKSUM_FUNCTIONS]; /* in-core DDTs */
 	uint64_t	spa_ddt_stat_object;	/* DDT statistics */
 	uint64_t	spa_dedup_ditto;	/* dedup ditto threshold */
+	uint64_t	spa_dedup_max_entries;	/* DDT entry limit, 0 = none */
+	boolean_t	spa_dedup_full;		/* DDT is at its limit */
+	uint64_t	spa_dedup_bypassed;	/* not deduped while full */
+	kmutex_t	spa_ddt_prune_lock;	/* protects DDT prune state */
+	boolean_t	spa_ddt_pruning;	/* a DDT prune is running */
+	uint64_t	spa_ddt_pruned;		/* entries pruned, this import */
+	uint64_t	spa_ddt_prune_time;	/* end time of the last prune */
 	uint64_t	spa_dedup_checksum;	/* default dedup checksum */
 	uint64_t	spa_dspace;		/* dspace in normal class */
 	kmutex_t	spa_vdev_top_lock;	/* dueling offline/remove */
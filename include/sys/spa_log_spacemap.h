@@ -0,0 +1,105 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef _SYS_SPA_LOG_SPACEMAP_H
+#define	_SYS_SPA_LOG_SPACEMAP_H
+
+#include <sys/avl.h>
+#include <sys/spa.h>
+#include <sys/range_tree.h>
+#include <sys/space_map.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * The bonus buffer of a log space map object.
+ */
+typedef struct spa_log_sm_phys {
+	uint64_t	slp_txg;	/* txg whose changes are logged */
+	uint64_t	slp_length;	/* bytes of records in the object */
+	uint64_t	slp_pad[6];	/* reserved */
+} spa_log_sm_phys_t;
+
+/*
+ * A log space map records the allocs and frees of all metaslabs that
+ * were synced to it in a txg, so every record carries its vdev.  Each
+ * record takes two words:
+ *
+ *    1         24                          39
+ *  +---+-------------+--------------------------------------------+
+ *  | t |    vdev     |    run, in units of SPA_MINBLOCKSIZE       |
+ *  +---+-------------+--------------------------------------------+
+ *   63  62         39 38                                         0
+ *
+ *  +--------------------------------------------------------------+
+ *  |                     offset, in bytes                         |
+ *  +--------------------------------------------------------------+
+ *
+ * where t is the maptype_t (SM_ALLOC or SM_FREE).  Since a run is never
+ * zero, the first word of a record is never zero either.
+ */
+#define	SLS_RECORD_SIZE		(2 * sizeof (uint64_t))
+#define	SLS_RUN_BITS		39
+#define	SLS_VDEV_BITS		24
+
+#define	SLS_TYPE_DECODE(x)	BF64_DECODE(x, 63, 1)
+#define	SLS_TYPE_ENCODE(x)	BF64_ENCODE(x, 63, 1)
+#define	SLS_VDEV_DECODE(x)	BF64_DECODE(x, SLS_RUN_BITS, SLS_VDEV_BITS)
+#define	SLS_VDEV_ENCODE(x)	BF64_ENCODE(x, SLS_RUN_BITS, SLS_VDEV_BITS)
+#define	SLS_RUN_DECODE(x)	\
+	(BF64_DECODE(x, 0, SLS_RUN_BITS) << SPA_MINBLOCKSHIFT)
+#define	SLS_RUN_ENCODE(x)	\
+	BF64_ENCODE((x) >> SPA_MINBLOCKSHIFT, 0, SLS_RUN_BITS)
+#define	SLS_RUN_MAX		\
+	(((1ULL << SLS_RUN_BITS) - 1) << SPA_MINBLOCKSHIFT)
+
+/*
+ * In-core state of a log space map.  sls_dbuf is only held while the
+ * log's txg is syncing.
+ */
+typedef struct spa_log_sm {
+	uint64_t	sls_txg;	/* txg whose changes are logged */
+	uint64_t	sls_object;	/* MOS object of the log */
+	dmu_buf_t	*sls_dbuf;	/* bonus buffer, while syncing */
+	spa_log_sm_phys_t *sls_phys;	/* on-disk header, while syncing */
+	avl_node_t	sls_node;	/* node in spa_log_sms */
+} spa_log_sm_t;
+
+extern void spa_log_sm_init(spa_t *);
+extern void spa_log_sm_fini(spa_t *);
+extern void spa_log_sm_unload(spa_t *);
+extern int spa_log_sm_load(spa_t *);
+
+extern void spa_log_sm_sync_start(spa_t *, dmu_tx_t *);
+extern void spa_log_sm_sync_done(spa_t *);
+extern boolean_t spa_log_sm_syncing(spa_t *, uint64_t);
+extern void spa_log_sm_write(spa_t *, uint64_t, range_tree_t *,
+    maptype_t, dmu_tx_t *);
+
+extern int spa_log_sm_flushed_compare(const void *, const void *);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_SPA_LOG_SPACEMAP_H */
@@ -133,6 +133,7 @@ extern void vdev_queue_io_done(zio_t *zio);
 extern int vdev_queue_length(vdev_t *vd);
 extern uint64_t vdev_queue_lastoffset(vdev_t *vd);
 extern void vdev_queue_register_lastoffset(vdev_t *vd, zio_t *zio);
+extern hrtime_t vdev_queue_read_latency(vdev_t *vd, hrtime_t maxage);
 
 extern void vdev_config_dirty(vdev_t *vd);
 extern void vdev_config_clean(vdev_t *vd);
@@ -0,0 +1,224 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef _VDEV_RAIDZ_IMPL_H
+#define	_VDEV_RAIDZ_IMPL_H
+
+#include <sys/types.h>
+#include <sys/debug.h>
+#include <sys/kstat.h>
+#include <sys/abd.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define	VDEV_RAIDZ_P		0
+#define	VDEV_RAIDZ_Q		1
+#define	VDEV_RAIDZ_R		2
+
+#define	VDEV_RAIDZ_MUL_2(x)	(((x) << 1) ^ (((x) & 0x80) ? 0x1d : 0))
+#define	VDEV_RAIDZ_MUL_4(x)	(VDEV_RAIDZ_MUL_2(VDEV_RAIDZ_MUL_2(x)))
+
+/*
+ * We provide a mechanism to perform the field multiplication operation on a
+ * 64-bit value all at once rather than a byte at a time. This works by
+ * creating a mask from the top bit in each byte and using that to
+ * conditionally apply the XOR of 0x1d.
+ */
+#define	VDEV_RAIDZ_64MUL_2(x, mask) \
+{ \
+	(mask) = (x) & 0x8080808080808080ULL; \
+	(mask) = ((mask) << 1) - ((mask) >> 7); \
+	(x) = (((x) << 1) & 0xfefefefefefefefeULL) ^ \
+	    ((mask) & 0x1d1d1d1d1d1d1d1dULL); \
+}
+
+#define	VDEV_RAIDZ_64MUL_4(x, mask) \
+{ \
+	VDEV_RAIDZ_64MUL_2((x), mask); \
+	VDEV_RAIDZ_64MUL_2((x), mask); \
+}
+
+/*
+ * Parity generation methods, indexed by the number of parity columns - 1
+ */
+enum raidz_math_gen_op {
+	RAIDZ_GEN_P = 0,
+	RAIDZ_GEN_PQ,
+	RAIDZ_GEN_PQR,
+	RAIDZ_GEN_NUM
+};
+
+/*
+ * Data reconstruction methods, named after the parity columns they use
+ */
+enum raidz_rec_op {
+	RAIDZ_REC_P = 0,
+	RAIDZ_REC_Q,
+	RAIDZ_REC_R,
+	RAIDZ_REC_PQ,
+	RAIDZ_REC_PR,
+	RAIDZ_REC_QR,
+	RAIDZ_REC_PQR,
+	RAIDZ_REC_NUM
+};
+
+extern const char *raidz_gen_name[RAIDZ_GEN_NUM];
+extern const char *raidz_rec_name[RAIDZ_REC_NUM];
+
+/*
+ * Buffer kernels. Every implementation provides the same small set of
+ * GF(2^8) primitives over flat buffers; the generic code in
+ * vdev_raidz_math.c walks the ABDs of a raidz_map_t and feeds the mapped
+ * chunks through them. Kernels accept any size, but are only expected to
+ * be fast for multiples of 64 bytes.
+ */
+typedef void raidz_xor_f(uint8_t *, const uint8_t *, size_t);
+typedef void raidz_gen_pq_f(uint8_t *, uint8_t *, const uint8_t *, size_t);
+typedef void raidz_gen_pqr_f(uint8_t *, uint8_t *, uint8_t *,
+    const uint8_t *, size_t);
+typedef void raidz_mul_f(uint8_t *, size_t);
+typedef void raidz_step_f(uint8_t *, const uint8_t *, size_t);
+typedef void raidz_mulc_f(uint8_t *, const uint8_t *, uint8_t, size_t);
+typedef boolean_t raidz_will_f(void);
+
+#define	RAIDZ_IMPL_NAME_MAX	(16)
+
+typedef struct raidz_impl_ops {
+	raidz_xor_f	*rio_xor;	/* d ^= s */
+	raidz_gen_pq_f	*rio_gen_pq;	/* p ^= s; q = 2q ^ s */
+	raidz_gen_pqr_f	*rio_gen_pqr;	/* p ^= s; q = 2q ^ s; r = 4r ^ s */
+	raidz_mul_f	*rio_mul2;	/* d = 2d */
+	raidz_mul_f	*rio_mul4;	/* d = 4d */
+	raidz_step_f	*rio_q_step;	/* d = 2d ^ s */
+	raidz_step_f	*rio_r_step;	/* d = 4d ^ s */
+	raidz_mulc_f	*rio_mul_copy;	/* d = c * s */
+	raidz_mulc_f	*rio_mul_add;	/* d ^= c * s */
+	raidz_will_f	*rio_is_supported;
+	char		rio_name[RAIDZ_IMPL_NAME_MAX];
+} raidz_impl_ops_t;
+
+/*
+ * The set of kernels used by a raidz_map_t. Each method may be backed by a
+ * different implementation, which is how the benchmarked "fastest" set is
+ * assembled.
+ */
+typedef struct raidz_math_ops {
+	const raidz_impl_ops_t	*rmo_gen[RAIDZ_GEN_NUM];
+	const raidz_impl_ops_t	*rmo_rec[RAIDZ_REC_NUM];
+	const char		*rmo_name;
+} raidz_math_ops_t;
+
+typedef struct raidz_col {
+	uint64_t rc_devidx;		/* child device index for I/O */
+	uint64_t rc_offset;		/* device offset */
+	uint64_t rc_size;		/* I/O size */
+	abd_t *rc_abd;			/* I/O data */
+	void *rc_gdata;			/* used to store the "good" version */
+	int rc_error;			/* I/O error for this device */
+	uint8_t rc_tried;		/* Did we attempt this I/O column? */
+	uint8_t rc_skipped;		/* Did we skip this I/O column? */
+} raidz_col_t;
+
+typedef struct raidz_map {
+	uint64_t rm_cols;		/* Regular column count */
+	uint64_t rm_scols;		/* Count including skipped columns */
+	uint64_t rm_bigcols;		/* Number of oversized columns */
+	uint64_t rm_asize;		/* Actual total I/O size */
+	uint64_t rm_missingdata;	/* Count of missing data devices */
+	uint64_t rm_missingparity;	/* Count of missing parity devices */
+	uint64_t rm_firstdatacol;	/* First data column/parity count */
+	uint64_t rm_nskip;		/* Skipped sectors for padding */
+	uint64_t rm_skipstart;		/* Column index of padding start */
+	abd_t *rm_abd_copy;		/* rm_asize-buffer of copied data */
+	uintptr_t rm_reports;		/* # of referencing checksum reports */
+	uint8_t	rm_freed;		/* map no longer has referencing ZIO */
+	uint8_t	rm_ecksuminjected;	/* checksum error was injected */
+	const raidz_math_ops_t *rm_ops;	/* RAIDZ math operations */
+	raidz_col_t rm_col[1];		/* Flexible array of I/O columns */
+} raidz_map_t;
+
+/*
+ * Returned by the math layer when the map is to be handled by the
+ * original code in vdev_raidz.c.
+ */
+#define	RAIDZ_ORIGINAL_IMPL	(INT_MAX)
+
+/*
+ * Powers and logs of 2 in GF(2^8), see vdev_raidz.c
+ */
+extern const uint8_t vdev_raidz_pow2[256];
+extern const uint8_t vdev_raidz_log2[256];
+
+/*
+ * Nibble multiplication tables used by the table driven kernels. Row c
+ * holds c * i for i = 0..15 followed by c * (i << 4) for i = 0..15.
+ */
+extern uint8_t vdev_raidz_mul_lt[256][32];
+
+extern const raidz_impl_ops_t vdev_raidz_scalar_impl;
+#if defined(__x86_64) && defined(HAVE_SSE2)
+extern const raidz_impl_ops_t vdev_raidz_sse2_impl;
+#endif
+#if defined(__x86_64) && defined(HAVE_SSE2) && defined(HAVE_SSSE3)
+extern const raidz_impl_ops_t vdev_raidz_ssse3_impl;
+#endif
+#if defined(__x86_64) && defined(HAVE_AVX2)
+extern const raidz_impl_ops_t vdev_raidz_avx2_impl;
+#endif
+#if defined(__x86_64) && defined(HAVE_AVX512BW)
+extern const raidz_impl_ops_t vdev_raidz_avx512bw_impl;
+#endif
+
+/*
+ * Scalar kernels, also used by the vector implementations to finish off
+ * buffers whose size is not a multiple of their vector width.
+ */
+extern raidz_xor_f raidz_scalar_xor;
+extern raidz_gen_pq_f raidz_scalar_gen_pq;
+extern raidz_gen_pqr_f raidz_scalar_gen_pqr;
+extern raidz_mul_f raidz_scalar_mul2;
+extern raidz_mul_f raidz_scalar_mul4;
+extern raidz_step_f raidz_scalar_q_step;
+extern raidz_step_f raidz_scalar_r_step;
+extern raidz_mulc_f raidz_scalar_mul_copy;
+extern raidz_mulc_f raidz_scalar_mul_add;
+
+#if defined(__x86_64) && defined(HAVE_SSE2)
+/*
+ * SSE2 kernels, shared with the SSSE3 implementation which only replaces
+ * the constant multiplication.
+ */
+extern raidz_xor_f raidz_sse2_xor;
+extern raidz_gen_pq_f raidz_sse2_gen_pq;
+extern raidz_gen_pqr_f raidz_sse2_gen_pqr;
+extern raidz_mul_f raidz_sse2_mul2;
+extern raidz_mul_f raidz_sse2_mul4;
+extern raidz_step_f raidz_sse2_q_step;
+extern raidz_step_f raidz_sse2_r_step;
+#endif
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _VDEV_RAIDZ_IMPL_H */
@@ -107,6 +107,7 @@ typedef enum drr_headertype {
 #define	DMU_BACKUP_FEATURE_COMPRESSED		(1 << 22)
 /* flag #23 is reserved for the large dnode feature */
 #define	DMU_BACKUP_FEATURE_RAW			(1 << 24)
+#define	DMU_BACKUP_FEATURE_ZSTD			(1 << 25)
 
     /* Unsure what Oracle called this bit */
 #define	DMU_BACKUP_FEATURE_SPILLBLOCKS	(0x20)
@@ -133,7 +134,7 @@ NOTE 3:  Fix to 7097870 (spill block can be dropped in some situations during
     DMU_BACKUP_FEATURE_EMBED_DATA | DMU_BACKUP_FEATURE_LZ4 | \
     DMU_BACKUP_FEATURE_RESUMING | DMU_BACKUP_FEATURE_LARGE_BLOCKS | \
 	DMU_BACKUP_FEATURE_COMPRESSED /*| DMU_BACKUP_FEATURE_LARGE_DNODE*/ | \
-    DMU_BACKUP_FEATURE_RAW)
+    DMU_BACKUP_FEATURE_RAW | DMU_BACKUP_FEATURE_ZSTD)
 
 /* Are all features in the given flag word currently supported? */
 #define	DMU_STREAM_SUPPORTED(x)	(!((x) & ~DMU_BACKUP_FEATURE_MASK))
@@ -572,6 +573,9 @@ typedef enum zfs_ioc {
 	ZFS_IOC_LOAD_KEY,
 	ZFS_IOC_UNLOAD_KEY,
 	ZFS_IOC_CHANGE_KEY,
+	ZFS_IOC_POOL_TRIM,
+	ZFS_IOC_PREFETCH,
+	ZFS_IOC_POOL_DDT_PRUNE,
 
 	/*
 	 * Linux - 3/64 numbers reserved.
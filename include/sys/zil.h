@@ -151,7 +151,8 @@ typedef enum zil_create {
 #define	TX_MKDIR_ATTR		18	/* mkdir with attr */
 #define	TX_MKDIR_ACL_ATTR	19	/* mkdir with ACL + attrs */
 #define	TX_WRITE2		20	/* dmu_sync EALREADY write */
-#define	TX_MAX_TYPE		21	/* Max transaction type */
+#define	TX_COMMIT		21	/* Commit marker (no on-disk state) */
+#define	TX_MAX_TYPE		22	/* Max transaction type */
 
 /*
  * The transactions for mkdir, symlink, remove, rmdir, link, and rename
@@ -379,6 +380,12 @@ typedef struct itx {
 	/* followed by type-specific part of lr_xx_t and its immediate data */
 } itx_t;
 
+/*
+ * Number of power-of-two microsecond buckets in the zil_commit() latency
+ * histogram; the last one ends at 2^(ZIL_COMMIT_LATENCY_BUCKETS - 1)us.
+ */
+#define	ZIL_COMMIT_LATENCY_BUCKETS	24
+
 /*
  * Used for zil kstat.
  */
@@ -429,6 +436,15 @@ typedef struct zil_stats {
 	 */
 	kstat_named_t zil_itx_metaslab_slog_count;
 	kstat_named_t zil_itx_metaslab_slog_bytes;
+
+	/*
+	 * Histogram of zil_commit() latencies, from the time the commit
+	 * is requested until the log blocks holding its itxs have been
+	 * written and flushed. Bucket "zil_commit_latency_<n>us" counts
+	 * the commits that took less than <n> microseconds (and at least
+	 * half of that); the last bucket also counts everything slower.
+	 */
+	kstat_named_t zil_commit_latency[ZIL_COMMIT_LATENCY_BUCKETS];
 } zil_stats_t;
 
 extern zil_stats_t zil_stats;
@@ -446,8 +462,9 @@ typedef int (*zil_replay_func_t)(void *, char *, boolean_t);
 
 struct znode;
 struct rl;
-typedef int zil_get_data_t(void *arg, lr_write_t *lr, char *dbuf, zio_t *zio,
-						   struct znode *zp, struct rl *rl);
+struct lwb;
+typedef int zil_get_data_t(void *arg, lr_write_t *lr, char *dbuf,
+    struct lwb *lwb, zio_t *zio, struct znode *zp, struct rl *rl);
 
 extern int zil_parse(zilog_t *zilog, zil_parse_blk_func_t *parse_blk_func,
     zil_parse_lr_func_t *parse_lr_func, void *arg, uint64_t txg,
@@ -485,7 +502,7 @@ extern void	zil_clean(zilog_t *zilog, uint64_t synced_txg);
 extern int	zil_suspend(const char *osname, void **cookiep);
 extern void	zil_resume(void *cookie);
 
-extern void	zil_add_block(zilog_t *zilog, const blkptr_t *bp);
+extern void	zil_lwb_add_block(struct lwb *lwb, const blkptr_t *bp);
 extern int	zil_bp_tree_add(zilog_t *zilog, const blkptr_t *bp);
 
 extern void	zil_set_sync(zilog_t *zilog, uint64_t syncval);
@@ -493,6 +510,7 @@ extern void	zil_set_sync(zilog_t *zilog, uint64_t syncval);
 extern void	zil_set_logbias(zilog_t *zilog, uint64_t slogval);
 
 extern int zil_replay_disable;
+extern int zfs_commit_timeout_pct;
 
 #ifdef	__cplusplus
 }
@@ -31,6 +31,7 @@
 #define	_SYS_ZIO_COMPRESS_H
 
 #include <sys/abd.h>
+#include <zfeature_common.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -53,9 +54,56 @@ enum zio_compress {
 	ZIO_COMPRESS_GZIP_9,
 	ZIO_COMPRESS_ZLE,
 	ZIO_COMPRESS_LZ4,
+	ZIO_COMPRESS_ZSTD_1,
+	ZIO_COMPRESS_ZSTD_2,
+	ZIO_COMPRESS_ZSTD_3,
+	ZIO_COMPRESS_ZSTD_4,
+	ZIO_COMPRESS_ZSTD_5,
+	ZIO_COMPRESS_ZSTD_6,
+	ZIO_COMPRESS_ZSTD_7,
+	ZIO_COMPRESS_ZSTD_8,
+	ZIO_COMPRESS_ZSTD_9,
+	ZIO_COMPRESS_ZSTD_10,
+	ZIO_COMPRESS_ZSTD_11,
+	ZIO_COMPRESS_ZSTD_12,
+	ZIO_COMPRESS_ZSTD_13,
+	ZIO_COMPRESS_ZSTD_14,
+	ZIO_COMPRESS_ZSTD_15,
+	ZIO_COMPRESS_ZSTD_16,
+	ZIO_COMPRESS_ZSTD_17,
+	ZIO_COMPRESS_ZSTD_18,
+	ZIO_COMPRESS_ZSTD_19,
+	ZIO_COMPRESS_ZSTD_FAST_1,
+	ZIO_COMPRESS_ZSTD_FAST_2,
+	ZIO_COMPRESS_ZSTD_FAST_3,
+	ZIO_COMPRESS_ZSTD_FAST_4,
+	ZIO_COMPRESS_ZSTD_FAST_5,
+	ZIO_COMPRESS_ZSTD_FAST_6,
+	ZIO_COMPRESS_ZSTD_FAST_7,
+	ZIO_COMPRESS_ZSTD_FAST_8,
+	ZIO_COMPRESS_ZSTD_FAST_9,
+	ZIO_COMPRESS_ZSTD_FAST_10,
+	ZIO_COMPRESS_ZSTD_FAST_20,
+	ZIO_COMPRESS_ZSTD_FAST_30,
+	ZIO_COMPRESS_ZSTD_FAST_40,
+	ZIO_COMPRESS_ZSTD_FAST_50,
+	ZIO_COMPRESS_ZSTD_FAST_60,
+	ZIO_COMPRESS_ZSTD_FAST_70,
+	ZIO_COMPRESS_ZSTD_FAST_80,
+	ZIO_COMPRESS_ZSTD_FAST_90,
+	ZIO_COMPRESS_ZSTD_FAST_100,
+	ZIO_COMPRESS_ZSTD_FAST_500,
+	ZIO_COMPRESS_ZSTD_FAST_1000,
 	ZIO_COMPRESS_FUNCTIONS
 };
 
+#define	ZIO_COMPRESS_ZSTD_DEFAULT	ZIO_COMPRESS_ZSTD_3
+#define	ZIO_COMPRESS_ZSTD_FAST_DEFAULT	ZIO_COMPRESS_ZSTD_FAST_1
+
+#define	ZIO_COMPRESS_IS_ZSTD(compress)			\
+	((compress) >= ZIO_COMPRESS_ZSTD_1 &&		\
+	(compress) <= ZIO_COMPRESS_ZSTD_FAST_1000)
+
 /* Common signature for all zio compress functions. */
 typedef size_t zio_compress_func_t(void *src, void *dst,
     size_t s_len, size_t d_len, int);
@@ -88,6 +136,12 @@ extern zio_compress_info_t zio_compress_table[ZIO_COMPRESS_FUNCTIONS];
 extern void lz4_init(void);
 extern void lz4_fini(void);
 
+/*
+ * zstd compression init & free
+ */
+extern void zstd_init(void);
+extern void zstd_fini(void);
+
 /*
  * Compression routines.
  */
@@ -107,6 +161,10 @@ extern size_t lz4_compress_zfs(void *src, void *dst, size_t s_len, size_t d_len,
     int level);
 extern int lz4_decompress_zfs(void *src, void *dst, size_t s_len, size_t d_len,
     int level);
+extern size_t zstd_compress(void *src, void *dst, size_t s_len, size_t d_len,
+    int level);
+extern int zstd_decompress(void *src, void *dst, size_t s_len, size_t d_len,
+    int level);
 
 /*
  * Compress and decompress data if necessary.
@@ -117,6 +175,7 @@ extern int zio_decompress_data(enum zio_compress c, abd_t *src, void *dst,
     size_t s_len, size_t d_len);
 extern int zio_decompress_data_buf(enum zio_compress c, void *src, void *dst,
     size_t s_len, size_t d_len);
+extern spa_feature_t zio_compress_to_feature(enum zio_compress c);
 
 #ifdef	__cplusplus
 }
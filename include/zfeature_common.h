@@ -55,6 +55,10 @@ typedef enum spa_feature {
 	SPA_FEATURE_SKEIN,
 	SPA_FEATURE_EDONR,
 	SPA_FEATURE_ENCRYPTION,
+	SPA_FEATURE_ZSTD_COMPRESS,
+	SPA_FEATURE_ALLOCATION_CLASSES,
+	SPA_FEATURE_LOG_SPACEMAP,
+	SPA_FEATURE_DEDUP_LOG,
 	SPA_FEATURES
 } spa_feature_t;
 
@@ -69,6 +69,7 @@ typedef enum {
 	ZFS_DELEG_NOTE_BOOKMARK,
 	ZFS_DELEG_NOTE_LOAD_KEY,
 	ZFS_DELEG_NOTE_CHANGE_KEY,
+	ZFS_DELEG_NOTE_PREFETCH,
 	ZFS_DELEG_NOTE_NONE
 } zfs_deleg_note_t;
 
@@ -51,6 +51,75 @@ void fletcher_4_native(const void *, size_t, const void *, zio_cksum_t *);
 void fletcher_4_byteswap(const void *, size_t, const void *, zio_cksum_t *);
 int fletcher_4_incremental_native(void *, size_t, void *);
 int fletcher_4_incremental_byteswap(void *, size_t, void *);
+int fletcher_4_impl_set(const char *);
+void fletcher_4_impl_get(char *, size_t);
+void fletcher_4_init(void);
+void fletcher_4_fini(void);
+
+/*
+ * fletcher checksum struct, one per SIMD lane
+ */
+typedef struct zfs_fletcher_sse {
+	uint64_t v[2] __attribute__((aligned(16)));
+} zfs_fletcher_sse_t;
+
+typedef struct zfs_fletcher_avx {
+	uint64_t v[4] __attribute__((aligned(32)));
+} zfs_fletcher_avx_t;
+
+typedef struct zfs_fletcher_avx512 {
+	uint64_t v[8] __attribute__((aligned(64)));
+} zfs_fletcher_avx512_t;
+
+/*
+ * Running state of a fletcher-4 computation. The scalar code keeps the four
+ * sums directly; vector implementations keep a, b, c and d for each lane
+ * and fold them into a zio_cksum_t when done.
+ */
+typedef union fletcher_4_ctx {
+	zio_cksum_t scalar;
+	zfs_fletcher_sse_t sse[4][2];
+	zfs_fletcher_avx_t avx[4];
+	zfs_fletcher_avx512_t avx512[4];
+} fletcher_4_ctx_t;
+
+/*
+ * fletcher-4 implementation ops
+ */
+typedef void (*fletcher_4_init_f)(fletcher_4_ctx_t *);
+typedef void (*fletcher_4_fini_f)(fletcher_4_ctx_t *, zio_cksum_t *);
+typedef void (*fletcher_4_compute_f)(fletcher_4_ctx_t *,
+    const void *, uint64_t);
+
+typedef struct fletcher_4_func {
+	fletcher_4_init_f init_native;
+	fletcher_4_fini_f fini_native;
+	fletcher_4_compute_f compute_native;
+	fletcher_4_init_f init_byteswap;
+	fletcher_4_fini_f fini_byteswap;
+	fletcher_4_compute_f compute_byteswap;
+	boolean_t (*valid)(void);
+	const char *name;
+} fletcher_4_ops_t;
+
+extern void fletcher_4_simd_fini(const uint64_t *, const uint64_t *,
+    const uint64_t *, const uint64_t *, int, zio_cksum_t *);
+
+#if defined(__x86_64) && defined(HAVE_SSE2)
+extern const fletcher_4_ops_t fletcher_4_sse2_ops;
+#endif
+
+#if defined(__x86_64) && defined(HAVE_SSE2) && defined(HAVE_SSSE3)
+extern const fletcher_4_ops_t fletcher_4_ssse3_ops;
+#endif
+
+#if defined(__x86_64) && defined(HAVE_AVX2)
+extern const fletcher_4_ops_t fletcher_4_avx2_ops;
+#endif
+
+#if defined(__x86_64) && defined(HAVE_AVX512F) && defined(HAVE_AVX2)
+extern const fletcher_4_ops_t fletcher_4_avx512f_ops;
+#endif
 
 #ifdef	__cplusplus
 }
@@ -2048,6 +2048,87 @@ zpool_scan(zpool_handle_t *zhp, pool_scan_func_t func, pool_scrub_cmd_t cmd)
 	}
 }
 
+/*
+ * Start or cancel a manual TRIM of the pool's free space.  'rate' limits
+ * the TRIM to that many bytes per second, 0 meaning no limit.
+ */
+int
+zpool_trim(zpool_handle_t *zhp, pool_trim_func_t func, uint64_t rate)
+{
+	zfs_cmd_t zc = {"\0"};
+	char msg[1024];
+	int err;
+	libzfs_handle_t *hdl = zhp->zpool_hdl;
+
+	(void) strlcpy(zc.zc_name, zhp->zpool_name, sizeof (zc.zc_name));
+	zc.zc_cookie = func;
+	zc.zc_obj = rate;
+
+	if (zfs_ioctl(hdl, ZFS_IOC_POOL_TRIM, &zc) == 0)
+		return (0);
+
+	err = errno;
+
+	if (func == POOL_TRIM_START) {
+		(void) snprintf(msg, sizeof (msg), dgettext(TEXT_DOMAIN,
+		    "cannot trim %s"), zc.zc_name);
+	} else {
+		(void) snprintf(msg, sizeof (msg), dgettext(TEXT_DOMAIN,
+		    "cannot cancel trimming %s"), zc.zc_name);
+	}
+
+	if (err == EBUSY) {
+		zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+		    "currently trimming"));
+		return (zfs_error(hdl, EZFS_BUSY, msg));
+	} else if (err == ENOENT && func == POOL_TRIM_CANCEL) {
+		zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+		    "there is no active trim"));
+		return (zfs_error(hdl, EZFS_NOENT, msg));
+	} else {
+		return (zpool_standard_error(hdl, err, msg));
+	}
+}
+
+/*
+ * Prune the oldest 'percent' percent of the pool's unique DDT entries.
+ * The number of entries pruned is returned in 'pruned'.
+ */
+int
+zpool_ddt_prune(zpool_handle_t *zhp, uint64_t percent, uint64_t *pruned)
+{
+	zfs_cmd_t zc = {"\0"};
+	char msg[1024];
+	int err;
+	libzfs_handle_t *hdl = zhp->zpool_hdl;
+
+	(void) strlcpy(zc.zc_name, zhp->zpool_name, sizeof (zc.zc_name));
+	zc.zc_cookie = percent;
+
+	if (zfs_ioctl(hdl, ZFS_IOC_POOL_DDT_PRUNE, &zc) == 0) {
+		if (pruned != NULL)
+			*pruned = zc.zc_obj;
+		return (0);
+	}
+
+	err = errno;
+
+	(void) snprintf(msg, sizeof (msg), dgettext(TEXT_DOMAIN,
+	    "cannot prune dedup table of %s"), zc.zc_name);
+
+	if (err == EBUSY) {
+		zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+		    "dedup table is already being pruned"));
+		return (zfs_error(hdl, EZFS_BUSY, msg));
+	} else if (err == EINTR) {
+		zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+		    "pool is being exported or is suspended"));
+		return (zfs_error(hdl, EZFS_INTR, msg));
+	} else {
+		return (zpool_standard_error(hdl, err, msg));
+	}
+}
+
 #ifdef illumos
 
 /*
@@ -957,3 +957,48 @@ lzc_change_key(const char *fsname, uint64_t crypt_cmd, nvlist_t *props,
 	nvlist_free(ioc_args);
 	return (error);
 }
+
+/*
+ * Ask for part or all of an object to be read into the ARC in the
+ * background.
+ *
+ * "length" bytes are read starting at "offset", or the rest of the object
+ * if "length" is 0.  If "budget" is not 0, at most that many bytes are
+ * read.  LZC_PREFETCH_FLAG_SYNC reads the data at the priority of
+ * synchronous reads rather than of prefetch, and LZC_PREFETCH_FLAG_DROPBEHIND
+ * lets the data be evicted soon after it has been read.
+ *
+ * If "issued" is not NULL, it is set to the number of bytes that will be
+ * read.
+ *
+ * The caller needs the "prefetch" permission on the dataset.  A user can
+ * only have so much being read in at once, a quarter of the ARC's maximum
+ * size, and gets EAGAIN while all of it is in use.
+ */
+int
+lzc_prefetch(const char *fsname, uint64_t object, uint64_t offset,
+    uint64_t length, uint64_t budget, enum lzc_prefetch_flags flags,
+    uint64_t *issued)
+{
+	nvlist_t *args = fnvlist_alloc();
+	nvlist_t *result = NULL;
+	int error;
+
+	fnvlist_add_uint64(args, "object", object);
+	fnvlist_add_uint64(args, "offset", offset);
+	fnvlist_add_uint64(args, "length", length);
+	fnvlist_add_uint64(args, "priority", (flags & LZC_PREFETCH_FLAG_SYNC) ?
+	    ZFS_PREFETCH_PRIO_SYNC : ZFS_PREFETCH_PRIO_ASYNC);
+	if (budget != 0)
+		fnvlist_add_uint64(args, "budget", budget);
+	if (flags & LZC_PREFETCH_FLAG_DROPBEHIND)
+		fnvlist_add_boolean(args, "dropbehind");
+
+	error = lzc_ioctl(ZFS_IOC_PREFETCH, fsname, args, &result);
+	if (error == 0 && issued != NULL)
+		*issued = fnvlist_lookup_uint64(result, "issued");
+	nvlist_free(args);
+	nvlist_free(result);
+
+	return (error);
+}
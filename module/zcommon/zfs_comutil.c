@@ -42,7 +42,7 @@
 #include "zfs_comutil.h"
 
 /*
- * Are there allocatable vdevs?
+ * Are there allocatable vdevs in the normal class?
  */
 boolean_t
 zfs_allocatable_devs(nvlist_t *nv)
@@ -57,9 +57,14 @@ zfs_allocatable_devs(nvlist_t *nv)
 		return (B_FALSE);
 	}
 	for (c = 0; c < children; c++) {
+		char *bias;
+
 		is_log = 0;
 		(void) nvlist_lookup_uint64(child[c], ZPOOL_CONFIG_IS_LOG,
 		    &is_log);
+		if (nvlist_lookup_string(child[c],
+		    ZPOOL_CONFIG_ALLOCATION_BIAS, &bias) == 0)
+			continue;
 		if (!is_log)
 			return (B_TRUE);
 	}
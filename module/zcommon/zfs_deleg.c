@@ -67,6 +67,7 @@ zfs_deleg_perm_tab_t zfs_deleg_perm_tab[] = {
 	{ZFS_DELEG_PERM_RELEASE},
 	{ZFS_DELEG_PERM_LOAD_KEY},
 	{ZFS_DELEG_PERM_CHANGE_KEY},
+	{ZFS_DELEG_PERM_PREFETCH},
 	{NULL}
 };
 
@@ -129,6 +129,7 @@
  * than sha-256, and slower than 'off', which doesn't touch the data at all.
  */
 
+#include <sys/zfs_context.h>
 #include <sys/types.h>
 #include <sys/sysmacros.h>
 #include <sys/byteorder.h>
@@ -209,19 +210,40 @@ fletcher_2_byteswap(const void *buf, size_t size,
 	(void) fletcher_2_incremental_byteswap((void *) buf, size, zcp);
 }
 
-int
-fletcher_4_incremental_native(void *buf, size_t size, void *data)
+/*
+ * Fletcher-4 is computed with one of several implementations. The scalar
+ * code below is the reference; SIMD variants split the input into lanes
+ * (every N-th 32-bit word goes to the same lane), run fletcher-4 on each
+ * lane independently and fold the lane sums together at the end, see
+ * fletcher_4_simd_fini(). The implementation in use is picked by a
+ * benchmark at module load and can be overridden with the
+ * zfs_fletcher_4_impl tunable.
+ */
+
+static void
+fletcher_4_scalar_init(fletcher_4_ctx_t *ctx)
 {
-	zio_cksum_t *zcp = data;
+	ZIO_SET_CHECKSUM(&ctx->scalar, 0, 0, 0, 0);
+}
 
+static void
+fletcher_4_scalar_fini(fletcher_4_ctx_t *ctx, zio_cksum_t *zcp)
+{
+	memcpy(zcp, &ctx->scalar, sizeof (zio_cksum_t));
+}
+
+static void
+fletcher_4_scalar_native(fletcher_4_ctx_t *ctx, const void *buf,
+    uint64_t size)
+{
 	const uint32_t *ip = buf;
 	const uint32_t *ipend = ip + (size / sizeof (uint32_t));
 	uint64_t a, b, c, d;
 
-	a = zcp->zc_word[0];
-	b = zcp->zc_word[1];
-	c = zcp->zc_word[2];
-	d = zcp->zc_word[3];
+	a = ctx->scalar.zc_word[0];
+	b = ctx->scalar.zc_word[1];
+	c = ctx->scalar.zc_word[2];
+	d = ctx->scalar.zc_word[3];
 
 	for (; ip < ipend; ip++) {
 		a += ip[0];
@@ -230,8 +252,190 @@ fletcher_4_incremental_native(void *buf, size_t size, void *data)
 		d += c;
 	}
 
-	ZIO_SET_CHECKSUM(zcp, a, b, c, d);
-	return (0);
+	ZIO_SET_CHECKSUM(&ctx->scalar, a, b, c, d);
+}
+
+static void
+fletcher_4_scalar_byteswap(fletcher_4_ctx_t *ctx, const void *buf,
+    uint64_t size)
+{
+	const uint32_t *ip = buf;
+	const uint32_t *ipend = ip + (size / sizeof (uint32_t));
+	uint64_t a, b, c, d;
+
+	a = ctx->scalar.zc_word[0];
+	b = ctx->scalar.zc_word[1];
+	c = ctx->scalar.zc_word[2];
+	d = ctx->scalar.zc_word[3];
+
+	for (; ip < ipend; ip++) {
+		a += BSWAP_32(ip[0]);
+		b += a;
+		c += b;
+		d += c;
+	}
+
+	ZIO_SET_CHECKSUM(&ctx->scalar, a, b, c, d);
+}
+
+static boolean_t
+fletcher_4_scalar_valid(void)
+{
+	return (B_TRUE);
+}
+
+static const fletcher_4_ops_t fletcher_4_scalar_ops = {
+	.init_native = fletcher_4_scalar_init,
+	.fini_native = fletcher_4_scalar_fini,
+	.compute_native = fletcher_4_scalar_native,
+	.init_byteswap = fletcher_4_scalar_init,
+	.fini_byteswap = fletcher_4_scalar_fini,
+	.compute_byteswap = fletcher_4_scalar_byteswap,
+	.valid = fletcher_4_scalar_valid,
+	.name = "scalar"
+};
+
+/*
+ * Fold the per lane sums of an n lane SIMD implementation into the
+ * fletcher-4 checksum of the whole stream. Lane i holds words i, i + n,
+ * i + 2n, ... of a buffer of n * m words. With t counting the words of a
+ * lane from its end, the position of a word counted from the end of the
+ * buffer is n * t - i, and each of B, C and D can be written in terms of
+ * the lane sums, which weight the words by 1, t, t(t+1)/2 and
+ * t(t+1)(t+2)/6 respectively. All arithmetic is modulo 2^64, as for the
+ * scalar code.
+ */
+void
+fletcher_4_simd_fini(const uint64_t *a, const uint64_t *b, const uint64_t *c,
+    const uint64_t *d, int n, zio_cksum_t *zcp)
+{
+	const uint64_t n1 = n, n2 = n1 * n1, n3 = n2 * n1;
+	uint64_t A = 0, B = 0, C = 0, D = 0;
+	uint64_t i;
+
+	for (i = 0; i < n; i++) {
+		const uint64_t ti2 = i * (i - 1) / 2;
+		const uint64_t ti3 = (i < 2) ? 0 : i * (i - 1) * (i - 2) / 6;
+
+		A += a[i];
+		B += n1 * b[i] - i * a[i];
+		C += n2 * c[i] - (n1 * (n1 - 1) / 2 + n1 * i) * b[i] +
+		    ti2 * a[i];
+		D += n3 * d[i] - (n2 * (n1 - 1) + n2 * i) * c[i] +
+		    (n1 * (n1 - 1) * (n1 - 2) / 6 + n1 * (n1 - 1) / 2 * i +
+		    n1 * ti2) * b[i] - ti3 * a[i];
+	}
+
+	ZIO_SET_CHECKSUM(zcp, A, B, C, D);
+}
+
+/* All compiled in implementations */
+static const fletcher_4_ops_t *fletcher_4_impls[] = {
+	&fletcher_4_scalar_ops,
+#if defined(__x86_64) && defined(HAVE_SSE2)
+	&fletcher_4_sse2_ops,
+#endif
+#if defined(__x86_64) && defined(HAVE_SSE2) && defined(HAVE_SSSE3)
+	&fletcher_4_ssse3_ops,
+#endif
+#if defined(__x86_64) && defined(HAVE_AVX2)
+	&fletcher_4_avx2_ops,
+#endif
+#if defined(__x86_64) && defined(HAVE_AVX512F) && defined(HAVE_AVX2)
+	&fletcher_4_avx512f_ops,
+#endif
+};
+
+#define	FLETCHER_4_IMPL_MAX	ARRAY_SIZE(fletcher_4_impls)
+
+/* Hold all supported implementations */
+static uint32_t fletcher_4_supp_impls_cnt = 0;
+static const fletcher_4_ops_t *fletcher_4_supp_impls[FLETCHER_4_IMPL_MAX];
+
+/* Select fletcher4 implementation */
+#define	IMPL_FASTEST	(UINT32_MAX)
+#define	IMPL_CYCLE	(UINT32_MAX - 1)
+#define	IMPL_SCALAR	(0)
+
+static uint32_t fletcher_4_impl_chosen = IMPL_FASTEST;
+static uint32_t user_sel_impl = IMPL_FASTEST;
+
+/* Indicate that benchmark has been completed */
+static boolean_t fletcher_4_initialized = B_FALSE;
+
+/* Fastest native and byteswap implementations, assembled by benchmark */
+static fletcher_4_ops_t fletcher_4_fastest_impl = {
+	.name = "fastest",
+	.valid = fletcher_4_scalar_valid
+};
+
+static const struct {
+	char *name;
+	uint32_t sel;
+} fletcher_4_impl_selectors[] = {
+	{ "cycle",	IMPL_CYCLE },
+	{ "fastest",	IMPL_FASTEST },
+	{ "scalar",	IMPL_SCALAR }
+};
+
+static inline const fletcher_4_ops_t *
+fletcher_4_impl_get_ops(void)
+{
+	static volatile uint32_t cycle_count = 0;
+	const fletcher_4_ops_t *ops = NULL;
+	uint32_t impl;
+
+	if (!fletcher_4_initialized)
+		return (&fletcher_4_scalar_ops);
+
+	impl = fletcher_4_impl_chosen;
+
+	switch (impl) {
+	case IMPL_FASTEST:
+		ops = &fletcher_4_fastest_impl;
+		break;
+	case IMPL_CYCLE:
+		/* Cycle through supported implementations */
+		impl = atomic_inc_32_nv(&cycle_count);
+		ops = fletcher_4_supp_impls[impl % fletcher_4_supp_impls_cnt];
+		break;
+	default:
+		ASSERT3U(impl, <, fletcher_4_supp_impls_cnt);
+		ops = fletcher_4_supp_impls[impl];
+		break;
+	}
+
+	ASSERT3P(ops, !=, NULL);
+
+	return (ops);
+}
+
+/*
+ * SIMD implementations consume the buffer in blocks of this size; the
+ * remainder is handled by the scalar code continuing from their result.
+ */
+#define	FLETCHER_MIN_SIMD_SIZE	64
+
+static inline void
+fletcher_4_native_impl(const fletcher_4_ops_t *ops, const void *buf,
+    uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_ctx_t ctx;
+
+	ops->init_native(&ctx);
+	ops->compute_native(&ctx, buf, size);
+	ops->fini_native(&ctx, zcp);
+}
+
+static inline void
+fletcher_4_byteswap_impl(const fletcher_4_ops_t *ops, const void *buf,
+    uint64_t size, zio_cksum_t *zcp)
+{
+	fletcher_4_ctx_t ctx;
+
+	ops->init_byteswap(&ctx);
+	ops->compute_byteswap(&ctx, buf, size);
+	ops->fini_byteswap(&ctx, zcp);
 }
 
 /*ARGSUSED*/
@@ -239,8 +443,110 @@ void
 fletcher_4_native(const void *buf, size_t size,
     const void *ctx_template, zio_cksum_t *zcp)
 {
-	fletcher_init(zcp);
-	(void) fletcher_4_incremental_native((void *) buf, size, zcp);
+	const uint64_t p2size = P2ALIGN(size, FLETCHER_MIN_SIMD_SIZE);
+
+	if (p2size == 0) {
+		ZIO_SET_CHECKSUM(zcp, 0, 0, 0, 0);
+	} else {
+		fletcher_4_native_impl(fletcher_4_impl_get_ops(), buf, p2size,
+		    zcp);
+	}
+
+	if (p2size < size) {
+		fletcher_4_scalar_native((fletcher_4_ctx_t *)zcp,
+		    (const char *)buf + p2size, size - p2size);
+	}
+}
+
+/*ARGSUSED*/
+void
+fletcher_4_byteswap(const void *buf, size_t size,
+    const void *ctx_template, zio_cksum_t *zcp)
+{
+	const uint64_t p2size = P2ALIGN(size, FLETCHER_MIN_SIMD_SIZE);
+
+	if (p2size == 0) {
+		ZIO_SET_CHECKSUM(zcp, 0, 0, 0, 0);
+	} else {
+		fletcher_4_byteswap_impl(fletcher_4_impl_get_ops(), buf, p2size,
+		    zcp);
+	}
+
+	if (p2size < size) {
+		fletcher_4_scalar_byteswap((fletcher_4_ctx_t *)zcp,
+		    (const char *)buf + p2size, size - p2size);
+	}
+}
+
+/*
+ * Incremental fletcher-4
+ *
+ * The checksum of a buffer appended to a stream can be derived from the
+ * checksum of the stream so far and the checksum of the buffer on its own,
+ * so the SIMD implementations can also be used for the streaming interface
+ * (abd_iterate_func() callbacks in zio_checksum.c, send streams). For a
+ * buffer of c1 words, the old sums are carried forward as:
+ *
+ *	d' = d + c1 * c + c2 * b + c3 * a + d_buf
+ *	c' = c + c1 * b + c2 * a + c_buf
+ *	b' = b + c1 * a + b_buf
+ *	a' = a + a_buf
+ *
+ * where c2 = c1(c1+1)/2 and c3 = c1(c1+1)(c1+2)/6. Buffers are processed in
+ * chunks of at most ZFS_FLETCHER_4_INC_MAX_SIZE bytes, so that computing
+ * c3 cannot overflow.
+ */
+#define	ZFS_FLETCHER_4_INC_MAX_SIZE	(8ULL << 20)
+
+static inline void
+fletcher_4_incremental_combine(zio_cksum_t *zcp, const uint64_t size,
+    const zio_cksum_t *nzcp)
+{
+	const uint64_t c1 = size / sizeof (uint32_t);
+	const uint64_t c2 = c1 * (c1 + 1) / 2;
+	const uint64_t c3 = c2 * (c1 + 2) / 3;
+
+	ASSERT3U(size, <=, ZFS_FLETCHER_4_INC_MAX_SIZE);
+
+	zcp->zc_word[3] += nzcp->zc_word[3] + c1 * zcp->zc_word[2] +
+	    c2 * zcp->zc_word[1] + c3 * zcp->zc_word[0];
+	zcp->zc_word[2] += nzcp->zc_word[2] + c1 * zcp->zc_word[1] +
+	    c2 * zcp->zc_word[0];
+	zcp->zc_word[1] += nzcp->zc_word[1] + c1 * zcp->zc_word[0];
+	zcp->zc_word[0] += nzcp->zc_word[0];
+}
+
+static inline void
+fletcher_4_incremental_impl(boolean_t native, const void *buf, uint64_t size,
+    zio_cksum_t *zcp)
+{
+	while (size > 0) {
+		zio_cksum_t nzc;
+		uint64_t len = MIN(size, ZFS_FLETCHER_4_INC_MAX_SIZE);
+
+		if (native)
+			fletcher_4_native(buf, len, NULL, &nzc);
+		else
+			fletcher_4_byteswap(buf, len, NULL, &nzc);
+
+		fletcher_4_incremental_combine(zcp, len, &nzc);
+
+		size -= len;
+		buf = (const char *)buf + len;
+	}
+}
+
+int
+fletcher_4_incremental_native(void *buf, size_t size, void *data)
+{
+	zio_cksum_t *zcp = data;
+
+	/* Use scalar impl to directly update cksum of small blocks */
+	if (size < SPA_MINBLOCKSIZE)
+		fletcher_4_scalar_native((fletcher_4_ctx_t *)zcp, buf, size);
+	else
+		fletcher_4_incremental_impl(B_TRUE, buf, size, zcp);
+	return (0);
 }
 
 int
@@ -248,33 +554,317 @@ fletcher_4_incremental_byteswap(void *buf, size_t size, void *data)
 {
 	zio_cksum_t *zcp = data;
 
-	const uint32_t *ip = buf;
-	const uint32_t *ipend = ip + (size / sizeof (uint32_t));
-	uint64_t a, b, c, d;
+	/* Use scalar impl to directly update cksum of small blocks */
+	if (size < SPA_MINBLOCKSIZE)
+		fletcher_4_scalar_byteswap((fletcher_4_ctx_t *)zcp, buf, size);
+	else
+		fletcher_4_incremental_impl(B_FALSE, buf, size, zcp);
+	return (0);
+}
 
-	a = zcp->zc_word[0];
-	b = zcp->zc_word[1];
-	c = zcp->zc_word[2];
-	d = zcp->zc_word[3];
+/*
+ * Set the fletcher-4 implementation to use.
+ *
+ * If called before fletcher_4_init(), the selection is saved and applied
+ * once the supported implementations are known.
+ */
+int
+fletcher_4_impl_set(const char *val)
+{
+	int err = EINVAL;
+	char req_name[32];
+	uint32_t impl = IMPL_FASTEST;
+	size_t i;
 
-	for (; ip < ipend; ip++) {
-		a += BSWAP_32(ip[0]);
-		b += a;
-		c += b;
-		d += c;
+	/* sanitize input */
+	i = strnlen(val, sizeof (req_name));
+	if (i == 0 || i == sizeof (req_name))
+		return (err);
+
+	strlcpy(req_name, val, sizeof (req_name));
+	while (i > 0 && (req_name[i-1] == ' ' || req_name[i-1] == '\t' ||
+	    req_name[i-1] == '\n'))
+		i--;
+	req_name[i] = '\0';
+
+	/* Check mandatory options */
+	for (i = 0; i < ARRAY_SIZE(fletcher_4_impl_selectors); i++) {
+		if (strcmp(req_name, fletcher_4_impl_selectors[i].name) == 0) {
+			impl = fletcher_4_impl_selectors[i].sel;
+			err = 0;
+			break;
+		}
 	}
 
-	ZIO_SET_CHECKSUM(zcp, a, b, c, d);
+	/* check all supported impl if init() was already called */
+	if (err != 0 && fletcher_4_initialized) {
+		for (i = 0; i < fletcher_4_supp_impls_cnt; i++) {
+			if (strcmp(req_name, fletcher_4_supp_impls[i]->name) ==
+			    0) {
+				impl = i;
+				err = 0;
+				break;
+			}
+		}
+	}
+
+	if (err == 0) {
+		if (fletcher_4_initialized)
+			atomic_swap_32(&fletcher_4_impl_chosen, impl);
+		else
+			atomic_swap_32(&user_sel_impl, impl);
+	}
+
+	return (err);
+}
+
+/*
+ * Describe the available implementations, with the selected one in
+ * square brackets.
+ */
+void
+fletcher_4_impl_get(char *buffer, size_t size)
+{
+	const uint32_t impl = fletcher_4_initialized ?
+	    fletcher_4_impl_chosen : user_sel_impl;
+	const char *fmt;
+	size_t off = 0;
+	int i;
+
+	ASSERT3U(size, >, 0);
+	buffer[0] = '\0';
+
+	/* list mandatory options */
+	for (i = 0; i < ARRAY_SIZE(fletcher_4_impl_selectors) - 1 &&
+	    off < size; i++) {
+		fmt = (impl == fletcher_4_impl_selectors[i].sel) ?
+		    "[%s] " : "%s ";
+		off += snprintf(buffer + off, size - off, fmt,
+		    fletcher_4_impl_selectors[i].name);
+	}
+
+	/* list all supported implementations */
+	for (i = 0; i < fletcher_4_supp_impls_cnt && off < size; i++) {
+		fmt = (i == impl) ? "[%s] " : "%s ";
+		off += snprintf(buffer + off, size - off, fmt,
+		    fletcher_4_supp_impls[i]->name);
+	}
+}
+
+/*
+ * Benchmark and statistics
+ */
+typedef struct fletcher_4_kstat {
+	uint64_t native;	/* native speed B/s */
+	uint64_t byteswap;	/* byteswap speed B/s */
+} fletcher_4_stat_t;
+
+/* One entry per supported implementation, plus one for "fastest" */
+static fletcher_4_stat_t fletcher_4_stat_data[FLETCHER_4_IMPL_MAX + 1];
+
+static kstat_t *fletcher_4_kstat = NULL;
+static kmutex_t fletcher_4_kstat_lock;
+
+static int
+fletcher_4_kstat_headers(char *buf, size_t size)
+{
+	ssize_t off = 0;
+
+	off += snprintf(buf + off, size - off, "%-17s", "implementation");
+	off += snprintf(buf + off, size - off, "%-12s", "native");
+	(void) snprintf(buf + off, size - off, "%-12s\n", "byteswap");
+
 	return (0);
 }
 
-/*ARGSUSED*/
+/* Speeds are reported in GB/s with two decimals */
+#define	FLETCHER_KSTAT_GB(bps)	((bps) / 1000000000ULL)
+#define	FLETCHER_KSTAT_CGB(bps)	(((bps) / 10000000ULL) % 100)
+
+static int
+fletcher_4_kstat_data(char *buf, size_t size, void *data)
+{
+	fletcher_4_stat_t *fastest_stat =
+	    &fletcher_4_stat_data[fletcher_4_supp_impls_cnt];
+	fletcher_4_stat_t *curr_stat = (fletcher_4_stat_t *)data;
+	ssize_t off = 0;
+
+	if (curr_stat == fastest_stat) {
+		off += snprintf(buf + off, size - off, "%-17s", "fastest");
+		off += snprintf(buf + off, size - off, "%-12s",
+		    fletcher_4_supp_impls[fastest_stat->native]->name);
+		off += snprintf(buf + off, size - off, "%-12s\n",
+		    fletcher_4_supp_impls[fastest_stat->byteswap]->name);
+	} else {
+		ptrdiff_t id = curr_stat - fletcher_4_stat_data;
+
+		off += snprintf(buf + off, size - off, "%-17s",
+		    fletcher_4_supp_impls[id]->name);
+		off += snprintf(buf + off, size - off, "%llu.%02llu%8s",
+		    (u_longlong_t)FLETCHER_KSTAT_GB(curr_stat->native),
+		    (u_longlong_t)FLETCHER_KSTAT_CGB(curr_stat->native), "");
+		off += snprintf(buf + off, size - off, "%llu.%02llu%8s\n",
+		    (u_longlong_t)FLETCHER_KSTAT_GB(curr_stat->byteswap),
+		    (u_longlong_t)FLETCHER_KSTAT_CGB(curr_stat->byteswap), "");
+	}
+
+	return (0);
+}
+
+static void *
+fletcher_4_kstat_addr(kstat_t *ksp, off_t n)
+{
+	if (n <= fletcher_4_supp_impls_cnt)
+		ksp->ks_private = (void *) (fletcher_4_stat_data + n);
+	else
+		ksp->ks_private = NULL;
+
+	return (ksp->ks_private);
+}
+
+#if defined(_KERNEL)
+
+#define	FLETCHER_4_BENCH_SIZE	(128 * 1024)
+#define	FLETCHER_4_BENCH_NS	(MSEC2NSEC(1))
+
+#define	FLETCHER_4_FASTEST_FN_COPY(type, src)				  \
+{									  \
+	fletcher_4_fastest_impl.init_ ## type = src->init_ ## type;	  \
+	fletcher_4_fastest_impl.fini_ ## type = src->fini_ ## type;	  \
+	fletcher_4_fastest_impl.compute_ ## type = src->compute_ ## type; \
+}
+
+static void
+fletcher_4_benchmark_impl(boolean_t native, char *data, uint64_t data_size)
+{
+	fletcher_4_stat_t *fastest_stat =
+	    &fletcher_4_stat_data[fletcher_4_supp_impls_cnt];
+	hrtime_t start;
+	uint64_t run_bw, run_time_ns, best_run = 0;
+	zio_cksum_t zc;
+	uint32_t i, l;
+
+	for (i = 0; i < fletcher_4_supp_impls_cnt; i++) {
+		const fletcher_4_ops_t *ops = fletcher_4_supp_impls[i];
+		uint64_t run_count = 0;
+
+		kpreempt_disable();
+		start = gethrtime();
+		do {
+			for (l = 0; l < 32; l++, run_count++) {
+				if (native)
+					fletcher_4_native_impl(ops, data,
+					    data_size, &zc);
+				else
+					fletcher_4_byteswap_impl(ops, data,
+					    data_size, &zc);
+			}
+
+			run_time_ns = gethrtime() - start;
+		} while (run_time_ns < FLETCHER_4_BENCH_NS);
+		kpreempt_enable();
+
+		run_bw = data_size * run_count * NANOSEC;
+		run_bw /= run_time_ns;	/* B/s */
+
+		if (native)
+			fletcher_4_stat_data[i].native = run_bw;
+		else
+			fletcher_4_stat_data[i].byteswap = run_bw;
+
+		if (run_bw > best_run) {
+			best_run = run_bw;
+
+			if (native) {
+				fastest_stat->native = i;
+				FLETCHER_4_FASTEST_FN_COPY(native, ops);
+			} else {
+				fastest_stat->byteswap = i;
+				FLETCHER_4_FASTEST_FN_COPY(byteswap, ops);
+			}
+		}
+	}
+}
+
+static void
+fletcher_4_benchmark(void)
+{
+	char *databuf;
+	uint64_t i;
+
+	databuf = kmem_alloc(FLETCHER_4_BENCH_SIZE, KM_SLEEP);
+	for (i = 0; i < FLETCHER_4_BENCH_SIZE / sizeof (uint64_t); i++)
+		((uint64_t *)databuf)[i] = (uintptr_t)(databuf + i);
+
+	fletcher_4_benchmark_impl(B_TRUE, databuf, FLETCHER_4_BENCH_SIZE);
+	fletcher_4_benchmark_impl(B_FALSE, databuf, FLETCHER_4_BENCH_SIZE);
+
+	kmem_free(databuf, FLETCHER_4_BENCH_SIZE);
+}
+#endif /* _KERNEL */
+
 void
-fletcher_4_byteswap(const void *buf, size_t size,
-    const void *ctx_template, zio_cksum_t *zcp)
+fletcher_4_init(void)
 {
-	fletcher_init(zcp);
-	(void) fletcher_4_incremental_byteswap((void *) buf, size, zcp);
+	const fletcher_4_ops_t *last;
+	uint32_t i, c;
+
+	/* move supported impl into fletcher_4_supp_impls */
+	for (i = 0, c = 0; i < FLETCHER_4_IMPL_MAX; i++) {
+		const fletcher_4_ops_t *curr_impl = fletcher_4_impls[i];
+
+		if (curr_impl->valid && curr_impl->valid())
+			fletcher_4_supp_impls[c++] = curr_impl;
+	}
+	membar_producer();	/* complete fletcher_4_supp_impls[] init */
+	fletcher_4_supp_impls_cnt = c;	/* number of supported impl */
+
+	/* Until benchmarked, the fastest is the last supported one */
+	last = fletcher_4_supp_impls[c - 1];
+	fletcher_4_fastest_impl.init_native = last->init_native;
+	fletcher_4_fastest_impl.fini_native = last->fini_native;
+	fletcher_4_fastest_impl.compute_native = last->compute_native;
+	fletcher_4_fastest_impl.init_byteswap = last->init_byteswap;
+	fletcher_4_fastest_impl.fini_byteswap = last->fini_byteswap;
+	fletcher_4_fastest_impl.compute_byteswap = last->compute_byteswap;
+	fletcher_4_stat_data[c].native = c - 1;
+	fletcher_4_stat_data[c].byteswap = c - 1;
+
+#if defined(_KERNEL)
+	fletcher_4_benchmark();
+#endif
+
+	/* install kstats for all implementations */
+	mutex_init(&fletcher_4_kstat_lock, NULL, MUTEX_DEFAULT, NULL);
+	fletcher_4_kstat = kstat_create("zfs", 0, "fletcher_4_bench", "misc",
+	    KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+	if (fletcher_4_kstat != NULL) {
+		fletcher_4_kstat->ks_lock = &fletcher_4_kstat_lock;
+		fletcher_4_kstat->ks_data = NULL;
+		fletcher_4_kstat->ks_ndata = UINT32_MAX;
+		kstat_set_raw_ops(fletcher_4_kstat,
+		    fletcher_4_kstat_headers,
+		    fletcher_4_kstat_data,
+		    fletcher_4_kstat_addr);
+		kstat_install(fletcher_4_kstat);
+	}
+
+	/* Finish initialization */
+	fletcher_4_impl_chosen = user_sel_impl;
+	membar_producer();
+	fletcher_4_initialized = B_TRUE;
+}
+
+void
+fletcher_4_fini(void)
+{
+	if (fletcher_4_kstat != NULL) {
+		kstat_delete(fletcher_4_kstat);
+		fletcher_4_kstat = NULL;
+	}
+	mutex_destroy(&fletcher_4_kstat_lock);
+
+	fletcher_4_initialized = B_FALSE;
 }
 
 #if defined(_KERNEL) && defined(HAVE_SPL)
@@ -284,4 +874,8 @@ EXPORT_SYMBOL(fletcher_4_native);
 EXPORT_SYMBOL(fletcher_4_byteswap);
 EXPORT_SYMBOL(fletcher_4_incremental_native);
 EXPORT_SYMBOL(fletcher_4_incremental_byteswap);
+EXPORT_SYMBOL(fletcher_4_init);
+EXPORT_SYMBOL(fletcher_4_fini);
+EXPORT_SYMBOL(fletcher_4_impl_set);
+EXPORT_SYMBOL(fletcher_4_impl_get);
 #endif
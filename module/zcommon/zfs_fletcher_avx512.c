@@ -0,0 +1,127 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/isa_defs.h>
+
+#if defined(__x86_64) && defined(HAVE_AVX512F) && defined(HAVE_AVX2)
+
+#include <sys/zfs_context.h>
+#include <sys/simd_x86.h>
+#include <sys/byteorder.h>
+#include <zfs_fletcher.h>
+
+#include <immintrin.h>
+
+/*
+ * AVX-512F implementation of fletcher-4, on eight 64-bit lanes fed from
+ * 32 byte loads. AVX-512F has no byte shuffle, so the byteswap variant
+ * swaps the words with the AVX2 vpshufb before extending them. Note that
+ * zfs_avx512f_available() is always false in the OS X kernel.
+ */
+
+#define	AVX512_TARGET	__attribute__((target("avx512f,avx2")))
+
+#define	AVX512_LOAD(ctx, s)	\
+	_mm512_load_si512((const void *)(ctx)->avx512[s].v)
+#define	AVX512_STORE(ctx, s, x)	\
+	_mm512_store_si512((void *)(ctx)->avx512[s].v, (x))
+
+static void
+fletcher_4_avx512f_init(fletcher_4_ctx_t *ctx)
+{
+	kfpu_begin();
+	bzero(ctx->avx512, 4 * sizeof (zfs_fletcher_avx512_t));
+}
+
+static void
+fletcher_4_avx512f_fini(fletcher_4_ctx_t *ctx, zio_cksum_t *zcp)
+{
+	uint64_t lanes[4][8];
+
+	memcpy(lanes, ctx->avx512, sizeof (lanes));
+
+	kfpu_end();
+
+	fletcher_4_simd_fini(lanes[0], lanes[1], lanes[2], lanes[3], 8, zcp);
+}
+
+static inline AVX512_TARGET void
+fletcher_4_avx512f_compute(fletcher_4_ctx_t *ctx, const void *buf,
+    uint64_t size, boolean_t bswap)
+{
+	const __m256i bswap_mask = _mm256_set_epi8(
+	    12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+	    12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	const uint8_t *ip = buf;
+	const uint8_t *ipend = ip + size;
+	__m512i a = AVX512_LOAD(ctx, 0), b = AVX512_LOAD(ctx, 1);
+	__m512i c = AVX512_LOAD(ctx, 2), d = AVX512_LOAD(ctx, 3);
+	__m256i w;
+
+	for (; ip < ipend; ip += sizeof (__m256i)) {
+		w = _mm256_loadu_si256((const __m256i *)ip);
+		if (bswap)
+			w = _mm256_shuffle_epi8(w, bswap_mask);
+		a = _mm512_add_epi64(a, _mm512_cvtepu32_epi64(w));
+		b = _mm512_add_epi64(b, a);
+		c = _mm512_add_epi64(c, b);
+		d = _mm512_add_epi64(d, c);
+	}
+
+	AVX512_STORE(ctx, 0, a);
+	AVX512_STORE(ctx, 1, b);
+	AVX512_STORE(ctx, 2, c);
+	AVX512_STORE(ctx, 3, d);
+}
+
+static AVX512_TARGET void
+fletcher_4_avx512f_native(fletcher_4_ctx_t *ctx, const void *buf,
+    uint64_t size)
+{
+	fletcher_4_avx512f_compute(ctx, buf, size, B_FALSE);
+}
+
+static AVX512_TARGET void
+fletcher_4_avx512f_byteswap(fletcher_4_ctx_t *ctx, const void *buf,
+    uint64_t size)
+{
+	fletcher_4_avx512f_compute(ctx, buf, size, B_TRUE);
+}
+
+static boolean_t
+fletcher_4_avx512f_valid(void)
+{
+	return (zfs_avx_available() && zfs_avx2_available() &&
+	    zfs_avx512f_available());
+}
+
+const fletcher_4_ops_t fletcher_4_avx512f_ops = {
+	.init_native = fletcher_4_avx512f_init,
+	.fini_native = fletcher_4_avx512f_fini,
+	.compute_native = fletcher_4_avx512f_native,
+	.init_byteswap = fletcher_4_avx512f_init,
+	.fini_byteswap = fletcher_4_avx512f_fini,
+	.compute_byteswap = fletcher_4_avx512f_byteswap,
+	.valid = fletcher_4_avx512f_valid,
+	.name = "avx512f"
+};
+
+#endif /* defined(__x86_64) && defined(HAVE_AVX512F) && defined(HAVE_AVX2) */
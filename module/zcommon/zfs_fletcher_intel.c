@@ -0,0 +1,123 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/isa_defs.h>
+
+#if defined(__x86_64) && defined(HAVE_AVX2)
+
+#include <sys/zfs_context.h>
+#include <sys/simd_x86.h>
+#include <sys/byteorder.h>
+#include <zfs_fletcher.h>
+
+#include <immintrin.h>
+
+/*
+ * AVX2 implementation of fletcher-4. Each 16 byte load is zero extended
+ * into one register of four 64-bit lanes; the byteswap variant swaps the
+ * words with pshufb before extending them.
+ */
+
+#define	AVX2_TARGET	__attribute__((target("avx2")))
+
+#define	AVX2_LOAD(ctx, s)	\
+	_mm256_load_si256((const __m256i *)(ctx)->avx[s].v)
+#define	AVX2_STORE(ctx, s, x)	\
+	_mm256_store_si256((__m256i *)(ctx)->avx[s].v, (x))
+
+static void
+fletcher_4_avx2_init(fletcher_4_ctx_t *ctx)
+{
+	kfpu_begin();
+	bzero(ctx->avx, 4 * sizeof (zfs_fletcher_avx_t));
+}
+
+static void
+fletcher_4_avx2_fini(fletcher_4_ctx_t *ctx, zio_cksum_t *zcp)
+{
+	uint64_t lanes[4][4];
+
+	memcpy(lanes, ctx->avx, sizeof (lanes));
+
+	kfpu_end();
+
+	fletcher_4_simd_fini(lanes[0], lanes[1], lanes[2], lanes[3], 4, zcp);
+}
+
+static inline AVX2_TARGET void
+fletcher_4_avx2_compute(fletcher_4_ctx_t *ctx, const void *buf,
+    uint64_t size, boolean_t bswap)
+{
+	const __m128i bswap_mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+	    4, 5, 6, 7, 0, 1, 2, 3);
+	const uint8_t *ip = buf;
+	const uint8_t *ipend = ip + size;
+	__m256i a = AVX2_LOAD(ctx, 0), b = AVX2_LOAD(ctx, 1);
+	__m256i c = AVX2_LOAD(ctx, 2), d = AVX2_LOAD(ctx, 3);
+	__m128i w;
+
+	for (; ip < ipend; ip += sizeof (__m128i)) {
+		w = _mm_loadu_si128((const __m128i *)ip);
+		if (bswap)
+			w = _mm_shuffle_epi8(w, bswap_mask);
+		a = _mm256_add_epi64(a, _mm256_cvtepu32_epi64(w));
+		b = _mm256_add_epi64(b, a);
+		c = _mm256_add_epi64(c, b);
+		d = _mm256_add_epi64(d, c);
+	}
+
+	AVX2_STORE(ctx, 0, a);
+	AVX2_STORE(ctx, 1, b);
+	AVX2_STORE(ctx, 2, c);
+	AVX2_STORE(ctx, 3, d);
+}
+
+static AVX2_TARGET void
+fletcher_4_avx2_native(fletcher_4_ctx_t *ctx, const void *buf, uint64_t size)
+{
+	fletcher_4_avx2_compute(ctx, buf, size, B_FALSE);
+}
+
+static AVX2_TARGET void
+fletcher_4_avx2_byteswap(fletcher_4_ctx_t *ctx, const void *buf,
+    uint64_t size)
+{
+	fletcher_4_avx2_compute(ctx, buf, size, B_TRUE);
+}
+
+static boolean_t
+fletcher_4_avx2_valid(void)
+{
+	return (zfs_avx_available() && zfs_avx2_available());
+}
+
+const fletcher_4_ops_t fletcher_4_avx2_ops = {
+	.init_native = fletcher_4_avx2_init,
+	.fini_native = fletcher_4_avx2_fini,
+	.compute_native = fletcher_4_avx2_native,
+	.init_byteswap = fletcher_4_avx2_init,
+	.fini_byteswap = fletcher_4_avx2_fini,
+	.compute_byteswap = fletcher_4_avx2_byteswap,
+	.valid = fletcher_4_avx2_valid,
+	.name = "avx2"
+};
+
+#endif /* defined(__x86_64) && defined(HAVE_AVX2) */
@@ -0,0 +1,177 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/isa_defs.h>
+
+#if defined(__x86_64) && defined(HAVE_SSE2)
+
+#include <sys/zfs_context.h>
+#include <sys/simd_x86.h>
+#include <sys/byteorder.h>
+#include <zfs_fletcher.h>
+
+#include <immintrin.h>
+
+/*
+ * SSE2 and SSSE3 implementations of fletcher-4. Every 16 bytes of input
+ * are four 32-bit words, which are zero extended into two registers of two
+ * 64-bit lanes each, so word i of every block always lands in lane i.
+ */
+
+#define	SSE2_TARGET	__attribute__((target("sse2")))
+#define	SSSE3_TARGET	__attribute__((target("ssse3")))
+
+#define	SSE_LOAD(ctx, s, r)	\
+	_mm_load_si128((const __m128i *)(ctx)->sse[s][r].v)
+#define	SSE_STORE(ctx, s, r, x)	\
+	_mm_store_si128((__m128i *)(ctx)->sse[s][r].v, (x))
+
+static void
+fletcher_4_sse2_init(fletcher_4_ctx_t *ctx)
+{
+	kfpu_begin();
+	bzero(ctx->sse, 4 * sizeof (ctx->sse[0]));
+}
+
+static void
+fletcher_4_sse2_fini(fletcher_4_ctx_t *ctx, zio_cksum_t *zcp)
+{
+	uint64_t lanes[4][4];
+	int s, l;
+
+	for (s = 0; s < 4; s++) {
+		for (l = 0; l < 4; l++)
+			lanes[s][l] = ctx->sse[s][l / 2].v[l % 2];
+	}
+
+	kfpu_end();
+
+	fletcher_4_simd_fini(lanes[0], lanes[1], lanes[2], lanes[3], 4, zcp);
+}
+
+/*
+ * Run the four running sums over the zero extended words. BSWAP is applied
+ * to every 16 byte load, to byte swap the words for the byteswap variants.
+ */
+#define	FLETCHER_4_SSE_LOOP(BSWAP)					\
+{									\
+	const __m128i zero = _mm_setzero_si128();			\
+	const uint8_t *ip = buf;					\
+	const uint8_t *ipend = ip + size;				\
+	__m128i a0 = SSE_LOAD(ctx, 0, 0), a1 = SSE_LOAD(ctx, 0, 1);	\
+	__m128i b0 = SSE_LOAD(ctx, 1, 0), b1 = SSE_LOAD(ctx, 1, 1);	\
+	__m128i c0 = SSE_LOAD(ctx, 2, 0), c1 = SSE_LOAD(ctx, 2, 1);	\
+	__m128i d0 = SSE_LOAD(ctx, 3, 0), d1 = SSE_LOAD(ctx, 3, 1);	\
+	__m128i w;							\
+									\
+	for (; ip < ipend; ip += sizeof (__m128i)) {			\
+		w = BSWAP(_mm_loadu_si128((const __m128i *)ip));	\
+		a0 = _mm_add_epi64(a0, _mm_unpacklo_epi32(w, zero));	\
+		a1 = _mm_add_epi64(a1, _mm_unpackhi_epi32(w, zero));	\
+		b0 = _mm_add_epi64(b0, a0);				\
+		b1 = _mm_add_epi64(b1, a1);				\
+		c0 = _mm_add_epi64(c0, b0);				\
+		c1 = _mm_add_epi64(c1, b1);				\
+		d0 = _mm_add_epi64(d0, c0);				\
+		d1 = _mm_add_epi64(d1, c1);				\
+	}								\
+									\
+	SSE_STORE(ctx, 0, 0, a0); SSE_STORE(ctx, 0, 1, a1);		\
+	SSE_STORE(ctx, 1, 0, b0); SSE_STORE(ctx, 1, 1, b1);		\
+	SSE_STORE(ctx, 2, 0, c0); SSE_STORE(ctx, 2, 1, c1);		\
+	SSE_STORE(ctx, 3, 0, d0); SSE_STORE(ctx, 3, 1, d1);		\
+}
+
+#define	SSE_NOSWAP(w)	(w)
+
+static inline SSE2_TARGET __m128i
+sse2_bswap32(__m128i w)
+{
+	/* swap the bytes of each 16-bit word, then the words of each dword */
+	w = _mm_or_si128(_mm_slli_epi16(w, 8), _mm_srli_epi16(w, 8));
+	w = _mm_shufflelo_epi16(w, _MM_SHUFFLE(2, 3, 0, 1));
+	return (_mm_shufflehi_epi16(w, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+static SSE2_TARGET void
+fletcher_4_sse2_native(fletcher_4_ctx_t *ctx, const void *buf, uint64_t size)
+FLETCHER_4_SSE_LOOP(SSE_NOSWAP)
+
+static SSE2_TARGET void
+fletcher_4_sse2_byteswap(fletcher_4_ctx_t *ctx, const void *buf,
+    uint64_t size)
+FLETCHER_4_SSE_LOOP(sse2_bswap32)
+
+static boolean_t
+fletcher_4_sse2_valid(void)
+{
+	return (zfs_sse2_available());
+}
+
+const fletcher_4_ops_t fletcher_4_sse2_ops = {
+	.init_native = fletcher_4_sse2_init,
+	.fini_native = fletcher_4_sse2_fini,
+	.compute_native = fletcher_4_sse2_native,
+	.init_byteswap = fletcher_4_sse2_init,
+	.fini_byteswap = fletcher_4_sse2_fini,
+	.compute_byteswap = fletcher_4_sse2_byteswap,
+	.valid = fletcher_4_sse2_valid,
+	.name = "sse2"
+};
+
+#if defined(HAVE_SSSE3)
+
+/*
+ * SSSE3 only improves the byteswap case, which does the swap with a
+ * single pshufb.
+ */
+#define	SSSE3_BSWAP(w)	_mm_shuffle_epi8((w), bswap_mask)
+
+static SSSE3_TARGET void
+fletcher_4_ssse3_byteswap(fletcher_4_ctx_t *ctx, const void *buf,
+    uint64_t size)
+{
+	const __m128i bswap_mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+	    4, 5, 6, 7, 0, 1, 2, 3);
+
+	FLETCHER_4_SSE_LOOP(SSSE3_BSWAP);
+}
+
+static boolean_t
+fletcher_4_ssse3_valid(void)
+{
+	return (zfs_sse2_available() && zfs_ssse3_available());
+}
+
+const fletcher_4_ops_t fletcher_4_ssse3_ops = {
+	.init_native = fletcher_4_sse2_init,
+	.fini_native = fletcher_4_sse2_fini,
+	.compute_native = fletcher_4_sse2_native,
+	.init_byteswap = fletcher_4_sse2_init,
+	.fini_byteswap = fletcher_4_sse2_fini,
+	.compute_byteswap = fletcher_4_ssse3_byteswap,
+	.valid = fletcher_4_ssse3_valid,
+	.name = "ssse3"
+};
+
+#endif /* defined(HAVE_SSSE3) */
+
+#endif /* defined(__x86_64) && defined(HAVE_SSE2) */
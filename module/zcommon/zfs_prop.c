@@ -111,6 +111,48 @@ zfs_prop_init(void)
 		{ "gzip-9",	ZIO_COMPRESS_GZIP_9 },
 		{ "zle",	ZIO_COMPRESS_ZLE },
 		{ "lz4",	ZIO_COMPRESS_LZ4 },
+		{ "zstd",	ZIO_COMPRESS_ZSTD_DEFAULT },	/* zstd default */
+		{ "zstd-1",	ZIO_COMPRESS_ZSTD_1 },
+		{ "zstd-2",	ZIO_COMPRESS_ZSTD_2 },
+		{ "zstd-3",	ZIO_COMPRESS_ZSTD_3 },
+		{ "zstd-4",	ZIO_COMPRESS_ZSTD_4 },
+		{ "zstd-5",	ZIO_COMPRESS_ZSTD_5 },
+		{ "zstd-6",	ZIO_COMPRESS_ZSTD_6 },
+		{ "zstd-7",	ZIO_COMPRESS_ZSTD_7 },
+		{ "zstd-8",	ZIO_COMPRESS_ZSTD_8 },
+		{ "zstd-9",	ZIO_COMPRESS_ZSTD_9 },
+		{ "zstd-10",	ZIO_COMPRESS_ZSTD_10 },
+		{ "zstd-11",	ZIO_COMPRESS_ZSTD_11 },
+		{ "zstd-12",	ZIO_COMPRESS_ZSTD_12 },
+		{ "zstd-13",	ZIO_COMPRESS_ZSTD_13 },
+		{ "zstd-14",	ZIO_COMPRESS_ZSTD_14 },
+		{ "zstd-15",	ZIO_COMPRESS_ZSTD_15 },
+		{ "zstd-16",	ZIO_COMPRESS_ZSTD_16 },
+		{ "zstd-17",	ZIO_COMPRESS_ZSTD_17 },
+		{ "zstd-18",	ZIO_COMPRESS_ZSTD_18 },
+		{ "zstd-19",	ZIO_COMPRESS_ZSTD_19 },
+		{ "zstd-fast",	ZIO_COMPRESS_ZSTD_FAST_DEFAULT },
+		{ "zstd-fast-1",	ZIO_COMPRESS_ZSTD_FAST_1 },
+		{ "zstd-fast-2",	ZIO_COMPRESS_ZSTD_FAST_2 },
+		{ "zstd-fast-3",	ZIO_COMPRESS_ZSTD_FAST_3 },
+		{ "zstd-fast-4",	ZIO_COMPRESS_ZSTD_FAST_4 },
+		{ "zstd-fast-5",	ZIO_COMPRESS_ZSTD_FAST_5 },
+		{ "zstd-fast-6",	ZIO_COMPRESS_ZSTD_FAST_6 },
+		{ "zstd-fast-7",	ZIO_COMPRESS_ZSTD_FAST_7 },
+		{ "zstd-fast-8",	ZIO_COMPRESS_ZSTD_FAST_8 },
+		{ "zstd-fast-9",	ZIO_COMPRESS_ZSTD_FAST_9 },
+		{ "zstd-fast-10",	ZIO_COMPRESS_ZSTD_FAST_10 },
+		{ "zstd-fast-20",	ZIO_COMPRESS_ZSTD_FAST_20 },
+		{ "zstd-fast-30",	ZIO_COMPRESS_ZSTD_FAST_30 },
+		{ "zstd-fast-40",	ZIO_COMPRESS_ZSTD_FAST_40 },
+		{ "zstd-fast-50",	ZIO_COMPRESS_ZSTD_FAST_50 },
+		{ "zstd-fast-60",	ZIO_COMPRESS_ZSTD_FAST_60 },
+		{ "zstd-fast-70",	ZIO_COMPRESS_ZSTD_FAST_70 },
+		{ "zstd-fast-80",	ZIO_COMPRESS_ZSTD_FAST_80 },
+		{ "zstd-fast-90",	ZIO_COMPRESS_ZSTD_FAST_90 },
+		{ "zstd-fast-100",	ZIO_COMPRESS_ZSTD_FAST_100 },
+		{ "zstd-fast-500",	ZIO_COMPRESS_ZSTD_FAST_500 },
+		{ "zstd-fast-1000",	ZIO_COMPRESS_ZSTD_FAST_1000 },
 		{ NULL }
 	};
 
@@ -288,7 +330,8 @@ zfs_prop_init(void)
 	zprop_register_index(ZFS_PROP_COMPRESSION, "compression",
 	    ZIO_COMPRESS_DEFAULT, PROP_INHERIT,
 	    ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME,
-	    "on | off | lzjb | gzip | gzip-[1-9] | zle | lz4", "COMPRESS",
+	    "on | off | lzjb | gzip | gzip-[1-9] | zle | lz4 | zstd | zstd-[1-19] "
+	    "| zstd-fast | zstd-fast-[1-10,20,...,100,500,1000]", "COMPRESS",
 	    compress_table);
 	zprop_register_index(ZFS_PROP_SNAPDIR, "snapdir", ZFS_SNAPDIR_HIDDEN,
 	    PROP_INHERIT, ZFS_TYPE_FILESYSTEM,
@@ -497,11 +540,16 @@ zfs_prop_init(void)
 	    PROP_READONLY, ZFS_TYPE_DATASET, "<size>", "LUSED");
 	zprop_register_number(ZFS_PROP_LOGICALREFERENCED, "logicalreferenced",
 	    0, PROP_READONLY, ZFS_TYPE_DATASET, "<size>", "LREFER");
+	zprop_register_number(ZFS_PROP_ARCSIZE, "arcsize", 0, PROP_READONLY,
+	    ZFS_TYPE_DATASET, "<size>", "ARCSIZE");
 	zprop_register_number(ZFS_PROP_PBKDF2_ITERS, "pbkdf2iters",
 	    0, PROP_ONETIME_DEFAULT, ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME,
 	    "<iters>", "PBKDF2ITERS");
 
 	/* default number properties */
+	zprop_register_number(ZFS_PROP_ARCRESERVE, "arcreserve", 0,
+	    PROP_DEFAULT, ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME,
+	    "<size> | none", "ARCRESERVE");
 	zprop_register_number(ZFS_PROP_QUOTA, "quota", 0, PROP_DEFAULT,
 	    ZFS_TYPE_FILESYSTEM, "<size> | none", "QUOTA");
 	zprop_register_number(ZFS_PROP_RESERVATION, "reservation", 0,
@@ -531,6 +579,9 @@ zfs_prop_init(void)
 	zprop_register_number(ZFS_PROP_RECORDSIZE, "recordsize",
 	    SPA_OLD_MAXBLOCKSIZE, PROP_INHERIT,
 	    ZFS_TYPE_FILESYSTEM, "512 to 1M, power of 2", "RECSIZE");
+	zprop_register_number(ZFS_PROP_SPECIAL_SMALL_BLOCKS,
+	    "special_small_blocks", 0, PROP_INHERIT, ZFS_TYPE_FILESYSTEM,
+	    "zero or 512 to 128K, power of 2", "SPECSMALL");
 
 	/* hidden properties */
 	zprop_register_hidden(ZFS_PROP_CREATETXG, "createtxg", PROP_TYPE_NUMBER,
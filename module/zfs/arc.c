@@ -323,6 +323,13 @@ static kcondvar_t	arc_reclaim_thread_cv;
 static boolean_t	arc_reclaim_thread_exit;
 static kcondvar_t	arc_reclaim_waiters_cv;
 
+/*
+ * Large evictions are split across the threads of arc_evict_taskq, each
+ * taking its own share of the sublists of the list being evicted from.
+ */
+static taskq_t		*arc_evict_taskq;
+static int		arc_evict_nthreads;
+
 uint_t arc_reduce_dnlc_percent = 3;
 
 /*
@@ -334,6 +341,28 @@ uint_t arc_reduce_dnlc_percent = 3;
  */
 int zfs_arc_evict_batch_limit = 10;
 
+/*
+ * The number of threads used to evict from the ARC in parallel. If this
+ * is not set by the user, it is configured from the number of CPUs in
+ * arc_init(). A value of 1 evicts from the reclaim thread alone.
+ */
+int zfs_arc_evict_threads = 0;
+
+/*
+ * log2(fraction of arc_c to keep free ahead of demand). The reclaim
+ * thread is woken once arc_size passes arc_c less half of this margin,
+ * and evicts down to arc_c less all of it, so that allocations rarely
+ * find the ARC at its target size and have to wait for eviction.
+ * The margin is capped at SPA_MAXBLOCKSIZE, which keeps arc_size within
+ * the band where arc_adapt() still grows arc_c, and bounds the space
+ * left unused on large ARCs. 0 disables this, and eviction only starts
+ * at arc_c.
+ */
+int zfs_arc_evict_lead_shift = 6;
+
+/* Set once an early wakeup is sent, cleared by the reclaim thread. */
+static volatile uint32_t arc_evict_early_signalled = 0;
+
 /*
  * The number of sublists used for each of the arc state lists. If this
  * is not set to a suitable value by the user, it will be configured to
@@ -394,6 +423,7 @@ int zfs_arc_grow_retry = 0;
 int zfs_arc_shrink_shift = 0;
 int zfs_arc_p_min_shift = 0;
 int zfs_arc_average_blocksize = 8 * 1024; /* 8KB */
+int zfs_arc_hash_max_load = 2; /* hdrs per hash bucket before growing */
 
 boolean_t zfs_compressed_arc_enabled = B_TRUE;
 
@@ -475,11 +505,55 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_evict_l2_eligible;
 	kstat_named_t arcstat_evict_l2_ineligible;
 	kstat_named_t arcstat_evict_l2_skip;
+	/*
+	 * Bytes evicted from each of the arc states; sampled over time,
+	 * these give the eviction rate of each state.
+	 */
+	kstat_named_t arcstat_evict_mru;
+	kstat_named_t arcstat_evict_mfu;
+	kstat_named_t arcstat_evict_mru_ghost;
+	kstat_named_t arcstat_evict_mfu_ghost;
+	/*
+	 * Number of evictions split across the arc_evict taskq, and the
+	 * number of times the reclaim thread was woken before arc_size
+	 * reached arc_c.
+	 */
+	kstat_named_t arcstat_evict_parallel;
+	kstat_named_t arcstat_evict_early_wakeups;
+	/*
+	 * Number of headers skipped by eviction because their dataset
+	 * was within its ARC reservation, and number of evictions that
+	 * had to evict from reserved datasets after all.
+	 */
+	kstat_named_t arcstat_evict_reserved_skip;
+	kstat_named_t arcstat_evict_reserved_overrun;
+	/*
+	 * Number and size of buffers that zfetch read on behalf of a long
+	 * sequential stream and that were admitted at the cold end of the
+	 * MRU state, and number of those that were later promoted to MFU.
+	 */
+	kstat_named_t arcstat_stream_admits;
+	kstat_named_t arcstat_stream_admit_bytes;
+	kstat_named_t arcstat_stream_promotions;
 	kstat_named_t arcstat_hash_elements;
 	kstat_named_t arcstat_hash_elements_max;
 	kstat_named_t arcstat_hash_collisions;
 	kstat_named_t arcstat_hash_chains;
 	kstat_named_t arcstat_hash_chain_max;
+	/*
+	 * Distribution of the lengths of the hash table's chains (buckets
+	 * with two or more headers): 2, 3-4, 5-8 and longer.
+	 */
+	kstat_named_t arcstat_hash_chains_2;
+	kstat_named_t arcstat_hash_chains_4;
+	kstat_named_t arcstat_hash_chains_8;
+	kstat_named_t arcstat_hash_chains_long;
+	/*
+	 * Number of buckets in the hash table, and number of times it
+	 * has been grown.
+	 */
+	kstat_named_t arcstat_hash_buckets;
+	kstat_named_t arcstat_hash_resizes;
 	kstat_named_t arcstat_p;
 	kstat_named_t arcstat_c;
 	kstat_named_t arcstat_c_min;
@@ -657,6 +731,39 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_l2_lsize;
 	kstat_named_t arcstat_l2_psize;
 	kstat_named_t arcstat_l2_hdr_size;
+	/*
+	 * Bytes the L2ARC saves by holding blocks compressed (l2_size less
+	 * l2_asize), buffers written to it straight from the ARC or after
+	 * being copied, padded, compressed or encrypted, buffers that had to
+	 * be decrypted or decompressed when read back, and the time spent
+	 * on those transforms.
+	 */
+	kstat_named_t arcstat_l2_compress_saved;
+	kstat_named_t arcstat_l2_write_direct;
+	kstat_named_t arcstat_l2_write_transformed;
+	kstat_named_t arcstat_l2_write_transform_ns;
+	kstat_named_t arcstat_l2_read_transformed;
+	kstat_named_t arcstat_l2_read_transform_ns;
+	/*
+	 * Raw (encrypted) data that decrypted headers keep only so that it
+	 * can be written to the L2ARC as it is, see L2ARC_WANTS_RABD().
+	 */
+	kstat_named_t arcstat_l2_rabd_size;
+	/*
+	 * Persistent L2ARC: log blocks written, and the outcome and
+	 * progress of the rebuilds done when cache devices are added.
+	 */
+	kstat_named_t arcstat_l2_log_blk_writes;
+	kstat_named_t arcstat_l2_rebuild_success;
+	kstat_named_t arcstat_l2_rebuild_unsupported;
+	kstat_named_t arcstat_l2_rebuild_io_errors;
+	kstat_named_t arcstat_l2_rebuild_cksum_lb_errors;
+	kstat_named_t arcstat_l2_rebuild_lowmem;
+	kstat_named_t arcstat_l2_rebuild_log_blks;
+	kstat_named_t arcstat_l2_rebuild_bufs;
+	kstat_named_t arcstat_l2_rebuild_bufs_precached;
+	kstat_named_t arcstat_l2_rebuild_lsize;
+	kstat_named_t arcstat_l2_rebuild_psize;
 	kstat_named_t arcstat_memory_throttle_count;
 	kstat_named_t arcstat_meta_used;
 	kstat_named_t arcstat_meta_limit;
@@ -716,11 +823,28 @@ static arc_stats_t arc_stats = {
 	{ "evict_l2_eligible",		KSTAT_DATA_UINT64 },
 	{ "evict_l2_ineligible",	KSTAT_DATA_UINT64 },
 	{ "evict_l2_skip",		KSTAT_DATA_UINT64 },
+	{ "evict_mru",			KSTAT_DATA_UINT64 },
+	{ "evict_mfu",			KSTAT_DATA_UINT64 },
+	{ "evict_mru_ghost",		KSTAT_DATA_UINT64 },
+	{ "evict_mfu_ghost",		KSTAT_DATA_UINT64 },
+	{ "evict_parallel",		KSTAT_DATA_UINT64 },
+	{ "evict_early_wakeups",	KSTAT_DATA_UINT64 },
+	{ "evict_reserved_skip",	KSTAT_DATA_UINT64 },
+	{ "evict_reserved_overrun",	KSTAT_DATA_UINT64 },
+	{ "stream_admits",		KSTAT_DATA_UINT64 },
+	{ "stream_admit_bytes",		KSTAT_DATA_UINT64 },
+	{ "stream_promotions",		KSTAT_DATA_UINT64 },
 	{ "hash_elements",		KSTAT_DATA_UINT64 },
 	{ "hash_elements_max",		KSTAT_DATA_UINT64 },
 	{ "hash_collisions",		KSTAT_DATA_UINT64 },
 	{ "hash_chains",		KSTAT_DATA_UINT64 },
 	{ "hash_chain_max",		KSTAT_DATA_UINT64 },
+	{ "hash_chains_2",		KSTAT_DATA_UINT64 },
+	{ "hash_chains_4",		KSTAT_DATA_UINT64 },
+	{ "hash_chains_8",		KSTAT_DATA_UINT64 },
+	{ "hash_chains_long",		KSTAT_DATA_UINT64 },
+	{ "hash_buckets",		KSTAT_DATA_UINT64 },
+	{ "hash_resizes",		KSTAT_DATA_UINT64 },
 	{ "p",				KSTAT_DATA_UINT64 },
 	{ "c",				KSTAT_DATA_UINT64 },
 	{ "c_min",			KSTAT_DATA_UINT64 },
@@ -769,6 +893,24 @@ static arc_stats_t arc_stats = {
 	{ "l2_size",			KSTAT_DATA_UINT64 },
 	{ "l2_asize",			KSTAT_DATA_UINT64 },
 	{ "l2_hdr_size",		KSTAT_DATA_UINT64 },
+	{ "l2_compress_saved",		KSTAT_DATA_UINT64 },
+	{ "l2_write_direct",		KSTAT_DATA_UINT64 },
+	{ "l2_write_transformed",	KSTAT_DATA_UINT64 },
+	{ "l2_write_transform_ns",	KSTAT_DATA_UINT64 },
+	{ "l2_read_transformed",	KSTAT_DATA_UINT64 },
+	{ "l2_read_transform_ns",	KSTAT_DATA_UINT64 },
+	{ "l2_rabd_size",		KSTAT_DATA_UINT64 },
+	{ "l2_log_blk_writes",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_success",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_unsupported",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_io_errors",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_cksum_lb_errors",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_lowmem",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_log_blks",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_bufs",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_bufs_precached",	KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_size",		KSTAT_DATA_UINT64 },
+	{ "l2_rebuild_asize",		KSTAT_DATA_UINT64 },
 	{ "memory_throttle_count",	KSTAT_DATA_UINT64 },
 	{ "arc_meta_used",		KSTAT_DATA_UINT64 },
 	{ "arc_meta_limit",		KSTAT_DATA_UINT64 },
@@ -935,6 +1077,8 @@ typedef struct l2arc_dev l2arc_dev_t;
 #define	HDR_IO_IN_PROGRESS(hdr)	((hdr)->b_flags & ARC_FLAG_IO_IN_PROGRESS)
 #define	HDR_IO_ERROR(hdr)	((hdr)->b_flags & ARC_FLAG_IO_ERROR)
 #define	HDR_PREFETCH(hdr)	((hdr)->b_flags & ARC_FLAG_PREFETCH)
+#define	HDR_STREAMING(hdr)	((hdr)->b_flags & ARC_FLAG_STREAMING)
+#define	HDR_L2_RABD(hdr)	((hdr)->b_flags & ARC_FLAG_L2_RABD)
 #define	HDR_COMPRESSION_ENABLED(hdr)	\
 	((hdr)->b_flags & ARC_FLAG_COMPRESSED_ARC)
 
@@ -988,30 +1132,51 @@ typedef struct l2arc_dev l2arc_dev_t;
  * Hash table routines
  */
 
+/*
+ * The hash table can grow while the ARC is running, so that its chains
+ * stay short as the number of headers rises.  A header's lock is chosen
+ * by the low bits of its hash alone, and the table always has at least
+ * BUF_LOCKS buckets, so every bucket of a lock's stripe, in the old table
+ * and the new one, is covered by the same lock.  This lets the table be
+ * rehashed one stripe at a time: each stripe keeps its own view of the
+ * table and mask, which is switched to the new table once the stripe's
+ * chains have been moved.  Lookups only ever look at their stripe's view,
+ * under their stripe's lock, so they never see a half-moved chain.
+ */
 #define	HT_LOCK_PAD	64
 
 struct ht_lock {
 	kmutex_t	ht_lock;
+	arc_buf_hdr_t	**ht_table;	/* table seen by this stripe */
+	uint64_t	ht_mask;	/* and its mask */
 #ifdef _KERNEL
-	unsigned char	pad[(HT_LOCK_PAD - sizeof (kmutex_t))];
+	unsigned char	pad[HT_LOCK_PAD - ((sizeof (kmutex_t) +
+	    2 * sizeof (uint64_t)) % HT_LOCK_PAD)];
 #endif
 };
 
+#ifdef _KERNEL
+#define	BUF_LOCKS 2048
+#else
 #define	BUF_LOCKS 256
+#endif
 typedef struct buf_hash_table {
 	uint64_t ht_mask;
 	arc_buf_hdr_t **ht_table;
+	uint64_t ht_new_mask;		/* table being grown into, if any */
+	arc_buf_hdr_t **ht_new_table;
+	boolean_t ht_growing;		/* buf_hash_grow_task() queued */
 	struct ht_lock ht_locks[BUF_LOCKS];
 } buf_hash_table_t;
 
 static buf_hash_table_t buf_hash_table;
+static taskq_t *buf_hash_taskq;
 
-#define	BUF_HASH_INDEX(spa, dva, birth) \
-	(buf_hash(spa, dva, birth) & buf_hash_table.ht_mask)
-#define	BUF_HASH_LOCK_NTRY(idx) (buf_hash_table.ht_locks[idx & (BUF_LOCKS-1)])
-#define	BUF_HASH_LOCK(idx)	(&(BUF_HASH_LOCK_NTRY(idx).ht_lock))
+#define	BUF_HASH_LOCK_NTRY(hash) \
+	(buf_hash_table.ht_locks[(hash) & (BUF_LOCKS-1)])
+#define	BUF_HASH_LOCK(hash)	(&(BUF_HASH_LOCK_NTRY(hash).ht_lock))
 #define	HDR_LOCK(hdr) \
-	(BUF_HASH_LOCK(BUF_HASH_INDEX(hdr->b_spa, &hdr->b_dva, hdr->b_birth)))
+	(BUF_HASH_LOCK(buf_hash(hdr->b_spa, &hdr->b_dva, hdr->b_birth)))
 
 #ifdef __APPLE__
 uint64_t *zfs_crc64_table = NULL;
@@ -1055,11 +1220,45 @@ uint64_t l2arc_feed_min_ms = L2ARC_FEED_MIN_MS;	/* min interval milliseconds */
 boolean_t l2arc_noprefetch = B_TRUE;		/* don't cache prefetch bufs */
 boolean_t l2arc_feed_again = B_TRUE;		/* turbo warmup */
 boolean_t l2arc_norw = B_TRUE;			/* no reads during writes */
+boolean_t l2arc_rebuild_enabled = B_TRUE;	/* restore cache at import */
+
+/*
+ * Which ARC buffers the L2ARC is fed from.  With L2ARC_FEED_ALL,
+ * prefetched buffers are cached even if l2arc_noprefetch is set.
+ */
+#define	L2ARC_FEED_MRU_MFU	0	/* MRU and MFU */
+#define	L2ARC_FEED_MFU		1	/* MFU only */
+#define	L2ARC_FEED_ALL		2	/* MRU and MFU, including prefetches */
+
+int l2arc_feed_policy = L2ARC_FEED_MRU_MFU;
+int l2arc_feed_threads = 8;			/* devices fed at once */
+uint64_t l2arc_write_max_scale = 8;		/* max x l2arc_write_max */
+uint64_t l2arc_rabd_max = 64 * 1024 * 1024;	/* raw data kept for L2 */
+
+#define	L2ARC_SKIP_PREFETCH(hdr)					\
+	(l2arc_noprefetch && l2arc_feed_policy != L2ARC_FEED_ALL &&	\
+	HDR_PREFETCH(hdr))
+
+/*
+ * An encrypted hdr keeps its raw data, even once it has been decrypted,
+ * until it has been written to the L2ARC, so that the feed can write it
+ * as it is instead of encrypting it again.  Such hdrs are flagged
+ * ARC_FLAG_L2_RABD, and the raw data they hold is limited to
+ * l2arc_rabd_max.  The feed drops it from hdrs it passes over without
+ * writing them.
+ */
+#define	L2ARC_WANTS_RABD(hdr)						\
+	(l2arc_ndev != 0 && HDR_L2CACHE(hdr) && !HDR_HAS_L2HDR(hdr) &&	\
+	(HDR_L2_RABD(hdr) || ARCSTAT(arcstat_l2_rabd_size) +		\
+	HDR_GET_PSIZE(hdr) <= l2arc_rabd_max))
 
 static list_t L2ARC_dev_list;			/* device list */
 static list_t *l2arc_dev_list;			/* device list pointer */
 static kmutex_t l2arc_dev_mtx;			/* device list mutex */
-static l2arc_dev_t *l2arc_dev_last;		/* last device used */
+static taskq_t *l2arc_feed_taskq;		/* per-device feeds */
+static int l2arc_feed_nthreads;
+static kmutex_t l2arc_dev_kstat_lock;
+static kstat_t *l2arc_dev_ksp;
 static list_t L2ARC_free_on_write;		/* free after write buf list */
 static list_t *l2arc_free_on_write;		/* free after write list ptr */
 static kmutex_t l2arc_free_on_write_mtx;	/* mutex for list */
@@ -1147,17 +1346,39 @@ buf_discard_identity(arc_buf_hdr_t *hdr)
 	hdr->b_birth = 0;
 }
 
+/*
+ * Account for a chain of 'len' headers appearing (delta 1) or going away
+ * (delta -1) in the chain kstats.
+ */
+static void
+buf_hash_chain_stat(uint64_t len, int64_t delta)
+{
+	if (len < 2)
+		return;
+
+	ARCSTAT_INCR(arcstat_hash_chains, delta);
+	if (len == 2)
+		ARCSTAT_INCR(arcstat_hash_chains_2, delta);
+	else if (len <= 4)
+		ARCSTAT_INCR(arcstat_hash_chains_4, delta);
+	else if (len <= 8)
+		ARCSTAT_INCR(arcstat_hash_chains_8, delta);
+	else
+		ARCSTAT_INCR(arcstat_hash_chains_long, delta);
+}
+
 static arc_buf_hdr_t *
 buf_hash_find(uint64_t spa, const blkptr_t *bp, kmutex_t **lockp)
 {
 	const dva_t *dva = BP_IDENTITY(bp);
 	uint64_t birth = BP_PHYSICAL_BIRTH(bp);
-	uint64_t idx = BUF_HASH_INDEX(spa, dva, birth);
-	kmutex_t *hash_lock = BUF_HASH_LOCK(idx);
+	uint64_t hash = buf_hash(spa, dva, birth);
+	struct ht_lock *htl = &BUF_HASH_LOCK_NTRY(hash);
+	kmutex_t *hash_lock = &htl->ht_lock;
 	arc_buf_hdr_t *hdr;
 
 	mutex_enter(hash_lock);
-	for (hdr = buf_hash_table.ht_table[idx]; hdr != NULL;
+	for (hdr = htl->ht_table[hash & htl->ht_mask]; hdr != NULL;
 	    hdr = hdr->b_hash_next) {
 		if (HDR_EQUAL(spa, dva, birth, hdr)) {
 			*lockp = hash_lock;
@@ -1179,9 +1400,10 @@ buf_hash_find(uint64_t spa, const blkptr_t *bp, kmutex_t **lockp)
 static arc_buf_hdr_t *
 buf_hash_insert(arc_buf_hdr_t *hdr, kmutex_t **lockp)
 {
-	uint64_t idx = BUF_HASH_INDEX(hdr->b_spa, &hdr->b_dva, hdr->b_birth);
-	kmutex_t *hash_lock = BUF_HASH_LOCK(idx);
-	arc_buf_hdr_t *fhdr;
+	uint64_t hash = buf_hash(hdr->b_spa, &hdr->b_dva, hdr->b_birth);
+	struct ht_lock *htl = &BUF_HASH_LOCK_NTRY(hash);
+	kmutex_t *hash_lock = &htl->ht_lock;
+	arc_buf_hdr_t *fhdr, **bucket;
 	uint32_t i;
 
 	ASSERT(!DVA_IS_EMPTY(&hdr->b_dva));
@@ -1195,24 +1417,24 @@ buf_hash_insert(arc_buf_hdr_t *hdr, kmutex_t **lockp)
 		ASSERT(MUTEX_HELD(hash_lock));
 	}
 
-	for (fhdr = buf_hash_table.ht_table[idx], i = 0; fhdr != NULL;
+	bucket = &htl->ht_table[hash & htl->ht_mask];
+	for (fhdr = *bucket, i = 0; fhdr != NULL;
 	    fhdr = fhdr->b_hash_next, i++) {
 		if (HDR_EQUAL(hdr->b_spa, &hdr->b_dva, hdr->b_birth, fhdr))
 			return (fhdr);
 	}
 
-	hdr->b_hash_next = buf_hash_table.ht_table[idx];
-	buf_hash_table.ht_table[idx] = hdr;
+	hdr->b_hash_next = *bucket;
+	*bucket = hdr;
 	arc_hdr_set_flags(hdr, ARC_FLAG_IN_HASH_TABLE);
 
 	/* collect some hash table performance data */
 	if (i > 0) {
 		ARCSTAT_BUMP(arcstat_hash_collisions);
-		if (i == 1)
-			ARCSTAT_BUMP(arcstat_hash_chains);
-
 		ARCSTAT_MAX(arcstat_hash_chain_max, i);
 	}
+	buf_hash_chain_stat(i, -1);
+	buf_hash_chain_stat(i + 1, 1);
 
 	ARCSTAT_BUMP(arcstat_hash_elements);
 	ARCSTAT_MAXSTAT(arcstat_hash_elements);
@@ -1223,13 +1445,19 @@ buf_hash_insert(arc_buf_hdr_t *hdr, kmutex_t **lockp)
 static void
 buf_hash_remove(arc_buf_hdr_t *hdr)
 {
-	arc_buf_hdr_t *fhdr, **hdrp;
-	uint64_t idx = BUF_HASH_INDEX(hdr->b_spa, &hdr->b_dva, hdr->b_birth);
+	uint64_t hash = buf_hash(hdr->b_spa, &hdr->b_dva, hdr->b_birth);
+	struct ht_lock *htl = &BUF_HASH_LOCK_NTRY(hash);
+	arc_buf_hdr_t *fhdr, **hdrp, **bucket;
+	uint64_t len = 0;
 
-	ASSERT(MUTEX_HELD(BUF_HASH_LOCK(idx)));
+	ASSERT(MUTEX_HELD(&htl->ht_lock));
 	ASSERT(HDR_IN_HASH_TABLE(hdr));
 
-	hdrp = &buf_hash_table.ht_table[idx];
+	bucket = &htl->ht_table[hash & htl->ht_mask];
+	for (fhdr = *bucket; fhdr != NULL; fhdr = fhdr->b_hash_next)
+		len++;
+
+	hdrp = bucket;
 	while ((fhdr = *hdrp) != hdr) {
 		ASSERT3P(fhdr, !=, NULL);
 		hdrp = &fhdr->b_hash_next;
@@ -1240,10 +1468,119 @@ buf_hash_remove(arc_buf_hdr_t *hdr)
 
 	/* collect some hash table performance data */
 	ARCSTAT_BUMPDOWN(arcstat_hash_elements);
+	buf_hash_chain_stat(len, -1);
+	buf_hash_chain_stat(len - 1, 1);
+}
+
+/*
+ * Move the chains of lock stripe 'stripe' into the new table and switch
+ * the stripe over to it.  Returns the length of the longest new chain.
+ */
+static uint64_t
+buf_hash_move_stripe(struct ht_lock *htl, uint64_t stripe)
+{
+	arc_buf_hdr_t **ntable = buf_hash_table.ht_new_table;
+	uint64_t nmask = buf_hash_table.ht_new_mask;
+	arc_buf_hdr_t *hdr, *next;
+	uint64_t idx, nidx, len, maxlen = 0;
+
+	ASSERT(MUTEX_HELD(&htl->ht_lock));
+	ASSERT3P(htl->ht_table, !=, ntable);
+
+	for (idx = stripe; idx <= htl->ht_mask; idx += BUF_LOCKS) {
+		len = 0;
+		for (hdr = htl->ht_table[idx]; hdr != NULL; hdr = next) {
+			next = hdr->b_hash_next;
+			nidx = buf_hash(hdr->b_spa, &hdr->b_dva,
+			    hdr->b_birth) & nmask;
+			ASSERT3U(nidx & (BUF_LOCKS - 1), ==, stripe);
+			hdr->b_hash_next = ntable[nidx];
+			ntable[nidx] = hdr;
+			len++;
+		}
+		htl->ht_table[idx] = NULL;
+		buf_hash_chain_stat(len, -1);
+	}
+
+	for (idx = stripe; idx <= nmask; idx += BUF_LOCKS) {
+		len = 0;
+		for (hdr = ntable[idx]; hdr != NULL; hdr = hdr->b_hash_next)
+			len++;
+		buf_hash_chain_stat(len, 1);
+		maxlen = MAX(maxlen, len);
+	}
+
+	htl->ht_table = ntable;
+	htl->ht_mask = nmask;
+
+	return (maxlen);
+}
+
+/*
+ * Rehash the table into one big enough for the current number of headers.
+ * Runs on buf_hash_taskq, so unlike the reclaim thread it can wait for
+ * memory and for the hash locks.  The old table is freed once every
+ * stripe has been moved.
+ */
+/* ARGSUSED */
+static void
+buf_hash_grow_task(void *arg)
+{
+	buf_hash_table_t *ht = &buf_hash_table;
+	uint64_t elements = ARCSTAT(arcstat_hash_elements);
+	uint64_t i, nsize, maxlen, chain_max = 0;
+
+	nsize = (ht->ht_mask + 1) << 1;
+	while (elements > nsize * zfs_arc_hash_max_load)
+		nsize <<= 1;
+
+	ht->ht_new_table = kmem_zalloc(nsize * sizeof (void *), KM_SLEEP);
+	ht->ht_new_mask = nsize - 1;
+
+	for (i = 0; i < BUF_LOCKS; i++) {
+		struct ht_lock *htl = &ht->ht_locks[i];
+
+		mutex_enter(&htl->ht_lock);
+		maxlen = buf_hash_move_stripe(htl, i);
+		mutex_exit(&htl->ht_lock);
+
+		chain_max = MAX(chain_max, maxlen);
+	}
+
+	kmem_free(ht->ht_table, (ht->ht_mask + 1) * sizeof (void *));
+	ht->ht_table = ht->ht_new_table;
+	ht->ht_mask = ht->ht_new_mask;
+	ht->ht_new_table = NULL;
+	ht->ht_new_mask = 0;
+
+	ARCSTAT(arcstat_hash_chain_max) = chain_max > 0 ? chain_max - 1 : 0;
+	ARCSTAT(arcstat_hash_buckets) = ht->ht_mask + 1;
+	ARCSTAT_BUMP(arcstat_hash_resizes);
+
+	membar_producer();
+	ht->ht_growing = B_FALSE;
+}
+
+/*
+ * Grow the hash table once it holds more than zfs_arc_hash_max_load
+ * headers per bucket.  This is called from the reclaim thread, which must
+ * not wait for memory or block on hash locks (see the comment above
+ * arc_reclaim_thread()), so it only queues the work for buf_hash_taskq.
+ */
+static void
+buf_hash_grow(void)
+{
+	buf_hash_table_t *ht = &buf_hash_table;
+	uint64_t elements = ARCSTAT(arcstat_hash_elements);
+
+	if (ht->ht_growing || zfs_arc_hash_max_load <= 0 ||
+	    elements <= (ht->ht_mask + 1) * zfs_arc_hash_max_load)
+		return;
 
-	if (buf_hash_table.ht_table[idx] &&
-	    buf_hash_table.ht_table[idx]->b_hash_next == NULL)
-		ARCSTAT_BUMPDOWN(arcstat_hash_chains);
+	ht->ht_growing = B_TRUE;
+	if (taskq_dispatch(buf_hash_taskq, buf_hash_grow_task, NULL,
+	    TQ_NOSLEEP) == 0)
+		ht->ht_growing = B_FALSE;
 }
 
 /*
@@ -1260,6 +1597,10 @@ buf_fini(void)
 {
 	int i;
 
+	/* Waits for a growth in progress */
+	taskq_destroy(buf_hash_taskq);
+
+	ASSERT3P(buf_hash_table.ht_new_table, ==, NULL);
 	kmem_free(buf_hash_table.ht_table,
 	    (buf_hash_table.ht_mask + 1) * sizeof (void *));
 	for (i = 0; i < BUF_LOCKS; i++)
@@ -1412,15 +1753,23 @@ buf_init(void)
 	 */
 	while (hsize * zfs_arc_average_blocksize < physmem * PAGESIZE)
 		hsize <<= 1;
+	/*
+	 * The table can never have fewer buckets than there are hash locks
+	 * (see buf_hash_move_stripe()), so fall back to smaller tables
+	 * only down to that size, which we wait for.
+	 */
+	hsize = MAX(hsize, BUF_LOCKS);
 retry:
 	buf_hash_table.ht_mask = hsize - 1;
-	buf_hash_table.ht_table =
-	    kmem_zalloc(hsize * sizeof (void*), KM_NOSLEEP);
+	buf_hash_table.ht_table = kmem_zalloc(hsize * sizeof (void*),
+	    hsize > BUF_LOCKS ? KM_NOSLEEP : KM_SLEEP);
 	if (buf_hash_table.ht_table == NULL) {
-		ASSERT(hsize > (1ULL << 8));
 		hsize >>= 1;
 		goto retry;
 	}
+	buf_hash_table.ht_growing = B_FALSE;
+	buf_hash_taskq = taskq_create("arc_hash_grow", 1, minclsyspri,
+	    1, 1, 0);
 
 	hdr_full_cache = kmem_cache_create("arc_buf_hdr_t_full", HDR_FULL_SIZE,
 	    0, hdr_full_cons, hdr_full_dest, hdr_recl, NULL, NULL, 0);
@@ -1442,7 +1791,10 @@ retry:
 	for (i = 0; i < BUF_LOCKS; i++) {
 		mutex_init(&buf_hash_table.ht_locks[i].ht_lock,
 		    NULL, MUTEX_DEFAULT, NULL);
+		buf_hash_table.ht_locks[i].ht_table = buf_hash_table.ht_table;
+		buf_hash_table.ht_locks[i].ht_mask = buf_hash_table.ht_mask;
 	}
+	ARCSTAT(arcstat_hash_buckets) = hsize;
 }
 
 /*
@@ -2469,6 +2821,23 @@ add_reference(arc_buf_hdr_t *hdr, void *tag)
 	}
 }
 
+/*
+ * Add an evictable hdr to the list of the given state.  Headers read by
+ * a long sequential stream go to the tail of the MRU (and MRU ghost)
+ * lists instead of the head, so that eviction, which works from the
+ * tail, takes them before anything that was accessed normally.
+ */
+static void
+arc_state_list_insert(arc_state_t *state, arc_buf_hdr_t *hdr)
+{
+	multilist_t *ml = state->arcs_list[arc_buf_type(hdr)];
+
+	if (HDR_STREAMING(hdr) && (state == arc_mru || state == arc_mru_ghost))
+		multilist_insert_tail(ml, hdr);
+	else
+		multilist_insert(ml, hdr);
+}
+
 /*
  * Remove a reference from this hdr. When the reference transitions from
  * 1 to 0 and we're not anonymous, then we add this hdr to the arc_state_t's
@@ -2490,13 +2859,381 @@ remove_reference(arc_buf_hdr_t *hdr, kmutex_t *hash_lock, void *tag)
 	 */
 	if (((cnt = refcount_remove(&hdr->b_l1hdr.b_refcnt, tag)) == 0) &&
 	    (state != arc_anon)) {
-		multilist_insert(state->arcs_list[arc_buf_type(hdr)], hdr);
+		arc_state_list_insert(state, hdr);
 		ASSERT3U(hdr->b_l1hdr.b_bufcnt, >, 0);
 		arc_evictable_space_increment(hdr, state);
 	}
 	return (cnt);
 }
 
+/*
+ * Per-dataset accounting of the ARC.
+ *
+ * Entries are kept in arc_acct_tree, sorted by pool and dataset, and are
+ * held by every header that has one.  A header gets its entry from the
+ * bookmark passed to arc_read() or arc_write(), keeps it for its life,
+ * and moves its sizes between the entry's states in arc_change_state();
+ * anonymous headers aren't counted.  The lock only needs to be taken for
+ * writing when an entry is created or freed.
+ */
+static krwlock_t	arc_acct_lock;
+static avl_tree_t	arc_acct_tree;
+static kmutex_t		arc_acct_kstat_lock;
+static kstat_t		*arc_acct_ksp;
+static uint64_t		arc_acct_nreserved;
+
+static int
+arc_acct_compare(const void *x1, const void *x2)
+{
+	const arc_acct_t *a1 = x1;
+	const arc_acct_t *a2 = x2;
+
+	if (a1->aa_spa < a2->aa_spa)
+		return (-1);
+	if (a1->aa_spa > a2->aa_spa)
+		return (1);
+	if (a1->aa_objset < a2->aa_objset)
+		return (-1);
+	if (a1->aa_objset > a2->aa_objset)
+		return (1);
+	return (0);
+}
+
+static arc_acct_t *
+arc_acct_hold(spa_t *spa, uint64_t objset)
+{
+	arc_acct_t search, *aa;
+	avl_index_t where;
+
+	search.aa_spa = spa_load_guid(spa);
+	search.aa_objset = objset;
+
+	rw_enter(&arc_acct_lock, RW_READER);
+	aa = avl_find(&arc_acct_tree, &search, NULL);
+	if (aa != NULL) {
+		atomic_inc_64(&aa->aa_holds);
+		rw_exit(&arc_acct_lock);
+		return (aa);
+	}
+	rw_exit(&arc_acct_lock);
+
+	rw_enter(&arc_acct_lock, RW_WRITER);
+	aa = avl_find(&arc_acct_tree, &search, &where);
+	if (aa == NULL) {
+		aa = kmem_zalloc(sizeof (arc_acct_t), KM_PUSHPAGE);
+		aa->aa_spa = search.aa_spa;
+		aa->aa_objset = objset;
+		(void) strlcpy(aa->aa_spa_name, spa_name(spa),
+		    sizeof (aa->aa_spa_name));
+		avl_insert(&arc_acct_tree, aa, where);
+	}
+	atomic_inc_64(&aa->aa_holds);
+	rw_exit(&arc_acct_lock);
+
+	return (aa);
+}
+
+/*
+ * Take another hold on an entry that the caller already holds.
+ */
+static arc_acct_t *
+arc_acct_dup(arc_acct_t *aa)
+{
+	if (aa != NULL)
+		atomic_inc_64(&aa->aa_holds);
+	return (aa);
+}
+
+static void
+arc_acct_rele(arc_acct_t *aa)
+{
+	arc_acct_t search;
+
+	search.aa_spa = aa->aa_spa;
+	search.aa_objset = aa->aa_objset;
+	if (atomic_dec_64_nv(&aa->aa_holds) != 0)
+		return;
+
+	/*
+	 * Someone may have found the entry and held it again before we
+	 * got the lock, and even released it again, so look it up anew.
+	 */
+	rw_enter(&arc_acct_lock, RW_WRITER);
+	aa = avl_find(&arc_acct_tree, &search, NULL);
+	if (aa != NULL && aa->aa_holds == 0) {
+		avl_remove(&arc_acct_tree, aa);
+		kmem_free(aa, sizeof (arc_acct_t));
+	}
+	rw_exit(&arc_acct_lock);
+}
+
+/*
+ * Move a header's sizes from its old state to its new state in its
+ * dataset's entry.
+ */
+static void
+arc_acct_change_state(arc_buf_hdr_t *hdr, arc_state_t *old_state,
+    arc_state_t *new_state)
+{
+	arc_acct_t *aa = hdr->b_acct;
+	arc_buf_contents_t type = arc_buf_type(hdr);
+	uint64_t lsize = HDR_GET_LSIZE(hdr);
+	uint64_t psize = HDR_GET_PSIZE(hdr);
+
+	if (old_state != arc_anon) {
+		atomic_add_64(&aa->aa_lsize[old_state->arcs_state][type],
+		    -lsize);
+		atomic_add_64(&aa->aa_psize[old_state->arcs_state][type],
+		    -psize);
+	}
+	if (new_state != arc_anon) {
+		atomic_add_64(&aa->aa_lsize[new_state->arcs_state][type],
+		    lsize);
+		atomic_add_64(&aa->aa_psize[new_state->arcs_state][type],
+		    psize);
+	}
+}
+
+/*
+ * The physical bytes of an entry's blocks in the MRU and MFU states.
+ */
+static uint64_t
+arc_acct_cached(const arc_acct_t *aa)
+{
+	uint64_t size = 0;
+
+	for (int t = 0; t < ARC_BUFC_NUMTYPES; t++) {
+		size += aa->aa_psize[ARC_STATE_MRU][t] +
+		    aa->aa_psize[ARC_STATE_MFU][t];
+	}
+
+	return (size);
+}
+
+/*
+ * Return the number of (physical) bytes of the given dataset's blocks
+ * that are cached in the MRU and MFU states.
+ */
+uint64_t
+arc_dataset_size(spa_t *spa, uint64_t dsobj)
+{
+	arc_acct_t search, *aa;
+	uint64_t size = 0;
+
+	search.aa_spa = spa_load_guid(spa);
+	search.aa_objset = dsobj;
+
+	rw_enter(&arc_acct_lock, RW_READER);
+	aa = avl_find(&arc_acct_tree, &search, NULL);
+	if (aa != NULL)
+		size = arc_acct_cached(aa);
+	rw_exit(&arc_acct_lock);
+
+	return (size);
+}
+
+/*
+ * Change an objset's ARC reservation of its dataset (the "arcreserve"
+ * property) from 'old', what the objset had set before, to 'bytes'.
+ * While a dataset uses no more of the MRU and MFU than its reservation,
+ * its headers are only evicted once nothing else can be.
+ *
+ * A dataset can have more than one objset open at a time, e.g. while an
+ * evicted one is torn down and a new one is opened, so the entry counts
+ * the objsets that set a reservation and only drops it when the last one
+ * clears it; objsets clear theirs when they are evicted.  While the count
+ * isn't zero the entry keeps an extra hold, so that the reservation
+ * outlives the dataset's headers.
+ */
+void
+arc_dataset_set_reserve(spa_t *spa, uint64_t dsobj, uint64_t old,
+    uint64_t bytes)
+{
+	arc_acct_t *aa = arc_acct_hold(spa, dsobj);
+	boolean_t keep = B_FALSE, drop = B_FALSE;
+
+	rw_enter(&arc_acct_lock, RW_WRITER);
+	if (old == 0 && bytes != 0) {
+		if (aa->aa_reserve_holds++ == 0) {
+			atomic_inc_64(&arc_acct_nreserved);
+			keep = B_TRUE;
+		}
+	} else if (old != 0 && bytes == 0) {
+		ASSERT3U(aa->aa_reserve_holds, >, 0);
+		if (--aa->aa_reserve_holds == 0) {
+			aa->aa_reserve = 0;
+			atomic_dec_64(&arc_acct_nreserved);
+			drop = B_TRUE;
+		}
+	}
+	if (bytes != 0)
+		aa->aa_reserve = bytes;
+	rw_exit(&arc_acct_lock);
+
+	if (drop)
+		arc_acct_rele(aa);
+	if (!keep)
+		arc_acct_rele(aa);
+}
+
+/*
+ * Whether a header's dataset is within its ARC reservation.  b_acct
+ * doesn't change while the header is on a state list, so this can be
+ * called without the hash lock.
+ */
+static inline boolean_t
+arc_hdr_reserved(arc_buf_hdr_t *hdr)
+{
+	arc_acct_t *aa = hdr->b_acct;
+
+	if (aa == NULL || aa->aa_reserve == 0)
+		return (B_FALSE);
+
+	return (arc_acct_cached(aa) <= aa->aa_reserve);
+}
+
+static int
+arc_acct_kstat_headers(char *buf, size_t size)
+{
+	(void) snprintf(buf, size,
+	    "%-24s %-8s %-12s %-12s %-12s %-12s %-12s %-12s %-12s "
+	    "%-12s %-12s %-10s %-10s %-10s\n",
+	    "pool", "objset", "mru_data", "mru_meta", "mfu_data", "mfu_meta",
+	    "mru_ghost", "mfu_ghost", "l2_only", "psize", "reserve", "hits",
+	    "misses", "ghost_hits");
+
+	return (0);
+}
+
+static int
+arc_acct_kstat_row(char *buf, size_t size, const char *pool,
+    const char *objset, const arc_acct_t *aa)
+{
+	int n;
+
+	n = snprintf(buf, size,
+	    "%-24s %-8s %-12llu %-12llu %-12llu %-12llu %-12llu %-12llu "
+	    "%-12llu %-12llu %-12llu %-10llu %-10llu %-10llu\n", pool, objset,
+	    (u_longlong_t)aa->aa_lsize[ARC_STATE_MRU][ARC_BUFC_DATA],
+	    (u_longlong_t)aa->aa_lsize[ARC_STATE_MRU][ARC_BUFC_METADATA],
+	    (u_longlong_t)aa->aa_lsize[ARC_STATE_MFU][ARC_BUFC_DATA],
+	    (u_longlong_t)aa->aa_lsize[ARC_STATE_MFU][ARC_BUFC_METADATA],
+	    (u_longlong_t)(aa->aa_lsize[ARC_STATE_MRU_GHOST][ARC_BUFC_DATA] +
+	    aa->aa_lsize[ARC_STATE_MRU_GHOST][ARC_BUFC_METADATA]),
+	    (u_longlong_t)(aa->aa_lsize[ARC_STATE_MFU_GHOST][ARC_BUFC_DATA] +
+	    aa->aa_lsize[ARC_STATE_MFU_GHOST][ARC_BUFC_METADATA]),
+	    (u_longlong_t)(aa->aa_lsize[ARC_STATE_L2C_ONLY][ARC_BUFC_DATA] +
+	    aa->aa_lsize[ARC_STATE_L2C_ONLY][ARC_BUFC_METADATA]),
+	    (u_longlong_t)arc_acct_cached(aa), (u_longlong_t)aa->aa_reserve,
+	    (u_longlong_t)aa->aa_hits,
+	    (u_longlong_t)aa->aa_misses, (u_longlong_t)aa->aa_ghost_hits);
+
+	return (n);
+}
+
+/*
+ * One row per dataset, followed by a "total" row for each pool.  All
+ * sizes are logical bytes, except psize, which is the physical size of
+ * the blocks in the MRU and MFU states, and reserve, the dataset's
+ * "arcreserve" (which psize is held to).
+ */
+static int
+arc_acct_kstat_data(char *buf, size_t size, void *data)
+{
+	arc_acct_t total, *aa;
+	char objset[24];
+	int n, error = 0;
+
+	rw_enter(&arc_acct_lock, RW_READER);
+	for (aa = avl_first(&arc_acct_tree); aa != NULL;
+	    aa = AVL_NEXT(&arc_acct_tree, aa)) {
+		arc_acct_t *prev = AVL_PREV(&arc_acct_tree, aa);
+		arc_acct_t *next = AVL_NEXT(&arc_acct_tree, aa);
+
+		if (prev == NULL || prev->aa_spa != aa->aa_spa)
+			bzero(&total, sizeof (total));
+		for (int s = 0; s < ARC_STATE_NUMTYPES; s++) {
+			for (int t = 0; t < ARC_BUFC_NUMTYPES; t++) {
+				total.aa_lsize[s][t] += aa->aa_lsize[s][t];
+				total.aa_psize[s][t] += aa->aa_psize[s][t];
+			}
+		}
+		total.aa_reserve += aa->aa_reserve;
+		total.aa_hits += aa->aa_hits;
+		total.aa_misses += aa->aa_misses;
+		total.aa_ghost_hits += aa->aa_ghost_hits;
+
+		(void) snprintf(objset, sizeof (objset), "%llu",
+		    (u_longlong_t)aa->aa_objset);
+		n = arc_acct_kstat_row(buf, size, aa->aa_spa_name, objset, aa);
+		if (n >= size) {
+			error = SET_ERROR(ENOMEM);
+			break;
+		}
+		buf += n;
+		size -= n;
+
+		if (next == NULL || next->aa_spa != aa->aa_spa) {
+			n = arc_acct_kstat_row(buf, size, aa->aa_spa_name,
+			    "total", &total);
+			if (n >= size) {
+				error = SET_ERROR(ENOMEM);
+				break;
+			}
+			buf += n;
+			size -= n;
+		}
+	}
+	rw_exit(&arc_acct_lock);
+
+	return (error);
+}
+
+static void *
+arc_acct_kstat_addr(kstat_t *ksp, off_t n)
+{
+	if (n == 0)
+		return (ksp);
+	return (NULL);
+}
+
+static void
+arc_acct_init(void)
+{
+	rw_init(&arc_acct_lock, NULL, RW_DEFAULT, NULL);
+	avl_create(&arc_acct_tree, arc_acct_compare, sizeof (arc_acct_t),
+	    offsetof(arc_acct_t, aa_node));
+	mutex_init(&arc_acct_kstat_lock, NULL, MUTEX_DEFAULT, NULL);
+
+	arc_acct_ksp = kstat_create("zfs", 0, "arc_datasets", "misc",
+	    KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+	if (arc_acct_ksp != NULL) {
+		arc_acct_ksp->ks_lock = &arc_acct_kstat_lock;
+		arc_acct_ksp->ks_ndata = UINT32_MAX;
+		kstat_set_raw_ops(arc_acct_ksp, arc_acct_kstat_headers,
+		    arc_acct_kstat_data, arc_acct_kstat_addr);
+		kstat_install(arc_acct_ksp);
+	}
+}
+
+static void
+arc_acct_fini(void)
+{
+	if (arc_acct_ksp != NULL) {
+		kstat_delete(arc_acct_ksp);
+		arc_acct_ksp = NULL;
+	}
+
+	/* every header, and so every hold, is gone by now */
+	void *cookie = NULL;
+	arc_acct_t *aa;
+	while ((aa = avl_destroy_nodes(&arc_acct_tree, &cookie)) != NULL)
+		kmem_free(aa, sizeof (arc_acct_t));
+	avl_destroy(&arc_acct_tree);
+	rw_destroy(&arc_acct_lock);
+	mutex_destroy(&arc_acct_kstat_lock);
+}
+
 /*
  * Move the supplied buffer to the indicated state. The hash lock
  * for the buffer must be held by the caller.
@@ -2561,7 +3298,7 @@ arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *hdr,
 			 * beforehand.
 			 */
 			ASSERT(HDR_HAS_L1HDR(hdr));
-			multilist_insert(new_state->arcs_list[buftype], hdr);
+			arc_state_list_insert(new_state, hdr);
 
 			if (GHOST_STATE(new_state)) {
 				ASSERT0(bufcnt);
@@ -2576,6 +3313,9 @@ arc_change_state(arc_state_t *new_state, arc_buf_hdr_t *hdr,
 	if (new_state == arc_anon && HDR_IN_HASH_TABLE(hdr))
 		buf_hash_remove(hdr);
 
+	if (hdr->b_acct != NULL)
+		arc_acct_change_state(hdr, old_state, new_state);
+
 	/* adjust state sizes (ignore arc_l2c_only) */
 
 	if (update_new && new_state != arc_l2c_only) {
@@ -2899,8 +3639,15 @@ arc_buf_alloc_impl(arc_buf_hdr_t *hdr, spa_t *spa, uint64_t dsobj, void *tag,
 
 	hdr->b_l1hdr.b_buf = buf;
 	hdr->b_l1hdr.b_bufcnt += 1;
-	if (encrypted)
+	if (encrypted) {
 		hdr->b_crypt_hdr.b_ebufcnt += 1;
+		/* b_rabd now backs a buf, not just the L2ARC */
+		if (HDR_L2_RABD(hdr)) {
+			arc_hdr_clear_flags(hdr, ARC_FLAG_L2_RABD);
+			ARCSTAT_INCR(arcstat_l2_rabd_size,
+			    -HDR_GET_PSIZE(hdr));
+		}
+	}
 
 	/*
 	 * If the user wants the data from the hdr, we need to either copy or
@@ -3183,11 +3930,17 @@ arc_buf_destroy_impl(arc_buf_t *buf)
 		/*
 		 * If we have no more encrypted buffers and we've already
 		 * gotten a copy of the decrypted data we can free b_rabd to
-		 * save some space.
+		 * save some space, unless the L2ARC still wants it.
 		 */
-		if (hdr->b_crypt_hdr.b_ebufcnt == 0 && HDR_HAS_RABD(hdr) &&
+		if (HDR_HAS_RABD(hdr) && hdr->b_crypt_hdr.b_ebufcnt == 0 &&
 		    hdr->b_l1hdr.b_pabd != NULL && !HDR_IO_IN_PROGRESS(hdr)) {
-			arc_hdr_free_abd(hdr, B_TRUE);
+			if (!L2ARC_WANTS_RABD(hdr)) {
+				arc_hdr_free_abd(hdr, B_TRUE);
+			} else if (!HDR_L2_RABD(hdr)) {
+				arc_hdr_set_flags(hdr, ARC_FLAG_L2_RABD);
+				ARCSTAT_INCR(arcstat_l2_rabd_size,
+				    HDR_GET_PSIZE(hdr));
+			}
 		}
 	}
 
@@ -3308,6 +4061,10 @@ arc_hdr_free_abd(arc_buf_hdr_t *hdr, boolean_t free_rdata)
 
 	if (free_rdata) {
 		hdr->b_crypt_hdr.b_rabd = NULL;
+		if (HDR_L2_RABD(hdr)) {
+			arc_hdr_clear_flags(hdr, ARC_FLAG_L2_RABD);
+			ARCSTAT_INCR(arcstat_l2_rabd_size, -size);
+		}
 		//ARCSTAT_INCR(arcstat_raw_size, -size);
 	} else {
 		hdr->b_l1hdr.b_pabd = NULL;
@@ -3335,6 +4092,7 @@ arc_hdr_alloc(uint64_t spa, int32_t psize, int32_t lsize,
 	}
 	ASSERT(HDR_EMPTY(hdr));
 	ASSERT3P(hdr->b_l1hdr.b_freeze_cksum, ==, NULL);
+	ASSERT3P(hdr->b_acct, ==, NULL);
 	HDR_SET_PSIZE(hdr, psize);
 	HDR_SET_LSIZE(hdr, lsize);
 	hdr->b_spa = spa;
@@ -3473,6 +4231,7 @@ arc_hdr_realloc(arc_buf_hdr_t *hdr, kmem_cache_t *old, kmem_cache_t *new)
 	(void) refcount_add_many(&dev->l2ad_alloc, arc_hdr_size(nhdr), nhdr);
 
 	buf_discard_identity(hdr);
+	hdr->b_acct = NULL;
 	kmem_cache_free(old, hdr);
 
 	return (nhdr);
@@ -3548,6 +4307,7 @@ arc_hdr_realloc_crypt(arc_buf_hdr_t *hdr, boolean_t need_crypt)
  	}
 
 	buf_discard_identity(hdr);
+	hdr->b_acct = NULL;
  	kmem_cache_free(ocache, hdr);
 
 	return (nhdr);
@@ -3724,6 +4484,11 @@ arc_hdr_destroy(arc_buf_hdr_t *hdr)
 	if (!HDR_EMPTY(hdr))
 		buf_discard_identity(hdr);
 
+	if (hdr->b_acct != NULL) {
+		arc_acct_rele(hdr->b_acct);
+		hdr->b_acct = NULL;
+	}
+
 	if (HDR_HAS_L2HDR(hdr)) {
 		l2arc_dev_t *dev = hdr->b_l2hdr.b_dev;
 		boolean_t buflist_held = MUTEX_HELD(&dev->l2ad_mtx);
@@ -3938,13 +4703,14 @@ arc_evict_hdr(arc_buf_hdr_t *hdr, kmutex_t *hash_lock)
 
 static uint64_t
 arc_evict_state_impl(multilist_t *ml, int idx, arc_buf_hdr_t *marker,
-    uint64_t spa, int64_t bytes)
+    uint64_t spa, int64_t bytes, boolean_t reserve)
 {
 	multilist_sublist_t *mls;
 	uint64_t bytes_evicted = 0;
 	arc_buf_hdr_t *hdr;
 	kmutex_t *hash_lock;
 	int evict_count = 0;
+	int reserved_count = 0;
 
 	ASSERT3P(marker, !=, NULL);
 	IMPLY(bytes < 0, bytes == ARC_EVICT_ALL);
@@ -3988,6 +4754,23 @@ arc_evict_state_impl(multilist_t *ml, int idx, arc_buf_hdr_t *marker,
 			continue;
 		}
 
+		/*
+		 * Leave datasets within their reservation for last. A
+		 * long run of reserved headers evicts nothing, so give
+		 * up the sublist lock every batch of them; the marker
+		 * keeps our place while it's dropped.
+		 */
+		if (reserve && arc_hdr_reserved(hdr)) {
+			ARCSTAT_BUMP(arcstat_evict_reserved_skip);
+			if (++reserved_count >= zfs_arc_evict_batch_limit) {
+				reserved_count = 0;
+				multilist_sublist_unlock(mls);
+				kpreempt(KPREEMPT_SYNC);
+				mls = multilist_sublist_lock(ml, idx);
+			}
+			continue;
+		}
+
 		hash_lock = HDR_LOCK(hdr);
 
 		/*
@@ -4048,53 +4831,17 @@ arc_evict_state_impl(multilist_t *ml, int idx, arc_buf_hdr_t *marker,
 }
 
 /*
- * Evict buffers from the given arc state, until we've removed the
- * specified number of bytes. Move the removed buffers to the
- * appropriate evict state.
- *
- * This function makes a "best effort". It skips over any buffers
- * it can't get a hash_lock on, and so, may not catch all candidates.
- * It may also return without evicting as much space as requested.
- *
- * If bytes is specified using the special value ARC_EVICT_ALL, this
- * will evict all available (i.e. unlocked and evictable) buffers from
- * the given arc state; which is used by arc_flush().
+ * Evict from the sublists first, first + stride, ... of the given list
+ * until we've removed the specified number of bytes, or a scan over all
+ * of those sublists evicted nothing.
  */
 static uint64_t
-arc_evict_state(arc_state_t *state, uint64_t spa, int64_t bytes,
-    arc_buf_contents_t type)
+arc_evict_state_scan(multilist_t *ml, arc_buf_hdr_t **markers, int first,
+    int stride, uint64_t spa, int64_t bytes, boolean_t reserve)
 {
+	int num_sublists = multilist_get_num_sublists(ml);
+	int nscan = (num_sublists - first + stride - 1) / stride;
 	uint64_t total_evicted = 0;
-	multilist_t *ml = state->arcs_list[type];
-	int num_sublists;
-	arc_buf_hdr_t **markers;
-
-	IMPLY(bytes < 0, bytes == ARC_EVICT_ALL);
-
-	num_sublists = multilist_get_num_sublists(ml);
-
-	/*
-	 * If we've tried to evict from each sublist, made some
-	 * progress, but still have not hit the target number of bytes
-	 * to evict, we want to keep trying. The markers allow us to
-	 * pick up where we left off for each individual sublist, rather
-	 * than starting from the tail each time.
-	 */
-	markers = kmem_zalloc(sizeof (*markers) * num_sublists, KM_SLEEP);
-	for (int i = 0; i < num_sublists; i++) {
-		markers[i] = kmem_cache_alloc(hdr_full_cache, KM_SLEEP);
-
-		/*
-		 * A b_spa of 0 is used to indicate that this header is
-		 * a marker. This fact is used in arc_adjust_type() and
-		 * arc_evict_state_impl().
-		 */
-		markers[i]->b_spa = 0;
-
-		multilist_sublist_t *mls = multilist_sublist_lock(ml, i);
-		multilist_sublist_insert_tail(mls, markers[i]);
-		multilist_sublist_unlock(mls);
-	}
 
 	/*
 	 * While we haven't hit our target number of bytes to evict, or
@@ -4108,10 +4855,10 @@ arc_evict_state(arc_state_t *state, uint64_t spa, int64_t bytes,
 		 * (e.g. index 0) would cause evictions to favor certain
 		 * sublists over others.
 		 */
-		int sublist_idx = multilist_get_random_index(ml);
+		int sublist_idx = first + spa_get_random(nscan) * stride;
 		uint64_t scan_evicted = 0;
 
-		for (int i = 0; i < num_sublists; i++) {
+		for (int i = 0; i < nscan; i++) {
 			uint64_t bytes_remaining;
 			uint64_t bytes_evicted;
 
@@ -4123,14 +4870,16 @@ arc_evict_state(arc_state_t *state, uint64_t spa, int64_t bytes,
 				break;
 
 			bytes_evicted = arc_evict_state_impl(ml, sublist_idx,
-			    markers[sublist_idx], spa, bytes_remaining);
+			    markers[sublist_idx], spa, bytes_remaining,
+			    reserve);
 
 			scan_evicted += bytes_evicted;
 			total_evicted += bytes_evicted;
 
 			/* we've reached the end, wrap to the beginning */
-			if (++sublist_idx >= num_sublists)
-				sublist_idx = 0;
+			sublist_idx += stride;
+			if (sublist_idx >= num_sublists)
+				sublist_idx = first;
 		}
 
 		/*
@@ -4141,22 +4890,182 @@ arc_evict_state(arc_state_t *state, uint64_t spa, int64_t bytes,
 		if (scan_evicted == 0) {
 			/* This isn't possible, let's make that obvious */
 			ASSERT3S(bytes, !=, 0);
+			break;
+		}
+	}
 
-			/*
-			 * When bytes is ARC_EVICT_ALL, the only way to
-			 * break the loop is when scan_evicted is zero.
-			 * In that case, we actually have evicted enough,
-			 * so we don't want to increment the kstat.
-			 */
-			if (bytes != ARC_EVICT_ALL) {
-				ASSERT3S(total_evicted, <, bytes);
-				ARCSTAT_BUMP(arcstat_evict_not_enough);
-			}
+	return (total_evicted);
+}
 
-			break;
+typedef struct arc_evict_arg {
+	multilist_t	*eva_ml;
+	arc_buf_hdr_t	**eva_markers;
+	int		eva_first;
+	int		eva_stride;
+	uint64_t	eva_spa;
+	int64_t		eva_bytes;
+	boolean_t	eva_reserve;
+	uint64_t	eva_evicted;
+} arc_evict_arg_t;
+
+static void
+arc_evict_task(void *arg)
+{
+	arc_evict_arg_t *eva = arg;
+
+	eva->eva_evicted = arc_evict_state_scan(eva->eva_ml,
+	    eva->eva_markers, eva->eva_first, eva->eva_stride,
+	    eva->eva_spa, eva->eva_bytes, eva->eva_reserve);
+}
+
+/*
+ * Split an eviction of 'bytes' from the given list between the threads
+ * of arc_evict_taskq. Task i evicts its share from sublists i, i + n,
+ * ..., so the tasks don't contend for sublist locks. Since buffers are
+ * evenly distributed between the sublists, the shares are about equal;
+ * whatever the tasks fall short by is then evicted from all sublists.
+ */
+static uint64_t
+arc_evict_state_parallel(multilist_t *ml, arc_buf_hdr_t **markers,
+    uint64_t spa, int64_t bytes, boolean_t reserve)
+{
+	int ntasks = MIN(arc_evict_nthreads, multilist_get_num_sublists(ml));
+	arc_evict_arg_t *evas;
+	uint64_t total_evicted = 0;
+
+	evas = kmem_zalloc(sizeof (*evas) * ntasks, KM_SLEEP);
+	for (int i = 0; i < ntasks; i++) {
+		arc_evict_arg_t *eva = &evas[i];
+
+		eva->eva_ml = ml;
+		eva->eva_markers = markers;
+		eva->eva_first = i;
+		eva->eva_stride = ntasks;
+		eva->eva_spa = spa;
+		eva->eva_reserve = reserve;
+		eva->eva_bytes = bytes / ntasks;
+		if (i == 0)
+			eva->eva_bytes += bytes % ntasks;
+
+		if (taskq_dispatch(arc_evict_taskq, arc_evict_task, eva,
+		    TQ_SLEEP) == 0)
+			arc_evict_task(eva);
+	}
+	taskq_wait(arc_evict_taskq);
+
+	for (int i = 0; i < ntasks; i++)
+		total_evicted += evas[i].eva_evicted;
+	kmem_free(evas, sizeof (*evas) * ntasks);
+
+	ARCSTAT_BUMP(arcstat_evict_parallel);
+
+	if (total_evicted < bytes) {
+		total_evicted += arc_evict_state_scan(ml, markers, 0, 1, spa,
+		    bytes - total_evicted, reserve);
+	}
+
+	return (total_evicted);
+}
+
+/*
+ * Evict buffers from the given arc state, until we've removed the
+ * specified number of bytes. Move the removed buffers to the
+ * appropriate evict state.
+ *
+ * This function makes a "best effort". It skips over any buffers
+ * it can't get a hash_lock on, and so, may not catch all candidates.
+ * It may also return without evicting as much space as requested.
+ *
+ * If bytes is specified using the special value ARC_EVICT_ALL, this
+ * will evict all available (i.e. unlocked and evictable) buffers from
+ * the given arc state; which is used by arc_flush().
+ */
+static uint64_t
+arc_evict_state(arc_state_t *state, uint64_t spa, int64_t bytes,
+    arc_buf_contents_t type)
+{
+	uint64_t total_evicted = 0;
+	multilist_t *ml = state->arcs_list[type];
+	int num_sublists;
+	arc_buf_hdr_t **markers;
+
+	IMPLY(bytes < 0, bytes == ARC_EVICT_ALL);
+
+	num_sublists = multilist_get_num_sublists(ml);
+
+	/*
+	 * If we've tried to evict from each sublist, made some
+	 * progress, but still have not hit the target number of bytes
+	 * to evict, we want to keep trying. The markers allow us to
+	 * pick up where we left off for each individual sublist, rather
+	 * than starting from the tail each time.
+	 */
+	markers = kmem_zalloc(sizeof (*markers) * num_sublists, KM_SLEEP);
+	for (int i = 0; i < num_sublists; i++) {
+		markers[i] = kmem_cache_alloc(hdr_full_cache, KM_SLEEP);
+
+		/*
+		 * A b_spa of 0 is used to indicate that this header is
+		 * a marker. This fact is used in arc_adjust_type() and
+		 * arc_evict_state_impl().
+		 */
+		markers[i]->b_spa = 0;
+
+		multilist_sublist_t *mls = multilist_sublist_lock(ml, i);
+		multilist_sublist_insert_tail(mls, markers[i]);
+		multilist_sublist_unlock(mls);
+	}
+
+	/*
+	 * Only the reclaim thread asks for a specific number of bytes
+	 * (through arc_adjust()), so it is the only user of the evict
+	 * taskq and may wait for all of its tasks. Flushes evict
+	 * everything they can from their own context.
+	 */
+	boolean_t reserve = (bytes != ARC_EVICT_ALL &&
+	    !GHOST_STATE(state) && arc_acct_nreserved != 0);
+
+	if (bytes != ARC_EVICT_ALL && arc_evict_nthreads > 1 &&
+	    num_sublists > 1 && bytes > arc_evict_nthreads * SPA_MAXBLOCKSIZE)
+		total_evicted = arc_evict_state_parallel(ml, markers, spa, bytes,
+		    reserve);
+	else
+		total_evicted = arc_evict_state_scan(ml, markers, 0, 1, spa,
+		    bytes, reserve);
+
+	/*
+	 * If the datasets without a reservation couldn't give up enough,
+	 * evict from the reserved ones too, starting over from the tails.
+	 */
+	if (reserve && total_evicted < bytes) {
+		ARCSTAT_BUMP(arcstat_evict_reserved_overrun);
+		for (int i = 0; i < num_sublists; i++) {
+			multilist_sublist_t *mls = multilist_sublist_lock(ml, i);
+			multilist_sublist_remove(mls, markers[i]);
+			multilist_sublist_insert_tail(mls, markers[i]);
+			multilist_sublist_unlock(mls);
 		}
+		total_evicted += arc_evict_state_scan(ml, markers, 0, 1, spa,
+		    bytes - total_evicted, B_FALSE);
 	}
 
+	/*
+	 * When bytes is ARC_EVICT_ALL, the scan only stops once it
+	 * can't evict anything more; in that case, we actually have
+	 * evicted enough, so we don't want to increment the kstat.
+	 */
+	if (bytes != ARC_EVICT_ALL && total_evicted < bytes)
+		ARCSTAT_BUMP(arcstat_evict_not_enough);
+
+	if (state == arc_mru)
+		ARCSTAT_INCR(arcstat_evict_mru, total_evicted);
+	else if (state == arc_mfu)
+		ARCSTAT_INCR(arcstat_evict_mfu, total_evicted);
+	else if (state == arc_mru_ghost)
+		ARCSTAT_INCR(arcstat_evict_mru_ghost, total_evicted);
+	else if (state == arc_mfu_ghost)
+		ARCSTAT_INCR(arcstat_evict_mfu_ghost, total_evicted);
+
 	for (int i = 0; i < num_sublists; i++) {
 		multilist_sublist_t *mls = multilist_sublist_lock(ml, i);
 		multilist_sublist_remove(mls, markers[i]);
@@ -4334,12 +5243,27 @@ arc_adjust_type(arc_state_t *state)
 }
 
 /*
- * Evict buffers from the cache, such that arc_size is capped by arc_c.
+ * The margin below arc_c that the reclaim thread keeps free; see
+ * zfs_arc_evict_lead_shift.
+ */
+static uint64_t
+arc_evict_lead(void)
+{
+	if (zfs_arc_evict_lead_shift <= 0 || zfs_arc_evict_lead_shift >= 64)
+		return (0);
+
+	return (MIN(arc_c >> zfs_arc_evict_lead_shift, SPA_MAXBLOCKSIZE));
+}
+
+/*
+ * Evict buffers from the cache, such that arc_size is capped by arc_c,
+ * less the eviction lead.
  */
 static uint64_t
 arc_adjust(void)
 {
 	uint64_t total_evicted = 0;
+	uint64_t evict_target = arc_c - arc_evict_lead();
 	uint64_t bytes;
 	int64_t target;
 
@@ -4359,7 +5283,7 @@ arc_adjust(void)
 	 * the MRU is over arc_p, we'll evict enough to get back to
 	 * arc_p here, and then evict more from the MFU below.
 	 */
-	target = MIN((int64_t)(arc_size - arc_c),
+	target = MIN((int64_t)(arc_size - evict_target),
 	    (int64_t)(refcount_count(&arc_anon->arcs_size) +
 	    refcount_count(&arc_mru->arcs_size) + arc_meta_used - arc_p));
 
@@ -4405,7 +5329,7 @@ arc_adjust(void)
 	 * size back to arc_p, if we're still above the target cache
 	 * size, we evict the rest from the MFU.
 	 */
-	target = arc_size - arc_c;
+	target = arc_size - evict_target;
 
 	if (arc_adjust_type(arc_mfu) == ARC_BUFC_METADATA &&
 	    arc_meta_used > arc_meta_min) {
@@ -4804,6 +5728,7 @@ arc_reclaim_thread(void)
 	mutex_enter(&arc_reclaim_lock);
 	while (!arc_reclaim_thread_exit) {
 		arc_reclaim_in_loop = B_TRUE;
+		arc_evict_early_signalled = 0;
 		uint64_t evicted = 0;
 
 		/*
@@ -5061,6 +5986,13 @@ arc_reclaim_thread(void)
 			arc_no_grow = B_FALSE;
 		}
 
+		/*
+		 * Grow the hash table if it has become too loaded, but not
+		 * while we are short of memory.
+		 */
+		if (!arc_no_grow)
+			buf_hash_grow();
+
 #ifdef __APPLE__
 #ifdef _KERNEL
 	lock_and_sleep:
@@ -5363,6 +6295,19 @@ arc_get_data_impl(arc_buf_hdr_t *hdr, uint64_t size, void *tag)
 	arc_adapt(size, state);
 #endif
 
+	/*
+	 * Start the reclaim thread before arc_size reaches arc_c, so that
+	 * it is already evicting by the time we would have to wait for it.
+	 * Only the first allocation to cross the threshold signals; the
+	 * flag is re-armed when the reclaim thread starts its next pass.
+	 */
+	if (arc_reclaim_in_loop == B_FALSE && arc_evict_lead() != 0 &&
+	    arc_size > arc_c - arc_evict_lead() / 2 &&
+	    atomic_cas_32(&arc_evict_early_signalled, 0, 1) == 0) {
+		ARCSTAT_BUMP(arcstat_evict_early_wakeups);
+		cv_signal(&arc_reclaim_thread_cv);
+	}
+
 	/*
 	 * If arc_size is currently overflowing, and has grown past our
 	 * upper limit, we must be adding data faster than the evict
@@ -5574,8 +6519,14 @@ arc_access(arc_buf_hdr_t *hdr, kmutex_t *hash_lock)
 			/*
 			 * More than 125ms have passed since we
 			 * instantiated this buffer.  Move it to the
-			 * most frequently used state.
+			 * most frequently used state.  If it came in with
+			 * a stream, it has now proven itself worth
+			 * keeping like any other buffer.
 			 */
+			if (HDR_STREAMING(hdr)) {
+				arc_hdr_clear_flags(hdr, ARC_FLAG_STREAMING);
+				ARCSTAT_BUMP(arcstat_stream_promotions);
+			}
 			hdr->b_l1hdr.b_arc_access = now;
 			DTRACE_PROBE1(new_state__mfu, arc_buf_hdr_t *, hdr);
 			arc_change_state(arc_mfu, hdr, hash_lock);
@@ -5586,10 +6537,12 @@ arc_access(arc_buf_hdr_t *hdr, kmutex_t *hash_lock)
 		/*
 		 * This buffer has been "accessed" recently, but
 		 * was evicted from the cache.  Move it to the
-		 * MFU state.
+		 * MFU state.  A buffer that was only ever read by
+		 * a stream goes back to MRU instead, so that reading
+		 * the same large file twice doesn't flood MFU.
 		 */
 
-		if (HDR_PREFETCH(hdr)) {
+		if (HDR_PREFETCH(hdr) || HDR_STREAMING(hdr)) {
 			new_state = arc_mru;
 			if (refcount_count(&hdr->b_l1hdr.b_refcnt) > 0)
 				arc_hdr_clear_flags(hdr, ARC_FLAG_PREFETCH);
@@ -5603,6 +6556,8 @@ arc_access(arc_buf_hdr_t *hdr, kmutex_t *hash_lock)
 		arc_change_state(new_state, hdr, hash_lock);
 
 		ARCSTAT_BUMP(arcstat_mru_ghost_hits);
+		if (hdr->b_acct != NULL)
+			atomic_inc_64(&hdr->b_acct->aa_ghost_hits);
 	} else if (hdr->b_l1hdr.b_state == arc_mfu) {
 		/*
 		 * This buffer has been accessed more than once and is
@@ -5642,6 +6597,8 @@ arc_access(arc_buf_hdr_t *hdr, kmutex_t *hash_lock)
 		arc_change_state(new_state, hdr, hash_lock);
 
 		ARCSTAT_BUMP(arcstat_mfu_ghost_hits);
+		if (hdr->b_acct != NULL)
+			atomic_inc_64(&hdr->b_acct->aa_ghost_hits);
 	} else if (hdr->b_l1hdr.b_state == arc_l2c_only) {
 		/*
 		 * This buffer is on the 2nd Level ARC.
@@ -5769,7 +6726,7 @@ arc_read_done(zio_t *zio)
 	}
 
 	arc_hdr_clear_flags(hdr, ARC_FLAG_L2_EVICTED);
-	if (l2arc_noprefetch && HDR_PREFETCH(hdr))
+	if (L2ARC_SKIP_PREFETCH(hdr))
 		arc_hdr_clear_flags(hdr, ARC_FLAG_L2CACHE);
 
 	callback_list = hdr->b_l1hdr.b_acb;
@@ -5977,6 +6934,7 @@ top:
 			if (hdr->b_flags & ARC_FLAG_PREDICTIVE_PREFETCH) {
 				arc_hdr_clear_flags(hdr,
 				    ARC_FLAG_PREDICTIVE_PREFETCH);
+				*arc_flags |= ARC_FLAG_PREFETCH_INFLIGHT;
 			}
 
 			if (*arc_flags & ARC_FLAG_WAIT) {
@@ -6041,6 +6999,8 @@ top:
 			arc_hdr_set_flags(hdr, ARC_FLAG_PREFETCH);
 		}
 		DTRACE_PROBE1(arc__hit, arc_buf_hdr_t *, hdr);
+		if (hdr->b_acct != NULL)
+			atomic_inc_64(&hdr->b_acct->aa_hits);
 		arc_access(hdr, hash_lock);
 		if (*arc_flags & ARC_FLAG_L2CACHE)
 			arc_hdr_set_flags(hdr, ARC_FLAG_L2CACHE);
@@ -6057,6 +7017,7 @@ top:
 		uint64_t psize = BP_GET_PSIZE(bp);
 		arc_callback_t *acb;
 		vdev_t *vd = NULL;
+		l2arc_dev_t *l2dev = NULL;
 		uint64_t addr = 0;
 		boolean_t devw = B_FALSE;
 		uint64_t size;
@@ -6069,6 +7030,8 @@ top:
 			hdr = arc_hdr_alloc(spa_load_guid(spa), psize, lsize,
 			    BP_IS_PROTECTED(bp), BP_GET_COMPRESS(bp), type,
 			    encrypted_read);
+			if (zb != NULL)
+				hdr->b_acct = arc_acct_hold(spa, zb->zb_objset);
 
 			if (!BP_IS_EMBEDDED(bp)) {
 				hdr->b_dva = *BP_IDENTITY(bp);
@@ -6165,6 +7128,12 @@ top:
 			arc_hdr_set_flags(hdr, ARC_FLAG_INDIRECT);
 		if (*arc_flags & ARC_FLAG_PREDICTIVE_PREFETCH)
 			arc_hdr_set_flags(hdr, ARC_FLAG_PREDICTIVE_PREFETCH);
+		if (*arc_flags & ARC_FLAG_STREAMING &&
+		    refcount_is_zero(&hdr->b_l1hdr.b_refcnt)) {
+			arc_hdr_set_flags(hdr, ARC_FLAG_STREAMING);
+			ARCSTAT_BUMP(arcstat_stream_admits);
+			ARCSTAT_INCR(arcstat_stream_admit_bytes, lsize);
+		}
 		ASSERT(!GHOST_STATE(hdr->b_l1hdr.b_state));
 
 		acb = kmem_zalloc(sizeof (arc_callback_t), KM_SLEEP);
@@ -6181,7 +7150,8 @@ top:
 
 		if (HDR_HAS_L2HDR(hdr) &&
 		    (vd = hdr->b_l2hdr.b_dev->l2ad_vdev) != NULL) {
-			devw = hdr->b_l2hdr.b_dev->l2ad_writing;
+			l2dev = hdr->b_l2hdr.b_dev;
+			devw = l2dev->l2ad_writing;
 			addr = hdr->b_l2hdr.b_daddr;
 			/*
 			 * Lock out device removal.
@@ -6208,6 +7178,8 @@ top:
 		DTRACE_PROBE4(arc__miss, arc_buf_hdr_t *, hdr, blkptr_t *, bp,
 		    uint64_t, lsize, zbookmark_phys_t *, zb);
 		ARCSTAT_BUMP(arcstat_misses);
+		if (hdr->b_acct != NULL)
+			atomic_inc_64(&hdr->b_acct->aa_misses);
 		ARCSTAT_CONDSTAT(!HDR_PREFETCH(hdr),
 		    demand, prefetch, !HDR_ISTYPE_METADATA(hdr),
 		    data, metadata, misses);
@@ -6224,13 +7196,16 @@ top:
 			 */
 			if (HDR_HAS_L2HDR(hdr) &&
 			    !HDR_L2_WRITING(hdr) && !HDR_L2_EVICTED(hdr) &&
-			    !(l2arc_noprefetch && HDR_PREFETCH(hdr))) {
+			    !L2ARC_SKIP_PREFETCH(hdr)) {
 				l2arc_read_callback_t *cb;
 				abd_t *abd;
 				uint64_t asize;
 
 				DTRACE_PROBE1(l2arc__hit, arc_buf_hdr_t *, hdr);
 				ARCSTAT_BUMP(arcstat_l2_hits);
+				atomic_inc_64(&l2dev->l2ad_hits);
+				atomic_add_64(&l2dev->l2ad_hit_bytes,
+				    HDR_GET_PSIZE(hdr));
 
 				cb = kmem_zalloc(sizeof (l2arc_read_callback_t),
 				    KM_SLEEP);
@@ -6287,6 +7262,7 @@ top:
 				DTRACE_PROBE1(l2arc__miss,
 				    arc_buf_hdr_t *, hdr);
 				ARCSTAT_BUMP(arcstat_l2_misses);
+				atomic_inc_64(&l2dev->l2ad_misses);
 				if (HDR_L2_WRITING(hdr))
 					ARCSTAT_BUMP(arcstat_l2_rw_clash);
 				spa_config_exit(spa, SCL_L2ARC, vd);
@@ -6549,6 +7525,7 @@ arc_release(arc_buf_t *buf, void *tag)
 		ASSERT0(refcount_count(&nhdr->b_l1hdr.b_refcnt));
 		VERIFY3U(nhdr->b_type, ==, type);
 		ASSERT(!HDR_SHARED_DATA(nhdr));
+		nhdr->b_acct = arc_acct_dup(hdr->b_acct);
 
 		nhdr->b_l1hdr.b_buf = buf;
 		nhdr->b_l1hdr.b_bufcnt = 1;
@@ -6871,6 +7848,8 @@ arc_write(zio_t *pio, spa_t *spa, uint64_t txg,
 	ASSERT3U(hdr->b_l1hdr.b_bufcnt, >, 0);
 	if (l2arc)
 		arc_hdr_set_flags(hdr, ARC_FLAG_L2CACHE);
+	if (hdr->b_acct == NULL && zb != NULL)
+		hdr->b_acct = arc_acct_hold(spa, zb->zb_objset);
 
 	if (ARC_BUF_ENCRYPTED(buf)) {
 		ASSERT(ARC_BUF_COMPRESSED(buf));
@@ -7153,6 +8132,10 @@ arc_kstat_update(kstat_t *ksp, int rw)
 		    &as->arcstat_mfu_ghost_size,
 		    &as->arcstat_mfu_ghost_evictable_data,
 		    &as->arcstat_mfu_ghost_evictable_metadata);
+		as->arcstat_l2_compress_saved.value.ui64 =
+		    as->arcstat_l2_lsize.value.ui64 -
+		    MIN(as->arcstat_l2_psize.value.ui64,
+		    as->arcstat_l2_lsize.value.ui64);
 	}
 
 	return (0);
@@ -7237,6 +8220,9 @@ int arc_kstat_update_osx(kstat_t *ksp, int rw)
 		zfs_arc_shrink_shift      = ks->arc_zfs_arc_shrink_shift.value.ui64;
 		zfs_arc_p_min_shift       = ks->arc_zfs_arc_p_min_shift.value.ui64;
 		zfs_arc_average_blocksize = ks->arc_zfs_arc_average_blocksize.value.ui64;
+		zfs_arc_hash_max_load     = ks->arc_zfs_arc_hash_max_load.value.ui64;
+		zfs_arc_evict_threads     = ks->arc_zfs_arc_evict_threads.value.ui64;
+		zfs_arc_evict_lead_shift  = ks->arc_zfs_arc_evict_lead_shift.value.ui64;
 
 	} else {
 
@@ -7253,6 +8239,9 @@ int arc_kstat_update_osx(kstat_t *ksp, int rw)
 		ks->arc_zfs_arc_shrink_shift.value.ui64      = zfs_arc_shrink_shift;
 		ks->arc_zfs_arc_p_min_shift.value.ui64       = zfs_arc_p_min_shift;
 		ks->arc_zfs_arc_average_blocksize.value.ui64 = zfs_arc_average_blocksize;
+		ks->arc_zfs_arc_hash_max_load.value.ui64     = zfs_arc_hash_max_load;
+		ks->arc_zfs_arc_evict_threads.value.ui64     = zfs_arc_evict_threads;
+		ks->arc_zfs_arc_evict_lead_shift.value.ui64  = zfs_arc_evict_lead_shift;
 	}
 	return 0;
 }
@@ -7522,9 +8511,16 @@ arc_init(void)
 
 	arc_state_init();
 	buf_init();
+	arc_acct_init();
 
 	arc_reclaim_thread_exit = B_FALSE;
 
+	arc_evict_nthreads = zfs_arc_evict_threads;
+	if (arc_evict_nthreads <= 0)
+		arc_evict_nthreads = MAX(1, MIN(max_ncpus / 4, 16));
+	arc_evict_taskq = taskq_create("arc_evict", arc_evict_nthreads,
+	    minclsyspri, arc_evict_nthreads, INT_MAX, TASKQ_PREPOPULATE);
+
 	arc_ksp = kstat_create("zfs", 0, "arcstats", "misc", KSTAT_TYPE_NAMED,
 	    sizeof (arc_stats) / sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
 
@@ -7582,6 +8578,8 @@ arc_fini(void)
 	/* Use B_TRUE to ensure *all* buffers are evicted */
 	arc_flush(NULL, B_TRUE);
 
+	taskq_destroy(arc_evict_taskq);
+
 	arc_dead = B_TRUE;
 
 	if (arc_ksp != NULL) {
@@ -7595,6 +8593,7 @@ arc_fini(void)
 
 	arc_state_fini();
 	buf_fini();
+	arc_acct_fini();
 
 	ASSERT0(arc_loaned_bytes);
 }
@@ -7730,6 +8729,13 @@ arc_fini(void)
  *				since more compressed buffers are likely to
  *				be present
  *	l2arc_feed_secs		seconds between L2ARC writing
+ *	l2arc_feed_policy	feed from MRU and MFU, MFU only, or MRU and
+ *				MFU including prefetched buffers
+ *	l2arc_feed_threads	max number of devices fed at once
+ *	l2arc_write_max_scale	how far a device's write size may grow
+ *				beyond l2arc_write_max
+ *	l2arc_rabd_max		max raw data kept by decrypted buffers
+ *				until they are written
  *
  * Tunables may be removed or added as future performance improvements are
  * integrated, and also may become zpool properties.
@@ -7808,64 +8814,76 @@ l2arc_write_interval(clock_t began, uint64_t wanted, uint64_t wrote)
 }
 
 /*
- * Cycle through L2ARC devices.  This is how L2ARC load balances.
- * If a device is returned, this also returns holding the spa config lock.
+ * Pick the L2ARC devices that are due to be fed, up to 'max' of them.
+ * Devices that are faulted or still being rebuilt are passed over.  Each
+ * device is returned holding its spa's config lock, which the feed of
+ * that device drops.
  */
-static l2arc_dev_t *
-l2arc_dev_get_next(void)
+static int
+l2arc_dev_get_ready(l2arc_dev_t **devs, int max, clock_t now)
 {
-	l2arc_dev_t *first, *next = NULL;
+	l2arc_dev_t *dev;
+	int n = 0, ready = 0;
 
 	/*
 	 * Lock out the removal of spas (spa_namespace_lock), then removal
-	 * of cache devices (l2arc_dev_mtx).  Once a device has been selected,
-	 * both locks will be dropped and a spa config lock held instead.
+	 * of cache devices (l2arc_dev_mtx).  Once the devices have been
+	 * selected, both locks will be dropped and spa config locks held
+	 * instead.
 	 */
 	mutex_enter(&spa_namespace_lock);
 	mutex_enter(&l2arc_dev_mtx);
+	for (dev = list_head(l2arc_dev_list); dev != NULL && n < max;
+	    dev = list_next(l2arc_dev_list, dev)) {
+		if (vdev_is_dead(dev->l2ad_vdev) || dev->l2ad_rebuild ||
+		    dev->l2ad_feed_next > now)
+			continue;
+		devs[n++] = dev;
+	}
+	mutex_exit(&l2arc_dev_mtx);
 
-	/* if there are no vdevs, there is nothing to do */
-	if (l2arc_ndev == 0)
-		goto out;
-
-	first = NULL;
-	next = l2arc_dev_last;
-	do {
-		/* loop around the list looking for a non-faulted vdev */
-		if (next == NULL) {
-			next = list_head(l2arc_dev_list);
+	/*
+	 * Grab the config locks to prevent the devices from being
+	 * removed while we are writing to them.  Since we may already
+	 * hold the lock for another device of the same spa, waiting for
+	 * it could deadlock against a writer; a device whose lock is
+	 * busy is put off until the next feed interval instead.
+	 */
+	for (int i = 0; i < n; i++) {
+		dev = devs[i];
+		if (spa_config_tryenter(dev->l2ad_spa, SCL_L2ARC, dev,
+		    RW_READER)) {
+			devs[ready++] = dev;
 		} else {
-			next = list_next(l2arc_dev_list, next);
-			if (next == NULL)
-				next = list_head(l2arc_dev_list);
+			dev->l2ad_feed_next = now +
+			    (hz * l2arc_feed_min_ms) / 1000;
 		}
+	}
+	mutex_exit(&spa_namespace_lock);
 
-		/* if we have come back to the start, bail out */
-		if (first == NULL)
-			first = next;
-		else if (next == first)
-			break;
-
-	} while (vdev_is_dead(next->l2ad_vdev));
-
-	/* if we were unable to find any usable vdevs, return NULL */
-	if (vdev_is_dead(next->l2ad_vdev))
-		next = NULL;
+	return (ready);
+}
 
-	l2arc_dev_last = next;
+/*
+ * The earliest time a usable L2ARC device is due to be fed, but no more
+ * than a second from now, so that new devices are noticed.
+ */
+static clock_t
+l2arc_feed_next(void)
+{
+	l2arc_dev_t *dev;
+	clock_t now = ddi_get_lbolt();
+	clock_t next = now + hz;
 
-out:
+	mutex_enter(&l2arc_dev_mtx);
+	for (dev = list_head(l2arc_dev_list); dev != NULL;
+	    dev = list_next(l2arc_dev_list, dev)) {
+		if (!vdev_is_dead(dev->l2ad_vdev) && !dev->l2ad_rebuild)
+			next = MIN(next, dev->l2ad_feed_next);
+	}
 	mutex_exit(&l2arc_dev_mtx);
 
-	/*
-	 * Grab the config lock to prevent the 'next' device from being
-	 * removed while we are writing to it.
-	 */
-	if (next != NULL)
-		spa_config_enter(next->l2ad_spa, SCL_L2ARC, next, RW_READER);
-	mutex_exit(&spa_namespace_lock);
-
-	return (next);
+	return (MAX(next, now));
 }
 
 /*
@@ -7991,6 +9009,17 @@ top:
 		 */
 		arc_hdr_clear_flags(hdr, ARC_FLAG_L2_WRITING);
 
+		/*
+		 * Drop raw data that was only kept for this write, see
+		 * L2ARC_WANTS_RABD().  HDR_L2_RABD() is only ever set on
+		 * protected hdrs, so check it before touching b_crypt_hdr.
+		 */
+		if (zio->io_error == 0 && HDR_L2_RABD(hdr) &&
+		    HDR_HAS_RABD(hdr) && hdr->b_crypt_hdr.b_ebufcnt == 0 &&
+		    hdr->b_l1hdr.b_pabd != NULL && !HDR_IO_IN_PROGRESS(hdr)) {
+			arc_hdr_free_abd(hdr, B_TRUE);
+		}
+
 		mutex_exit(hash_lock);
 	}
 
@@ -8019,6 +9048,7 @@ l2arc_untransform(zio_t *zio, l2arc_read_callback_t *cb)
 	uint8_t iv[ZIO_DATA_IV_LEN];
 	uint8_t mac[ZIO_DATA_MAC_LEN];
 	boolean_t no_crypt = B_FALSE;
+	hrtime_t start = gethrtime();
 
 	/*
 	 * ZIL data is never be written to the L2ARC, so we don't need
@@ -8102,6 +9132,13 @@ l2arc_untransform(zio_t *zio, l2arc_read_callback_t *cb)
 		zio->io_size = HDR_GET_LSIZE(hdr);
 	}
 
+	if (BP_IS_ENCRYPTED(bp) || (HDR_GET_COMPRESS(hdr) !=
+	    ZIO_COMPRESS_OFF && !HDR_COMPRESSION_ENABLED(hdr))) {
+		ARCSTAT_BUMP(arcstat_l2_read_transformed);
+		ARCSTAT_INCR(arcstat_l2_read_transform_ns,
+		    gethrtime() - start);
+	}
+
 	return (0);
 
 error:
@@ -8500,6 +9537,124 @@ error:
 	return (ret);
 }
 
+/*
+ * Only buffers that are stored on the device exactly as a later L2ARC read
+ * of an L2-only header expects them are recorded in the log blocks.
+ * Encrypted and authenticated buffers need their encryption parameters,
+ * which L2-only headers do not carry, so they are not persisted.
+ */
+static boolean_t
+l2arc_log_blk_eligible(arc_buf_hdr_t *hdr)
+{
+	return (!HDR_PROTECTED(hdr) && (HDR_COMPRESSION_ENABLED(hdr) ||
+	    HDR_GET_COMPRESS(hdr) == ZIO_COMPRESS_OFF));
+}
+
+/*
+ * Add an entry for a buffer that is being written to the device to the log
+ * block being filled.  Returns B_TRUE once the log block is full.
+ */
+static boolean_t
+l2arc_log_blk_insert(l2arc_dev_t *dev, arc_buf_hdr_t *hdr, uint64_t asize)
+{
+	l2arc_log_blk_phys_t *lb = dev->l2ad_log_blk;
+	l2arc_log_ent_phys_t *le;
+
+	ASSERT3U(lb->lb_nentries, <, L2ARC_LOG_BLK_ENTRIES);
+
+	le = &lb->lb_entries[lb->lb_nentries++];
+	le->le_dva = hdr->b_dva;
+	le->le_birth = hdr->b_birth;
+	le->le_daddr = hdr->b_l2hdr.b_daddr;
+	le->le_prop = 0;
+	L2BLK_SET_LSIZE(le->le_prop, HDR_GET_LSIZE(hdr));
+	L2BLK_SET_PSIZE(le->le_prop, HDR_GET_PSIZE(hdr));
+	L2BLK_SET_COMPRESS(le->le_prop, HDR_GET_COMPRESS(hdr));
+	L2BLK_SET_TYPE(le->le_prop, arc_buf_type(hdr));
+	dev->l2ad_log_blk_payload_asize += asize;
+
+	return (lb->lb_nentries == L2ARC_LOG_BLK_ENTRIES);
+}
+
+/*
+ * Write the full log block at the device hand, as part of the same write
+ * as the buffers it describes, and make it the newest one in the device
+ * header.  Returns the space the log block takes on the device.
+ */
+static uint64_t
+l2arc_log_blk_commit(l2arc_dev_t *dev, zio_t *pio)
+{
+	l2arc_log_blk_phys_t *lb = dev->l2ad_log_blk;
+	l2arc_dev_hdr_phys_t *dh = dev->l2ad_dev_hdr;
+	l2arc_log_blkptr_t *lbp = &dh->dh_last_lbp;
+	uint64_t asize = vdev_psize_to_asize(dev->l2ad_vdev, sizeof (*lb));
+	abd_t *abd;
+
+	lb->lb_magic = L2ARC_LOG_BLK_MAGIC;
+	lb->lb_prev_lbp = *lbp;
+
+	lbp->lbp_daddr = dev->l2ad_hand;
+	lbp->lbp_asize = asize;
+	lbp->lbp_payload_asize = dev->l2ad_log_blk_payload_asize;
+	fletcher_4_native(lb, sizeof (*lb), NULL, &lbp->lbp_cksum);
+	dh->dh_lb_count++;
+
+	abd = abd_alloc_for_io(asize, B_TRUE);
+	abd_copy_from_buf(abd, lb, sizeof (*lb));
+	if (asize > sizeof (*lb))
+		abd_zero_off(abd, sizeof (*lb), asize - sizeof (*lb));
+	l2arc_free_abd_on_write(abd, asize, ARC_BUFC_METADATA);
+
+	(void) zio_nowait(zio_write_phys(pio, dev->l2ad_vdev,
+	    dev->l2ad_hand, asize, abd, ZIO_CHECKSUM_OFF, NULL, NULL,
+	    ZIO_PRIORITY_ASYNC_WRITE, ZIO_FLAG_CANFAIL, B_FALSE));
+
+	dev->l2ad_hand += asize;
+	bzero(lb, sizeof (*lb));
+	dev->l2ad_log_blk_payload_asize = 0;
+	ARCSTAT_BUMP(arcstat_l2_log_blk_writes);
+
+	return (asize);
+}
+
+/*
+ * Write out the device header.  This is done once the log blocks it points
+ * to are on stable storage, so a crash never leaves it pointing at a log
+ * block that was not completely written.
+ */
+static void
+l2arc_dev_hdr_update(l2arc_dev_t *dev)
+{
+	l2arc_dev_hdr_phys_t *dh = dev->l2ad_dev_hdr;
+	vdev_t *vd = dev->l2ad_vdev;
+	abd_t *abd;
+	int err;
+
+	dh->dh_magic = L2ARC_DEV_HDR_MAGIC;
+	dh->dh_version = L2ARC_PERSISTENT_VERSION;
+	dh->dh_spa_guid = spa_guid(dev->l2ad_spa);
+	dh->dh_vdev_guid = vd->vdev_guid;
+	dh->dh_start = dev->l2ad_start;
+	dh->dh_end = dev->l2ad_end;
+	ZIO_SET_CHECKSUM(&dh->dh_cksum, 0, 0, 0, 0);
+	fletcher_4_native(dh, sizeof (*dh), NULL, &dh->dh_cksum);
+
+	abd = abd_alloc_for_io(dev->l2ad_dev_hdr_asize, B_TRUE);
+	abd_copy_from_buf(abd, dh, sizeof (*dh));
+	abd_zero_off(abd, sizeof (*dh), dev->l2ad_dev_hdr_asize - sizeof (*dh));
+
+	err = zio_wait(zio_write_phys(NULL, vd, VDEV_LABEL_START_SIZE,
+	    dev->l2ad_dev_hdr_asize, abd, ZIO_CHECKSUM_OFF, NULL, NULL,
+	    ZIO_PRIORITY_ASYNC_WRITE, ZIO_FLAG_CANFAIL, B_FALSE));
+	abd_free(abd);
+
+	if (err != 0) {
+		zfs_dbgmsg("L2ARC device header update failed, "
+		    "vdev guid %llu, error %d",
+		    (u_longlong_t)vd->vdev_guid, err);
+	}
+}
+
 /*
  * Find and write ARC buffers to the L2ARC device.
  *
@@ -8516,16 +9671,26 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 {
 	arc_buf_hdr_t *hdr, *hdr_prev, *head;
 	uint64_t write_asize, write_psize, write_lsize, headroom;
-	boolean_t full;
+	uint64_t lb_asize;
+	boolean_t full, lb_committed;
 	l2arc_write_callback_t *cb;
 	zio_t *pio, *wzio;
 	uint64_t guid = spa_load_guid(spa);
+	hrtime_t start;
 
 	ASSERT3P(dev->l2ad_vdev, !=, NULL);
 
+	dev->l2ad_write_lat = 0;
 	pio = NULL;
 	write_lsize = write_asize = write_psize = 0;
-	full = B_FALSE;
+	full = lb_committed = B_FALSE;
+
+	/*
+	 * Keep room for a log block in every write, so that one filling up
+	 * never pushes the write past the space l2arc_evict() cleared.
+	 */
+	lb_asize = vdev_psize_to_asize(dev->l2ad_vdev,
+	    sizeof (l2arc_log_blk_phys_t));
 	head = kmem_cache_alloc(hdr_l2only_cache, KM_PUSHPAGE);
 	arc_hdr_set_flags(head, ARC_FLAG_L2_WRITE_HEAD | ARC_FLAG_HAS_L2HDR);
 
@@ -8533,9 +9698,14 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 	 * Copy buffers for L2ARC writing.
 	 */
 	for (int try = 0; try < L2ARC_FEED_TYPES; try++) {
-		multilist_sublist_t *mls = l2arc_sublist_lock(try);
+		multilist_sublist_t *mls;
 		uint64_t passed_sz = 0;
 
+		/* the odd lists are the MRU ones, see l2arc_sublist_lock() */
+		if (l2arc_feed_policy == L2ARC_FEED_MFU && (try & 1))
+			continue;
+		mls = l2arc_sublist_lock(try);
+
 		/*
 		 * L2ARC fast warmup.
 		 *
@@ -8578,6 +9748,14 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 			}
 
 			if (!l2arc_write_eligible(guid, hdr)) {
+				/*
+				 * Raw data kept for a write that won't
+				 * happen, see L2ARC_WANTS_RABD().
+				 */
+				if (HDR_L2_RABD(hdr) && HDR_HAS_L1HDR(hdr) &&
+				    !HDR_IO_IN_PROGRESS(hdr) &&
+				    !HDR_L2_WRITING(hdr))
+					arc_hdr_free_abd(hdr, B_TRUE);
 				mutex_exit(hash_lock);
 				continue;
 			}
@@ -8598,7 +9776,7 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 			uint64_t asize = vdev_psize_to_asize(dev->l2ad_vdev,
 			    psize);
 
-			if ((write_asize + asize) > target_sz) {
+			if ((write_asize + asize + lb_asize) > target_sz) {
 				full = B_TRUE;
 				mutex_exit(hash_lock);
 				break;
@@ -8634,17 +9812,23 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 			 */
 			if (HDR_HAS_RABD(hdr) && psize == asize) {
 				to_write = hdr->b_crypt_hdr.b_rabd;
+				ARCSTAT_BUMP(arcstat_l2_write_direct);
 			} else if ((HDR_COMPRESSION_ENABLED(hdr) ||
 			    HDR_GET_COMPRESS(hdr) == ZIO_COMPRESS_OFF) &&
 			    !HDR_ENCRYPTED(hdr) && !HDR_SHARED_DATA(hdr) &&
 			    psize == asize) {
 				to_write = hdr->b_l1hdr.b_pabd;
+				ARCSTAT_BUMP(arcstat_l2_write_direct);
 			} else {
 				int ret;
 				arc_buf_contents_t type = arc_buf_type(hdr);
+				hrtime_t tfm_start = gethrtime();
 
 				ret = l2arc_apply_transforms(spa, hdr, asize,
 				    &to_write);
+				ARCSTAT_BUMP(arcstat_l2_write_transformed);
+				ARCSTAT_INCR(arcstat_l2_write_transform_ns,
+				    gethrtime() - tfm_start);
 				if (ret != 0) {
 					arc_hdr_clear_flags(hdr,
 					    ARC_FLAG_L2_WRITING);
@@ -8684,37 +9868,6 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
             (void) refcount_add_many(&dev->l2ad_alloc,
                 arc_hdr_size(hdr), hdr);
 
-			/*
-			 * Normally the L2ARC can use the hdr's data, but if
-			 * we're sharing data between the hdr and one of its
-			 * bufs, L2ARC needs its own copy of the data so that
-			 * the ZIO below can't race with the buf consumer.
-			 * Another case where we need to create a copy of the
-			 * data is when the buffer size is not device-aligned
-			 * and we need to pad the block to make it such.
-			 * That also keeps the clock hand suitably aligned.
-			 *
-			 * To ensure that the copy will be available for the
-			 * lifetime of the ZIO and be cleaned up afterwards, we
-			 * add it to the l2arc_free_on_write queue.
-			 */
-			asize = vdev_psize_to_asize(dev->l2ad_vdev,
-			    psize);
-			if (!HDR_SHARED_DATA(hdr) && psize == asize) {
-				to_write = hdr->b_l1hdr.b_pabd;
-			} else {
-				to_write = abd_alloc_for_io(asize,
-				    HDR_ISTYPE_METADATA(hdr));
-				ASSERT3S(psize, <=, hdr->b_l1hdr.b_pabd->abd_size);
-				abd_copy_off(to_write, hdr->b_l1hdr.b_pabd, 0, 0, psize);
-				if (asize != psize) {
-					abd_zero_off(to_write, psize,
-					    asize - psize);
-				}
-				l2arc_free_abd_on_write(to_write, asize,
-				    arc_buf_type(hdr));
-			}
-
 			wzio = zio_write_phys(pio, dev->l2ad_vdev,
 				hdr->b_l2hdr.b_daddr, asize, to_write,
 			    ZIO_CHECKSUM_OFF, NULL, hdr,
@@ -8729,6 +9882,12 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 			write_psize += psize;
 			dev->l2ad_hand += asize;
 
+			if (l2arc_log_blk_eligible(hdr) &&
+			    l2arc_log_blk_insert(dev, hdr, asize)) {
+				write_asize += l2arc_log_blk_commit(dev, pio);
+				lb_committed = B_TRUE;
+			}
+
 			mutex_exit(hash_lock);
 
 			(void) zio_nowait(wzio);
@@ -8765,15 +9924,104 @@ l2arc_write_buffers(spa_t *spa, l2arc_dev_t *dev, uint64_t target_sz)
 	}
 
 	dev->l2ad_writing = B_TRUE;
+	start = gethrtime();
 	(void) zio_wait(pio);
+	dev->l2ad_write_lat = gethrtime() - start;
 	dev->l2ad_writing = B_FALSE;
 
+	if (lb_committed)
+		l2arc_dev_hdr_update(dev);
+
 	return (write_asize);
 }
 
+/*
+ * How much to write to a device in one feed: l2arc_write_size(), scaled
+ * up by l2arc_feed_adapt() for devices that can take more.
+ */
+static uint64_t
+l2arc_dev_write_size(l2arc_dev_t *dev)
+{
+	uint64_t base = l2arc_write_size();
+	uint64_t max = base * MAX(l2arc_write_max_scale, 1);
+
+	return (MIN(MAX(dev->l2ad_write_target, base), max));
+}
+
+/*
+ * Adapt a device's write size to how long it took to write the last
+ * feed.  While the ARC lists keep the writes full, a device that finishes
+ * them in less than half of l2arc_feed_min_ms gets twice as much the next
+ * time, and a device that takes longer than l2arc_feed_min_ms gets half
+ * as much.  l2arc_dev_write_size() keeps the result within bounds.
+ */
+static void
+l2arc_feed_adapt(l2arc_dev_t *dev, uint64_t wanted, uint64_t wrote)
+{
+	hrtime_t slow = (hrtime_t)l2arc_feed_min_ms * (NANOSEC / MILLISEC);
+
+	if (wrote > wanted / 2 && dev->l2ad_write_lat < slow / 2)
+		dev->l2ad_write_target = wanted * 2;
+	else if (dev->l2ad_write_lat > slow)
+		dev->l2ad_write_target = wanted / 2;
+	else
+		dev->l2ad_write_target = wanted;
+}
+
+/*
+ * Feed one L2ARC device.  Called with the device's spa config lock held,
+ * which is dropped here.
+ */
+static void
+l2arc_feed_dev(void *arg)
+{
+	l2arc_dev_t *dev = arg;
+	spa_t *spa = dev->l2ad_spa;
+	clock_t begin = ddi_get_lbolt();
+	uint64_t size, wrote;
+
+	ASSERT3P(spa, !=, NULL);
+
+	/*
+	 * If the pool is read-only then leave the device alone for a
+	 * little longer.
+	 */
+	if (!spa_writeable(spa)) {
+		dev->l2ad_feed_next = begin + 5 * l2arc_feed_secs * hz;
+		spa_config_exit(spa, SCL_L2ARC, dev);
+		return;
+	}
+
+	ARCSTAT_BUMP(arcstat_l2_feeds);
+	dev->l2ad_feeds++;
+
+	size = l2arc_dev_write_size(dev);
+
+	/*
+	 * Evict L2ARC buffers that will be overwritten.
+	 */
+	l2arc_evict(dev, size, B_FALSE);
+
+	/*
+	 * Write ARC buffers.
+	 */
+	wrote = l2arc_write_buffers(spa, dev, size);
+	dev->l2ad_write_bytes += wrote;
+	dev->l2ad_write_time += dev->l2ad_write_lat;
+	l2arc_feed_adapt(dev, size, wrote);
+
+	/*
+	 * Calculate interval between writes.
+	 */
+	dev->l2ad_feed_next = l2arc_write_interval(begin, size, wrote);
+	spa_config_exit(spa, SCL_L2ARC, dev);
+}
+
 /*
  * This thread feeds the L2ARC at regular intervals.  This is the beating
- * heart of the L2ARC.
+ * heart of the L2ARC.  Every device that is due is fed at once, each by
+ * its own task on l2arc_feed_taskq, and is then due again after its own
+ * interval, so that fast devices aren't held back by slow ones.
  */
 static void
 #ifdef __APPLE__
@@ -8783,13 +10031,15 @@ l2arc_feed_thread(void)
 #endif
 {
 	callb_cpr_t cpr;
-	l2arc_dev_t *dev;
-	spa_t *spa;
-	uint64_t size, wrote;
-	clock_t begin, next = ddi_get_lbolt();
+	l2arc_dev_t **devs;
+	clock_t next = ddi_get_lbolt();
+	int n;
 
 	CALLB_CPR_INIT(&cpr, &l2arc_feed_thr_lock, callb_generic_cpr, FTAG);
 
+	devs = kmem_alloc(sizeof (l2arc_dev_t *) * l2arc_feed_nthreads,
+	    KM_SLEEP);
+
 	mutex_enter(&l2arc_feed_thr_lock);
 
 	while (l2arc_thread_exit == 0) {
@@ -8808,67 +10058,311 @@ l2arc_feed_thread(void)
 			continue;
 		}
 		mutex_exit(&l2arc_dev_mtx);
-		begin = ddi_get_lbolt();
 
 		/*
-		 * This selects the next l2arc device to write to, and in
-		 * doing so the next spa to feed from: dev->l2ad_spa.   This
-		 * will return NULL if there are now no l2arc devices or if
-		 * they are all faulted.
-		 *
-		 * If a device is returned, its spa's config lock is also
-		 * held to prevent device removal.  l2arc_dev_get_next()
-		 * will grab and release l2arc_dev_mtx.
+		 * Avoid contributing to memory pressure.
 		 */
-		if ((dev = l2arc_dev_get_next()) == NULL)
+		if (arc_reclaim_needed()) {
+			ARCSTAT_BUMP(arcstat_l2_abort_lowmem);
 			continue;
-
-		spa = dev->l2ad_spa;
-		ASSERT3P(spa, !=, NULL);
+		}
 
 		/*
-		 * If the pool is read-only then force the feed thread to
-		 * sleep a little longer.
+		 * This selects the devices to write to, and in doing so
+		 * the spas to feed from: dev->l2ad_spa.  Each device's spa
+		 * config lock is held to prevent its removal until its feed
+		 * is done.  l2arc_dev_get_ready() will grab and release
+		 * l2arc_dev_mtx.
 		 */
-		if (!spa_writeable(spa)) {
-			next = ddi_get_lbolt() + 5 * l2arc_feed_secs * hz;
-			spa_config_exit(spa, SCL_L2ARC, dev);
-			continue;
+		n = l2arc_dev_get_ready(devs, l2arc_feed_nthreads,
+		    ddi_get_lbolt());
+		for (int i = 0; i < n; i++) {
+			if (taskq_dispatch(l2arc_feed_taskq, l2arc_feed_dev,
+			    devs[i], TQ_SLEEP) == 0)
+				l2arc_feed_dev(devs[i]);
 		}
+		taskq_wait(l2arc_feed_taskq);
+
+		next = l2arc_feed_next();
+	}
+
+	kmem_free(devs, sizeof (l2arc_dev_t *) * l2arc_feed_nthreads);
+
+	l2arc_thread_exit = 0;
+	cv_broadcast(&l2arc_feed_thr_cv);
+	CALLB_CPR_EXIT(&cpr);		/* drops l2arc_feed_thr_lock */
+	thread_exit();
+}
+
+/*
+ * Read from an L2ARC device during a rebuild.  The rebuild thread is started
+ * while the config lock is held for writing, so it polls for the lock rather
+ * than blocking, and gives up if the device is being removed.
+ */
+static int
+l2arc_rebuild_read(l2arc_dev_t *dev, uint64_t offset, uint64_t size,
+    abd_t *abd)
+{
+	spa_t *spa = dev->l2ad_spa;
+	int err;
+
+	while (spa_config_tryenter(spa, SCL_L2ARC, dev, RW_READER) == 0) {
+		if (dev->l2ad_rebuild_cancel)
+			return (SET_ERROR(ECANCELED));
+		delay(1);
+	}
+
+	err = zio_wait(zio_read_phys(NULL, dev->l2ad_vdev, offset, size, abd,
+	    ZIO_CHECKSUM_OFF, NULL, NULL, ZIO_PRIORITY_ASYNC_READ,
+	    ZIO_FLAG_CANFAIL | ZIO_FLAG_DONT_PROPAGATE | ZIO_FLAG_DONT_RETRY,
+	    B_FALSE));
+
+	spa_config_exit(spa, SCL_L2ARC, dev);
+
+	return (err);
+}
+
+/*
+ * Read the device header into l2ad_dev_hdr.  A header that does not belong
+ * to this device as it is laid out now is cleared, so that the device
+ * starts over from an empty log.
+ */
+static int
+l2arc_dev_hdr_read(l2arc_dev_t *dev)
+{
+	l2arc_dev_hdr_phys_t *dh = dev->l2ad_dev_hdr;
+	zio_cksum_t cksum, saved;
+	abd_t *abd;
+	int err;
+
+	abd = abd_alloc_linear(dev->l2ad_dev_hdr_asize, B_TRUE);
+	err = l2arc_rebuild_read(dev, VDEV_LABEL_START_SIZE,
+	    dev->l2ad_dev_hdr_asize, abd);
+	if (err == 0)
+		abd_copy_to_buf(dh, abd, sizeof (*dh));
+	abd_free(abd);
+
+	if (err != 0) {
+		if (err != ECANCELED)
+			ARCSTAT_BUMP(arcstat_l2_rebuild_io_errors);
+		bzero(dh, sizeof (*dh));
+		return (err);
+	}
+
+	saved = dh->dh_cksum;
+	ZIO_SET_CHECKSUM(&dh->dh_cksum, 0, 0, 0, 0);
+	fletcher_4_native(dh, sizeof (*dh), NULL, &cksum);
+
+	if (dh->dh_magic != L2ARC_DEV_HDR_MAGIC ||
+	    dh->dh_version != L2ARC_PERSISTENT_VERSION ||
+	    dh->dh_spa_guid != spa_guid(dev->l2ad_spa) ||
+	    dh->dh_vdev_guid != dev->l2ad_vdev->vdev_guid ||
+	    dh->dh_start != dev->l2ad_start ||
+	    dh->dh_end != dev->l2ad_end ||
+	    !ZIO_CHECKSUM_EQUAL(cksum, saved)) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_unsupported);
+		bzero(dh, sizeof (*dh));
+		return (SET_ERROR(ENOTSUP));
+	}
+
+	return (0);
+}
+
+static boolean_t
+l2arc_log_blkptr_valid(l2arc_dev_t *dev, const l2arc_log_blkptr_t *lbp)
+{
+	return (lbp->lbp_asize != 0 && lbp->lbp_daddr >= dev->l2ad_start &&
+	    lbp->lbp_daddr + lbp->lbp_asize <= dev->l2ad_end);
+}
+
+/*
+ * Read the log block lbp points to into lb and verify it against lbp.
+ */
+static int
+l2arc_log_blk_read(l2arc_dev_t *dev, const l2arc_log_blkptr_t *lbp,
+    l2arc_log_blk_phys_t *lb)
+{
+	zio_cksum_t cksum;
+	abd_t *abd;
+	int err;
+
+	if (lbp->lbp_asize < sizeof (*lb))
+		return (SET_ERROR(EINVAL));
+
+	abd = abd_alloc_for_io(lbp->lbp_asize, B_TRUE);
+	err = l2arc_rebuild_read(dev, lbp->lbp_daddr, lbp->lbp_asize, abd);
+	if (err == 0)
+		abd_copy_to_buf(lb, abd, sizeof (*lb));
+	abd_free(abd);
+
+	if (err != 0) {
+		if (err != ECANCELED)
+			ARCSTAT_BUMP(arcstat_l2_rebuild_io_errors);
+		return (err);
+	}
+
+	fletcher_4_native(lb, sizeof (*lb), NULL, &cksum);
+	if (!ZIO_CHECKSUM_EQUAL(cksum, lbp->lbp_cksum) ||
+	    lb->lb_magic != L2ARC_LOG_BLK_MAGIC ||
+	    lb->lb_nentries > L2ARC_LOG_BLK_ENTRIES) {
+		ARCSTAT_BUMP(arcstat_l2_rebuild_cksum_lb_errors);
+		return (SET_ERROR(ECKSUM));
+	}
+
+	return (0);
+}
+
+/*
+ * Create an L2-only header for a log entry, unless the buffer it describes
+ * is already in the ARC.
+ */
+static void
+l2arc_hdr_restore(const l2arc_log_ent_phys_t *le, l2arc_dev_t *dev)
+{
+	arc_buf_hdr_t *hdr, *exists;
+	kmutex_t *hash_lock;
+	arc_buf_contents_t type = L2BLK_GET_TYPE(le->le_prop);
+	enum zio_compress compress = L2BLK_GET_COMPRESS(le->le_prop);
+	uint64_t lsize = L2BLK_GET_LSIZE(le->le_prop);
+	uint64_t psize = L2BLK_GET_PSIZE(le->le_prop);
+	uint64_t asize = vdev_psize_to_asize(dev->l2ad_vdev, psize);
+	uint64_t size;
+
+	if ((type != ARC_BUFC_DATA && type != ARC_BUFC_METADATA) ||
+	    compress >= ZIO_COMPRESS_FUNCTIONS || psize > lsize ||
+	    DVA_IS_EMPTY(&le->le_dva) || le->le_birth == 0 ||
+	    le->le_daddr < dev->l2ad_start ||
+	    le->le_daddr + asize > dev->l2ad_end)
+		return;
+
+	/*
+	 * A compressed buffer can only be handed back as is when the ARC
+	 * keeps buffers compressed.
+	 */
+	if (compress != ZIO_COMPRESS_OFF && !zfs_compressed_arc_enabled)
+		return;
+
+	hdr = kmem_cache_alloc(hdr_l2only_cache, KM_SLEEP);
+	hdr->b_flags = 0;
+	hdr->b_type = type;
+	arc_hdr_set_flags(hdr, arc_bufc_to_flags(type) | ARC_FLAG_HAS_L2HDR);
+	HDR_SET_LSIZE(hdr, lsize);
+	HDR_SET_PSIZE(hdr, psize);
+	arc_hdr_set_compress(hdr, compress);
+	hdr->b_dva = le->le_dva;
+	hdr->b_birth = le->le_birth;
+	hdr->b_spa = spa_load_guid(dev->l2ad_spa);
+	hdr->b_l2hdr.b_dev = dev;
+	hdr->b_l2hdr.b_daddr = le->le_daddr;
+
+	exists = buf_hash_insert(hdr, &hash_lock);
+	if (exists != NULL) {
+		mutex_exit(hash_lock);
+		arc_hdr_clear_flags(hdr, ARC_FLAG_HAS_L2HDR);
+		arc_hdr_destroy(hdr);
+		ARCSTAT_BUMP(arcstat_l2_rebuild_bufs_precached);
+		return;
+	}
+
+	/* the same accounting arc_hdr_l2hdr_destroy() undoes */
+	size = arc_hdr_size(hdr);
+	mutex_enter(&dev->l2ad_mtx);
+	list_insert_tail(&dev->l2ad_buflist, hdr);
+	(void) refcount_add_many(&dev->l2ad_alloc, size, hdr);
+	mutex_exit(&dev->l2ad_mtx);
+	mutex_exit(hash_lock);
+
+	ARCSTAT_INCR(arcstat_l2_lsize, lsize);
+	ARCSTAT_INCR(arcstat_l2_psize, size);
+	vdev_space_update(dev->l2ad_vdev, size, 0, 0);
+	ARCSTAT_BUMP(arcstat_l2_rebuild_bufs);
+	ARCSTAT_INCR(arcstat_l2_rebuild_lsize, lsize);
+	ARCSTAT_INCR(arcstat_l2_rebuild_psize, size);
+}
 
+/*
+ * Put the buffers recorded on the device back into the ARC, newest log
+ * block first.  The buffer list of the device is kept in the order the
+ * buffers were written, oldest at the tail, so that l2arc_evict() keeps
+ * working on it as if the buffers had been written in this import.
+ */
+static void
+l2arc_rebuild(l2arc_dev_t *dev)
+{
+	l2arc_dev_hdr_phys_t *dh = dev->l2ad_dev_hdr;
+	l2arc_log_blk_phys_t *lb;
+	l2arc_log_blkptr_t lbp;
+	uint64_t walked = 0;
+	boolean_t aborted = B_FALSE;
+	int err;
+
+	if (l2arc_dev_hdr_read(dev) != 0)
+		return;
+
+	lbp = dh->dh_last_lbp;
+	if (!l2arc_log_blkptr_valid(dev, &lbp))
+		return;
+
+	/*
+	 * Carry on writing right after the newest log block, so that the
+	 * device is not overwritten from the start on every import.
+	 */
+	dev->l2ad_hand = lbp.lbp_daddr + lbp.lbp_asize;
+	if (dev->l2ad_hand >= dev->l2ad_end - l2arc_write_size())
+		dev->l2ad_hand = dev->l2ad_start;
+	dev->l2ad_first = B_FALSE;
+
+	lb = kmem_alloc(sizeof (*lb), KM_SLEEP);
+	while (l2arc_log_blkptr_valid(dev, &lbp)) {
 		/*
-		 * Avoid contributing to memory pressure.
+		 * Once a whole device worth of data has been walked, the
+		 * rest of the chain has been overwritten.
 		 */
+		walked += lbp.lbp_asize + lbp.lbp_payload_asize;
+		if (walked > dev->l2ad_end - dev->l2ad_start)
+			break;
+
+		if (dev->l2ad_rebuild_cancel) {
+			aborted = B_TRUE;
+			break;
+		}
 		if (arc_reclaim_needed()) {
-			ARCSTAT_BUMP(arcstat_l2_abort_lowmem);
-			spa_config_exit(spa, SCL_L2ARC, dev);
-			continue;
+			ARCSTAT_BUMP(arcstat_l2_rebuild_lowmem);
+			aborted = B_TRUE;
+			break;
 		}
 
-		ARCSTAT_BUMP(arcstat_l2_feeds);
+		err = l2arc_log_blk_read(dev, &lbp, lb);
+		if (err != 0) {
+			if (err != ECKSUM)
+				aborted = B_TRUE;
+			break;
+		}
 
-		size = l2arc_write_size();
+		for (int i = lb->lb_nentries - 1; i >= 0; i--)
+			l2arc_hdr_restore(&lb->lb_entries[i], dev);
 
-		/*
-		 * Evict L2ARC buffers that will be overwritten.
-		 */
-		l2arc_evict(dev, size, B_FALSE);
+		ARCSTAT_BUMP(arcstat_l2_rebuild_log_blks);
+		lbp = lb->lb_prev_lbp;
+	}
+	kmem_free(lb, sizeof (*lb));
 
-		/*
-		 * Write ARC buffers.
-		 */
-		wrote = l2arc_write_buffers(spa, dev, size);
+	if (!aborted)
+		ARCSTAT_BUMP(arcstat_l2_rebuild_success);
+}
 
-		/*
-		 * Calculate interval between writes.
-		 */
-		next = l2arc_write_interval(begin, size, wrote);
-		spa_config_exit(spa, SCL_L2ARC, dev);
-	}
+static void
+l2arc_dev_rebuild_thread(void *arg)
+{
+	l2arc_dev_t *dev = arg;
+
+	l2arc_rebuild(dev);
+
+	mutex_enter(&dev->l2ad_mtx);
+	dev->l2ad_rebuild = B_FALSE;
+	cv_broadcast(&dev->l2ad_rebuild_cv);
+	mutex_exit(&dev->l2ad_mtx);
 
-	l2arc_thread_exit = 0;
-	cv_broadcast(&l2arc_feed_thr_cv);
-	CALLB_CPR_EXIT(&cpr);		/* drops l2arc_feed_thr_lock */
 	thread_exit();
 }
 
@@ -8900,18 +10394,27 @@ l2arc_add_vdev(spa_t *spa, vdev_t *vd)
 	ASSERT(!l2arc_vdev_present(vd));
 
 	/*
-	 * Create a new l2arc device entry.
+	 * Create a new l2arc device entry.  The persistent L2ARC device
+	 * header sits between the front labels and the data.
 	 */
 	adddev = kmem_zalloc(sizeof (l2arc_dev_t), KM_SLEEP);
 	adddev->l2ad_spa = spa;
 	adddev->l2ad_vdev = vd;
-	adddev->l2ad_start = VDEV_LABEL_START_SIZE;
+	adddev->l2ad_dev_hdr = kmem_zalloc(sizeof (l2arc_dev_hdr_phys_t),
+	    KM_SLEEP);
+	adddev->l2ad_dev_hdr_asize = vdev_psize_to_asize(vd,
+	    sizeof (l2arc_dev_hdr_phys_t));
+	adddev->l2ad_log_blk = kmem_zalloc(sizeof (l2arc_log_blk_phys_t),
+	    KM_SLEEP);
+	adddev->l2ad_start = VDEV_LABEL_START_SIZE +
+	    adddev->l2ad_dev_hdr_asize;
 	adddev->l2ad_end = VDEV_LABEL_START_SIZE + vdev_get_min_asize(vd);
 	adddev->l2ad_hand = adddev->l2ad_start;
 	adddev->l2ad_first = B_TRUE;
 	adddev->l2ad_writing = B_FALSE;
 
 	mutex_init(&adddev->l2ad_mtx, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&adddev->l2ad_rebuild_cv, NULL, CV_DEFAULT, NULL);
 	/*
 	 * This is a list of all ARC buffers that are still valid on the
 	 * device.
@@ -8922,6 +10425,16 @@ l2arc_add_vdev(spa_t *spa, vdev_t *vd)
 	vdev_space_update(vd, 0, 0, adddev->l2ad_end - adddev->l2ad_hand);
 	refcount_create(&adddev->l2ad_alloc);
 
+	/*
+	 * Bring back what the device held the last time the pool was
+	 * imported.  Pools that are only being looked at by tryimport are
+	 * not worth it.  The feed thread leaves the device alone until the
+	 * rebuild is done.
+	 */
+	if (l2arc_rebuild_enabled &&
+	    spa->spa_load_state != SPA_LOAD_TRYIMPORT)
+		adddev->l2ad_rebuild = B_TRUE;
+
 	/*
 	 * Add device to global list
 	 */
@@ -8929,6 +10442,11 @@ l2arc_add_vdev(spa_t *spa, vdev_t *vd)
 	list_insert_head(l2arc_dev_list, adddev);
 	atomic_inc_64(&l2arc_ndev);
 	mutex_exit(&l2arc_dev_mtx);
+
+	if (adddev->l2ad_rebuild) {
+		(void) thread_create(NULL, 0, l2arc_dev_rebuild_thread, adddev,
+		    0, &p0, TS_RUN, minclsyspri);
+	}
 }
 
 /*
@@ -8956,20 +10474,95 @@ l2arc_remove_vdev(vdev_t *vd)
 	 * Remove device from global list
 	 */
 	list_remove(l2arc_dev_list, remdev);
-	l2arc_dev_last = NULL;		/* may have been invalidated */
 	atomic_dec_64(&l2arc_ndev);
 	mutex_exit(&l2arc_dev_mtx);
 
+	/*
+	 * Stop a rebuild that is still running, it adds to the buflist.
+	 */
+	mutex_enter(&remdev->l2ad_mtx);
+	remdev->l2ad_rebuild_cancel = B_TRUE;
+	while (remdev->l2ad_rebuild)
+		cv_wait(&remdev->l2ad_rebuild_cv, &remdev->l2ad_mtx);
+	mutex_exit(&remdev->l2ad_mtx);
+
 	/*
 	 * Clear all buflists and ARC references.  L2ARC device flush.
 	 */
 	l2arc_evict(remdev, 0, B_TRUE);
 	list_destroy(&remdev->l2ad_buflist);
+	cv_destroy(&remdev->l2ad_rebuild_cv);
 	mutex_destroy(&remdev->l2ad_mtx);
 	refcount_destroy(&remdev->l2ad_alloc);
+	kmem_free(remdev->l2ad_log_blk, sizeof (l2arc_log_blk_phys_t));
+	kmem_free(remdev->l2ad_dev_hdr, sizeof (l2arc_dev_hdr_phys_t));
 	kmem_free(remdev, sizeof (l2arc_dev_t));
 }
 
+static int
+l2arc_dev_kstat_headers(char *buf, size_t size)
+{
+	(void) snprintf(buf, size,
+	    "%-24s %-20s %-10s %-14s %-10s %-10s %-12s %-10s %-14s "
+	    "%-10s %-6s\n",
+	    "pool", "vdev", "feeds", "write_bytes", "write_ms", "write_mbps",
+	    "write_target", "hits", "hit_bytes", "misses", "hit%");
+
+	return (0);
+}
+
+/*
+ * One row per cache device.  write_mbps is the rate the device was
+ * written at while it was being written to, and hit% is the share of the
+ * reads of buffers cached on the device that it served.
+ */
+static int
+l2arc_dev_kstat_data(char *buf, size_t size, void *data)
+{
+	l2arc_dev_t *dev;
+	int n, error = 0;
+
+	mutex_enter(&l2arc_dev_mtx);
+	for (dev = list_head(l2arc_dev_list); dev != NULL;
+	    dev = list_next(l2arc_dev_list, dev)) {
+		uint64_t ms = dev->l2ad_write_time / (NANOSEC / MILLISEC);
+		uint64_t lookups = dev->l2ad_hits + dev->l2ad_misses;
+
+		n = snprintf(buf, size,
+		    "%-24s %-20llu %-10llu %-14llu %-10llu %-10llu %-12llu "
+		    "%-10llu %-14llu %-10llu %-6llu\n",
+		    spa_name(dev->l2ad_spa),
+		    (u_longlong_t)dev->l2ad_vdev->vdev_guid,
+		    (u_longlong_t)dev->l2ad_feeds,
+		    (u_longlong_t)dev->l2ad_write_bytes, (u_longlong_t)ms,
+		    (u_longlong_t)(ms == 0 ? 0 :
+		    dev->l2ad_write_bytes / 1000 / ms),
+		    (u_longlong_t)l2arc_dev_write_size(dev),
+		    (u_longlong_t)dev->l2ad_hits,
+		    (u_longlong_t)dev->l2ad_hit_bytes,
+		    (u_longlong_t)dev->l2ad_misses,
+		    (u_longlong_t)(lookups == 0 ? 0 :
+		    dev->l2ad_hits * 100 / lookups));
+		if (n >= size) {
+			error = SET_ERROR(ENOMEM);
+			break;
+		}
+		buf += n;
+		size -= n;
+	}
+	mutex_exit(&l2arc_dev_mtx);
+
+	return (error);
+}
+
+static void *
+l2arc_dev_kstat_addr(kstat_t *ksp, off_t n)
+{
+	if (n == 0)
+		return (ksp);
+	return (NULL);
+}
+
 void
 l2arc_init(void)
 {
@@ -8989,6 +10582,17 @@ l2arc_init(void)
 	    offsetof(l2arc_dev_t, l2ad_node));
 	list_create(l2arc_free_on_write, sizeof (l2arc_data_free_t),
 	    offsetof(l2arc_data_free_t, l2df_list_node));
+
+	mutex_init(&l2arc_dev_kstat_lock, NULL, MUTEX_DEFAULT, NULL);
+	l2arc_dev_ksp = kstat_create("zfs", 0, "l2arc_devices", "misc",
+	    KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+	if (l2arc_dev_ksp != NULL) {
+		l2arc_dev_ksp->ks_lock = &l2arc_dev_kstat_lock;
+		l2arc_dev_ksp->ks_ndata = UINT32_MAX;
+		kstat_set_raw_ops(l2arc_dev_ksp, l2arc_dev_kstat_headers,
+		    l2arc_dev_kstat_data, l2arc_dev_kstat_addr);
+		kstat_install(l2arc_dev_ksp);
+	}
 }
 
 void
@@ -9002,6 +10606,12 @@ l2arc_fini(void)
 
 	l2arc_do_free_on_write();
 
+	if (l2arc_dev_ksp != NULL) {
+		kstat_delete(l2arc_dev_ksp);
+		l2arc_dev_ksp = NULL;
+	}
+	mutex_destroy(&l2arc_dev_kstat_lock);
+
 	mutex_destroy(&l2arc_feed_thr_lock);
 	cv_destroy(&l2arc_feed_thr_cv);
 	mutex_destroy(&l2arc_dev_mtx);
@@ -9017,6 +10627,10 @@ l2arc_start(void)
 	if (!(spa_mode_global & FWRITE))
 		return;
 
+	l2arc_feed_nthreads = MAX(l2arc_feed_threads, 1);
+	l2arc_feed_taskq = taskq_create("l2arc_feed", l2arc_feed_nthreads,
+	    minclsyspri, l2arc_feed_nthreads, INT_MAX, TASKQ_PREPOPULATE);
+
 	(void) thread_create(NULL, 0, l2arc_feed_thread, NULL, 0, &p0,
 	    TS_RUN, minclsyspri);
 }
@@ -9033,6 +10647,9 @@ l2arc_stop(void)
 	while (l2arc_thread_exit != 0)
 		cv_wait(&l2arc_feed_thr_cv, &l2arc_feed_thr_lock);
 	mutex_exit(&l2arc_feed_thr_lock);
+
+	taskq_destroy(l2arc_feed_taskq);
+	l2arc_feed_taskq = NULL;
 }
 
 #ifdef __APPLE__
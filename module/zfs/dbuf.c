@@ -46,6 +46,7 @@
 #include <sys/range_tree.h>
 #include <sys/trace_dbuf.h>
 #include <sys/callb.h>
+#include <sys/kstat.h>
 #include <sys/abd.h>
 
 uint_t zfs_dbuf_evict_key;
@@ -95,10 +96,18 @@ extern inline void dmu_buf_init_user(dmu_buf_user_t *dbu,
 static kmem_cache_t *dbuf_kmem_cache;
 static taskq_t *dbu_evict_taskq;
 
-static kthread_t *dbuf_cache_evict_thread;
 static kmutex_t dbuf_evict_lock;
 static kcondvar_t dbuf_evict_cv;
 static boolean_t dbuf_evict_thread_exit;
+static int dbuf_evict_nthreads;
+static int dbuf_evict_threads_running;
+
+/*
+ * Number of dbuf eviction threads; 0 picks one per 8 CPUs.  Each thread
+ * evicts from its own share of the dbuf cache's sublists.  Only read at
+ * module load.
+ */
+int dbuf_evict_threads = 0;
 
 /*
  * LRU cache of dbufs. The dbuf cache maintains a list of dbufs that
@@ -162,6 +171,29 @@ int dbuf_cache_max_shift = 5;
 uint_t dbuf_cache_hiwater_pct = 10;
 uint_t dbuf_cache_lowater_pct = 10;
 
+typedef struct dbuf_cache_stats {
+	kstat_named_t dcs_hash_elements;
+	kstat_named_t dcs_hash_lock_contended;
+	kstat_named_t dcs_cache_size_bytes;
+	kstat_named_t dcs_cache_evicts;
+	kstat_named_t dcs_cache_direct_evicts;
+	kstat_named_t dcs_evict_threads;
+} dbuf_cache_stats_t;
+
+static dbuf_cache_stats_t dbuf_cache_stats = {
+	{ "hash_elements",		KSTAT_DATA_UINT64 },
+	{ "hash_lock_contended",	KSTAT_DATA_UINT64 },
+	{ "cache_size_bytes",		KSTAT_DATA_UINT64 },
+	{ "cache_evicts",		KSTAT_DATA_UINT64 },
+	{ "cache_direct_evicts",	KSTAT_DATA_UINT64 },
+	{ "evict_threads",		KSTAT_DATA_UINT64 }
+};
+
+#define	DBUFSTAT_BUMP(stat) \
+	atomic_inc_64(&dbuf_cache_stats.stat.value.ui64)
+
+static kstat_t *dbuf_cache_ksp;
+
 /* ARGSUSED */
 static int
 dbuf_cons(void *vdb, void *unused, int kmflag)
@@ -194,6 +226,20 @@ static dbuf_hash_table_t dbuf_hash_table;
 
 static uint64_t dbuf_hash_count;
 
+/*
+ * Take a hash stripe lock, counting the times that we had to wait for it.
+ */
+static inline void
+dbuf_hash_enter(dbuf_hash_table_t *h, uint64_t idx)
+{
+	kmutex_t *hmtx = DBUF_HASH_MUTEX(h, idx);
+
+	if (!mutex_tryenter(hmtx)) {
+		DBUFSTAT_BUMP(dcs_hash_lock_contended);
+		mutex_enter(hmtx);
+	}
+}
+
 static uint64_t
 dbuf_hash(void *os, uint64_t obj, uint8_t lvl, uint64_t blkid)
 {
@@ -229,7 +275,7 @@ dbuf_find(objset_t *os, uint64_t obj, uint8_t level, uint64_t blkid)
 
 	idx = hv & h->hash_table_mask;
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
+	dbuf_hash_enter(h, idx);
 	for (db = h->hash_table[idx]; db != NULL; db = db->db_hash_next) {
 		if (DBUF_EQUAL(db, os, obj, level, blkid)) {
 			mutex_enter(&db->db_mtx);
@@ -280,7 +326,7 @@ dbuf_hash_insert(dmu_buf_impl_t *db)
 	uint64_t idx = hv & h->hash_table_mask;
 	dmu_buf_impl_t *dbf;
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
+	dbuf_hash_enter(h, idx);
 	for (dbf = h->hash_table[idx]; dbf != NULL; dbf = dbf->db_hash_next) {
 		if (DBUF_EQUAL(dbf, os, obj, level, blkid)) {
 			mutex_enter(&dbf->db_mtx);
@@ -321,7 +367,7 @@ dbuf_hash_remove(dmu_buf_impl_t *db)
 	ASSERT(db->db_state == DB_EVICTING);
 	ASSERT(!MUTEX_HELD(&db->db_mtx));
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
+	dbuf_hash_enter(h, idx);
 	dbp = &h->hash_table[idx];
 	while ((dbf = *dbp) != db) {
 		dbp = &dbf->db_hash_next;
@@ -483,12 +529,12 @@ dbuf_cache_above_lowater(void)
 }
 
 /*
- * Evict the oldest eligible dbuf from the dbuf cache.
+ * Evict the oldest eligible dbuf from the given sublist of the dbuf cache.
+ * Returns B_FALSE if there was nothing that could be evicted.
  */
-static void
-dbuf_evict_one(void)
+static boolean_t
+dbuf_evict_sublist(int idx)
 {
-	int idx = multilist_get_random_index(dbuf_cache);
 	multilist_sublist_t *mls = multilist_sublist_lock(dbuf_cache, idx);
 
 	ASSERT(!MUTEX_HELD(&dbuf_evict_lock));
@@ -521,23 +567,40 @@ dbuf_evict_one(void)
 		multilist_sublist_unlock(mls);
 	}
 	(void) tsd_set(zfs_dbuf_evict_key, NULL);
+
+	return (db != NULL);
+}
+
+/*
+ * Evict the oldest eligible dbuf from a random sublist of the dbuf cache.
+ * This is used when callers have to evict in their own context.
+ */
+static void
+dbuf_evict_one(void)
+{
+	if (dbuf_evict_sublist(multilist_get_random_index(dbuf_cache)))
+		DBUFSTAT_BUMP(dcs_cache_direct_evicts);
 }
 
 /*
- * The dbuf evict thread is responsible for aging out dbufs from the
+ * The dbuf evict threads are responsible for aging out dbufs from the
  * cache. Once the cache has reached it's maximum size, dbufs are removed
- * and destroyed. The eviction thread will continue running until the size
+ * and destroyed. The eviction threads will continue running until the size
  * of the dbuf cache is at or below the maximum size. Once the dbuf is aged
  * out of the cache it is destroyed and becomes eligible for arc eviction.
+ *
+ * Thread 'shard' of dbuf_evict_nthreads only evicts from sublists
+ * shard, shard + dbuf_evict_nthreads, ..., taking one dbuf from each in
+ * turn, so that the threads never contend for a sublist lock with each
+ * other.  Since dbufs are evenly distributed between the sublists, each
+ * thread's share of the cache is about the same.
  */
-#ifdef __APPLE__
-static void
-dbuf_evict_thread(void *notused)
-#else
 static void
-dbuf_evict_thread(void)
-#endif
+dbuf_evict_thread(void *arg)
 {
+	int shard = (int)(uintptr_t)arg;
+	int nsublists = multilist_get_num_sublists(dbuf_cache);
+	int idx = shard;
 	callb_cpr_t cpr;
 
 	CALLB_CPR_INIT(&cpr, &dbuf_evict_lock, callb_generic_cpr, FTAG);
@@ -550,26 +613,69 @@ dbuf_evict_thread(void)
 			    &dbuf_evict_lock, SEC2NSEC(1), MSEC2NSEC(1), 0);
 			CALLB_CPR_SAFE_END(&cpr, &dbuf_evict_lock);
 		}
+
+		/*
+		 * Callers only signal one thread; if the cache is over its
+		 * maximum size, get the next one going as well.
+		 */
+		if (refcount_count(&dbuf_cache_size) > dbuf_cache_max_bytes)
+			cv_signal(&dbuf_evict_cv);
 		mutex_exit(&dbuf_evict_lock);
 
 		/*
 		 * Keep evicting as long as we're above the low water mark
 		 * for the cache. We do this without holding the locks to
-		 * minimize lock contention.
+		 * minimize lock contention.  If a whole pass over our
+		 * sublists found nothing to evict, leave the rest to the
+		 * other threads.
 		 */
+		boolean_t evicted = B_FALSE;
 		while (dbuf_cache_above_lowater() && !dbuf_evict_thread_exit) {
-			dbuf_evict_one();
+			if (dbuf_evict_sublist(idx)) {
+				DBUFSTAT_BUMP(dcs_cache_evicts);
+				evicted = B_TRUE;
+			}
+			idx += dbuf_evict_nthreads;
+			if (idx >= nsublists) {
+				idx = shard;
+				if (!evicted)
+					break;
+				evicted = B_FALSE;
+			}
 		}
 
 		mutex_enter(&dbuf_evict_lock);
+		if (!evicted && dbuf_cache_above_lowater() &&
+		    !dbuf_evict_thread_exit) {
+			CALLB_CPR_SAFE_BEGIN(&cpr);
+			(void) cv_timedwait_hires(&dbuf_evict_cv,
+			    &dbuf_evict_lock, MSEC2NSEC(10), MSEC2NSEC(1), 0);
+			CALLB_CPR_SAFE_END(&cpr, &dbuf_evict_lock);
+		}
 	}
 
-	dbuf_evict_thread_exit = B_FALSE;
+	dbuf_evict_threads_running--;
 	cv_broadcast(&dbuf_evict_cv);
 	CALLB_CPR_EXIT(&cpr);	/* drops dbuf_evict_lock */
 	thread_exit();
 }
 
+static int
+dbuf_cache_kstat_update(kstat_t *ksp, int rw)
+{
+	dbuf_cache_stats_t *dcs = ksp->ks_data;
+
+	if (rw == KSTAT_WRITE)
+		return (SET_ERROR(EACCES));
+
+	dcs->dcs_hash_elements.value.ui64 = dbuf_hash_count;
+	dcs->dcs_cache_size_bytes.value.ui64 =
+	    refcount_count(&dbuf_cache_size);
+	dcs->dcs_evict_threads.value.ui64 = dbuf_evict_nthreads;
+
+	return (0);
+}
+
 /*
  * Wake up the dbuf eviction thread if the dbuf cache is at its max size.
  * If the dbuf cache is at its high water mark, then evict a dbuf from the
@@ -651,8 +757,10 @@ retry:
 	    sizeof (dmu_buf_impl_t),
 	    0, dbuf_cons, dbuf_dest, NULL, NULL, NULL, 0);
 
-	for (i = 0; i < DBUF_MUTEXES; i++)
-		mutex_init(&h->hash_mutexes[i], NULL, MUTEX_DEFAULT, NULL);
+	for (i = 0; i < DBUF_MUTEXES; i++) {
+		mutex_init(&h->hash_mutexes[i].dhl_lock, NULL,
+		    MUTEX_DEFAULT, NULL);
+	}
 
 	dbuf_stats_init(h);
 
@@ -680,8 +788,29 @@ retry:
 	dbuf_evict_thread_exit = B_FALSE;
 	mutex_init(&dbuf_evict_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&dbuf_evict_cv, NULL, CV_DEFAULT, NULL);
-	dbuf_cache_evict_thread = thread_create(NULL, 0, dbuf_evict_thread,
-		NULL, 0, &p0, TS_RUN, minclsyspri);
+
+	dbuf_evict_nthreads = dbuf_evict_threads;
+	if (dbuf_evict_nthreads <= 0)
+		dbuf_evict_nthreads = MAX(1, max_ncpus / 8);
+	dbuf_evict_nthreads = MIN(dbuf_evict_nthreads,
+	    multilist_get_num_sublists(dbuf_cache));
+
+	mutex_enter(&dbuf_evict_lock);
+	for (i = 0; i < dbuf_evict_nthreads; i++) {
+		(void) thread_create(NULL, 0, dbuf_evict_thread,
+		    (void *)(uintptr_t)i, 0, &p0, TS_RUN, minclsyspri);
+		dbuf_evict_threads_running++;
+	}
+	mutex_exit(&dbuf_evict_lock);
+
+	dbuf_cache_ksp = kstat_create("zfs", 0, "dbufstats", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (dbuf_cache_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (dbuf_cache_ksp != NULL) {
+		dbuf_cache_ksp->ks_data = &dbuf_cache_stats;
+		dbuf_cache_ksp->ks_update = dbuf_cache_kstat_update;
+		kstat_install(dbuf_cache_ksp);
+	}
 }
 
 void
@@ -692,8 +821,13 @@ dbuf_fini(void)
 
 	dbuf_stats_destroy();
 
+	if (dbuf_cache_ksp != NULL) {
+		kstat_delete(dbuf_cache_ksp);
+		dbuf_cache_ksp = NULL;
+	}
+
 	for (i = 0; i < DBUF_MUTEXES; i++)
-		mutex_destroy(&h->hash_mutexes[i]);
+		mutex_destroy(&h->hash_mutexes[i].dhl_lock);
 
 	kmem_free(h->hash_table, (h->hash_table_mask + 1) * sizeof (void *));
 	kmem_cache_destroy(dbuf_kmem_cache);
@@ -701,10 +835,11 @@ dbuf_fini(void)
 
 	mutex_enter(&dbuf_evict_lock);
 	dbuf_evict_thread_exit = B_TRUE;
-	while (dbuf_evict_thread_exit) {
-		cv_signal(&dbuf_evict_cv);
+	while (dbuf_evict_threads_running > 0) {
+		cv_broadcast(&dbuf_evict_cv);
 		cv_wait(&dbuf_evict_cv, &dbuf_evict_lock);
 	}
+	dbuf_evict_thread_exit = B_FALSE;
 	mutex_exit(&dbuf_evict_lock);
 #ifdef _KERNEL
 	tsd_destroy(&zfs_dbuf_evict_key);
@@ -982,7 +1117,8 @@ dbuf_read_done(zio_t *zio, int err, arc_buf_t *buf, void *vdb)
 }
 
 static int
-dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
+dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags,
+    zfetch_access_t *accessp)
 {
 	dnode_t *dn;
 	zbookmark_phys_t zb;
@@ -998,6 +1134,7 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 	ASSERT(db->db_state == DB_UNCACHED);
 	ASSERT(db->db_buf == NULL);
 
+	*accessp = ZFETCH_ACCESS_CACHED;
 	if (db->db_blkid == DMU_BONUS_BLKID) {
 		int bonuslen = MIN(dn->dn_bonuslen, dn->dn_phys->dn_bonuslen);
  		arc_buf_t *dn_buf = (dn->dn_dbuf) ? dn->dn_dbuf->db_buf : NULL;
@@ -1105,6 +1242,11 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 	    dbuf_read_done, db, ZIO_PRIORITY_SYNC_READ, zio_flags,
 	    &aflags, &zb);
 
+	if (aflags & ARC_FLAG_PREFETCH_INFLIGHT)
+		*accessp = ZFETCH_ACCESS_INFLIGHT;
+	else if ((aflags & ARC_FLAG_CACHED) == 0)
+		*accessp = ZFETCH_ACCESS_MISS;
+
 	return (SET_ERROR(err));
 }
 
@@ -1183,12 +1325,19 @@ dbuf_fix_old_data(dmu_buf_impl_t *db, uint64_t txg)
 	}
 }
 
+/*
+ * Like dbuf_read(), but also reports in *accessp (if not NULL) where the
+ * block was found, for the benefit of callers that do their own
+ * prefetching.
+ */
 int
-dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
+dbuf_read_access(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags,
+    zfetch_access_t *accessp)
 {
 	int err = 0;
 	boolean_t prefetch;
 	dnode_t *dn;
+	zfetch_access_t access = ZFETCH_ACCESS_UNKNOWN;
 
 	/*
 	 * We don't have to hold the mutex to check db_state because it
@@ -1229,8 +1378,11 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 			dbuf_set_data(db, db->db_buf);
 		}
 		mutex_exit(&db->db_mtx);
-		if (prefetch)
-			dmu_zfetch(&dn->dn_zfetch, db->db_blkid, 1, B_TRUE);
+		access = ZFETCH_ACCESS_CACHED;
+		if (prefetch) {
+			dmu_zfetch(&dn->dn_zfetch, db->db_blkid, 1, B_TRUE,
+			    access);
+		}
 		if ((flags & DB_RF_HAVESTRUCT) == 0)
 			rw_exit(&dn->dn_struct_rwlock);
 		DB_DNODE_EXIT(db);
@@ -1243,12 +1395,14 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 			zio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
 			need_wait = B_TRUE;
 		}
-		err = dbuf_read_impl(db, zio, flags);
+		err = dbuf_read_impl(db, zio, flags, &access);
 
 		/* dbuf_read_impl has dropped db_mtx for us */
 
-		if (!err && prefetch)
-			dmu_zfetch(&dn->dn_zfetch, db->db_blkid, 1, B_TRUE);
+		if (!err && prefetch) {
+			dmu_zfetch(&dn->dn_zfetch, db->db_blkid, 1, B_TRUE,
+			    access);
+		}
 
 		if ((flags & DB_RF_HAVESTRUCT) == 0)
 			rw_exit(&dn->dn_struct_rwlock);
@@ -1266,8 +1420,10 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 		 * occurred and the dbuf went to UNCACHED.
 		 */
 		mutex_exit(&db->db_mtx);
-		if (prefetch)
-			dmu_zfetch(&dn->dn_zfetch, db->db_blkid, 1, B_TRUE);
+		if (prefetch) {
+			dmu_zfetch(&dn->dn_zfetch, db->db_blkid, 1, B_TRUE,
+			    access);
+		}
 		if ((flags & DB_RF_HAVESTRUCT) == 0)
 			rw_exit(&dn->dn_struct_rwlock);
 		DB_DNODE_EXIT(db);
@@ -1289,9 +1445,18 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 		mutex_exit(&db->db_mtx);
 	}
 
+	if (accessp != NULL)
+		*accessp = access;
+
 	return (err);
 }
 
+int
+dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
+{
+	return (dbuf_read_access(db, zio, flags, NULL));
+}
+
 static void
 dbuf_noread(dmu_buf_impl_t *db)
 {
@@ -2551,6 +2716,17 @@ dbuf_prefetch_indirect_done(zio_t *zio, int err, arc_buf_t *abuf, void *private)
 void
 dbuf_prefetch(dnode_t *dn, int64_t level, uint64_t blkid, zio_priority_t prio,
 	arc_flags_t aflags)
+{
+	dbuf_prefetch_impl(dn, level, blkid, prio, aflags, NULL);
+}
+
+/*
+ * As dbuf_prefetch(), but the reads are issued as children of the given
+ * parent zio, if any, so that it completes once all of them are done.
+ */
+void
+dbuf_prefetch_impl(dnode_t *dn, int64_t level, uint64_t blkid,
+    zio_priority_t prio, arc_flags_t aflags, zio_t *parent)
 {
 	blkptr_t bp;
 	int epbs, nlevels, curlevel;
@@ -2622,8 +2798,8 @@ dbuf_prefetch(dnode_t *dn, int64_t level, uint64_t blkid, zio_priority_t prio,
 
 	ASSERT3U(curlevel, ==, BP_GET_LEVEL(&bp));
 
-	zio_t *pio = zio_root(dmu_objset_spa(dn->dn_objset), NULL, NULL,
-						  ZIO_FLAG_CANFAIL);
+	zio_t *pio = zio_null(parent, dmu_objset_spa(dn->dn_objset), NULL,
+	    NULL, NULL, ZIO_FLAG_CANFAIL);
 
 	dbuf_prefetch_arg_t *dpa = kmem_zalloc(sizeof (*dpa), KM_SLEEP);
 	dsl_dataset_t *ds = dn->dn_objset->os_dsl_dataset;
@@ -37,6 +37,9 @@
 #include <sys/zio_compress.h>
 #include <sys/dsl_scan.h>
 #include <sys/abd.h>
+#include <sys/zfeature.h>
+
+extern int zfs_dedup_log_enabled;
 
 static kmem_cache_t *ddt_cache;
 static kmem_cache_t *ddt_entry_cache;
@@ -46,6 +49,33 @@ static kmem_cache_t *ddt_entry_cache;
  */
 int zfs_dedup_prefetch = 0;
 
+typedef struct ddt_stats {
+	kstat_named_t ddtstat_lookups;
+	kstat_named_t ddtstat_lookup_hits;
+	kstat_named_t ddtstat_lookup_misses;
+	kstat_named_t ddtstat_lookup_found;
+	kstat_named_t ddtstat_load_waits;
+	kstat_named_t ddtstat_lock_waits;
+	kstat_named_t ddtstat_lock_wait_ns;
+} ddt_stats_t;
+
+static ddt_stats_t ddt_stats = {
+	{ "lookups",			KSTAT_DATA_UINT64 },
+	{ "lookup_hits",		KSTAT_DATA_UINT64 },
+	{ "lookup_misses",		KSTAT_DATA_UINT64 },
+	{ "lookup_found",		KSTAT_DATA_UINT64 },
+	{ "load_waits",			KSTAT_DATA_UINT64 },
+	{ "lock_waits",			KSTAT_DATA_UINT64 },
+	{ "lock_wait_ns",		KSTAT_DATA_UINT64 },
+};
+
+#define	DDTSTAT_BUMP(stat) \
+	atomic_inc_64(&ddt_stats.stat.value.ui64);
+#define	DDTSTAT_ADD(stat, val) \
+	atomic_add_64(&ddt_stats.stat.value.ui64, (val));
+
+static kstat_t *ddt_ksp;
+
 static const ddt_ops_t *ddt_ops[DDT_TYPES] = {
 	&ddt_zap_ops,
 };
@@ -160,7 +190,7 @@ ddt_object_sync(ddt_t *ddt, enum ddt_type type, enum ddt_class class,
 	ddo->ddo_mspace = doi.doi_fill_count * doi.doi_data_block_size;
 }
 
-static int
+int
 ddt_object_lookup(ddt_t *ddt, enum ddt_type type, enum ddt_class class,
     ddt_entry_t *dde)
 {
@@ -192,7 +222,7 @@ ddt_object_update(ddt_t *ddt, enum ddt_type type, enum ddt_class class,
 	    ddt->ddt_object[type][class], dde, tx));
 }
 
-static int
+int
 ddt_object_remove(ddt_t *ddt, enum ddt_type type, enum ddt_class class,
     ddt_entry_t *dde, dmu_tx_t *tx)
 {
@@ -429,7 +459,9 @@ ddt_stat_update(ddt_t *ddt, ddt_entry_t *dde, uint64_t neg)
 
 	ddh = &ddt->ddt_histogram[dde->dde_type][dde->dde_class];
 
+	mutex_enter(&ddt->ddt_stat_lock);
 	ddt_stat_add(&ddh->ddh_stat[bucket], &dds, neg);
+	mutex_exit(&ddt->ddt_stat_lock);
 }
 
 void
@@ -660,16 +692,58 @@ ddt_select(spa_t *spa, const blkptr_t *bp)
 	return (spa->spa_ddt[BP_GET_CHECKSUM(bp)]);
 }
 
+/*
+ * The shard holding the entry for a block with the given checksum.  The
+ * dedup checksums are cryptographic, so their low bits are well mixed;
+ * folding in a second word helps when fletcher4 is used with verify.
+ */
+static inline ddt_shard_t *
+ddt_shard(ddt_t *ddt, const zio_cksum_t *cksum)
+{
+	return (&ddt->ddt_shard[(cksum->zc_word[0] ^ cksum->zc_word[1]) %
+	    DDT_SHARDS]);
+}
+
+/*
+ * Lock the shard of the entry for a block with the given checksum, which
+ * is both the block pointer's blk_cksum and the entry's ddk_cksum.  Time
+ * spent waiting for the lock is counted in the ddt kstat.
+ */
 void
-ddt_enter(ddt_t *ddt)
+ddt_enter(ddt_t *ddt, const zio_cksum_t *cksum)
 {
-	mutex_enter(&ddt->ddt_lock);
+	kmutex_t *lock = &ddt_shard(ddt, cksum)->dsh_lock;
+	hrtime_t start;
+
+	if (mutex_tryenter(lock))
+		return;
+
+	start = gethrtime();
+	mutex_enter(lock);
+	DDTSTAT_BUMP(ddtstat_lock_waits);
+	DDTSTAT_ADD(ddtstat_lock_wait_ns, gethrtime() - start);
 }
 
 void
-ddt_exit(ddt_t *ddt)
+ddt_exit(ddt_t *ddt, const zio_cksum_t *cksum)
 {
-	mutex_exit(&ddt->ddt_lock);
+	mutex_exit(&ddt_shard(ddt, cksum)->dsh_lock);
+}
+
+/*
+ * Whether there are in-core entries that have yet to be synced.
+ */
+boolean_t
+ddt_changes_pending(ddt_t *ddt)
+{
+	int s;
+
+	for (s = 0; s < DDT_SHARDS; s++) {
+		if (avl_numnodes(&ddt->ddt_shard[s].dsh_tree) != 0)
+			return (B_TRUE);
+	}
+
+	return (B_FALSE);
 }
 
 void
@@ -679,11 +753,28 @@ ddt_init(void)
 	    sizeof (ddt_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
 	ddt_entry_cache = kmem_cache_create("ddt_entry_cache",
 	    sizeof (ddt_entry_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+
+	ddt_ksp = kstat_create("zfs", 0, "ddtstats", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (ddt_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+
+	if (ddt_ksp != NULL) {
+		ddt_ksp->ks_data = &ddt_stats;
+		kstat_install(ddt_ksp);
+	}
+
+	ddt_log_init();
 }
 
 void
 ddt_fini(void)
 {
+	if (ddt_ksp != NULL) {
+		kstat_delete(ddt_ksp);
+		ddt_ksp = NULL;
+	}
+
+	ddt_log_fini();
 	kmem_cache_destroy(ddt_entry_cache);
 	kmem_cache_destroy(ddt_cache);
 }
@@ -722,58 +813,84 @@ ddt_free(ddt_entry_t *dde)
 void
 ddt_remove(ddt_t *ddt, ddt_entry_t *dde)
 {
-	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+	ddt_shard_t *dsh = ddt_shard(ddt, &dde->dde_key.ddk_cksum);
+
+	ASSERT(MUTEX_HELD(&dsh->dsh_lock));
 
-	avl_remove(&ddt->ddt_tree, dde);
+	avl_remove(&dsh->dsh_tree, dde);
 	ddt_free(dde);
 }
 
+/*
+ * Find the in-core entry for a block, optionally adding it.  The caller
+ * holds the lock of its shard (see ddt_enter()).  An entry that isn't
+ * loaded yet is looked up in the on-disk tables with the lock dropped, so
+ * only lookups of the same block wait for it.
+ */
 ddt_entry_t *
 ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 {
+	ddt_shard_t *dsh = ddt_shard(ddt, &bp->blk_cksum);
 	ddt_entry_t *dde, dde_search;
 	enum ddt_type type;
 	enum ddt_class class;
 	avl_index_t where;
 	int error;
 
-	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+	ASSERT(MUTEX_HELD(&dsh->dsh_lock));
 
 	ddt_key_fill(&dde_search.dde_key, bp);
 
-	dde = avl_find(&ddt->ddt_tree, &dde_search, &where);
+	DDTSTAT_BUMP(ddtstat_lookups);
+
+	dde = avl_find(&dsh->dsh_tree, &dde_search, &where);
 	if (dde == NULL) {
 		if (!add)
 			return (NULL);
 		dde = ddt_alloc(&dde_search.dde_key);
-		avl_insert(&ddt->ddt_tree, dde, where);
+		avl_insert(&dsh->dsh_tree, dde, where);
 	}
 
-	while (dde->dde_loading)
-		cv_wait(&dde->dde_cv, &ddt->ddt_lock);
+	if (dde->dde_loading) {
+		DDTSTAT_BUMP(ddtstat_load_waits);
+		while (dde->dde_loading)
+			cv_wait(&dde->dde_cv, &dsh->dsh_lock);
+	}
 
-	if (dde->dde_loaded)
+	if (dde->dde_loaded) {
+		DDTSTAT_BUMP(ddtstat_lookup_hits);
 		return (dde);
+	}
+
+	DDTSTAT_BUMP(ddtstat_lookup_misses);
 
 	dde->dde_loading = B_TRUE;
 
-	ddt_exit(ddt);
+	mutex_exit(&dsh->dsh_lock);
 
 	error = ENOENT;
 
-	for (type = 0; type < DDT_TYPES; type++) {
-		for (class = 0; class < DDT_CLASSES; class++) {
-			error = ddt_object_lookup(ddt, type, class, dde);
+	if (ddt_log_find(ddt, dde)) {
+		type = dde->dde_type;
+		class = dde->dde_class;
+		if (class != DDT_CLASSES)
+			error = 0;
+	} else {
+		for (type = 0; type < DDT_TYPES; type++) {
+			for (class = 0; class < DDT_CLASSES; class++) {
+				error = ddt_object_lookup(ddt, type, class,
+				    dde);
+				if (error != ENOENT)
+					break;
+			}
 			if (error != ENOENT)
 				break;
 		}
-		if (error != ENOENT)
-			break;
 	}
 
 	ASSERT(error == 0 || error == ENOENT);
 
-	ddt_enter(ddt);
+	mutex_enter(&dsh->dsh_lock);
 
 	ASSERT(dde->dde_loaded == B_FALSE);
 	ASSERT(dde->dde_loading == B_TRUE);
@@ -783,8 +900,10 @@ ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 	dde->dde_loaded = B_TRUE;
 	dde->dde_loading = B_FALSE;
 
-	if (error == 0)
+	if (error == 0) {
+		DDTSTAT_BUMP(ddtstat_lookup_found);
 		ddt_stat_update(ddt, dde, -1ULL);
+	}
 
 	cv_broadcast(&dde->dde_cv);
 
@@ -840,15 +959,23 @@ static ddt_t *
 ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 {
 	ddt_t *ddt;
+	int s;
 
 	ddt = kmem_cache_alloc(ddt_cache, KM_SLEEP);
 	bzero(ddt, sizeof (ddt_t));
 
-	mutex_init(&ddt->ddt_lock, NULL, MUTEX_DEFAULT, NULL);
-	avl_create(&ddt->ddt_tree, ddt_entry_compare,
-	    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
+	for (s = 0; s < DDT_SHARDS; s++) {
+		ddt_shard_t *dsh = &ddt->ddt_shard[s];
+
+		mutex_init(&dsh->dsh_lock, NULL, MUTEX_DEFAULT, NULL);
+		avl_create(&dsh->dsh_tree, ddt_entry_compare,
+		    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
+	}
+	mutex_init(&ddt->ddt_repair_lock, NULL, MUTEX_DEFAULT, NULL);
 	avl_create(&ddt->ddt_repair_tree, ddt_entry_compare,
 	    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
+	mutex_init(&ddt->ddt_stat_lock, NULL, MUTEX_DEFAULT, NULL);
+	ddt_log_alloc(ddt);
 	ddt->ddt_checksum = c;
 	ddt->ddt_spa = spa;
 	ddt->ddt_os = spa->spa_meta_objset;
@@ -859,11 +986,20 @@ ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 static void
 ddt_table_free(ddt_t *ddt)
 {
-	ASSERT(avl_numnodes(&ddt->ddt_tree) == 0);
+	int s;
+
+	for (s = 0; s < DDT_SHARDS; s++) {
+		ddt_shard_t *dsh = &ddt->ddt_shard[s];
+
+		ASSERT(avl_numnodes(&dsh->dsh_tree) == 0);
+		avl_destroy(&dsh->dsh_tree);
+		mutex_destroy(&dsh->dsh_lock);
+	}
 	ASSERT(avl_numnodes(&ddt->ddt_repair_tree) == 0);
-	avl_destroy(&ddt->ddt_tree);
 	avl_destroy(&ddt->ddt_repair_tree);
-	mutex_destroy(&ddt->ddt_lock);
+	mutex_destroy(&ddt->ddt_repair_lock);
+	mutex_destroy(&ddt->ddt_stat_lock);
+	ddt_log_free(ddt);
 	kmem_cache_free(ddt_cache, ddt);
 }
 
@@ -906,6 +1042,10 @@ ddt_load(spa_t *spa)
 			}
 		}
 
+		error = ddt_log_load(ddt);
+		if (error != 0)
+			return (error);
+
 		/*
 		 * Seed the cached histograms.
 		 */
@@ -940,14 +1080,25 @@ ddt_class_contains(spa_t *spa, enum ddt_class max_class, const blkptr_t *bp)
 	if (!BP_GET_DEDUP(bp))
 		return (B_FALSE);
 
-	if (max_class == DDT_CLASS_UNIQUE)
-		return (B_TRUE);
-
 	ddt = spa->spa_ddt[BP_GET_CHECKSUM(bp)];
 	dde = kmem_cache_alloc(ddt_entry_cache, KM_SLEEP);
 
 	ddt_key_fill(&(dde->dde_key), bp);
 
+	/*
+	 * ddt_walk() skips the entries that are in the dedup log, so the
+	 * scan has to visit their blocks when it comes across them.
+	 */
+	if (ddt_log_contains(ddt, &dde->dde_key)) {
+		kmem_cache_free(ddt_entry_cache, dde);
+		return (B_FALSE);
+	}
+
+	if (max_class == DDT_CLASS_UNIQUE) {
+		kmem_cache_free(ddt_entry_cache, dde);
+		return (B_TRUE);
+	}
+
 	for (type = 0; type < DDT_TYPES; type++) {
 		for (class = 0; class <= max_class; class++) {
 			if (ddt_object_lookup(ddt, type, class, dde) == 0) {
@@ -973,6 +1124,13 @@ ddt_repair_start(ddt_t *ddt, const blkptr_t *bp)
 
 	dde = ddt_alloc(&ddk);
 
+	if (ddt_log_find(ddt, dde)) {
+		if (dde->dde_class == DDT_CLASSES ||
+		    dde->dde_class == DDT_CLASS_UNIQUE)
+			bzero(dde->dde_phys, sizeof (dde->dde_phys));
+		return (dde);
+	}
+
 	for (type = 0; type < DDT_TYPES; type++) {
 		for (class = 0; class < DDT_CLASSES; class++) {
 			/*
@@ -996,7 +1154,7 @@ ddt_repair_done(ddt_t *ddt, ddt_entry_t *dde)
 {
 	avl_index_t where;
 
-	ddt_enter(ddt);
+	mutex_enter(&ddt->ddt_repair_lock);
 
 	if (dde->dde_repair_abd != NULL && spa_writeable(ddt->ddt_spa) &&
 	    avl_find(&ddt->ddt_repair_tree, dde, &where) == NULL)
@@ -1004,7 +1162,7 @@ ddt_repair_done(ddt_t *ddt, ddt_entry_t *dde)
 	else
 		ddt_free(dde);
 
-	ddt_exit(ddt);
+	mutex_exit(&ddt->ddt_repair_lock);
 }
 
 static void
@@ -1054,22 +1212,27 @@ ddt_repair_table(ddt_t *ddt, zio_t *rio)
 	if (spa_sync_pass(spa) > 1)
 		return;
 
-	ddt_enter(ddt);
+	mutex_enter(&ddt->ddt_repair_lock);
 	for (rdde = avl_first(t); rdde != NULL; rdde = rdde_next) {
 		rdde_next = AVL_NEXT(t, rdde);
 		avl_remove(&ddt->ddt_repair_tree, rdde);
-		ddt_exit(ddt);
+		mutex_exit(&ddt->ddt_repair_lock);
 		ddt_bp_create(ddt->ddt_checksum, &rdde->dde_key, NULL, &blk);
 		dde = ddt_repair_start(ddt, &blk);
 		ddt_repair_entry(ddt, dde, rdde, rio);
 		ddt_repair_done(ddt, dde);
-		ddt_enter(ddt);
+		mutex_enter(&ddt->ddt_repair_lock);
 	}
-	ddt_exit(ddt);
+	mutex_exit(&ddt->ddt_repair_lock);
 }
 
+/*
+ * Write out a changed entry: to the dedup log if dlu is set, and to the
+ * DDT ZAPs otherwise.
+ */
 static void
-ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
+ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, ddt_log_update_t *dlu,
+    dmu_tx_t *tx, uint64_t txg)
 {
 	dsl_pool_t *dp = ddt->ddt_spa->spa_dsl_pool;
 	ddt_phys_t *ddp = dde->dde_phys;
@@ -1107,6 +1270,26 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 	else
 		nclass = DDT_CLASS_UNIQUE;
 
+	if (dlu != NULL) {
+		if (total_refcnt != 0) {
+			dde->dde_type = ntype;
+			dde->dde_class = nclass;
+			ddt_stat_update(ddt, dde, 0);
+			/*
+			 * The object is only written when the entry is
+			 * flushed, but it keeps the class's histogram.
+			 */
+			if (!ddt_object_exists(ddt, ntype, nclass))
+				ddt_object_create(ddt, ntype, nclass, tx);
+			ddt_log_entry(ddt, dlu, dde, tx);
+		} else if (otype != DDT_TYPES) {
+			dde->dde_type = DDT_TYPES;
+			dde->dde_class = DDT_CLASSES;
+			ddt_log_entry(ddt, dlu, dde, tx);
+		}
+		return;
+	}
+
 	if (otype != DDT_TYPES &&
 	    (otype != ntype || oclass != nclass || total_refcnt == 0)) {
 		VERIFY(ddt_object_remove(ddt, otype, oclass, dde, tx) == 0);
@@ -1139,12 +1322,15 @@ static void
 ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 {
 	spa_t *spa = ddt->ddt_spa;
+	ddt_log_update_t dlu, *dlup = NULL;
 	ddt_entry_t *dde;
-	void *cookie = NULL;
 	enum ddt_type type;
 	enum ddt_class class;
+	boolean_t use_log;
+	uint64_t total = 0;
+	int s;
 
-	if (avl_numnodes(&ddt->ddt_tree) == 0)
+	if (!ddt_changes_pending(ddt) && ddt_log_empty(ddt))
 		return;
 
 	ASSERT(spa->spa_uberblock.ub_version >= SPA_VERSION_DEDUP);
@@ -1155,11 +1341,35 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 		    DMU_POOL_DDT_STATS, tx);
 	}
 
-	while ((dde = avl_destroy_nodes(&ddt->ddt_tree, &cookie)) != NULL) {
-		ddt_sync_entry(ddt, dde, tx, txg);
-		ddt_free(dde);
+	/*
+	 * While there is anything in the logs, changes have to go through
+	 * them as well, or lookups would find the older logged state.
+	 */
+	use_log = (zfs_dedup_log_enabled &&
+	    spa_feature_is_enabled(spa, SPA_FEATURE_DEDUP_LOG)) ||
+	    !ddt_log_empty(ddt);
+
+	if (use_log && ddt_changes_pending(ddt)) {
+		ddt_log_begin(ddt, &dlu, tx);
+		dlup = &dlu;
+	}
+
+	for (s = 0; s < DDT_SHARDS; s++) {
+		ddt_shard_t *dsh = &ddt->ddt_shard[s];
+		void *cookie = NULL;
+
+		while ((dde = avl_destroy_nodes(&dsh->dsh_tree,
+		    &cookie)) != NULL) {
+			ddt_sync_entry(ddt, dde, dlup, tx, txg);
+			ddt_free(dde);
+		}
 	}
 
+	if (dlup != NULL)
+		ddt_log_commit(ddt, dlup, tx);
+	if (use_log)
+		ddt_log_flush(ddt, !zfs_dedup_log_enabled, tx);
+
 	for (type = 0; type < DDT_TYPES; type++) {
 		uint64_t count = 0;
 		for (class = 0; class < DDT_CLASSES; class++) {
@@ -1169,11 +1379,22 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 			}
 		}
 		for (class = 0; class < DDT_CLASSES; class++) {
-			if (count == 0 && ddt_object_exists(ddt, type, class))
+			if (count == 0 && ddt_log_empty(ddt) &&
+			    ddt_object_exists(ddt, type, class))
 				ddt_object_destroy(ddt, type, class, tx);
 		}
+		total += count;
 	}
 
+	/*
+	 * Destroy the logs once they are empty, if the DDT is empty too or
+	 * they are no longer wanted.
+	 */
+	if (ddt_log_exists(ddt) && ddt_log_empty(ddt) &&
+	    (total == 0 || !zfs_dedup_log_enabled ||
+	    !spa_feature_is_enabled(spa, SPA_FEATURE_DEDUP_LOG)))
+		ddt_log_destroy(ddt, tx);
+
 	bcopy(ddt->ddt_histogram, &ddt->ddt_histogram_cache,
 	    sizeof (ddt->ddt_histogram));
 }
@@ -1201,6 +1422,8 @@ ddt_sync(spa_t *spa, uint64_t txg)
 	(void) zio_wait(rio);
 
 	dmu_tx_commit(tx);
+
+	ddt_prune_check(spa);
 }
 
 int
@@ -1211,11 +1434,20 @@ ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde)
 			do {
 				ddt_t *ddt = spa->spa_ddt[ddb->ddb_checksum];
 				int error = ENOENT;
+				/*
+				 * Entries that are in the dedup log are
+				 * skipped; see ddt_class_contains().
+				 */
 				if (ddt_object_exists(ddt, ddb->ddb_type,
 				    ddb->ddb_class)) {
-					error = ddt_object_walk(ddt,
-					    ddb->ddb_type, ddb->ddb_class,
-					    &ddb->ddb_cursor, dde);
+					do {
+						error = ddt_object_walk(ddt,
+						    ddb->ddb_type,
+						    ddb->ddb_class,
+						    &ddb->ddb_cursor, dde);
+					} while (error == 0 &&
+					    ddt_log_contains(ddt,
+					    &dde->dde_key));
 				}
 				dde->dde_type = ddb->ddb_type;
 				dde->dde_class = ddb->ddb_class;
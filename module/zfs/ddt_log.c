@@ -0,0 +1,679 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/zio.h>
+#include <sys/ddt.h>
+#include <sys/zap.h>
+#include <sys/dmu_tx.h>
+#include <sys/dsl_pool.h>
+#include <sys/dsl_scan.h>
+#include <sys/zio_checksum.h>
+#include <sys/zfeature.h>
+
+/*
+ * Dedup log
+ *
+ * Updating the DDT ZAP objects in place costs a read-modify-write of a
+ * ZAP leaf for every entry that changes, and the leaves of a large DDT
+ * are spread all over the pool and rarely cached.  With the dedup_log
+ * feature, ddt_sync_table() instead appends the entries that changed in
+ * the txg to the DDT's active log, which is a plain sequential write,
+ * and keeps them in the log's in-core index.
+ *
+ * Once the active log is zfs_dedup_log_txg_max txgs old (or the logs
+ * take more than half of zfs_dedup_log_mem_max), and the flushing log is
+ * empty, the two swap.  The entries of the flushing log are then written
+ * to the ZAPs over about the next zfs_dedup_log_txg_max txgs, in key
+ * order, which is also the order of the ZAP leaves since the DDT ZAPs
+ * are pre-hashed.  An entry that changed again in the meantime is only
+ * flushed from the active log.  The flushing log is truncated once it is
+ * empty.
+ *
+ * While an entry is in a log, the log's copy is the current one:
+ * ddt_lookup() and ddt_repair_start() look in the logs before the ZAPs.
+ * The dedup statistics are updated when an entry is logged, but the ZAP
+ * objects, and so the entry counts of "zpool status -D", only change as
+ * entries are flushed.
+ *
+ * Scans walk the DDT ZAPs (see ddt_walk()), which skips entries that are
+ * in a log, and ddt_class_contains() says that such entries are in no
+ * class, so their blocks are visited when the scan traverses the pool.
+ * Once an entry is flushed it is visible to the walk again, so it is
+ * handed to the scan right away, as ddt_sync_entry() does when an entry
+ * moves to a lower class.
+ *
+ * When the pool is imported, ddt_log_load() reads both logs back into
+ * their indexes.  Flushing an entry is idempotent, so a flushing log
+ * that was only partly flushed is simply flushed again.
+ */
+
+/*
+ * Log changed DDT entries instead of updating the DDT ZAPs every txg.
+ * When this is turned off, the logs are flushed and then destroyed.
+ */
+int zfs_dedup_log_enabled = 1;
+
+/*
+ * Number of txgs that changes are gathered in the active log before it
+ * is flushed; the flushing log is spread over as many txgs.
+ */
+uint64_t zfs_dedup_log_txg_max = 100;
+
+/*
+ * Minimum number of entries flushed per txg.
+ */
+uint64_t zfs_dedup_log_flush_entries_min = 1000;
+
+/*
+ * Upper bound for the memory used by the indexes of the logs of a DDT.
+ * Past half of it the active log is flushed early, and past all of it
+ * the whole flushing log is flushed in one txg.
+ */
+uint64_t zfs_dedup_log_mem_max = 1ULL << 28;
+
+/*
+ * Block size of the log objects, and size of the buffer that records are
+ * gathered in before they are written.
+ */
+static int ddt_log_blksz = 1 << 17;
+
+static kmem_cache_t *ddt_log_entry_cache;
+
+static int
+ddt_log_entry_compare(const void *x1, const void *x2)
+{
+	const ddt_log_entry_t *dle1 = x1;
+	const ddt_log_entry_t *dle2 = x2;
+	const uint64_t *u1 = (const uint64_t *)&dle1->dle_key;
+	const uint64_t *u2 = (const uint64_t *)&dle2->dle_key;
+	int i;
+
+	for (i = 0; i < DDT_KEY_WORDS; i++) {
+		if (u1[i] < u2[i])
+			return (-1);
+		if (u1[i] > u2[i])
+			return (1);
+	}
+
+	return (0);
+}
+
+void
+ddt_log_init(void)
+{
+	ddt_log_entry_cache = kmem_cache_create("ddt_log_entry_cache",
+	    sizeof (ddt_log_entry_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+}
+
+void
+ddt_log_fini(void)
+{
+	kmem_cache_destroy(ddt_log_entry_cache);
+}
+
+void
+ddt_log_alloc(ddt_t *ddt)
+{
+	int n;
+
+	mutex_init(&ddt->ddt_log_lock, NULL, MUTEX_DEFAULT, NULL);
+	for (n = 0; n < 2; n++) {
+		avl_create(&ddt->ddt_log[n].ddl_tree, ddt_log_entry_compare,
+		    sizeof (ddt_log_entry_t), offsetof(ddt_log_entry_t,
+		    dle_node));
+	}
+	ddt->ddt_log_active = &ddt->ddt_log[0];
+	ddt->ddt_log_flushing = &ddt->ddt_log[1];
+}
+
+void
+ddt_log_free(ddt_t *ddt)
+{
+	ddt_log_entry_t *dle;
+	int n;
+
+	for (n = 0; n < 2; n++) {
+		ddt_log_t *ddl = &ddt->ddt_log[n];
+		void *cookie = NULL;
+
+		while ((dle = avl_destroy_nodes(&ddl->ddl_tree,
+		    &cookie)) != NULL)
+			kmem_cache_free(ddt_log_entry_cache, dle);
+		avl_destroy(&ddl->ddl_tree);
+	}
+	mutex_destroy(&ddt->ddt_log_lock);
+}
+
+static void
+ddt_log_name(ddt_t *ddt, int n, char *name)
+{
+	(void) snprintf(name, DDT_NAMELEN, DMU_POOL_DDT_LOG,
+	    zio_checksum_table[ddt->ddt_checksum].ci_name, n);
+}
+
+static uint64_t
+ddt_log_memory(ddt_t *ddt)
+{
+	return ((avl_numnodes(&ddt->ddt_log[0].ddl_tree) +
+	    avl_numnodes(&ddt->ddt_log[1].ddl_tree)) *
+	    sizeof (ddt_log_entry_t));
+}
+
+/*
+ * Make a record the latest state of its key in a log's index.
+ */
+static void
+ddt_log_update_tree(ddt_t *ddt, ddt_log_t *ddl, const ddt_log_record_t *dlr)
+{
+	ddt_log_entry_t *dle, dle_search;
+	avl_index_t where;
+
+	ASSERT(MUTEX_HELD(&ddt->ddt_log_lock));
+
+	dle_search.dle_key = dlr->dlr_key;
+	dle = avl_find(&ddl->ddl_tree, &dle_search, &where);
+	if (dle == NULL) {
+		dle = kmem_cache_alloc(ddt_log_entry_cache, KM_SLEEP);
+		dle->dle_key = dlr->dlr_key;
+		avl_insert(&ddl->ddl_tree, dle, where);
+	}
+	bcopy(dlr->dlr_phys, dle->dle_phys, sizeof (dle->dle_phys));
+	dle->dle_type = DLR_GET_TYPE(dlr);
+	dle->dle_class = DLR_GET_CLASS(dlr);
+}
+
+static void
+ddt_log_sync_phys(ddt_t *ddt, ddt_log_t *ddl, dmu_tx_t *tx)
+{
+	ddt_log_phys_t *dlp;
+	dmu_buf_t *db;
+
+	VERIFY0(dmu_bonus_hold(ddt->ddt_os, ddl->ddl_object, FTAG, &db));
+	dmu_buf_will_dirty(db, tx);
+	dlp = db->db_data;
+	dlp->dlp_length = ddl->ddl_length;
+	dlp->dlp_first_txg = ddl->ddl_first_txg;
+	dlp->dlp_flags = (ddl == ddt->ddt_log_flushing) ?
+	    DDL_FLAG_FLUSHING : 0;
+	dmu_buf_rele(db, FTAG);
+}
+
+static int
+ddt_log_replay(ddt_t *ddt, ddt_log_t *ddl)
+{
+	uint64_t chunk = (ddt_log_blksz / sizeof (ddt_log_record_t)) *
+	    sizeof (ddt_log_record_t);
+	ddt_log_record_t *buf;
+	uint64_t off, size, i;
+	int error = 0;
+
+	if (ddl->ddl_length % sizeof (ddt_log_record_t) != 0)
+		return (SET_ERROR(ECKSUM));
+
+	buf = zio_buf_alloc(ddt_log_blksz);
+	for (off = 0; off < ddl->ddl_length; off += size) {
+		size = MIN(chunk, ddl->ddl_length - off);
+		error = dmu_read(ddt->ddt_os, ddl->ddl_object, off, size, buf,
+		    DMU_READ_PREFETCH);
+		if (error != 0)
+			break;
+
+		mutex_enter(&ddt->ddt_log_lock);
+		for (i = 0; i < size / sizeof (ddt_log_record_t); i++)
+			ddt_log_update_tree(ddt, ddl, &buf[i]);
+		mutex_exit(&ddt->ddt_log_lock);
+	}
+	zio_buf_free(buf, ddt_log_blksz);
+
+	return (error);
+}
+
+/*
+ * Read the logs of a DDT, if it has any, back into their indexes.
+ */
+int
+ddt_log_load(ddt_t *ddt)
+{
+	char name[DDT_NAMELEN];
+	boolean_t flushing[2];
+	int error, n;
+
+	for (n = 0; n < 2; n++) {
+		ddt_log_t *ddl = &ddt->ddt_log[n];
+		ddt_log_phys_t *dlp;
+		dmu_buf_t *db;
+
+		ddt_log_name(ddt, n, name);
+		error = zap_lookup(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT, name,
+		    sizeof (uint64_t), 1, &ddl->ddl_object);
+		if (error == ENOENT && n == 0)
+			return (0);
+		if (error != 0)
+			return (error);
+
+		error = dmu_bonus_hold(ddt->ddt_os, ddl->ddl_object, FTAG, &db);
+		if (error != 0)
+			return (error);
+		dlp = db->db_data;
+		ddl->ddl_length = dlp->dlp_length;
+		ddl->ddl_first_txg = dlp->dlp_first_txg;
+		flushing[n] = !!(dlp->dlp_flags & DDL_FLAG_FLUSHING);
+		dmu_buf_rele(db, FTAG);
+
+		error = ddt_log_replay(ddt, ddl);
+		if (error != 0)
+			return (error);
+	}
+
+	if (flushing[0]) {
+		ddt->ddt_log_active = &ddt->ddt_log[1];
+		ddt->ddt_log_flushing = &ddt->ddt_log[0];
+	}
+	ddt->ddt_log_flush_rate = MAX(zfs_dedup_log_flush_entries_min,
+	    avl_numnodes(&ddt->ddt_log_flushing->ddl_tree) /
+	    MAX(zfs_dedup_log_txg_max, 1));
+
+	zfs_dbgmsg("spa %s: replayed %llu %s dedup log entries",
+	    spa_name(ddt->ddt_spa),
+	    (u_longlong_t)(avl_numnodes(&ddt->ddt_log[0].ddl_tree) +
+	    avl_numnodes(&ddt->ddt_log[1].ddl_tree)),
+	    zio_checksum_table[ddt->ddt_checksum].ci_name);
+
+	return (0);
+}
+
+boolean_t
+ddt_log_exists(ddt_t *ddt)
+{
+	return (ddt->ddt_log[0].ddl_object != 0);
+}
+
+boolean_t
+ddt_log_empty(ddt_t *ddt)
+{
+	boolean_t empty;
+
+	mutex_enter(&ddt->ddt_log_lock);
+	empty = (avl_numnodes(&ddt->ddt_log[0].ddl_tree) == 0 &&
+	    avl_numnodes(&ddt->ddt_log[1].ddl_tree) == 0);
+	mutex_exit(&ddt->ddt_log_lock);
+
+	return (empty);
+}
+
+/*
+ * Number of keys in the logs, tombstones included.
+ */
+uint64_t
+ddt_log_count(ddt_t *ddt)
+{
+	uint64_t count;
+
+	mutex_enter(&ddt->ddt_log_lock);
+	count = avl_numnodes(&ddt->ddt_log[0].ddl_tree) +
+	    avl_numnodes(&ddt->ddt_log[1].ddl_tree);
+	mutex_exit(&ddt->ddt_log_lock);
+
+	return (count);
+}
+
+static ddt_log_entry_t *
+ddt_log_lookup(ddt_t *ddt, const ddt_key_t *ddk)
+{
+	ddt_log_entry_t *dle, dle_search;
+
+	ASSERT(MUTEX_HELD(&ddt->ddt_log_lock));
+
+	dle_search.dle_key = *ddk;
+	dle = avl_find(&ddt->ddt_log_active->ddl_tree, &dle_search, NULL);
+	if (dle == NULL) {
+		dle = avl_find(&ddt->ddt_log_flushing->ddl_tree, &dle_search,
+		    NULL);
+	}
+
+	return (dle);
+}
+
+/*
+ * Whether an entry, or its tombstone, is in a log.
+ */
+boolean_t
+ddt_log_contains(ddt_t *ddt, const ddt_key_t *ddk)
+{
+	boolean_t found;
+
+	mutex_enter(&ddt->ddt_log_lock);
+	found = (ddt_log_lookup(ddt, ddk) != NULL);
+	mutex_exit(&ddt->ddt_log_lock);
+
+	return (found);
+}
+
+/*
+ * Fill in an entry from the logs, if it's there.  If the entry was
+ * removed, its type and class are set to DDT_TYPES and DDT_CLASSES.
+ */
+boolean_t
+ddt_log_find(ddt_t *ddt, ddt_entry_t *dde)
+{
+	ddt_log_entry_t *dle;
+
+	mutex_enter(&ddt->ddt_log_lock);
+	dle = ddt_log_lookup(ddt, &dde->dde_key);
+	if (dle != NULL) {
+		if (dle->dle_class == DDT_CLASSES) {
+			bzero(dde->dde_phys, sizeof (dde->dde_phys));
+			dde->dde_type = DDT_TYPES;
+			dde->dde_class = DDT_CLASSES;
+		} else {
+			bcopy(dle->dle_phys, dde->dde_phys,
+			    sizeof (dde->dde_phys));
+			dde->dde_type = dle->dle_type;
+			dde->dde_class = dle->dle_class;
+		}
+	}
+	mutex_exit(&ddt->ddt_log_lock);
+
+	return (dle != NULL);
+}
+
+static void
+ddt_log_walk_entry(ddt_t *ddt, const ddt_log_entry_t *dle,
+    ddt_log_walk_func_t *func, void *arg)
+{
+	ddt_entry_t dde;
+
+	bzero(&dde, sizeof (dde));
+	dde.dde_key = dle->dle_key;
+	bcopy(dle->dle_phys, dde.dde_phys, sizeof (dde.dde_phys));
+	dde.dde_type = dle->dle_type;
+	dde.dde_class = dle->dle_class;
+	func(arg, ddt, &dde);
+}
+
+/*
+ * Call func on the latest state of every entry in the logs, except for
+ * removed entries.  The logs must not change during the walk, so this is
+ * only for zdb, which needs the entries that ddt_walk() skips.
+ */
+void
+ddt_log_walk(ddt_t *ddt, ddt_log_walk_func_t *func, void *arg)
+{
+	avl_tree_t *active = &ddt->ddt_log_active->ddl_tree;
+	avl_tree_t *flushing = &ddt->ddt_log_flushing->ddl_tree;
+	ddt_log_entry_t *dle;
+
+	for (dle = avl_first(active); dle != NULL;
+	    dle = AVL_NEXT(active, dle)) {
+		if (dle->dle_class != DDT_CLASSES)
+			ddt_log_walk_entry(ddt, dle, func, arg);
+	}
+
+	for (dle = avl_first(flushing); dle != NULL;
+	    dle = AVL_NEXT(flushing, dle)) {
+		if (dle->dle_class != DDT_CLASSES &&
+		    avl_find(active, dle, NULL) == NULL)
+			ddt_log_walk_entry(ddt, dle, func, arg);
+	}
+}
+
+static void
+ddt_log_create(ddt_t *ddt, dmu_tx_t *tx)
+{
+	char name[DDT_NAMELEN];
+	int n;
+
+	for (n = 0; n < 2; n++) {
+		ddt_log_t *ddl = &ddt->ddt_log[n];
+
+		ASSERT0(ddl->ddl_object);
+		ddl->ddl_object = dmu_object_alloc(ddt->ddt_os,
+		    DMU_OTN_UINT64_METADATA, ddt_log_blksz,
+		    DMU_OTN_UINT64_METADATA, sizeof (ddt_log_phys_t), tx);
+
+		ddt_log_name(ddt, n, name);
+		VERIFY0(zap_add(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT, name,
+		    sizeof (uint64_t), 1, &ddl->ddl_object, tx));
+	}
+
+	spa_feature_incr(ddt->ddt_spa, SPA_FEATURE_DEDUP_LOG, tx);
+}
+
+/*
+ * Destroy the logs of a DDT once they are empty and no longer needed.
+ */
+void
+ddt_log_destroy(ddt_t *ddt, dmu_tx_t *tx)
+{
+	char name[DDT_NAMELEN];
+	int n;
+
+	ASSERT(ddt_log_empty(ddt));
+
+	for (n = 0; n < 2; n++) {
+		ddt_log_t *ddl = &ddt->ddt_log[n];
+
+		ddt_log_name(ddt, n, name);
+		VERIFY0(zap_remove(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT, name,
+		    tx));
+		VERIFY0(dmu_object_free(ddt->ddt_os, ddl->ddl_object, tx));
+		ddl->ddl_object = 0;
+		ddl->ddl_length = 0;
+		ddl->ddl_first_txg = 0;
+	}
+	ddt->ddt_log_active = &ddt->ddt_log[0];
+	ddt->ddt_log_flushing = &ddt->ddt_log[1];
+
+	spa_feature_decr(ddt->ddt_spa, SPA_FEATURE_DEDUP_LOG, tx);
+}
+
+void
+ddt_log_begin(ddt_t *ddt, ddt_log_update_t *dlu, dmu_tx_t *tx)
+{
+	if (!ddt_log_exists(ddt))
+		ddt_log_create(ddt, tx);
+
+	dlu->dlu_buf = zio_buf_alloc(ddt_log_blksz);
+	dlu->dlu_max = ddt_log_blksz / sizeof (ddt_log_record_t);
+	dlu->dlu_count = 0;
+	dlu->dlu_appended = 0;
+}
+
+static void
+ddt_log_write(ddt_t *ddt, ddt_log_update_t *dlu, dmu_tx_t *tx)
+{
+	ddt_log_t *ddl = ddt->ddt_log_active;
+	uint64_t size = dlu->dlu_count * sizeof (ddt_log_record_t);
+
+	dmu_write(ddt->ddt_os, ddl->ddl_object, ddl->ddl_length, size,
+	    dlu->dlu_buf, tx);
+	ddl->ddl_length += size;
+	dlu->dlu_count = 0;
+}
+
+/*
+ * Append the state of a changed entry to the active log.  An entry whose
+ * type and class are DDT_TYPES and DDT_CLASSES was removed.
+ */
+void
+ddt_log_entry(ddt_t *ddt, ddt_log_update_t *dlu, ddt_entry_t *dde,
+    dmu_tx_t *tx)
+{
+	ddt_log_t *ddl = ddt->ddt_log_active;
+	ddt_log_record_t *dlr = &dlu->dlu_buf[dlu->dlu_count++];
+
+	dlr->dlr_key = dde->dde_key;
+	dlr->dlr_info = 0;
+	DLR_SET_TYPE(dlr, dde->dde_type);
+	DLR_SET_CLASS(dlr, dde->dde_class);
+	bcopy(dde->dde_phys, dlr->dlr_phys, sizeof (dlr->dlr_phys));
+
+	mutex_enter(&ddt->ddt_log_lock);
+	ddt_log_update_tree(ddt, ddl, dlr);
+	mutex_exit(&ddt->ddt_log_lock);
+
+	if (ddl->ddl_first_txg == 0)
+		ddl->ddl_first_txg = dmu_tx_get_txg(tx);
+	dlu->dlu_appended++;
+
+	if (dlu->dlu_count == dlu->dlu_max)
+		ddt_log_write(ddt, dlu, tx);
+}
+
+void
+ddt_log_commit(ddt_t *ddt, ddt_log_update_t *dlu, dmu_tx_t *tx)
+{
+	if (dlu->dlu_count != 0)
+		ddt_log_write(ddt, dlu, tx);
+	if (dlu->dlu_appended != 0)
+		ddt_log_sync_phys(ddt, ddt->ddt_log_active, tx);
+
+	zio_buf_free(dlu->dlu_buf, ddt_log_blksz);
+	dlu->dlu_buf = NULL;
+}
+
+/*
+ * Write a logged entry to the ZAPs, moving or removing the ZAP entry
+ * that it replaces.  dde is scratch space.
+ */
+static void
+ddt_log_flush_entry(ddt_t *ddt, const ddt_log_entry_t *dle,
+    ddt_entry_t *dde, dmu_tx_t *tx)
+{
+	dsl_pool_t *dp = ddt->ddt_spa->spa_dsl_pool;
+	enum ddt_type type;
+	enum ddt_class class;
+	int error = ENOENT;
+
+	dde->dde_key = dle->dle_key;
+
+	for (type = 0; type < DDT_TYPES; type++) {
+		for (class = 0; class < DDT_CLASSES; class++) {
+			error = ddt_object_lookup(ddt, type, class, dde);
+			if (error != ENOENT)
+				break;
+		}
+		if (error != ENOENT)
+			break;
+	}
+
+	ASSERT(error == 0 || error == ENOENT);
+
+	if (error == 0 && (dle->dle_class == DDT_CLASSES ||
+	    type != dle->dle_type || class != dle->dle_class))
+		VERIFY0(ddt_object_remove(ddt, type, class, dde, tx));
+
+	if (dle->dle_class == DDT_CLASSES)
+		return;
+
+	bcopy(dle->dle_phys, dde->dde_phys, sizeof (dde->dde_phys));
+	dde->dde_type = dle->dle_type;
+	dde->dde_class = dle->dle_class;
+	VERIFY0(ddt_object_update(ddt, dde->dde_type, dde->dde_class, dde,
+	    tx));
+
+	/*
+	 * ddt_walk() didn't see the entry while it was logged; hand it to
+	 * the scan in case the walk is already past it.
+	 */
+	dsl_scan_ddt_entry(dp->dp_scan, ddt->ddt_checksum, dde, tx);
+}
+
+/*
+ * Flush a batch of the flushing log to the ZAPs, swapping the logs first
+ * if the flushing log is empty and the active log is due.  If 'all' is
+ * set, everything is flushed, which takes two txgs when both logs have
+ * entries.
+ */
+void
+ddt_log_flush(ddt_t *ddt, boolean_t all, dmu_tx_t *tx)
+{
+	uint64_t txg = dmu_tx_get_txg(tx);
+	ddt_log_t *active = ddt->ddt_log_active;
+	ddt_log_t *ddl = ddt->ddt_log_flushing;
+	ddt_log_entry_t *dle;
+	ddt_entry_t *dde;
+	uint64_t count, n;
+	boolean_t skip;
+
+	if (avl_numnodes(&ddl->ddl_tree) == 0) {
+		if (avl_numnodes(&active->ddl_tree) == 0)
+			return;
+		if (!all && txg < active->ddl_first_txg +
+		    zfs_dedup_log_txg_max &&
+		    ddt_log_memory(ddt) < zfs_dedup_log_mem_max / 2)
+			return;
+
+		mutex_enter(&ddt->ddt_log_lock);
+		ddt->ddt_log_active = ddl;
+		ddt->ddt_log_flushing = active;
+		mutex_exit(&ddt->ddt_log_lock);
+		ddt_log_sync_phys(ddt, ddl, tx);
+		ddt_log_sync_phys(ddt, active, tx);
+
+		ddl = ddt->ddt_log_flushing;
+		active = ddt->ddt_log_active;
+		ddt->ddt_log_flush_rate = MAX(zfs_dedup_log_flush_entries_min,
+		    avl_numnodes(&ddl->ddl_tree) /
+		    MAX(zfs_dedup_log_txg_max, 1));
+	}
+
+	if (all || ddt_log_memory(ddt) >= zfs_dedup_log_mem_max)
+		count = UINT64_MAX;
+	else
+		count = ddt->ddt_log_flush_rate;
+
+	dde = kmem_zalloc(sizeof (ddt_entry_t), KM_SLEEP);
+
+	for (n = 0; n < count; n++) {
+		mutex_enter(&ddt->ddt_log_lock);
+		dle = avl_first(&ddl->ddl_tree);
+		skip = (dle != NULL &&
+		    avl_find(&active->ddl_tree, dle, NULL) != NULL);
+		mutex_exit(&ddt->ddt_log_lock);
+		if (dle == NULL)
+			break;
+
+		/*
+		 * Only this thread removes entries, so dle stays valid.
+		 */
+		if (!skip)
+			ddt_log_flush_entry(ddt, dle, dde, tx);
+
+		mutex_enter(&ddt->ddt_log_lock);
+		avl_remove(&ddl->ddl_tree, dle);
+		mutex_exit(&ddt->ddt_log_lock);
+		kmem_cache_free(ddt_log_entry_cache, dle);
+	}
+
+	kmem_free(dde, sizeof (ddt_entry_t));
+
+	if (avl_numnodes(&ddl->ddl_tree) == 0 && ddl->ddl_length != 0) {
+		VERIFY0(dmu_free_range(ddt->ddt_os, ddl->ddl_object, 0,
+		    DMU_OBJECT_END, tx));
+		ddl->ddl_length = 0;
+		ddl->ddl_first_txg = 0;
+		ddt_log_sync_phys(ddt, ddl, tx);
+	}
+}
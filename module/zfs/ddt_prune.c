@@ -0,0 +1,451 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/zio.h>
+#include <sys/ddt.h>
+#include <sys/dmu_tx.h>
+#include <sys/dsl_synctask.h>
+
+/*
+ * DDT pruning
+ *
+ * Most entries of a large DDT are usually unique (a refcount of 1) and
+ * stay that way, costing memory and I/O without ever saving any space.
+ * Pruning removes the oldest unique entries, by birth txg, from the DDT
+ * without freeing their blocks.  Such a block is then an ordinary block
+ * that happens to have the dedup bit set: zio_ddt_free() frees it
+ * directly when it finds no entry for it, and a new write of the same
+ * data simply gets a new entry.
+ *
+ * Entries are pruned on request ("zpool ddtprune"), or by the async
+ * thread when the DDT has more entries than the pool's "dedupmaxentries"
+ * property allows, down to zfs_dedup_prune_target_pct percent of the
+ * limit.  While the DDT is at or over its limit, blocks that aren't in
+ * it yet are written without dedup (see zio_ddt_write()), so the limit
+ * holds even if there is nothing left to prune.
+ *
+ * The candidates are found in open context by walking the unique DDT
+ * objects twice: first to build a histogram of their birth txgs, which
+ * gives the birth txg up to which entries are pruned, and then to collect
+ * them.  They are pruned a batch at a time by a sync task, which skips
+ * any entry that has changed since it was collected.
+ */
+
+/*
+ * Number of entries pruned by each sync task.
+ */
+int zfs_dedup_prune_batch = 8192;
+
+/*
+ * Percentage of the "dedupmaxentries" limit that the DDT is pruned down
+ * to once it is over the limit.
+ */
+int zfs_dedup_prune_target_pct = 90;
+
+/*
+ * Minimum number of seconds between two automatic prunes, so that a DDT
+ * that stays over its limit because it has few unique entries isn't
+ * walked every txg.
+ */
+#define	DDT_PRUNE_INTERVAL	60
+
+#define	DDT_PRUNE_BUCKETS	256
+#define	DDT_PRUNE_BUCKET(birth, txg)	\
+	MIN((birth) * DDT_PRUNE_BUCKETS / ((txg) + 1), DDT_PRUNE_BUCKETS - 1)
+
+typedef struct ddt_prune_key {
+	ddt_key_t	dpk_key;
+	uint64_t	dpk_birth;
+} ddt_prune_key_t;
+
+/*
+ * A batch of entries of one DDT to prune in a sync task.
+ */
+typedef struct ddt_prune_arg {
+	ddt_t		*dpa_ddt;
+	ddt_prune_key_t	*dpa_keys;
+	uint64_t	dpa_count;
+	uint64_t	dpa_max;
+	uint64_t	dpa_pruned;
+} ddt_prune_arg_t;
+
+typedef struct ddt_pruner {
+	spa_t		*dpr_spa;
+	uint64_t	dpr_txg;	/* txg the histogram is scaled to */
+	uint64_t	*dpr_hist;	/* unique entries by birth bucket */
+	uint64_t	dpr_cutoff;	/* last bucket to prune from */
+	uint64_t	dpr_wanted;	/* entries still to collect */
+	uint64_t	dpr_pruned;
+	int		dpr_error;
+	ddt_prune_arg_t	dpr_batch;
+} ddt_pruner_t;
+
+typedef boolean_t ddt_prune_func_t(ddt_pruner_t *dpr, ddt_t *ddt,
+    const ddt_entry_t *dde, uint64_t birth);
+
+/*
+ * Return the birth txg of an entry that can be pruned: one with a single
+ * copy of its block and a refcount of 1.  Return 0 for any other entry.
+ */
+static uint64_t
+ddt_prune_birth(const ddt_entry_t *dde)
+{
+	const ddt_phys_t *ddp = dde->dde_phys;
+	uint64_t birth = 0;
+	int p;
+
+	for (p = 0; p < DDT_PHYS_TYPES; p++, ddp++) {
+		if (ddp->ddp_phys_birth == 0)
+			continue;
+		if (birth != 0 || p == DDT_PHYS_DITTO || ddp->ddp_refcnt != 1)
+			return (0);
+		birth = ddp->ddp_phys_birth;
+	}
+
+	return (birth);
+}
+
+/*
+ * Count the entries of all of the pool's DDTs, as of the last txg synced.
+ */
+static void
+ddt_prune_count(spa_t *spa, uint64_t *entries, uint64_t *unique)
+{
+	enum zio_checksum c;
+	enum ddt_type type;
+	enum ddt_class class;
+	ddt_stat_t dds;
+
+	*entries = 0;
+	*unique = 0;
+
+	for (c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ddt_t *ddt = spa->spa_ddt[c];
+		if (ddt == NULL)
+			continue;
+		for (type = 0; type < DDT_TYPES; type++) {
+			for (class = 0; class < DDT_CLASSES; class++) {
+				ddt_histogram_stat(&dds,
+				    &ddt->ddt_histogram_cache[type][class]);
+				*entries += dds.dds_blocks;
+				if (class == DDT_CLASS_UNIQUE)
+					*unique += dds.dds_blocks;
+			}
+		}
+	}
+}
+
+static boolean_t
+ddt_prune_stopping(spa_t *spa)
+{
+	return (spa->spa_async_suspended != 0 || spa_suspended(spa));
+}
+
+static void
+ddt_prune_sync(void *arg, dmu_tx_t *tx)
+{
+	ddt_prune_arg_t *dpa = arg;
+	ddt_t *ddt = dpa->dpa_ddt;
+	uint64_t i;
+	int p;
+
+	for (i = 0; i < dpa->dpa_count; i++) {
+		ddt_prune_key_t *dpk = &dpa->dpa_keys[i];
+		ddt_entry_t *dde;
+		blkptr_t blk;
+
+		ddt_bp_create(ddt->ddt_checksum, &dpk->dpk_key, NULL, &blk);
+		ddt_enter(ddt, &blk.blk_cksum);
+		dde = ddt_lookup(ddt, &blk, B_TRUE);
+
+		for (p = 0; p < DDT_PHYS_TYPES; p++) {
+			if (dde->dde_lead_zio[p] != NULL)
+				break;
+		}
+
+		/*
+		 * Clearing the entry without freeing its block leaves the
+		 * block to whoever references it; ddt_sync_entry() then
+		 * removes the entry.
+		 */
+		if (p == DDT_PHYS_TYPES &&
+		    ddt_prune_birth(dde) == dpk->dpk_birth) {
+			for (p = 0; p < DDT_PHYS_TYPES; p++)
+				ddt_phys_clear(&dde->dde_phys[p]);
+			dpa->dpa_pruned++;
+		}
+
+		ddt_exit(ddt, &blk.blk_cksum);
+	}
+}
+
+static int
+ddt_prune_batch(ddt_pruner_t *dpr)
+{
+	ddt_prune_arg_t *dpa = &dpr->dpr_batch;
+	spa_t *spa = dpr->dpr_spa;
+	int error = 0;
+
+	if (dpa->dpa_count == 0)
+		return (0);
+
+	dpa->dpa_pruned = 0;
+	error = dsl_sync_task(spa_name(spa), NULL, ddt_prune_sync, dpa,
+	    0, ZFS_SPACE_CHECK_NONE);
+	dpa->dpa_count = 0;
+
+	dpr->dpr_pruned += dpa->dpa_pruned;
+	mutex_enter(&spa->spa_ddt_prune_lock);
+	spa->spa_ddt_pruned += dpa->dpa_pruned;
+	mutex_exit(&spa->spa_ddt_prune_lock);
+
+	return (error);
+}
+
+/*
+ * Call func for every prunable entry in the DDT objects, until it returns
+ * B_TRUE or the pool is being exported.
+ */
+static int
+ddt_prune_walk(ddt_pruner_t *dpr, ddt_prune_func_t *func)
+{
+	spa_t *spa = dpr->dpr_spa;
+	ddt_entry_t *dde;
+	enum zio_checksum c;
+	enum ddt_type type;
+	int error = 0;
+
+	dde = kmem_zalloc(sizeof (ddt_entry_t), KM_SLEEP);
+
+	for (c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ddt_t *ddt = spa->spa_ddt[c];
+		if (ddt == NULL)
+			continue;
+		for (type = 0; type < DDT_TYPES; type++) {
+			uint64_t walk = 0;
+			uint64_t birth;
+
+			while (ddt_object_exists(ddt, type,
+			    DDT_CLASS_UNIQUE)) {
+				if (ddt_prune_stopping(spa)) {
+					error = SET_ERROR(EINTR);
+					goto out;
+				}
+				error = ddt_object_walk(ddt, type,
+				    DDT_CLASS_UNIQUE, &walk, dde);
+				if (error == ENOENT) {
+					error = 0;
+					break;
+				}
+				if (error != 0)
+					goto out;
+				birth = ddt_prune_birth(dde);
+				if (birth != 0 && func(dpr, ddt, dde, birth))
+					goto out;
+			}
+		}
+	}
+out:
+	kmem_free(dde, sizeof (ddt_entry_t));
+	return (error);
+}
+
+static boolean_t
+ddt_prune_histogram(ddt_pruner_t *dpr, ddt_t *ddt,
+    const ddt_entry_t *dde, uint64_t birth)
+{
+	dpr->dpr_hist[DDT_PRUNE_BUCKET(birth, dpr->dpr_txg)]++;
+	return (B_FALSE);
+}
+
+static boolean_t
+ddt_prune_collect(ddt_pruner_t *dpr, ddt_t *ddt,
+    const ddt_entry_t *dde, uint64_t birth)
+{
+	ddt_prune_arg_t *dpa = &dpr->dpr_batch;
+	ddt_prune_key_t *dpk;
+
+	if (DDT_PRUNE_BUCKET(birth, dpr->dpr_txg) > dpr->dpr_cutoff)
+		return (B_FALSE);
+
+	if (dpa->dpa_ddt != ddt || dpa->dpa_count == dpa->dpa_max) {
+		dpr->dpr_error = ddt_prune_batch(dpr);
+		if (dpr->dpr_error != 0)
+			return (B_TRUE);
+		dpa->dpa_ddt = ddt;
+	}
+
+	dpk = &dpa->dpa_keys[dpa->dpa_count++];
+	dpk->dpk_key = dde->dde_key;
+	dpk->dpk_birth = birth;
+
+	return (--dpr->dpr_wanted == 0);
+}
+
+/*
+ * Prune up to 'count' of the oldest unique entries of the pool's DDTs.
+ */
+static int
+ddt_prune_impl(spa_t *spa, uint64_t count, uint64_t *pruned)
+{
+	ddt_pruner_t dpr;
+	ddt_prune_arg_t *dpa = &dpr.dpr_batch;
+	uint64_t sum;
+	int error;
+
+	*pruned = 0;
+
+	if (!spa_writeable(spa))
+		return (SET_ERROR(EROFS));
+
+	mutex_enter(&spa->spa_ddt_prune_lock);
+	if (spa->spa_ddt_pruning) {
+		mutex_exit(&spa->spa_ddt_prune_lock);
+		return (SET_ERROR(EBUSY));
+	}
+	spa->spa_ddt_pruning = B_TRUE;
+	mutex_exit(&spa->spa_ddt_prune_lock);
+
+	bzero(&dpr, sizeof (dpr));
+	dpr.dpr_spa = spa;
+	dpr.dpr_txg = spa_last_synced_txg(spa);
+	dpr.dpr_wanted = count;
+	dpr.dpr_hist = kmem_zalloc(DDT_PRUNE_BUCKETS * sizeof (uint64_t),
+	    KM_SLEEP);
+	dpa->dpa_max = MAX(zfs_dedup_prune_batch, 1);
+	dpa->dpa_keys = kmem_alloc(dpa->dpa_max * sizeof (ddt_prune_key_t),
+	    KM_SLEEP);
+
+	error = (count == 0) ? 0 : ddt_prune_walk(&dpr, ddt_prune_histogram);
+
+	if (error == 0 && count != 0) {
+		for (sum = 0; dpr.dpr_cutoff < DDT_PRUNE_BUCKETS - 1;
+		    dpr.dpr_cutoff++) {
+			sum += dpr.dpr_hist[dpr.dpr_cutoff];
+			if (sum >= count)
+				break;
+		}
+		error = ddt_prune_walk(&dpr, ddt_prune_collect);
+		if (error == 0)
+			error = dpr.dpr_error;
+		if (error == 0)
+			error = ddt_prune_batch(&dpr);
+	}
+
+	kmem_free(dpa->dpa_keys, dpa->dpa_max * sizeof (ddt_prune_key_t));
+	kmem_free(dpr.dpr_hist, DDT_PRUNE_BUCKETS * sizeof (uint64_t));
+
+	mutex_enter(&spa->spa_ddt_prune_lock);
+	spa->spa_ddt_pruning = B_FALSE;
+	spa->spa_ddt_prune_time = gethrestime_sec();
+	mutex_exit(&spa->spa_ddt_prune_lock);
+
+	*pruned = dpr.dpr_pruned;
+
+	return (error);
+}
+
+/*
+ * Prune the oldest 'percent' percent of the unique entries.
+ */
+int
+ddt_prune(spa_t *spa, uint64_t percent, uint64_t *pruned)
+{
+	uint64_t entries, unique;
+
+	if (percent == 0 || percent > 100)
+		return (SET_ERROR(EINVAL));
+
+	ddt_prune_count(spa, &entries, &unique);
+
+	return (ddt_prune_impl(spa, unique / 100 * percent +
+	    unique % 100 * percent / 100, pruned));
+}
+
+/*
+ * Called by the async thread once the DDT is over its limit.
+ */
+void
+ddt_prune_auto(spa_t *spa)
+{
+	uint64_t max = spa->spa_dedup_max_entries;
+	uint64_t entries, unique, target, pruned;
+
+	if (max == 0)
+		return;
+
+	ddt_prune_count(spa, &entries, &unique);
+	if (entries <= max)
+		return;
+
+	target = max / 100 * zfs_dedup_prune_target_pct +
+	    max % 100 * zfs_dedup_prune_target_pct / 100;
+
+	(void) ddt_prune_impl(spa, MIN(entries - target, unique), &pruned);
+}
+
+/*
+ * Called at the end of ddt_sync(): note whether the DDT is at its limit,
+ * and have it pruned if it is over.
+ */
+void
+ddt_prune_check(spa_t *spa)
+{
+	uint64_t max = spa->spa_dedup_max_entries;
+	uint64_t entries, unique;
+
+	if (max == 0) {
+		spa->spa_dedup_full = B_FALSE;
+		return;
+	}
+
+	ddt_prune_count(spa, &entries, &unique);
+	spa->spa_dedup_full = (entries >= max);
+
+	if (entries > max && unique != 0 && !spa->spa_ddt_pruning &&
+	    gethrestime_sec() >= spa->spa_ddt_prune_time + DDT_PRUNE_INTERVAL)
+		spa_async_request(spa, SPA_ASYNC_DDT_PRUNE);
+}
+
+void
+ddt_get_prune_stats(spa_t *spa, ddt_prune_stat_t *dps)
+{
+	enum zio_checksum c;
+
+	bzero(dps, sizeof (*dps));
+
+	dps->dps_max_entries = spa->spa_dedup_max_entries;
+	ddt_prune_count(spa, &dps->dps_entries, &dps->dps_unique);
+	dps->dps_bypassed = spa->spa_dedup_bypassed;
+
+	for (c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		if (spa->spa_ddt[c] != NULL)
+			dps->dps_logged += ddt_log_count(spa->spa_ddt[c]);
+	}
+
+	mutex_enter(&spa->spa_ddt_prune_lock);
+	dps->dps_pruned = spa->spa_ddt_pruned;
+	dps->dps_prune_time = spa->spa_ddt_prune_time;
+	mutex_exit(&spa->spa_ddt_prune_lock);
+}
@@ -475,6 +475,7 @@ dmu_buf_hold_array_by_dnode(dnode_t *dn, uint64_t offset, uint64_t length,
 	uint32_t dbuf_flags;
 	int err;
 	zio_t *zio;
+	zfetch_access_t access = ZFETCH_ACCESS_CACHED;
 
 	ASSERT(length <= DMU_MAX_ACCESS);
 
@@ -517,15 +518,29 @@ dmu_buf_hold_array_by_dnode(dnode_t *dn, uint64_t offset, uint64_t length,
 			return (SET_ERROR(EIO));
 		}
 		/* initiate async i/o */
-		if (read)
-			(void) dbuf_read(db, zio, dbuf_flags);
+		if (read) {
+			zfetch_access_t a = ZFETCH_ACCESS_UNKNOWN;
+
+			(void) dbuf_read_access(db, zio, dbuf_flags, &a);
+
+			/*
+			 * Report the access as a whole by its worst block:
+			 * one still in flight, then one that had to be read.
+			 */
+			if (access != ZFETCH_ACCESS_INFLIGHT &&
+			    (a == ZFETCH_ACCESS_INFLIGHT ||
+			    a == ZFETCH_ACCESS_MISS ||
+			    access == ZFETCH_ACCESS_CACHED))
+				access = a;
+		}
 		dbp[i] = &db->db;
 	}
 
 	if ((flags & DMU_READ_NO_PREFETCH) == 0 &&
 	    DNODE_META_IS_CACHEABLE(dn) && length <= zfetch_array_rd_sz) {
 		dmu_zfetch(&dn->dn_zfetch, blkid, nblks,
-		    read && DNODE_IS_CACHEABLE(dn));
+		    read && DNODE_IS_CACHEABLE(dn),
+		    read ? access : ZFETCH_ACCESS_UNKNOWN);
 	}
 	rw_exit(&dn->dn_struct_rwlock);
 
@@ -677,6 +692,72 @@ dmu_prefetch(objset_t *os, uint64_t object, int64_t level, uint64_t offset,
 	dnode_rele(dn, FTAG);
 }
 
+/*
+ * Blocks that dmu_prefetch_hint() issues reads for between drops of
+ * dn_struct_rwlock.
+ */
+int dmu_prefetch_hint_batch = 64;
+
+/*
+ * Prefetch the data of an object on behalf of an application that knows
+ * what it will read next.  Reads are issued for the blocks from offset
+ * through offset + len (or to the end of the object if len is zero), up
+ * to at most budget bytes.  If dropbehind is set, the blocks are admitted
+ * at the cold end of the ARC, like those of a long sequential stream, so
+ * that they are evicted soon after being read unless they are read again.
+ * The reads are children of pio, if given, which completes once they
+ * are all done.
+ *
+ * The number of bytes for which reads were issued is returned in *issued.
+ */
+int
+dmu_prefetch_hint(objset_t *os, uint64_t object, uint64_t offset,
+    uint64_t len, zio_priority_t pri, uint64_t budget, boolean_t dropbehind,
+    zio_t *pio, uint64_t *issued)
+{
+	dnode_t *dn;
+	arc_flags_t aflags = dropbehind ? ARC_FLAG_STREAMING : 0;
+	uint64_t blksz, size, end, blkid, nblks, i;
+	int batch = MAX(dmu_prefetch_hint_batch, 1);
+	int err;
+
+	*issued = 0;
+
+	err = dnode_hold(os, object, FTAG, &dn);
+	if (err != 0)
+		return (err);
+
+	rw_enter(&dn->dn_struct_rwlock, RW_READER);
+	blksz = dn->dn_datablksz;
+	size = (dn->dn_maxblkid + 1) * blksz;
+	if (offset < size) {
+		end = (len == 0 || len > size - offset) ? size : offset + len;
+		blkid = dbuf_whichblock(dn, 0, offset);
+		nblks = dbuf_whichblock(dn, 0, end - 1) - blkid + 1;
+		nblks = MIN(nblks, budget / blksz);
+
+		/*
+		 * Let writers to the object in between batches, and stop
+		 * if the block size changed meanwhile.
+		 */
+		for (i = 0; i < nblks; i++) {
+			if (i != 0 && i % batch == 0) {
+				rw_exit(&dn->dn_struct_rwlock);
+				rw_enter(&dn->dn_struct_rwlock, RW_READER);
+				if (dn->dn_datablksz != blksz)
+					break;
+			}
+			dbuf_prefetch_impl(dn, 0, blkid + i, pri, aflags, pio);
+		}
+		*issued = i * blksz;
+	}
+	rw_exit(&dn->dn_struct_rwlock);
+
+	dnode_rele(dn, FTAG);
+
+	return (0);
+}
+
 /*
  * Get the next "chunk" of file data to free.  We traverse the file from
  * the end so that the file gets shorter over time (if we crashes in the
@@ -2450,6 +2531,8 @@ dmu_write_policy(objset_t *os, dnode_t *dn, int level, int wp, zio_prop_t *zp)
 	zp->zp_type = (wp & WP_SPILL) ? dn->dn_bonustype : type;
 	zp->zp_level = level;
 	zp->zp_copies = MIN(copies, spa_max_replication(os->os_spa));
+	zp->zp_zpl_smallblk = DMU_OT_IS_FILE(zp->zp_type) ?
+	    os->os_zpl_special_smallblock : 0;
 	zp->zp_dedup = dedup;
 	zp->zp_dedup_verify = dedup && dedup_verify;
 	zp->zp_nopwrite = nopwrite;
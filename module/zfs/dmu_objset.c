@@ -209,6 +209,17 @@ dedup_changed_cb(void *arg, uint64_t newval)
 	os->os_dedup_verify = !!(checksum & ZIO_CHECKSUM_VERIFY);
 }
 
+static void
+arc_reserve_changed_cb(void *arg, uint64_t newval)
+{
+	objset_t *os = arg;
+	uint64_t old = os->os_arc_reserve;
+
+	os->os_arc_reserve = newval;
+	arc_dataset_set_reserve(os->os_spa, os->os_dsl_dataset->ds_object,
+	    old, newval);
+}
+
 static void
 primary_cache_changed_cb(void *arg, uint64_t newval)
 {
@@ -287,6 +298,20 @@ recordsize_changed_cb(void *arg, uint64_t newval)
 	os->os_recordsize = newval;
 }
 
+static void
+smallblk_changed_cb(void *arg, uint64_t newval)
+{
+	objset_t *os = arg;
+
+	/*
+	 * Inheritance and range checking should have been done by now.
+	 */
+	ASSERT(newval <= SPA_OLD_MAXBLOCKSIZE);
+	ASSERT(ISP2(newval));
+
+	os->os_zpl_special_smallblock = newval;
+}
+
 void
 dmu_objset_byteswap(void *buf, size_t size)
 {
@@ -474,6 +499,17 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 				    zfs_prop_to_name(ZFS_PROP_RECORDSIZE),
 				    recordsize_changed_cb, os);
 			}
+			if (err == 0) {
+				err = dsl_prop_register(ds,
+				    zfs_prop_to_name(
+				    ZFS_PROP_SPECIAL_SMALL_BLOCKS),
+				    smallblk_changed_cb, os);
+			}
+			if (err == 0) {
+				err = dsl_prop_register(ds,
+				    zfs_prop_to_name(ZFS_PROP_ARCRESERVE),
+				    arc_reserve_changed_cb, os);
+			}
 		}
 		if (needlock)
 			dsl_pool_config_exit(dmu_objset_pool(os), FTAG);
@@ -808,6 +844,13 @@ dmu_objset_evict(objset_t *os)
 	if (ds)
 		dsl_prop_unregister_all(ds, os);
 
+	/* the reservation only applies while the objset is open */
+	if (os->os_arc_reserve != 0) {
+		arc_dataset_set_reserve(os->os_spa, ds->ds_object,
+		    os->os_arc_reserve, 0);
+		os->os_arc_reserve = 0;
+	}
+
 	if (os->os_sa)
 		sa_tear_down(os);
 
@@ -47,27 +47,65 @@ boolean_t zfs_prefetch_disable = B_FALSE;
 uint32_t	zfetch_max_streams = 8;
 /* min time before stream reclaim */
 uint32_t	zfetch_min_sec_reap = 2;
-/* max bytes to prefetch per stream (default 8MB) */
-uint32_t	zfetch_max_distance = 8 * 1024 * 1024;
+/* min bytes to prefetch per stream, if its prefetches are evicted (1MB) */
+uint32_t	zfetch_min_distance = 1024 * 1024;
+/* max bytes to prefetch per stream, if its prefetches are late (64MB) */
+uint32_t	zfetch_max_distance = 64 * 1024 * 1024;
 /* max bytes to prefetch indirects for per stream (default 64MB) */
 uint32_t	zfetch_max_idistance = 64 * 1024 * 1024;
+/* max bytes between the accesses of a strided stream (default 4MB) */
+uint32_t	zfetch_max_stride = 4 * 1024 * 1024;
 /* max number of bytes in an array_read in which we allow prefetching (1MB) */
 uint64_t	zfetch_array_rd_sz = 1024 * 1024;
+/*
+ * Once a stream has read this many bytes (default 64MB), the data it
+ * prefetches is admitted at the cold end of the ARC, so that a backup or
+ * other large sequential read doesn't push out the rest of the cache.
+ * Zero disables this.
+ */
+uint64_t	zfetch_stream_cold_bytes = 64 * 1024 * 1024;
+
+/*
+ * A stream starts out prefetching up to this many bytes ahead, and then
+ * moves between zfetch_min_distance and zfetch_max_distance.
+ */
+#define	ZFETCH_START_DISTANCE \
+	MAX(zfetch_min_distance, zfetch_max_distance / 8)
 
 typedef struct zfetch_stats {
 	kstat_named_t zfetchstat_hits;
 	kstat_named_t zfetchstat_misses;
 	kstat_named_t zfetchstat_max_streams;
+	kstat_named_t zfetchstat_forward_hits;
+	kstat_named_t zfetchstat_backward_hits;
+	kstat_named_t zfetchstat_stride_hits;
+	kstat_named_t zfetchstat_late;
+	kstat_named_t zfetchstat_evicted;
+	kstat_named_t zfetchstat_recycled;
+	kstat_named_t zfetchstat_data_blocks;
+	kstat_named_t zfetchstat_indirect_blocks;
+	kstat_named_t zfetchstat_streaming_blocks;
 } zfetch_stats_t;
 
 static zfetch_stats_t zfetch_stats = {
 	{ "hits",			KSTAT_DATA_UINT64 },
 	{ "misses",			KSTAT_DATA_UINT64 },
 	{ "max_streams",		KSTAT_DATA_UINT64 },
+	{ "forward_hits",		KSTAT_DATA_UINT64 },
+	{ "backward_hits",		KSTAT_DATA_UINT64 },
+	{ "stride_hits",		KSTAT_DATA_UINT64 },
+	{ "late",			KSTAT_DATA_UINT64 },
+	{ "evicted",			KSTAT_DATA_UINT64 },
+	{ "recycled",			KSTAT_DATA_UINT64 },
+	{ "data_blocks",		KSTAT_DATA_UINT64 },
+	{ "indirect_blocks",		KSTAT_DATA_UINT64 },
+	{ "streaming_blocks",		KSTAT_DATA_UINT64 },
 };
 
 #define	ZFETCHSTAT_BUMP(stat) \
 	atomic_inc_64(&zfetch_stats.stat.value.ui64);
+#define	ZFETCHSTAT_ADD(stat, val) \
+	atomic_add_64(&zfetch_stats.stat.value.ui64, (val));
 
 kstat_t		*zfetch_ksp;
 
@@ -143,15 +181,18 @@ dmu_zfetch_fini(zfetch_t *zf)
 }
 
 /*
- * If there aren't too many streams already, create a new stream.
- * The "blkid" argument is the next block that we expect this stream to access.
- * While we're here, clean up old streams (which haven't been
- * accessed for at least zfetch_min_sec_reap seconds).
+ * If there aren't too many streams already, create a new stream for an
+ * access of "nblks" blocks at "blkid".  While we're here, clean up old
+ * streams (which haven't been accessed for at least zfetch_min_sec_reap
+ * seconds).  If we are at the maximum number of streams, the least
+ * recently used stream that hasn't found its pattern yet makes room for
+ * the new one, so that random accesses can't keep streams that are
+ * working from getting a slot.
  */
 static void
-dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid)
+dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid, uint64_t nblks)
 {
-	zstream_t *zs_next;
+	zstream_t *zs_next, *zs_victim = NULL;
 	int numstreams = 0;
 
 	ASSERT(RW_WRITE_HELD(&zf->zf_rwlock));
@@ -163,38 +204,153 @@ dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid)
 	    zs != NULL; zs = zs_next) {
 		zs_next = list_next(&zf->zf_stream, zs);
 		if (((gethrtime() - zs->zs_atime) / NANOSEC) >
-		    zfetch_min_sec_reap)
+		    zfetch_min_sec_reap) {
 			dmu_zfetch_stream_remove(zf, zs);
-		else
-			numstreams++;
+			continue;
+		}
+		numstreams++;
+		if ((zs->zs_pattern == ZSTREAM_NEW ||
+		    (zs->zs_pattern == ZSTREAM_STRIDE && !zs->zs_confirmed)) &&
+		    (zs_victim == NULL || zs->zs_atime < zs_victim->zs_atime))
+			zs_victim = zs;
 	}
 
 	/*
 	 * The maximum number of streams is normally zfetch_max_streams,
 	 * but for small files we lower it such that it's at least possible
 	 * for all the streams to be non-overlapping.
-	 *
-	 * If we are already at the maximum number of streams for this file,
-	 * even after removing old streams, then don't create this stream.
 	 */
 	uint32_t max_streams = MAX(1, MIN(zfetch_max_streams,
 	    zf->zf_dnode->dn_maxblkid * zf->zf_dnode->dn_datablksz /
-	    zfetch_max_distance));
+	    ZFETCH_START_DISTANCE));
 	if (numstreams >= max_streams) {
-		ZFETCHSTAT_BUMP(zfetchstat_max_streams);
-		return;
+		if (zs_victim == NULL) {
+			ZFETCHSTAT_BUMP(zfetchstat_max_streams);
+			return;
+		}
+		dmu_zfetch_stream_remove(zf, zs_victim);
+		ZFETCHSTAT_BUMP(zfetchstat_recycled);
 	}
 
 	zstream_t *zs = kmem_zalloc(sizeof (*zs), KM_SLEEP);
-	zs->zs_blkid = blkid;
-	zs->zs_pf_blkid = blkid;
-	zs->zs_ipf_blkid = blkid;
+	zs->zs_blkid = blkid + nblks;
+	zs->zs_pf_blkid = blkid + nblks;
+	zs->zs_ipf_blkid = blkid + nblks;
+	zs->zs_last_blkid = blkid;
+	zs->zs_len = nblks;
+	zs->zs_pattern = ZSTREAM_NEW;
+	zs->zs_distance = MIN(ZFETCH_START_DISTANCE, zfetch_max_distance);
 	zs->zs_atime = gethrtime();
 	mutex_init(&zs->zs_lock, NULL, MUTEX_DEFAULT, NULL);
 
 	list_insert_head(&zf->zf_stream, zs);
 }
 
+/*
+ * Does an access of "nblks" blocks at "blkid" continue this stream?  A new
+ * stream is continued by an access just after or just before its first
+ * one; with "stride" set, by any access of the same size that is no more
+ * than zfetch_max_stride bytes away, which makes it a strided stream.
+ */
+static boolean_t
+dmu_zfetch_stream_match(zfetch_t *zf, zstream_t *zs, uint64_t blkid,
+    uint64_t nblks, boolean_t stride)
+{
+	int64_t dist;
+
+	switch (zs->zs_pattern) {
+	case ZSTREAM_NEW:
+		if (stride) {
+			dist = (int64_t)(blkid - zs->zs_last_blkid);
+			if (dist < 0)
+				dist = -dist;
+			return (nblks == zs->zs_len && dist > (int64_t)nblks &&
+			    dist <= zfetch_max_stride >>
+			    zf->zf_dnode->dn_datablkshift);
+		}
+		return (blkid == zs->zs_blkid ||
+		    blkid + nblks == zs->zs_last_blkid);
+	case ZSTREAM_FORWARD:
+		return (!stride && blkid == zs->zs_blkid);
+	case ZSTREAM_BACKWARD:
+		return (!stride && blkid + nblks == zs->zs_blkid);
+	case ZSTREAM_STRIDE:
+		return (!stride && blkid == zs->zs_blkid &&
+		    nblks == zs->zs_len);
+	default:
+		return (B_FALSE);
+	}
+}
+
+/*
+ * Find the stream that this access continues, preferring streams whose
+ * pattern it follows exactly over new streams it could make strided, and
+ * return it with zs_lock held.
+ */
+static zstream_t *
+dmu_zfetch_stream_find(zfetch_t *zf, uint64_t blkid, uint64_t nblks)
+{
+	zstream_t *zs;
+
+	ASSERT(RW_LOCK_HELD(&zf->zf_rwlock));
+
+	for (int pass = 0; pass < 2; pass++) {
+		boolean_t stride = (pass == 1);
+
+		for (zs = list_head(&zf->zf_stream); zs != NULL;
+		    zs = list_next(&zf->zf_stream, zs)) {
+			if (!dmu_zfetch_stream_match(zf, zs, blkid, nblks,
+			    stride))
+				continue;
+			mutex_enter(&zs->zs_lock);
+			/*
+			 * The stream could have changed before we
+			 * acquired zs_lock; re-check it here.
+			 */
+			if (!dmu_zfetch_stream_match(zf, zs, blkid, nblks,
+			    stride)) {
+				mutex_exit(&zs->zs_lock);
+				continue;
+			}
+			return (zs);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ * Adjust the stream's distance based on where the blocks of an access
+ * that it prefetched were found.  If they were still being read, the
+ * prefetch was issued too late and we move further ahead.  If they had
+ * to be read again, they were evicted before they were used and we stay
+ * closer.  Returns B_TRUE in the latter case, so that the caller can
+ * prefetch them again.
+ */
+static boolean_t
+dmu_zfetch_adapt(zstream_t *zs, boolean_t prefetched, zfetch_access_t access)
+{
+	ASSERT(MUTEX_HELD(&zs->zs_lock));
+
+	if (!prefetched)
+		return (B_FALSE);
+
+	switch (access) {
+	case ZFETCH_ACCESS_INFLIGHT:
+		ZFETCHSTAT_BUMP(zfetchstat_late);
+		zs->zs_distance = MIN(MAX(zs->zs_distance, 1) * 2ULL,
+		    zfetch_max_distance);
+		return (B_FALSE);
+	case ZFETCH_ACCESS_MISS:
+		ZFETCHSTAT_BUMP(zfetchstat_evicted);
+		zs->zs_distance = MAX(zs->zs_distance / 2,
+		    zfetch_min_distance);
+		return (B_TRUE);
+	default:
+		return (B_FALSE);
+	}
+}
+
 /*
  * This is the predictive prefetch entry point.  It associates dnode access
  * specified with blkid and nblks arguments with prefetch stream, predicts
@@ -202,15 +358,27 @@ dmu_zfetch_stream_create(zfetch_t *zf, uint64_t blkid)
  * fetch_data argument specifies whether actual data blocks should be fetched:
  *   FALSE -- prefetch only indirect blocks for predicted data blocks;
  *   TRUE -- prefetch predicted data blocks plus following indirect blocks.
+ * access says where the accessed blocks were found, if the caller knows.
+ *
+ * Streams may run forward, backward, or with a constant stride between
+ * accesses of the same size.  A stream starts out not knowing its
+ * direction, and takes it from the first access that continues it.
+ * Strided streams only prefetch data, once their stride has been seen
+ * twice in a row.
  */
 void
-dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data)
+dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data,
+    zfetch_access_t access)
 {
 	zstream_t *zs;
+	zstream_pattern_t pattern;
 	int64_t pf_start, ipf_start, ipf_istart, ipf_iend;
-	int64_t pf_ahead_blks, max_blks;
-	int epbs, max_dist_blks, pf_nblks, ipf_nblks;
+	int64_t pf_ahead_blks, max_blks, stride = 0, len = 0;
+	int64_t epbs, max_dist_blks, pf_nblks, ipf_nblks;
 	uint64_t end_of_access_blkid = blkid + nblks;
+	int blkshift = zf->zf_dnode->dn_datablkshift;
+	boolean_t prefetched;
+	arc_flags_t aflags = ARC_FLAG_PREDICTIVE_PREFETCH;
 
 	if (zfs_prefetch_disable)
 		return;
@@ -224,22 +392,7 @@ dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data)
 
 	rw_enter(&zf->zf_rwlock, RW_READER);
 
-	for (zs = list_head(&zf->zf_stream); zs != NULL;
-	    zs = list_next(&zf->zf_stream, zs)) {
-		if (blkid == zs->zs_blkid) {
-			mutex_enter(&zs->zs_lock);
-			/*
-			 * zs_blkid could have changed before we
-			 * acquired zs_lock; re-check them here.
-			 */
-			if (blkid != zs->zs_blkid) {
-				mutex_exit(&zs->zs_lock);
-				continue;
-			}
-			break;
-		}
-	}
-
+	zs = dmu_zfetch_stream_find(zf, blkid, nblks);
 	if (zs == NULL) {
 		/*
 		 * This access is not part of any existing stream.  Create
@@ -247,70 +400,200 @@ dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data)
 		 */
 		ZFETCHSTAT_BUMP(zfetchstat_misses);
 		if (rw_tryupgrade(&zf->zf_rwlock))
-			dmu_zfetch_stream_create(zf, end_of_access_blkid);
+			dmu_zfetch_stream_create(zf, blkid, nblks);
 		rw_exit(&zf->zf_rwlock);
 		return;
 	}
 
 	/*
-	 * This access was to a block that we issued a prefetch for on
-	 * behalf of this stream. Issue further prefetches for this stream.
-	 *
-	 * Normally, we start prefetching where we stopped
-	 * prefetching last (zs_pf_blkid).  But when we get our first
-	 * hit on this stream, zs_pf_blkid == zs_blkid, we don't
-	 * want to prefetch the block we just accessed.  In this case,
-	 * start just after the block we just accessed.
+	 * The second access of a new stream gives it its pattern.  For a
+	 * backward stream nothing has been prefetched yet, so we start
+	 * below the first access.  A stride isn't trusted until it is seen
+	 * again, so there is nothing to prefetch yet.
 	 */
-	pf_start = MAX(zs->zs_pf_blkid, end_of_access_blkid);
+	if (zs->zs_pattern == ZSTREAM_NEW) {
+		if (blkid == zs->zs_blkid) {
+			zs->zs_pattern = ZSTREAM_FORWARD;
+		} else if (end_of_access_blkid == zs->zs_last_blkid) {
+			zs->zs_pattern = ZSTREAM_BACKWARD;
+			zs->zs_blkid = zs->zs_last_blkid;
+			zs->zs_pf_blkid = zs->zs_last_blkid;
+			zs->zs_ipf_blkid = zs->zs_last_blkid;
+		} else {
+			zs->zs_pattern = ZSTREAM_STRIDE;
+			zs->zs_stride = (int64_t)(blkid - zs->zs_last_blkid);
+			zs->zs_blkid = blkid + zs->zs_stride;
+			zs->zs_pf_blkid = zs->zs_blkid;
+			zs->zs_last_blkid = blkid;
+			zs->zs_atime = gethrtime();
+			mutex_exit(&zs->zs_lock);
+			rw_exit(&zf->zf_rwlock);
+			ZFETCHSTAT_BUMP(zfetchstat_misses);
+			return;
+		}
+	}
+
+	pattern = zs->zs_pattern;
+	pf_nblks = ipf_istart = ipf_iend = 0;
+	epbs = zf->zf_dnode->dn_indblkshift - SPA_BLKPTRSHIFT;
+
+	switch (pattern) {
+	case ZSTREAM_FORWARD:
+		prefetched = (zs->zs_pf_blkid > blkid);
+		if (dmu_zfetch_adapt(zs, prefetched, access))
+			zs->zs_pf_blkid = end_of_access_blkid;
 
-	/*
-	 * Double our amount of prefetched data, but don't let the
-	 * prefetch get further ahead than zfetch_max_distance.
-	 */
-	if (fetch_data) {
-		max_dist_blks =
-		    zfetch_max_distance >> zf->zf_dnode->dn_datablkshift;
 		/*
-		 * Previously, we were (zs_pf_blkid - blkid) ahead.  We
-		 * want to now be double that, so read that amount again,
-		 * plus the amount we are catching up by (i.e. the amount
-		 * read just now).
+		 * This access was to a block that we issued a prefetch for on
+		 * behalf of this stream. Issue further prefetches for this
+		 * stream.
+		 *
+		 * Normally, we start prefetching where we stopped
+		 * prefetching last (zs_pf_blkid).  But when we get our first
+		 * hit on this stream, zs_pf_blkid == zs_blkid, we don't
+		 * want to prefetch the block we just accessed.  In this case,
+		 * start just after the block we just accessed.
 		 */
-		pf_ahead_blks = zs->zs_pf_blkid - blkid + nblks;
-		max_blks = max_dist_blks - (pf_start - end_of_access_blkid);
-		pf_nblks = MIN(pf_ahead_blks, max_blks);
-	} else {
-		pf_nblks = 0;
-	}
+		pf_start = MAX(zs->zs_pf_blkid, end_of_access_blkid);
 
-	zs->zs_pf_blkid = pf_start + pf_nblks;
+		/*
+		 * Double our amount of prefetched data, but don't let the
+		 * prefetch get further ahead than the stream's distance.
+		 */
+		if (fetch_data) {
+			max_dist_blks = zs->zs_distance >> blkshift;
+			/*
+			 * Previously, we were (zs_pf_blkid - blkid) ahead.  We
+			 * want to now be double that, so read that amount
+			 * again, plus the amount we are catching up by
+			 * (i.e. the amount read just now).
+			 */
+			pf_ahead_blks = zs->zs_pf_blkid - blkid + nblks;
+			max_blks = max_dist_blks -
+			    (pf_start - end_of_access_blkid);
+			pf_nblks = MAX(0, MIN(pf_ahead_blks, max_blks));
+		}
+
+		zs->zs_pf_blkid = pf_start + pf_nblks;
+
+		/*
+		 * Do the same for indirects, starting from where we stopped
+		 * last, or where we will stop reading data blocks (and the
+		 * indirects that point to them).
+		 */
+		ipf_start = MAX(zs->zs_ipf_blkid, zs->zs_pf_blkid);
+		max_dist_blks = MAX(zfetch_max_idistance, zs->zs_distance) >>
+		    blkshift;
+		/*
+		 * We want to double our distance ahead of the data prefetch
+		 * (or reader, if we are not prefetching data).  Previously, we
+		 * were (zs_ipf_blkid - blkid) ahead.  To double that, we read
+		 * that amount again, plus the amount we are catching up by
+		 * (i.e. the amount read now + the amount of data prefetched
+		 * now).
+		 */
+		pf_ahead_blks = zs->zs_ipf_blkid - blkid + nblks + pf_nblks;
+		max_blks = max_dist_blks - (ipf_start - end_of_access_blkid);
+		ipf_nblks = MAX(0, MIN(pf_ahead_blks, max_blks));
+		zs->zs_ipf_blkid = ipf_start + ipf_nblks;
+
+		ipf_istart = P2ROUNDUP(ipf_start, 1 << epbs) >> epbs;
+		ipf_iend = P2ROUNDUP(zs->zs_ipf_blkid, 1 << epbs) >> epbs;
+
+		zs->zs_blkid = end_of_access_blkid;
+		ZFETCHSTAT_BUMP(zfetchstat_forward_hits);
+		break;
+
+	case ZSTREAM_BACKWARD:
+		/*
+		 * The mirror image of the above: blocks from zs_pf_blkid up
+		 * to the reader have been prefetched, and we extend that
+		 * range downwards, never below block 0.
+		 */
+		prefetched = (zs->zs_pf_blkid < end_of_access_blkid);
+		if (dmu_zfetch_adapt(zs, prefetched, access))
+			zs->zs_pf_blkid = end_of_access_blkid;
+
+		pf_start = MIN(zs->zs_pf_blkid, blkid);
+		if (fetch_data) {
+			max_dist_blks = zs->zs_distance >> blkshift;
+			pf_ahead_blks = zs->zs_blkid - zs->zs_pf_blkid + nblks;
+			max_blks = max_dist_blks - (blkid - pf_start);
+			pf_nblks = MAX(0, MIN(MIN(pf_ahead_blks, max_blks),
+			    pf_start));
+		}
+		zs->zs_pf_blkid = pf_start - pf_nblks;
+
+		ipf_start = MIN(zs->zs_ipf_blkid, zs->zs_pf_blkid);
+		max_dist_blks = MAX(zfetch_max_idistance, zs->zs_distance) >>
+		    blkshift;
+		pf_ahead_blks = zs->zs_blkid - zs->zs_ipf_blkid + nblks +
+		    pf_nblks;
+		max_blks = max_dist_blks - (blkid - ipf_start);
+		ipf_nblks = MAX(0, MIN(MIN(pf_ahead_blks, max_blks),
+		    ipf_start));
+		zs->zs_ipf_blkid = ipf_start - ipf_nblks;
+
+		/*
+		 * Prefetch the indirects whose last level-0 block lies in
+		 * [zs_ipf_blkid, ipf_start), so that each is only
+		 * prefetched once as the range moves down.
+		 */
+		ipf_istart = (P2ROUNDUP(zs->zs_ipf_blkid + 1, 1ULL << epbs) >>
+		    epbs) - 1;
+		ipf_iend = (P2ROUNDUP(ipf_start + 1, 1ULL << epbs) >> epbs) - 1;
+
+		zs->zs_blkid = blkid;
+		ZFETCHSTAT_BUMP(zfetchstat_backward_hits);
+		break;
+
+	case ZSTREAM_STRIDE:
+		/*
+		 * zs_pf_blkid is the first block of the next access that
+		 * hasn't been prefetched.  Double the number of accesses we
+		 * are ahead by, up to the stream's distance.
+		 */
+		stride = zs->zs_stride;
+		len = zs->zs_len;
+		prefetched = zs->zs_confirmed &&
+		    (int64_t)(zs->zs_pf_blkid - blkid) / stride > 0;
+		if (dmu_zfetch_adapt(zs, prefetched, access))
+			zs->zs_pf_blkid = blkid + stride;
+		zs->zs_confirmed = B_TRUE;
+
+		pf_ahead_blks = (int64_t)(zs->zs_pf_blkid - blkid) / stride - 1;
+		if (pf_ahead_blks < 0) {
+			zs->zs_pf_blkid = blkid + stride;
+			pf_ahead_blks = 0;
+		}
+		pf_start = zs->zs_pf_blkid;
+		if (fetch_data) {
+			max_blks = MAX(1, (zs->zs_distance >> blkshift) / len);
+			pf_nblks = MAX(0, MIN(pf_ahead_blks + 1,
+			    max_blks - pf_ahead_blks));
+		}
+		zs->zs_pf_blkid = pf_start + pf_nblks * stride;
+
+		zs->zs_last_blkid = blkid;
+		zs->zs_blkid = blkid + stride;
+		ZFETCHSTAT_BUMP(zfetchstat_stride_hits);
+		break;
+
+	default:
+		pf_start = 0;
+		break;
+	}
 
 	/*
-	 * Do the same for indirects, starting from where we stopped last,
-	 * or where we will stop reading data blocks (and the indirects
-	 * that point to them).
-	 */
-	ipf_start = MAX(zs->zs_ipf_blkid, zs->zs_pf_blkid);
-	max_dist_blks = zfetch_max_idistance >> zf->zf_dnode->dn_datablkshift;
-	/*
-	 * We want to double our distance ahead of the data prefetch
-	 * (or reader, if we are not prefetching data).  Previously, we
-	 * were (zs_ipf_blkid - blkid) ahead.  To double that, we read
-	 * that amount again, plus the amount we are catching up by
-	 * (i.e. the amount read now + the amount of data prefetched now).
+	 * A stream that has gone on for long enough is a bulk read, whose
+	 * data is unlikely to be read again soon.
 	 */
-	pf_ahead_blks = zs->zs_ipf_blkid - blkid + nblks + pf_nblks;
-	max_blks = max_dist_blks - (ipf_start - end_of_access_blkid);
-	ipf_nblks = MIN(pf_ahead_blks, max_blks);
-	zs->zs_ipf_blkid = ipf_start + ipf_nblks;
-
-	epbs = zf->zf_dnode->dn_indblkshift - SPA_BLKPTRSHIFT;
-	ipf_istart = P2ROUNDUP(ipf_start, 1 << epbs) >> epbs;
-	ipf_iend = P2ROUNDUP(zs->zs_ipf_blkid, 1 << epbs) >> epbs;
+	zs->zs_bytes += nblks << blkshift;
+	if (zfetch_stream_cold_bytes != 0 &&
+	    zs->zs_bytes >= zfetch_stream_cold_bytes)
+		aflags |= ARC_FLAG_STREAMING;
 
 	zs->zs_atime = gethrtime();
-	zs->zs_blkid = end_of_access_blkid;
 	mutex_exit(&zs->zs_lock);
 	rw_exit(&zf->zf_rwlock);
 
@@ -320,13 +603,52 @@ dmu_zfetch(zfetch_t *zf, uint64_t blkid, uint64_t nblks, boolean_t fetch_data)
 	 * calling it to reduce the time we hold them.
 	 */
 
-	for (int i = 0; i < pf_nblks; i++) {
-		dbuf_prefetch(zf->zf_dnode, 0, pf_start + i,
-		    ZIO_PRIORITY_ASYNC_READ, ARC_FLAG_PREDICTIVE_PREFETCH);
-	}
-	for (int64_t iblk = ipf_istart; iblk < ipf_iend; iblk++) {
-		dbuf_prefetch(zf->zf_dnode, 1, iblk,
-		    ZIO_PRIORITY_ASYNC_READ, ARC_FLAG_PREDICTIVE_PREFETCH);
+	switch (pattern) {
+	case ZSTREAM_FORWARD:
+		for (int64_t i = 0; i < pf_nblks; i++) {
+			dbuf_prefetch(zf->zf_dnode, 0, pf_start + i,
+			    ZIO_PRIORITY_ASYNC_READ, aflags);
+		}
+		for (int64_t iblk = ipf_istart; iblk < ipf_iend; iblk++) {
+			dbuf_prefetch(zf->zf_dnode, 1, iblk,
+			    ZIO_PRIORITY_ASYNC_READ,
+			    ARC_FLAG_PREDICTIVE_PREFETCH);
+		}
+		break;
+	case ZSTREAM_BACKWARD:
+		for (int64_t i = 1; i <= pf_nblks; i++) {
+			dbuf_prefetch(zf->zf_dnode, 0, pf_start - i,
+			    ZIO_PRIORITY_ASYNC_READ, aflags);
+		}
+		for (int64_t iblk = ipf_iend - 1; iblk >= ipf_istart; iblk--) {
+			dbuf_prefetch(zf->zf_dnode, 1, iblk,
+			    ZIO_PRIORITY_ASYNC_READ,
+			    ARC_FLAG_PREDICTIVE_PREFETCH);
+		}
+		break;
+	case ZSTREAM_STRIDE:
+		for (int64_t i = 0; i < pf_nblks; i++) {
+			int64_t start = pf_start + i * stride;
+
+			if (start < 0)
+				break;
+			for (int64_t j = 0; j < len; j++) {
+				dbuf_prefetch(zf->zf_dnode, 0, start + j,
+				    ZIO_PRIORITY_ASYNC_READ, aflags);
+			}
+		}
+		pf_nblks *= len;
+		break;
+	default:
+		break;
 	}
+
 	ZFETCHSTAT_BUMP(zfetchstat_hits);
+	if (pf_nblks > 0)
+		ZFETCHSTAT_ADD(zfetchstat_data_blocks, pf_nblks);
+	if (pf_nblks > 0 && (aflags & ARC_FLAG_STREAMING))
+		ZFETCHSTAT_ADD(zfetchstat_streaming_blocks, pf_nblks);
+	if (ipf_iend > ipf_istart)
+		ZFETCHSTAT_ADD(zfetchstat_indirect_blocks,
+		    ipf_iend - ipf_istart);
 }
@@ -57,10 +57,26 @@
 typedef int (scan_cb_t)(dsl_pool_t *, const blkptr_t *,
     const zbookmark_phys_t *);
 
+/*
+ * How dsl_scan_sync_state() treats the on-disk scan state.  While sorted
+ * blocks are waiting in the I/O queues, the traversal is ahead of the
+ * blocks that were actually read, so only the state as of the last time
+ * the queues were empty (a checkpoint) may be written out.
+ */
+typedef enum {
+	SYNC_OPTIONAL,	/* write a checkpoint if the queues are empty */
+	SYNC_MANDATORY,	/* the queues are known to be empty */
+	SYNC_CACHED	/* otherwise rewrite the last checkpoint */
+} state_sync_type_t;
+
 static scan_cb_t dsl_scan_scrub_cb;
 static void dsl_scan_cancel_sync(void *, dmu_tx_t *);
-static void dsl_scan_sync_state(dsl_scan_t *, dmu_tx_t *);
+static void dsl_scan_sync_state(dsl_scan_t *, dmu_tx_t *, state_sync_type_t);
 static boolean_t dsl_scan_restarting(dsl_scan_t *, dmu_tx_t *);
+static void dsl_scan_io_queues_destroy(dsl_scan_t *);
+static boolean_t dsl_scan_should_issue(dsl_scan_t *);
+static void dsl_scan_issue_queues(dsl_scan_t *);
+static void dsl_scan_prefetch_thread(void *);
 
 int zfs_top_maxinflight = 32;		/* maximum I/Os per top-level */
 int zfs_resilver_delay = 2;		/* number of ticks to delay resilver */
@@ -72,11 +88,63 @@ int zfs_free_min_time_ms = 1000; /* min millisecs to free per txg */
 int zfs_resilver_min_time_ms = 3000; /* min millisecs to resilver per txg */
 int zfs_no_scrub_io = B_FALSE; /* set to disable scrub i/o */
 int zfs_no_scrub_prefetch = B_FALSE; /* set to disable scrub prefetch */
+int zfs_scan_prefetch_threads = 4; /* threads walking ahead of the scan */
+int zfs_scan_prefetch_maxinflight = 32;	/* prefetches per top-level */
+uint64_t zfs_scan_prefetch_mem_lim = 32ULL << 20; /* queued and in flight */
 enum ddt_class zfs_scrub_ddt_class_max = DDT_CLASS_DUPLICATE;
 int dsl_scan_delay_completion = B_FALSE; /* set to delay scan completion */
 /* max number of blocks to free in a single TXG */
 uint64_t zfs_free_max_blocks = 100000;
 
+/*
+ * Scrubs and resilvers are sorted: the traversal only gathers the blocks
+ * it finds into per top-level vdev queues sorted by offset, and the blocks
+ * are read from there in large sequential sweeps.  Setting zfs_scan_legacy
+ * issues every block as soon as it is visited instead; it takes effect for
+ * the next scan.  The queues may use up to 1/zfs_scan_mem_lim_fact of
+ * physical memory, and they are drained at least every
+ * zfs_scan_checkpoint_intval seconds so that the on-disk scan state, which
+ * a scan resumes from after a reboot, does not fall too far behind.
+ */
+int zfs_scan_legacy = B_FALSE;
+int zfs_scan_mem_lim_fact = 20;
+int zfs_scan_checkpoint_intval = 7200;	/* in seconds */
+
+#define	DSL_SCAN_MEM_LIM_MIN	(16ULL << 20)
+
+/* a dataset that is waiting to be visited */
+typedef struct scan_ds {
+	avl_node_t	sds_node;
+	uint64_t	sds_dsobj;
+	uint64_t	sds_txg;
+} scan_ds_t;
+
+/* a block that is waiting in a sorted I/O queue */
+typedef struct scan_io {
+	avl_node_t	sio_node;
+	blkptr_t	sio_bp;
+	zbookmark_phys_t sio_zb;
+	uint64_t	sio_asize;	/* allocated size of all copies */
+	int		sio_flags;
+} scan_io_t;
+
+#define	SIO_OFFSET(sio)	DVA_GET_OFFSET(&(sio)->sio_bp.blk_dva[0])
+
+/* a metadata block that is waiting to be prefetched */
+typedef struct scan_prefetch {
+	avl_node_t	spf_node;
+	dsl_scan_t	*spf_scn;
+	blkptr_t	spf_bp;
+	zbookmark_phys_t spf_zb;
+	uint16_t	spf_datablkszsec;	/* of the dnode it belongs to */
+	uint8_t		spf_indblkshift;
+} scan_prefetch_t;
+
+typedef struct dsl_scan_io_queue {
+	avl_tree_t	q_sios;		/* scan_io_t sorted by offset */
+	uint64_t	q_cursor;	/* where the current sweep stands */
+} dsl_scan_io_queue_t;
+
 #define	DSL_SCAN_IS_SCRUB_RESILVER(scn) \
 	((scn)->scn_phys.scn_func == POOL_SCAN_SCRUB || \
 	(scn)->scn_phys.scn_func == POOL_SCAN_RESILVER)
@@ -93,6 +161,178 @@ static scan_cb_t *scan_funcs[POOL_SCAN_FUNCS] = {
 	dsl_scan_scrub_cb,	/* POOL_SCAN_RESILVER */
 };
 
+/*
+ * The datasets that remain to be visited are kept in memory and only
+ * written to scn_queue_obj together with the rest of the scan state.
+ */
+static int
+scan_ds_compare(const void *a, const void *b)
+{
+	const scan_ds_t *sds_a = a;
+	const scan_ds_t *sds_b = b;
+
+	if (sds_a->sds_dsobj < sds_b->sds_dsobj)
+		return (-1);
+	if (sds_a->sds_dsobj > sds_b->sds_dsobj)
+		return (1);
+	return (0);
+}
+
+static boolean_t
+scan_ds_queue_contains(dsl_scan_t *scn, uint64_t dsobj, uint64_t *txg)
+{
+	scan_ds_t search, *sds;
+
+	search.sds_dsobj = dsobj;
+	sds = avl_find(&scn->scn_queue, &search, NULL);
+	if (sds != NULL && txg != NULL)
+		*txg = sds->sds_txg;
+	return (sds != NULL);
+}
+
+static void
+scan_ds_queue_insert(dsl_scan_t *scn, uint64_t dsobj, uint64_t txg)
+{
+	scan_ds_t *sds;
+
+	sds = kmem_alloc(sizeof (scan_ds_t), KM_SLEEP);
+	sds->sds_dsobj = dsobj;
+	sds->sds_txg = txg;
+	avl_add(&scn->scn_queue, sds);
+}
+
+static void
+scan_ds_queue_remove(dsl_scan_t *scn, uint64_t dsobj)
+{
+	scan_ds_t search, *sds;
+
+	search.sds_dsobj = dsobj;
+	sds = avl_find(&scn->scn_queue, &search, NULL);
+	VERIFY(sds != NULL);
+	avl_remove(&scn->scn_queue, sds);
+	kmem_free(sds, sizeof (scan_ds_t));
+}
+
+static void
+scan_ds_queue_clear(dsl_scan_t *scn)
+{
+	void *cookie = NULL;
+	scan_ds_t *sds;
+
+	while ((sds = avl_destroy_nodes(&scn->scn_queue, &cookie)) != NULL)
+		kmem_free(sds, sizeof (scan_ds_t));
+}
+
+/*
+ * Replace the on-disk dataset queue with the in-memory one.  This is only
+ * done at a checkpoint, when every block found so far has been read.
+ */
+static void
+scan_ds_queue_sync(dsl_scan_t *scn, dmu_tx_t *tx)
+{
+	dsl_pool_t *dp = scn->scn_dp;
+	dmu_object_type_t ot = DMU_OT_SCAN_QUEUE;
+	scan_ds_t *sds;
+
+	ASSERT0(scn->scn_bytes_pending);
+	ASSERT(scn->scn_phys.scn_queue_obj != 0);
+
+	if (spa_version(dp->dp_spa) < SPA_VERSION_DSL_SCRUB)
+		ot = DMU_OT_ZAP_OTHER;
+
+	VERIFY0(dmu_object_free(dp->dp_meta_objset,
+	    scn->scn_phys.scn_queue_obj, tx));
+	scn->scn_phys.scn_queue_obj = zap_create(dp->dp_meta_objset, ot,
+	    DMU_OT_NONE, 0, tx);
+	for (sds = avl_first(&scn->scn_queue); sds != NULL;
+	    sds = AVL_NEXT(&scn->scn_queue, sds)) {
+		VERIFY0(zap_add_int_key(dp->dp_meta_objset,
+		    scn->scn_phys.scn_queue_obj, sds->sds_dsobj,
+		    sds->sds_txg, tx));
+	}
+}
+
+/*
+ * The prefetch queue is sorted in the order in which the traversal visits
+ * the blocks of an objset, so the blocks it needs next are read first.
+ */
+static int
+scan_prefetch_compare(const void *a, const void *b)
+{
+	const scan_prefetch_t *spf_a = a;
+	const scan_prefetch_t *spf_b = b;
+
+	if (spf_a->spf_zb.zb_objset < spf_b->spf_zb.zb_objset)
+		return (-1);
+	if (spf_a->spf_zb.zb_objset > spf_b->spf_zb.zb_objset)
+		return (1);
+	return (zbookmark_compare(spf_a->spf_datablkszsec,
+	    spf_a->spf_indblkshift, spf_b->spf_datablkszsec,
+	    spf_b->spf_indblkshift, &spf_a->spf_zb, &spf_b->spf_zb));
+}
+
+static void
+scan_prefetch_queue_clear(dsl_scan_t *scn)
+{
+	void *cookie = NULL;
+	scan_prefetch_t *spf;
+
+	ASSERT(MUTEX_HELD(&scn->scn_prefetch_lock));
+
+	while ((spf = avl_destroy_nodes(&scn->scn_prefetch_queue,
+	    &cookie)) != NULL) {
+		scn->scn_prefetch_mem -= sizeof (scan_prefetch_t);
+		kmem_free(spf, sizeof (scan_prefetch_t));
+	}
+}
+
+/*
+ * Scan prefetch statistics.  The hits and misses are counted for the
+ * metadata reads of the traversal itself, so they give the hit rate of
+ * the prefetcher.
+ */
+typedef struct scan_prefetch_stats {
+	kstat_named_t spfstat_hits;
+	kstat_named_t spfstat_misses;
+	kstat_named_t spfstat_issued;
+	kstat_named_t spfstat_dropped;
+} scan_prefetch_stats_t;
+
+static scan_prefetch_stats_t scan_prefetch_stats = {
+	{ "hits",			KSTAT_DATA_UINT64 },
+	{ "misses",			KSTAT_DATA_UINT64 },
+	{ "issued",			KSTAT_DATA_UINT64 },
+	{ "dropped",			KSTAT_DATA_UINT64 },
+};
+
+#define	SPFSTAT_BUMP(stat) \
+	atomic_inc_64(&scan_prefetch_stats.stat.value.ui64)
+
+static kstat_t *scan_prefetch_ksp;
+
+void
+dsl_scan_stat_init(void)
+{
+	scan_prefetch_ksp = kstat_create("zfs", 0, "scanprefetchstats",
+	    "misc", KSTAT_TYPE_NAMED,
+	    sizeof (scan_prefetch_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+
+	if (scan_prefetch_ksp != NULL) {
+		scan_prefetch_ksp->ks_data = &scan_prefetch_stats;
+		kstat_install(scan_prefetch_ksp);
+	}
+}
+
+void
+dsl_scan_stat_fini(void)
+{
+	if (scan_prefetch_ksp != NULL) {
+		kstat_delete(scan_prefetch_ksp);
+		scan_prefetch_ksp = NULL;
+	}
+}
+
 int
 dsl_scan_init(dsl_pool_t *dp, uint64_t txg)
 {
@@ -100,9 +340,25 @@ dsl_scan_init(dsl_pool_t *dp, uint64_t txg)
 	dsl_scan_t *scn;
 	spa_t *spa = dp->dp_spa;
 	uint64_t f;
+	int nthreads, i;
 
 	scn = dp->dp_scan = kmem_zalloc(sizeof (dsl_scan_t), KM_SLEEP);
 	scn->scn_dp = dp;
+	mutex_init(&scn->scn_io_queues_lock, NULL, MUTEX_DEFAULT, NULL);
+	avl_create(&scn->scn_queue, scan_ds_compare, sizeof (scan_ds_t),
+	    offsetof(scan_ds_t, sds_node));
+
+	mutex_init(&scn->scn_prefetch_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&scn->scn_prefetch_cv, NULL, CV_DEFAULT, NULL);
+	avl_create(&scn->scn_prefetch_queue, scan_prefetch_compare,
+	    sizeof (scan_prefetch_t), offsetof(scan_prefetch_t, spf_node));
+	nthreads = MAX(zfs_scan_prefetch_threads, 1);
+	scn->scn_prefetch_taskq = taskq_create("dsl_scan_prefetch", nthreads,
+	    minclsyspri, nthreads, nthreads, TASKQ_PREPOPULATE);
+	for (i = 0; i < nthreads; i++) {
+		VERIFY(taskq_dispatch(scn->scn_prefetch_taskq,
+		    dsl_scan_prefetch_thread, scn, TQ_SLEEP) != 0);
+	}
 
 	/*
 	 * It's possible that we're resuming a scan after a reboot so
@@ -191,8 +447,34 @@ dsl_scan_init(dsl_pool_t *dp, uint64_t txg)
 			    "by old software; restarting in txg %llu",
 			    scn->scn_restart_txg);
 		}
+
+		/* reload the dataset queue of the last checkpoint */
+		if (scn->scn_phys.scn_state == DSS_SCANNING &&
+		    scn->scn_phys.scn_queue_obj != 0) {
+			zap_cursor_t zc;
+			zap_attribute_t za;
+
+			for (zap_cursor_init(&zc, dp->dp_meta_objset,
+			    scn->scn_phys.scn_queue_obj);
+			    zap_cursor_retrieve(&zc, &za) == 0;
+			    zap_cursor_advance(&zc)) {
+				scan_ds_queue_insert(scn,
+				    strtonum(za.za_name, NULL),
+				    za.za_first_integer);
+			}
+			zap_cursor_fini(&zc);
+		}
 	}
 
+	/*
+	 * Everything that was examined before the checkpoint we resume
+	 * from has been issued.
+	 */
+	scn->scn_is_sorted = !zfs_scan_legacy;
+	scn->scn_last_checkpoint = gethrtime();
+	scn->scn_issued_before_pass = scn->scn_phys.scn_examined;
+	bcopy(&scn->scn_phys, &scn->scn_phys_cached, sizeof (scn->scn_phys));
+
 	spa_scan_stat_init(spa);
 	return (0);
 }
@@ -201,6 +483,30 @@ void
 dsl_scan_fini(dsl_pool_t *dp)
 {
 	if (dp->dp_scan) {
+		dsl_scan_t *scn = dp->dp_scan;
+
+		/*
+		 * Stop the prefetch threads and wait for the reads they
+		 * issued, whose callbacks still refer to the scan.
+		 */
+		mutex_enter(&scn->scn_prefetch_lock);
+		scn->scn_prefetch_stop = B_TRUE;
+		cv_broadcast(&scn->scn_prefetch_cv);
+		mutex_exit(&scn->scn_prefetch_lock);
+		taskq_destroy(scn->scn_prefetch_taskq);
+		mutex_enter(&scn->scn_prefetch_lock);
+		while (scn->scn_prefetch_inflight > 0)
+			cv_wait(&scn->scn_prefetch_cv, &scn->scn_prefetch_lock);
+		scan_prefetch_queue_clear(scn);
+		mutex_exit(&scn->scn_prefetch_lock);
+		avl_destroy(&scn->scn_prefetch_queue);
+		cv_destroy(&scn->scn_prefetch_cv);
+		mutex_destroy(&scn->scn_prefetch_lock);
+
+		dsl_scan_io_queues_destroy(scn);
+		scan_ds_queue_clear(scn);
+		avl_destroy(&scn->scn_queue);
+		mutex_destroy(&scn->scn_io_queues_lock);
 		kmem_free(dp->dp_scan, sizeof (dsl_scan_t));
 		dp->dp_scan = NULL;
 	}
@@ -240,6 +546,10 @@ dsl_scan_setup_sync(void *arg, dmu_tx_t *tx)
 	scn->scn_phys.scn_to_examine = spa->spa_root_vdev->vdev_stat.vs_alloc;
 	scn->scn_restart_txg = 0;
 	scn->scn_done_txg = 0;
+	scn->scn_is_sorted = !zfs_scan_legacy;
+	scn->scn_issued_before_pass = 0;
+	ASSERT0(scn->scn_bytes_pending);
+	ASSERT0(avl_numnodes(&scn->scn_queue));
 	spa_scan_stat_init(spa);
 
 	if (DSL_SCAN_IS_SCRUB_RESILVER(scn)) {
@@ -282,7 +592,7 @@ dsl_scan_setup_sync(void *arg, dmu_tx_t *tx)
 	scn->scn_phys.scn_queue_obj = zap_create(dp->dp_meta_objset,
 	    ot ? ot : DMU_OT_SCAN_QUEUE, DMU_OT_NONE, 0, tx);
 
-	dsl_scan_sync_state(scn, tx);
+	dsl_scan_sync_state(scn, tx, SYNC_MANDATORY);
 
 	spa_history_log_internal(spa, "scan setup", tx,
 	    "func=%u mintxg=%llu maxtxg=%llu",
@@ -315,6 +625,17 @@ dsl_scan_done(dsl_scan_t *scn, boolean_t complete, dmu_tx_t *tx)
 		    DMU_POOL_DIRECTORY_OBJECT, old_names[i], tx);
 	}
 
+	/*
+	 * A completed scan has issued everything it queued; a cancelled
+	 * or restarted one throws away whatever is still waiting.
+	 */
+	ASSERT(!complete || scn->scn_bytes_pending == 0);
+	dsl_scan_io_queues_destroy(scn);
+	scan_ds_queue_clear(scn);
+	mutex_enter(&scn->scn_prefetch_lock);
+	scan_prefetch_queue_clear(scn);
+	mutex_exit(&scn->scn_prefetch_lock);
+
 	if (scn->scn_phys.scn_queue_obj != 0) {
 		VERIFY(0 == dmu_object_free(dp->dp_meta_objset,
 		    scn->scn_phys.scn_queue_obj, tx));
@@ -400,7 +721,7 @@ dsl_scan_cancel_sync(void *arg, dmu_tx_t *tx)
 	dsl_scan_t *scn = dmu_tx_pool(tx)->dp_scan;
 
 	dsl_scan_done(scn, B_FALSE, tx);
-	dsl_scan_sync_state(scn, tx);
+	dsl_scan_sync_state(scn, tx, SYNC_MANDATORY);
 }
 
 int
@@ -454,7 +775,8 @@ dsl_scrub_pause_resume_sync(void *arg, dmu_tx_t *tx)
 		/* can't pause a scrub when there is no in-progress scrub */
 		spa->spa_scan_pass_scrub_pause = gethrestime_sec();
 		scn->scn_phys.scn_flags |= DSF_SCRUB_PAUSED;
-		dsl_scan_sync_state(scn, tx);
+		scn->scn_phys_cached.scn_flags |= DSF_SCRUB_PAUSED;
+		dsl_scan_sync_state(scn, tx, SYNC_CACHED);
 	} else {
 		ASSERT3U(*cmd, ==, POOL_SCRUB_NORMAL);
 		if (dsl_scan_is_paused_scrub(scn)) {
@@ -467,7 +789,8 @@ dsl_scrub_pause_resume_sync(void *arg, dmu_tx_t *tx)
 			    gethrestime_sec() - spa->spa_scan_pass_scrub_pause;
 			spa->spa_scan_pass_scrub_pause = 0;
 			scn->scn_phys.scn_flags &= ~DSF_SCRUB_PAUSED;
-			dsl_scan_sync_state(scn, tx);
+			scn->scn_phys_cached.scn_flags &= ~DSF_SCRUB_PAUSED;
+			dsl_scan_sync_state(scn, tx, SYNC_CACHED);
 		}
 	}
 }
@@ -525,23 +848,100 @@ dsl_scan_ds_maxtxg(dsl_dataset_t *ds)
 }
 
 static void
-dsl_scan_sync_state(dsl_scan_t *scn, dmu_tx_t *tx)
+dsl_scan_sync_state(dsl_scan_t *scn, dmu_tx_t *tx, state_sync_type_t sync_type)
 {
-	VERIFY0(zap_update(scn->scn_dp->dp_meta_objset,
-	    DMU_POOL_DIRECTORY_OBJECT,
-	    DMU_POOL_SCAN, sizeof (uint64_t), SCAN_PHYS_NUMINTS,
-	    &scn->scn_phys, tx));
+	ASSERT(sync_type != SYNC_MANDATORY || scn->scn_bytes_pending == 0);
+
+	if (scn->scn_bytes_pending == 0) {
+		if (scn->scn_phys.scn_state == DSS_SCANNING)
+			scan_ds_queue_sync(scn, tx);
+		VERIFY0(zap_update(scn->scn_dp->dp_meta_objset,
+		    DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_SCAN, sizeof (uint64_t), SCAN_PHYS_NUMINTS,
+		    &scn->scn_phys, tx));
+		bcopy(&scn->scn_phys, &scn->scn_phys_cached,
+		    sizeof (scn->scn_phys));
+		if (scn->scn_checkpointing) {
+			zfs_dbgmsg("finished scan checkpoint txg %llu",
+			    (longlong_t)tx->tx_txg);
+		}
+		scn->scn_checkpointing = B_FALSE;
+		scn->scn_last_checkpoint = gethrtime();
+	} else if (sync_type == SYNC_CACHED) {
+		VERIFY0(zap_update(scn->scn_dp->dp_meta_objset,
+		    DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_SCAN, sizeof (uint64_t), SCAN_PHYS_NUMINTS,
+		    &scn->scn_phys_cached, tx));
+	}
 }
 
 extern int zfs_vdev_async_write_active_min_dirty_percent;
 
+/*
+ * We stop working on the scan for this txg if:
+ *  - we have scanned for the maximum time: an entire txg
+ *    timeout (default 5 sec)
+ *  or
+ *  - we have scanned for at least the minimum time (default 1 sec
+ *    for scrub, 3 sec for resilver), and either we have sufficient
+ *    dirty data that we are starting to write more quickly
+ *    (default 30%), or someone is explicitly waiting for this txg
+ *    to complete.
+ *  or
+ *  - the spa is shutting down because this pool is being exported
+ *    or the machine is rebooting.
+ */
 static boolean_t
-dsl_scan_check_suspend(dsl_scan_t *scn, const zbookmark_phys_t *zb)
+dsl_scan_txg_time_up(dsl_scan_t *scn)
 {
 	uint64_t elapsed_nanosecs;
 	int mintime;
 	int dirty_pct;
 
+	mintime = (scn->scn_phys.scn_func == POOL_SCAN_RESILVER) ?
+	    zfs_resilver_min_time_ms : zfs_scan_min_time_ms;
+	elapsed_nanosecs = gethrtime() - scn->scn_sync_start_time;
+	dirty_pct = scn->scn_dp->dp_dirty_total * 100 / zfs_dirty_data_max;
+	return (elapsed_nanosecs / NANOSEC >= zfs_txg_timeout ||
+	    (NSEC2MSEC(elapsed_nanosecs) > mintime &&
+	    (txg_sync_waiting(scn->scn_dp) ||
+	    dirty_pct >= zfs_vdev_async_write_active_min_dirty_percent)) ||
+	    spa_shutting_down(scn->scn_dp->dp_spa));
+}
+
+static uint64_t
+dsl_scan_mem_limit(void)
+{
+	uint64_t limit = physmem * PAGESIZE / MAX(zfs_scan_mem_lim_fact, 1);
+
+	return (MAX(limit, DSL_SCAN_MEM_LIM_MIN));
+}
+
+/*
+ * Once the sorted queues use up their memory, the traversal stops and
+ * the queues are issued until they are down to half of the limit.
+ */
+static boolean_t
+dsl_scan_should_clear(dsl_scan_t *scn)
+{
+	uint64_t limit = dsl_scan_mem_limit();
+
+	if (!scn->scn_is_sorted)
+		return (B_FALSE);
+
+	if (scn->scn_clearing && scn->scn_queues_mem <= limit / 2) {
+		scn->scn_clearing = B_FALSE;
+	} else if (!scn->scn_clearing && scn->scn_queues_mem >= limit) {
+		zfs_dbgmsg("scan queues full with %llu bytes; issuing",
+		    (longlong_t)scn->scn_queues_mem);
+		scn->scn_clearing = B_TRUE;
+	}
+	return (scn->scn_clearing);
+}
+
+static boolean_t
+dsl_scan_check_suspend(dsl_scan_t *scn, const zbookmark_phys_t *zb)
+{
 	/* we never skip user/group accounting objects */
 	if (zb && (int64_t)zb->zb_object < 0)
 		return (B_FALSE);
@@ -557,28 +957,10 @@ dsl_scan_check_suspend(dsl_scan_t *scn, const zbookmark_phys_t *zb)
 		return (B_FALSE);
 
 	/*
-	 * We suspend if:
-	 *  - we have scanned for the maximum time: an entire txg
-	 *    timeout (default 5 sec)
-	 *  or
-	 *  - we have scanned for at least the minimum time (default 1 sec
-	 *    for scrub, 3 sec for resilver), and either we have sufficient
-	 *    dirty data that we are starting to write more quickly
-	 *    (default 30%), or someone is explicitly waiting for this txg
-	 *    to complete.
-	 *  or
-	 *  - the spa is shutting down because this pool is being exported
-	 *    or the machine is rebooting.
+	 * We suspend when our time for this txg is up (see
+	 * dsl_scan_txg_time_up()), or when the sorted queues are full.
 	 */
-	mintime = (scn->scn_phys.scn_func == POOL_SCAN_RESILVER) ?
-	    zfs_resilver_min_time_ms : zfs_scan_min_time_ms;
-	elapsed_nanosecs = gethrtime() - scn->scn_sync_start_time;
-	dirty_pct = scn->scn_dp->dp_dirty_total * 100 / zfs_dirty_data_max;
-	if (elapsed_nanosecs / NANOSEC >= zfs_txg_timeout ||
-	    (NSEC2MSEC(elapsed_nanosecs) > mintime &&
-	    (txg_sync_waiting(scn->scn_dp) ||
-	    dirty_pct >= zfs_vdev_async_write_active_min_dirty_percent)) ||
-	    spa_shutting_down(scn->scn_dp->dp_spa)) {
+	if (dsl_scan_txg_time_up(scn) || dsl_scan_should_clear(scn)) {
 		if (zb) {
 			dprintf("suspending at bookmark %llx/%llx/%llx/%llx\n",
 			    (longlong_t)zb->zb_objset,
@@ -688,14 +1070,18 @@ dsl_scan_zil(dsl_pool_t *dp, zil_header_t *zh)
 	zil_free(zilog);
 }
 
-/* ARGSUSED */
+/*
+ * Queue a metadata block for the prefetch threads.  Prefetching is best
+ * effort: the block is dropped if the prefetcher is over its memory limit
+ * or if the traversal has already moved on to another objset.
+ */
 static void
-dsl_scan_prefetch(dsl_scan_t *scn, arc_buf_t *buf, blkptr_t *bp,
-    uint64_t objset, uint64_t object, uint64_t blkid)
+dsl_scan_prefetch(dsl_scan_t *scn, uint16_t datablkszsec,
+    uint8_t indblkshift, const blkptr_t *bp, uint64_t objset,
+    uint64_t object, uint64_t blkid)
 {
-	zbookmark_phys_t czb;
-	arc_flags_t flags = ARC_FLAG_NOWAIT | ARC_FLAG_PREFETCH;
-	int zio_flags = ZIO_FLAG_CANFAIL | ZIO_FLAG_SCAN_THREAD;
+	scan_prefetch_t *spf;
+	avl_index_t where;
 
 	if (zfs_no_scrub_prefetch)
 		return;
@@ -704,17 +1090,144 @@ dsl_scan_prefetch(dsl_scan_t *scn, arc_buf_t *buf, blkptr_t *bp,
 	    (BP_GET_LEVEL(bp) == 0 && BP_GET_TYPE(bp) != DMU_OT_DNODE))
 		return;
 
-	if (BP_IS_PROTECTED(bp)) {
+	mutex_enter(&scn->scn_prefetch_lock);
+	if (scn->scn_prefetch_stop || objset != scn->scn_prefetch_objset) {
+		mutex_exit(&scn->scn_prefetch_lock);
+		return;
+	}
+	if (scn->scn_prefetch_mem + sizeof (scan_prefetch_t) >
+	    zfs_scan_prefetch_mem_lim ||
+	    (spf = kmem_alloc(sizeof (scan_prefetch_t), KM_NOSLEEP)) == NULL) {
+		mutex_exit(&scn->scn_prefetch_lock);
+		SPFSTAT_BUMP(spfstat_dropped);
+		return;
+	}
+
+	spf->spf_scn = scn;
+	spf->spf_bp = *bp;
+	SET_BOOKMARK(&spf->spf_zb, objset, object, BP_GET_LEVEL(bp), blkid);
+	spf->spf_datablkszsec = datablkszsec;
+	spf->spf_indblkshift = indblkshift;
+
+	if (avl_find(&scn->scn_prefetch_queue, spf, &where) != NULL) {
+		mutex_exit(&scn->scn_prefetch_lock);
+		kmem_free(spf, sizeof (scan_prefetch_t));
+		return;
+	}
+	avl_insert(&scn->scn_prefetch_queue, spf, where);
+	scn->scn_prefetch_mem += sizeof (scan_prefetch_t);
+	cv_signal(&scn->scn_prefetch_cv);
+	mutex_exit(&scn->scn_prefetch_lock);
+}
+
+/*
+ * A prefetched block has arrived.  Queue the metadata it points to, so the
+ * prefetcher keeps walking down the tree and across the dnode blocks ahead
+ * of the traversal instead of a single level below it.
+ */
+/* ARGSUSED */
+static void
+dsl_scan_prefetch_cb(zio_t *zio, int error, arc_buf_t *buf, void *private)
+{
+	scan_prefetch_t *spf = private;
+	dsl_scan_t *scn = spf->spf_scn;
+	const blkptr_t *bp = &spf->spf_bp;
+	const zbookmark_phys_t *zb = &spf->spf_zb;
+	int i, j;
+
+	if (buf == NULL)
+		goto out;
+
+	if (BP_GET_LEVEL(bp) > 0) {
+		int epb = BP_GET_LSIZE(bp) >> SPA_BLKPTRSHIFT;
+		blkptr_t *cbp;
+
+		for (i = 0, cbp = buf->b_data; i < epb; i++, cbp++) {
+			dsl_scan_prefetch(scn, spf->spf_datablkszsec,
+			    spf->spf_indblkshift, cbp, zb->zb_objset,
+			    zb->zb_object, zb->zb_blkid * epb + i);
+		}
+	} else {
+		int epb = BP_GET_LSIZE(bp) >> DNODE_SHIFT;
+		dnode_phys_t *cdnp;
+
 		ASSERT3U(BP_GET_TYPE(bp), ==, DMU_OT_DNODE);
-		ASSERT3U(BP_GET_LEVEL(bp), ==, 0);
-		zio_flags |= ZIO_FLAG_RAW;
+		for (i = 0, cdnp = buf->b_data; i < epb; i++, cdnp++) {
+			for (j = 0; j < cdnp->dn_nblkptr; j++) {
+				dsl_scan_prefetch(scn, cdnp->dn_datablkszsec,
+				    cdnp->dn_indblkshift, &cdnp->dn_blkptr[j],
+				    zb->zb_objset, zb->zb_blkid * epb + i, j);
+			}
+		}
 	}
+	arc_buf_destroy(buf, private);
+
+out:
+	mutex_enter(&scn->scn_prefetch_lock);
+	ASSERT3U(scn->scn_prefetch_inflight, >, 0);
+	scn->scn_prefetch_inflight--;
+	scn->scn_prefetch_mem -= BP_GET_LSIZE(bp);
+	cv_broadcast(&scn->scn_prefetch_cv);
+	mutex_exit(&scn->scn_prefetch_lock);
+	kmem_free(spf, sizeof (scan_prefetch_t));
+}
+
+/*
+ * The prefetch threads issue the queued blocks in traversal order, keeping
+ * up to zfs_scan_prefetch_maxinflight reads per top-level vdev in flight.
+ */
+static void
+dsl_scan_prefetch_thread(void *arg)
+{
+	dsl_scan_t *scn = arg;
+	spa_t *spa = scn->scn_dp->dp_spa;
+	scan_prefetch_t *spf;
+
+	mutex_enter(&scn->scn_prefetch_lock);
+	for (;;) {
+		uint64_t maxinflight = MAX(zfs_scan_prefetch_maxinflight, 1) *
+		    MAX(spa->spa_root_vdev->vdev_children, 1);
+		arc_flags_t flags = ARC_FLAG_NOWAIT | ARC_FLAG_PREFETCH;
+		int zio_flags = ZIO_FLAG_CANFAIL | ZIO_FLAG_SCAN_THREAD;
 
-	SET_BOOKMARK(&czb, objset, object, BP_GET_LEVEL(bp), blkid);
+		if (scn->scn_prefetch_stop)
+			break;
+		if (avl_numnodes(&scn->scn_prefetch_queue) == 0 ||
+		    scn->scn_prefetch_inflight >= maxinflight) {
+			cv_wait(&scn->scn_prefetch_cv, &scn->scn_prefetch_lock);
+			continue;
+		}
 
-	(void) arc_read(scn->scn_zio_root, scn->scn_dp->dp_spa, bp,
-	    NULL, NULL, ZIO_PRIORITY_ASYNC_READ,
-	    zio_flags, &flags, &czb);
+		spf = avl_first(&scn->scn_prefetch_queue);
+		avl_remove(&scn->scn_prefetch_queue, spf);
+		scn->scn_prefetch_mem -= sizeof (scan_prefetch_t);
+		scn->scn_prefetch_inflight++;
+		scn->scn_prefetch_mem += BP_GET_LSIZE(&spf->spf_bp);
+		mutex_exit(&scn->scn_prefetch_lock);
+
+		if (BP_IS_PROTECTED(&spf->spf_bp)) {
+			ASSERT3U(BP_GET_TYPE(&spf->spf_bp), ==, DMU_OT_DNODE);
+			ASSERT3U(BP_GET_LEVEL(&spf->spf_bp), ==, 0);
+			zio_flags |= ZIO_FLAG_RAW;
+		}
+
+		SPFSTAT_BUMP(spfstat_issued);
+		(void) arc_read(NULL, spa, &spf->spf_bp, dsl_scan_prefetch_cb,
+		    spf, ZIO_PRIORITY_ASYNC_READ, zio_flags, &flags,
+		    &spf->spf_zb);
+
+		mutex_enter(&scn->scn_prefetch_lock);
+	}
+	mutex_exit(&scn->scn_prefetch_lock);
+}
+
+static void
+dsl_scan_prefetch_stat(arc_flags_t flags)
+{
+	if (flags & ARC_FLAG_CACHED)
+		SPFSTAT_BUMP(spfstat_hits);
+	else
+		SPFSTAT_BUMP(spfstat_misses);
 }
 
 static boolean_t
@@ -779,8 +1292,10 @@ dsl_scan_recurse(dsl_scan_t *scn, dsl_dataset_t *ds, dmu_objset_type_t ostype,
 			scn->scn_phys.scn_errors++;
 			return (err);
 		}
+		dsl_scan_prefetch_stat(flags);
 		for (i = 0, cbp = buf->b_data; i < epb; i++, cbp++) {
-			dsl_scan_prefetch(scn, buf, cbp, zb->zb_objset,
+			dsl_scan_prefetch(scn, dnp->dn_datablkszsec,
+			    dnp->dn_indblkshift, cbp, zb->zb_objset,
 			    zb->zb_object, zb->zb_blkid * epb + i);
 		}
 		for (i = 0, cbp = buf->b_data; i < epb; i++, cbp++) {
@@ -811,10 +1326,12 @@ dsl_scan_recurse(dsl_scan_t *scn, dsl_dataset_t *ds, dmu_objset_type_t ostype,
 			scn->scn_phys.scn_errors++;
 			return (err);
 		}
+		dsl_scan_prefetch_stat(flags);
 		for (i = 0, cdnp = buf->b_data; i < epb; i++, cdnp++) {
 			for (j = 0; j < cdnp->dn_nblkptr; j++) {
 				blkptr_t *cbp = &cdnp->dn_blkptr[j];
-				dsl_scan_prefetch(scn, buf, cbp,
+				dsl_scan_prefetch(scn, cdnp->dn_datablkszsec,
+				    cdnp->dn_indblkshift, cbp,
 				    zb->zb_objset, zb->zb_blkid * epb + i, j);
 			}
 		}
@@ -828,6 +1345,7 @@ dsl_scan_recurse(dsl_scan_t *scn, dsl_dataset_t *ds, dmu_objset_type_t ostype,
 		arc_flags_t flags = ARC_FLAG_WAIT;
 		objset_phys_t *osp;
 		arc_buf_t *buf;
+		int i;
 
 		err = arc_read(NULL, dp->dp_spa, bp, arc_getbuf_func, &buf,
 		    ZIO_PRIORITY_ASYNC_READ, zio_flags, &flags, zb);
@@ -836,8 +1354,28 @@ dsl_scan_recurse(dsl_scan_t *scn, dsl_dataset_t *ds, dmu_objset_type_t ostype,
 			return (err);
 		}
 
+		dsl_scan_prefetch_stat(flags);
 		osp = buf->b_data;
 
+		/*
+		 * The traversal enters a new objset, so whatever is still
+		 * queued for the previous one is of no use any more.  Start
+		 * walking the meta-dnode of this one.
+		 */
+		mutex_enter(&scn->scn_prefetch_lock);
+		if (scn->scn_prefetch_objset != zb->zb_objset) {
+			scan_prefetch_queue_clear(scn);
+			scn->scn_prefetch_objset = zb->zb_objset;
+		}
+		mutex_exit(&scn->scn_prefetch_lock);
+		for (i = 0; i < osp->os_meta_dnode.dn_nblkptr; i++) {
+			dsl_scan_prefetch(scn,
+			    osp->os_meta_dnode.dn_datablkszsec,
+			    osp->os_meta_dnode.dn_indblkshift,
+			    &osp->os_meta_dnode.dn_blkptr[i], zb->zb_objset,
+			    DMU_META_DNODE_OBJECT, i);
+		}
+
 		dsl_scan_visitdnode(scn, ds, osp->os_type,
 		    &osp->os_meta_dnode, DMU_META_DNODE_OBJECT, tx);
 
@@ -971,6 +1509,45 @@ dsl_scan_visit_rootbp(dsl_scan_t *scn, dsl_dataset_t *ds, blkptr_t *bp,
 	dprintf_ds(ds, "finished scan%s", "");
 }
 
+/*
+ * The dataset hooks below fix up both the in-core scan state and the state
+ * of the last checkpoint, which is what is on disk while sorted blocks are
+ * queued: the bookmarks in scn_phys and scn_phys_cached, and the in-memory
+ * and on-disk dataset queues.
+ */
+static void
+ds_destroyed_scn_phys(dsl_dataset_t *ds, dsl_scan_phys_t *scn_phys)
+{
+	if (scn_phys->scn_bookmark.zb_objset != ds->ds_object)
+		return;
+
+	if (ds->ds_is_snapshot) {
+		/*
+		 * Note:
+		 *  - scn_cur_{min,max}_txg stays the same.
+		 *  - Setting the flag is not really necessary if
+		 *    scn_cur_max_txg == scn_max_txg, because there
+		 *    is nothing after this snapshot that we care
+		 *    about.  However, we set it anyway and then
+		 *    ignore it when we retraverse it in
+		 *    dsl_scan_visitds().
+		 */
+		scn_phys->scn_bookmark.zb_objset =
+		    dsl_dataset_phys(ds)->ds_next_snap_obj;
+		zfs_dbgmsg("destroying ds %llu; currently traversing; "
+		    "reset zb_objset to %llu",
+		    (u_longlong_t)ds->ds_object,
+		    (u_longlong_t)dsl_dataset_phys(ds)->ds_next_snap_obj);
+		scn_phys->scn_flags |= DSF_VISIT_DS_AGAIN;
+	} else {
+		SET_BOOKMARK(&scn_phys->scn_bookmark,
+		    ZB_DESTROYED_OBJSET, 0, 0, 0);
+		zfs_dbgmsg("destroying ds %llu; currently traversing; "
+		    "reset bookmark to -1,0,0,0",
+		    (u_longlong_t)ds->ds_object);
+	}
+}
+
 void
 dsl_scan_ds_destroyed(dsl_dataset_t *ds, dmu_tx_t *tx)
 {
@@ -981,44 +1558,28 @@ dsl_scan_ds_destroyed(dsl_dataset_t *ds, dmu_tx_t *tx)
 	if (scn->scn_phys.scn_state != DSS_SCANNING)
 		return;
 
-	if (scn->scn_phys.scn_bookmark.zb_objset == ds->ds_object) {
+	ds_destroyed_scn_phys(ds, &scn->scn_phys);
+	ds_destroyed_scn_phys(ds, &scn->scn_phys_cached);
+
+	if (scan_ds_queue_contains(scn, ds->ds_object, &mintxg)) {
+		scan_ds_queue_remove(scn, ds->ds_object);
+		/*
+		 * We keep the same mintxg; it could be >
+		 * ds_creation_txg if the previous snapshot was
+		 * deleted too.
+		 */
 		if (ds->ds_is_snapshot) {
-			/*
-			 * Note:
-			 *  - scn_cur_{min,max}_txg stays the same.
-			 *  - Setting the flag is not really necessary if
-			 *    scn_cur_max_txg == scn_max_txg, because there
-			 *    is nothing after this snapshot that we care
-			 *    about.  However, we set it anyway and then
-			 *    ignore it when we retraverse it in
-			 *    dsl_scan_visitds().
-			 */
-			scn->scn_phys.scn_bookmark.zb_objset =
-			    dsl_dataset_phys(ds)->ds_next_snap_obj;
-			zfs_dbgmsg("destroying ds %llu; currently traversing; "
-			    "reset zb_objset to %llu",
-			    (u_longlong_t)ds->ds_object,
-			    (u_longlong_t)dsl_dataset_phys(ds)->
-			    ds_next_snap_obj);
-			scn->scn_phys.scn_flags |= DSF_VISIT_DS_AGAIN;
-		} else {
-			SET_BOOKMARK(&scn->scn_phys.scn_bookmark,
-			    ZB_DESTROYED_OBJSET, 0, 0, 0);
-			zfs_dbgmsg("destroying ds %llu; currently traversing; "
-			    "reset bookmark to -1,0,0,0",
-			    (u_longlong_t)ds->ds_object);
+			scan_ds_queue_insert(scn,
+			    dsl_dataset_phys(ds)->ds_next_snap_obj, mintxg);
 		}
-	} else if (zap_lookup_int_key(dp->dp_meta_objset,
+	}
+
+	if (zap_lookup_int_key(dp->dp_meta_objset,
 	    scn->scn_phys.scn_queue_obj, ds->ds_object, &mintxg) == 0) {
 		ASSERT3U(dsl_dataset_phys(ds)->ds_num_children, <=, 1);
 		VERIFY3U(0, ==, zap_remove_int(dp->dp_meta_objset,
 		    scn->scn_phys.scn_queue_obj, ds->ds_object, tx));
 		if (ds->ds_is_snapshot) {
-			/*
-			 * We keep the same mintxg; it could be >
-			 * ds_creation_txg if the previous snapshot was
-			 * deleted too.
-			 */
 			VERIFY(zap_add_int_key(dp->dp_meta_objset,
 			    scn->scn_phys.scn_queue_obj,
 			    dsl_dataset_phys(ds)->ds_next_snap_obj,
@@ -1038,7 +1599,20 @@ dsl_scan_ds_destroyed(dsl_dataset_t *ds, dmu_tx_t *tx)
 	 * dsl_scan_sync() should be called after this, and should sync
 	 * out our changed state, but just to be safe, do it here.
 	 */
-	dsl_scan_sync_state(scn, tx);
+	dsl_scan_sync_state(scn, tx, SYNC_CACHED);
+}
+
+static void
+ds_snapshotted_bookmark(dsl_dataset_t *ds, zbookmark_phys_t *scn_bookmark)
+{
+	if (scn_bookmark->zb_objset == ds->ds_object) {
+		scn_bookmark->zb_objset =
+		    dsl_dataset_phys(ds)->ds_prev_snap_obj;
+		zfs_dbgmsg("snapshotting ds %llu; currently traversing; "
+		    "reset zb_objset to %llu",
+		    (u_longlong_t)ds->ds_object,
+		    (u_longlong_t)dsl_dataset_phys(ds)->ds_prev_snap_obj);
+	}
 }
 
 void
@@ -1053,14 +1627,16 @@ dsl_scan_ds_snapshotted(dsl_dataset_t *ds, dmu_tx_t *tx)
 
 	ASSERT(dsl_dataset_phys(ds)->ds_prev_snap_obj != 0);
 
-	if (scn->scn_phys.scn_bookmark.zb_objset == ds->ds_object) {
-		scn->scn_phys.scn_bookmark.zb_objset =
-		    dsl_dataset_phys(ds)->ds_prev_snap_obj;
-		zfs_dbgmsg("snapshotting ds %llu; currently traversing; "
-		    "reset zb_objset to %llu",
-		    (u_longlong_t)ds->ds_object,
-		    (u_longlong_t)dsl_dataset_phys(ds)->ds_prev_snap_obj);
-	} else if (zap_lookup_int_key(dp->dp_meta_objset,
+	ds_snapshotted_bookmark(ds, &scn->scn_phys.scn_bookmark);
+	ds_snapshotted_bookmark(ds, &scn->scn_phys_cached.scn_bookmark);
+
+	if (scan_ds_queue_contains(scn, ds->ds_object, &mintxg)) {
+		scan_ds_queue_remove(scn, ds->ds_object);
+		scan_ds_queue_insert(scn,
+		    dsl_dataset_phys(ds)->ds_prev_snap_obj, mintxg);
+	}
+
+	if (zap_lookup_int_key(dp->dp_meta_objset,
 	    scn->scn_phys.scn_queue_obj, ds->ds_object, &mintxg) == 0) {
 		VERIFY3U(0, ==, zap_remove_int(dp->dp_meta_objset,
 		    scn->scn_phys.scn_queue_obj, ds->ds_object, tx));
@@ -1072,7 +1648,26 @@ dsl_scan_ds_snapshotted(dsl_dataset_t *ds, dmu_tx_t *tx)
 		    (u_longlong_t)ds->ds_object,
 		    (u_longlong_t)dsl_dataset_phys(ds)->ds_prev_snap_obj);
 	}
-	dsl_scan_sync_state(scn, tx);
+	dsl_scan_sync_state(scn, tx, SYNC_CACHED);
+}
+
+static void
+ds_clone_swapped_bookmark(dsl_dataset_t *ds1, dsl_dataset_t *ds2,
+    zbookmark_phys_t *scn_bookmark)
+{
+	if (scn_bookmark->zb_objset == ds1->ds_object) {
+		scn_bookmark->zb_objset = ds2->ds_object;
+		zfs_dbgmsg("clone_swap ds %llu; currently traversing; "
+		    "reset zb_objset to %llu",
+		    (u_longlong_t)ds1->ds_object,
+		    (u_longlong_t)ds2->ds_object);
+	} else if (scn_bookmark->zb_objset == ds2->ds_object) {
+		scn_bookmark->zb_objset = ds1->ds_object;
+		zfs_dbgmsg("clone_swap ds %llu; currently traversing; "
+		    "reset zb_objset to %llu",
+		    (u_longlong_t)ds2->ds_object,
+		    (u_longlong_t)ds1->ds_object);
+	}
 }
 
 void
@@ -1085,18 +1680,18 @@ dsl_scan_ds_clone_swapped(dsl_dataset_t *ds1, dsl_dataset_t *ds2, dmu_tx_t *tx)
 	if (scn->scn_phys.scn_state != DSS_SCANNING)
 		return;
 
-	if (scn->scn_phys.scn_bookmark.zb_objset == ds1->ds_object) {
-		scn->scn_phys.scn_bookmark.zb_objset = ds2->ds_object;
-		zfs_dbgmsg("clone_swap ds %llu; currently traversing; "
-		    "reset zb_objset to %llu",
-		    (u_longlong_t)ds1->ds_object,
-		    (u_longlong_t)ds2->ds_object);
-	} else if (scn->scn_phys.scn_bookmark.zb_objset == ds2->ds_object) {
-		scn->scn_phys.scn_bookmark.zb_objset = ds1->ds_object;
-		zfs_dbgmsg("clone_swap ds %llu; currently traversing; "
-		    "reset zb_objset to %llu",
-		    (u_longlong_t)ds2->ds_object,
-		    (u_longlong_t)ds1->ds_object);
+	ds_clone_swapped_bookmark(ds1, ds2, &scn->scn_phys.scn_bookmark);
+	ds_clone_swapped_bookmark(ds1, ds2, &scn->scn_phys_cached.scn_bookmark);
+
+	if (scan_ds_queue_contains(scn, ds1->ds_object, &mintxg)) {
+		/* If both were there to begin with, nothing changes. */
+		if (!scan_ds_queue_contains(scn, ds2->ds_object, NULL)) {
+			scan_ds_queue_remove(scn, ds1->ds_object);
+			scan_ds_queue_insert(scn, ds2->ds_object, mintxg);
+		}
+	} else if (scan_ds_queue_contains(scn, ds2->ds_object, &mintxg)) {
+		scan_ds_queue_remove(scn, ds2->ds_object);
+		scan_ds_queue_insert(scn, ds1->ds_object, mintxg);
 	}
 
 	if (zap_lookup_int_key(dp->dp_meta_objset, scn->scn_phys.scn_queue_obj,
@@ -1134,11 +1729,10 @@ dsl_scan_ds_clone_swapped(dsl_dataset_t *ds1, dsl_dataset_t *ds2, dmu_tx_t *tx)
 		    (u_longlong_t)ds1->ds_object);
 	}
 
-	dsl_scan_sync_state(scn, tx);
+	dsl_scan_sync_state(scn, tx, SYNC_CACHED);
 }
 
 struct enqueue_clones_arg {
-	dmu_tx_t *tx;
 	uint64_t originobj;
 };
 
@@ -1168,9 +1762,8 @@ enqueue_clones_cb(dsl_pool_t *dp, dsl_dataset_t *hds, void *arg)
 			return (err);
 		ds = prev;
 	}
-	VERIFY(zap_add_int_key(dp->dp_meta_objset,
-	    scn->scn_phys.scn_queue_obj, ds->ds_object,
-	    dsl_dataset_phys(ds)->ds_prev_snap_txg, eca->tx) == 0);
+	scan_ds_queue_insert(scn, ds->ds_object,
+	    dsl_dataset_phys(ds)->ds_prev_snap_txg);
 	dsl_dataset_rele(ds, FTAG);
 	return (0);
 }
@@ -1268,9 +1861,8 @@ dsl_scan_visitds(dsl_scan_t *scn, uint64_t dsobj, dmu_tx_t *tx)
 	if (scn->scn_phys.scn_flags & DSF_VISIT_DS_AGAIN) {
 		zfs_dbgmsg("incomplete pass; visiting again");
 		scn->scn_phys.scn_flags &= ~DSF_VISIT_DS_AGAIN;
-		VERIFY(zap_add_int_key(dp->dp_meta_objset,
-		    scn->scn_phys.scn_queue_obj, ds->ds_object,
-		    scn->scn_phys.scn_cur_max_txg, tx) == 0);
+		scan_ds_queue_insert(scn, ds->ds_object,
+		    scn->scn_phys.scn_cur_max_txg);
 		goto out;
 	}
 
@@ -1278,10 +1870,9 @@ dsl_scan_visitds(dsl_scan_t *scn, uint64_t dsobj, dmu_tx_t *tx)
 	 * Add descendent datasets to work queue.
 	 */
 	if (dsl_dataset_phys(ds)->ds_next_snap_obj != 0) {
-		VERIFY(zap_add_int_key(dp->dp_meta_objset,
-		    scn->scn_phys.scn_queue_obj,
+		scan_ds_queue_insert(scn,
 		    dsl_dataset_phys(ds)->ds_next_snap_obj,
-		    dsl_dataset_phys(ds)->ds_creation_txg, tx) == 0);
+		    dsl_dataset_phys(ds)->ds_creation_txg);
 	}
 	if (dsl_dataset_phys(ds)->ds_num_children > 1) {
 		boolean_t usenext = B_FALSE;
@@ -1302,13 +1893,22 @@ dsl_scan_visitds(dsl_scan_t *scn, uint64_t dsobj, dmu_tx_t *tx)
 		}
 
 		if (usenext) {
-			VERIFY0(zap_join_key(dp->dp_meta_objset,
-			    dsl_dataset_phys(ds)->ds_next_clones_obj,
-			    scn->scn_phys.scn_queue_obj,
-			    dsl_dataset_phys(ds)->ds_creation_txg, tx));
+			zap_cursor_t zc;
+			zap_attribute_t *za;
+
+			za = kmem_alloc(sizeof (zap_attribute_t), KM_SLEEP);
+			for (zap_cursor_init(&zc, dp->dp_meta_objset,
+			    dsl_dataset_phys(ds)->ds_next_clones_obj);
+			    zap_cursor_retrieve(&zc, za) == 0;
+			    zap_cursor_advance(&zc)) {
+				scan_ds_queue_insert(scn,
+				    strtonum(za->za_name, NULL),
+				    dsl_dataset_phys(ds)->ds_creation_txg);
+			}
+			zap_cursor_fini(&zc);
+			kmem_free(za, sizeof (zap_attribute_t));
 		} else {
 			struct enqueue_clones_arg eca;
-			eca.tx = tx;
 			eca.originobj = ds->ds_object;
 
 			VERIFY0(dmu_objset_find_dp(dp, dp->dp_root_dir_obj,
@@ -1324,7 +1924,6 @@ out:
 static int
 enqueue_cb(dsl_pool_t *dp, dsl_dataset_t *hds, void *arg)
 {
-	dmu_tx_t *tx = arg;
 	dsl_dataset_t *ds;
 	int err;
 	dsl_scan_t *scn = dp->dp_scan;
@@ -1354,8 +1953,8 @@ enqueue_cb(dsl_pool_t *dp, dsl_dataset_t *hds, void *arg)
 		ds = prev;
 	}
 
-	VERIFY(zap_add_int_key(dp->dp_meta_objset, scn->scn_phys.scn_queue_obj,
-	    ds->ds_object, dsl_dataset_phys(ds)->ds_prev_snap_txg, tx) == 0);
+	scan_ds_queue_insert(scn, ds->ds_object,
+	    dsl_dataset_phys(ds)->ds_prev_snap_txg);
 	dsl_dataset_rele(ds, FTAG);
 	return (0);
 }
@@ -1416,7 +2015,7 @@ dsl_scan_ddt(dsl_scan_t *scn, dmu_tx_t *tx)
 
 		/* There should be no pending changes to the dedup table */
 		ddt = scn->scn_dp->dp_spa->spa_ddt[ddb->ddb_checksum];
-		ASSERT(avl_first(&ddt->ddt_tree) == NULL);
+		ASSERT(!ddt_changes_pending(ddt));
 
 		dsl_scan_ddt_entry(scn, ddb->ddb_checksum, &dde, tx);
 		n++;
@@ -1463,8 +2062,7 @@ static void
 dsl_scan_visit(dsl_scan_t *scn, dmu_tx_t *tx)
 {
 	dsl_pool_t *dp = scn->scn_dp;
-	zap_cursor_t *zc;
-	zap_attribute_t *za;
+	scan_ds_t *sds;
 
 	if (scn->scn_phys.scn_ddt_bookmark.ddb_class <=
 	    scn->scn_phys.scn_ddt_class_max) {
@@ -1488,7 +2086,7 @@ dsl_scan_visit(dsl_scan_t *scn, dmu_tx_t *tx)
 
 		if (spa_version(dp->dp_spa) < SPA_VERSION_DSL_SCRUB) {
 			VERIFY0(dmu_objset_find_dp(dp, dp->dp_root_dir_obj,
-			    enqueue_cb, tx, DS_FIND_CHILDREN));
+			    enqueue_cb, NULL, DS_FIND_CHILDREN));
 		} else {
 			dsl_scan_visitds(scn,
 			    dp->dp_origin_snap->ds_object, tx);
@@ -1512,26 +2110,20 @@ dsl_scan_visit(dsl_scan_t *scn, dmu_tx_t *tx)
 	 * bookmark so we don't think that we're still trying to resume.
 	 */
 	bzero(&scn->scn_phys.scn_bookmark, sizeof (zbookmark_phys_t));
-	zc = kmem_alloc(sizeof (zap_cursor_t), KM_SLEEP);
-	za = kmem_alloc(sizeof (zap_attribute_t), KM_SLEEP);
 
-	/* keep pulling things out of the zap-object-as-queue */
-	while (zap_cursor_init(zc, dp->dp_meta_objset,
-	    scn->scn_phys.scn_queue_obj),
-	    zap_cursor_retrieve(zc, za) == 0) {
+	/* keep pulling things out of the dataset queue */
+	while ((sds = avl_first(&scn->scn_queue)) != NULL) {
 		dsl_dataset_t *ds;
-		uint64_t dsobj;
+		uint64_t dsobj = sds->sds_dsobj;
+		uint64_t txg = sds->sds_txg;
 
-		dsobj = strtonum(za->za_name, NULL);
-		VERIFY3U(0, ==, zap_remove_int(dp->dp_meta_objset,
-		    scn->scn_phys.scn_queue_obj, dsobj, tx));
+		scan_ds_queue_remove(scn, dsobj);
 
 		/* Set up min/max txg */
 		VERIFY3U(0, ==, dsl_dataset_hold_obj(dp, dsobj, FTAG, &ds));
-		if (za->za_first_integer != 0) {
+		if (txg != 0) {
 			scn->scn_phys.scn_cur_min_txg =
-			    MAX(scn->scn_phys.scn_min_txg,
-			    za->za_first_integer);
+			    MAX(scn->scn_phys.scn_min_txg, txg);
 		} else {
 			scn->scn_phys.scn_cur_min_txg =
 			    MAX(scn->scn_phys.scn_min_txg,
@@ -1541,14 +2133,9 @@ dsl_scan_visit(dsl_scan_t *scn, dmu_tx_t *tx)
 		dsl_dataset_rele(ds, FTAG);
 
 		dsl_scan_visitds(scn, dsobj, tx);
-		zap_cursor_fini(zc);
 		if (scn->scn_suspending)
-			goto out;
+			return;
 	}
-	zap_cursor_fini(zc);
-out:
-	kmem_free(za, sizeof (zap_attribute_t));
-	kmem_free(zc, sizeof (zap_cursor_t));
 }
 
 static boolean_t
@@ -1775,59 +2362,89 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 	if (scn->scn_phys.scn_state != DSS_SCANNING)
 		return;
 
-	if (scn->scn_done_txg == tx->tx_txg) {
+	/*
+	 * The scan is complete once the traversal is done and everything
+	 * it queued has been read.
+	 */
+	if (scn->scn_done_txg != 0 && scn->scn_done_txg <= tx->tx_txg &&
+	    scn->scn_bytes_pending == 0) {
 		ASSERT(!scn->scn_suspending);
 		/* finished with scan. */
 		zfs_dbgmsg("txg %llu scan complete", tx->tx_txg);
 		dsl_scan_done(scn, B_TRUE, tx);
 		ASSERT3U(spa->spa_scrub_inflight, ==, 0);
-		dsl_scan_sync_state(scn, tx);
+		dsl_scan_sync_state(scn, tx, SYNC_MANDATORY);
 		return;
 	}
 
 	if (dsl_scan_is_paused_scrub(scn))
 		return;
 
-	if (scn->scn_phys.scn_ddt_bookmark.ddb_class <=
-	    scn->scn_phys.scn_ddt_class_max) {
-		zfs_dbgmsg("doing scan sync txg %llu; "
-		    "ddt bm=%llu/%llu/%llu/%llx",
-		    (longlong_t)tx->tx_txg,
-		    (longlong_t)scn->scn_phys.scn_ddt_bookmark.ddb_class,
-		    (longlong_t)scn->scn_phys.scn_ddt_bookmark.ddb_type,
-		    (longlong_t)scn->scn_phys.scn_ddt_bookmark.ddb_checksum,
-		    (longlong_t)scn->scn_phys.scn_ddt_bookmark.ddb_cursor);
-		ASSERT(scn->scn_phys.scn_bookmark.zb_objset == 0);
-		ASSERT(scn->scn_phys.scn_bookmark.zb_object == 0);
-		ASSERT(scn->scn_phys.scn_bookmark.zb_level == 0);
-		ASSERT(scn->scn_phys.scn_bookmark.zb_blkid == 0);
-	} else {
-		zfs_dbgmsg("doing scan sync txg %llu; bm=%llu/%llu/%llu/%llu",
-		    (longlong_t)tx->tx_txg,
-		    (longlong_t)scn->scn_phys.scn_bookmark.zb_objset,
-		    (longlong_t)scn->scn_phys.scn_bookmark.zb_object,
-		    (longlong_t)scn->scn_phys.scn_bookmark.zb_level,
-		    (longlong_t)scn->scn_phys.scn_bookmark.zb_blkid);
+	if (scn->scn_bytes_pending != 0 && !scn->scn_checkpointing &&
+	    gethrtime() - scn->scn_last_checkpoint >
+	    SEC2NSEC(zfs_scan_checkpoint_intval)) {
+		zfs_dbgmsg("begin scan checkpoint txg %llu",
+		    (longlong_t)tx->tx_txg);
+		scn->scn_checkpointing = B_TRUE;
 	}
 
-	scn->scn_zio_root = zio_root(dp->dp_spa, NULL,
-	    NULL, ZIO_FLAG_CANFAIL);
-	dsl_pool_config_enter(dp, FTAG);
-	dsl_scan_visit(scn, tx);
-	dsl_pool_config_exit(dp, FTAG);
-	(void) zio_wait(scn->scn_zio_root);
-	scn->scn_zio_root = NULL;
-
-	zfs_dbgmsg("visited %llu blocks in %llums",
-	    (longlong_t)scn->scn_visited_this_txg,
-	    (longlong_t)NSEC2MSEC(gethrtime() - scn->scn_sync_start_time));
+	/*
+	 * Traverse the pool unless the traversal is complete or the sorted
+	 * queues have to be drained first.
+	 */
+	if (scn->scn_done_txg == 0 && !scn->scn_checkpointing &&
+	    !dsl_scan_should_clear(scn)) {
+		if (scn->scn_phys.scn_ddt_bookmark.ddb_class <=
+		    scn->scn_phys.scn_ddt_class_max) {
+			zfs_dbgmsg("doing scan sync txg %llu; "
+			    "ddt bm=%llu/%llu/%llu/%llx",
+			    (longlong_t)tx->tx_txg,
+			    (longlong_t)scn->scn_phys.scn_ddt_bookmark.ddb_class,
+			    (longlong_t)scn->scn_phys.scn_ddt_bookmark.ddb_type,
+			    (longlong_t)
+			    scn->scn_phys.scn_ddt_bookmark.ddb_checksum,
+			    (longlong_t)
+			    scn->scn_phys.scn_ddt_bookmark.ddb_cursor);
+			ASSERT(scn->scn_phys.scn_bookmark.zb_objset == 0);
+			ASSERT(scn->scn_phys.scn_bookmark.zb_object == 0);
+			ASSERT(scn->scn_phys.scn_bookmark.zb_level == 0);
+			ASSERT(scn->scn_phys.scn_bookmark.zb_blkid == 0);
+		} else {
+			zfs_dbgmsg("doing scan sync txg %llu; "
+			    "bm=%llu/%llu/%llu/%llu",
+			    (longlong_t)tx->tx_txg,
+			    (longlong_t)scn->scn_phys.scn_bookmark.zb_objset,
+			    (longlong_t)scn->scn_phys.scn_bookmark.zb_object,
+			    (longlong_t)scn->scn_phys.scn_bookmark.zb_level,
+			    (longlong_t)scn->scn_phys.scn_bookmark.zb_blkid);
+		}
 
-	if (!scn->scn_suspending) {
-		scn->scn_done_txg = tx->tx_txg + 1;
-		zfs_dbgmsg("txg %llu traversal complete, waiting till txg %llu",
-		    tx->tx_txg, scn->scn_done_txg);
+		scn->scn_zio_root = zio_root(dp->dp_spa, NULL,
+		    NULL, ZIO_FLAG_CANFAIL);
+		dsl_pool_config_enter(dp, FTAG);
+		dsl_scan_visit(scn, tx);
+		dsl_pool_config_exit(dp, FTAG);
+		(void) zio_wait(scn->scn_zio_root);
+		scn->scn_zio_root = NULL;
+
+		zfs_dbgmsg("visited %llu blocks in %llums; "
+		    "%llu bytes queued",
+		    (longlong_t)scn->scn_visited_this_txg,
+		    (longlong_t)NSEC2MSEC(gethrtime() -
+		    scn->scn_sync_start_time),
+		    (longlong_t)scn->scn_bytes_pending);
+
+		if (!scn->scn_suspending) {
+			scn->scn_done_txg = tx->tx_txg + 1;
+			zfs_dbgmsg("txg %llu traversal complete, "
+			    "waiting till txg %llu",
+			    tx->tx_txg, scn->scn_done_txg);
+		}
 	}
 
+	if (dsl_scan_should_issue(scn))
+		dsl_scan_issue_queues(scn);
+
 	if (DSL_SCAN_IS_SCRUB_RESILVER(scn)) {
 		mutex_enter(&spa->spa_scrub_lock);
 		while (spa->spa_scrub_inflight > 0) {
@@ -1837,7 +2454,7 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 		mutex_exit(&spa->spa_scrub_lock);
 	}
 
-	dsl_scan_sync_state(scn, tx);
+	dsl_scan_sync_state(scn, tx, SYNC_OPTIONAL);
 }
 
 /*
@@ -1939,17 +2556,303 @@ dsl_scan_scrub_done(zio_t *zio)
 	mutex_exit(&spa->spa_scrub_lock);
 }
 
+/*
+ * Read a block for the scan, waiting for a slot if too many scan I/Os are
+ * already in flight.
+ */
+static void
+scan_exec_io(dsl_pool_t *dp, const blkptr_t *bp, int zio_flags,
+    const zbookmark_phys_t *zb, uint64_t asize)
+{
+	spa_t *spa = dp->dp_spa;
+	size_t size = BP_GET_PSIZE(bp);
+	uint64_t maxinflight =
+	    spa->spa_root_vdev->vdev_children * zfs_top_maxinflight;
+	int scan_delay = (dp->dp_scan->scn_phys.scn_func == POOL_SCAN_SCRUB) ?
+	    zfs_scrub_delay : zfs_resilver_delay;
+
+	mutex_enter(&spa->spa_scrub_lock);
+	while (spa->spa_scrub_inflight >= maxinflight)
+		cv_wait(&spa->spa_scrub_io_cv, &spa->spa_scrub_lock);
+	spa->spa_scrub_inflight++;
+	mutex_exit(&spa->spa_scrub_lock);
+
+	/*
+	 * If we're seeing recent (zfs_scan_idle) "important" I/Os
+	 * then throttle our workload to limit the impact of a scan.
+	 */
+	if (ddi_get_lbolt64() - spa->spa_last_io <= zfs_scan_idle)
+		delay(scan_delay);
+
+	atomic_add_64(&spa->spa_scan_pass_issued, asize);
+	zio_nowait(zio_read(NULL, spa, bp,
+	    abd_alloc_for_io(size, B_FALSE), size, dsl_scan_scrub_done,
+	    NULL, ZIO_PRIORITY_SCRUB, zio_flags, zb));
+}
+
+static int
+scan_io_compare(const void *a, const void *b)
+{
+	uint64_t off_a = SIO_OFFSET((const scan_io_t *)a);
+	uint64_t off_b = SIO_OFFSET((const scan_io_t *)b);
+
+	if (off_a < off_b)
+		return (-1);
+	if (off_a > off_b)
+		return (1);
+	return (0);
+}
+
+static dsl_scan_io_queue_t *
+dsl_scan_io_queue_get(dsl_scan_t *scn, uint64_t id)
+{
+	dsl_scan_io_queue_t *queue;
+
+	ASSERT(MUTEX_HELD(&scn->scn_io_queues_lock));
+
+	if (id >= scn->scn_io_queues_cnt) {
+		uint64_t cnt = MAX(id + 1,
+		    scn->scn_dp->dp_spa->spa_root_vdev->vdev_children);
+		dsl_scan_io_queue_t **queues;
+
+		queues = kmem_zalloc(cnt * sizeof (*queues), KM_SLEEP);
+		if (scn->scn_io_queues != NULL) {
+			bcopy(scn->scn_io_queues, queues,
+			    scn->scn_io_queues_cnt * sizeof (*queues));
+			kmem_free(scn->scn_io_queues,
+			    scn->scn_io_queues_cnt * sizeof (*queues));
+		}
+		scn->scn_io_queues = queues;
+		scn->scn_io_queues_cnt = cnt;
+	}
+
+	if ((queue = scn->scn_io_queues[id]) == NULL) {
+		queue = kmem_zalloc(sizeof (dsl_scan_io_queue_t), KM_SLEEP);
+		avl_create(&queue->q_sios, scan_io_compare, sizeof (scan_io_t),
+		    offsetof(scan_io_t, sio_node));
+		scn->scn_io_queues[id] = queue;
+	}
+	return (queue);
+}
+
+static void
+dsl_scan_io_queues_destroy(dsl_scan_t *scn)
+{
+	uint64_t id;
+
+	for (id = 0; id < scn->scn_io_queues_cnt; id++) {
+		dsl_scan_io_queue_t *queue = scn->scn_io_queues[id];
+		void *cookie = NULL;
+		scan_io_t *sio;
+
+		if (queue == NULL)
+			continue;
+		while ((sio = avl_destroy_nodes(&queue->q_sios,
+		    &cookie)) != NULL)
+			kmem_free(sio, sizeof (scan_io_t));
+		avl_destroy(&queue->q_sios);
+		kmem_free(queue, sizeof (dsl_scan_io_queue_t));
+	}
+	if (scn->scn_io_queues != NULL) {
+		kmem_free(scn->scn_io_queues,
+		    scn->scn_io_queues_cnt * sizeof (dsl_scan_io_queue_t *));
+	}
+	scn->scn_io_queues = NULL;
+	scn->scn_io_queues_cnt = 0;
+	scn->scn_bytes_pending = 0;
+	scn->scn_queues_mem = 0;
+	scn->scn_clearing = B_FALSE;
+	scn->scn_checkpointing = B_FALSE;
+}
+
+/*
+ * Hand a block that needs to be read to the scan.  A sorted scan queues
+ * it on the top-level vdev of its first DVA, sorted by offset; any other
+ * copies are read along with it, so a damaged copy can still be repaired
+ * from the others.  Gang blocks are scattered over the pool and intent log
+ * blocks may live on a log device that is about to be removed, so both
+ * are read right away.
+ */
+static void
+dsl_scan_enqueue(dsl_pool_t *dp, const blkptr_t *bp, int zio_flags,
+    const zbookmark_phys_t *zb, uint64_t asize)
+{
+	dsl_scan_t *scn = dp->dp_scan;
+	dsl_scan_io_queue_t *queue;
+	scan_io_t *sio;
+	avl_index_t where;
+
+	if (!scn->scn_is_sorted || BP_IS_GANG(bp) ||
+	    zb->zb_level == ZB_ZIL_LEVEL) {
+		scan_exec_io(dp, bp, zio_flags, zb, asize);
+		return;
+	}
+
+	sio = kmem_alloc(sizeof (scan_io_t), KM_SLEEP);
+	sio->sio_bp = *bp;
+	sio->sio_zb = *zb;
+	sio->sio_asize = asize;
+	sio->sio_flags = zio_flags;
+
+	mutex_enter(&scn->scn_io_queues_lock);
+	queue = dsl_scan_io_queue_get(scn, DVA_GET_VDEV(&bp->blk_dva[0]));
+	if (avl_find(&queue->q_sios, sio, &where) != NULL) {
+		/* the block is already waiting to be read */
+		mutex_exit(&scn->scn_io_queues_lock);
+		kmem_free(sio, sizeof (scan_io_t));
+		atomic_add_64(&dp->dp_spa->spa_scan_pass_issued, asize);
+		return;
+	}
+	avl_insert(&queue->q_sios, sio, where);
+	scn->scn_bytes_pending += asize;
+	scn->scn_queues_mem += sizeof (scan_io_t);
+	mutex_exit(&scn->scn_io_queues_lock);
+}
+
+/*
+ * Take the next block of a queue's sweep: the first one at or after the
+ * cursor, wrapping around to the lowest offset once the end is reached.
+ */
+static scan_io_t *
+dsl_scan_io_queue_next(dsl_scan_t *scn, uint64_t id)
+{
+	dsl_scan_io_queue_t *queue;
+	scan_io_t search, *sio;
+	avl_index_t where;
+
+	mutex_enter(&scn->scn_io_queues_lock);
+	queue = scn->scn_io_queues[id];
+	if (queue == NULL || avl_numnodes(&queue->q_sios) == 0) {
+		mutex_exit(&scn->scn_io_queues_lock);
+		return (NULL);
+	}
+
+	bzero(&search.sio_bp.blk_dva[0], sizeof (dva_t));
+	DVA_SET_OFFSET(&search.sio_bp.blk_dva[0], queue->q_cursor);
+	sio = avl_find(&queue->q_sios, &search, &where);
+	if (sio == NULL)
+		sio = avl_nearest(&queue->q_sios, where, AVL_AFTER);
+	if (sio == NULL)
+		sio = avl_first(&queue->q_sios);
+
+	avl_remove(&queue->q_sios, sio);
+	queue->q_cursor = SIO_OFFSET(sio) +
+	    DVA_GET_ASIZE(&sio->sio_bp.blk_dva[0]);
+	scn->scn_bytes_pending -= sio->sio_asize;
+	scn->scn_queues_mem -= sizeof (scan_io_t);
+	mutex_exit(&scn->scn_io_queues_lock);
+
+	return (sio);
+}
+
+/*
+ * The sorted queues are issued while the traversal is stopped to free
+ * queue memory, to reach a checkpoint, or because it is complete.
+ */
+static boolean_t
+dsl_scan_should_issue(dsl_scan_t *scn)
+{
+	if (scn->scn_bytes_pending == 0 ||
+	    spa_shutting_down(scn->scn_dp->dp_spa))
+		return (B_FALSE);
+
+	return (dsl_scan_should_clear(scn) || scn->scn_checkpointing ||
+	    scn->scn_done_txg != 0);
+}
+
+/*
+ * Read queued blocks in offset order for the rest of this txg.  Each
+ * queue is swept like an elevator, one batch of zfs_top_maxinflight
+ * blocks at a time, and the top-level vdevs take turns so that all of
+ * them are kept busy.  Adjacent blocks reach the vdev queues together,
+ * where they are aggregated into large sequential reads.
+ */
+static void
+dsl_scan_issue_queues(dsl_scan_t *scn)
+{
+	uint64_t issued = 0;
+	uint64_t id;
+	boolean_t progress = B_TRUE;
+
+	while (progress && dsl_scan_should_issue(scn)) {
+		progress = B_FALSE;
+		for (id = 0; id < scn->scn_io_queues_cnt; id++) {
+			scan_io_t *sio;
+			int i;
+
+			for (i = 0; i < zfs_top_maxinflight; i++) {
+				if ((sio = dsl_scan_io_queue_next(scn,
+				    id)) == NULL)
+					break;
+				scan_exec_io(scn->scn_dp, &sio->sio_bp,
+				    sio->sio_flags, &sio->sio_zb,
+				    sio->sio_asize);
+				kmem_free(sio, sizeof (scan_io_t));
+				progress = B_TRUE;
+				issued++;
+			}
+			if (dsl_scan_txg_time_up(scn)) {
+				progress = B_FALSE;
+				break;
+			}
+		}
+	}
+
+	zfs_dbgmsg("issued %llu sorted blocks in %llums; %llu bytes queued",
+	    (longlong_t)issued,
+	    (longlong_t)NSEC2MSEC(gethrtime() - scn->scn_sync_start_time),
+	    (longlong_t)scn->scn_bytes_pending);
+}
+
+/*
+ * Called when a block is freed.  A block that is still waiting in a
+ * sorted queue is dropped: by the time it would be read, its space may
+ * have been reused, and the read would report a bogus checksum error.
+ */
+void
+dsl_scan_freed(spa_t *spa, const blkptr_t *bp)
+{
+	dsl_pool_t *dp = spa->spa_dsl_pool;
+	dsl_scan_t *scn;
+	dsl_scan_io_queue_t *queue;
+	scan_io_t search, *sio;
+	uint64_t id;
+
+	if (dp == NULL || (scn = dp->dp_scan) == NULL ||
+	    scn->scn_bytes_pending == 0 || BP_IS_EMBEDDED(bp) ||
+	    BP_IS_GANG(bp))
+		return;
+
+	id = DVA_GET_VDEV(&bp->blk_dva[0]);
+	search.sio_bp.blk_dva[0] = bp->blk_dva[0];
+
+	mutex_enter(&scn->scn_io_queues_lock);
+	if (id >= scn->scn_io_queues_cnt ||
+	    (queue = scn->scn_io_queues[id]) == NULL ||
+	    (sio = avl_find(&queue->q_sios, &search, NULL)) == NULL ||
+	    BP_PHYSICAL_BIRTH(&sio->sio_bp) != BP_PHYSICAL_BIRTH(bp)) {
+		mutex_exit(&scn->scn_io_queues_lock);
+		return;
+	}
+	avl_remove(&queue->q_sios, sio);
+	scn->scn_bytes_pending -= sio->sio_asize;
+	scn->scn_queues_mem -= sizeof (scan_io_t);
+	mutex_exit(&scn->scn_io_queues_lock);
+
+	atomic_add_64(&spa->spa_scan_pass_issued, sio->sio_asize);
+	kmem_free(sio, sizeof (scan_io_t));
+}
+
 static int
 dsl_scan_scrub_cb(dsl_pool_t *dp,
     const blkptr_t *bp, const zbookmark_phys_t *zb)
 {
 	dsl_scan_t *scn = dp->dp_scan;
-	size_t size = BP_GET_PSIZE(bp);
 	spa_t *spa = dp->dp_spa;
 	uint64_t phys_birth = BP_PHYSICAL_BIRTH(bp);
+	uint64_t asize = 0;
 	boolean_t needs_io = B_FALSE;
 	int zio_flags = ZIO_FLAG_SCAN_THREAD | ZIO_FLAG_RAW | ZIO_FLAG_CANFAIL;
-	int scan_delay = 0;
 	int d;
 
 	if (phys_birth <= scn->scn_phys.scn_min_txg ||
@@ -1965,12 +2868,10 @@ dsl_scan_scrub_cb(dsl_pool_t *dp,
 	if (scn->scn_phys.scn_func == POOL_SCAN_SCRUB) {
 		zio_flags |= ZIO_FLAG_SCRUB;
 		needs_io = B_TRUE;
-		scan_delay = zfs_scrub_delay;
 	} else {
 		ASSERT3U(scn->scn_phys.scn_func, ==, POOL_SCAN_RESILVER);
 		zio_flags |= ZIO_FLAG_RESILVER;
 		needs_io = B_FALSE;
-		scan_delay = zfs_resilver_delay;
 	}
 
 	/* If it's an intent log block, failure is expected. */
@@ -1985,6 +2886,7 @@ dsl_scan_scrub_cb(dsl_pool_t *dp,
 		 * Keep track of how much data we've examined so that
 		 * zpool(1M) status can make useful progress reports.
 		 */
+		asize += DVA_GET_ASIZE(&bp->blk_dva[d]);
 		scn->scn_phys.scn_examined += DVA_GET_ASIZE(&bp->blk_dva[d]);
 		spa->spa_scan_pass_exam += DVA_GET_ASIZE(&bp->blk_dva[d]);
 
@@ -2007,27 +2909,14 @@ dsl_scan_scrub_cb(dsl_pool_t *dp,
 		}
 	}
 
-	if (needs_io && !zfs_no_scrub_io) {
-		vdev_t *rvd = spa->spa_root_vdev;
-		uint64_t maxinflight = rvd->vdev_children * zfs_top_maxinflight;
-
-		mutex_enter(&spa->spa_scrub_lock);
-		while (spa->spa_scrub_inflight >= maxinflight)
-			cv_wait(&spa->spa_scrub_io_cv, &spa->spa_scrub_lock);
-		spa->spa_scrub_inflight++;
-		mutex_exit(&spa->spa_scrub_lock);
-
-		/*
-		 * If we're seeing recent (zfs_scan_idle) "important" I/Os
-		 * then throttle our workload to limit the impact of a scan.
-		 */
-		if (ddi_get_lbolt64() - spa->spa_last_io <= zfs_scan_idle)
-			delay(scan_delay);
-
-		zio_nowait(zio_read(NULL, spa, bp,
-		    abd_alloc_for_io(size, B_FALSE), size, dsl_scan_scrub_done,
-		    NULL, ZIO_PRIORITY_SCRUB, zio_flags, zb));
-	}
+	/*
+	 * Blocks that need no I/O are done as soon as they are examined, so
+	 * they count as issued right away.
+	 */
+	if (needs_io && !zfs_no_scrub_io)
+		dsl_scan_enqueue(dp, bp, zio_flags, zb, asize);
+	else
+		atomic_add_64(&spa->spa_scan_pass_issued, asize);
 
 	/* do not relocate this block */
 	return (0);
@@ -1878,4 +1878,38 @@ handle_is_solidstate_iokit(struct ldi_handle *lhp, int *isssd)
 	return (0);
 }
 
+int
+handle_unmap_iokit(struct ldi_handle *lhp, dkioc_free_t *dfl)
+{
+	IOStorageExtent extent;
+	IOReturn result;
+
+	/* Validate arguments */
+	if (!lhp || !dfl) {
+		return (EINVAL);
+	}
+
+	/* Validate IOMedia */
+	if (!OSDynamicCast(IOMedia, LH_MEDIA(lhp))) {
+		dprintf("%s invalid IOKit handle\n", __func__);
+		return (ENODEV);
+	}
+
+	extent.byteStart = dfl->df_start;
+	extent.byteCount = dfl->df_length;
+
+	LH_MEDIA(lhp)->retain();
+	result = LH_MEDIA(lhp)->unmap(LH_CLIENT(lhp), &extent, 1);
+	LH_MEDIA(lhp)->release();
+
+	if (result == kIOReturnUnsupported) {
+		return (ENOTSUP);
+	} else if (result != kIOReturnSuccess) {
+		dprintf("%s unmap failed %x\n", __func__, result);
+		return (EIO);
+	}
+
+	return (0);
+}
+
 } /* extern "C" */
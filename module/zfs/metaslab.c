@@ -33,6 +33,7 @@
 #include <sys/zio.h>
 #include <sys/spa_impl.h>
 #include <sys/zfeature.h>
+#include <sys/zap.h>
 
 #define	WITH_DF_BLOCK_ALLOCATOR
 
@@ -195,8 +196,20 @@ boolean_t metaslab_trace_enabled = B_TRUE;
  */
 uint64_t metaslab_trace_max_entries = 5000;
 
+/*
+ * Free ranges are TRIMmed in extents of at most zfs_trim_extent_bytes_max
+ * bytes. Autotrim skips freed ranges smaller than zfs_trim_extent_bytes_min,
+ * which are likely to be allocated again before a TRIM would do any good,
+ * and only issues a metaslab's freed ranges once every zfs_trim_txg_batch
+ * txgs so that they have a chance to coalesce.
+ */
+uint64_t zfs_trim_extent_bytes_max = 128 << 20;
+uint64_t zfs_trim_extent_bytes_min = 32 << 10;
+int zfs_trim_txg_batch = 32;
+
 static uint64_t metaslab_weight(metaslab_t *);
 static void metaslab_set_fragmentation(metaslab_t *);
+static uint64_t metaslab_allocated_space(metaslab_t *);
 
 kmem_cache_t *metaslab_alloc_trace_cache;
 
@@ -467,12 +480,21 @@ metaslab_verify_space(metaslab_t *msp, uint64_t txg)
 	 * allocations in the future.
 	 */
 	if (txg != spa_syncing_txg(spa) || msp->ms_sm == NULL ||
-	    !msp->ms_loaded)
+	    !msp->ms_loaded || msp->ms_flushed_txg == txg)
 		return;
 
-	sm_free_space = msp->ms_size - space_map_allocated(msp->ms_sm) -
+	sm_free_space = msp->ms_size - metaslab_allocated_space(msp) -
 	    space_map_alloc_delta(msp->ms_sm);
 
+	/*
+	 * What this txg wrote to the log space map is neither in the space
+	 * map's alloc delta nor in the unflushed trees yet.
+	 */
+	if (msp->ms_logged_txg == txg) {
+		sm_free_space += range_tree_space(msp->ms_freedtree) -
+		    range_tree_space(msp->ms_loggedtree);
+	}
+
 	/*
 	 * Account for future allocations since we would have already
 	 * deducted that space from the ms_freetree.
@@ -483,7 +505,8 @@ metaslab_verify_space(metaslab_t *msp, uint64_t txg)
 	}
 
 	msp_free_space = range_tree_space(msp->ms_tree) + allocated +
-	    msp->ms_deferspace + range_tree_space(msp->ms_freedtree);
+	    msp->ms_deferspace + range_tree_space(msp->ms_freedtree) +
+	    range_tree_space(msp->ms_trimming);
 
 	VERIFY3U(sm_free_space, ==, msp_free_space);
 }
@@ -876,11 +899,12 @@ metaslab_group_allocatable(metaslab_group_t *mg, metaslab_group_t *rotor,
 
 	/*
 	 * We can only consider skipping this metaslab group if it's
-	 * in the normal metaslab class and there are other metaslab
-	 * groups to select from. Otherwise, we always consider it eligible
-	 * for allocations.
+	 * in a data metaslab class (normal, special or dedup) and there are
+	 * other metaslab groups to select from. Otherwise, we always consider
+	 * it eligible for allocations.
 	 */
-	if (mc != spa_normal_class(spa) || mc->mc_groups <= 1)
+	if ((mc != spa_normal_class(spa) && mc != spa_special_class(spa) &&
+	    mc != spa_dedup_class(spa)) || mc->mc_groups <= 1)
 		return (B_TRUE);
 
 	/*
@@ -1382,10 +1406,25 @@ metaslab_load(metaslab_t *msp)
 		ASSERT3P(msp->ms_group, !=, NULL);
 		msp->ms_loaded = B_TRUE;
 
+		/*
+		 * Apply the changes that are only in the log space maps.
+		 */
+		range_tree_walk(msp->ms_unflushed_allocs,
+		    range_tree_remove, msp->ms_tree);
+		range_tree_walk(msp->ms_unflushed_frees,
+		    range_tree_add, msp->ms_tree);
+
 		for (t = 0; t < TXG_DEFER_SIZE; t++) {
 			range_tree_walk(msp->ms_defertree[t],
 			    range_tree_remove, msp->ms_tree);
 		}
+
+		/*
+		 * Space that is being TRIMmed is free on disk, but must not
+		 * be allocated until the TRIM completes.
+		 */
+		range_tree_walk(msp->ms_trimming, range_tree_remove,
+		    msp->ms_tree);
 		msp->ms_max_size = metaslab_block_maxsize(msp);
 	}
 	cv_broadcast(&msp->ms_load_cv);
@@ -1402,6 +1441,191 @@ metaslab_unload(metaslab_t *msp)
 	msp->ms_max_size = 0;
 }
 
+/*
+ * ==========================================================================
+ * Log space map support
+ * ==========================================================================
+ */
+
+/*
+ * Return the space allocated in the metaslab as of the last synced txg,
+ * including the allocs and frees that are only in the log space maps.
+ */
+static uint64_t
+metaslab_allocated_space(metaslab_t *msp)
+{
+	return (space_map_allocated(msp->ms_sm) +
+	    range_tree_space(msp->ms_unflushed_allocs) -
+	    range_tree_space(msp->ms_unflushed_frees));
+}
+
+static uint64_t
+metaslab_unflushed_segs(metaslab_t *msp)
+{
+	return (avl_numnodes(&msp->ms_unflushed_allocs->rt_root) +
+	    avl_numnodes(&msp->ms_unflushed_frees->rt_root));
+}
+
+/*
+ * Set the txg of the oldest log space map that the metaslab's unflushed
+ * changes came from, and move the metaslab in spa_metaslabs_by_flushed.
+ */
+void
+metaslab_unflushed_txg_update(metaslab_t *msp, uint64_t txg)
+{
+	spa_t *spa = msp->ms_group->mg_vd->vdev_spa;
+
+	mutex_enter(&spa->spa_flushed_ms_lock);
+	if (msp->ms_unflushed_txg != 0)
+		avl_remove(&spa->spa_metaslabs_by_flushed, msp);
+	msp->ms_unflushed_txg = txg;
+	if (txg != 0)
+		avl_add(&spa->spa_metaslabs_by_flushed, msp);
+	mutex_exit(&spa->spa_flushed_ms_lock);
+}
+
+/*
+ * Record a logged alloc or free in the unflushed trees.  Whatever part
+ * of it undoes an earlier unflushed change (e.g. the free of a block that
+ * was allocated since the last flush) cancels out instead, so that the
+ * two trees never overlap and the space map plus the trees describe the
+ * metaslab.
+ */
+void
+metaslab_unflushed_add(metaslab_t *msp, uint64_t start, uint64_t size,
+    maptype_t maptype)
+{
+	range_tree_t *add, *cancel;
+	uint64_t end = start + size;
+	uint64_t ostart, osize;
+
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+
+	if (maptype == SM_ALLOC) {
+		add = msp->ms_unflushed_allocs;
+		cancel = msp->ms_unflushed_frees;
+	} else {
+		add = msp->ms_unflushed_frees;
+		cancel = msp->ms_unflushed_allocs;
+	}
+
+	while (start < end &&
+	    range_tree_find_in(cancel, start, end - start, &ostart, &osize)) {
+		if (ostart > start)
+			range_tree_add(add, start, ostart - start);
+		range_tree_remove(cancel, ostart, osize);
+		start = ostart + osize;
+	}
+	if (start < end)
+		range_tree_add(add, start, end - start);
+}
+
+static void
+metaslab_unflushed_alloc(void *arg, uint64_t start, uint64_t size)
+{
+	metaslab_unflushed_add(arg, start, size, SM_ALLOC);
+}
+
+static void
+metaslab_unflushed_free(void *arg, uint64_t start, uint64_t size)
+{
+	metaslab_unflushed_add(arg, start, size, SM_FREE);
+}
+
+/*
+ * Persist the unflushed txg of the metaslab in its vdev's array, which is
+ * where spa_log_sm_load() finds which logs still apply to it.
+ */
+static void
+metaslab_unflushed_txg_persist(metaslab_t *msp, uint64_t txg, dmu_tx_t *tx)
+{
+	vdev_t *vd = msp->ms_group->mg_vd;
+	objset_t *mos = spa_meta_objset(vd->vdev_spa);
+
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+	ASSERT3U(vd->vdev_top_zap, !=, 0);
+
+	mutex_exit(&msp->ms_lock);
+	if (vd->vdev_ms_unflushed_obj == 0) {
+		vd->vdev_ms_unflushed_obj = dmu_object_alloc(mos,
+		    DMU_OTN_UINT64_METADATA, 0, DMU_OT_NONE, 0, tx);
+		VERIFY0(zap_add(mos, vd->vdev_top_zap,
+		    VDEV_TOP_ZAP_MS_UNFLUSHED_PHYS_TXGS, sizeof (uint64_t), 1,
+		    &vd->vdev_ms_unflushed_obj, tx));
+	}
+	dmu_write(mos, vd->vdev_ms_unflushed_obj,
+	    msp->ms_id * sizeof (uint64_t), sizeof (uint64_t), &txg, tx);
+	mutex_enter(&msp->ms_lock);
+}
+
+/*
+ * Decide whether this txg's changes to the metaslab go to the log space
+ * map instead of its own space map.  Log devices keep writing their space
+ * maps directly, so that they can still be removed.
+ */
+static boolean_t
+metaslab_use_log(metaslab_t *msp, uint64_t txg)
+{
+	vdev_t *vd = msp->ms_group->mg_vd;
+
+	return (spa_log_sm_syncing(vd->vdev_spa, txg) &&
+	    msp->ms_flush_txg != txg && vd->vdev_top_zap != 0 &&
+	    !vd->vdev_islog && !vd->vdev_removing);
+}
+
+/*
+ * Fold this txg's logged changes into the unflushed trees, or empty them
+ * if the metaslab was flushed.  Returns the change in allocated space.
+ */
+static int64_t
+metaslab_unflushed_sync_done(metaslab_t *msp, uint64_t txg)
+{
+	spa_t *spa = msp->ms_group->mg_vd->vdev_spa;
+	int64_t before = range_tree_space(msp->ms_unflushed_allocs) -
+	    range_tree_space(msp->ms_unflushed_frees);
+	uint64_t segs = metaslab_unflushed_segs(msp);
+
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+
+	if (txg == 0)
+		return (0);
+
+	if (msp->ms_flushed_txg == txg) {
+		ASSERT0(range_tree_space(msp->ms_loggedtree));
+		range_tree_vacate(msp->ms_unflushed_allocs, NULL, NULL);
+		range_tree_vacate(msp->ms_unflushed_frees, NULL, NULL);
+		metaslab_unflushed_txg_update(msp, 0);
+	} else if (msp->ms_logged_txg == txg) {
+		range_tree_vacate(msp->ms_loggedtree,
+		    metaslab_unflushed_alloc, msp);
+		range_tree_walk(msp->ms_freedtree, metaslab_unflushed_free, msp);
+		if (msp->ms_unflushed_txg == 0)
+			metaslab_unflushed_txg_update(msp, txg);
+	}
+
+	spa->spa_unflushed_segs += metaslab_unflushed_segs(msp) - segs;
+
+	return (range_tree_space(msp->ms_unflushed_allocs) -
+	    range_tree_space(msp->ms_unflushed_frees) - before);
+}
+
+/*
+ * Called by spa_log_sm_load() once all logs have been replayed, to
+ * account for the replayed changes.
+ */
+void
+metaslab_unflushed_load_done(metaslab_t *msp)
+{
+	vdev_t *vd = msp->ms_group->mg_vd;
+
+	mutex_enter(&msp->ms_lock);
+	vd->vdev_spa->spa_unflushed_segs += metaslab_unflushed_segs(msp);
+	vdev_space_update(vd, range_tree_space(msp->ms_unflushed_allocs) -
+	    range_tree_space(msp->ms_unflushed_frees), 0, 0);
+	metaslab_group_sort(msp->ms_group, msp, metaslab_weight(msp));
+	mutex_exit(&msp->ms_lock);
+}
+
 int
 metaslab_init(metaslab_group_t *mg, uint64_t id, uint64_t object, uint64_t txg,
     metaslab_t **msp)
@@ -1414,6 +1638,7 @@ metaslab_init(metaslab_group_t *mg, uint64_t id, uint64_t object, uint64_t txg,
 	ms = kmem_zalloc(sizeof (metaslab_t), KM_SLEEP);
 	mutex_init(&ms->ms_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&ms->ms_load_cv, NULL, CV_DEFAULT, NULL);
+	cv_init(&ms->ms_trim_cv, NULL, CV_DEFAULT, NULL);
 	ms->ms_id = id;
 	ms->ms_start = id << vd->vdev_ms_shift;
 	ms->ms_size = 1ULL << vd->vdev_ms_shift;
@@ -1442,6 +1667,10 @@ metaslab_init(metaslab_group_t *mg, uint64_t id, uint64_t object, uint64_t txg,
 	 * data fault on any attempt to use this metaslab before it's ready.
 	 */
 	ms->ms_tree = range_tree_create(&metaslab_rt_ops, ms, &ms->ms_lock);
+	ms->ms_unflushed_allocs = range_tree_create(NULL, ms, &ms->ms_lock);
+	ms->ms_unflushed_frees = range_tree_create(NULL, ms, &ms->ms_lock);
+	ms->ms_trimtree = range_tree_create(NULL, ms, &ms->ms_lock);
+	ms->ms_trimming = range_tree_create(NULL, ms, &ms->ms_lock);
 	metaslab_group_add(mg, ms);
 
 	metaslab_set_fragmentation(ms);
@@ -1485,12 +1714,20 @@ metaslab_fini(metaslab_t *msp)
 	int t;
 
 	metaslab_group_t *mg = msp->ms_group;
+	spa_t *spa = mg->mg_vd->vdev_spa;
 
+	/*
+	 * The flushed order compares vdev ids, so this must be done
+	 * while the metaslab still has its group.
+	 */
+	metaslab_unflushed_txg_update(msp, 0);
 	metaslab_group_remove(mg, msp);
 
 	mutex_enter(&msp->ms_lock);
+	while (msp->ms_trim_zio != NULL)
+		cv_wait(&msp->ms_trim_cv, &msp->ms_lock);
 	VERIFY(msp->ms_group == NULL);
-	vdev_space_update(mg->mg_vd, -space_map_allocated(msp->ms_sm),
+	vdev_space_update(mg->mg_vd, -metaslab_allocated_space(msp),
 	    0, -msp->ms_size);
 	space_map_close(msp->ms_sm);
 
@@ -1498,6 +1735,16 @@ metaslab_fini(metaslab_t *msp)
 	range_tree_destroy(msp->ms_tree);
 	range_tree_destroy(msp->ms_freeingtree);
 	range_tree_destroy(msp->ms_freedtree);
+	range_tree_destroy(msp->ms_loggedtree);
+
+	spa->spa_unflushed_segs -= metaslab_unflushed_segs(msp);
+	range_tree_vacate(msp->ms_unflushed_allocs, NULL, NULL);
+	range_tree_destroy(msp->ms_unflushed_allocs);
+	range_tree_vacate(msp->ms_unflushed_frees, NULL, NULL);
+	range_tree_destroy(msp->ms_unflushed_frees);
+	range_tree_vacate(msp->ms_trimtree, NULL, NULL);
+	range_tree_destroy(msp->ms_trimtree);
+	range_tree_destroy(msp->ms_trimming);
 
 	for (t = 0; t < TXG_SIZE; t++) {
 		range_tree_destroy(msp->ms_alloctree[t]);
@@ -1511,6 +1758,7 @@ metaslab_fini(metaslab_t *msp)
 
 	mutex_exit(&msp->ms_lock);
 	cv_destroy(&msp->ms_load_cv);
+	cv_destroy(&msp->ms_trim_cv);
 	mutex_destroy(&msp->ms_lock);
 
 	kmem_free(msp, sizeof (metaslab_t));
@@ -1654,7 +1902,7 @@ metaslab_space_weight(metaslab_t *msp)
 	/*
 	 * The baseline weight is the metaslab's free space.
 	 */
-	space = msp->ms_size - space_map_allocated(msp->ms_sm);
+	space = msp->ms_size - metaslab_allocated_space(msp);
 
 	if (metaslab_fragmentation_factor_enabled &&
 	    msp->ms_fragmentation != ZFS_FRAG_INVALID) {
@@ -1790,7 +2038,7 @@ metaslab_segment_weight(metaslab_t *msp)
 	/*
 	 * The metaslab is completely free.
 	 */
-	if (space_map_allocated(msp->ms_sm) == 0) {
+	if (metaslab_allocated_space(msp) == 0) {
 		int idx = highbit64(msp->ms_size) - 1;
 		int max_idx = SPACE_MAP_HISTOGRAM_SIZE + shift - 1;
 
@@ -1812,7 +2060,7 @@ metaslab_segment_weight(metaslab_t *msp)
 	/*
 	 * If the metaslab is fully allocated then just make the weight 0.
 	 */
-	if (space_map_allocated(msp->ms_sm) == msp->ms_size)
+	if (metaslab_allocated_space(msp) == msp->ms_size)
 		return (0);
 	/*
 	 * If the metaslab is already loaded, then use the range tree to
@@ -1882,7 +2130,7 @@ metaslab_weight(metaslab_t *msp)
 	 * for us to do here.
 	 */
 	if (vd->vdev_removing) {
-		ASSERT0(space_map_allocated(msp->ms_sm));
+		ASSERT0(metaslab_allocated_space(msp));
 		ASSERT0(vd->vdev_ms_shift);
 		return (0);
 	}
@@ -2165,6 +2413,11 @@ metaslab_condense(metaslab_t *msp, uint64_t txg, dmu_tx_t *tx)
 		    range_tree_remove, condense_tree);
 	}
 
+	/*
+	 * Space being TRIMmed is free, but it is not in the ms_tree.
+	 */
+	range_tree_walk(msp->ms_trimming, range_tree_remove, condense_tree);
+
 	/*
 	 * We're about to drop the metaslab's lock thus allowing
 	 * other consumers to change it's content. Set the
@@ -2195,9 +2448,173 @@ metaslab_condense(metaslab_t *msp, uint64_t txg, dmu_tx_t *tx)
 	range_tree_destroy(condense_tree);
 
 	space_map_write(sm, msp->ms_tree, SM_FREE, tx);
+	space_map_write(sm, msp->ms_trimming, SM_FREE, tx);
 	msp->ms_condensing = B_FALSE;
 }
 
+/*
+ * ==========================================================================
+ * TRIM of free space
+ * ==========================================================================
+ */
+
+static void
+metaslab_trim_done(zio_t *zio)
+{
+	metaslab_t *msp = zio->io_private;
+	spa_t *spa = zio->io_spa;
+
+	mutex_enter(&msp->ms_lock);
+	ASSERT3P(msp->ms_trim_zio, ==, zio);
+	range_tree_vacate(msp->ms_trimming,
+	    msp->ms_loaded ? range_tree_add : NULL, msp->ms_tree);
+	if (msp->ms_loaded)
+		msp->ms_max_size = metaslab_block_maxsize(msp);
+	msp->ms_trim_zio = NULL;
+	cv_broadcast(&msp->ms_trim_cv);
+	mutex_exit(&msp->ms_lock);
+
+	spa_config_exit(spa, SCL_ZIO, msp);
+}
+
+/*
+ * Move a free range out of the allocatable space for the duration of
+ * the metaslab's TRIM zio, and add TRIMs for it as children of that zio.
+ */
+static void
+metaslab_trim_add(metaslab_t *msp, uint64_t start, uint64_t size)
+{
+	vdev_t *vd = msp->ms_group->mg_vd;
+	spa_t *spa = vd->vdev_spa;
+	uint64_t extent = MAX(P2ALIGN(zfs_trim_extent_bytes_max,
+	    1ULL << vd->vdev_ashift), 1ULL << vd->vdev_ashift);
+
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+	ASSERT3P(msp->ms_trim_zio, !=, NULL);
+
+	if (msp->ms_loaded)
+		range_tree_remove(msp->ms_tree, start, size);
+	range_tree_clear(msp->ms_trimtree, start, size);
+	range_tree_add(msp->ms_trimming, start, size);
+
+	while (size != 0) {
+		uint64_t len = MIN(size, extent);
+
+		zio_nowait(zio_trim(msp->ms_trim_zio, spa, vd, start, len, 0));
+		start += len;
+		size -= len;
+	}
+}
+
+/*
+ * Start TRIMming the ranges of 'rt' that are at least 'min' bytes long,
+ * emptying 'rt'.  The caller must hold SCL_ZIO as reader; the hold is
+ * passed to the TRIM zio, which is returned for the caller to issue once
+ * it has dropped the ms_lock.
+ */
+static zio_t *
+metaslab_trim_start(metaslab_t *msp, range_tree_t *rt, uint64_t min,
+    uint64_t txg)
+{
+	spa_t *spa = msp->ms_group->mg_vd->vdev_spa;
+	range_seg_t *rs;
+
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+	ASSERT(spa_config_held(spa, SCL_ZIO, RW_READER));
+	ASSERT3P(msp->ms_trim_zio, ==, NULL);
+	ASSERT0(range_tree_space(msp->ms_trimming));
+
+	msp->ms_trim_zio = zio_root(spa, metaslab_trim_done, msp,
+	    ZIO_FLAG_CANFAIL);
+	msp->ms_trim_txg = txg;
+
+	while ((rs = avl_first(&rt->rt_root)) != NULL) {
+		uint64_t start = rs->rs_start;
+		uint64_t size = rs->rs_end - rs->rs_start;
+
+		range_tree_remove(rt, start, size);
+		if (size >= min)
+			metaslab_trim_add(msp, start, size);
+	}
+
+	return (msp->ms_trim_zio);
+}
+
+/*
+ * TRIM up to 'limit' bytes of the metaslab's free space at or after
+ * '*cursor', and wait for it.  The cursor is advanced past what was
+ * TRIMmed, or to the end of the metaslab once there is nothing left.
+ * Returns the number of bytes TRIMmed.
+ */
+uint64_t
+metaslab_trim_manual(metaslab_t *msp, uint64_t *cursor, uint64_t limit)
+{
+	vdev_t *vd = msp->ms_group->mg_vd;
+	spa_t *spa = vd->vdev_spa;
+	uint64_t end = msp->ms_start + msp->ms_size;
+	uint64_t trimmed = 0;
+	range_tree_t *rt;
+	range_seg_t *rs, rsearch;
+	avl_index_t where;
+	zio_t *zio = NULL;
+
+	ASSERT3U(*cursor, >=, msp->ms_start);
+
+	spa_config_enter(spa, SCL_ZIO, msp, RW_READER);
+	mutex_enter(&msp->ms_lock);
+
+	while (msp->ms_trim_zio != NULL)
+		cv_wait(&msp->ms_trim_cv, &msp->ms_lock);
+
+	/*
+	 * A metaslab that was just added has no space until its first
+	 * sync, and one that can't be loaded can't tell us what's free.
+	 */
+	metaslab_load_wait(msp);
+	if (msp->ms_freedtree == NULL ||
+	    (!msp->ms_loaded && metaslab_load(msp) != 0)) {
+		mutex_exit(&msp->ms_lock);
+		spa_config_exit(spa, SCL_ZIO, msp);
+		*cursor = end;
+		return (0);
+	}
+	msp->ms_selected_txg = spa_syncing_txg(spa);
+
+	rt = range_tree_create(NULL, NULL, &msp->ms_lock);
+
+	rsearch.rs_start = *cursor;
+	rsearch.rs_end = *cursor + 1;
+	rs = avl_find(&msp->ms_tree->rt_root, &rsearch, &where);
+	if (rs == NULL)
+		rs = avl_nearest(&msp->ms_tree->rt_root, where, AVL_AFTER);
+
+	for (; rs != NULL; rs = AVL_NEXT(&msp->ms_tree->rt_root, rs)) {
+		uint64_t start = MAX(rs->rs_start, *cursor);
+		uint64_t size = P2ALIGN(MIN(rs->rs_end - start,
+		    limit - trimmed), 1ULL << vd->vdev_ashift);
+
+		if (size == 0)
+			break;
+		range_tree_add(rt, start, size);
+		trimmed += size;
+		*cursor = start + size;
+	}
+	if (rs == NULL)
+		*cursor = end;
+
+	if (trimmed != 0)
+		zio = metaslab_trim_start(msp, rt, 0, spa_syncing_txg(spa));
+	range_tree_destroy(rt);
+	mutex_exit(&msp->ms_lock);
+
+	if (zio != NULL)
+		(void) zio_wait(zio);
+	else
+		spa_config_exit(spa, SCL_ZIO, msp);
+
+	return (trimmed);
+}
+
 /*
  * Write a metaslab to disk in the context of the specified transaction group.
  */
@@ -2211,6 +2628,7 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 	range_tree_t *alloctree = msp->ms_alloctree[txg & TXG_MASK];
 	dmu_tx_t *tx;
 	uint64_t object = space_map_object(msp->ms_sm);
+	boolean_t logging, flushing;
 
 	ASSERT(!vd->vdev_ishole);
 
@@ -2229,12 +2647,13 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 	/*
 	 * Normally, we don't want to process a metaslab if there
 	 * are no allocations or frees to perform. However, if the metaslab
-	 * is being forced to condense and it's loaded, we need to let it
-	 * through.
+	 * is being forced to condense and it's loaded, or if it has been
+	 * selected to be flushed, we need to let it through.
 	 */
 	if (range_tree_space(alloctree) == 0 &&
 	    range_tree_space(msp->ms_freeingtree) == 0 &&
-	    !(msp->ms_loaded && msp->ms_condense_wanted))
+	    !(msp->ms_loaded && msp->ms_condense_wanted) &&
+	    msp->ms_flush_txg != txg)
 		return;
 
 
@@ -2266,6 +2685,47 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 
 	mutex_enter(&msp->ms_lock);
 
+	/*
+	 * A metaslab that doesn't log this txg must first write out the
+	 * changes it has in the log space maps, since they are older than
+	 * the ones it's about to write.  This is done once per txg.
+	 */
+	logging = metaslab_use_log(msp, txg);
+	flushing = !logging && msp->ms_unflushed_txg != 0 &&
+	    msp->ms_flushed_txg != txg;
+
+	if (logging) {
+		if (range_tree_space(alloctree) != 0 ||
+		    range_tree_space(msp->ms_freeingtree) != 0) {
+			spa_log_sm_write(spa, vd->vdev_id, alloctree,
+			    SM_ALLOC, tx);
+			spa_log_sm_write(spa, vd->vdev_id,
+			    msp->ms_freeingtree, SM_FREE, tx);
+			if (msp->ms_unflushed_txg == 0 &&
+			    msp->ms_logged_txg != txg)
+				metaslab_unflushed_txg_persist(msp, txg, tx);
+			msp->ms_logged_txg = txg;
+		}
+
+		/*
+		 * The space map and its histogram are left as they are
+		 * until the metaslab is flushed.
+		 */
+		range_tree_vacate(msp->ms_freeingtree,
+		    range_tree_add, msp->ms_freedtree);
+		range_tree_vacate(alloctree, range_tree_add,
+		    msp->ms_loggedtree);
+		mutex_exit(&msp->ms_lock);
+
+		if (object != space_map_object(msp->ms_sm)) {
+			object = space_map_object(msp->ms_sm);
+			dmu_write(mos, vd->vdev_ms_array, sizeof (uint64_t) *
+			    msp->ms_id, sizeof (uint64_t), &object, tx);
+		}
+		dmu_tx_commit(tx);
+		return;
+	}
+
 	/*
 	 * Note: metaslab_condense() clears the space map's histogram.
 	 * Therefore we muse verify and remove this histogram before
@@ -2277,12 +2737,31 @@ metaslab_sync(metaslab_t *msp, uint64_t txg)
 
 	if (msp->ms_loaded && spa_sync_pass(spa) == 1 &&
 	    metaslab_should_condense(msp)) {
+		/*
+		 * The in-core free tree already includes the unflushed
+		 * changes, so condensing flushes them too.
+		 */
 		metaslab_condense(msp, txg, tx);
 	} else {
+		if (flushing) {
+			space_map_write(msp->ms_sm, msp->ms_unflushed_allocs,
+			    SM_ALLOC, tx);
+			space_map_write(msp->ms_sm, msp->ms_unflushed_frees,
+			    SM_FREE, tx);
+			if (!msp->ms_loaded) {
+				space_map_histogram_add(msp->ms_sm,
+				    msp->ms_unflushed_frees, tx);
+			}
+		}
 		space_map_write(msp->ms_sm, alloctree, SM_ALLOC, tx);
 		space_map_write(msp->ms_sm, msp->ms_freeingtree, SM_FREE, tx);
 	}
 
+	if (flushing) {
+		metaslab_unflushed_txg_persist(msp, 0, tx);
+		msp->ms_flushed_txg = txg;
+	}
+
 	if (msp->ms_loaded) {
 		/*
 		 * When the space map is loaded, we have an accruate
@@ -2367,8 +2846,9 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 	vdev_t *vd = mg->mg_vd;
 	spa_t *spa = vd->vdev_spa;
 	range_tree_t **defer_tree;
-	int64_t alloc_delta, defer_delta;
+	int64_t alloc_delta, defer_delta, unflushed_delta;
 	boolean_t defer_allowed = B_TRUE;
+	zio_t *trim_zio = NULL;
 	int t;
 
 	ASSERT(!vd->vdev_ishole);
@@ -2395,6 +2875,10 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 		msp->ms_freedtree = range_tree_create(NULL, msp,
 		    &msp->ms_lock);
 
+		ASSERT3P(msp->ms_loggedtree, ==, NULL);
+		msp->ms_loggedtree = range_tree_create(NULL, msp,
+		    &msp->ms_lock);
+
 		for (t = 0; t < TXG_DEFER_SIZE; t++) {
 			ASSERT(msp->ms_defertree[t] == NULL);
 
@@ -2407,6 +2891,15 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 
 	defer_tree = &msp->ms_defertree[txg % TXG_DEFER_SIZE];
 
+	/*
+	 * If there's a metaslab_load() in progress, wait for it to complete
+	 * so that we have a consistent view of the in-core space map.  The
+	 * unflushed trees are updated along with the space map's synced
+	 * length below, so a load never sees one without the other.
+	 */
+	metaslab_load_wait(msp);
+	unflushed_delta = metaslab_unflushed_sync_done(msp, txg);
+
 	uint64_t free_space = metaslab_class_get_space(spa_normal_class(spa)) -
 	    metaslab_class_get_alloc(spa_normal_class(spa));
 	if (free_space <= spa_get_slop_space(spa)) {
@@ -2414,7 +2907,7 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 	}
 
 	defer_delta = 0;
-	alloc_delta = space_map_alloc_delta(msp->ms_sm);
+	alloc_delta = space_map_alloc_delta(msp->ms_sm) + unflushed_delta;
 	if (defer_allowed) {
 		defer_delta = range_tree_space(msp->ms_freedtree) -
 		    range_tree_space(*defer_tree);
@@ -2424,18 +2917,26 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 
 	vdev_space_update(vd, alloc_delta + defer_delta, defer_delta, 0);
 
-	/*
-	 * If there's a metaslab_load() in progress, wait for it to complete
-	 * so that we have a consistent view of the in-core space map.
-	 */
-	metaslab_load_wait(msp);
-
 	/*
 	 * Move the frees from the defer_tree back to the free
 	 * range tree (if it's loaded). Swap the freed_tree and the
 	 * defer_tree -- this is safe to do because we've just emptied out
 	 * the defer_tree.
 	 */
+	/*
+	 * With autotrim on, remember what is becoming allocatable again
+	 * so that it can be TRIMmed if it's still free in a few txgs.
+	 */
+	if (spa->spa_autotrim) {
+		range_tree_walk(*defer_tree, range_tree_add, msp->ms_trimtree);
+		if (!defer_allowed) {
+			range_tree_walk(msp->ms_freedtree, range_tree_add,
+			    msp->ms_trimtree);
+		}
+	} else {
+		range_tree_vacate(msp->ms_trimtree, NULL, NULL);
+	}
+
 	range_tree_vacate(*defer_tree,
 	    msp->ms_loaded ? range_tree_add : NULL, msp->ms_tree);
 	if (defer_allowed) {
@@ -2479,7 +2980,24 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 			metaslab_unload(msp);
 	}
 
+	/*
+	 * Issue the autotrim batch once it has had zfs_trim_txg_batch txgs
+	 * to coalesce, or once this metaslab stops being synced.  The
+	 * config lock is only tried, since we hold the ms_lock.
+	 */
+	if (spa->spa_autotrim && txg != 0 && msp->ms_trim_zio == NULL &&
+	    range_tree_space(msp->ms_trimtree) != 0 &&
+	    (txg >= msp->ms_trim_txg + zfs_trim_txg_batch ||
+	    msp->ms_deferspace == 0) &&
+	    spa_config_tryenter(spa, SCL_ZIO, msp, RW_READER)) {
+		trim_zio = metaslab_trim_start(msp, msp->ms_trimtree,
+		    zfs_trim_extent_bytes_min, txg);
+	}
+
 	mutex_exit(&msp->ms_lock);
+
+	if (trim_zio != NULL)
+		zio_nowait(trim_zio);
 }
 
 void
@@ -2685,6 +3203,7 @@ metaslab_block_alloc(metaslab_t *msp, uint64_t size, uint64_t txg)
 		VERIFY0(P2PHASE(size, 1ULL << vd->vdev_ashift));
 		VERIFY3U(range_tree_space(rt) - size, <=, msp->ms_size);
 		range_tree_remove(rt, start, size);
+		range_tree_clear(msp->ms_trimtree, start, size);
 
 		if (range_tree_space(msp->ms_alloctree[txg & TXG_MASK]) == 0)
 			vdev_dirty(mg->mg_vd, VDD_METASLAB, msp, txg);
@@ -2768,7 +3287,7 @@ metaslab_group_alloc_normal(metaslab_group_t *mg, zio_alloc_list_t *zal,
 				break;
 
 			target_distance = min_distance +
-			    (space_map_allocated(msp->ms_sm) != 0 ? 0 :
+			    (metaslab_allocated_space(msp) != 0 ? 0 :
 			    min_distance >> 1);
 
 			for (i = 0; i < d; i++) {
@@ -3288,6 +3807,7 @@ metaslab_claim_dva(spa_t *spa, const dva_t *dva, uint64_t txg)
 	VERIFY0(P2PHASE(size, 1ULL << vd->vdev_ashift));
 	VERIFY3U(range_tree_space(msp->ms_tree) - size, <=, msp->ms_size);
 	range_tree_remove(msp->ms_tree, offset, size);
+	range_tree_clear(msp->ms_trimtree, offset, size);
 
 	if (spa_writeable(spa)) {	/* don't dirty if we're zdb(1M) */
 		if (range_tree_space(msp->ms_alloctree[txg & TXG_MASK]) == 0)
@@ -3321,7 +3841,8 @@ metaslab_class_throttle_reserve(metaslab_class_t *mc, int slots, zio_t *zio,
 	if (reserved_slots < mc->mc_alloc_max_slots)
 		available_slots = mc->mc_alloc_max_slots - reserved_slots;
 
-	if (slots <= available_slots || GANG_ALLOCATION(flags)) {
+	if (slots <= available_slots || GANG_ALLOCATION(flags) ||
+	    (flags & METASLAB_MUST_RESERVE)) {
 		/*
 		 * We reserve the slots individually so that we can unreserve
 		 * them individually when an I/O completes.
@@ -148,8 +148,8 @@ multilist_destroy(multilist_t *ml)
  * The sublist locks are automatically acquired if not already held, to
  * ensure consistency when inserting and removing from multiple threads.
  */
-void
-multilist_insert(multilist_t *ml, void *obj)
+static void
+multilist_insert_impl(multilist_t *ml, void *obj, boolean_t tail)
 {
 	unsigned int sublist_idx = ml->ml_index_func(ml, obj);
 	multilist_sublist_t *mls;
@@ -178,12 +178,31 @@ multilist_insert(multilist_t *ml, void *obj)
 
 	ASSERT(!multilist_link_active(multilist_d2l(ml, obj)));
 
-	multilist_sublist_insert_head(mls, obj);
+	if (tail)
+		multilist_sublist_insert_tail(mls, obj);
+	else
+		multilist_sublist_insert_head(mls, obj);
 
 	if (need_lock)
 		mutex_exit(&mls->mls_lock);
 }
 
+void
+multilist_insert(multilist_t *ml, void *obj)
+{
+	multilist_insert_impl(ml, obj, B_FALSE);
+}
+
+/*
+ * Like multilist_insert(), but put the object at the tail of its sublist,
+ * where it will be visited first by a walk from the tail.
+ */
+void
+multilist_insert_tail(multilist_t *ml, void *obj)
+{
+	multilist_insert_impl(ml, obj, B_TRUE);
+}
+
 /*
  * Remove the given object from the multilist.
  *
@@ -350,6 +350,29 @@ range_tree_contains(range_tree_t *rt, uint64_t start, uint64_t size)
 	return (range_tree_find(rt, start, size) != NULL);
 }
 
+/*
+ * Find the lowest part of [start, start + size) that is in the tree.
+ * Returns B_FALSE if none of the range is in the tree.
+ */
+boolean_t
+range_tree_find_in(range_tree_t *rt, uint64_t start, uint64_t size,
+    uint64_t *ostart, uint64_t *osize)
+{
+	range_seg_t *rs, *prev;
+
+	rs = range_tree_find_impl(rt, start, size);
+	if (rs == NULL)
+		return (B_FALSE);
+
+	while ((prev = AVL_PREV(&rt->rt_root, rs)) != NULL &&
+	    prev->rs_end > start)
+		rs = prev;
+
+	*ostart = MAX(rs->rs_start, start);
+	*osize = MIN(rs->rs_end, start + size) - *ostart;
+	return (B_TRUE);
+}
+
 /*
  * Ensure that this range is not in the tree, regardless of whether
  * it is currently in the tree.
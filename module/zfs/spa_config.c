@@ -495,6 +495,7 @@ spa_config_generate(spa_t *spa, vdev_t *vd, uint64_t txg, int getstats)
 		ddt_histogram_t *ddh;
 		ddt_stat_t *dds;
 		ddt_object_t *ddo;
+		ddt_prune_stat_t dps;
 
 		ddh = kmem_zalloc(sizeof (ddt_histogram_t), KM_SLEEP);
 		ddt_get_dedup_histogram(spa, ddh);
@@ -516,6 +517,11 @@ spa_config_generate(spa_t *spa, vdev_t *vd, uint64_t txg, int getstats)
 		    ZPOOL_CONFIG_DDT_STATS,
 		    (uint64_t *)dds, sizeof (*dds) / sizeof (uint64_t));
 		kmem_free(dds, sizeof (ddt_stat_t));
+
+		ddt_get_prune_stats(spa, &dps);
+		fnvlist_add_uint64_array(config,
+		    ZPOOL_CONFIG_DDT_PRUNE_STATS,
+		    (uint64_t *)&dps, sizeof (dps) / sizeof (uint64_t));
 	}
 
 	if (locked)
@@ -0,0 +1,566 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/dmu.h>
+#include <sys/dmu_objset.h>
+#include <sys/dmu_tx.h>
+#include <sys/zap.h>
+#include <sys/zio.h>
+#include <sys/spa_impl.h>
+#include <sys/vdev_impl.h>
+#include <sys/metaslab_impl.h>
+#include <sys/spa_log_spacemap.h>
+#include <sys/zfeature.h>
+
+/*
+ * Log space maps
+ *
+ * Without the log_spacemap feature, every metaslab that is allocated from
+ * or freed to in a txg appends those changes to its own space map.  On a
+ * pool with many metaslabs and a random workload this means writing (and
+ * later condensing) a small block for hundreds of space maps every txg,
+ * and those writes come to dominate the cost of a sync.
+ *
+ * With the feature enabled, the changes of all metaslabs in a txg are
+ * appended to a single pool-wide object instead, the log space map of
+ * that txg.  Each metaslab also keeps what it has logged since it was
+ * last flushed in its ms_unflushed_allocs and ms_unflushed_frees trees.
+ * Flushing a metaslab appends those trees to its own space map; each txg
+ * a few of the metaslabs that have gone unflushed the longest are
+ * flushed, and log space maps older than every metaslab's oldest
+ * unflushed change are destroyed.  How many metaslabs are flushed is
+ * governed by the following bounds:
+ *
+ * - zfs_min_metaslabs_to_flush are flushed in every txg that is not
+ *   otherwise empty, so the logs keep moving forward,
+ *
+ * - while the unflushed trees take more than zfs_unflushed_max_mem_amt
+ *   bytes of memory, more metaslabs are flushed,
+ *
+ * - and so are all metaslabs whose oldest unflushed change is more than
+ *   zfs_unflushed_log_txg_max txgs old, which bounds the number of logs
+ *   (and so the work needed at import).
+ *
+ * On-disk, the logs are listed in a ZAP in the MOS directory that maps
+ * txgs to objects, and each top-level vdev has an array, referenced from
+ * its ZAP, with the txg of the oldest unflushed change of each metaslab.
+ * When the pool is imported, spa_log_sm_load() replays to each metaslab
+ * the records of the logs at and after that txg, which recreates the
+ * unflushed trees.
+ */
+
+/*
+ * Minimum number of metaslabs flushed per txg.
+ */
+int zfs_min_metaslabs_to_flush = 1;
+
+/*
+ * Upper bound for the memory used by the unflushed trees of all
+ * metaslabs in the pool.
+ */
+uint64_t zfs_unflushed_max_mem_amt = 1ULL << 30;
+
+/*
+ * Maximum number of txgs that a change may stay unflushed.
+ */
+uint64_t zfs_unflushed_log_txg_max = 1000;
+
+/*
+ * Block size of the log space map objects, and size of the buffer that
+ * records are gathered in before they are written.
+ */
+static int spa_log_sm_blksz = 1 << 17;
+
+static int
+spa_log_sm_compare(const void *x1, const void *x2)
+{
+	const spa_log_sm_t *s1 = x1;
+	const spa_log_sm_t *s2 = x2;
+
+	if (s1->sls_txg < s2->sls_txg)
+		return (-1);
+	if (s1->sls_txg > s2->sls_txg)
+		return (1);
+	return (0);
+}
+
+/*
+ * Order of spa_metaslabs_by_flushed: oldest unflushed change first.
+ */
+int
+spa_log_sm_flushed_compare(const void *x1, const void *x2)
+{
+	const metaslab_t *m1 = x1;
+	const metaslab_t *m2 = x2;
+	uint64_t v1 = m1->ms_group->mg_vd->vdev_id;
+	uint64_t v2 = m2->ms_group->mg_vd->vdev_id;
+
+	if (m1->ms_unflushed_txg < m2->ms_unflushed_txg)
+		return (-1);
+	if (m1->ms_unflushed_txg > m2->ms_unflushed_txg)
+		return (1);
+	if (v1 < v2)
+		return (-1);
+	if (v1 > v2)
+		return (1);
+	if (m1->ms_id < m2->ms_id)
+		return (-1);
+	if (m1->ms_id > m2->ms_id)
+		return (1);
+	return (0);
+}
+
+void
+spa_log_sm_init(spa_t *spa)
+{
+	mutex_init(&spa->spa_flushed_ms_lock, NULL, MUTEX_DEFAULT, NULL);
+	avl_create(&spa->spa_log_sms, spa_log_sm_compare,
+	    sizeof (spa_log_sm_t), offsetof(spa_log_sm_t, sls_node));
+	avl_create(&spa->spa_metaslabs_by_flushed, spa_log_sm_flushed_compare,
+	    sizeof (metaslab_t), offsetof(metaslab_t, ms_spa_txg_node));
+}
+
+void
+spa_log_sm_fini(spa_t *spa)
+{
+	avl_destroy(&spa->spa_metaslabs_by_flushed);
+	avl_destroy(&spa->spa_log_sms);
+	mutex_destroy(&spa->spa_flushed_ms_lock);
+}
+
+/*
+ * Forget the in-core state of the logs.  The metaslabs must already be
+ * gone.
+ */
+void
+spa_log_sm_unload(spa_t *spa)
+{
+	spa_log_sm_t *sls;
+	void *cookie = NULL;
+
+	ASSERT3P(spa->spa_syncing_log_sm, ==, NULL);
+	ASSERT0(avl_numnodes(&spa->spa_metaslabs_by_flushed));
+
+	while ((sls = avl_destroy_nodes(&spa->spa_log_sms, &cookie)) != NULL) {
+		ASSERT3P(sls->sls_dbuf, ==, NULL);
+		kmem_free(sls, sizeof (spa_log_sm_t));
+	}
+	spa->spa_log_sm_zap = 0;
+	spa->spa_log_sm_txg = 0;
+	spa->spa_unflushed_segs = 0;
+}
+
+/*
+ * Returns true if the metaslabs that can log should write their changes
+ * of this txg to the log space map.
+ */
+boolean_t
+spa_log_sm_syncing(spa_t *spa, uint64_t txg)
+{
+	return (spa->spa_log_sm_txg == txg);
+}
+
+static spa_log_sm_t *
+spa_log_sm_create(spa_t *spa, dmu_tx_t *tx)
+{
+	objset_t *mos = spa_meta_objset(spa);
+	uint64_t txg = dmu_tx_get_txg(tx);
+	spa_log_sm_t *sls;
+
+	ASSERT3P(spa->spa_syncing_log_sm, ==, NULL);
+
+	if (spa->spa_log_sm_zap == 0) {
+		spa->spa_log_sm_zap = zap_create(mos, DMU_OTN_ZAP_METADATA,
+		    DMU_OT_NONE, 0, tx);
+		VERIFY0(zap_add(mos, DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_LOG_SPACEMAP_ZAP, sizeof (uint64_t), 1,
+		    &spa->spa_log_sm_zap, tx));
+		spa_feature_incr(spa, SPA_FEATURE_LOG_SPACEMAP, tx);
+	}
+
+	sls = kmem_zalloc(sizeof (spa_log_sm_t), KM_SLEEP);
+	sls->sls_txg = txg;
+	sls->sls_object = dmu_object_alloc(mos, DMU_OTN_UINT64_METADATA,
+	    spa_log_sm_blksz, DMU_OTN_UINT64_METADATA,
+	    sizeof (spa_log_sm_phys_t), tx);
+	VERIFY0(zap_add_int_key(mos, spa->spa_log_sm_zap, txg,
+	    sls->sls_object, tx));
+
+	VERIFY0(dmu_bonus_hold(mos, sls->sls_object, sls, &sls->sls_dbuf));
+	dmu_buf_will_dirty(sls->sls_dbuf, tx);
+	sls->sls_phys = sls->sls_dbuf->db_data;
+	sls->sls_phys->slp_txg = txg;
+
+	avl_add(&spa->spa_log_sms, sls);
+	spa->spa_syncing_log_sm = sls;
+
+	return (sls);
+}
+
+static void
+spa_log_sm_append(spa_log_sm_t *sls, objset_t *mos, uint64_t *buf,
+    uint64_t size, range_tree_t *rt, dmu_tx_t *tx)
+{
+	mutex_exit(rt->rt_lock);
+	dmu_write(mos, sls->sls_object, sls->sls_phys->slp_length, size,
+	    buf, tx);
+	mutex_enter(rt->rt_lock);
+	sls->sls_phys->slp_length += size;
+}
+
+/*
+ * Append the segments of a metaslab's range tree to the log space map of
+ * the syncing txg.  Like space_map_write(), this drops the tree's lock
+ * while calling into the DMU.
+ */
+void
+spa_log_sm_write(spa_t *spa, uint64_t vdev_id, range_tree_t *rt,
+    maptype_t maptype, dmu_tx_t *tx)
+{
+	objset_t *mos = spa_meta_objset(spa);
+	spa_log_sm_t *sls = spa->spa_syncing_log_sm;
+	avl_tree_t *t = &rt->rt_root;
+	uint64_t *entry, *entry_map, *entry_map_end;
+	range_seg_t *rs;
+
+	ASSERT(MUTEX_HELD(rt->rt_lock));
+	ASSERT(dsl_pool_sync_context(spa_get_dsl(spa)));
+	ASSERT(spa_log_sm_syncing(spa, dmu_tx_get_txg(tx)));
+	ASSERT3U(vdev_id, <, 1ULL << SLS_VDEV_BITS);
+
+	if (range_tree_space(rt) == 0)
+		return;
+
+	if (sls == NULL) {
+		mutex_exit(rt->rt_lock);
+		sls = spa_log_sm_create(spa, tx);
+		mutex_enter(rt->rt_lock);
+	}
+
+	entry_map = zio_buf_alloc(spa_log_sm_blksz);
+	entry_map_end = entry_map + (spa_log_sm_blksz / sizeof (uint64_t));
+	entry = entry_map;
+
+	for (rs = avl_first(t); rs != NULL; rs = AVL_NEXT(t, rs)) {
+		uint64_t start = rs->rs_start;
+		uint64_t size = rs->rs_end - rs->rs_start;
+
+		ASSERT0(P2PHASE(start | size, SPA_MINBLOCKSIZE));
+
+		while (size != 0) {
+			uint64_t run_len = MIN(size, SLS_RUN_MAX);
+
+			if (entry == entry_map_end) {
+				spa_log_sm_append(sls, mos, entry_map,
+				    spa_log_sm_blksz, rt, tx);
+				entry = entry_map;
+			}
+
+			*entry++ = SLS_TYPE_ENCODE(maptype) |
+			    SLS_VDEV_ENCODE(vdev_id) |
+			    SLS_RUN_ENCODE(run_len);
+			*entry++ = start;
+
+			start += run_len;
+			size -= run_len;
+		}
+	}
+
+	if (entry != entry_map) {
+		spa_log_sm_append(sls, mos, entry_map,
+		    (entry - entry_map) * sizeof (uint64_t), rt, tx);
+	}
+
+	zio_buf_free(entry_map, spa_log_sm_blksz);
+}
+
+/*
+ * Destroy the logs that no metaslab has unflushed changes from.
+ */
+static void
+spa_log_sm_destroy_obsolete(spa_t *spa, dmu_tx_t *tx)
+{
+	objset_t *mos = spa_meta_objset(spa);
+	uint64_t min_txg = dmu_tx_get_txg(tx);
+	spa_log_sm_t *sls;
+	metaslab_t *ms;
+
+	mutex_enter(&spa->spa_flushed_ms_lock);
+	ms = avl_first(&spa->spa_metaslabs_by_flushed);
+	if (ms != NULL)
+		min_txg = ms->ms_unflushed_txg;
+	mutex_exit(&spa->spa_flushed_ms_lock);
+
+	while ((sls = avl_first(&spa->spa_log_sms)) != NULL &&
+	    sls->sls_txg < min_txg) {
+		VERIFY0(zap_remove_int(mos, spa->spa_log_sm_zap,
+		    sls->sls_txg, tx));
+		VERIFY0(dmu_object_free(mos, sls->sls_object, tx));
+		avl_remove(&spa->spa_log_sms, sls);
+		kmem_free(sls, sizeof (spa_log_sm_t));
+	}
+}
+
+/*
+ * Select the metaslabs to flush in this txg.  They are dirtied here, and
+ * write out their unflushed changes in metaslab_sync().
+ */
+static void
+spa_log_sm_select_flushes(spa_t *spa, uint64_t txg)
+{
+	avl_tree_t *t = &spa->spa_metaslabs_by_flushed;
+	uint64_t segs = spa->spa_unflushed_segs;
+	int nflushed = 0;
+	metaslab_t *ms;
+
+	mutex_enter(&spa->spa_flushed_ms_lock);
+	for (ms = avl_first(t); ms != NULL; ms = AVL_NEXT(t, ms)) {
+		uint64_t ms_segs;
+
+		if (nflushed >= zfs_min_metaslabs_to_flush &&
+		    segs * sizeof (range_seg_t) <= zfs_unflushed_max_mem_amt &&
+		    ms->ms_unflushed_txg + zfs_unflushed_log_txg_max > txg)
+			break;
+
+		ms_segs = avl_numnodes(&ms->ms_unflushed_allocs->rt_root) +
+		    avl_numnodes(&ms->ms_unflushed_frees->rt_root);
+		segs -= MIN(segs, ms_segs);
+
+		ms->ms_flush_txg = txg;
+		vdev_dirty(ms->ms_group->mg_vd, VDD_METASLAB, ms, txg);
+		nflushed++;
+	}
+	mutex_exit(&spa->spa_flushed_ms_lock);
+}
+
+/*
+ * Called in the first pass of spa_sync(), before the vdevs are synced.
+ */
+void
+spa_log_sm_sync_start(spa_t *spa, dmu_tx_t *tx)
+{
+	uint64_t txg = dmu_tx_get_txg(tx);
+
+	ASSERT3U(spa_sync_pass(spa), ==, 1);
+	ASSERT3P(spa->spa_syncing_log_sm, ==, NULL);
+
+	if (!spa_feature_is_enabled(spa, SPA_FEATURE_LOG_SPACEMAP) ||
+	    txg > spa_final_dirty_txg(spa)) {
+		spa->spa_log_sm_txg = 0;
+		return;
+	}
+	spa->spa_log_sm_txg = txg;
+
+	/*
+	 * Don't turn a txg that would otherwise be a no-op into one that
+	 * writes.  The logs simply move forward in the next busy txg.
+	 */
+	if (!dmu_objset_is_dirty(spa_meta_objset(spa), txg))
+		return;
+
+	spa_log_sm_destroy_obsolete(spa, tx);
+	spa_log_sm_select_flushes(spa, txg);
+}
+
+/*
+ * Called once spa_sync() has converged.
+ */
+void
+spa_log_sm_sync_done(spa_t *spa)
+{
+	spa_log_sm_t *sls = spa->spa_syncing_log_sm;
+
+	if (sls == NULL)
+		return;
+
+	dmu_buf_rele(sls->sls_dbuf, sls);
+	sls->sls_dbuf = NULL;
+	sls->sls_phys = NULL;
+	spa->spa_syncing_log_sm = NULL;
+}
+
+/*
+ * Read the unflushed txg of each metaslab of a top-level vdev.
+ */
+static int
+spa_log_sm_load_vdev(vdev_t *vd)
+{
+	objset_t *mos = spa_meta_objset(vd->vdev_spa);
+	uint64_t *txgs;
+	uint64_t size;
+	int error;
+
+	if (vd->vdev_top_zap == 0 || vd->vdev_ms == NULL)
+		return (0);
+
+	error = zap_lookup(mos, vd->vdev_top_zap,
+	    VDEV_TOP_ZAP_MS_UNFLUSHED_PHYS_TXGS, sizeof (uint64_t), 1,
+	    &vd->vdev_ms_unflushed_obj);
+	if (error == ENOENT)
+		return (0);
+	if (error != 0)
+		return (error);
+
+	size = vd->vdev_ms_count * sizeof (uint64_t);
+	txgs = kmem_alloc(size, KM_SLEEP);
+	error = dmu_read(mos, vd->vdev_ms_unflushed_obj, 0, size, txgs,
+	    DMU_READ_PREFETCH);
+	if (error == 0) {
+		for (uint64_t m = 0; m < vd->vdev_ms_count; m++) {
+			if (txgs[m] != 0)
+				metaslab_unflushed_txg_update(vd->vdev_ms[m],
+				    txgs[m]);
+		}
+	}
+	kmem_free(txgs, size);
+
+	return (error);
+}
+
+/*
+ * Apply the records of a log to the metaslabs whose unflushed changes
+ * include it.
+ */
+static int
+spa_log_sm_replay(spa_t *spa, spa_log_sm_t *sls)
+{
+	objset_t *mos = spa_meta_objset(spa);
+	vdev_t *rvd = spa->spa_root_vdev;
+	dmu_buf_t *db;
+	uint64_t *buf, length, offset;
+	int error;
+
+	error = dmu_bonus_hold(mos, sls->sls_object, FTAG, &db);
+	if (error != 0)
+		return (error);
+	length = ((spa_log_sm_phys_t *)db->db_data)->slp_length;
+	dmu_buf_rele(db, FTAG);
+
+	if (length % SLS_RECORD_SIZE != 0)
+		return (SET_ERROR(EIO));
+
+	buf = zio_buf_alloc(spa_log_sm_blksz);
+	for (offset = 0; offset < length && error == 0;
+	    offset += spa_log_sm_blksz) {
+		uint64_t size = MIN(length - offset, spa_log_sm_blksz);
+		uint64_t *entry, *end = buf + size / sizeof (uint64_t);
+
+		error = dmu_read(mos, sls->sls_object, offset, size, buf,
+		    DMU_READ_PREFETCH);
+		if (error != 0)
+			break;
+
+		for (entry = buf; entry < end; entry += 2) {
+			uint64_t id = SLS_VDEV_DECODE(entry[0]);
+			uint64_t run = SLS_RUN_DECODE(entry[0]);
+			uint64_t start = entry[1];
+			metaslab_t *ms;
+			vdev_t *vd;
+
+			if (run == 0 || id >= rvd->vdev_children) {
+				error = SET_ERROR(EIO);
+				break;
+			}
+
+			vd = rvd->vdev_child[id];
+			if (vd->vdev_ms == NULL)
+				continue;
+			if ((start >> vd->vdev_ms_shift) >= vd->vdev_ms_count) {
+				error = SET_ERROR(EIO);
+				break;
+			}
+
+			ms = vd->vdev_ms[start >> vd->vdev_ms_shift];
+			if (ms->ms_unflushed_txg == 0 ||
+			    sls->sls_txg < ms->ms_unflushed_txg)
+				continue;
+
+			mutex_enter(&ms->ms_lock);
+			metaslab_unflushed_add(ms, start, run,
+			    SLS_TYPE_DECODE(entry[0]));
+			mutex_exit(&ms->ms_lock);
+		}
+	}
+	zio_buf_free(buf, spa_log_sm_blksz);
+
+	return (error);
+}
+
+/*
+ * Called at import, once the metaslabs have been opened, to recreate
+ * their unflushed trees from the log space maps.
+ */
+int
+spa_log_sm_load(spa_t *spa)
+{
+	objset_t *mos = spa_meta_objset(spa);
+	vdev_t *rvd = spa->spa_root_vdev;
+	zap_cursor_t zc;
+	zap_attribute_t za;
+	spa_log_sm_t *sls;
+	metaslab_t *ms;
+	int error;
+
+	error = zap_lookup(mos, DMU_POOL_DIRECTORY_OBJECT,
+	    DMU_POOL_LOG_SPACEMAP_ZAP, sizeof (uint64_t), 1,
+	    &spa->spa_log_sm_zap);
+	if (error == ENOENT)
+		return (0);
+	if (error != 0)
+		return (error);
+
+	for (zap_cursor_init(&zc, mos, spa->spa_log_sm_zap);
+	    (error = zap_cursor_retrieve(&zc, &za)) == 0;
+	    zap_cursor_advance(&zc)) {
+		sls = kmem_zalloc(sizeof (spa_log_sm_t), KM_SLEEP);
+		sls->sls_txg = strtonum(za.za_name, NULL);
+		sls->sls_object = za.za_first_integer;
+		avl_add(&spa->spa_log_sms, sls);
+	}
+	zap_cursor_fini(&zc);
+	if (error != ENOENT)
+		return (error);
+
+	for (uint64_t c = 0; c < rvd->vdev_children; c++) {
+		error = spa_log_sm_load_vdev(rvd->vdev_child[c]);
+		if (error != 0)
+			return (error);
+	}
+
+	for (sls = avl_first(&spa->spa_log_sms); sls != NULL;
+	    sls = AVL_NEXT(&spa->spa_log_sms, sls)) {
+		error = spa_log_sm_replay(spa, sls);
+		if (error != 0)
+			return (error);
+	}
+
+	for (ms = avl_first(&spa->spa_metaslabs_by_flushed); ms != NULL;
+	    ms = AVL_NEXT(&spa->spa_metaslabs_by_flushed, ms))
+		metaslab_unflushed_load_done(ms);
+
+	zfs_dbgmsg("spa %s: replayed %llu log space maps, "
+	    "%llu unflushed segments", spa_name(spa),
+	    (u_longlong_t)avl_numnodes(&spa->spa_log_sms),
+	    (u_longlong_t)spa->spa_unflushed_segs);
+
+	return (0);
+}
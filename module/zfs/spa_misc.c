@@ -53,6 +53,8 @@
 #include <sys/metaslab_impl.h>
 #include <sys/arc.h>
 #include <sys/ddt.h>
+#include <sys/vdev_raidz.h>
+#include <zfs_fletcher.h>
 #include <sys/stropts.h>
 #include "zfs_prop.h"
 #include <sys/zfeature.h>
@@ -302,6 +304,17 @@ int spa_asize_inflation = 24;
 int spa_slop_shift = 5;
 uint64_t spa_min_slop = 128 * 1024 * 1024;
 
+/*
+ * Allocation classes.  Metadata, and with them DDT blocks and the indirect
+ * blocks of files, go to the special class when the pool has one; see
+ * spa_preferential_class().  Small file blocks only go there while the
+ * special class has more than zfs_special_class_metadata_reserve_pct
+ * percent of its space left, so that it never fills up with file data.
+ */
+int zfs_ddt_data_is_special = B_TRUE;
+int zfs_user_indirect_is_special = B_TRUE;
+int zfs_special_class_metadata_reserve_pct = 25;
+
 /*
  * ==========================================================================
  * SPA config locking
@@ -528,12 +541,15 @@ spa_add(const char *name, nvlist_t *config, const char *altroot)
 	mutex_init(&spa->spa_vdev_top_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&spa->spa_feat_stats_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&spa->spa_alloc_lock, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&spa->spa_trim_lock, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&spa->spa_ddt_prune_lock, NULL, MUTEX_DEFAULT, NULL);
 
 	cv_init(&spa->spa_async_cv, NULL, CV_DEFAULT, NULL);
 	cv_init(&spa->spa_evicting_os_cv, NULL, CV_DEFAULT, NULL);
 	cv_init(&spa->spa_proc_cv, NULL, CV_DEFAULT, NULL);
 	cv_init(&spa->spa_scrub_io_cv, NULL, CV_DEFAULT, NULL);
 	cv_init(&spa->spa_suspend_cv, NULL, CV_DEFAULT, NULL);
+	cv_init(&spa->spa_trim_cv, NULL, CV_DEFAULT, NULL);
 
 	for (t = 0; t < TXG_SIZE; t++)
 		bplist_create(&spa->spa_free_bplist[t]);
@@ -562,6 +578,7 @@ spa_add(const char *name, nvlist_t *config, const char *altroot)
 
 	avl_create(&spa->spa_alloc_tree, zio_bookmark_compare,
 	    sizeof (zio_t), offsetof(zio_t, io_alloc_node));
+	spa_log_sm_init(spa);
 
 	/*
 	 * Every pool starts with the default cachefile
@@ -641,6 +658,7 @@ spa_remove(spa_t *spa)
 	}
 
 	avl_destroy(&spa->spa_alloc_tree);
+	spa_log_sm_fini(spa);
 	list_destroy(&spa->spa_config_list);
 
 	nvlist_free(spa->spa_label_features);
@@ -663,6 +681,7 @@ spa_remove(spa_t *spa)
 	cv_destroy(&spa->spa_proc_cv);
 	cv_destroy(&spa->spa_scrub_io_cv);
 	cv_destroy(&spa->spa_suspend_cv);
+	cv_destroy(&spa->spa_trim_cv);
 
 	mutex_destroy(&spa->spa_alloc_lock);
 	mutex_destroy(&spa->spa_async_lock);
@@ -677,6 +696,8 @@ spa_remove(spa_t *spa)
 	mutex_destroy(&spa->spa_suspend_lock);
 	mutex_destroy(&spa->spa_vdev_top_lock);
 	mutex_destroy(&spa->spa_feat_stats_lock);
+	mutex_destroy(&spa->spa_trim_lock);
+	mutex_destroy(&spa->spa_ddt_prune_lock);
 
 	kmem_free(spa, sizeof (spa_t));
 }
@@ -1047,6 +1068,8 @@ spa_vdev_config_exit(spa_t *spa, vdev_t *vd, uint64_t txg, int error, char *tag)
 	 */
 	ASSERT(metaslab_class_validate(spa_normal_class(spa)) == 0);
 	ASSERT(metaslab_class_validate(spa_log_class(spa)) == 0);
+	ASSERT(metaslab_class_validate(spa_special_class(spa)) == 0);
+	ASSERT(metaslab_class_validate(spa_dedup_class(spa)) == 0);
 
 	spa_config_exit(spa, SCL_ALL, spa);
 
@@ -1608,6 +1631,13 @@ spa_update_dspace(spa_t *spa)
 {
 	spa->spa_dspace = metaslab_class_get_dspace(spa_normal_class(spa)) +
 	    ddt_get_dedup_dspace(spa);
+
+	/*
+	 * The special and dedup classes hold data that would otherwise be
+	 * in the normal class, so their space counts towards the pool.
+	 */
+	spa->spa_dspace += metaslab_class_get_dspace(spa_special_class(spa)) +
+	    metaslab_class_get_dspace(spa_dedup_class(spa));
 }
 
 /*
@@ -1650,6 +1680,72 @@ spa_log_class(spa_t *spa)
 	return (spa->spa_log_class);
 }
 
+metaslab_class_t *
+spa_special_class(spa_t *spa)
+{
+	return (spa->spa_special_class);
+}
+
+metaslab_class_t *
+spa_dedup_class(spa_t *spa)
+{
+	return (spa->spa_dedup_class);
+}
+
+/*
+ * Locate an appropriate allocation class for a block, given its size,
+ * object type, level and the special_small_blocks setting of its dataset.
+ * Without special or dedup vdevs everything goes to the normal class.
+ */
+metaslab_class_t *
+spa_preferential_class(spa_t *spa, uint64_t size, dmu_object_type_t objtype,
+    uint_t level, uint_t special_smallblk)
+{
+	metaslab_class_t *special = spa_special_class(spa);
+	boolean_t has_special_class = special->mc_groups != 0;
+
+	if (DMU_OT_IS_DDT(objtype)) {
+		if (spa->spa_dedup_class->mc_groups != 0)
+			return (spa_dedup_class(spa));
+		else if (has_special_class && zfs_ddt_data_is_special)
+			return (special);
+		else
+			return (spa_normal_class(spa));
+	}
+
+	/* indirect blocks of user data only go to special if allowed */
+	if (level > 0 && DMU_OT_IS_FILE(objtype)) {
+		if (has_special_class && zfs_user_indirect_is_special)
+			return (special);
+		else
+			return (spa_normal_class(spa));
+	}
+
+	if (DMU_OT_IS_METADATA(objtype) || level > 0) {
+		if (has_special_class)
+			return (special);
+		else
+			return (spa_normal_class(spa));
+	}
+
+	/*
+	 * Small file blocks may go to the special class too, but always
+	 * leave zfs_special_class_metadata_reserve_pct of it to metadata.
+	 */
+	if (DMU_OT_IS_FILE(objtype) && has_special_class &&
+	    size <= special_smallblk) {
+		uint64_t alloc = metaslab_class_get_alloc(special);
+		uint64_t space = metaslab_class_get_space(special);
+		uint64_t limit = (space *
+		    (100 - zfs_special_class_metadata_reserve_pct)) / 100;
+
+		if (alloc < limit)
+			return (special);
+	}
+
+	return (spa_normal_class(spa));
+}
+
 void
 spa_evicting_os_register(spa_t *spa, objset_t *os)
 {
@@ -1818,10 +1914,14 @@ spa_init(int mode)
 	range_tree_init();
 	metaslab_alloc_trace_init();
 	ddt_init();
+	fletcher_4_init();
 	zio_init();
 	dmu_init();
 	zil_init();
 	vdev_cache_stat_init();
+	dsl_scan_stat_init();
+	vdev_raidz_math_init();
+	vdev_file_init();
 	zfs_prop_init();
 	zpool_prop_init();
 	zpool_feature_init();
@@ -1836,10 +1936,14 @@ spa_fini(void)
 
 	spa_evict_all();
 
+	vdev_file_fini();
+	vdev_raidz_math_fini();
+	dsl_scan_stat_fini();
 	vdev_cache_stat_fini();
 	zil_fini();
 	dmu_fini();
 	zio_fini();
+	fletcher_4_fini();
 	ddt_fini();
 	metaslab_alloc_trace_fini();
 	range_tree_fini();
@@ -1946,6 +2050,7 @@ spa_scan_stat_init(spa_t *spa)
 		spa->spa_scan_pass_scrub_pause = 0;
 	spa->spa_scan_pass_scrub_spent_paused = 0;
 	spa->spa_scan_pass_exam = 0;
+	spa->spa_scan_pass_issued = 0;
 	vdev_scan_stat_init(spa->spa_root_vdev);
 }
 
@@ -1977,6 +2082,9 @@ spa_scan_get_stats(spa_t *spa, pool_scan_stat_t *ps)
 	ps->pss_pass_exam = spa->spa_scan_pass_exam;
 	ps->pss_pass_scrub_pause = spa->spa_scan_pass_scrub_pause;
 	ps->pss_pass_scrub_spent_paused = spa->spa_scan_pass_scrub_spent_paused;
+	ps->pss_pass_issued = spa->spa_scan_pass_issued;
+	ps->pss_issued =
+	    scn->scn_issued_before_pass + spa->spa_scan_pass_issued;
 
 	return (0);
 }
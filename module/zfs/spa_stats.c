@@ -21,6 +21,7 @@
 
 #include <sys/zfs_context.h>
 #include <sys/spa_impl.h>
+#include <sys/vdev_impl.h>
 
 /*
  * Keeps stats on last N reads per spa_t, disabled by default.
@@ -655,6 +656,191 @@ spa_io_history_destroy(spa_t *spa)
 	mutex_destroy(&ssh->lock);
 }
 
+/*
+ * ==========================================================================
+ * SPA Vdev Latency Routines
+ * ==========================================================================
+ */
+
+/*
+ * The smoothed read service time of each leaf vdev, which mirrors use to
+ * pick a child to read from.  The entries are a snapshot taken when the
+ * kstat is updated.
+ */
+typedef struct spa_vdev_latency {
+	uint64_t	guid;		/* leaf vdev guid */
+	uint64_t	samples;	/* reads measured */
+	hrtime_t	lat;		/* smoothed read service time */
+	hrtime_t	lat_dev;	/* its smoothed mean deviation */
+	hrtime_t	age;		/* time since the last sample */
+	char		path[64];	/* leaf vdev path, may be truncated */
+} spa_vdev_latency_t;
+
+static int
+spa_vdev_latency_headers(char *buf, size_t size)
+{
+	(void) snprintf(buf, size, "%-20s %-12s %-12s %-12s %-12s %s\n",
+	    "guid", "samples", "lat_ns", "dev_ns", "age_ms", "path");
+
+	return (0);
+}
+
+static int
+spa_vdev_latency_data(char *buf, size_t size, void *data)
+{
+	spa_vdev_latency_t *svl = (spa_vdev_latency_t *)data;
+
+	(void) snprintf(buf, size, "%-20llu %-12llu %-12llu %-12llu %-12llu "
+	    "%s\n", (u_longlong_t)svl->guid, (u_longlong_t)svl->samples,
+	    (u_longlong_t)svl->lat, (u_longlong_t)svl->lat_dev,
+	    (u_longlong_t)NSEC2MSEC(svl->age), svl->path);
+
+	return (0);
+}
+
+static void *
+spa_vdev_latency_addr(kstat_t *ksp, off_t n)
+{
+	spa_t *spa = ksp->ks_private;
+	spa_stats_history_t *ssh = &spa->spa_stats.vdev_latency;
+
+	ASSERT(MUTEX_HELD(&ssh->lock));
+
+	if (n < ssh->size)
+		return ((spa_vdev_latency_t *)ssh->_private + n);
+
+	return (NULL);
+}
+
+static uint64_t
+spa_vdev_latency_collect(vdev_t *vd, spa_vdev_latency_t *svl, uint64_t n,
+    uint64_t max, hrtime_t now)
+{
+	vdev_queue_t *vq = &vd->vdev_queue;
+	int c;
+
+	if (vd->vdev_ishole)
+		return (n);
+
+	if (!vd->vdev_ops->vdev_op_leaf) {
+		for (c = 0; c < vd->vdev_children; c++) {
+			n = spa_vdev_latency_collect(vd->vdev_child[c], svl, n,
+			    max, now);
+		}
+		return (n);
+	}
+
+	if (svl != NULL && n < max) {
+		svl += n;
+		svl->guid = vd->vdev_guid;
+		mutex_enter(&vq->vq_lock);
+		svl->samples = vq->vq_read_lat_samples;
+		svl->lat = vq->vq_read_lat;
+		svl->lat_dev = vq->vq_read_lat_dev;
+		svl->age = svl->samples != 0 ? now - vq->vq_read_lat_ts : 0;
+		mutex_exit(&vq->vq_lock);
+		if (vd->vdev_path != NULL)
+			(void) strlcpy(svl->path, vd->vdev_path,
+			    sizeof (svl->path));
+	}
+
+	return (n + 1);
+}
+
+static void
+spa_vdev_latency_free(spa_stats_history_t *ssh)
+{
+	if (ssh->_private != NULL)
+		kmem_free(ssh->_private, ssh->count *
+		    sizeof (spa_vdev_latency_t));
+	ssh->_private = NULL;
+	ssh->count = 0;
+	ssh->size = 0;
+}
+
+/*
+ * Take a new snapshot of the leaf vdevs' latencies.  If the pool's vdevs
+ * are being reconfigured the kstat reads as busy rather than waiting.
+ */
+static int
+spa_vdev_latency_update(kstat_t *ksp, int rw)
+{
+	spa_t *spa = ksp->ks_private;
+	spa_stats_history_t *ssh = &spa->spa_stats.vdev_latency;
+	vdev_t *rvd;
+	uint64_t n;
+
+	if (rw == KSTAT_WRITE)
+		return (SET_ERROR(EACCES));
+
+	spa_vdev_latency_free(ssh);
+
+	if (!spa_config_tryenter(spa, SCL_VDEV, FTAG, RW_READER))
+		return (SET_ERROR(EBUSY));
+
+	rvd = spa->spa_root_vdev;
+	if (rvd != NULL) {
+		n = spa_vdev_latency_collect(rvd, NULL, 0, 0, 0);
+		ssh->_private = kmem_zalloc(n * sizeof (spa_vdev_latency_t),
+		    KM_SLEEP);
+		ssh->count = n;
+		ssh->size = spa_vdev_latency_collect(rvd, ssh->_private, 0, n,
+		    gethrtime());
+	}
+
+	spa_config_exit(spa, SCL_VDEV, FTAG);
+
+	ksp->ks_ndata = ssh->size;
+	ksp->ks_data_size = ssh->size * sizeof (spa_vdev_latency_t);
+
+	return (0);
+}
+
+static void
+spa_vdev_latency_init(spa_t *spa)
+{
+	spa_stats_history_t *ssh = &spa->spa_stats.vdev_latency;
+	char name[KSTAT_STRLEN];
+	kstat_t *ksp;
+
+	mutex_init(&ssh->lock, NULL, MUTEX_DEFAULT, NULL);
+
+	ssh->count = 0;
+	ssh->size = 0;
+	ssh->_private = NULL;
+
+	(void) snprintf(name, KSTAT_STRLEN, "zfs/%s", spa_name(spa));
+
+	ksp = kstat_create(name, 0, "vdev_latency", "misc",
+	    KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+	ssh->kstat = ksp;
+
+	if (ksp) {
+		ksp->ks_lock = &ssh->lock;
+		ksp->ks_data = NULL;
+		ksp->ks_private = spa;
+		ksp->ks_update = spa_vdev_latency_update;
+		kstat_set_raw_ops(ksp, spa_vdev_latency_headers,
+		    spa_vdev_latency_data, spa_vdev_latency_addr);
+		kstat_install(ksp);
+	}
+}
+
+static void
+spa_vdev_latency_destroy(spa_t *spa)
+{
+	spa_stats_history_t *ssh = &spa->spa_stats.vdev_latency;
+
+	if (ssh->kstat)
+		kstat_delete(ssh->kstat);
+
+	mutex_enter(&ssh->lock);
+	spa_vdev_latency_free(ssh);
+	mutex_exit(&ssh->lock);
+
+	mutex_destroy(&ssh->lock);
+}
+
 void
 spa_stats_init(spa_t *spa)
 {
@@ -662,6 +848,7 @@ spa_stats_init(spa_t *spa)
 	spa_txg_history_init(spa);
 	spa_tx_assign_init(spa);
 	spa_io_history_init(spa);
+	spa_vdev_latency_init(spa);
 }
 
 void
@@ -671,4 +858,5 @@ spa_stats_destroy(spa_t *spa)
 	spa_txg_history_destroy(spa);
 	spa_read_history_destroy(spa);
 	spa_io_history_destroy(spa);
+	spa_vdev_latency_destroy(spa);
 }
@@ -0,0 +1,247 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa_impl.h>
+#include <sys/vdev_impl.h>
+#include <sys/metaslab_impl.h>
+
+/*
+ * Manual TRIM
+ *
+ * "zpool trim" starts a thread that walks the metaslabs of every top-level
+ * vdev in order and TRIMs the free space of each, a step of at most
+ * zfs_trim_extent_bytes_max bytes at a time (see metaslab_trim_manual()).
+ * Between steps the thread drops the config lock and, if a rate was
+ * given, sleeps until the bytes TRIMmed so far are within that rate.
+ *
+ * Autotrim (the "autotrim" pool property) is handled entirely in
+ * metaslab_sync_done(); this thread only exists while a manual TRIM is
+ * running.  Its progress is kept in spa_trim_stats and reported in the
+ * pool's config.  It is not persisted, so a TRIM that is interrupted by
+ * an export or reboot has to be started again.
+ */
+
+extern uint64_t zfs_trim_extent_bytes_max;
+
+static boolean_t
+spa_trim_stopping(spa_t *spa)
+{
+	boolean_t stop;
+
+	mutex_enter(&spa->spa_trim_lock);
+	stop = spa->spa_trim_stop;
+	mutex_exit(&spa->spa_trim_lock);
+
+	return (stop);
+}
+
+/*
+ * Sleep until the 'trimmed' bytes since 'start' are within the rate.
+ */
+static void
+spa_trim_throttle(spa_t *spa, clock_t start, uint64_t trimmed, uint64_t rate)
+{
+	clock_t target;
+
+	if (rate == 0)
+		return;
+
+	target = start + (trimmed / rate) * hz + ((trimmed % rate) * hz) / rate;
+
+	mutex_enter(&spa->spa_trim_lock);
+	while (!spa->spa_trim_stop && ddi_get_lbolt() < target) {
+		(void) cv_timedwait(&spa->spa_trim_cv, &spa->spa_trim_lock,
+		    target);
+	}
+	mutex_exit(&spa->spa_trim_lock);
+}
+
+static uint64_t
+spa_trim_total_space(spa_t *spa)
+{
+	vdev_t *rvd = spa->spa_root_vdev;
+	uint64_t space = 0;
+	int c;
+
+	ASSERT(spa_config_held(spa, SCL_CONFIG, RW_READER));
+
+	for (c = 0; c < rvd->vdev_children; c++) {
+		vdev_t *vd = rvd->vdev_child[c];
+
+		if (!vd->vdev_ishole)
+			space += vd->vdev_ms_count << vd->vdev_ms_shift;
+	}
+
+	return (space);
+}
+
+static void
+spa_trim_thread(void *arg)
+{
+	spa_t *spa = arg;
+	pool_trim_stat_t *pts = &spa->spa_trim_stats;
+	clock_t start = ddi_get_lbolt();
+	uint64_t c = 0, m = 0, guid = 0, cursor = 0;
+	uint64_t trimmed = 0;
+	boolean_t done = B_FALSE;
+
+	while (!spa_trim_stopping(spa)) {
+		vdev_t *rvd, *vd;
+		metaslab_t *msp;
+		uint64_t before, bytes;
+
+		spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+		rvd = spa->spa_root_vdev;
+		if (c >= rvd->vdev_children) {
+			spa_config_exit(spa, SCL_CONFIG, FTAG);
+			done = B_TRUE;
+			break;
+		}
+
+		/*
+		 * The config may have changed while we slept; start over
+		 * on a vdev that isn't the one we were working on.
+		 */
+		vd = rvd->vdev_child[c];
+		if (vd->vdev_guid != guid) {
+			guid = vd->vdev_guid;
+			m = 0;
+			cursor = 0;
+		}
+
+		if (vd->vdev_ishole || !vdev_writeable(vd) ||
+		    m >= vd->vdev_ms_count) {
+			spa_config_exit(spa, SCL_CONFIG, FTAG);
+			c++;
+			continue;
+		}
+
+		msp = vd->vdev_ms[m];
+		cursor = MAX(cursor, msp->ms_start);
+		before = cursor;
+		bytes = metaslab_trim_manual(msp, &cursor,
+		    zfs_trim_extent_bytes_max);
+		if (cursor >= msp->ms_start + msp->ms_size)
+			m++;
+		spa_config_exit(spa, SCL_CONFIG, FTAG);
+
+		trimmed += bytes;
+
+		mutex_enter(&spa->spa_trim_lock);
+		pts->pts_examined += cursor - before;
+		pts->pts_trimmed += bytes;
+		mutex_exit(&spa->spa_trim_lock);
+
+		spa_trim_throttle(spa, start, trimmed, pts->pts_rate);
+	}
+
+	mutex_enter(&spa->spa_trim_lock);
+	pts->pts_state = done ? POOL_TRIM_FINISHED : POOL_TRIM_CANCELED;
+	pts->pts_end_time = gethrestime_sec();
+	if (done)
+		pts->pts_examined = pts->pts_to_examine;
+	spa->spa_trim_thread = NULL;
+	cv_broadcast(&spa->spa_trim_cv);
+	mutex_exit(&spa->spa_trim_lock);
+
+	thread_exit();
+}
+
+/*
+ * Stop the trim thread, if there is one, and wait for it to exit.
+ */
+void
+spa_trim_stop(spa_t *spa)
+{
+	mutex_enter(&spa->spa_trim_lock);
+	spa->spa_trim_stop = B_TRUE;
+	cv_broadcast(&spa->spa_trim_cv);
+	while (spa->spa_trim_thread != NULL)
+		cv_wait(&spa->spa_trim_cv, &spa->spa_trim_lock);
+	spa->spa_trim_stop = B_FALSE;
+	mutex_exit(&spa->spa_trim_lock);
+}
+
+/*
+ * Start a manual TRIM of all of the pool's free space, limited to 'rate'
+ * bytes per second (0 for no limit).
+ */
+int
+spa_trim(spa_t *spa, uint64_t rate)
+{
+	pool_trim_stat_t *pts = &spa->spa_trim_stats;
+
+	if (!spa_writeable(spa))
+		return (SET_ERROR(EROFS));
+
+	mutex_enter(&spa->spa_trim_lock);
+	if (spa->spa_trim_thread != NULL) {
+		mutex_exit(&spa->spa_trim_lock);
+		return (SET_ERROR(EBUSY));
+	}
+
+	bzero(pts, sizeof (*pts));
+	pts->pts_state = POOL_TRIM_ACTIVE;
+	pts->pts_start_time = gethrestime_sec();
+	pts->pts_rate = rate;
+	spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+	pts->pts_to_examine = spa_trim_total_space(spa);
+	spa_config_exit(spa, SCL_CONFIG, FTAG);
+
+	spa->spa_trim_thread = thread_create(NULL, 0, spa_trim_thread, spa,
+	    0, &p0, TS_RUN, minclsyspri);
+	mutex_exit(&spa->spa_trim_lock);
+
+	return (0);
+}
+
+int
+spa_trim_cancel(spa_t *spa)
+{
+	mutex_enter(&spa->spa_trim_lock);
+	if (spa->spa_trim_thread == NULL) {
+		mutex_exit(&spa->spa_trim_lock);
+		return (SET_ERROR(ENOENT));
+	}
+	mutex_exit(&spa->spa_trim_lock);
+
+	spa_trim_stop(spa);
+
+	return (0);
+}
+
+/*
+ * Get the progress of the current or last manual TRIM.
+ */
+int
+spa_trim_get_stats(spa_t *spa, pool_trim_stat_t *pts)
+{
+	mutex_enter(&spa->spa_trim_lock);
+	if (spa->spa_trim_stats.pts_state == POOL_TRIM_NONE) {
+		mutex_exit(&spa->spa_trim_lock);
+		return (SET_ERROR(ENOENT));
+	}
+	*pts = spa->spa_trim_stats;
+	mutex_exit(&spa->spa_trim_lock);
+
+	return (0);
+}
@@ -44,6 +44,7 @@
 #include <sys/zil.h>
 #include <sys/dsl_scan.h>
 #include <sys/zvol.h>
+#include <sys/zfeature.h>
 #include <sys/zfs_context.h>
 #include <sys/abd.h>
 
@@ -85,6 +86,43 @@ vdev_getops(const char *type)
 	return (ops);
 }
 
+/*
+ * Given a vdev allocation bias, as stored in the config, return its type.
+ */
+static vdev_alloc_bias_t
+vdev_derive_alloc_bias(const char *bias)
+{
+	vdev_alloc_bias_t alloc_bias = VDEV_BIAS_NONE;
+
+	if (strcmp(bias, VDEV_ALLOC_BIAS_LOG) == 0)
+		alloc_bias = VDEV_BIAS_LOG;
+	else if (strcmp(bias, VDEV_ALLOC_BIAS_SPECIAL) == 0)
+		alloc_bias = VDEV_BIAS_SPECIAL;
+	else if (strcmp(bias, VDEV_ALLOC_BIAS_DEDUP) == 0)
+		alloc_bias = VDEV_BIAS_DEDUP;
+
+	return (alloc_bias);
+}
+
+/*
+ * Return the metaslab class a top-level vdev with the given bias allocates
+ * from.
+ */
+static metaslab_class_t *
+vdev_get_mclass(spa_t *spa, vdev_alloc_bias_t alloc_bias)
+{
+	switch (alloc_bias) {
+	case VDEV_BIAS_LOG:
+		return (spa_log_class(spa));
+	case VDEV_BIAS_SPECIAL:
+		return (spa_special_class(spa));
+	case VDEV_BIAS_DEDUP:
+		return (spa_dedup_class(spa));
+	default:
+		return (spa_normal_class(spa));
+	}
+}
+
 /*
  * Default asize function: return the MAX of psize with the asize of
  * all children.  This is what's used by anything other than RAID-Z.
@@ -380,9 +418,11 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
     int alloctype)
 {
 	vdev_ops_t *ops;
-	char *type;
+	char *type, *bias;
 	uint64_t guid = 0, islog, nparity;
+	vdev_alloc_bias_t alloc_bias = VDEV_BIAS_NONE;
 	vdev_t *vd;
+	boolean_t top_level = (parent && !parent->vdev_parent);
 
 	ASSERT(spa_config_held(spa, SCL_ALL, RW_WRITER) == SCL_ALL);
 
@@ -430,6 +470,27 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 	if (islog && spa_version(spa) < SPA_VERSION_SLOGS)
 		return (SET_ERROR(ENOTSUP));
 
+	/*
+	 * Determine the allocation class of a top-level vdev.  Adding a
+	 * special or dedup vdev to an existing pool needs the feature, for
+	 * new pools spa_create() checks it.
+	 */
+	if (top_level && alloctype != VDEV_ALLOC_ATTACH &&
+	    nvlist_lookup_string(nv, ZPOOL_CONFIG_ALLOCATION_BIAS,
+	    &bias) == 0) {
+		alloc_bias = vdev_derive_alloc_bias(bias);
+		if (alloc_bias == VDEV_BIAS_NONE)
+			return (SET_ERROR(EINVAL));
+		if (alloc_bias != VDEV_BIAS_LOG &&
+		    alloctype == VDEV_ALLOC_ADD &&
+		    spa->spa_load_state != SPA_LOAD_CREATE &&
+		    !spa_feature_is_enabled(spa,
+		    SPA_FEATURE_ALLOCATION_CLASSES))
+			return (SET_ERROR(ENOTSUP));
+	}
+	if (islog)
+		alloc_bias = VDEV_BIAS_LOG;
+
 	if (ops == &vdev_hole_ops && spa_version(spa) < SPA_VERSION_HOLES)
 		return (SET_ERROR(ENOTSUP));
 
@@ -472,6 +533,7 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 	vd = vdev_alloc_common(spa, id, guid, ops);
 
 	vd->vdev_islog = islog;
+	vd->vdev_alloc_bias = alloc_bias;
 	vd->vdev_nparity = nparity;
 
 	if (nvlist_lookup_string(nv, ZPOOL_CONFIG_PATH, &vd->vdev_path) == 0)
@@ -513,7 +575,7 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 	/*
 	 * If we're a top-level vdev, try to load the allocation parameters.
 	 */
-	if (parent && !parent->vdev_parent &&
+	if (top_level &&
 	    (alloctype == VDEV_ALLOC_LOAD || alloctype == VDEV_ALLOC_SPLIT)) {
 		(void) nvlist_lookup_uint64(nv, ZPOOL_CONFIG_METASLAB_ARRAY,
 		    &vd->vdev_ms_array);
@@ -529,13 +591,13 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 		ASSERT0(vd->vdev_top_zap);
 	}
 
-	if (parent && !parent->vdev_parent && alloctype != VDEV_ALLOC_ATTACH) {
+	if (top_level && alloctype != VDEV_ALLOC_ATTACH) {
 		ASSERT(alloctype == VDEV_ALLOC_LOAD ||
 		    alloctype == VDEV_ALLOC_ADD ||
 		    alloctype == VDEV_ALLOC_SPLIT ||
 		    alloctype == VDEV_ALLOC_ROOTPOOL);
-		vd->vdev_mg = metaslab_group_create(islog ?
-		    spa_log_class(spa) : spa_normal_class(spa), vd);
+		vd->vdev_mg = metaslab_group_create(
+		    vdev_get_mclass(spa, alloc_bias), vd);
 	}
 
 	if (vd->vdev_ops->vdev_op_leaf &&
@@ -763,6 +825,9 @@ vdev_top_transfer(vdev_t *svd, vdev_t *tvd)
 
 	tvd->vdev_islog = svd->vdev_islog;
 	svd->vdev_islog = 0;
+
+	tvd->vdev_alloc_bias = svd->vdev_alloc_bias;
+	svd->vdev_alloc_bias = VDEV_BIAS_NONE;
 }
 
 static void
@@ -2379,6 +2444,18 @@ vdev_sync(vdev_t *vd, uint64_t txg)
 		    DMU_OT_OBJECT_ARRAY, 0, DMU_OT_NONE, 0, tx);
 		ASSERT(vd->vdev_ms_array != 0);
 		vdev_config_dirty(vd);
+
+		/*
+		 * This is the first txg of a new top-level vdev, which is
+		 * when a special or dedup vdev puts the feature to use.
+		 */
+		if ((vd->vdev_alloc_bias == VDEV_BIAS_SPECIAL ||
+		    vd->vdev_alloc_bias == VDEV_BIAS_DEDUP) &&
+		    spa_feature_is_enabled(spa,
+		    SPA_FEATURE_ALLOCATION_CLASSES)) {
+			spa_feature_incr(spa,
+			    SPA_FEATURE_ALLOCATION_CLASSES, tx);
+		}
 		dmu_tx_commit(tx);
 	}
 
@@ -3142,7 +3219,8 @@ vdev_space_update(vdev_t *vd, int64_t alloc_delta, int64_t defer_delta,
 	vd->vdev_stat.vs_dspace += dspace_delta;
 	mutex_exit(&vd->vdev_stat_lock);
 
-	if (mc == spa_normal_class(spa)) {
+	if (mc == spa_normal_class(spa) || mc == spa_special_class(spa) ||
+	    mc == spa_dedup_class(spa)) {
 		mutex_enter(&rvd->vdev_stat_lock);
 		rvd->vdev_stat.vs_alloc += alloc_delta;
 		rvd->vdev_stat.vs_space += space_delta;
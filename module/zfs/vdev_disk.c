@@ -539,6 +539,7 @@ skip_open:
 	 * try again.
 	 */
 	vd->vdev_nowritecache = B_FALSE;
+	vd->vdev_notrim = B_FALSE;
 
 #ifdef __APPLE__
 	/* Inform the ZIO pipeline that we are non-rotational */
@@ -804,6 +805,26 @@ vdev_disk_io_start(zio_t *zio)
 		zio_execute(zio);
 		return;
 
+	case ZIO_TYPE_TRIM:
+	{
+		dkioc_free_t dfl;
+
+		if (vd->vdev_notrim) {
+			zio->io_error = SET_ERROR(ENOTSUP);
+			zio_execute(zio);
+			return;
+		}
+
+		dfl.df_start = zio->io_offset;
+		dfl.df_length = zio->io_size;
+
+		zio->io_error = ldi_ioctl(dvd->vd_lh, DKIOCFREE,
+		    (intptr_t)&dfl, FKIOCTL, kcred, NULL);
+
+		zio_interrupt(zio);
+		return;
+	}
+
 	case ZIO_TYPE_WRITE:
 		if (zio->io_priority == ZIO_PRIORITY_SYNC_WRITE)
 			flags = B_WRITE;
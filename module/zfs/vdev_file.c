@@ -32,13 +32,119 @@
 #include <sys/fs/zfs.h>
 #include <sys/fm/fs/zfs.h>
 #include <sys/vnode.h>
+#ifndef _KERNEL
+#include <aio.h>
+#endif
 
 
 /*
  * Virtual device vector for files.
+ *
+ * Reads and writes go to vdev_file_taskq, whose threads do one blocking
+ * vn_rdwr() each.  In the userland build (ztest, zdb and the other
+ * libzpool consumers) they instead go through POSIX AIO when it is
+ * available: vdev_file_io_start() queues the I/O, a batch of queued I/Os
+ * is handed to the kernel with a single lio_listio() call, and one reaper
+ * thread waits for all of the outstanding I/Os with aio_suspend() and
+ * completes them, so there's no thread tied up per in-flight I/O.  I/Os
+ * that AIO won't take fall back to the taskq.  Writes are split in two
+ * like vn_rdwr() splits them, so that ztest still gets partial writes
+ * when it kills the process.
  */
 
 static taskq_t *vdev_file_taskq;
+static kmem_cache_t *vdev_file_io_cache;
+
+/*
+ * A read or write in progress.
+ */
+typedef struct vdev_file_io {
+	zio_t		*vfio_zio;
+	hrtime_t	vfio_start;	/* when vdev_file_io_start() saw it */
+	void		*vfio_data;	/* borrowed linear buffer */
+#ifndef _KERNEL
+	struct aiocb	vfio_aiocb;
+	size_t		vfio_done;	/* bytes transferred by AIO so far */
+	list_node_t	vfio_node;	/* on the pending or in-flight list */
+#endif
+} vdev_file_io_t;
+
+typedef struct vdev_file_stats {
+	kstat_named_t vfstat_sync_ios;
+	kstat_named_t vfstat_aio_ios;
+	kstat_named_t vfstat_aio_batches;
+	kstat_named_t vfstat_aio_fallbacks;
+	kstat_named_t vfstat_queue_depth;
+	kstat_named_t vfstat_queue_depth_max;
+	kstat_named_t vfstat_latency_total_ns;
+	kstat_named_t vfstat_latency_max_ns;
+} vdev_file_stats_t;
+
+static vdev_file_stats_t vdev_file_stats = {
+	{ "sync_ios",			KSTAT_DATA_UINT64 },
+	{ "aio_ios",			KSTAT_DATA_UINT64 },
+	{ "aio_batches",		KSTAT_DATA_UINT64 },
+	{ "aio_fallbacks",		KSTAT_DATA_UINT64 },
+	{ "queue_depth",		KSTAT_DATA_UINT64 },
+	{ "queue_depth_max",		KSTAT_DATA_UINT64 },
+	{ "latency_total_ns",		KSTAT_DATA_UINT64 },
+	{ "latency_max_ns",		KSTAT_DATA_UINT64 },
+};
+
+#define	VFSTAT_BUMP(stat) \
+	atomic_inc_64(&vdev_file_stats.stat.value.ui64);
+#define	VFSTAT_ADD(stat, val) \
+	atomic_add_64(&vdev_file_stats.stat.value.ui64, (val));
+
+static kstat_t *vdev_file_ksp;
+
+/*
+ * Raise a high-water mark kstat to 'val'.
+ */
+static void
+vdev_file_stat_max(kstat_named_t *kn, uint64_t val)
+{
+	uint64_t old;
+
+	while ((old = kn->value.ui64) < val) {
+		if (atomic_cas_64(&kn->value.ui64, old, val) == old)
+			break;
+	}
+}
+
+#ifndef _KERNEL
+/*
+ * Use POSIX AIO for file vdevs.  This and the queue depth below are only
+ * read by spa_init().
+ */
+int zfs_vdev_file_aio = 1;
+
+/*
+ * The most AIO requests kept in flight at once.  macOS only allows 16
+ * per process by default (kern.aioprocmax), and going over that makes
+ * lio_listio() fail, which sends the I/Os to the taskq instead.
+ */
+int zfs_vdev_file_aio_queue_depth = 16;
+
+/* The most I/Os handed to one lio_listio() call. */
+#define	VDEV_FILE_AIO_BATCH	16
+
+/*
+ * How long the reaper sleeps in aio_suspend() before it rescans the
+ * in-flight list, which picks up I/Os submitted while it was asleep.
+ */
+#define	VDEV_FILE_AIO_POLL_NS	(NANOSEC / 1000)
+
+static kmutex_t vdev_file_aio_lock;
+static kcondvar_t vdev_file_aio_cv;
+static list_t vdev_file_aio_pending;	/* queued, not yet submitted */
+static list_t vdev_file_aio_inflight;	/* submitted, not yet reaped */
+static int vdev_file_aio_depth;
+static int vdev_file_aio_ninflight;	/* in flight, or being submitted */
+static boolean_t vdev_file_aio_submitting;
+static boolean_t vdev_file_aio_exit;
+static kthread_t *vdev_file_aio_thread;
+#endif
 
 static void
 vdev_file_hold(vdev_t *vd)
@@ -176,6 +282,9 @@ skip_open:
 	*max_psize = *psize = vp->v_size;
 #endif
     *ashift = SPA_MINBLOCKSHIFT;
+
+	/* Retry TRIM after a reopen, like the disk vdev does. */
+	vd->vdev_notrim = B_FALSE;
     VN_RELE(vf->vf_vnode);
 
 	return (0);
@@ -209,68 +318,383 @@ vdev_file_close(vdev_t *vd)
  */
 _Atomic uint64_t zfs_vdev_file_size_mismatch_cnt = 0;
 
+static void *
+vdev_file_io_borrow(zio_t *zio)
+{
+#ifdef DEBUG
+	if (zio->io_abd->abd_size != zio->io_size) {
+		zfs_vdev_file_size_mismatch_cnt++;
+
+		// this dprintf can be very noisy
+		dprintf("ZFS: %s: trimming zio->io_abd from 0x%x to 0x%llx\n",
+			__func__, zio->io_abd->abd_size, zio->io_size);
+	}
+#endif
+	ASSERT3S(zio->io_abd->abd_size,>=,zio->io_size);
+	if (zio->io_type == ZIO_TYPE_READ)
+		return (abd_borrow_buf(zio->io_abd, zio->io_abd->abd_size));
+	else
+		return (abd_borrow_buf_copy(zio->io_abd, zio->io_abd->abd_size));
+}
+
+static void
+vdev_file_io_return(zio_t *zio, void *data)
+{
+	if (zio->io_type == ZIO_TYPE_READ) {
+		if (zio->io_abd->abd_size == zio->io_size) {
+			abd_return_buf_copy(zio->io_abd, data, zio->io_size);
+		} else {
+			VERIFY3S(zio->io_abd->abd_size,>=,zio->io_size);
+			abd_return_buf_copy_off(zio->io_abd, data,
+				0, zio->io_size, zio->io_abd->abd_size);
+		}
+	} else {
+		VERIFY3S(zio->io_abd->abd_size,>=,zio->io_size);
+		abd_return_buf_off(zio->io_abd, data, 0, zio->io_size,
+			zio->io_abd->abd_size);
+	}
+}
+
+/*
+ * Finish a read or write, by whichever path it took: give back the
+ * borrowed buffer, set the zio's error and account for the I/O.
+ */
+static void
+vdev_file_io_finish(vdev_file_io_t *vfio, int error, ssize_t resid)
+{
+	zio_t *zio = vfio->vfio_zio;
+	hrtime_t delta = gethrtime() - vfio->vfio_start;
+
+	if (vfio->vfio_data != NULL)
+		vdev_file_io_return(zio, vfio->vfio_data);
+
+	zio->io_error = (error != 0 ? EIO : 0);
+
+	if (zio->io_error == 0 && resid != 0)
+		zio->io_error = SET_ERROR(ENOSPC);
+
+	atomic_dec_64(&vdev_file_stats.vfstat_queue_depth.value.ui64);
+	VFSTAT_ADD(vfstat_latency_total_ns, delta);
+	vdev_file_stat_max(&vdev_file_stats.vfstat_latency_max_ns, delta);
+
+	kmem_cache_free(vdev_file_io_cache, vfio);
+	zio_delay_interrupt(zio);
+}
+
 static void
 vdev_file_io_strategy(void *arg)
 {
-	zio_t *zio = (zio_t *)arg;
+	vdev_file_io_t *vfio = arg;
+	zio_t *zio = vfio->vfio_zio;
 	vdev_t *vd = zio->io_vd;
 	vdev_file_t *vf = vd->vdev_tsd;
-	ssize_t resid;
-	void *data;
+	ssize_t resid = 0;
+	int error;
 
-    if (!vnode_getwithvid(vf->vf_vnode, vf->vf_vid)) {
+	VFSTAT_BUMP(vfstat_sync_ios);
 
-#ifdef DEBUG
-		if (zio->io_abd->abd_size != zio->io_size) {
-			zfs_vdev_file_size_mismatch_cnt++;
+	if (!vnode_getwithvid(vf->vf_vnode, vf->vf_vid)) {
 
-			// this dprintf can be very noisy
-			dprintf("ZFS: %s: trimming zio->io_abd from 0x%x to 0x%llx\n",
-				__func__, zio->io_abd->abd_size, zio->io_size);
-		}
-#endif
-		if (zio->io_type == ZIO_TYPE_READ) {
-			ASSERT3S(zio->io_abd->abd_size,>=,zio->io_size);
-			data =
-				abd_borrow_buf(zio->io_abd, zio->io_abd->abd_size);
-		} else {
-			ASSERT3S(zio->io_abd->abd_size,>=,zio->io_size);
-			data =
-				abd_borrow_buf_copy(zio->io_abd, zio->io_abd->abd_size);
-		}
+		/* An I/O that AIO turned down already has its buffer. */
+		if (vfio->vfio_data == NULL)
+			vfio->vfio_data = vdev_file_io_borrow(zio);
+
+		error = vn_rdwr(zio->io_type == ZIO_TYPE_READ ?
+		    UIO_READ : UIO_WRITE, vf->vf_vnode, vfio->vfio_data,
+		    zio->io_size, zio->io_offset, UIO_SYSSPACE, 0,
+		    RLIM64_INFINITY, kcred, &resid);
+
+        vnode_put(vf->vf_vnode);
 
-		zio->io_error = vn_rdwr(zio->io_type == ZIO_TYPE_READ ?
-		    UIO_READ : UIO_WRITE, vf->vf_vnode, data, zio->io_size,
-			zio->io_offset, UIO_SYSSPACE, 0, RLIM64_INFINITY, kcred, &resid);
+	} else { // vnode_getwithvid()
 
-		zio->io_error = (zio->io_error != 0 ? EIO : 0);
+		error = EIO;
 
-		if (zio->io_error == 0 && resid != 0)
-			zio->io_error = SET_ERROR(ENOSPC);
+	}
+
+	vdev_file_io_finish(vfio, error, resid);
+}
+
+static void
+vdev_file_io_dispatch(vdev_file_io_t *vfio)
+{
+	VERIFY3U(taskq_dispatch(vdev_file_taskq, vdev_file_io_strategy, vfio,
+	    TQ_SLEEP), !=, 0);
+}
+
+#ifndef _KERNEL
+/*
+ * Submit queued I/Os, a batch per lio_listio() call, for as long as there
+ * are I/Os queued and room in flight for them.  Only one thread submits at
+ * a time; I/Os queued meanwhile go out with its next batch.  I/Os that AIO
+ * refuses, e.g. because the system-wide AIO limit was reached, are done
+ * by the taskq instead.
+ */
+static void
+vdev_file_aio_submit(void)
+{
+	vdev_file_io_t *batch[VDEV_FILE_AIO_BATCH];
+	struct aiocb *cbs[VDEV_FILE_AIO_BATCH];
+	boolean_t queued[VDEV_FILE_AIO_BATCH];
+	vdev_file_io_t *vfio;
+	list_t refused;
+	int i, n;
+
+	list_create(&refused, sizeof (vdev_file_io_t),
+	    offsetof(vdev_file_io_t, vfio_node));
+
+	mutex_enter(&vdev_file_aio_lock);
+	if (vdev_file_aio_submitting) {
+		mutex_exit(&vdev_file_aio_lock);
+		list_destroy(&refused);
+		return;
+	}
+	vdev_file_aio_submitting = B_TRUE;
+
+	for (;;) {
+		n = 0;
+		while (n < VDEV_FILE_AIO_BATCH &&
+		    vdev_file_aio_ninflight < vdev_file_aio_depth &&
+		    (vfio = list_remove_head(&vdev_file_aio_pending)) != NULL) {
+			batch[n] = vfio;
+			cbs[n] = &vfio->vfio_aiocb;
+			queued[n] = B_TRUE;
+			vdev_file_aio_ninflight++;
+			n++;
+		}
+		if (n == 0)
+			break;
+		mutex_exit(&vdev_file_aio_lock);
+
+		VFSTAT_BUMP(vfstat_aio_batches);
+		if (lio_listio(LIO_NOWAIT, cbs, n, NULL) != 0) {
+			/*
+			 * Some of the batch may still have been queued.  Those
+			 * report EINPROGRESS, or their result if they already
+			 * completed, and have to be reaped like the others.
+			 */
+			for (i = 0; i < n; i++) {
+				int err = aio_error(cbs[i]);
+
+				if (err == -1 || err == EAGAIN)
+					queued[i] = B_FALSE;
+			}
+		}
 
-		if (zio->io_type == ZIO_TYPE_READ) {
-			if (zio->io_abd->abd_size == zio->io_size) {
-				abd_return_buf_copy(zio->io_abd, data, zio->io_size);
+		mutex_enter(&vdev_file_aio_lock);
+		for (i = 0; i < n; i++) {
+			if (queued[i]) {
+				list_insert_tail(&vdev_file_aio_inflight,
+				    batch[i]);
 			} else {
-				VERIFY3S(zio->io_abd->abd_size,>=,zio->io_size);
-				abd_return_buf_copy_off(zio->io_abd, data,
-					0, zio->io_size, zio->io_abd->abd_size);
+				list_insert_tail(&refused, batch[i]);
+				vdev_file_aio_ninflight--;
 			}
-		} else {
-			VERIFY3S(zio->io_abd->abd_size,>=,zio->io_size);
-			abd_return_buf_off(zio->io_abd, data, 0, zio->io_size,
-				zio->io_abd->abd_size);
 		}
+		cv_signal(&vdev_file_aio_cv);
+	}
+	vdev_file_aio_submitting = B_FALSE;
+	mutex_exit(&vdev_file_aio_lock);
 
-        vnode_put(vf->vf_vnode);
+	while ((vfio = list_remove_head(&refused)) != NULL) {
+		vdev_file_t *vf = vfio->vfio_zio->io_vd->vdev_tsd;
 
-	} else { // vnode_getwithvid()
+		/* The taskq takes its own hold for the vn_rdwr(). */
+		vnode_put(vf->vf_vnode);
+		VFSTAT_BUMP(vfstat_aio_fallbacks);
+		vdev_file_io_dispatch(vfio);
+	}
+	list_destroy(&refused);
+}
 
-		zio->io_error = EIO;
+/*
+ * Queue a read or write for AIO.  Returns B_FALSE if AIO isn't in use,
+ * in which case the caller does the I/O the blocking way.
+ */
+static boolean_t
+vdev_file_aio_start(vdev_file_io_t *vfio)
+{
+	zio_t *zio = vfio->vfio_zio;
+	vdev_file_t *vf = zio->io_vd->vdev_tsd;
+	struct aiocb *cb = &vfio->vfio_aiocb;
+	int sectors;
+
+	if (vdev_file_aio_thread == NULL)
+		return (B_FALSE);
+
+	/*
+	 * Hold the vnode until the I/O completes, as the taskq holds it
+	 * across its vn_rdwr().  If it's gone, the taskq fails the I/O.
+	 */
+	if (vnode_getwithvid(vf->vf_vnode, vf->vf_vid) != 0)
+		return (B_FALSE);
 
+	vfio->vfio_data = vdev_file_io_borrow(zio);
+	vfio->vfio_done = 0;
+
+	bzero(cb, sizeof (*cb));
+	cb->aio_fildes = vf->vf_vnode->v_fd;
+	cb->aio_offset = zio->io_offset;
+	cb->aio_buf = vfio->vfio_data;
+	cb->aio_nbytes = zio->io_size;
+	cb->aio_lio_opcode = (zio->io_type == ZIO_TYPE_READ) ?
+	    LIO_READ : LIO_WRITE;
+	cb->aio_sigevent.sigev_notify = SIGEV_NONE;
+
+	/*
+	 * Write the part up to a random sector first and the rest once
+	 * that's done, as vn_rdwr() does, see vdev_file_aio_resume().
+	 */
+	if (zio->io_type == ZIO_TYPE_WRITE) {
+		sectors = zio->io_size >> SPA_MINBLOCKSHIFT;
+		if (sectors > 1)
+			cb->aio_nbytes = (rand() % (sectors - 1) + 1) <<
+			    SPA_MINBLOCKSHIFT;
 	}
 
-	zio_delay_interrupt(zio);
+	mutex_enter(&vdev_file_aio_lock);
+	list_insert_tail(&vdev_file_aio_pending, vfio);
+	mutex_exit(&vdev_file_aio_lock);
+
+	vdev_file_aio_submit();
+
+	return (B_TRUE);
+}
+
+/*
+ * Account for an AIO request that transferred 'rc' bytes.  If it was the
+ * first part of a split write and it went out whole, queue the rest and
+ * return B_TRUE; the I/O is done otherwise.
+ */
+static boolean_t
+vdev_file_aio_resume(vdev_file_io_t *vfio, ssize_t rc)
+{
+	zio_t *zio = vfio->vfio_zio;
+	struct aiocb *cb = &vfio->vfio_aiocb;
+
+	vfio->vfio_done += rc;
+	if ((size_t)rc != cb->aio_nbytes || vfio->vfio_done >= zio->io_size)
+		return (B_FALSE);
+
+	cb->aio_offset = zio->io_offset + vfio->vfio_done;
+	cb->aio_buf = (char *)vfio->vfio_data + vfio->vfio_done;
+	cb->aio_nbytes = zio->io_size - vfio->vfio_done;
+
+	mutex_enter(&vdev_file_aio_lock);
+	list_insert_tail(&vdev_file_aio_pending, vfio);
+	mutex_exit(&vdev_file_aio_lock);
+
+	return (B_TRUE);
+}
+
+/*
+ * Wait for in-flight AIO requests to complete, complete their zios and
+ * submit whatever was queued behind them.
+ */
+static void
+vdev_file_aio_reaper(void *arg)
+{
+	const struct aiocb **cbs;
+	struct timespec ts = { 0, VDEV_FILE_AIO_POLL_NS };
+	vdev_file_io_t *vfio, *next;
+	list_t done;
+	int n;
+
+	cbs = kmem_alloc(vdev_file_aio_depth * sizeof (struct aiocb *),
+	    KM_SLEEP);
+	list_create(&done, sizeof (vdev_file_io_t),
+	    offsetof(vdev_file_io_t, vfio_node));
+
+	mutex_enter(&vdev_file_aio_lock);
+	for (;;) {
+		if (list_is_empty(&vdev_file_aio_inflight)) {
+			if (vdev_file_aio_exit)
+				break;
+			cv_wait(&vdev_file_aio_cv, &vdev_file_aio_lock);
+			continue;
+		}
+
+		n = 0;
+		for (vfio = list_head(&vdev_file_aio_inflight);
+		    vfio != NULL && n < vdev_file_aio_depth;
+		    vfio = list_next(&vdev_file_aio_inflight, vfio))
+			cbs[n++] = &vfio->vfio_aiocb;
+		mutex_exit(&vdev_file_aio_lock);
+
+		(void) aio_suspend(cbs, n, &ts);
+
+		mutex_enter(&vdev_file_aio_lock);
+		for (vfio = list_head(&vdev_file_aio_inflight); vfio != NULL;
+		    vfio = next) {
+			next = list_next(&vdev_file_aio_inflight, vfio);
+			if (aio_error(&vfio->vfio_aiocb) == EINPROGRESS)
+				continue;
+			list_remove(&vdev_file_aio_inflight, vfio);
+			list_insert_tail(&done, vfio);
+			vdev_file_aio_ninflight--;
+		}
+		if (list_is_empty(&done))
+			continue;
+		mutex_exit(&vdev_file_aio_lock);
+
+		while ((vfio = list_remove_head(&done)) != NULL) {
+			ssize_t rc = aio_return(&vfio->vfio_aiocb);
+			vdev_file_t *vf = vfio->vfio_zio->io_vd->vdev_tsd;
+
+			if (rc >= 0 && vdev_file_aio_resume(vfio, rc))
+				continue;
+
+			vnode_put(vf->vf_vnode);
+			VFSTAT_BUMP(vfstat_aio_ios);
+			if (rc < 0)
+				vdev_file_io_finish(vfio, EIO, 0);
+			else
+				vdev_file_io_finish(vfio, 0,
+				    vfio->vfio_zio->io_size - vfio->vfio_done);
+		}
+
+		vdev_file_aio_submit();
+		mutex_enter(&vdev_file_aio_lock);
+	}
+	vdev_file_aio_thread = NULL;
+	cv_broadcast(&vdev_file_aio_cv);
+	mutex_exit(&vdev_file_aio_lock);
+
+	list_destroy(&done);
+	kmem_free(cbs, vdev_file_aio_depth * sizeof (struct aiocb *));
+
+	thread_exit();
+}
+#endif
+
+/*
+ * Release the backing store of a freed range by punching a hole in the
+ * file, so that TRIM can be exercised on file vdevs.
+ */
+static int
+vdev_file_trim(vdev_file_t *vf, uint64_t offset, uint64_t size)
+{
+#ifdef F_PUNCHHOLE
+	fpunchhole_t fph = { 0 };
+	int error;
+
+	fph.fp_offset = offset;
+	fph.fp_length = size;
+
+#ifdef _KERNEL
+	if ((error = vnode_getwithvid(vf->vf_vnode, vf->vf_vid)) != 0)
+		return (SET_ERROR(ENXIO));
+	error = VNOP_IOCTL(vf->vf_vnode, F_PUNCHHOLE, (caddr_t)&fph, 0,
+	    vfs_context_current());
+	vnode_put(vf->vf_vnode);
+#else
+	error = (fcntl(vf->vf_vnode->v_fd, F_PUNCHHOLE, &fph) == -1) ?
+	    errno : 0;
+#endif
+	return (error);
+#else
+	return (SET_ERROR(ENOTSUP));
+#endif
 }
 
 static void
@@ -278,6 +702,8 @@ vdev_file_io_start(zio_t *zio)
 {
     vdev_t *vd = zio->io_vd;
     vdev_file_t *vf = vd->vdev_tsd;
+	vdev_file_io_t *vfio;
+	uint64_t depth;
 
     if (zio->io_type == ZIO_TYPE_IOCTL) {
 
@@ -304,11 +730,32 @@ vdev_file_io_start(zio_t *zio)
         return;
     }
 
+	if (zio->io_type == ZIO_TYPE_TRIM) {
+		if (vd->vdev_notrim)
+			zio->io_error = SET_ERROR(ENOTSUP);
+		else
+			zio->io_error = vdev_file_trim(vf, zio->io_offset,
+			    zio->io_size);
+		zio_interrupt(zio);
+		return;
+	}
+
 	ASSERT(zio->io_type == ZIO_TYPE_READ || zio->io_type == ZIO_TYPE_WRITE);
 	zio->io_target_timestamp = zio_handle_io_delay(zio);
 
-	VERIFY3U(taskq_dispatch(system_taskq, vdev_file_io_strategy, zio,
-        TQ_SLEEP), !=, 0);
+	vfio = kmem_cache_alloc(vdev_file_io_cache, KM_SLEEP);
+	vfio->vfio_zio = zio;
+	vfio->vfio_start = gethrtime();
+	vfio->vfio_data = NULL;
+
+	depth = atomic_inc_64_nv(&vdev_file_stats.vfstat_queue_depth.value.ui64);
+	vdev_file_stat_max(&vdev_file_stats.vfstat_queue_depth_max, depth);
+
+#ifndef _KERNEL
+	if (vdev_file_aio_start(vfio))
+		return;
+#endif
+	vdev_file_io_dispatch(vfio);
 }
 
 
@@ -338,12 +785,65 @@ vdev_file_init(void)
 	    max_ncpus, INT_MAX, TASKQ_PREPOPULATE | TASKQ_THREADS_CPU_PCT);
 
 	VERIFY(vdev_file_taskq);
+
+	vdev_file_io_cache = kmem_cache_create("vdev_file_io_cache",
+	    sizeof (vdev_file_io_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+
+	vdev_file_ksp = kstat_create("zfs", 0, "vdev_file", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (vdev_file_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+
+	if (vdev_file_ksp != NULL) {
+		vdev_file_ksp->ks_data = &vdev_file_stats;
+		kstat_install(vdev_file_ksp);
+	}
+
+#ifndef _KERNEL
+	mutex_init(&vdev_file_aio_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&vdev_file_aio_cv, NULL, CV_DEFAULT, NULL);
+	list_create(&vdev_file_aio_pending, sizeof (vdev_file_io_t),
+	    offsetof(vdev_file_io_t, vfio_node));
+	list_create(&vdev_file_aio_inflight, sizeof (vdev_file_io_t),
+	    offsetof(vdev_file_io_t, vfio_node));
+	vdev_file_aio_depth = MAX(zfs_vdev_file_aio_queue_depth, 1);
+	vdev_file_aio_exit = B_FALSE;
+
+	if (zfs_vdev_file_aio) {
+		vdev_file_aio_thread = thread_create(NULL, 0,
+		    vdev_file_aio_reaper, NULL, 0, &p0, TS_RUN, minclsyspri);
+	}
+#endif
 }
 
 void
 vdev_file_fini(void)
 {
+#ifndef _KERNEL
+	/*
+	 * All pools are gone by now, so nothing is queued and the reaper
+	 * exits as soon as it has nothing in flight.
+	 */
+	mutex_enter(&vdev_file_aio_lock);
+	vdev_file_aio_exit = B_TRUE;
+	cv_broadcast(&vdev_file_aio_cv);
+	while (vdev_file_aio_thread != NULL)
+		cv_wait(&vdev_file_aio_cv, &vdev_file_aio_lock);
+	mutex_exit(&vdev_file_aio_lock);
+
+	ASSERT(list_is_empty(&vdev_file_aio_pending));
+	list_destroy(&vdev_file_aio_inflight);
+	list_destroy(&vdev_file_aio_pending);
+	cv_destroy(&vdev_file_aio_cv);
+	mutex_destroy(&vdev_file_aio_lock);
+#endif
+
+	if (vdev_file_ksp != NULL) {
+		kstat_delete(vdev_file_ksp);
+		vdev_file_ksp = NULL;
+	}
+
 	taskq_destroy(vdev_file_taskq);
+	kmem_cache_destroy(vdev_file_io_cache);
 }
 
 /*
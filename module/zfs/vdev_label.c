@@ -420,6 +420,13 @@ vdev_config_generate(spa_t *spa, vdev_t *vd, boolean_t getstats,
 		fnvlist_add_uint64(nv, ZPOOL_CONFIG_ASIZE,
 		    vd->vdev_asize);
 		fnvlist_add_uint64(nv, ZPOOL_CONFIG_IS_LOG, vd->vdev_islog);
+		if (vd->vdev_alloc_bias == VDEV_BIAS_SPECIAL) {
+			fnvlist_add_string(nv, ZPOOL_CONFIG_ALLOCATION_BIAS,
+			    VDEV_ALLOC_BIAS_SPECIAL);
+		} else if (vd->vdev_alloc_bias == VDEV_BIAS_DEDUP) {
+			fnvlist_add_string(nv, ZPOOL_CONFIG_ALLOCATION_BIAS,
+			    VDEV_ALLOC_BIAS_DEDUP);
+		}
 		if (vd->vdev_removing)
 			fnvlist_add_uint64(nv, ZPOOL_CONFIG_REMOVING,
 			    vd->vdev_removing);
@@ -460,6 +467,16 @@ vdev_config_generate(spa_t *spa, vdev_t *vd, boolean_t getstats,
 		}
 	}
 
+	if (getstats && vd == spa->spa_root_vdev) {
+		pool_trim_stat_t pts;
+
+		if (spa_trim_get_stats(spa, &pts) == 0) {
+			fnvlist_add_uint64_array(nv,
+			    ZPOOL_CONFIG_TRIM_STATS, (uint64_t *)&pts,
+			    sizeof (pool_trim_stat_t) / sizeof (uint64_t));
+		}
+	}
+
 	if (!vd->vdev_ops->vdev_op_leaf) {
 		nvlist_t **child;
 		int c, idx;
@@ -43,6 +43,7 @@ typedef struct mirror_child {
 	uint64_t	mc_offset;
 	int		mc_error;
 	int		mc_load;
+	hrtime_t	mc_lat;
 	uint8_t		mc_tried;
 	uint8_t		mc_skipped;
 	uint8_t		mc_speculative;
@@ -78,6 +79,18 @@ uint64_t zfs_vdev_mirror_rotating_seek_offset = 1 * 1024 * 1024;
 uint64_t zfs_vdev_mirror_non_rotating_inc = 0;
 uint64_t zfs_vdev_mirror_non_rotating_seek_inc = 1;
 
+/*
+ * Children whose measured read latency differs can be weighted by it, so
+ * that a slower or misbehaving member of a mirror gets fewer reads.  A
+ * child's load is scaled by how much slower it has been than the fastest
+ * child, unless it is within zfs_vdev_mirror_latency_tolerance percent of
+ * it.  Latencies older than zfs_vdev_mirror_latency_stale_ms are ignored,
+ * so that a child that was avoided is tried again now and then.
+ */
+uint64_t zfs_vdev_mirror_latency_aware = 1;
+uint64_t zfs_vdev_mirror_latency_tolerance = 25;
+uint64_t zfs_vdev_mirror_latency_stale_ms = 1000;
+
 static inline size_t
 vdev_mirror_map_size(int children)
 {
@@ -164,6 +177,37 @@ vdev_mirror_load(mirror_map_t *mm, vdev_t *vd, uint64_t zio_offset)
 	return (load + zfs_vdev_mirror_rotating_seek_inc);
 }
 
+static hrtime_t
+vdev_mirror_latency(mirror_map_t *mm, vdev_t *vd)
+{
+	if (mm->mm_root || !zfs_vdev_mirror_latency_aware)
+		return (0);
+
+	return (vdev_queue_read_latency(vd,
+	    MSEC2NSEC(zfs_vdev_mirror_latency_stale_ms)));
+}
+
+/*
+ * Scale a child's load by its latency relative to the fastest child's,
+ * so that the load approximates how long a read would wait in the unit
+ * of the fastest child's service time.  A child without a recent
+ * latency, or within the tolerance of the fastest, counts as fastest.
+ */
+static int
+vdev_mirror_latency_load(mirror_child_t *mc, hrtime_t lat_min)
+{
+	hrtime_t lat = mc->mc_lat;
+
+	if (lat_min == 0)
+		return (mc->mc_load);
+
+	if (lat == 0 || lat * 100 <=
+	    lat_min * (100 + zfs_vdev_mirror_latency_tolerance))
+		lat = lat_min;
+
+	return ((int)MIN((mc->mc_load + 1LL) * lat / lat_min, INT_MAX - 1));
+}
+
 /*
  * Avoid inlining the function to keep vdev_mirror_io_start(), which
  * is this functions only caller, as small as possible on the stack.
@@ -342,11 +386,16 @@ vdev_mirror_child_select(zio_t *zio)
 {
 	mirror_map_t *mm = zio->io_vsd;
 	uint64_t txg = zio->io_txg;
-	int c, lowest_load;
+	hrtime_t lat_min = 0;
+	int c, i, n, load, lowest_load;
 
 	ASSERT(zio->io_bp == NULL || BP_PHYSICAL_BIRTH(zio->io_bp) == txg);
 
-	lowest_load = INT_MAX;
+	/*
+	 * Collect the children we can read from, with their load and
+	 * latency, then keep those with the lowest load once it has been
+	 * scaled by latency.
+	 */
 	mm->mm_preferred_cnt = 0;
 	for (c = 0; c < mm->mm_children; c++) {
 		mirror_child_t *mc;
@@ -370,11 +419,25 @@ vdev_mirror_child_select(zio_t *zio)
 		}
 
 		mc->mc_load = vdev_mirror_load(mm, mc->mc_vd, mc->mc_offset);
-		if (mc->mc_load > lowest_load)
+		mc->mc_lat = vdev_mirror_latency(mm, mc->mc_vd);
+		if (mc->mc_lat != 0 && (lat_min == 0 || mc->mc_lat < lat_min))
+			lat_min = mc->mc_lat;
+
+		mm->mm_preferred[mm->mm_preferred_cnt] = c;
+		mm->mm_preferred_cnt++;
+	}
+
+	lowest_load = INT_MAX;
+	n = mm->mm_preferred_cnt;
+	mm->mm_preferred_cnt = 0;
+	for (i = 0; i < n; i++) {
+		c = mm->mm_preferred[i];
+		load = vdev_mirror_latency_load(&mm->mm_child[c], lat_min);
+		if (load > lowest_load)
 			continue;
 
-		if (mc->mc_load < lowest_load) {
-			lowest_load = mc->mc_load;
+		if (load < lowest_load) {
+			lowest_load = load;
 			mm->mm_preferred_cnt = 0;
 		}
 		mm->mm_preferred[mm->mm_preferred_cnt] = c;
@@ -447,10 +510,11 @@ vdev_mirror_io_start(zio_t *zio)
 		c = vdev_mirror_child_select(zio);
 		children = (c >= 0);
 	} else {
-		ASSERT(zio->io_type == ZIO_TYPE_WRITE);
+		ASSERT(zio->io_type == ZIO_TYPE_WRITE ||
+		    zio->io_type == ZIO_TYPE_TRIM);
 
 		/*
-		 * Writes go to all children.
+		 * Writes and trims go to all children.
 		 */
 		c = 0;
 		children = mm->mm_children;
@@ -502,6 +566,16 @@ vdev_mirror_io_done(zio_t *zio)
 		}
 	}
 
+	if (zio->io_type == ZIO_TYPE_TRIM) {
+		/*
+		 * A TRIM is advisory; only report it failed if it failed
+		 * on every child.
+		 */
+		if (good_copies == 0)
+			zio->io_error = vdev_mirror_worst_error(mm);
+		return;
+	}
+
 	if (zio->io_type == ZIO_TYPE_WRITE) {
 		/*
 		 * XXX -- for now, treat partial writes as success.
@@ -154,6 +154,8 @@ uint32_t zfs_vdev_async_write_min_active = 1;
 uint32_t zfs_vdev_async_write_max_active = 10;
 uint32_t zfs_vdev_scrub_min_active = 1;
 uint32_t zfs_vdev_scrub_max_active = 2;
+uint32_t zfs_vdev_trim_min_active = 1;
+uint32_t zfs_vdev_trim_max_active = 2;
 
 /*
  * When the pool has less than zfs_vdev_async_write_active_min_dirty_percent
@@ -175,6 +177,12 @@ int zfs_vdev_aggregation_limit = SPA_OLD_MAXBLOCKSIZE;
 int zfs_vdev_read_gap_limit = 32 << 10;
 int zfs_vdev_write_gap_limit = 4 << 10;
 
+/*
+ * Adjacent TRIMs are merged up to the largest extent a metaslab will
+ * issue, since a discard carries no data to copy.
+ */
+extern uint64_t zfs_trim_extent_bytes_max;
+
 /*
  * Define the queue depth percentage for each top-level. This percentage is
  * used in conjunction with zfs_vdev_async_max_active to determine how many
@@ -219,11 +227,14 @@ vdev_queue_class_tree(vdev_queue_t *vq, zio_priority_t p)
 static inline avl_tree_t *
 vdev_queue_type_tree(vdev_queue_t *vq, zio_type_t t)
 {
-	ASSERT(t == ZIO_TYPE_READ || t == ZIO_TYPE_WRITE);
+	ASSERT(t == ZIO_TYPE_READ || t == ZIO_TYPE_WRITE ||
+	    t == ZIO_TYPE_TRIM);
 	if (t == ZIO_TYPE_READ)
 		return (&vq->vq_read_offset_tree);
-	else
+	else if (t == ZIO_TYPE_WRITE)
 		return (&vq->vq_write_offset_tree);
+	else
+		return (&vq->vq_trim_offset_tree);
 }
 
 int
@@ -259,6 +270,8 @@ vdev_queue_class_min_active(zio_priority_t p)
 		return (zfs_vdev_async_write_min_active);
 	case ZIO_PRIORITY_SCRUB:
 		return (zfs_vdev_scrub_min_active);
+	case ZIO_PRIORITY_TRIM:
+		return (zfs_vdev_trim_min_active);
 	default:
 		panic("invalid priority %u", p);
 		return (0);
@@ -318,6 +331,8 @@ vdev_queue_class_max_active(spa_t *spa, zio_priority_t p)
 		return (vdev_queue_max_async_writes(spa));
 	case ZIO_PRIORITY_SCRUB:
 		return (zfs_vdev_scrub_max_active);
+	case ZIO_PRIORITY_TRIM:
+		return (zfs_vdev_trim_max_active);
 	default:
 		panic("invalid priority %u", p);
 		return (0);
@@ -378,6 +393,9 @@ vdev_queue_init(vdev_t *vd)
 	avl_create(vdev_queue_type_tree(vq, ZIO_TYPE_WRITE),
 		vdev_queue_offset_compare, sizeof (zio_t),
 		offsetof(struct zio, io_offset_node));
+	avl_create(vdev_queue_type_tree(vq, ZIO_TYPE_TRIM),
+		vdev_queue_offset_compare, sizeof (zio_t),
+		offsetof(struct zio, io_offset_node));
 
 	for (p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++) {
 		int (*compfn) (const void *, const void *);
@@ -409,6 +427,7 @@ vdev_queue_fini(vdev_t *vd)
 	avl_destroy(&vq->vq_active_tree);
 	avl_destroy(vdev_queue_type_tree(vq, ZIO_TYPE_READ));
 	avl_destroy(vdev_queue_type_tree(vq, ZIO_TYPE_WRITE));
+	avl_destroy(vdev_queue_type_tree(vq, ZIO_TYPE_TRIM));
 
 	mutex_destroy(&vq->vq_lock);
 }
@@ -467,6 +486,7 @@ vdev_queue_pending_add(vdev_queue_t *vq, zio_t *zio)
 	ASSERT3U(zio->io_priority, <, ZIO_PRIORITY_NUM_QUEUEABLE);
 	vq->vq_class[zio->io_priority].vqc_active++;
 	avl_add(&vq->vq_active_tree, zio);
+	zio->io_issued_timestamp = gethrtime();
 
 #ifdef LINUX
 	if (ssh->kstat != NULL) {
@@ -520,7 +540,8 @@ vdev_queue_agg_io_done(zio_t *aio)
 		}
 	}
 
-	abd_free(aio->io_abd);
+	if (aio->io_abd != NULL)
+		abd_free(aio->io_abd);
 }
 
 /*
@@ -537,6 +558,7 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 {
 	zio_t *first, *last, *aio, *dio, *mandatory, *nio;
 	uint64_t maxgap = 0;
+	uint64_t limit;
 	uint64_t size;
 	boolean_t stretch = B_FALSE;
 	avl_tree_t *t = vdev_queue_type_tree(vq, zio->io_type);
@@ -551,6 +573,14 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 	 */
 	zfs_vdev_aggregation_limit =
 	    MIN(zfs_vdev_aggregation_limit, SPA_MAXBLOCKSIZE);
+	limit = zfs_vdev_aggregation_limit;
+
+	/*
+	 * TRIMs have no data, so only exactly adjacent ones are merged
+	 * and their size is bounded only by the largest discard extent.
+	 */
+	if (zio->io_type == ZIO_TYPE_TRIM)
+		limit = MAX(zfs_trim_extent_bytes_max, limit);
 
 	first = last = zio;
 
@@ -578,7 +608,7 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 	 */
 	while ((dio = AVL_PREV(t, first)) != NULL &&
 	    (dio->io_flags & ZIO_FLAG_AGG_INHERIT) == flags &&
-	    IO_SPAN(dio, last) <= zfs_vdev_aggregation_limit &&
+	    IO_SPAN(dio, last) <= limit &&
 	    IO_GAP(dio, first) <= maxgap) {
 		first = dio;
 		if (mandatory == NULL && !(first->io_flags & ZIO_FLAG_OPTIONAL))
@@ -602,7 +632,7 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 	 */
 	while ((dio = AVL_NEXT(t, last)) != NULL &&
 	    (dio->io_flags & ZIO_FLAG_AGG_INHERIT) == flags &&
-	    (IO_SPAN(first, dio) <= zfs_vdev_aggregation_limit ||
+	    (IO_SPAN(first, dio) <= limit ||
 	    (dio->io_flags & ZIO_FLAG_OPTIONAL)) &&
 	    IO_GAP(last, dio) <= maxgap) {
 		last = dio;
@@ -655,9 +685,10 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 		return (NULL);
 
 	size = IO_SPAN(first, last);
-	ASSERT3U(size, <=, SPA_MAXBLOCKSIZE);
+	IMPLY(zio->io_type != ZIO_TYPE_TRIM, size <= SPA_MAXBLOCKSIZE);
 
 	aio = zio_vdev_delegated_io(first->io_vd, first->io_offset,
+	    zio->io_type == ZIO_TYPE_TRIM ? NULL :
 	    abd_alloc_for_io(size, B_TRUE), size, first->io_type,
 	    zio->io_priority, flags | ZIO_FLAG_DONT_CACHE | ZIO_FLAG_DONT_QUEUE,
 	    vdev_queue_agg_io_done, NULL);
@@ -765,11 +796,13 @@ vdev_queue_io(zio_t *zio)
 		    zio->io_priority != ZIO_PRIORITY_ASYNC_READ &&
 		    zio->io_priority != ZIO_PRIORITY_SCRUB)
 			zio->io_priority = ZIO_PRIORITY_ASYNC_READ;
-	} else {
-		ASSERT(zio->io_type == ZIO_TYPE_WRITE);
+	} else if (zio->io_type == ZIO_TYPE_WRITE) {
 		if (zio->io_priority != ZIO_PRIORITY_SYNC_WRITE &&
 		    zio->io_priority != ZIO_PRIORITY_ASYNC_WRITE)
 			zio->io_priority = ZIO_PRIORITY_ASYNC_WRITE;
+	} else {
+		ASSERT(zio->io_type == ZIO_TYPE_TRIM);
+		zio->io_priority = ZIO_PRIORITY_TRIM;
 	}
 
 	zio->io_flags |= ZIO_FLAG_DONT_CACHE | ZIO_FLAG_DONT_QUEUE;
@@ -791,6 +824,32 @@ vdev_queue_io(zio_t *zio)
 	return (nio);
 }
 
+/*
+ * Track how long the device takes to service a read, from the time it is
+ * issued until it completes.  As with TCP round trip times, the average
+ * moves an eighth and the mean deviation a quarter of the way towards
+ * each new sample.
+ */
+static void
+vdev_queue_read_latency_update(vdev_queue_t *vq, zio_t *zio)
+{
+	hrtime_t lat = vq->vq_io_complete_ts - zio->io_issued_timestamp;
+	hrtime_t err;
+
+	ASSERT(MUTEX_HELD(&vq->vq_lock));
+
+	if (vq->vq_read_lat_samples == 0) {
+		vq->vq_read_lat = lat;
+		vq->vq_read_lat_dev = lat / 2;
+	} else {
+		err = lat - vq->vq_read_lat;
+		vq->vq_read_lat += err / 8;
+		vq->vq_read_lat_dev += (ABS(err) - vq->vq_read_lat_dev) / 4;
+	}
+	vq->vq_read_lat_ts = vq->vq_io_complete_ts;
+	vq->vq_read_lat_samples++;
+}
+
 void
 vdev_queue_io_done(zio_t *zio)
 {
@@ -804,6 +863,8 @@ vdev_queue_io_done(zio_t *zio)
 	zio->io_delta = gethrtime() - zio->io_timestamp;
 	vq->vq_io_complete_ts = gethrtime();
 	vq->vq_io_delta_ts = vq->vq_io_complete_ts - zio->io_timestamp;
+	if (zio->io_type == ZIO_TYPE_READ && zio->io_error == 0)
+		vdev_queue_read_latency_update(vq, zio);
 
 	while ((nio = vdev_queue_io_to_issue(vq)) != NULL) {
 		mutex_exit(&vq->vq_lock);
@@ -820,7 +881,7 @@ vdev_queue_io_done(zio_t *zio)
 }
 
 /*
- * As these three methods are only used for load calculations we're not
+ * As these methods are only used for load calculations we're not
  * concerned if we get an incorrect value on 32bit platforms due to lack of
  * vq_lock mutex use here, instead we prefer to keep it lock free for
  * performance.
@@ -842,3 +903,22 @@ vdev_queue_register_lastoffset(vdev_t *vd, zio_t *zio)
 {
 	vd->vdev_queue.vq_lastoffset = zio->io_offset + zio->io_size;
 }
+
+/*
+ * A high estimate of how long the device takes to service a read: the
+ * smoothed average plus twice the mean deviation, so that a device with
+ * latency spikes looks slower than one that is merely steady.  Returns 0
+ * if no read has completed within the last maxage nanoseconds, since an
+ * old estimate says little about the device now.
+ */
+hrtime_t
+vdev_queue_read_latency(vdev_t *vd, hrtime_t maxage)
+{
+	vdev_queue_t *vq = &vd->vdev_queue;
+
+	if (vq->vq_read_lat_samples == 0 ||
+	    gethrtime() - vq->vq_read_lat_ts > maxage)
+		return (0);
+
+	return (vq->vq_read_lat + 2 * vq->vq_read_lat_dev);
+}
@@ -34,6 +34,8 @@
 #include <sys/abd.h>
 #include <sys/fs/zfs.h>
 #include <sys/fm/fs/zfs.h>
+#include <sys/vdev_raidz.h>
+#include <sys/vdev_raidz_impl.h>
 
 /*
  * Virtual device vector for RAID-Z.
@@ -102,61 +104,6 @@
  * or in concert to recover missing data columns.
  */
 
-typedef struct raidz_col {
-	uint64_t rc_devidx;		/* child device index for I/O */
-	uint64_t rc_offset;		/* device offset */
-	uint64_t rc_size;		/* I/O size */
-	abd_t *rc_abd;			/* I/O data */
-	void *rc_gdata;			/* used to store the "good" version */
-	int rc_error;			/* I/O error for this device */
-	uint8_t rc_tried;		/* Did we attempt this I/O column? */
-	uint8_t rc_skipped;		/* Did we skip this I/O column? */
-} raidz_col_t;
-
-typedef struct raidz_map {
-	uint64_t rm_cols;		/* Regular column count */
-	uint64_t rm_scols;		/* Count including skipped columns */
-	uint64_t rm_bigcols;		/* Number of oversized columns */
-	uint64_t rm_asize;		/* Actual total I/O size */
-	uint64_t rm_missingdata;	/* Count of missing data devices */
-	uint64_t rm_missingparity;	/* Count of missing parity devices */
-	uint64_t rm_firstdatacol;	/* First data column/parity count */
-	uint64_t rm_nskip;		/* Skipped sectors for padding */
-	uint64_t rm_skipstart;		/* Column index of padding start */
-	abd_t *rm_abd_copy;		/* rm_asize-buffer of copied data */
-	uintptr_t rm_reports;		/* # of referencing checksum reports */
-	uint8_t	rm_freed;		/* map no longer has referencing ZIO */
-	uint8_t	rm_ecksuminjected;	/* checksum error was injected */
-	raidz_col_t rm_col[1];		/* Flexible array of I/O columns */
-} raidz_map_t;
-
-#define	VDEV_RAIDZ_P		0
-#define	VDEV_RAIDZ_Q		1
-#define	VDEV_RAIDZ_R		2
-
-#define	VDEV_RAIDZ_MUL_2(x)	(((x) << 1) ^ (((x) & 0x80) ? 0x1d : 0))
-#define	VDEV_RAIDZ_MUL_4(x)	(VDEV_RAIDZ_MUL_2(VDEV_RAIDZ_MUL_2(x)))
-
-/*
- * We provide a mechanism to perform the field multiplication operation on a
- * 64-bit value all at once rather than a byte at a time. This works by
- * creating a mask from the top bit in each byte and using that to
- * conditionally apply the XOR of 0x1d.
- */
-#define	VDEV_RAIDZ_64MUL_2(x, mask) \
-{ \
-	(mask) = (x) & 0x8080808080808080ULL; \
-	(mask) = ((mask) << 1) - ((mask) >> 7); \
-	(x) = (((x) << 1) & 0xfefefefefefefefeULL) ^ \
-	    ((mask) & 0x1d1d1d1d1d1d1d1dULL); \
-}
-
-#define	VDEV_RAIDZ_64MUL_4(x, mask) \
-{ \
-	VDEV_RAIDZ_64MUL_2((x), mask); \
-	VDEV_RAIDZ_64MUL_2((x), mask); \
-}
-
 #define VDEV_LABEL_OFFSET(x)    (x + VDEV_LABEL_START_SIZE)
 
 /*
@@ -165,7 +112,7 @@ typedef struct raidz_map {
 int vdev_raidz_default_to_general;
 
 /* Powers of 2 in the Galois field defined above. */
-static const uint8_t vdev_raidz_pow2[256] = {
+const uint8_t vdev_raidz_pow2[256] = {
 	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
 	0x1d, 0x3a, 0x74, 0xe8, 0xcd, 0x87, 0x13, 0x26,
 	0x4c, 0x98, 0x2d, 0x5a, 0xb4, 0x75, 0xea, 0xc9,
@@ -200,7 +147,7 @@ static const uint8_t vdev_raidz_pow2[256] = {
 	0x1b, 0x36, 0x6c, 0xd8, 0xad, 0x47, 0x8e, 0x01
 };
 /* Logs of 2 in the Galois field defined above. */
-static const uint8_t vdev_raidz_log2[256] = {
+const uint8_t vdev_raidz_log2[256] = {
 	0x00, 0x00, 0x01, 0x19, 0x02, 0x32, 0x1a, 0xc6,
 	0x03, 0xdf, 0x33, 0xee, 0x1b, 0x68, 0xc7, 0x4b,
 	0x04, 0x64, 0xe0, 0x0e, 0x34, 0x8d, 0xef, 0x81,
@@ -256,7 +203,7 @@ vdev_raidz_exp2(uint_t a, int exp)
 	return (vdev_raidz_pow2[exp]);
 }
 
-static void
+void
 vdev_raidz_map_free(raidz_map_t *rm)
 {
 	int c;
@@ -453,10 +400,11 @@ static const zio_vsd_ops_t vdev_raidz_vsd_ops = {
  * Divides the IO evenly across all child vdevs; usually, dcols is
  * the number of children in the target vdev.
  *
- * Avoid inlining the function to keep vdev_raidz_io_start(), which
- * is this functions only caller, as small as possible on the stack.
+ * The map is also allocated by the RAID-Z math benchmark, so the function
+ * is not static; this also keeps it from being inlined into
+ * vdev_raidz_io_start(), which must stay as small as possible on the stack.
  */
-static raidz_map_t *
+raidz_map_t *
 vdev_raidz_map_alloc(abd_t *abd, uint64_t size, uint64_t offset,
     uint64_t unit_shift, uint64_t dcols, uint64_t nparity)
 {
@@ -519,6 +467,7 @@ vdev_raidz_map_alloc(abd_t *abd, uint64_t size, uint64_t offset,
 	rm->rm_reports = 0;
 	rm->rm_freed = 0;
 	rm->rm_ecksuminjected = 0;
+	rm->rm_ops = vdev_raidz_math_get_ops();
 
 	asize = 0;
 
@@ -794,6 +743,10 @@ vdev_raidz_generate_parity_pqr(raidz_map_t *rm)
 static void
 vdev_raidz_generate_parity(raidz_map_t *rm)
 {
+	/* Generate using the new math implementation */
+	if (vdev_raidz_math_generate(rm) != RAIDZ_ORIGINAL_IMPL)
+		return;
+
 	switch (rm->rm_firstdatacol) {
 	case 1:
 		vdev_raidz_generate_parity_p(rm);
@@ -1613,6 +1566,9 @@ vdev_raidz_reconstruct(raidz_map_t *rm, int *t, int nt)
 		ASSERT(t[i] > t[i - 1]);
 	}
 
+	for (i = 0; i < VDEV_RAIDZ_MAXPARITY; i++)
+		parity_valid[i] = B_FALSE;
+
 	nbadparity = rm->rm_firstdatacol;
 	nbaddata = rm->rm_cols - nbadparity;
 	ntgts = 0;
@@ -1643,6 +1599,12 @@ vdev_raidz_reconstruct(raidz_map_t *rm, int *t, int nt)
 	 * See if we can use any of our optimized reconstruction routines.
 	 */
 	if (!vdev_raidz_default_to_general) {
+		/* Reconstruct using the new math implementation */
+		code = vdev_raidz_math_reconstruct(rm, parity_valid, dt,
+		    nbaddata);
+		if (code != RAIDZ_ORIGINAL_IMPL)
+			return (code);
+
 		switch (nbaddata) {
 		case 1:
 			if (parity_valid[VDEV_RAIDZ_P])
@@ -1903,6 +1865,43 @@ vdev_raidz_child_done(zio_t *zio)
 	rc->rc_skipped = 0;
 }
 
+/*
+ * Sectors of a RAID-Z vdev are laid out round-robin across its children,
+ * so the part of a free top-level range [start, end) that lands on child
+ * 'c' is a single contiguous range of that child's sectors.  Return the
+ * number of sectors below top-level sector 'b' that belong to child 'c'.
+ */
+static inline uint64_t
+vdev_raidz_child_sectors(uint64_t b, uint64_t c, uint64_t width)
+{
+	return (b > c ? ((b - c - 1) / width) + 1 : 0);
+}
+
+static void
+vdev_raidz_trim_start(zio_t *zio)
+{
+	vdev_t *vd = zio->io_vd;
+	uint64_t ashift = vd->vdev_top->vdev_ashift;
+	uint64_t width = vd->vdev_children;
+	uint64_t b_start = zio->io_offset >> ashift;
+	uint64_t b_end = (zio->io_offset + zio->io_size) >> ashift;
+	uint64_t c;
+
+	for (c = 0; c < width; c++) {
+		uint64_t start = vdev_raidz_child_sectors(b_start, c, width);
+		uint64_t end = vdev_raidz_child_sectors(b_end, c, width);
+
+		if (end == start)
+			continue;
+
+		zio_nowait(zio_vdev_child_io(zio, NULL, vd->vdev_child[c],
+		    start << ashift, NULL, (end - start) << ashift,
+		    ZIO_TYPE_TRIM, zio->io_priority, 0, NULL, NULL));
+	}
+
+	zio_execute(zio);
+}
+
 /*
  * Start an IO operation on a RAIDZ VDev
  *
@@ -1930,6 +1929,11 @@ vdev_raidz_io_start(zio_t *zio)
 	raidz_col_t *rc;
 	int c, i;
 
+	if (zio->io_type == ZIO_TYPE_TRIM) {
+		vdev_raidz_trim_start(zio);
+		return;
+	}
+
 	rm = vdev_raidz_map_alloc(zio->io_abd, zio->io_size, zio->io_offset,
 	    tvd->vdev_ashift, vd->vdev_children,
 	    vd->vdev_nparity);
@@ -2316,6 +2320,13 @@ vdev_raidz_io_done(zio_t *zio)
 	int tgts[VDEV_RAIDZ_MAXPARITY];
 	int code;
 
+	/*
+	 * TRIM children are issued without a map and their errors are
+	 * never propagated; there is nothing to reconstruct.
+	 */
+	if (zio->io_type == ZIO_TYPE_TRIM)
+		return;
+
 	ASSERT(zio->io_bp != NULL);  /* XXX need to add code to enforce this */
 
 	ASSERT(rm->rm_missingparity <= rm->rm_firstdatacol);
@@ -0,0 +1,1031 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/types.h>
+#include <sys/zio.h>
+#include <sys/debug.h>
+#include <sys/zfs_debug.h>
+#include <sys/vdev_impl.h>
+#include <sys/vdev_raidz.h>
+#include <sys/vdev_raidz_impl.h>
+
+/*
+ * RAID-Z math layer.
+ *
+ * Parity generation and data reconstruction are expressed in terms of a
+ * handful of GF(2^8) buffer kernels (see raidz_impl_ops_t), so that every
+ * method, including all seven reconstruction cases, can run on any of the
+ * vectorized implementations. This file holds the generic drivers which
+ * walk the columns of a raidz_map_t, the implementation registry, and the
+ * benchmark which picks the fastest implementation for each method when
+ * the module is loaded.
+ *
+ * The original code in vdev_raidz.c is kept as is and is used whenever a
+ * map has no math operations attached, which is the case before this
+ * layer is initialized or when the "original" implementation is selected.
+ */
+
+/* All compiled in implementations */
+static const raidz_impl_ops_t *const raidz_all_maths[] = {
+	&vdev_raidz_scalar_impl,
+#if defined(__x86_64) && defined(HAVE_SSE2)
+	&vdev_raidz_sse2_impl,
+#endif
+#if defined(__x86_64) && defined(HAVE_SSE2) && defined(HAVE_SSSE3)
+	&vdev_raidz_ssse3_impl,
+#endif
+#if defined(__x86_64) && defined(HAVE_AVX2)
+	&vdev_raidz_avx2_impl,
+#endif
+#if defined(__x86_64) && defined(HAVE_AVX512BW)
+	&vdev_raidz_avx512bw_impl,
+#endif
+};
+
+#define	RAIDZ_IMPL_MAX	ARRAY_SIZE(raidz_all_maths)
+
+/* Implementations which are supported by the running CPU */
+static raidz_math_ops_t raidz_supp_ops[RAIDZ_IMPL_MAX];
+static uint32_t raidz_supp_impl_cnt = 0;
+
+/* Per method fastest implementation, assembled by the benchmark */
+static raidz_math_ops_t raidz_fastest_ops = { .rmo_name = "fastest" };
+
+/* Indicate that the implementations have been probed */
+static boolean_t raidz_math_initialized = B_FALSE;
+
+#define	IMPL_FASTEST	(UINT32_MAX)
+#define	IMPL_CYCLE	(UINT32_MAX - 1)
+#define	IMPL_ORIGINAL	(UINT32_MAX - 2)
+
+static uint32_t zfs_vdev_raidz_impl = IMPL_FASTEST;
+static uint32_t user_sel_impl = IMPL_FASTEST;
+
+const char *raidz_gen_name[RAIDZ_GEN_NUM] = {
+	"gen_p", "gen_pq", "gen_pqr"
+};
+
+const char *raidz_rec_name[RAIDZ_REC_NUM] = {
+	"rec_p", "rec_q", "rec_r",
+	"rec_pq", "rec_pr", "rec_qr", "rec_pqr"
+};
+
+/* Parity columns used by each reconstruction method */
+static const uint8_t raidz_rec_mask[RAIDZ_REC_NUM] = {
+	[RAIDZ_REC_P] = (1 << VDEV_RAIDZ_P),
+	[RAIDZ_REC_Q] = (1 << VDEV_RAIDZ_Q),
+	[RAIDZ_REC_R] = (1 << VDEV_RAIDZ_R),
+	[RAIDZ_REC_PQ] = (1 << VDEV_RAIDZ_P) | (1 << VDEV_RAIDZ_Q),
+	[RAIDZ_REC_PR] = (1 << VDEV_RAIDZ_P) | (1 << VDEV_RAIDZ_R),
+	[RAIDZ_REC_QR] = (1 << VDEV_RAIDZ_Q) | (1 << VDEV_RAIDZ_R),
+	[RAIDZ_REC_PQR] = (1 << VDEV_RAIDZ_P) | (1 << VDEV_RAIDZ_Q) |
+	    (1 << VDEV_RAIDZ_R),
+};
+
+uint8_t vdev_raidz_mul_lt[256][32];
+
+/*
+ * Returns the math operations to be used for a newly allocated map, or
+ * NULL if the original implementation should be used.
+ */
+const raidz_math_ops_t *
+vdev_raidz_math_get_ops(void)
+{
+	static volatile uint32_t cycle_impl_idx = 0;
+	const raidz_math_ops_t *ops = NULL;
+	uint32_t impl;
+
+	if (!raidz_math_initialized)
+		return (NULL);
+
+	impl = zfs_vdev_raidz_impl;
+
+	switch (impl) {
+	case IMPL_ORIGINAL:
+		break;
+	case IMPL_FASTEST:
+		ops = &raidz_fastest_ops;
+		break;
+	case IMPL_CYCLE:
+		/* Cycle through all supported implementations */
+		impl = atomic_inc_32_nv(&cycle_impl_idx);
+		ops = &raidz_supp_ops[impl % raidz_supp_impl_cnt];
+		break;
+	default:
+		ASSERT3U(impl, <, raidz_supp_impl_cnt);
+		ops = &raidz_supp_ops[impl];
+		break;
+	}
+
+	return (ops);
+}
+
+/*
+ * GF(2^8) arithmetic on single elements, used to set up the
+ * reconstruction matrices and the multiplication tables.
+ */
+static inline uint8_t
+raidz_gf_mul(uint8_t a, uint8_t b)
+{
+	if (a == 0 || b == 0)
+		return (0);
+
+	return (vdev_raidz_pow2[(vdev_raidz_log2[a] + vdev_raidz_log2[b]) %
+	    255]);
+}
+
+static inline uint8_t
+raidz_gf_inv(uint8_t a)
+{
+	ASSERT3U(a, !=, 0);
+
+	return (vdev_raidz_pow2[(255 - vdev_raidz_log2[a]) % 255]);
+}
+
+/* 2^exp in GF(2^8) */
+static inline uint8_t
+raidz_gf_exp2(uint64_t exp)
+{
+	return (vdev_raidz_pow2[exp % 255]);
+}
+
+/*
+ * Parity generation
+ */
+struct raidz_gen_arg {
+	const raidz_impl_ops_t *impl;
+	int nparity;
+	uint8_t *p;
+	uint8_t *q;
+	uint8_t *r;
+};
+
+static int
+raidz_gen_func(void *buf, size_t size, void *private)
+{
+	struct raidz_gen_arg *ga = private;
+	const uint8_t *src = buf;
+
+	switch (ga->nparity) {
+	case 1:
+		ga->impl->rio_xor(ga->p, src, size);
+		break;
+	case 2:
+		ga->impl->rio_gen_pq(ga->p, ga->q, src, size);
+		ga->q += size;
+		break;
+	case 3:
+		ga->impl->rio_gen_pqr(ga->p, ga->q, ga->r, src, size);
+		ga->q += size;
+		ga->r += size;
+		break;
+	}
+	ga->p += size;
+
+	return (0);
+}
+
+static void
+raidz_generate(raidz_map_t *rm, const raidz_impl_ops_t *impl)
+{
+	const int nparity = rm->rm_firstdatacol;
+	const size_t psize = rm->rm_col[VDEV_RAIDZ_P].rc_size;
+	uint8_t *pbuf[VDEV_RAIDZ_MAXPARITY];
+	size_t csize;
+	int c, i;
+
+	for (i = 0; i < nparity; i++) {
+		ASSERT3U(rm->rm_col[i].rc_size, ==, psize);
+		pbuf[i] = abd_to_buf(rm->rm_col[i].rc_abd);
+	}
+
+	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
+		abd_t *src = rm->rm_col[c].rc_abd;
+
+		csize = rm->rm_col[c].rc_size;
+		ASSERT3U(csize, <=, psize);
+
+		if (c == rm->rm_firstdatacol) {
+			abd_copy_to_buf_off(pbuf[0], src, 0, csize);
+			bzero(pbuf[0] + csize, psize - csize);
+			for (i = 1; i < nparity; i++)
+				bcopy(pbuf[0], pbuf[i], psize);
+		} else {
+			struct raidz_gen_arg ga = {
+				.impl = impl,
+				.nparity = nparity,
+				.p = pbuf[VDEV_RAIDZ_P],
+				.q = nparity > 1 ? pbuf[VDEV_RAIDZ_Q] : NULL,
+				.r = nparity > 2 ? pbuf[VDEV_RAIDZ_R] : NULL,
+			};
+
+			if (csize > 0) {
+				(void) abd_iterate_func(src, 0, csize,
+				    raidz_gen_func, &ga);
+			}
+
+			/*
+			 * Treat short columns as though they are full of 0s.
+			 * Note that there's therefore nothing needed for P.
+			 */
+			if (csize < psize && nparity > 1) {
+				impl->rio_mul2(pbuf[VDEV_RAIDZ_Q] + csize,
+				    psize - csize);
+			}
+			if (csize < psize && nparity > 2) {
+				impl->rio_mul4(pbuf[VDEV_RAIDZ_R] + csize,
+				    psize - csize);
+			}
+		}
+	}
+}
+
+/*
+ * Generate parity for the map using its math operations. Returns
+ * RAIDZ_ORIGINAL_IMPL if the map is to be handled by the original code.
+ */
+int
+vdev_raidz_math_generate(raidz_map_t *rm)
+{
+	const raidz_math_ops_t *ops = rm->rm_ops;
+	const raidz_impl_ops_t *impl;
+
+	if (ops == NULL)
+		return (RAIDZ_ORIGINAL_IMPL);
+
+	switch (rm->rm_firstdatacol) {
+	case 1:
+		impl = ops->rmo_gen[RAIDZ_GEN_P];
+		break;
+	case 2:
+		impl = ops->rmo_gen[RAIDZ_GEN_PQ];
+		break;
+	case 3:
+		impl = ops->rmo_gen[RAIDZ_GEN_PQR];
+		break;
+	default:
+		impl = NULL;
+		cmn_err(CE_PANIC, "invalid RAID-Z configuration");
+		return (RAIDZ_ORIGINAL_IMPL);
+	}
+
+	raidz_generate(rm, impl);
+
+	return (0);
+}
+
+/*
+ * Data reconstruction
+ *
+ * Let x_0 .. x_k-1 be the missing data columns and j_0 .. j_k-1 the parity
+ * columns used to recover them, with generators g = 2^j (1, 2 or 4). The
+ * syndrome of parity j is computed by regenerating the parity with the
+ * missing columns taken as zeros and adding the stored parity to it:
+ *
+ *	S_j = Parity_j + Regenerated_j
+ *	    = g_j^(n-1-x_0) * D_x_0 + ... + g_j^(n-1-x_k-1) * D_x_k-1
+ *
+ * The k x k coefficient matrix of this system is inverted in GF(2^8) and
+ * each missing column is then a linear combination of the syndromes. For
+ * a single column recovered from P this degenerates into a plain copy.
+ */
+struct raidz_syn_arg {
+	const raidz_impl_ops_t *impl;
+	uint8_t mask;
+	uint8_t *s[VDEV_RAIDZ_MAXPARITY];
+};
+
+static void
+raidz_syn_advance(struct raidz_syn_arg *sa, size_t size)
+{
+	int j;
+
+	for (j = 0; j < VDEV_RAIDZ_MAXPARITY; j++) {
+		if (sa->s[j] != NULL)
+			sa->s[j] += size;
+	}
+}
+
+static int
+raidz_syn_func(void *buf, size_t size, void *private)
+{
+	struct raidz_syn_arg *sa = private;
+	const raidz_impl_ops_t *impl = sa->impl;
+	const uint8_t *src = buf;
+
+	if (sa->mask == raidz_rec_mask[RAIDZ_REC_PQ]) {
+		impl->rio_gen_pq(sa->s[VDEV_RAIDZ_P], sa->s[VDEV_RAIDZ_Q],
+		    src, size);
+	} else if (sa->mask == raidz_rec_mask[RAIDZ_REC_PQR]) {
+		impl->rio_gen_pqr(sa->s[VDEV_RAIDZ_P], sa->s[VDEV_RAIDZ_Q],
+		    sa->s[VDEV_RAIDZ_R], src, size);
+	} else {
+		if (sa->s[VDEV_RAIDZ_P] != NULL)
+			impl->rio_xor(sa->s[VDEV_RAIDZ_P], src, size);
+		if (sa->s[VDEV_RAIDZ_Q] != NULL)
+			impl->rio_q_step(sa->s[VDEV_RAIDZ_Q], src, size);
+		if (sa->s[VDEV_RAIDZ_R] != NULL)
+			impl->rio_r_step(sa->s[VDEV_RAIDZ_R], src, size);
+	}
+
+	raidz_syn_advance(sa, size);
+
+	return (0);
+}
+
+/*
+ * Advance the syndromes over a range of a column which contributes only
+ * zeros, either because it is missing or because it is a short column.
+ */
+static void
+raidz_syn_zero(struct raidz_syn_arg *sa, size_t size)
+{
+	if (sa->s[VDEV_RAIDZ_Q] != NULL)
+		sa->impl->rio_mul2(sa->s[VDEV_RAIDZ_Q], size);
+	if (sa->s[VDEV_RAIDZ_R] != NULL)
+		sa->impl->rio_mul4(sa->s[VDEV_RAIDZ_R], size);
+
+	raidz_syn_advance(sa, size);
+}
+
+struct raidz_rec_arg {
+	const raidz_impl_ops_t *impl;
+	int nsyn;
+	uint8_t coeff[VDEV_RAIDZ_MAXPARITY];
+	uint8_t *s[VDEV_RAIDZ_MAXPARITY];
+};
+
+static int
+raidz_rec_func(void *buf, size_t size, void *private)
+{
+	struct raidz_rec_arg *ra = private;
+	const raidz_impl_ops_t *impl = ra->impl;
+	uint8_t *dst = buf;
+	int i;
+
+	for (i = 0; i < ra->nsyn; i++) {
+		uint8_t c = ra->coeff[i];
+
+		if (i == 0) {
+			if (c == 1)
+				bcopy(ra->s[i], dst, size);
+			else
+				impl->rio_mul_copy(dst, ra->s[i], c, size);
+		} else if (c == 1) {
+			impl->rio_xor(dst, ra->s[i], size);
+		} else if (c != 0) {
+			impl->rio_mul_add(dst, ra->s[i], c, size);
+		}
+		ra->s[i] += size;
+	}
+
+	return (0);
+}
+
+/*
+ * Invert the n x n matrix in place with Gauss-Jordan elimination. The
+ * matrices built for RAID-Z are always invertible.
+ */
+static void
+raidz_gf_matrix_invert(uint8_t m[][VDEV_RAIDZ_MAXPARITY],
+    uint8_t inv[][VDEV_RAIDZ_MAXPARITY], int n)
+{
+	uint8_t tmp, f;
+	int i, j, k;
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < n; j++)
+			inv[i][j] = (i == j) ? 1 : 0;
+	}
+
+	for (i = 0; i < n; i++) {
+		/* Find a pivot and move it onto the diagonal */
+		for (k = i; k < n && m[k][i] == 0; k++)
+			;
+		VERIFY3S(k, <, n);
+		if (k != i) {
+			for (j = 0; j < n; j++) {
+				tmp = m[i][j]; m[i][j] = m[k][j]; m[k][j] = tmp;
+				tmp = inv[i][j];
+				inv[i][j] = inv[k][j];
+				inv[k][j] = tmp;
+			}
+		}
+
+		/* Scale the pivot row to get a 1 on the diagonal */
+		f = raidz_gf_inv(m[i][i]);
+		for (j = 0; j < n; j++) {
+			m[i][j] = raidz_gf_mul(m[i][j], f);
+			inv[i][j] = raidz_gf_mul(inv[i][j], f);
+		}
+
+		/* Eliminate the column from all other rows */
+		for (k = 0; k < n; k++) {
+			if (k == i || m[k][i] == 0)
+				continue;
+			f = m[k][i];
+			for (j = 0; j < n; j++) {
+				m[k][j] ^= raidz_gf_mul(m[i][j], f);
+				inv[k][j] ^= raidz_gf_mul(inv[i][j], f);
+			}
+		}
+	}
+}
+
+static int
+raidz_reconstruct(raidz_map_t *rm, const raidz_impl_ops_t *impl,
+    uint8_t mask, const int *tgts, int ntgts)
+{
+	const uint64_t ndata = rm->rm_cols - rm->rm_firstdatacol;
+	const size_t psize = rm->rm_col[VDEV_RAIDZ_P].rc_size;
+	uint8_t m[VDEV_RAIDZ_MAXPARITY][VDEV_RAIDZ_MAXPARITY];
+	uint8_t inv[VDEV_RAIDZ_MAXPARITY][VDEV_RAIDZ_MAXPARITY];
+	abd_t *syn_abd[VDEV_RAIDZ_MAXPARITY] = { NULL };
+	uint8_t *syn[VDEV_RAIDZ_MAXPARITY] = { NULL };
+	int parity[VDEV_RAIDZ_MAXPARITY];
+	struct raidz_syn_arg sa;
+	size_t csize;
+	int c, i, j, t, nsyn;
+
+	/* The parity columns in use, in order */
+	for (j = 0, nsyn = 0; j < rm->rm_firstdatacol; j++) {
+		if (mask & (1 << j))
+			parity[nsyn++] = j;
+	}
+	ASSERT3S(nsyn, ==, ntgts);
+
+	for (i = 0; i < nsyn; i++) {
+		j = parity[i];
+		syn_abd[j] = abd_alloc_linear(psize, B_FALSE);
+		syn[j] = abd_to_buf(syn_abd[j]);
+	}
+
+	/*
+	 * Regenerate the used parities with the missing columns zeroed.
+	 */
+	for (c = rm->rm_firstdatacol, t = 0; c < rm->rm_cols; c++) {
+		abd_t *src = rm->rm_col[c].rc_abd;
+		boolean_t missing = (t < ntgts && tgts[t] == c);
+
+		csize = rm->rm_col[c].rc_size;
+		ASSERT3U(csize, <=, psize);
+
+		if (missing)
+			t++;
+
+		if (c == rm->rm_firstdatacol) {
+			for (i = 0; i < nsyn; i++) {
+				j = parity[i];
+				if (missing) {
+					bzero(syn[j], psize);
+				} else {
+					abd_copy_to_buf_off(syn[j], src, 0,
+					    csize);
+					bzero(syn[j] + csize, psize - csize);
+				}
+			}
+			continue;
+		}
+
+		sa.impl = impl;
+		sa.mask = mask;
+		for (j = 0; j < VDEV_RAIDZ_MAXPARITY; j++)
+			sa.s[j] = syn[j];
+
+		if (missing) {
+			raidz_syn_zero(&sa, psize);
+		} else {
+			if (csize > 0) {
+				(void) abd_iterate_func(src, 0, csize,
+				    raidz_syn_func, &sa);
+			}
+			if (csize < psize)
+				raidz_syn_zero(&sa, psize - csize);
+		}
+	}
+	ASSERT3S(t, ==, ntgts);
+
+	/* Add in the stored parity to get the syndromes */
+	for (i = 0; i < nsyn; i++) {
+		j = parity[i];
+		impl->rio_xor(syn[j], abd_to_buf(rm->rm_col[j].rc_abd), psize);
+	}
+
+	/*
+	 * Build and invert the coefficient matrix. Row i corresponds to the
+	 * i-th parity in use, column t to the t-th missing data column.
+	 */
+	for (i = 0; i < nsyn; i++) {
+		for (t = 0; t < ntgts; t++) {
+			uint64_t x = tgts[t] - rm->rm_firstdatacol;
+
+			ASSERT3U(x, <, ndata);
+			m[i][t] = raidz_gf_exp2(parity[i] * (ndata - 1 - x));
+		}
+	}
+	raidz_gf_matrix_invert(m, inv, nsyn);
+
+	/* Recover each missing column from the syndromes */
+	for (t = 0; t < ntgts; t++) {
+		raidz_col_t *rc = &rm->rm_col[tgts[t]];
+		struct raidz_rec_arg ra;
+
+		ra.impl = impl;
+		ra.nsyn = nsyn;
+		for (i = 0; i < nsyn; i++) {
+			ra.coeff[i] = inv[t][i];
+			ra.s[i] = syn[parity[i]];
+		}
+
+		if (rc->rc_size > 0) {
+			(void) abd_iterate_func(rc->rc_abd, 0, rc->rc_size,
+			    raidz_rec_func, &ra);
+		}
+	}
+
+	for (i = 0; i < nsyn; i++)
+		abd_free(syn_abd[parity[i]]);
+
+	return (mask);
+}
+
+/*
+ * Reconstruct the missing data columns dt[0 .. nbaddata-1] using the valid
+ * parity columns. Returns the bitmask of the parity columns used, or
+ * RAIDZ_ORIGINAL_IMPL if the map is to be handled by the original code.
+ */
+int
+vdev_raidz_math_reconstruct(raidz_map_t *rm, const int *parity_valid,
+    const int *dt, const int nbaddata)
+{
+	const raidz_math_ops_t *ops = rm->rm_ops;
+	const int nparity = rm->rm_firstdatacol;
+	int rec_op = RAIDZ_REC_NUM;
+	boolean_t p, q, r;
+
+	if (ops == NULL)
+		return (RAIDZ_ORIGINAL_IMPL);
+
+	p = parity_valid[VDEV_RAIDZ_P];
+	q = nparity > 1 && parity_valid[VDEV_RAIDZ_Q];
+	r = nparity > 2 && parity_valid[VDEV_RAIDZ_R];
+
+	switch (nbaddata) {
+	case 1:
+		if (p)
+			rec_op = RAIDZ_REC_P;
+		else if (q)
+			rec_op = RAIDZ_REC_Q;
+		else if (r)
+			rec_op = RAIDZ_REC_R;
+		break;
+	case 2:
+		if (p && q)
+			rec_op = RAIDZ_REC_PQ;
+		else if (p && r)
+			rec_op = RAIDZ_REC_PR;
+		else if (q && r)
+			rec_op = RAIDZ_REC_QR;
+		break;
+	case 3:
+		if (p && q && r)
+			rec_op = RAIDZ_REC_PQR;
+		break;
+	}
+
+	if (rec_op == RAIDZ_REC_NUM)
+		return (RAIDZ_ORIGINAL_IMPL);
+
+	return (raidz_reconstruct(rm, ops->rmo_rec[rec_op],
+	    raidz_rec_mask[rec_op], dt, nbaddata));
+}
+
+/*
+ * Benchmark and statistics
+ */
+typedef struct raidz_impl_kstat {
+	uint64_t gen[RAIDZ_GEN_NUM];	/* gen method speed B/s */
+	uint64_t rec[RAIDZ_REC_NUM];	/* rec method speed B/s */
+} raidz_impl_kstat_t;
+
+/* One entry per supported implementation, plus one for "fastest" */
+static raidz_impl_kstat_t raidz_impl_kstats[RAIDZ_IMPL_MAX + 1];
+
+static kstat_t *raidz_math_kstat = NULL;
+static kmutex_t raidz_math_kstat_lock;
+
+static int
+raidz_math_kstat_headers(char *buf, size_t size)
+{
+	ssize_t off;
+	int i;
+
+	ASSERT3U(size, >=, 256);
+
+	off = snprintf(buf, size, "%-17s", "implementation");
+
+	for (i = 0; i < RAIDZ_GEN_NUM; i++)
+		off += snprintf(buf + off, size - off, "%-12s",
+		    raidz_gen_name[i]);
+
+	for (i = 0; i < RAIDZ_REC_NUM; i++)
+		off += snprintf(buf + off, size - off, "%-12s",
+		    raidz_rec_name[i]);
+
+	(void) snprintf(buf + off, size - off, "\n");
+
+	return (0);
+}
+
+/* Speeds are reported in GB/s with two decimals */
+#define	RAIDZ_KSTAT_GB(bps)	((bps) / 1000000000ULL)
+#define	RAIDZ_KSTAT_CGB(bps)	(((bps) / 10000000ULL) % 100)
+
+static int
+raidz_math_kstat_data(char *buf, size_t size, void *data)
+{
+	raidz_impl_kstat_t *fstat = &raidz_impl_kstats[raidz_supp_impl_cnt];
+	raidz_impl_kstat_t *cstat = (raidz_impl_kstat_t *)data;
+	ssize_t off = 0;
+	int i;
+
+	ASSERT3U(size, >=, 256);
+
+	if (cstat == fstat) {
+		off += snprintf(buf + off, size - off, "%-17s", "fastest");
+
+		for (i = 0; i < RAIDZ_GEN_NUM; i++) {
+			off += snprintf(buf + off, size - off, "%-12s",
+			    raidz_fastest_ops.rmo_gen[i]->rio_name);
+		}
+		for (i = 0; i < RAIDZ_REC_NUM; i++) {
+			off += snprintf(buf + off, size - off, "%-12s",
+			    raidz_fastest_ops.rmo_rec[i]->rio_name);
+		}
+	} else {
+		ptrdiff_t id = cstat - raidz_impl_kstats;
+
+		off += snprintf(buf + off, size - off, "%-17s",
+		    raidz_supp_ops[id].rmo_name);
+
+		for (i = 0; i < RAIDZ_GEN_NUM; i++) {
+			off += snprintf(buf + off, size - off, "%llu.%02llu%6s",
+			    (u_longlong_t)RAIDZ_KSTAT_GB(cstat->gen[i]),
+			    (u_longlong_t)RAIDZ_KSTAT_CGB(cstat->gen[i]), "");
+		}
+		for (i = 0; i < RAIDZ_REC_NUM; i++) {
+			off += snprintf(buf + off, size - off, "%llu.%02llu%6s",
+			    (u_longlong_t)RAIDZ_KSTAT_GB(cstat->rec[i]),
+			    (u_longlong_t)RAIDZ_KSTAT_CGB(cstat->rec[i]), "");
+		}
+	}
+
+	(void) snprintf(buf + off, size - off, "\n");
+
+	return (0);
+}
+
+static void *
+raidz_math_kstat_addr(kstat_t *ksp, off_t n)
+{
+	if (n <= raidz_supp_impl_cnt)
+		ksp->ks_private = (void *) (raidz_impl_kstats + n);
+	else
+		ksp->ks_private = NULL;
+
+	return (ksp->ks_private);
+}
+
+#if defined(_KERNEL)
+
+#define	BENCH_D_COLS	(8ULL)
+#define	BENCH_COLS	(BENCH_D_COLS + VDEV_RAIDZ_MAXPARITY)
+#define	BENCH_ZIO_SIZE	(1ULL << SPA_OLD_MAXBLOCKSHIFT)	/* 128 kiB */
+#define	BENCH_NS	MSEC2NSEC(2)			/* 2ms */
+
+typedef void (*benchmark_fn)(raidz_map_t *rm, const int fn);
+
+static void
+benchmark_gen_impl(raidz_map_t *rm, const int fn)
+{
+	(void) fn;
+	VERIFY0(vdev_raidz_math_generate(rm));
+}
+
+static void
+benchmark_rec_impl(raidz_map_t *rm, const int fn)
+{
+	static const int rec_tgt[RAIDZ_REC_NUM][VDEV_RAIDZ_MAXPARITY] = {
+		{1, 2, 3},	/* rec_p:   bad QR & D[0]	*/
+		{0, 2, 3},	/* rec_q:   bad PR & D[0]	*/
+		{0, 1, 3},	/* rec_r:   bad PQ & D[0]	*/
+		{2, 3, 4},	/* rec_pq:  bad R  & D[0],D[1]	*/
+		{1, 3, 4},	/* rec_pr:  bad Q  & D[0],D[1]	*/
+		{0, 3, 4},	/* rec_qr:  bad P  & D[0],D[1]	*/
+		{3, 4, 5}	/* rec_pqr: bad    & D[0],D[1],D[2] */
+	};
+	int parity_valid[VDEV_RAIDZ_MAXPARITY];
+	const uint8_t mask = raidz_rec_mask[fn];
+	int i, ndt = 0;
+
+	for (i = 0; i < VDEV_RAIDZ_MAXPARITY; i++)
+		parity_valid[i] = (mask & (1 << i)) != 0;
+
+	for (i = 0; i < VDEV_RAIDZ_MAXPARITY; i++) {
+		if (rec_tgt[fn][i] >= rm->rm_firstdatacol)
+			ndt++;
+	}
+
+	VERIFY3S(vdev_raidz_math_reconstruct(rm, parity_valid,
+	    &rec_tgt[fn][VDEV_RAIDZ_MAXPARITY - ndt], ndt), ==, mask);
+}
+
+/*
+ * Benchmarking of all supported implementations (raidz_supp_impl_cnt)
+ * is performed by setting the rm_ops pointer and calling the top level
+ * generate/reconstruct methods of bench_rm.
+ */
+static void
+benchmark_raidz_impl(raidz_map_t *bench_rm, const int fn, benchmark_fn bench_fn)
+{
+	raidz_math_ops_t bench_ops;
+	uint64_t run_cnt, speed, best_speed = 0;
+	hrtime_t t_start, t_diff;
+	const raidz_impl_ops_t *curr_impl;
+	const raidz_math_ops_t *saved_ops = bench_rm->rm_ops;
+	int impl, i;
+
+	for (impl = 0; impl < raidz_supp_impl_cnt; impl++) {
+		/* set an implementation to benchmark */
+		curr_impl = raidz_supp_ops[impl].rmo_gen[0];
+		for (i = 0; i < RAIDZ_GEN_NUM; i++)
+			bench_ops.rmo_gen[i] = curr_impl;
+		for (i = 0; i < RAIDZ_REC_NUM; i++)
+			bench_ops.rmo_rec[i] = curr_impl;
+		bench_ops.rmo_name = curr_impl->rio_name;
+		bench_rm->rm_ops = &bench_ops;
+
+		kpreempt_disable();
+
+		run_cnt = 0;
+		t_start = gethrtime();
+
+		do {
+			for (i = 0; i < 25; i++, run_cnt++)
+				bench_fn(bench_rm, fn);
+
+			t_diff = gethrtime() - t_start;
+		} while (t_diff < BENCH_NS);
+
+		kpreempt_enable();
+
+		speed = run_cnt * BENCH_ZIO_SIZE * NANOSEC;
+		speed /= t_diff;
+
+		if (bench_fn == benchmark_gen_impl)
+			raidz_impl_kstats[impl].gen[fn] = speed;
+		else
+			raidz_impl_kstats[impl].rec[fn] = speed;
+
+		/* Update fastest implementation method */
+		if (speed > best_speed) {
+			best_speed = speed;
+
+			if (bench_fn == benchmark_gen_impl)
+				raidz_fastest_ops.rmo_gen[fn] = curr_impl;
+			else
+				raidz_fastest_ops.rmo_rec[fn] = curr_impl;
+		}
+	}
+
+	bench_rm->rm_ops = saved_ops;
+}
+
+static void
+benchmark_raidz(void)
+{
+	raidz_map_t *bench_rm;
+	abd_t *bench_abd;
+	int fn, nparity;
+
+	bench_abd = abd_alloc_linear(BENCH_ZIO_SIZE, B_FALSE);
+	(void) memset(abd_to_buf(bench_abd), 0xAA, BENCH_ZIO_SIZE);
+
+	/* Benchmark parity generation methods */
+	for (fn = 0; fn < RAIDZ_GEN_NUM; fn++) {
+		nparity = fn + 1;
+		bench_rm = vdev_raidz_map_alloc(bench_abd, BENCH_ZIO_SIZE, 0,
+		    SPA_MINBLOCKSHIFT, BENCH_D_COLS + nparity, nparity);
+
+		benchmark_raidz_impl(bench_rm, fn, benchmark_gen_impl);
+
+		vdev_raidz_map_free(bench_rm);
+	}
+
+	/* Benchmark data reconstruction methods */
+	bench_rm = vdev_raidz_map_alloc(bench_abd, BENCH_ZIO_SIZE, 0,
+	    SPA_MINBLOCKSHIFT, BENCH_COLS, VDEV_RAIDZ_MAXPARITY);
+
+	for (fn = 0; fn < RAIDZ_REC_NUM; fn++)
+		benchmark_raidz_impl(bench_rm, fn, benchmark_rec_impl);
+
+	vdev_raidz_map_free(bench_rm);
+
+	abd_free(bench_abd);
+}
+#endif /* _KERNEL */
+
+void
+vdev_raidz_math_init(void)
+{
+	const raidz_impl_ops_t *curr_impl;
+	raidz_math_ops_t *ops;
+	int i, fn, c, n;
+
+	/* Nibble multiplication tables */
+	for (c = 0; c < 256; c++) {
+		for (n = 0; n < 16; n++) {
+			vdev_raidz_mul_lt[c][n] = raidz_gf_mul(c, n);
+			vdev_raidz_mul_lt[c][16 + n] = raidz_gf_mul(c, n << 4);
+		}
+	}
+
+	/* Move supported implementations into raidz_supp_ops */
+	for (i = 0, c = 0; i < RAIDZ_IMPL_MAX; i++) {
+		curr_impl = raidz_all_maths[i];
+
+		if (!curr_impl->rio_is_supported())
+			continue;
+
+		ops = &raidz_supp_ops[c++];
+		for (fn = 0; fn < RAIDZ_GEN_NUM; fn++)
+			ops->rmo_gen[fn] = curr_impl;
+		for (fn = 0; fn < RAIDZ_REC_NUM; fn++)
+			ops->rmo_rec[fn] = curr_impl;
+		ops->rmo_name = curr_impl->rio_name;
+	}
+	raidz_supp_impl_cnt = c;	/* number of supported impl */
+
+	/* Until benchmarked, the fastest is the last supported one */
+	ops = &raidz_supp_ops[raidz_supp_impl_cnt - 1];
+	for (fn = 0; fn < RAIDZ_GEN_NUM; fn++)
+		raidz_fastest_ops.rmo_gen[fn] = ops->rmo_gen[fn];
+	for (fn = 0; fn < RAIDZ_REC_NUM; fn++)
+		raidz_fastest_ops.rmo_rec[fn] = ops->rmo_rec[fn];
+
+#if defined(_KERNEL)
+	/* Fake a zio and run the benchmark on every supported implementation */
+	benchmark_raidz();
+#endif
+
+	/* Install kstats for all implementations */
+	mutex_init(&raidz_math_kstat_lock, NULL, MUTEX_DEFAULT, NULL);
+	raidz_math_kstat = kstat_create("zfs", 0, "vdev_raidz_bench", "misc",
+	    KSTAT_TYPE_RAW, 0, KSTAT_FLAG_VIRTUAL);
+	if (raidz_math_kstat != NULL) {
+		raidz_math_kstat->ks_lock = &raidz_math_kstat_lock;
+		raidz_math_kstat->ks_data = NULL;
+		raidz_math_kstat->ks_ndata = UINT32_MAX;
+		kstat_set_raw_ops(raidz_math_kstat,
+		    raidz_math_kstat_headers,
+		    raidz_math_kstat_data,
+		    raidz_math_kstat_addr);
+		kstat_install(raidz_math_kstat);
+	}
+
+	/* Finish initialization */
+	zfs_vdev_raidz_impl = user_sel_impl;
+	membar_producer();
+	raidz_math_initialized = B_TRUE;
+}
+
+void
+vdev_raidz_math_fini(void)
+{
+	if (raidz_math_kstat != NULL) {
+		kstat_delete(raidz_math_kstat);
+		raidz_math_kstat = NULL;
+	}
+	mutex_destroy(&raidz_math_kstat_lock);
+
+	raidz_math_initialized = B_FALSE;
+}
+
+static const struct {
+	char *name;
+	uint32_t sel;
+} math_impl_opts[] = {
+	{ "cycle",	IMPL_CYCLE },
+	{ "fastest",	IMPL_FASTEST },
+	{ "original",	IMPL_ORIGINAL },
+};
+
+/*
+ * Function sets desired raidz implementation.
+ *
+ * If we are called before init(), user preference will be saved in
+ * user_sel_impl, and applied in later init() call. This occurs when module
+ * parameter is specified on module load. Otherwise, directly update
+ * zfs_vdev_raidz_impl.
+ *
+ * @val		Name of raidz implementation to use
+ */
+int
+vdev_raidz_impl_set(const char *val)
+{
+	int err = EINVAL;
+	char req_name[RAIDZ_IMPL_NAME_MAX];
+	uint32_t impl = IMPL_FASTEST;
+	size_t i;
+
+	/* sanitize input */
+	i = strnlen(val, RAIDZ_IMPL_NAME_MAX);
+	if (i == 0 || i == RAIDZ_IMPL_NAME_MAX)
+		return (err);
+
+	strlcpy(req_name, val, RAIDZ_IMPL_NAME_MAX);
+	while (i > 0 && (req_name[i-1] == ' ' || req_name[i-1] == '\t' ||
+	    req_name[i-1] == '\n'))
+		i--;
+	req_name[i] = '\0';
+
+	/* Check mandatory options */
+	for (i = 0; i < ARRAY_SIZE(math_impl_opts); i++) {
+		if (strcmp(req_name, math_impl_opts[i].name) == 0) {
+			impl = math_impl_opts[i].sel;
+			err = 0;
+			break;
+		}
+	}
+
+	/* check all supported impl if init() was already called */
+	if (err != 0 && raidz_math_initialized) {
+		/* check all supported implementations */
+		for (i = 0; i < raidz_supp_impl_cnt; i++) {
+			if (strcmp(req_name, raidz_supp_ops[i].rmo_name) == 0) {
+				impl = i;
+				err = 0;
+				break;
+			}
+		}
+	}
+
+	if (err == 0) {
+		if (raidz_math_initialized)
+			atomic_swap_32(&zfs_vdev_raidz_impl, impl);
+		else
+			atomic_swap_32(&user_sel_impl, impl);
+	}
+
+	return (err);
+}
+
+/*
+ * Describe the available implementations, with the selected one in
+ * square brackets, e.g. "cycle [fastest] original scalar sse2 avx2".
+ */
+void
+vdev_raidz_impl_get(char *buffer, size_t size)
+{
+	const uint32_t impl = raidz_math_initialized ?
+	    zfs_vdev_raidz_impl : user_sel_impl;
+	const char *fmt;
+	size_t off = 0;
+	int i;
+
+	ASSERT3U(size, >, 0);
+	buffer[0] = '\0';
+
+	/* list mandatory options */
+	for (i = 0; i < ARRAY_SIZE(math_impl_opts) && off < size; i++) {
+		fmt = (impl == math_impl_opts[i].sel) ? "[%s] " : "%s ";
+		off += snprintf(buffer + off, size - off, fmt,
+		    math_impl_opts[i].name);
+	}
+
+	/* list all supported implementations */
+	for (i = 0; i < raidz_supp_impl_cnt && off < size; i++) {
+		fmt = (i == impl) ? "[%s] " : "%s ";
+		off += snprintf(buffer + off, size - off, fmt,
+		    raidz_supp_ops[i].rmo_name);
+	}
+}
@@ -0,0 +1,302 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/isa_defs.h>
+
+#if defined(__x86_64) && defined(HAVE_AVX2)
+
+#include <sys/zfs_context.h>
+#include <sys/simd_x86.h>
+#include <sys/vdev_raidz_impl.h>
+
+#include <immintrin.h>
+
+/*
+ * AVX2 implementation of the RAID-Z buffer kernels. The algorithms are the
+ * same as for SSE2 and SSSE3, on 32 byte registers. vpshufb only shuffles
+ * within 128 bit lanes, so the nibble tables are broadcast to both lanes.
+ */
+
+#define	AVX2_TARGET	__attribute__((target("avx2")))
+#define	AVX2_STRIDE	(2 * sizeof (__m256i))
+#define	AVX2_BULK(size)	((size) & ~(AVX2_STRIDE - 1))
+
+#define	AVX2_LOAD(p, i)		_mm256_loadu_si256((const __m256i *)(p) + (i))
+#define	AVX2_STORE(p, i, v)	_mm256_storeu_si256((__m256i *)(p) + (i), (v))
+
+static inline AVX2_TARGET __m256i
+avx2_mul2(__m256i x, __m256i poly, __m256i zero)
+{
+	__m256i mask = _mm256_cmpgt_epi8(zero, x);
+
+	return (_mm256_xor_si256(_mm256_add_epi8(x, x),
+	    _mm256_and_si256(mask, poly)));
+}
+
+static AVX2_TARGET void
+avx2_xor_bulk(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t off;
+	int i;
+
+	for (off = 0; off < size; off += AVX2_STRIDE) {
+		for (i = 0; i < 2; i++) {
+			AVX2_STORE(dst + off, i, _mm256_xor_si256(
+			    AVX2_LOAD(dst + off, i), AVX2_LOAD(src + off, i)));
+		}
+	}
+}
+
+static AVX2_TARGET void
+avx2_gen_pq_bulk(uint8_t *p, uint8_t *q, const uint8_t *src, size_t size)
+{
+	const __m256i poly = _mm256_set1_epi8(0x1d);
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i s;
+	size_t off;
+	int i;
+
+	for (off = 0; off < size; off += AVX2_STRIDE) {
+		for (i = 0; i < 2; i++) {
+			s = AVX2_LOAD(src + off, i);
+			AVX2_STORE(p + off, i,
+			    _mm256_xor_si256(AVX2_LOAD(p + off, i), s));
+			AVX2_STORE(q + off, i, _mm256_xor_si256(avx2_mul2(
+			    AVX2_LOAD(q + off, i), poly, zero), s));
+		}
+	}
+}
+
+static AVX2_TARGET void
+avx2_gen_pqr_bulk(uint8_t *p, uint8_t *q, uint8_t *r, const uint8_t *src,
+    size_t size)
+{
+	const __m256i poly = _mm256_set1_epi8(0x1d);
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i s, x;
+	size_t off;
+	int i;
+
+	for (off = 0; off < size; off += AVX2_STRIDE) {
+		for (i = 0; i < 2; i++) {
+			s = AVX2_LOAD(src + off, i);
+			AVX2_STORE(p + off, i,
+			    _mm256_xor_si256(AVX2_LOAD(p + off, i), s));
+			AVX2_STORE(q + off, i, _mm256_xor_si256(avx2_mul2(
+			    AVX2_LOAD(q + off, i), poly, zero), s));
+			x = avx2_mul2(AVX2_LOAD(r + off, i), poly, zero);
+			x = avx2_mul2(x, poly, zero);
+			AVX2_STORE(r + off, i, _mm256_xor_si256(x, s));
+		}
+	}
+}
+
+static AVX2_TARGET void
+avx2_mul_bulk(uint8_t *dst, const uint8_t *src, int pow, size_t size)
+{
+	const __m256i poly = _mm256_set1_epi8(0x1d);
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i x;
+	size_t off;
+	int i, j;
+
+	for (off = 0; off < size; off += AVX2_STRIDE) {
+		for (i = 0; i < 2; i++) {
+			x = AVX2_LOAD(dst + off, i);
+			for (j = 0; j < pow; j++)
+				x = avx2_mul2(x, poly, zero);
+			if (src != NULL)
+				x = _mm256_xor_si256(x,
+				    AVX2_LOAD(src + off, i));
+			AVX2_STORE(dst + off, i, x);
+		}
+	}
+}
+
+static AVX2_TARGET void
+avx2_mulc_bulk(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size,
+    boolean_t add)
+{
+	const __m256i lo = _mm256_broadcastsi128_si256(
+	    _mm_loadu_si128((const __m128i *)vdev_raidz_mul_lt[c]));
+	const __m256i hi = _mm256_broadcastsi128_si256(
+	    _mm_loadu_si128((const __m128i *)vdev_raidz_mul_lt[c] + 1));
+	const __m256i nib = _mm256_set1_epi8(0x0f);
+	__m256i s, x;
+	size_t off;
+	int i;
+
+	for (off = 0; off < size; off += AVX2_STRIDE) {
+		for (i = 0; i < 2; i++) {
+			s = AVX2_LOAD(src + off, i);
+			x = _mm256_xor_si256(
+			    _mm256_shuffle_epi8(lo, _mm256_and_si256(s, nib)),
+			    _mm256_shuffle_epi8(hi, _mm256_and_si256(
+			    _mm256_srli_epi64(s, 4), nib)));
+			if (add)
+				x = _mm256_xor_si256(x,
+				    AVX2_LOAD(dst + off, i));
+			AVX2_STORE(dst + off, i, x);
+		}
+	}
+}
+
+static void
+raidz_avx2_xor(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t bulk = AVX2_BULK(size);
+
+	kfpu_begin();
+	avx2_xor_bulk(dst, src, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_xor(dst + bulk, src + bulk, size - bulk);
+}
+
+static void
+raidz_avx2_gen_pq(uint8_t *p, uint8_t *q, const uint8_t *src, size_t size)
+{
+	size_t bulk = AVX2_BULK(size);
+
+	kfpu_begin();
+	avx2_gen_pq_bulk(p, q, src, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_gen_pq(p + bulk, q + bulk, src + bulk,
+		    size - bulk);
+}
+
+static void
+raidz_avx2_gen_pqr(uint8_t *p, uint8_t *q, uint8_t *r, const uint8_t *src,
+    size_t size)
+{
+	size_t bulk = AVX2_BULK(size);
+
+	kfpu_begin();
+	avx2_gen_pqr_bulk(p, q, r, src, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_gen_pqr(p + bulk, q + bulk, r + bulk, src + bulk,
+		    size - bulk);
+}
+
+static void
+raidz_avx2_mul2(uint8_t *dst, size_t size)
+{
+	size_t bulk = AVX2_BULK(size);
+
+	kfpu_begin();
+	avx2_mul_bulk(dst, NULL, 1, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_mul2(dst + bulk, size - bulk);
+}
+
+static void
+raidz_avx2_mul4(uint8_t *dst, size_t size)
+{
+	size_t bulk = AVX2_BULK(size);
+
+	kfpu_begin();
+	avx2_mul_bulk(dst, NULL, 2, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_mul4(dst + bulk, size - bulk);
+}
+
+static void
+raidz_avx2_q_step(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t bulk = AVX2_BULK(size);
+
+	kfpu_begin();
+	avx2_mul_bulk(dst, src, 1, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_q_step(dst + bulk, src + bulk, size - bulk);
+}
+
+static void
+raidz_avx2_r_step(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t bulk = AVX2_BULK(size);
+
+	kfpu_begin();
+	avx2_mul_bulk(dst, src, 2, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_r_step(dst + bulk, src + bulk, size - bulk);
+}
+
+static void
+raidz_avx2_mul_copy(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size)
+{
+	size_t bulk = AVX2_BULK(size);
+
+	kfpu_begin();
+	avx2_mulc_bulk(dst, src, c, bulk, B_FALSE);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_mul_copy(dst + bulk, src + bulk, c, size - bulk);
+}
+
+static void
+raidz_avx2_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size)
+{
+	size_t bulk = AVX2_BULK(size);
+
+	kfpu_begin();
+	avx2_mulc_bulk(dst, src, c, bulk, B_TRUE);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_mul_add(dst + bulk, src + bulk, c, size - bulk);
+}
+
+static boolean_t
+raidz_will_avx2_work(void)
+{
+	return (zfs_avx_available() && zfs_avx2_available());
+}
+
+const raidz_impl_ops_t vdev_raidz_avx2_impl = {
+	.rio_xor = raidz_avx2_xor,
+	.rio_gen_pq = raidz_avx2_gen_pq,
+	.rio_gen_pqr = raidz_avx2_gen_pqr,
+	.rio_mul2 = raidz_avx2_mul2,
+	.rio_mul4 = raidz_avx2_mul4,
+	.rio_q_step = raidz_avx2_q_step,
+	.rio_r_step = raidz_avx2_r_step,
+	.rio_mul_copy = raidz_avx2_mul_copy,
+	.rio_mul_add = raidz_avx2_mul_add,
+	.rio_is_supported = raidz_will_avx2_work,
+	.rio_name = "avx2"
+};
+
+#endif /* defined(__x86_64) && defined(HAVE_AVX2) */
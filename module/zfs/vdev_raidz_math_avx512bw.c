@@ -0,0 +1,286 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/isa_defs.h>
+
+#if defined(__x86_64) && defined(HAVE_AVX512BW)
+
+#include <sys/zfs_context.h>
+#include <sys/simd_x86.h>
+#include <sys/vdev_raidz_impl.h>
+
+#include <immintrin.h>
+
+/*
+ * AVX512BW implementation of the RAID-Z buffer kernels. The sign bit of
+ * every byte is moved straight into a mask register, which then selects
+ * the reducing polynomial without a separate compare. Note that
+ * zfs_avx512bw_available() is always false in the OS X kernel, so this
+ * implementation is only ever selected by user space consumers.
+ */
+
+#define	AVX512_TARGET	__attribute__((target("avx512f,avx512bw")))
+#define	AVX512_STRIDE	(sizeof (__m512i))
+#define	AVX512_BULK(size)	((size) & ~(AVX512_STRIDE - 1))
+
+#define	AVX512_LOAD(p)		_mm512_loadu_si512((const void *)(p))
+#define	AVX512_STORE(p, v)	_mm512_storeu_si512((void *)(p), (v))
+
+static inline AVX512_TARGET __m512i
+avx512_mul2(__m512i x, __m512i poly)
+{
+	__mmask64 mask = _mm512_movepi8_mask(x);
+
+	return (_mm512_xor_si512(_mm512_add_epi8(x, x),
+	    _mm512_maskz_mov_epi8(mask, poly)));
+}
+
+static AVX512_TARGET void
+avx512_xor_bulk(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t off;
+
+	for (off = 0; off < size; off += AVX512_STRIDE) {
+		AVX512_STORE(dst + off, _mm512_xor_si512(AVX512_LOAD(dst + off),
+		    AVX512_LOAD(src + off)));
+	}
+}
+
+static AVX512_TARGET void
+avx512_gen_pq_bulk(uint8_t *p, uint8_t *q, const uint8_t *src, size_t size)
+{
+	const __m512i poly = _mm512_set1_epi8(0x1d);
+	__m512i s;
+	size_t off;
+
+	for (off = 0; off < size; off += AVX512_STRIDE) {
+		s = AVX512_LOAD(src + off);
+		AVX512_STORE(p + off, _mm512_xor_si512(AVX512_LOAD(p + off), s));
+		AVX512_STORE(q + off, _mm512_xor_si512(
+		    avx512_mul2(AVX512_LOAD(q + off), poly), s));
+	}
+}
+
+static AVX512_TARGET void
+avx512_gen_pqr_bulk(uint8_t *p, uint8_t *q, uint8_t *r, const uint8_t *src,
+    size_t size)
+{
+	const __m512i poly = _mm512_set1_epi8(0x1d);
+	__m512i s, x;
+	size_t off;
+
+	for (off = 0; off < size; off += AVX512_STRIDE) {
+		s = AVX512_LOAD(src + off);
+		AVX512_STORE(p + off, _mm512_xor_si512(AVX512_LOAD(p + off), s));
+		AVX512_STORE(q + off, _mm512_xor_si512(
+		    avx512_mul2(AVX512_LOAD(q + off), poly), s));
+		x = avx512_mul2(avx512_mul2(AVX512_LOAD(r + off), poly), poly);
+		AVX512_STORE(r + off, _mm512_xor_si512(x, s));
+	}
+}
+
+static AVX512_TARGET void
+avx512_mul_bulk(uint8_t *dst, const uint8_t *src, int pow, size_t size)
+{
+	const __m512i poly = _mm512_set1_epi8(0x1d);
+	__m512i x;
+	size_t off;
+	int j;
+
+	for (off = 0; off < size; off += AVX512_STRIDE) {
+		x = AVX512_LOAD(dst + off);
+		for (j = 0; j < pow; j++)
+			x = avx512_mul2(x, poly);
+		if (src != NULL)
+			x = _mm512_xor_si512(x, AVX512_LOAD(src + off));
+		AVX512_STORE(dst + off, x);
+	}
+}
+
+static AVX512_TARGET void
+avx512_mulc_bulk(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size,
+    boolean_t add)
+{
+	const __m512i lo = _mm512_broadcast_i32x4(
+	    _mm_loadu_si128((const __m128i *)vdev_raidz_mul_lt[c]));
+	const __m512i hi = _mm512_broadcast_i32x4(
+	    _mm_loadu_si128((const __m128i *)vdev_raidz_mul_lt[c] + 1));
+	const __m512i nib = _mm512_set1_epi8(0x0f);
+	__m512i s, x;
+	size_t off;
+
+	for (off = 0; off < size; off += AVX512_STRIDE) {
+		s = AVX512_LOAD(src + off);
+		x = _mm512_xor_si512(
+		    _mm512_shuffle_epi8(lo, _mm512_and_si512(s, nib)),
+		    _mm512_shuffle_epi8(hi,
+		    _mm512_and_si512(_mm512_srli_epi64(s, 4), nib)));
+		if (add)
+			x = _mm512_xor_si512(x, AVX512_LOAD(dst + off));
+		AVX512_STORE(dst + off, x);
+	}
+}
+
+static void
+raidz_avx512bw_xor(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t bulk = AVX512_BULK(size);
+
+	kfpu_begin();
+	avx512_xor_bulk(dst, src, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_xor(dst + bulk, src + bulk, size - bulk);
+}
+
+static void
+raidz_avx512bw_gen_pq(uint8_t *p, uint8_t *q, const uint8_t *src,
+    size_t size)
+{
+	size_t bulk = AVX512_BULK(size);
+
+	kfpu_begin();
+	avx512_gen_pq_bulk(p, q, src, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_gen_pq(p + bulk, q + bulk, src + bulk,
+		    size - bulk);
+}
+
+static void
+raidz_avx512bw_gen_pqr(uint8_t *p, uint8_t *q, uint8_t *r,
+    const uint8_t *src, size_t size)
+{
+	size_t bulk = AVX512_BULK(size);
+
+	kfpu_begin();
+	avx512_gen_pqr_bulk(p, q, r, src, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_gen_pqr(p + bulk, q + bulk, r + bulk, src + bulk,
+		    size - bulk);
+}
+
+static void
+raidz_avx512bw_mul2(uint8_t *dst, size_t size)
+{
+	size_t bulk = AVX512_BULK(size);
+
+	kfpu_begin();
+	avx512_mul_bulk(dst, NULL, 1, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_mul2(dst + bulk, size - bulk);
+}
+
+static void
+raidz_avx512bw_mul4(uint8_t *dst, size_t size)
+{
+	size_t bulk = AVX512_BULK(size);
+
+	kfpu_begin();
+	avx512_mul_bulk(dst, NULL, 2, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_mul4(dst + bulk, size - bulk);
+}
+
+static void
+raidz_avx512bw_q_step(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t bulk = AVX512_BULK(size);
+
+	kfpu_begin();
+	avx512_mul_bulk(dst, src, 1, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_q_step(dst + bulk, src + bulk, size - bulk);
+}
+
+static void
+raidz_avx512bw_r_step(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t bulk = AVX512_BULK(size);
+
+	kfpu_begin();
+	avx512_mul_bulk(dst, src, 2, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_r_step(dst + bulk, src + bulk, size - bulk);
+}
+
+static void
+raidz_avx512bw_mul_copy(uint8_t *dst, const uint8_t *src, uint8_t c,
+    size_t size)
+{
+	size_t bulk = AVX512_BULK(size);
+
+	kfpu_begin();
+	avx512_mulc_bulk(dst, src, c, bulk, B_FALSE);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_mul_copy(dst + bulk, src + bulk, c, size - bulk);
+}
+
+static void
+raidz_avx512bw_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c,
+    size_t size)
+{
+	size_t bulk = AVX512_BULK(size);
+
+	kfpu_begin();
+	avx512_mulc_bulk(dst, src, c, bulk, B_TRUE);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_mul_add(dst + bulk, src + bulk, c, size - bulk);
+}
+
+static boolean_t
+raidz_will_avx512bw_work(void)
+{
+	return (zfs_avx_available() && zfs_avx2_available() &&
+	    zfs_avx512f_available() && zfs_avx512bw_available());
+}
+
+const raidz_impl_ops_t vdev_raidz_avx512bw_impl = {
+	.rio_xor = raidz_avx512bw_xor,
+	.rio_gen_pq = raidz_avx512bw_gen_pq,
+	.rio_gen_pqr = raidz_avx512bw_gen_pqr,
+	.rio_mul2 = raidz_avx512bw_mul2,
+	.rio_mul4 = raidz_avx512bw_mul4,
+	.rio_q_step = raidz_avx512bw_q_step,
+	.rio_r_step = raidz_avx512bw_r_step,
+	.rio_mul_copy = raidz_avx512bw_mul_copy,
+	.rio_mul_add = raidz_avx512bw_mul_add,
+	.rio_is_supported = raidz_will_avx512bw_work,
+	.rio_name = "avx512bw"
+};
+
+#endif /* defined(__x86_64) && defined(HAVE_AVX512BW) */
@@ -0,0 +1,197 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/vdev_raidz_impl.h>
+
+/*
+ * Reference implementation of the RAID-Z buffer kernels. The bulk of each
+ * buffer is processed 64 bits at a time with the same SWAR multiplication
+ * the original code in vdev_raidz.c uses; any trailing bytes are handled
+ * one at a time. Constant multiplication goes through the nibble tables.
+ */
+
+#define	SCALAR_WORDS(size)	((size) / sizeof (uint64_t))
+
+void
+raidz_scalar_xor(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	uint64_t *d = (uint64_t *)dst;
+	const uint64_t *s = (const uint64_t *)src;
+	size_t i, cnt = SCALAR_WORDS(size);
+
+	for (i = 0; i < cnt; i++)
+		d[i] ^= s[i];
+
+	for (i = cnt * sizeof (uint64_t); i < size; i++)
+		dst[i] ^= src[i];
+}
+
+void
+raidz_scalar_gen_pq(uint8_t *pp, uint8_t *qp, const uint8_t *src, size_t size)
+{
+	uint64_t *p = (uint64_t *)pp;
+	uint64_t *q = (uint64_t *)qp;
+	const uint64_t *s = (const uint64_t *)src;
+	uint64_t mask;
+	size_t i, cnt = SCALAR_WORDS(size);
+
+	for (i = 0; i < cnt; i++) {
+		p[i] ^= s[i];
+		VDEV_RAIDZ_64MUL_2(q[i], mask);
+		q[i] ^= s[i];
+	}
+
+	for (i = cnt * sizeof (uint64_t); i < size; i++) {
+		pp[i] ^= src[i];
+		qp[i] = VDEV_RAIDZ_MUL_2(qp[i]) ^ src[i];
+	}
+}
+
+void
+raidz_scalar_gen_pqr(uint8_t *pp, uint8_t *qp, uint8_t *rp,
+    const uint8_t *src, size_t size)
+{
+	uint64_t *p = (uint64_t *)pp;
+	uint64_t *q = (uint64_t *)qp;
+	uint64_t *r = (uint64_t *)rp;
+	const uint64_t *s = (const uint64_t *)src;
+	uint64_t mask;
+	size_t i, cnt = SCALAR_WORDS(size);
+
+	for (i = 0; i < cnt; i++) {
+		p[i] ^= s[i];
+		VDEV_RAIDZ_64MUL_2(q[i], mask);
+		q[i] ^= s[i];
+		VDEV_RAIDZ_64MUL_4(r[i], mask);
+		r[i] ^= s[i];
+	}
+
+	for (i = cnt * sizeof (uint64_t); i < size; i++) {
+		pp[i] ^= src[i];
+		qp[i] = VDEV_RAIDZ_MUL_2(qp[i]) ^ src[i];
+		rp[i] = VDEV_RAIDZ_MUL_4(rp[i]) ^ src[i];
+	}
+}
+
+void
+raidz_scalar_mul2(uint8_t *dst, size_t size)
+{
+	uint64_t *d = (uint64_t *)dst;
+	uint64_t mask;
+	size_t i, cnt = SCALAR_WORDS(size);
+
+	for (i = 0; i < cnt; i++)
+		VDEV_RAIDZ_64MUL_2(d[i], mask);
+
+	for (i = cnt * sizeof (uint64_t); i < size; i++)
+		dst[i] = VDEV_RAIDZ_MUL_2(dst[i]);
+}
+
+void
+raidz_scalar_mul4(uint8_t *dst, size_t size)
+{
+	uint64_t *d = (uint64_t *)dst;
+	uint64_t mask;
+	size_t i, cnt = SCALAR_WORDS(size);
+
+	for (i = 0; i < cnt; i++)
+		VDEV_RAIDZ_64MUL_4(d[i], mask);
+
+	for (i = cnt * sizeof (uint64_t); i < size; i++)
+		dst[i] = VDEV_RAIDZ_MUL_4(dst[i]);
+}
+
+void
+raidz_scalar_q_step(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	uint64_t *d = (uint64_t *)dst;
+	const uint64_t *s = (const uint64_t *)src;
+	uint64_t mask;
+	size_t i, cnt = SCALAR_WORDS(size);
+
+	for (i = 0; i < cnt; i++) {
+		VDEV_RAIDZ_64MUL_2(d[i], mask);
+		d[i] ^= s[i];
+	}
+
+	for (i = cnt * sizeof (uint64_t); i < size; i++)
+		dst[i] = VDEV_RAIDZ_MUL_2(dst[i]) ^ src[i];
+}
+
+void
+raidz_scalar_r_step(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	uint64_t *d = (uint64_t *)dst;
+	const uint64_t *s = (const uint64_t *)src;
+	uint64_t mask;
+	size_t i, cnt = SCALAR_WORDS(size);
+
+	for (i = 0; i < cnt; i++) {
+		VDEV_RAIDZ_64MUL_4(d[i], mask);
+		d[i] ^= s[i];
+	}
+
+	for (i = cnt * sizeof (uint64_t); i < size; i++)
+		dst[i] = VDEV_RAIDZ_MUL_4(dst[i]) ^ src[i];
+}
+
+void
+raidz_scalar_mul_copy(uint8_t *dst, const uint8_t *src, uint8_t c,
+    size_t size)
+{
+	const uint8_t *lt = vdev_raidz_mul_lt[c];
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		dst[i] = lt[src[i] & 0x0f] ^ lt[16 + (src[i] >> 4)];
+}
+
+void
+raidz_scalar_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c,
+    size_t size)
+{
+	const uint8_t *lt = vdev_raidz_mul_lt[c];
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		dst[i] ^= lt[src[i] & 0x0f] ^ lt[16 + (src[i] >> 4)];
+}
+
+static boolean_t
+raidz_will_scalar_work(void)
+{
+	return (B_TRUE); /* always */
+}
+
+const raidz_impl_ops_t vdev_raidz_scalar_impl = {
+	.rio_xor = raidz_scalar_xor,
+	.rio_gen_pq = raidz_scalar_gen_pq,
+	.rio_gen_pqr = raidz_scalar_gen_pqr,
+	.rio_mul2 = raidz_scalar_mul2,
+	.rio_mul4 = raidz_scalar_mul4,
+	.rio_q_step = raidz_scalar_q_step,
+	.rio_r_step = raidz_scalar_r_step,
+	.rio_mul_copy = raidz_scalar_mul_copy,
+	.rio_mul_add = raidz_scalar_mul_add,
+	.rio_is_supported = raidz_will_scalar_work,
+	.rio_name = "scalar"
+};
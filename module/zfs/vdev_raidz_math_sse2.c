@@ -0,0 +1,247 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/isa_defs.h>
+
+#if defined(__x86_64) && defined(HAVE_SSE2)
+
+#include <sys/zfs_context.h>
+#include <sys/simd_x86.h>
+#include <sys/vdev_raidz_impl.h>
+
+#include <immintrin.h>
+
+/*
+ * SSE2 implementation of the RAID-Z buffer kernels. Multiplication by 2
+ * is done on 16 bytes at once: the sign of every byte selects whether the
+ * reducing polynomial 0x1d is folded into the doubled value. SSE2 has no
+ * byte shuffle, so constant multiplication is left to the scalar tables.
+ */
+
+#define	SSE2_TARGET	__attribute__((target("sse2")))
+#define	SSE2_STRIDE	(4 * sizeof (__m128i))
+#define	SSE2_BULK(size)	((size) & ~(SSE2_STRIDE - 1))
+
+static inline SSE2_TARGET __m128i
+sse2_mul2(__m128i x, __m128i poly, __m128i zero)
+{
+	__m128i mask = _mm_cmpgt_epi8(zero, x);
+
+	return (_mm_xor_si128(_mm_add_epi8(x, x), _mm_and_si128(mask, poly)));
+}
+
+#define	SSE2_LOAD(p, i)		_mm_loadu_si128((const __m128i *)(p) + (i))
+#define	SSE2_STORE(p, i, v)	_mm_storeu_si128((__m128i *)(p) + (i), (v))
+
+static SSE2_TARGET void
+sse2_xor_bulk(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t off;
+	int i;
+
+	for (off = 0; off < size; off += SSE2_STRIDE) {
+		for (i = 0; i < 4; i++) {
+			SSE2_STORE(dst + off, i, _mm_xor_si128(
+			    SSE2_LOAD(dst + off, i), SSE2_LOAD(src + off, i)));
+		}
+	}
+}
+
+static SSE2_TARGET void
+sse2_gen_pq_bulk(uint8_t *p, uint8_t *q, const uint8_t *src, size_t size)
+{
+	const __m128i poly = _mm_set1_epi8(0x1d);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i s;
+	size_t off;
+	int i;
+
+	for (off = 0; off < size; off += SSE2_STRIDE) {
+		for (i = 0; i < 4; i++) {
+			s = SSE2_LOAD(src + off, i);
+			SSE2_STORE(p + off, i,
+			    _mm_xor_si128(SSE2_LOAD(p + off, i), s));
+			SSE2_STORE(q + off, i, _mm_xor_si128(sse2_mul2(
+			    SSE2_LOAD(q + off, i), poly, zero), s));
+		}
+	}
+}
+
+static SSE2_TARGET void
+sse2_gen_pqr_bulk(uint8_t *p, uint8_t *q, uint8_t *r, const uint8_t *src,
+    size_t size)
+{
+	const __m128i poly = _mm_set1_epi8(0x1d);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i s, x;
+	size_t off;
+	int i;
+
+	for (off = 0; off < size; off += SSE2_STRIDE) {
+		for (i = 0; i < 4; i++) {
+			s = SSE2_LOAD(src + off, i);
+			SSE2_STORE(p + off, i,
+			    _mm_xor_si128(SSE2_LOAD(p + off, i), s));
+			SSE2_STORE(q + off, i, _mm_xor_si128(sse2_mul2(
+			    SSE2_LOAD(q + off, i), poly, zero), s));
+			x = sse2_mul2(SSE2_LOAD(r + off, i), poly, zero);
+			x = sse2_mul2(x, poly, zero);
+			SSE2_STORE(r + off, i, _mm_xor_si128(x, s));
+		}
+	}
+}
+
+static SSE2_TARGET void
+sse2_mul_bulk(uint8_t *dst, const uint8_t *src, int pow, size_t size)
+{
+	const __m128i poly = _mm_set1_epi8(0x1d);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i x;
+	size_t off;
+	int i, j;
+
+	for (off = 0; off < size; off += SSE2_STRIDE) {
+		for (i = 0; i < 4; i++) {
+			x = SSE2_LOAD(dst + off, i);
+			for (j = 0; j < pow; j++)
+				x = sse2_mul2(x, poly, zero);
+			if (src != NULL)
+				x = _mm_xor_si128(x, SSE2_LOAD(src + off, i));
+			SSE2_STORE(dst + off, i, x);
+		}
+	}
+}
+
+void
+raidz_sse2_xor(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t bulk = SSE2_BULK(size);
+
+	kfpu_begin();
+	sse2_xor_bulk(dst, src, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_xor(dst + bulk, src + bulk, size - bulk);
+}
+
+void
+raidz_sse2_gen_pq(uint8_t *p, uint8_t *q, const uint8_t *src, size_t size)
+{
+	size_t bulk = SSE2_BULK(size);
+
+	kfpu_begin();
+	sse2_gen_pq_bulk(p, q, src, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_gen_pq(p + bulk, q + bulk, src + bulk,
+		    size - bulk);
+}
+
+void
+raidz_sse2_gen_pqr(uint8_t *p, uint8_t *q, uint8_t *r, const uint8_t *src,
+    size_t size)
+{
+	size_t bulk = SSE2_BULK(size);
+
+	kfpu_begin();
+	sse2_gen_pqr_bulk(p, q, r, src, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_gen_pqr(p + bulk, q + bulk, r + bulk, src + bulk,
+		    size - bulk);
+}
+
+void
+raidz_sse2_mul2(uint8_t *dst, size_t size)
+{
+	size_t bulk = SSE2_BULK(size);
+
+	kfpu_begin();
+	sse2_mul_bulk(dst, NULL, 1, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_mul2(dst + bulk, size - bulk);
+}
+
+void
+raidz_sse2_mul4(uint8_t *dst, size_t size)
+{
+	size_t bulk = SSE2_BULK(size);
+
+	kfpu_begin();
+	sse2_mul_bulk(dst, NULL, 2, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_mul4(dst + bulk, size - bulk);
+}
+
+void
+raidz_sse2_q_step(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t bulk = SSE2_BULK(size);
+
+	kfpu_begin();
+	sse2_mul_bulk(dst, src, 1, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_q_step(dst + bulk, src + bulk, size - bulk);
+}
+
+void
+raidz_sse2_r_step(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t bulk = SSE2_BULK(size);
+
+	kfpu_begin();
+	sse2_mul_bulk(dst, src, 2, bulk);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_r_step(dst + bulk, src + bulk, size - bulk);
+}
+
+static boolean_t
+raidz_will_sse2_work(void)
+{
+	return (zfs_sse2_available());
+}
+
+const raidz_impl_ops_t vdev_raidz_sse2_impl = {
+	.rio_xor = raidz_sse2_xor,
+	.rio_gen_pq = raidz_sse2_gen_pq,
+	.rio_gen_pqr = raidz_sse2_gen_pqr,
+	.rio_mul2 = raidz_sse2_mul2,
+	.rio_mul4 = raidz_sse2_mul4,
+	.rio_q_step = raidz_sse2_q_step,
+	.rio_r_step = raidz_sse2_r_step,
+	.rio_mul_copy = raidz_scalar_mul_copy,
+	.rio_mul_add = raidz_scalar_mul_add,
+	.rio_is_supported = raidz_will_sse2_work,
+	.rio_name = "sse2"
+};
+
+#endif /* defined(__x86_64) && defined(HAVE_SSE2) */
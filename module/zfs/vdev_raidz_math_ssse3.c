@@ -0,0 +1,120 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/isa_defs.h>
+
+#if defined(__x86_64) && defined(HAVE_SSE2) && defined(HAVE_SSSE3)
+
+#include <sys/zfs_context.h>
+#include <sys/simd_x86.h>
+#include <sys/vdev_raidz_impl.h>
+
+#include <immintrin.h>
+
+/*
+ * SSSE3 implementation of the RAID-Z buffer kernels. Parity generation is
+ * shared with SSE2; the gain comes from constant multiplication, which is
+ * the hot loop of reconstruction. Each source byte is split into nibbles
+ * that index the two 16-entry halves of the multiplication table with
+ * pshufb, and the two partial products are XORed together.
+ */
+
+#define	SSSE3_TARGET	__attribute__((target("ssse3")))
+#define	SSSE3_STRIDE	(4 * sizeof (__m128i))
+#define	SSSE3_BULK(size)	((size) & ~(SSSE3_STRIDE - 1))
+
+#define	SSSE3_LOAD(p, i)	_mm_loadu_si128((const __m128i *)(p) + (i))
+#define	SSSE3_STORE(p, i, v)	_mm_storeu_si128((__m128i *)(p) + (i), (v))
+
+static SSSE3_TARGET void
+ssse3_mul_bulk(uint8_t *dst, const uint8_t *src, uint8_t c, size_t size,
+    boolean_t add)
+{
+	const __m128i lo = SSSE3_LOAD(vdev_raidz_mul_lt[c], 0);
+	const __m128i hi = SSSE3_LOAD(vdev_raidz_mul_lt[c], 1);
+	const __m128i nib = _mm_set1_epi8(0x0f);
+	__m128i s, x;
+	size_t off;
+	int i;
+
+	for (off = 0; off < size; off += SSSE3_STRIDE) {
+		for (i = 0; i < 4; i++) {
+			s = SSSE3_LOAD(src + off, i);
+			x = _mm_xor_si128(
+			    _mm_shuffle_epi8(lo, _mm_and_si128(s, nib)),
+			    _mm_shuffle_epi8(hi,
+			    _mm_and_si128(_mm_srli_epi64(s, 4), nib)));
+			if (add)
+				x = _mm_xor_si128(x, SSSE3_LOAD(dst + off, i));
+			SSSE3_STORE(dst + off, i, x);
+		}
+	}
+}
+
+static void
+raidz_ssse3_mul_copy(uint8_t *dst, const uint8_t *src, uint8_t c,
+    size_t size)
+{
+	size_t bulk = SSSE3_BULK(size);
+
+	kfpu_begin();
+	ssse3_mul_bulk(dst, src, c, bulk, B_FALSE);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_mul_copy(dst + bulk, src + bulk, c, size - bulk);
+}
+
+static void
+raidz_ssse3_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c,
+    size_t size)
+{
+	size_t bulk = SSSE3_BULK(size);
+
+	kfpu_begin();
+	ssse3_mul_bulk(dst, src, c, bulk, B_TRUE);
+	kfpu_end();
+
+	if (bulk < size)
+		raidz_scalar_mul_add(dst + bulk, src + bulk, c, size - bulk);
+}
+
+static boolean_t
+raidz_will_ssse3_work(void)
+{
+	return (zfs_sse2_available() && zfs_ssse3_available());
+}
+
+const raidz_impl_ops_t vdev_raidz_ssse3_impl = {
+	.rio_xor = raidz_sse2_xor,
+	.rio_gen_pq = raidz_sse2_gen_pq,
+	.rio_gen_pqr = raidz_sse2_gen_pqr,
+	.rio_mul2 = raidz_sse2_mul2,
+	.rio_mul4 = raidz_sse2_mul4,
+	.rio_q_step = raidz_sse2_q_step,
+	.rio_r_step = raidz_sse2_r_step,
+	.rio_mul_copy = raidz_ssse3_mul_copy,
+	.rio_mul_add = raidz_ssse3_mul_add,
+	.rio_is_supported = raidz_will_ssse3_work,
+	.rio_name = "ssse3"
+};
+
+#endif /* defined(__x86_64) && defined(HAVE_SSE2) && defined(HAVE_SSSE3) */
@@ -1041,6 +1041,24 @@ zfs_secpolicy_diff(zfs_cmd_t *zc, nvlist_t *innvl, cred_t *cr)
 	return (error);
 }
 
+/*
+ * Policy for application prefetch hints, which read data into the ARC on
+ * the caller's behalf.
+ */
+/* ARGSUSED */
+static int
+zfs_secpolicy_prefetch(zfs_cmd_t *zc, nvlist_t *innvl, cred_t *cr)
+{
+	int error;
+
+	if ((error = secpolicy_sys_config(cr, B_FALSE)) == 0)
+		return (0);
+
+	error = zfs_secpolicy_write_perms(zc->zc_name,
+	    ZFS_DELEG_PERM_PREFETCH, cr);
+	return (error);
+}
+
 /*
  * Policy for fault injection.  Requires all privileges.
  */
@@ -1633,6 +1651,61 @@ zfs_ioc_pool_scan(zfs_cmd_t *zc)
 	return (error);
 }
 
+/*
+ * inputs:
+ * zc_name              name of the pool
+ * zc_cookie            trim func (pool_trim_func_t)
+ * zc_obj               trim rate in bytes per second (0 is unlimited)
+ */
+static int
+zfs_ioc_pool_trim(zfs_cmd_t *zc)
+{
+	spa_t *spa;
+	int error;
+
+	if (zc->zc_cookie >= POOL_TRIM_FUNCS)
+		return (SET_ERROR(EINVAL));
+
+	if ((error = spa_open(zc->zc_name, &spa, FTAG)) != 0)
+		return (error);
+
+	if (zc->zc_cookie == POOL_TRIM_CANCEL)
+		error = spa_trim_cancel(spa);
+	else
+		error = spa_trim(spa, zc->zc_obj);
+
+	spa_close(spa, FTAG);
+
+	return (error);
+}
+
+/*
+ * inputs:
+ * zc_name              name of the pool
+ * zc_cookie            percentage of the unique DDT entries to prune
+ *
+ * outputs:
+ * zc_obj               number of entries pruned
+ */
+static int
+zfs_ioc_pool_ddt_prune(zfs_cmd_t *zc)
+{
+	spa_t *spa;
+	int error;
+
+	if (zc->zc_cookie == 0 || zc->zc_cookie > 100)
+		return (SET_ERROR(EINVAL));
+
+	if ((error = spa_open(zc->zc_name, &spa, FTAG)) != 0)
+		return (error);
+
+	error = ddt_prune(spa, zc->zc_cookie, &zc->zc_obj);
+
+	spa_close(spa, FTAG);
+
+	return (error);
+}
+
 static int
 zfs_ioc_pool_freeze(zfs_cmd_t *zc)
 {
@@ -3791,6 +3864,21 @@ zfs_check_settable(const char *dsname, nvpair_t *pair, cred_t *cr)
 				spa_close(spa, FTAG);
 			}
 
+			if (zio_compress_to_feature(intval) !=
+			    SPA_FEATURE_NONE) {
+				spa_t *spa;
+
+				if ((err = spa_open(dsname, &spa, FTAG)) != 0)
+					return (err);
+
+				if (!spa_feature_is_enabled(spa,
+				    zio_compress_to_feature(intval))) {
+					spa_close(spa, FTAG);
+					return (SET_ERROR(ENOTSUP));
+				}
+				spa_close(spa, FTAG);
+			}
+
 			/*
 			 * If this is a bootable dataset then
 			 * verify that the compression algorithm
@@ -3849,6 +3937,29 @@ zfs_check_settable(const char *dsname, nvpair_t *pair, cred_t *cr)
 		}
 		break;
 
+	case ZFS_PROP_SPECIAL_SMALL_BLOCKS:
+		/*
+		 * A nonzero value steers file data to the special class, so
+		 * the pool must be able to have one.
+		 */
+		if (nvpair_value_uint64(pair, &intval) == 0 && intval != 0) {
+			spa_t *spa;
+
+			if (intval > SPA_OLD_MAXBLOCKSIZE || !ISP2(intval))
+				return (SET_ERROR(EDOM));
+
+			if ((err = spa_open(dsname, &spa, FTAG)) != 0)
+				return (err);
+
+			if (!spa_feature_is_enabled(spa,
+			    SPA_FEATURE_ALLOCATION_CLASSES)) {
+				spa_close(spa, FTAG);
+				return (SET_ERROR(ENOTSUP));
+			}
+			spa_close(spa, FTAG);
+		}
+		break;
+
 	case ZFS_PROP_SHARESMB:
 		if (zpl_earlier_version(dsname, ZPL_VERSION_FUID))
 			return (SET_ERROR(ENOTSUP));
@@ -5636,6 +5747,184 @@ error:
 	return (ret);
 }
 
+/*
+ * Bytes of application prefetch in flight for each user, so that a user
+ * can't get around the limit on a single request by issuing many of them.
+ * An entry lives as long as requests of its user are in flight.
+ */
+typedef struct zfs_prefetch_user {
+	list_node_t	zpu_node;
+	uid_t		zpu_uid;
+	uint64_t	zpu_refs;
+	uint64_t	zpu_inflight;
+} zfs_prefetch_user_t;
+
+typedef struct zfs_prefetch_cb {
+	zfs_prefetch_user_t	*zpc_user;
+	uint64_t		zpc_bytes;
+} zfs_prefetch_cb_t;
+
+static kmutex_t zfs_prefetch_lock;
+static list_t zfs_prefetch_users;
+
+static void
+zfs_prefetch_init(void)
+{
+	mutex_init(&zfs_prefetch_lock, NULL, MUTEX_DEFAULT, NULL);
+	list_create(&zfs_prefetch_users, sizeof (zfs_prefetch_user_t),
+	    offsetof(zfs_prefetch_user_t, zpu_node));
+}
+
+static void
+zfs_prefetch_fini(void)
+{
+	ASSERT(list_is_empty(&zfs_prefetch_users));
+	list_destroy(&zfs_prefetch_users);
+	mutex_destroy(&zfs_prefetch_lock);
+}
+
+/*
+ * Reserve up to "want" bytes of what "uid" may have in flight, and return
+ * how many were reserved.  Unless that is 0, the caller holds a reference
+ * on *zpup until it calls zfs_prefetch_release().
+ */
+static uint64_t
+zfs_prefetch_reserve(uid_t uid, uint64_t want, zfs_prefetch_user_t **zpup)
+{
+	uint64_t limit = arc_max_bytes() / 4;
+	zfs_prefetch_user_t *zpu;
+	uint64_t got;
+
+	mutex_enter(&zfs_prefetch_lock);
+	for (zpu = list_head(&zfs_prefetch_users); zpu != NULL;
+	    zpu = list_next(&zfs_prefetch_users, zpu)) {
+		if (zpu->zpu_uid == uid)
+			break;
+	}
+	got = 0;
+	if (zpu == NULL || zpu->zpu_inflight < limit) {
+		got = MIN(want, limit - (zpu != NULL ? zpu->zpu_inflight : 0));
+	}
+	if (got != 0) {
+		if (zpu == NULL) {
+			zpu = kmem_zalloc(sizeof (*zpu), KM_SLEEP);
+			zpu->zpu_uid = uid;
+			list_insert_tail(&zfs_prefetch_users, zpu);
+		}
+		zpu->zpu_refs++;
+		zpu->zpu_inflight += got;
+	}
+	mutex_exit(&zfs_prefetch_lock);
+
+	*zpup = zpu;
+	return (got);
+}
+
+/*
+ * Give back bytes that were reserved, and drop the reference if "last".
+ */
+static void
+zfs_prefetch_release(zfs_prefetch_user_t *zpu, uint64_t bytes, boolean_t last)
+{
+	mutex_enter(&zfs_prefetch_lock);
+	ASSERT3U(zpu->zpu_inflight, >=, bytes);
+	zpu->zpu_inflight -= bytes;
+	if (last && --zpu->zpu_refs == 0) {
+		ASSERT0(zpu->zpu_inflight);
+		list_remove(&zfs_prefetch_users, zpu);
+		kmem_free(zpu, sizeof (*zpu));
+	}
+	mutex_exit(&zfs_prefetch_lock);
+}
+
+static void
+zfs_prefetch_done(zio_t *zio)
+{
+	zfs_prefetch_cb_t *cb = zio->io_private;
+
+	zfs_prefetch_release(cb->zpc_user, cb->zpc_bytes, B_TRUE);
+	kmem_free(cb, sizeof (*cb));
+}
+
+/*
+ * Prefetch part or all of an object into the ARC.  A user never has more
+ * than a quarter of the ARC's maximum size being read in at once; EAGAIN
+ * is returned while it is all in use.
+ *
+ * innvl: {
+ *     "object" -> object number
+ *     (optional) "offset" -> first byte to read (default 0)
+ *     (optional) "length" -> bytes to read, 0 for all (default 0)
+ *     (optional) "priority" -> zfs_prefetch_prio_t (default async)
+ *     (optional) "budget" -> most bytes to read, 0 for no limit
+ *     (optional) "dropbehind" -> (value ignored)
+ *         presence indicates the data should be evicted once read
+ * }
+ *
+ * outnvl: {
+ *     "issued" -> bytes for which reads were issued
+ * }
+ */
+static int
+zfs_ioc_prefetch(const char *dsname, nvlist_t *innvl, nvlist_t *outnvl)
+{
+	objset_t *os;
+	zfs_prefetch_user_t *zpu;
+	zfs_prefetch_cb_t *cb;
+	zio_t *pio;
+	uint64_t object, offset = 0, length = 0;
+	uint64_t prio = ZFS_PREFETCH_PRIO_ASYNC;
+	uint64_t budget = UINT64_MAX;
+	uint64_t issued;
+	boolean_t dropbehind = nvlist_exists(innvl, "dropbehind");
+	int error;
+
+	if (nvlist_lookup_uint64(innvl, "object", &object) != 0)
+		return (SET_ERROR(EINVAL));
+	(void) nvlist_lookup_uint64(innvl, "offset", &offset);
+	(void) nvlist_lookup_uint64(innvl, "length", &length);
+	(void) nvlist_lookup_uint64(innvl, "priority", &prio);
+	if (nvlist_lookup_uint64(innvl, "budget", &budget) == 0 && budget == 0)
+		budget = UINT64_MAX;
+
+	if (prio >= ZFS_PREFETCH_PRIO_FUNCS)
+		return (SET_ERROR(EINVAL));
+
+	error = dmu_objset_hold(dsname, FTAG, &os);
+	if (error != 0)
+		return (error);
+
+	budget = zfs_prefetch_reserve(crgetuid(CRED()), budget, &zpu);
+	if (budget == 0) {
+		dmu_objset_rele(os, FTAG);
+		return (SET_ERROR(EAGAIN));
+	}
+
+	/*
+	 * The reservation is held until the reads complete, less whatever
+	 * dmu_prefetch_hint() didn't use, which is given back right away.
+	 */
+	cb = kmem_alloc(sizeof (*cb), KM_SLEEP);
+	cb->zpc_user = zpu;
+	cb->zpc_bytes = budget;
+	pio = zio_root(dmu_objset_spa(os), zfs_prefetch_done, cb,
+	    ZIO_FLAG_CANFAIL);
+
+	error = dmu_prefetch_hint(os, object, offset, length,
+	    prio == ZFS_PREFETCH_PRIO_SYNC ? ZIO_PRIORITY_SYNC_READ :
+	    ZIO_PRIORITY_ASYNC_READ, budget, dropbehind, pio, &issued);
+	dmu_objset_rele(os, FTAG);
+
+	zfs_prefetch_release(zpu, budget - issued, B_FALSE);
+	cb->zpc_bytes = issued;
+	zio_nowait(pio);
+
+	if (error == 0)
+		fnvlist_add_uint64(outnvl, "issued", issued);
+
+	return (error);
+}
+
 static zfs_ioc_vec_t zfs_ioc_vec[ZFS_IOC_LAST - ZFS_IOC_FIRST];
 
 static void
@@ -5815,6 +6104,10 @@ zfs_ioctl_init(void)
 	    DATASET_NAME, POOL_CHECK_SUSPENDED | POOL_CHECK_READONLY,
 	    B_TRUE, B_TRUE);
 
+	zfs_ioctl_register("prefetch", ZFS_IOC_PREFETCH,
+	    zfs_ioc_prefetch, zfs_secpolicy_prefetch,
+	    DATASET_NAME, POOL_CHECK_SUSPENDED, B_FALSE, B_TRUE);
+
 	/* IOCTLS that use the legacy function signature */
 
 	zfs_ioctl_register_legacy(ZFS_IOC_POOL_FREEZE, zfs_ioc_pool_freeze,
@@ -5824,6 +6117,10 @@ zfs_ioctl_init(void)
 							zfs_secpolicy_config, B_TRUE, POOL_CHECK_NONE);
 	zfs_ioctl_register_pool_modify(ZFS_IOC_POOL_SCAN,
 								   zfs_ioc_pool_scan);
+	zfs_ioctl_register_pool_modify(ZFS_IOC_POOL_TRIM,
+								   zfs_ioc_pool_trim);
+	zfs_ioctl_register_pool_modify(ZFS_IOC_POOL_DDT_PRUNE,
+								   zfs_ioc_pool_ddt_prune);
 	zfs_ioctl_register_pool_modify(ZFS_IOC_POOL_UPGRADE,
 								   zfs_ioc_pool_upgrade);
 	zfs_ioctl_register_pool_modify(ZFS_IOC_VDEV_ADD,
@@ -6617,6 +6914,7 @@ zfs_ioctl_osx_init(void)
 #endif
 
 	zfs_ioctl_init();
+	zfs_prefetch_init();
 
 #ifdef illumos
 	if ((error = mod_install(&modlinkage)) != 0) {
@@ -6658,6 +6956,7 @@ zfs_ioctl_osx_init(void)
 out:
 	zfs_fini();
 	spa_fini();
+	zfs_prefetch_fini();
 	(void) zvol_fini();
 
 	printf("ZFS: Failed to Load ZFS Filesystem v%s-%s%s"
@@ -6694,6 +6993,7 @@ zfs_ioctl_osx_fini(void)
 	zfs_fini();
 #endif
 	spa_fini();
+	zfs_prefetch_fini();
 #ifdef illumos
 	if (zfs_nfsshare_inited)
 		(void) ddi_modclose(nfs_mod);
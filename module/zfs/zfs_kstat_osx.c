@@ -44,6 +44,8 @@
 #include <sys/spa.h>
 #include <sys/zap_impl.h>
 #include <sys/zil.h>
+#include <sys/vdev_raidz.h>
+#include <zfs_fletcher.h>
 
 /*
  * In Solaris the tunable are set via /etc/system. Until we have a load
@@ -77,6 +79,9 @@ osx_kstat_t osx_kstat = {
 	{ "zfs_arc_shrink_shift",		KSTAT_DATA_UINT64 },
 	{ "zfs_arc_p_min_shift",		KSTAT_DATA_UINT64 },
 	{ "zfs_arc_average_blocksize",	KSTAT_DATA_UINT64 },
+	{ "zfs_arc_hash_max_load",		KSTAT_DATA_UINT64 },
+	{ "zfs_arc_evict_threads",		KSTAT_DATA_UINT64 },
+	{ "zfs_arc_evict_lead_shift",		KSTAT_DATA_UINT64 },
 
 	{ "l2arc_write_max",			KSTAT_DATA_UINT64 },
 	{ "l2arc_write_boost",			KSTAT_DATA_UINT64 },
@@ -85,6 +90,8 @@ osx_kstat_t osx_kstat = {
 	{ "l2arc_max_block_size",		KSTAT_DATA_UINT64 },
 	{ "l2arc_feed_secs",			KSTAT_DATA_UINT64 },
 	{ "l2arc_feed_min_ms",			KSTAT_DATA_UINT64 },
+	{ "l2arc_write_max_scale",		KSTAT_DATA_UINT64 },
+	{ "l2arc_rabd_max",			KSTAT_DATA_UINT64 },
 
 	{ "max_active",					KSTAT_DATA_UINT64 },
 	{ "sync_read_min_active",		KSTAT_DATA_UINT64 },
@@ -97,6 +104,8 @@ osx_kstat_t osx_kstat = {
 	{ "async_write_max_active",		KSTAT_DATA_UINT64 },
 	{ "scrub_min_active",			KSTAT_DATA_UINT64 },
 	{ "scrub_max_active",			KSTAT_DATA_UINT64 },
+	{ "trim_min_active",			KSTAT_DATA_UINT64 },
+	{ "trim_max_active",			KSTAT_DATA_UINT64 },
 	{ "async_write_min_dirty_pct",	KSTAT_DATA_INT64  },
 	{ "async_write_max_dirty_pct",	KSTAT_DATA_INT64  },
 	{ "aggregation_limit",			KSTAT_DATA_INT64  },
@@ -116,6 +125,10 @@ osx_kstat_t osx_kstat = {
 	{"zfetch_max_streams",			KSTAT_DATA_INT64  },
 	{"zfetch_min_sec_reap",			KSTAT_DATA_INT64  },
 	{"zfetch_array_rd_sz",			KSTAT_DATA_INT64  },
+	{"zfetch_min_distance",			KSTAT_DATA_INT64  },
+	{"zfetch_max_distance",			KSTAT_DATA_INT64  },
+	{"zfetch_max_stride",			KSTAT_DATA_INT64  },
+	{"zfetch_stream_cold_bytes",		KSTAT_DATA_INT64  },
 	{"zfs_default_bs",				KSTAT_DATA_INT64  },
 	{"zfs_default_ibs",				KSTAT_DATA_INT64  },
 	{"metaslab_aliquot",			KSTAT_DATA_INT64  },
@@ -130,25 +143,38 @@ osx_kstat_t osx_kstat = {
 	{"zfs_scrub_limit",				KSTAT_DATA_INT64  },
 	{"zfs_no_scrub_io",				KSTAT_DATA_INT64  },
 	{"zfs_no_scrub_prefetch",		KSTAT_DATA_INT64  },
+	{"zfs_scan_prefetch_threads",	KSTAT_DATA_INT64  },
+	{"zfs_scan_prefetch_maxinflight",	KSTAT_DATA_INT64  },
+	{"zfs_scan_prefetch_mem_lim",	KSTAT_DATA_INT64  },
 	{"fzap_default_block_shift",	KSTAT_DATA_INT64  },
 	{"zfs_immediate_write_sz",		KSTAT_DATA_INT64  },
 	{"zfs_read_chunk_size",			KSTAT_DATA_INT64  },
 	{"zfs_nocacheflush",			KSTAT_DATA_INT64  },
+	{"zfs_commit_timeout_pct",		KSTAT_DATA_INT64  },
 	{"zil_replay_disable",			KSTAT_DATA_INT64  },
 	{"metaslab_gang_bang",			KSTAT_DATA_INT64  },
 	{"metaslab_df_alloc_threshold",	KSTAT_DATA_INT64  },
 	{"metaslab_df_free_pct",		KSTAT_DATA_INT64  },
+	{"zfs_trim_extent_bytes_max",	KSTAT_DATA_INT64  },
+	{"zfs_trim_extent_bytes_min",	KSTAT_DATA_INT64  },
+	{"zfs_trim_txg_batch",			KSTAT_DATA_INT64  },
 	{"zio_injection_enabled",		KSTAT_DATA_INT64  },
 	{"zvol_immediate_write_sz",		KSTAT_DATA_INT64  },
 
 	{ "l2arc_noprefetch",			KSTAT_DATA_INT64  },
 	{ "l2arc_feed_again",			KSTAT_DATA_INT64  },
 	{ "l2arc_norw",					KSTAT_DATA_INT64  },
+	{ "l2arc_rebuild_enabled",		KSTAT_DATA_INT64  },
+	{ "l2arc_feed_policy",			KSTAT_DATA_INT64  },
+	{ "l2arc_feed_threads",			KSTAT_DATA_INT64  },
 
 	{"zfs_top_maxinflight",			KSTAT_DATA_INT64  },
 	{"zfs_resilver_delay",			KSTAT_DATA_INT64  },
 	{"zfs_scrub_delay",				KSTAT_DATA_INT64  },
 	{"zfs_scan_idle",				KSTAT_DATA_INT64  },
+	{"zfs_scan_legacy",				KSTAT_DATA_INT64  },
+	{"zfs_scan_mem_lim_fact",		KSTAT_DATA_INT64  },
+	{"zfs_scan_checkpoint_intval",	KSTAT_DATA_INT64  },
 
 	{"zfs_recover",					KSTAT_DATA_INT64  },
 
@@ -164,6 +190,9 @@ osx_kstat_t osx_kstat = {
 	{"zfs_vdev_mirror_rotating_seek_offset",KSTAT_DATA_UINT64  },
 	{"zfs_vdev_mirror_non_rotating_inc",	KSTAT_DATA_UINT64  },
 	{"zfs_vdev_mirror_non_rotating_seek_inc",KSTAT_DATA_UINT64  },
+	{"zfs_vdev_mirror_latency_aware",	KSTAT_DATA_UINT64  },
+	{"zfs_vdev_mirror_latency_tolerance",	KSTAT_DATA_UINT64  },
+	{"zfs_vdev_mirror_latency_stale_ms",	KSTAT_DATA_UINT64  },
 
 	{"zvol_inhibit_dev",KSTAT_DATA_UINT64  },
 	{"zfs_send_set_freerecords_bit",KSTAT_DATA_UINT64  },
@@ -172,11 +201,30 @@ osx_kstat_t osx_kstat = {
 	{"zfs_send_holes_without_birth_time",KSTAT_DATA_UINT64  },
 
 	{"dbuf_cache_max_bytes",KSTAT_DATA_UINT64  },
+	{"dbuf_evict_threads",KSTAT_DATA_INT64  },
 
 	{"zfs_vdev_queue_depth_pct",KSTAT_DATA_UINT64  },
 	{"zio_dva_throttle_enabled",KSTAT_DATA_UINT64  },
 
 	{"zfs_vdev_file_size_mismatch_cnt",KSTAT_DATA_UINT64  },
+
+	{"zfs_ddt_data_is_special",		KSTAT_DATA_INT64  },
+	{"zfs_user_indirect_is_special",	KSTAT_DATA_INT64  },
+	{"zfs_special_class_metadata_reserve_pct",	KSTAT_DATA_INT64  },
+
+	{"zfs_min_metaslabs_to_flush",		KSTAT_DATA_INT64  },
+	{"zfs_unflushed_max_mem_amt",		KSTAT_DATA_UINT64  },
+	{"zfs_unflushed_log_txg_max",		KSTAT_DATA_UINT64  },
+
+	{"zfs_dedup_log_enabled",		KSTAT_DATA_INT64  },
+	{"zfs_dedup_log_txg_max",		KSTAT_DATA_UINT64  },
+	{"zfs_dedup_log_flush_entries_min",	KSTAT_DATA_UINT64  },
+	{"zfs_dedup_log_mem_max",		KSTAT_DATA_UINT64  },
+	{"zfs_dedup_prune_batch",		KSTAT_DATA_INT64  },
+	{"zfs_dedup_prune_target_pct",		KSTAT_DATA_INT64  },
+
+	{"zfs_vdev_raidz_impl",		KSTAT_DATA_STRING  },
+	{"zfs_fletcher_4_impl",		KSTAT_DATA_STRING  },
 };
 
 
@@ -184,6 +232,9 @@ osx_kstat_t osx_kstat = {
 
 static kstat_t		*osx_kstat_ksp;
 
+static char		vdev_raidz_impl_str[128];
+static char		fletcher_4_impl_str[128];
+
 #if !defined (__OPTIMIZE__)
 #pragma GCC diagnostic ignored "-Wframe-larger-than="
 #endif
@@ -217,10 +268,15 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 		l2arc_max_block_size = ks->l2arc_max_block_size.value.ui64;
 		l2arc_feed_secs = ks->l2arc_feed_secs.value.ui64;
 		l2arc_feed_min_ms = ks->l2arc_feed_min_ms.value.ui64;
+		l2arc_write_max_scale = ks->l2arc_write_max_scale.value.ui64;
+		l2arc_rabd_max = ks->l2arc_rabd_max.value.ui64;
 
 		l2arc_noprefetch = ks->l2arc_noprefetch.value.i64;
 		l2arc_feed_again = ks->l2arc_feed_again.value.i64;
 		l2arc_norw = ks->l2arc_norw.value.i64;
+		l2arc_rebuild_enabled = ks->l2arc_rebuild_enabled.value.i64;
+		l2arc_feed_policy = ks->l2arc_feed_policy.value.i64;
+		l2arc_feed_threads = ks->l2arc_feed_threads.value.i64;
 
 		/* vdev_queue */
 
@@ -246,6 +302,10 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 			ks->zfs_vdev_scrub_min_active.value.ui64;
 		zfs_vdev_scrub_max_active =
 			ks->zfs_vdev_scrub_max_active.value.ui64;
+		zfs_vdev_trim_min_active =
+			ks->zfs_vdev_trim_min_active.value.ui64;
+		zfs_vdev_trim_max_active =
+			ks->zfs_vdev_trim_max_active.value.ui64;
 		zfs_vdev_async_write_active_min_dirty_percent =
 			ks->zfs_vdev_async_write_active_min_dirty_percent.value.i64;
 		zfs_vdev_async_write_active_max_dirty_percent =
@@ -283,6 +343,14 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 			ks->zfetch_min_sec_reap.value.i64;
 		zfetch_array_rd_sz =
 			ks->zfetch_array_rd_sz.value.i64;
+		zfetch_min_distance =
+			ks->zfetch_min_distance.value.i64;
+		zfetch_max_distance =
+			ks->zfetch_max_distance.value.i64;
+		zfetch_max_stride =
+			ks->zfetch_max_stride.value.i64;
+		zfetch_stream_cold_bytes =
+			ks->zfetch_stream_cold_bytes.value.i64;
 		zfs_default_bs =
 			ks->zfs_default_bs.value.i64;
 		zfs_default_ibs =
@@ -305,6 +373,12 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 			ks->zfs_no_scrub_io.value.i64;
 		zfs_no_scrub_prefetch =
 			ks->zfs_no_scrub_prefetch.value.i64;
+		zfs_scan_prefetch_threads =
+			ks->zfs_scan_prefetch_threads.value.i64;
+		zfs_scan_prefetch_maxinflight =
+			ks->zfs_scan_prefetch_maxinflight.value.i64;
+		zfs_scan_prefetch_mem_lim =
+			ks->zfs_scan_prefetch_mem_lim.value.i64;
 		fzap_default_block_shift =
 			ks->fzap_default_block_shift.value.i64;
 		zfs_immediate_write_sz =
@@ -313,6 +387,8 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 			ks->zfs_read_chunk_size.value.i64;
 		zfs_nocacheflush =
 			ks->zfs_nocacheflush.value.i64;
+		zfs_commit_timeout_pct =
+			ks->zfs_commit_timeout_pct.value.i64;
 		zil_replay_disable =
 			ks->zil_replay_disable.value.i64;
 		metaslab_gang_bang =
@@ -321,6 +397,12 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 			ks->metaslab_df_alloc_threshold.value.i64;
 		metaslab_df_free_pct =
 			ks->metaslab_df_free_pct.value.i64;
+		zfs_trim_extent_bytes_max =
+			ks->zfs_trim_extent_bytes_max.value.i64;
+		zfs_trim_extent_bytes_min =
+			ks->zfs_trim_extent_bytes_min.value.i64;
+		zfs_trim_txg_batch =
+			ks->zfs_trim_txg_batch.value.i64;
 		zio_injection_enabled =
 			ks->zio_injection_enabled.value.i64;
 		zvol_immediate_write_sz =
@@ -334,6 +416,12 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 			ks->zfs_scrub_delay.value.i64;
 		zfs_scan_idle =
 			ks->zfs_scan_idle.value.i64;
+		zfs_scan_legacy =
+			ks->zfs_scan_legacy.value.i64;
+		zfs_scan_mem_lim_fact =
+			ks->zfs_scan_mem_lim_fact.value.i64;
+		zfs_scan_checkpoint_intval =
+			ks->zfs_scan_checkpoint_intval.value.i64;
 		zfs_recover =
 			ks->zfs_recover.value.i64;
 
@@ -359,6 +447,12 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 			ks->zfs_vdev_mirror_non_rotating_inc.value.ui64;
 		zfs_vdev_mirror_non_rotating_seek_inc =
 			ks->zfs_vdev_mirror_non_rotating_seek_inc.value.ui64;
+		zfs_vdev_mirror_latency_aware =
+			ks->zfs_vdev_mirror_latency_aware.value.ui64;
+		zfs_vdev_mirror_latency_tolerance =
+			ks->zfs_vdev_mirror_latency_tolerance.value.ui64;
+		zfs_vdev_mirror_latency_stale_ms =
+			ks->zfs_vdev_mirror_latency_stale_ms.value.ui64;
 
 		zvol_inhibit_dev =
 			ks->zvol_inhibit_dev.value.ui64;
@@ -372,12 +466,48 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 
 		dbuf_cache_max_bytes =
 		    ks->dbuf_cache_max_bytes.value.ui64;
+		dbuf_evict_threads = ks->dbuf_evict_threads.value.i64;
 
 		zfs_vdev_queue_depth_pct =
 		    ks->zfs_vdev_queue_depth_pct.value.ui64;
 
 		zio_dva_throttle_enabled =
 		    (boolean_t) ks->zio_dva_throttle_enabled.value.ui64;
+
+		zfs_ddt_data_is_special =
+		    ks->zfs_ddt_data_is_special.value.i64;
+		zfs_user_indirect_is_special =
+		    ks->zfs_user_indirect_is_special.value.i64;
+		zfs_special_class_metadata_reserve_pct =
+		    ks->zfs_special_class_metadata_reserve_pct.value.i64;
+
+		zfs_min_metaslabs_to_flush =
+		    ks->zfs_min_metaslabs_to_flush.value.i64;
+		zfs_unflushed_max_mem_amt =
+		    ks->zfs_unflushed_max_mem_amt.value.ui64;
+		zfs_unflushed_log_txg_max =
+		    ks->zfs_unflushed_log_txg_max.value.ui64;
+
+		zfs_dedup_log_enabled =
+		    ks->zfs_dedup_log_enabled.value.i64;
+		zfs_dedup_log_txg_max =
+		    ks->zfs_dedup_log_txg_max.value.ui64;
+		zfs_dedup_log_flush_entries_min =
+		    ks->zfs_dedup_log_flush_entries_min.value.ui64;
+		zfs_dedup_log_mem_max =
+		    ks->zfs_dedup_log_mem_max.value.ui64;
+		zfs_dedup_prune_batch =
+		    ks->zfs_dedup_prune_batch.value.i64;
+		zfs_dedup_prune_target_pct =
+		    ks->zfs_dedup_prune_target_pct.value.i64;
+
+		if (KSTAT_NAMED_STR_PTR(&ks->zfs_vdev_raidz_impl) != NULL)
+			(void) vdev_raidz_impl_set(
+			    KSTAT_NAMED_STR_PTR(&ks->zfs_vdev_raidz_impl));
+
+		if (KSTAT_NAMED_STR_PTR(&ks->zfs_fletcher_4_impl) != NULL)
+			(void) fletcher_4_impl_set(
+			    KSTAT_NAMED_STR_PTR(&ks->zfs_fletcher_4_impl));
 	} else {
 
 		/* kstat READ */
@@ -406,10 +536,15 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 		ks->l2arc_max_block_size.value.ui64          = l2arc_max_block_size;
 		ks->l2arc_feed_secs.value.ui64               = l2arc_feed_secs;
 		ks->l2arc_feed_min_ms.value.ui64             = l2arc_feed_min_ms;
+		ks->l2arc_write_max_scale.value.ui64         = l2arc_write_max_scale;
+		ks->l2arc_rabd_max.value.ui64                = l2arc_rabd_max;
 
 		ks->l2arc_noprefetch.value.i64               = l2arc_noprefetch;
 		ks->l2arc_feed_again.value.i64               = l2arc_feed_again;
 		ks->l2arc_norw.value.i64                     = l2arc_norw;
+		ks->l2arc_rebuild_enabled.value.i64          = l2arc_rebuild_enabled;
+		ks->l2arc_feed_policy.value.i64              = l2arc_feed_policy;
+		ks->l2arc_feed_threads.value.i64             = l2arc_feed_threads;
 
 		/* vdev_queue */
 		ks->zfs_vdev_max_active.value.ui64 =
@@ -434,6 +569,10 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 			zfs_vdev_scrub_min_active ;
 		ks->zfs_vdev_scrub_max_active.value.ui64 =
 			zfs_vdev_scrub_max_active ;
+		ks->zfs_vdev_trim_min_active.value.ui64 =
+			zfs_vdev_trim_min_active ;
+		ks->zfs_vdev_trim_max_active.value.ui64 =
+			zfs_vdev_trim_max_active ;
 		ks->zfs_vdev_async_write_active_min_dirty_percent.value.i64 =
 			zfs_vdev_async_write_active_min_dirty_percent ;
 		ks->zfs_vdev_async_write_active_max_dirty_percent.value.i64 =
@@ -471,6 +610,14 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 			zfetch_min_sec_reap;
 		ks->zfetch_array_rd_sz.value.i64 =
 			zfetch_array_rd_sz;
+		ks->zfetch_min_distance.value.i64 =
+			zfetch_min_distance;
+		ks->zfetch_max_distance.value.i64 =
+			zfetch_max_distance;
+		ks->zfetch_max_stride.value.i64 =
+			zfetch_max_stride;
+		ks->zfetch_stream_cold_bytes.value.i64 =
+			zfetch_stream_cold_bytes;
 		ks->zfs_default_bs.value.i64 =
 			zfs_default_bs;
 		ks->zfs_default_ibs.value.i64 =
@@ -493,6 +640,12 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 			zfs_no_scrub_io;
 		ks->zfs_no_scrub_prefetch.value.i64 =
 			zfs_no_scrub_prefetch;
+		ks->zfs_scan_prefetch_threads.value.i64 =
+			zfs_scan_prefetch_threads;
+		ks->zfs_scan_prefetch_maxinflight.value.i64 =
+			zfs_scan_prefetch_maxinflight;
+		ks->zfs_scan_prefetch_mem_lim.value.i64 =
+			zfs_scan_prefetch_mem_lim;
 		ks->fzap_default_block_shift.value.i64 =
 			fzap_default_block_shift;
 		ks->zfs_immediate_write_sz.value.i64 =
@@ -501,6 +654,8 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 			zfs_read_chunk_size;
 		ks->zfs_nocacheflush.value.i64 =
 			zfs_nocacheflush;
+		ks->zfs_commit_timeout_pct.value.i64 =
+			zfs_commit_timeout_pct;
 		ks->zil_replay_disable.value.i64 =
 			zil_replay_disable;
 		ks->metaslab_gang_bang.value.i64 =
@@ -509,6 +664,12 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 			metaslab_df_alloc_threshold;
 		ks->metaslab_df_free_pct.value.i64 =
 			metaslab_df_free_pct;
+		ks->zfs_trim_extent_bytes_max.value.i64 =
+			zfs_trim_extent_bytes_max;
+		ks->zfs_trim_extent_bytes_min.value.i64 =
+			zfs_trim_extent_bytes_min;
+		ks->zfs_trim_txg_batch.value.i64 =
+			zfs_trim_txg_batch;
 		ks->zio_injection_enabled.value.i64 =
 			zio_injection_enabled;
 		ks->zvol_immediate_write_sz.value.i64 =
@@ -522,6 +683,12 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 			zfs_scrub_delay;
 		ks->zfs_scan_idle.value.i64 =
 			zfs_scan_idle;
+		ks->zfs_scan_legacy.value.i64 =
+			zfs_scan_legacy;
+		ks->zfs_scan_mem_lim_fact.value.i64 =
+			zfs_scan_mem_lim_fact;
+		ks->zfs_scan_checkpoint_intval.value.i64 =
+			zfs_scan_checkpoint_intval;
 
 		ks->zfs_recover.value.i64 =
 			zfs_recover;
@@ -548,6 +715,12 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 			zfs_vdev_mirror_non_rotating_inc;
 		ks->zfs_vdev_mirror_non_rotating_seek_inc.value.ui64 =
 			zfs_vdev_mirror_non_rotating_seek_inc;
+		ks->zfs_vdev_mirror_latency_aware.value.ui64 =
+			zfs_vdev_mirror_latency_aware;
+		ks->zfs_vdev_mirror_latency_tolerance.value.ui64 =
+			zfs_vdev_mirror_latency_tolerance;
+		ks->zfs_vdev_mirror_latency_stale_ms.value.ui64 =
+			zfs_vdev_mirror_latency_stale_ms;
 
 		ks->zvol_inhibit_dev.value.ui64 =
 			zvol_inhibit_dev;
@@ -560,11 +733,49 @@ static int osx_kstat_update(kstat_t *ksp, int rw)
 			send_holes_without_birth_time;
 
 		ks->dbuf_cache_max_bytes.value.ui64 = dbuf_cache_max_bytes;
+		ks->dbuf_evict_threads.value.i64 = dbuf_evict_threads;
 
 		ks->zfs_vdev_queue_depth_pct.value.ui64 = zfs_vdev_queue_depth_pct;
 		ks->zio_dva_throttle_enabled.value.ui64 = (uint64_t) zio_dva_throttle_enabled;
 
 		ks->zfs_vdev_file_size_mismatch_cnt.value.ui64 = zfs_vdev_file_size_mismatch_cnt;
+
+		ks->zfs_ddt_data_is_special.value.i64 =
+		    zfs_ddt_data_is_special;
+		ks->zfs_user_indirect_is_special.value.i64 =
+		    zfs_user_indirect_is_special;
+		ks->zfs_special_class_metadata_reserve_pct.value.i64 =
+		    zfs_special_class_metadata_reserve_pct;
+
+		ks->zfs_min_metaslabs_to_flush.value.i64 =
+		    zfs_min_metaslabs_to_flush;
+		ks->zfs_unflushed_max_mem_amt.value.ui64 =
+		    zfs_unflushed_max_mem_amt;
+		ks->zfs_unflushed_log_txg_max.value.ui64 =
+		    zfs_unflushed_log_txg_max;
+
+		ks->zfs_dedup_log_enabled.value.i64 =
+		    zfs_dedup_log_enabled;
+		ks->zfs_dedup_log_txg_max.value.ui64 =
+		    zfs_dedup_log_txg_max;
+		ks->zfs_dedup_log_flush_entries_min.value.ui64 =
+		    zfs_dedup_log_flush_entries_min;
+		ks->zfs_dedup_log_mem_max.value.ui64 =
+		    zfs_dedup_log_mem_max;
+		ks->zfs_dedup_prune_batch.value.i64 =
+		    zfs_dedup_prune_batch;
+		ks->zfs_dedup_prune_target_pct.value.i64 =
+		    zfs_dedup_prune_target_pct;
+
+		vdev_raidz_impl_get(vdev_raidz_impl_str,
+		    sizeof (vdev_raidz_impl_str));
+		kstat_named_setstr(&ks->zfs_vdev_raidz_impl,
+		    vdev_raidz_impl_str);
+
+		fletcher_4_impl_get(fletcher_4_impl_str,
+		    sizeof (fletcher_4_impl_str));
+		kstat_named_setstr(&ks->zfs_fletcher_4_impl,
+		    fletcher_4_impl_str);
 	}
 
 	return 0;
@@ -930,4 +930,5 @@ zil_replay_func_t zfs_replay_vector[TX_MAX_TYPE] = {
 	(zil_replay_func_t)zfs_replay_create,		/* TX_MKDIR_ATTR */
 	(zil_replay_func_t)zfs_replay_create_acl,	/* TX_MKDIR_ACL_ATTR */
 	(zil_replay_func_t)zfs_replay_write2,		/* TX_WRITE2 */
+	(zil_replay_func_t)zfs_replay_error,		/* TX_COMMIT */
 };
@@ -47,6 +47,7 @@
 #include <sys/time.h>
 #include <sys/abd.h>
 #include <sys/dsl_crypt.h>
+#include <sys/dsl_scan.h>
 
 /*
  * ==========================================================================
@@ -54,7 +55,7 @@
  * ==========================================================================
  */
 const char *zio_type_name[ZIO_TYPES] = {
-	"z_null", "z_rd", "z_wr", "z_fr", "z_cl", "z_ioctl"
+	"z_null", "z_rd", "z_wr", "z_fr", "z_cl", "z_ioctl", "z_trim"
 };
 
 boolean_t zio_dva_throttle_enabled = B_TRUE;
@@ -211,6 +212,7 @@ zio_init(void)
 	zio_inject_init();
 
 	lz4_init();
+	zstd_init();
 
 }
 
@@ -248,6 +250,7 @@ zio_fini(void)
 
 	zio_inject_fini();
 
+	zstd_fini();
 	lz4_fini();
 
 #ifdef __APPLE__
@@ -751,7 +754,7 @@ zio_create(zio_t *pio, spa_t *spa, uint64_t txg, const blkptr_t *bp,
 {
 	zio_t *zio;
 
-	ASSERT3U(psize, <=, SPA_MAXBLOCKSIZE);
+	IMPLY(type != ZIO_TYPE_TRIM, psize <= SPA_MAXBLOCKSIZE);
 	ASSERT(P2PHASE(psize, SPA_MINBLOCKSIZE) == 0);
 	ASSERT(P2PHASE(offset, SPA_MINBLOCKSIZE) == 0);
 
@@ -1085,6 +1088,7 @@ zio_free_sync(zio_t *pio, spa_t *spa, uint64_t txg, const blkptr_t *bp,
 
 	metaslab_check_free(spa, bp);
 	arc_freed(spa, bp);
+	dsl_scan_freed(spa, bp);
 
 	/*
 	 * GANG and DEDUP blocks can induce a read (for the gang block header,
@@ -1160,6 +1164,28 @@ zio_ioctl(zio_t *pio, spa_t *spa, vdev_t *vd, int cmd,
 	return (zio);
 }
 
+/*
+ * Tell the devices under top-level vdev 'vd' that the given range of its
+ * allocatable space no longer holds any data.  The range is translated
+ * to the leaf vdevs by the mirror and RAID-Z io_start routines, exactly
+ * like a write, and the leaves discard it if they support doing so.
+ * A TRIM is only ever advisory, so its errors are never propagated.
+ */
+zio_t *
+zio_trim(zio_t *pio, spa_t *spa, vdev_t *vd, uint64_t offset, uint64_t size,
+    enum zio_flag flags)
+{
+	ASSERT3P(vd, ==, vd->vdev_top);
+	ASSERT0(P2PHASE(offset, 1ULL << vd->vdev_ashift));
+	ASSERT0(P2PHASE(size, 1ULL << vd->vdev_ashift));
+	ASSERT3U(size, !=, 0);
+
+	return (zio_create(pio, spa, 0, NULL, NULL, size, size, NULL, NULL,
+	    ZIO_TYPE_TRIM, ZIO_PRIORITY_TRIM, flags | ZIO_FLAG_CANFAIL |
+	    ZIO_FLAG_DONT_RETRY | ZIO_FLAG_DONT_PROPAGATE, vd, offset, NULL,
+	    ZIO_STAGE_OPEN, ZIO_TRIM_PIPELINE));
+}
+
 zio_t *
 zio_read_phys(zio_t *pio, vdev_t *vd, uint64_t offset, uint64_t size,
     abd_t *data, int checksum, zio_done_func_t *done, void *private,
@@ -1260,9 +1286,8 @@ zio_vdev_child_io(zio_t *pio, blkptr_t *bp, vdev_t *vd, uint64_t offset,
 	 */
 	if (flags & ZIO_FLAG_IO_ALLOCATING &&
 	    (vd != vd->vdev_top || (flags & ZIO_FLAG_IO_RETRY))) {
-		ASSERTV(metaslab_class_t *mc = spa_normal_class(pio->io_spa));
-
-		ASSERT(mc->mc_alloc_throttle_enabled);
+		ASSERT(pio->io_metaslab_class != NULL);
+		ASSERT(pio->io_metaslab_class->mc_alloc_throttle_enabled);
 		ASSERT(type == ZIO_TYPE_WRITE);
 		ASSERT(priority == ZIO_PRIORITY_ASYNC_WRITE);
 		ASSERT(!(flags & ZIO_FLAG_IO_REPAIR));
@@ -2521,6 +2546,7 @@ zio_write_gang_block(zio_t *pio)
 		zp.zp_type = DMU_OT_NONE;
 		zp.zp_level = 0;
 		zp.zp_copies = gio->io_prop.zp_copies;
+		zp.zp_zpl_smallblk = 0;
 		zp.zp_dedup = B_FALSE;
 		zp.zp_dedup_verify = B_FALSE;
 		zp.zp_nopwrite = B_FALSE;
@@ -2548,6 +2574,9 @@ zio_write_gang_block(zio_t *pio)
 			VERIFY(metaslab_class_throttle_reserve(mc,
 			    zp.zp_copies, cio, flags));
 		}
+
+		/* gang members stay in the class of their header */
+		cio->io_metaslab_class = mc;
 		zio_nowait(cio);
 	}
 
@@ -2780,7 +2809,7 @@ zio_ddt_collision(zio_t *zio, ddt_t *ddt, ddt_entry_t *dde)
 
 			ddt_bp_fill(ddp, &blk, ddp->ddp_phys_birth);
 
-			ddt_exit(ddt);
+			ddt_exit(ddt, &dde->dde_key.ddk_cksum);
 
 			/*
 			 * Intuitively, it would make more sense to compare
@@ -2811,7 +2840,7 @@ zio_ddt_collision(zio_t *zio, ddt_t *ddt, ddt_entry_t *dde)
 				arc_buf_destroy(abuf, &abuf);
 			}
 
-			ddt_enter(ddt);
+			ddt_enter(ddt, &dde->dde_key.ddk_cksum);
 			return (error != 0);
 		}
 	}
@@ -2831,7 +2860,7 @@ zio_ddt_child_write_ready(zio_t *zio)
 	if (zio->io_error)
 		return;
 
-	ddt_enter(ddt);
+	ddt_enter(ddt, &dde->dde_key.ddk_cksum);
 
 	ASSERT(dde->dde_lead_zio[p] == zio);
 
@@ -2841,7 +2870,7 @@ zio_ddt_child_write_ready(zio_t *zio)
 	while ((pio = zio_walk_parents(zio, &zl)) != NULL)
 		ddt_bp_fill(ddp, pio->io_bp, zio->io_txg);
 
-	ddt_exit(ddt);
+	ddt_exit(ddt, &dde->dde_key.ddk_cksum);
 }
 
 static void
@@ -2852,7 +2881,7 @@ zio_ddt_child_write_done(zio_t *zio)
 	ddt_entry_t *dde = zio->io_private;
 	ddt_phys_t *ddp = &dde->dde_phys[p];
 
-	ddt_enter(ddt);
+	ddt_enter(ddt, &dde->dde_key.ddk_cksum);
 
 	ASSERT(ddp->ddp_refcnt == 0);
 	ASSERT(dde->dde_lead_zio[p] == zio);
@@ -2866,7 +2895,7 @@ zio_ddt_child_write_done(zio_t *zio)
 		ddt_phys_clear(ddp);
 	}
 
-	ddt_exit(ddt);
+	ddt_exit(ddt, &dde->dde_key.ddk_cksum);
 }
 
 static void
@@ -2880,7 +2909,7 @@ zio_ddt_ditto_write_done(zio_t *zio)
 	ddt_key_t *ddk = &dde->dde_key;
 	ASSERTV(zio_prop_t *zp = &zio->io_prop);
 
-	ddt_enter(ddt);
+	ddt_enter(ddt, &dde->dde_key.ddk_cksum);
 
 	ASSERT(ddp->ddp_refcnt == 0);
 	ASSERT(dde->dde_lead_zio[p] == zio);
@@ -2895,7 +2924,24 @@ zio_ddt_ditto_write_done(zio_t *zio)
 		ddt_phys_fill(ddp, bp);
 	}
 
-	ddt_exit(ddt);
+	ddt_exit(ddt, &dde->dde_key.ddk_cksum);
+}
+
+/*
+ * Is dde a new entry that no write has claimed yet?
+ */
+static boolean_t
+zio_ddt_entry_unused(ddt_entry_t *dde)
+{
+	int p;
+
+	for (p = 0; p < DDT_PHYS_TYPES; p++) {
+		if (dde->dde_phys[p].ddp_phys_birth != 0 ||
+		    dde->dde_lead_zio[p] != NULL)
+			return (B_FALSE);
+	}
+
+	return (B_TRUE);
 }
 
 static int
@@ -2918,10 +2964,24 @@ zio_ddt_write(zio_t *zio)
 	ASSERT(BP_IS_HOLE(bp) || zio->io_bp_override);
 	ASSERT(!(zio->io_bp_override && (zio->io_flags & ZIO_FLAG_RAW)));
 
-	ddt_enter(ddt);
+	ddt_enter(ddt, &bp->blk_cksum);
 	dde = ddt_lookup(ddt, bp, B_TRUE);
 	ddp = &dde->dde_phys[p];
 
+	/*
+	 * If the DDT is at its "dedupmaxentries" limit, a block that isn't
+	 * in it already is written as an ordinary block.
+	 */
+	if (spa->spa_dedup_full && zio->io_bp_override == NULL &&
+	    dde->dde_type == DDT_TYPES && zio_ddt_entry_unused(dde)) {
+		atomic_inc_64(&spa->spa_dedup_bypassed);
+		zp->zp_dedup = B_FALSE;
+		BP_SET_DEDUP(bp, B_FALSE);
+		zio->io_pipeline = ZIO_WRITE_PIPELINE;
+		ddt_exit(ddt, &dde->dde_key.ddk_cksum);
+		return (ZIO_PIPELINE_CONTINUE);
+	}
+
 	if (zp->zp_dedup_verify && zio_ddt_collision(zio, ddt, dde)) {
 		/*
 		 * If we're using a weak checksum, upgrade to a strong checksum
@@ -2941,7 +3001,7 @@ zio_ddt_write(zio_t *zio)
 		}
 		ASSERT(!BP_GET_DEDUP(bp));
 		zio->io_pipeline = ZIO_WRITE_PIPELINE;
-		ddt_exit(ddt);
+		ddt_exit(ddt, &dde->dde_key.ddk_cksum);
 		return (ZIO_PIPELINE_CONTINUE);
 	}
 
@@ -2967,7 +3027,7 @@ zio_ddt_write(zio_t *zio)
 			zio->io_pipeline = ZIO_WRITE_PIPELINE;
 			zio->io_bp_override = NULL;
 			BP_ZERO(bp);
-			ddt_exit(ddt);
+			ddt_exit(ddt, &dde->dde_key.ddk_cksum);
 			return (ZIO_PIPELINE_CONTINUE);
 		}
 
@@ -3003,7 +3063,7 @@ zio_ddt_write(zio_t *zio)
 		dde->dde_lead_zio[p] = cio;
 	}
 
-	ddt_exit(ddt);
+	ddt_exit(ddt, &dde->dde_key.ddk_cksum);
 
 	if (cio)
 		zio_nowait(cio);
@@ -3027,14 +3087,21 @@ zio_ddt_free(zio_t *zio)
 	ASSERT(BP_GET_DEDUP(bp));
 	ASSERT(zio->io_child_type == ZIO_CHILD_LOGICAL);
 
-	ddt_enter(ddt);
+	ddt_enter(ddt, &bp->blk_cksum);
 	freedde = dde = ddt_lookup(ddt, bp, B_TRUE);
-	if (dde) {
-		ddp = ddt_phys_select(dde, bp);
-		if (ddp)
-			ddt_phys_decref(ddp);
+	ddp = ddt_phys_select(dde, bp);
+	if (ddp != NULL) {
+		ddt_phys_decref(ddp);
+	} else {
+		/*
+		 * The entry was pruned (see ddt_prune.c), so this is now
+		 * an ordinary block: free it directly.
+		 */
+		zio->io_pipeline |= ZIO_STAGE_DVA_FREE;
+		if (BP_IS_GANG(bp))
+			zio->io_pipeline |= ZIO_GANG_STAGES;
 	}
-	ddt_exit(ddt);
+	ddt_exit(ddt, &bp->blk_cksum);
 
 	return (ZIO_PIPELINE_CONTINUE);
 }
@@ -3062,7 +3129,7 @@ zio_io_to_allocate(spa_t *spa)
 	 * Try to place a reservation for this zio. If we're unable to
 	 * reserve then we throttle.
 	 */
-	if (!metaslab_class_throttle_reserve(spa_normal_class(spa),
+	if (!metaslab_class_throttle_reserve(zio->io_metaslab_class,
 	    zio->io_prop.zp_copies, zio, 0)) {
 		return (NULL);
 	}
@@ -3078,9 +3145,14 @@ zio_dva_throttle(zio_t *zio)
 {
 	spa_t *spa = zio->io_spa;
 	zio_t *nio;
+	metaslab_class_t *mc;
+
+	/* locate an appropriate allocation class */
+	mc = spa_preferential_class(spa, zio->io_size, zio->io_prop.zp_type,
+	    zio->io_prop.zp_level, zio->io_prop.zp_zpl_smallblk);
 
 	if (zio->io_priority == ZIO_PRIORITY_SYNC_WRITE ||
-	    !spa_normal_class(zio->io_spa)->mc_alloc_throttle_enabled ||
+	    !mc->mc_alloc_throttle_enabled ||
 	    zio->io_child_type == ZIO_CHILD_GANG ||
 	    zio->io_flags & ZIO_FLAG_NODATA) {
 		return (ZIO_PIPELINE_CONTINUE);
@@ -3091,6 +3163,7 @@ zio_dva_throttle(zio_t *zio)
 	ASSERT3U(zio->io_queued_timestamp, >, 0);
 	ASSERT(zio->io_stage == ZIO_STAGE_DVA_THROTTLE);
 
+	zio->io_metaslab_class = mc;
 	mutex_enter(&spa->spa_alloc_lock);
 
 	ASSERT(zio->io_type == ZIO_TYPE_WRITE);
@@ -3137,7 +3210,7 @@ static int
 zio_dva_allocate(zio_t *zio)
 {
 	spa_t *spa = zio->io_spa;
-	metaslab_class_t *mc = spa_normal_class(spa);
+	metaslab_class_t *mc;
 	blkptr_t *bp = zio->io_bp;
 	int error;
 	int flags = 0;
@@ -3166,10 +3239,47 @@ zio_dva_allocate(zio_t *zio)
 		flags |= METASLAB_FASTWRITE;
 	}
 
+	/*
+	 * If the throttle did not already pick one, locate an appropriate
+	 * allocation class.
+	 */
+	mc = zio->io_metaslab_class;
+	if (mc == NULL) {
+		mc = spa_preferential_class(spa, zio->io_size,
+		    zio->io_prop.zp_type, zio->io_prop.zp_level,
+		    zio->io_prop.zp_zpl_smallblk);
+		zio->io_metaslab_class = mc;
+	}
+
 	error = metaslab_alloc(spa, mc, zio->io_size, bp,
 	    zio->io_prop.zp_copies, zio->io_txg, NULL, flags,
 	    &zio->io_alloc_list, zio);
 
+	/*
+	 * Spill over to the normal class when a special or dedup class is
+	 * full.  A throttle reservation moves along with the allocation.
+	 */
+	if (error == ENOSPC && mc != spa_normal_class(spa)) {
+		if (mc->mc_alloc_throttle_enabled &&
+		    (zio->io_flags & ZIO_FLAG_IO_ALLOCATING)) {
+			metaslab_class_throttle_unreserve(mc,
+			    zio->io_prop.zp_copies, zio);
+			zio->io_flags &= ~ZIO_FLAG_IO_ALLOCATING;
+
+			mc = spa_normal_class(spa);
+			VERIFY(metaslab_class_throttle_reserve(mc,
+			    zio->io_prop.zp_copies, zio,
+			    flags | METASLAB_MUST_RESERVE));
+		} else {
+			mc = spa_normal_class(spa);
+		}
+		zio->io_metaslab_class = mc;
+
+		error = metaslab_alloc(spa, mc, zio->io_size, bp,
+		    zio->io_prop.zp_copies, zio->io_txg, NULL, flags,
+		    &zio->io_alloc_list, zio);
+	}
+
 	if (error != 0) {
 		spa_dbgmsg(spa, "%s: metaslab allocation failure: zio %p, "
 		    "size %llu, error %d", spa_name(spa), zio, zio->io_size,
@@ -3418,7 +3528,8 @@ zio_vdev_io_start(zio_t *zio)
 	}
 
 	if (vd->vdev_ops->vdev_op_leaf &&
-	    (zio->io_type == ZIO_TYPE_READ || zio->io_type == ZIO_TYPE_WRITE)) {
+	    (zio->io_type == ZIO_TYPE_READ || zio->io_type == ZIO_TYPE_WRITE ||
+	    zio->io_type == ZIO_TYPE_TRIM)) {
 
 		if (zio->io_type == ZIO_TYPE_READ && vdev_cache_read(zio))
 			return (ZIO_PIPELINE_CONTINUE);
@@ -3448,7 +3559,8 @@ zio_vdev_io_done(zio_t *zio)
 	if (zio_wait_for_children(zio, ZIO_CHILD_VDEV, ZIO_WAIT_DONE))
 		return (ZIO_PIPELINE_STOP);
 
-	ASSERT(zio->io_type == ZIO_TYPE_READ || zio->io_type == ZIO_TYPE_WRITE);
+	ASSERT(zio->io_type == ZIO_TYPE_READ ||
+	    zio->io_type == ZIO_TYPE_WRITE || zio->io_type == ZIO_TYPE_TRIM);
 
 	if (zio->io_delay)
 		zio->io_delay = gethrtime() - zio->io_delay;
@@ -3470,7 +3582,7 @@ zio_vdev_io_done(zio_t *zio)
 		if (zio->io_error) {
 			if (!vdev_accessible(vd, zio)) {
 				zio->io_error = SET_ERROR(ENXIO);
-			} else {
+			} else if (zio->io_type != ZIO_TYPE_TRIM) {
 				unexpected_error = B_TRUE;
 			}
 		}
@@ -3575,6 +3687,14 @@ zio_vdev_io_assess(zio_t *zio)
 	    zio->io_cmd == DKIOCFLUSHWRITECACHE && vd != NULL)
 		vd->vdev_nowritecache = B_TRUE;
 
+	/*
+	 * Likewise for a leaf that can't discard: stop sending it TRIMs.
+	 */
+	if ((zio->io_error == ENOTSUP || zio->io_error == ENOTTY) &&
+	    zio->io_type == ZIO_TYPE_TRIM && vd != NULL &&
+	    vd->vdev_ops->vdev_op_leaf)
+		vd->vdev_notrim = B_TRUE;
+
 	if (zio->io_error)
 		zio->io_pipeline = ZIO_INTERLOCK_PIPELINE;
 
@@ -3898,7 +4018,7 @@ zio_ready(zio_t *zio)
 			 * issue the next I/O to allocate.
 			 */
 			metaslab_class_throttle_unreserve(
-			    spa_normal_class(zio->io_spa),
+			    zio->io_metaslab_class,
 			    zio->io_prop.zp_copies, zio);
 			zio_allocate_dispatch(zio->io_spa);
 		}
@@ -3986,8 +4106,7 @@ zio_dva_throttle_done(zio_t *zio)
 	metaslab_group_alloc_decrement(zio->io_spa, vd->vdev_id, pio, flags);
 	mutex_exit(&pio->io_lock);
 
-	metaslab_class_throttle_unreserve(spa_normal_class(zio->io_spa),
-	    1, pio);
+	metaslab_class_throttle_unreserve(pio->io_metaslab_class, 1, pio);
 
 	/*
 	 * Call into the pipeline to see if there is more work that
@@ -4023,8 +4142,6 @@ zio_done(zio_t *zio)
 	 */
 	if (zio->io_flags & ZIO_FLAG_IO_ALLOCATING &&
 	    zio->io_child_type == ZIO_CHILD_VDEV) {
-		ASSERT(spa_normal_class(
-				zio->io_spa)->mc_alloc_throttle_enabled);
 		zio_dva_throttle_done(zio);
 	}
 
@@ -4037,8 +4154,9 @@ zio_done(zio_t *zio)
 		ASSERT(zio->io_priority == ZIO_PRIORITY_ASYNC_WRITE);
 		ASSERT(zio->io_bp != NULL);
 		metaslab_group_alloc_verify(zio->io_spa, zio->io_bp, zio);
+		ASSERT(zio->io_metaslab_class != NULL);
 		VERIFY(refcount_not_held(
-				&(spa_normal_class(zio->io_spa)->mc_alloc_slots), zio));
+		    &zio->io_metaslab_class->mc_alloc_slots, zio));
 	}
 
 	for (c = 0; c < ZIO_CHILD_TYPES; c++)
@@ -4125,6 +4243,7 @@ zio_done(zio_t *zio)
 		 */
 #ifndef __OPPLE__
 		if (zio->io_error != ECKSUM && zio->io_vd != NULL &&
+			zio->io_type != ZIO_TYPE_TRIM &&
 			!vdev_is_dead(zio->io_vd))
 			zfs_ereport_post(FM_EREPORT_ZFS_IO, zio->io_spa,
 			    zio->io_vd, &zio->io_bookmark, zio, 0, 0);
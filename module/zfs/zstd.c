@@ -0,0 +1,250 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Zstandard compression for ZFS.
+ *
+ * Every compressed block starts with a zfs_zstd_header_t holding the exact
+ * length of the zstd frame that follows and the level it was compressed
+ * with. The frame length is needed because the physical block is padded
+ * out to the sector size, and zstd rejects trailing data after a frame.
+ * Both fields are stored big endian.
+ *
+ * Compression and decompression contexts are expensive to set up, so a
+ * small pool of each is kept around and reused; a private context is
+ * created only if every pooled one is busy.
+ *
+ * The zstd library is the copy in module/zstd, built into both the kext
+ * and libzpool.
+ */
+
+#define	ZSTD_STATIC_LINKING_ONLY
+#include <sys/zfs_context.h>
+#include <sys/zio_compress.h>
+#include <sys/byteorder.h>
+#include <zstd.h>
+
+typedef struct zfs_zstd_header {
+	uint32_t	zh_c_len;	/* length of zh_data */
+	int32_t		zh_level;	/* level zh_data was compressed with */
+	char		zh_data[];
+} zfs_zstd_header_t;
+
+typedef struct zstd_pool {
+	kmutex_t	zp_lock;
+	void		*zp_ctx;
+} zstd_pool_t;
+
+static zstd_pool_t *zstd_cctx_pool;
+static zstd_pool_t *zstd_dctx_pool;
+static int zstd_pool_count;
+
+/*
+ * zstd allocates through these, so that its memory is accounted to and
+ * released by the kernel allocator. The size of each allocation is kept
+ * in front of the buffer handed to zstd. Compression can always fall back
+ * to storing the block uncompressed, so it does not wait for memory.
+ */
+static void *
+zstd_alloc(void *opaque, size_t size)
+{
+	size_t *p = kmem_alloc(size + sizeof (size_t),
+	    (int)(uintptr_t)opaque);
+
+	if (p == NULL)
+		return (NULL);
+	p[0] = size + sizeof (size_t);
+	return (p + 1);
+}
+
+static void
+zstd_free(void *opaque, void *ptr)
+{
+	size_t *p = ptr;
+
+	if (p == NULL)
+		return;
+	p--;
+	kmem_free(p, p[0]);
+}
+
+static const ZSTD_customMem zstd_cmem_nosleep = {
+	zstd_alloc, zstd_free, (void *)(uintptr_t)KM_NOSLEEP
+};
+
+static const ZSTD_customMem zstd_cmem_sleep = {
+	zstd_alloc, zstd_free, (void *)(uintptr_t)KM_SLEEP
+};
+
+static void *
+zstd_ctx_create(boolean_t compress)
+{
+	if (compress)
+		return (ZSTD_createCCtx_advanced(zstd_cmem_nosleep));
+	return (ZSTD_createDCtx_advanced(zstd_cmem_sleep));
+}
+
+static void
+zstd_ctx_destroy(boolean_t compress, void *ctx)
+{
+	if (ctx == NULL)
+		return;
+	if (compress)
+		(void) ZSTD_freeCCtx(ctx);
+	else
+		(void) ZSTD_freeDCtx(ctx);
+}
+
+/*
+ * Return a locked pool entry with a context, or NULL if all are busy.
+ */
+static zstd_pool_t *
+zstd_pool_get(zstd_pool_t *pool, boolean_t compress)
+{
+	int i;
+
+	for (i = 0; i < zstd_pool_count; i++) {
+		zstd_pool_t *zp = &pool[i];
+
+		if (!mutex_tryenter(&zp->zp_lock))
+			continue;
+		if (zp->zp_ctx == NULL)
+			zp->zp_ctx = zstd_ctx_create(compress);
+		if (zp->zp_ctx != NULL)
+			return (zp);
+		mutex_exit(&zp->zp_lock);
+	}
+
+	return (NULL);
+}
+
+/*ARGSUSED*/
+size_t
+zstd_compress(void *s_start, void *d_start, size_t s_len, size_t d_len,
+    int level)
+{
+	zfs_zstd_header_t *hdr = d_start;
+	zstd_pool_t *zp;
+	void *cctx;
+	size_t c_len;
+
+	ASSERT(d_len <= s_len);
+	ASSERT3S(level, !=, 0);
+
+	/* There must be room for the header and at least some data */
+	if (d_len <= sizeof (*hdr))
+		return (s_len);
+
+	zp = zstd_pool_get(zstd_cctx_pool, B_TRUE);
+	cctx = (zp != NULL) ? zp->zp_ctx : zstd_ctx_create(B_TRUE);
+	if (cctx == NULL)
+		return (s_len);
+
+	c_len = ZSTD_compressCCtx(cctx, hdr->zh_data, d_len - sizeof (*hdr),
+	    s_start, s_len, level);
+
+	if (zp != NULL)
+		mutex_exit(&zp->zp_lock);
+	else
+		zstd_ctx_destroy(B_TRUE, cctx);
+
+	/* Also covers output that did not fit in d_len */
+	if (ZSTD_isError(c_len))
+		return (s_len);
+
+	hdr->zh_c_len = BE_32(c_len);
+	hdr->zh_level = BE_32(level);
+
+	return (c_len + sizeof (*hdr));
+}
+
+/*ARGSUSED*/
+int
+zstd_decompress(void *s_start, void *d_start, size_t s_len, size_t d_len,
+    int level)
+{
+	const zfs_zstd_header_t *hdr = s_start;
+	zstd_pool_t *zp;
+	void *dctx;
+	size_t c_len, ret;
+
+	if (s_len < sizeof (*hdr))
+		return (-1);
+
+	c_len = BE_32(hdr->zh_c_len);
+	if (c_len > s_len - sizeof (*hdr))
+		return (-1);
+
+	zp = zstd_pool_get(zstd_dctx_pool, B_FALSE);
+	dctx = (zp != NULL) ? zp->zp_ctx : zstd_ctx_create(B_FALSE);
+	if (dctx == NULL)
+		return (-1);
+
+	ret = ZSTD_decompressDCtx(dctx, d_start, d_len, hdr->zh_data, c_len);
+
+	if (zp != NULL)
+		mutex_exit(&zp->zp_lock);
+	else
+		zstd_ctx_destroy(B_FALSE, dctx);
+
+	if (ZSTD_isError(ret))
+		return (-1);
+
+	return (0);
+}
+
+void
+zstd_init(void)
+{
+	int i;
+
+	zstd_pool_count = MAX(4, max_ncpus);
+	zstd_cctx_pool = kmem_zalloc(zstd_pool_count * sizeof (zstd_pool_t),
+	    KM_SLEEP);
+	zstd_dctx_pool = kmem_zalloc(zstd_pool_count * sizeof (zstd_pool_t),
+	    KM_SLEEP);
+
+	for (i = 0; i < zstd_pool_count; i++) {
+		mutex_init(&zstd_cctx_pool[i].zp_lock, NULL, MUTEX_DEFAULT,
+		    NULL);
+		mutex_init(&zstd_dctx_pool[i].zp_lock, NULL, MUTEX_DEFAULT,
+		    NULL);
+	}
+}
+
+void
+zstd_fini(void)
+{
+	int i;
+
+	for (i = 0; i < zstd_pool_count; i++) {
+		zstd_ctx_destroy(B_TRUE, zstd_cctx_pool[i].zp_ctx);
+		zstd_ctx_destroy(B_FALSE, zstd_dctx_pool[i].zp_ctx);
+		mutex_destroy(&zstd_cctx_pool[i].zp_lock);
+		mutex_destroy(&zstd_dctx_pool[i].zp_lock);
+	}
+
+	kmem_free(zstd_cctx_pool, zstd_pool_count * sizeof (zstd_pool_t));
+	kmem_free(zstd_dctx_pool, zstd_pool_count * sizeof (zstd_pool_t));
+	zstd_cctx_pool = NULL;
+	zstd_dctx_pool = NULL;
+	zstd_pool_count = 0;
+}
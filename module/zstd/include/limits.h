@@ -0,0 +1,43 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * <limits.h> for zstd in the kernel, see zstd_lib.c.
+ */
+
+#ifndef	_ZSTD_LIMITS_H
+#define	_ZSTD_LIMITS_H
+
+#define	CHAR_BIT	__CHAR_BIT__
+
+#define	INT_MAX		__INT_MAX__
+#define	INT_MIN		(-INT_MAX - 1)
+#define	UINT_MAX	(INT_MAX * 2U + 1U)
+
+#define	LONG_MAX	__LONG_MAX__
+#define	LONG_MIN	(-LONG_MAX - 1L)
+#define	ULONG_MAX	(LONG_MAX * 2UL + 1UL)
+
+#define	LLONG_MAX	__LONG_LONG_MAX__
+#define	LLONG_MIN	(-LLONG_MAX - 1LL)
+#define	ULLONG_MAX	(LLONG_MAX * 2ULL + 1ULL)
+
+#endif	/* _ZSTD_LIMITS_H */
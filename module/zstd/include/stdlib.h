@@ -0,0 +1,38 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * <stdlib.h> for zstd in the kernel, see zstd_lib.c.  zstd only wants
+ * malloc(), calloc() and free() from it, for its default allocator.  zfs
+ * always passes its own allocator, so these fail rather than having a
+ * context come from an allocator the kmem accounting doesn't see.
+ */
+
+#ifndef	_ZSTD_STDLIB_H
+#define	_ZSTD_STDLIB_H
+
+#include <stddef.h>
+
+#define	malloc(size)		((void)(size), NULL)
+#define	calloc(nmemb, size)	((void)(nmemb), (void)(size), NULL)
+#define	free(ptr)		((void)(ptr))
+
+#endif	/* _ZSTD_STDLIB_H */
@@ -0,0 +1,82 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * The zstd library, built as a single translation unit for both the kext
+ * and libzpool, the same way zstd's own single file build does it.
+ *
+ * lib/ is an unmodified copy of the common, compress and decompress parts
+ * of zstd 1.5.7 (BSD license, see lib/LICENSE); the dictionary builder,
+ * the legacy formats, multithreading and the assembly decoder are left
+ * out.  To update it, copy those directories and zstd.h and
+ * zstd_errors.h over lib/ and check that the list below is still
+ * complete.
+ *
+ * In the kernel there's no libc, so include/ supplies the few libc
+ * headers zstd includes.  zstd's default allocator fails there; zstd.c
+ * creates every context with its own kmem based allocator.  zstd's x86
+ * intrinsics and the dynamic BMI2 code are disabled as well, since
+ * kernel code mustn't touch the vector registers without saving them.
+ */
+
+#define	DEBUGLEVEL		0
+#define	MEM_MODULE
+#undef	XXH_NAMESPACE
+#define	XXH_NAMESPACE		ZSTD_
+#undef	XXH_PRIVATE_API
+#define	XXH_PRIVATE_API
+#undef	XXH_INLINE_ALL
+#define	XXH_INLINE_ALL
+#define	ZSTD_LEGACY_SUPPORT	0
+#define	ZSTD_TRACE		0
+#define	ZSTD_DISABLE_ASM	1
+#define	ZSTD_STRIP_ERROR_STRINGS
+
+#ifdef _KERNEL
+#define	ZSTD_NO_INTRINSICS
+#define	DYNAMIC_BMI2		0
+#endif
+
+#include "lib/common/debug.c"
+#include "lib/common/entropy_common.c"
+#include "lib/common/error_private.c"
+#include "lib/common/fse_decompress.c"
+#include "lib/common/xxhash.c"
+#include "lib/common/zstd_common.c"
+
+#include "lib/compress/fse_compress.c"
+#include "lib/compress/hist.c"
+#include "lib/compress/huf_compress.c"
+#include "lib/compress/zstd_compress_literals.c"
+#include "lib/compress/zstd_compress_sequences.c"
+#include "lib/compress/zstd_compress_superblock.c"
+#include "lib/compress/zstd_compress.c"
+#include "lib/compress/zstd_double_fast.c"
+#include "lib/compress/zstd_fast.c"
+#include "lib/compress/zstd_lazy.c"
+#include "lib/compress/zstd_ldm.c"
+#include "lib/compress/zstd_opt.c"
+#include "lib/compress/zstd_preSplit.c"
+
+#include "lib/decompress/huf_decompress.c"
+#include "lib/decompress/zstd_ddict.c"
+#include "lib/decompress/zstd_decompress.c"
+#include "lib/decompress/zstd_decompress_block.c"
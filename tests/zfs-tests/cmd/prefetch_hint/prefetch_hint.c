@@ -0,0 +1,90 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+
+/*
+ * Ask ZFS to read part or all of a file into the ARC with lzc_prefetch(),
+ * and print the number of bytes for which reads were issued.  On failure,
+ * the exit status is the error returned by the ioctl.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libzfs_core.h>
+
+static void
+usage(const char *prog)
+{
+	(void) fprintf(stderr, "Usage: %s [-ds] [-b budget] [-o offset] "
+	    "[-l length] dataset file\n", prog);
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	enum lzc_prefetch_flags flags = 0;
+	uint64_t budget = 0, offset = 0, length = 0, issued;
+	struct stat st;
+	int c, error;
+
+	while ((c = getopt(argc, argv, "b:dl:o:s")) != -1) {
+		switch (c) {
+		case 'b':
+			budget = strtoull(optarg, NULL, 0);
+			break;
+		case 'd':
+			flags |= LZC_PREFETCH_FLAG_DROPBEHIND;
+			break;
+		case 'l':
+			length = strtoull(optarg, NULL, 0);
+			break;
+		case 'o':
+			offset = strtoull(optarg, NULL, 0);
+			break;
+		case 's':
+			flags |= LZC_PREFETCH_FLAG_SYNC;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2)
+		usage(argv[0]);
+
+	/* a ZPL file's inode number is its object number */
+	if (stat(argv[optind + 1], &st) != 0) {
+		(void) printf("stat %s failed %d\n", argv[optind + 1], errno);
+		exit(1);
+	}
+
+	if (libzfs_core_init() != 0) {
+		(void) printf("libzfs_core_init failed %d\n", errno);
+		exit(1);
+	}
+	error = lzc_prefetch(argv[optind], st.st_ino, offset, length, budget,
+	    flags, &issued);
+	libzfs_core_fini();
+
+	if (error != 0) {
+		(void) printf("prefetch %s failed: %s\n", argv[optind + 1],
+		    strerror(error));
+		exit(error);
+	}
+	(void) printf("%llu\n", (unsigned long long)issued);
+
+	return (0);
+}